@@ -0,0 +1,31 @@
+/*
+ * Fuzzing Harness for DSV4L2 Event Log Reader
+ *
+ * Parses arbitrary bytes as a file-sink event log, as done when
+ * importing logs from untrusted or damaged media.
+ *
+ * Run fuzzing:
+ *   make fuzz-run FUZZ_TARGET=event_log
+ */
+
+#include "dsv4l2rt.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    dsv4l2_event_t *events = NULL;
+    size_t count = 0;
+
+    if (dsv4l2rt_parse_event_log(data, size, &events, &count) == 0) {
+        for (size_t i = 0; i < count; i++) {
+            volatile size_t n = strlen(events[i].role) +
+                                strlen(events[i].mission);
+            (void)n;
+        }
+        free(events);
+    }
+
+    return 0;
+}
@@ -0,0 +1,29 @@
+/*
+ * Fuzzing Harness for DSV4L2 Device Profile Parser
+ *
+ * Feeds arbitrary text through dsv4l2_parse_profile(), the same
+ * key/value parser used for the YAML files under profiles/.
+ *
+ * Run fuzzing:
+ *   make fuzz-run FUZZ_TARGET=profile_parser
+ */
+
+#include "dsv4l2_profiles.h"
+#include <stdint.h>
+#include <string.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    dsv4l2_device_profile_t profile;
+
+    if (dsv4l2_parse_profile((const char *)data, size, &profile) == 0) {
+        /* Every string field must come back terminated */
+        volatile size_t n = strlen(profile.id) + strlen(profile.vendor) +
+                            strlen(profile.model) + strlen(profile.role) +
+                            strlen(profile.classification) +
+                            strlen(profile.pixel_format);
+        (void)n;
+    }
+
+    return 0;
+}
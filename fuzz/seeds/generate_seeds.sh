@@ -47,3 +47,51 @@ echo "  Created klv_large.bin (275 bytes - 256-byte payload)"
 echo ""
 echo "Seed corpus generated with 6 files"
 echo "Total size: $(du -sh . | cut -f1)"
+
+# ------------------------------------------------------------------------
+# Corpora for the other in-process harnesses (fuzz/corpus/<target>)
+# ------------------------------------------------------------------------
+CORPUS=../corpus
+
+echo ""
+echo "Generating profile parser corpus..."
+mkdir -p "$CORPUS/profile_parser"
+cp ../../profiles/*.yaml "$CORPUS/profile_parser/"
+printf 'id: "x"\nrole: camera\ntempest_ctrl_id: 0x9a0902\n' > "$CORPUS/profile_parser/minimal.yaml"
+echo "  Copied $(ls ../../profiles/*.yaml | wc -l) device profiles + minimal.yaml"
+
+echo "Generating IR decode corpus..."
+mkdir -p "$CORPUS/ir_decode"
+# Header: u16 width, u16 height, f32 c1, f32 c2 (little-endian), then u16 pixels
+python3 - "$CORPUS/ir_decode" <<'PYEOF'
+import struct, sys
+out = sys.argv[1]
+def seed(name, w, h, c1, c2, pixels):
+    with open(f"{out}/{name}", "wb") as f:
+        f.write(struct.pack("<HHff", w, h, c1, c2))
+        f.write(struct.pack(f"<{len(pixels)}H", *pixels))
+seed("ir_4x4.bin", 4, 4, 0.01, 273.15, [i * 4096 for i in range(16)])
+seed("ir_1x1.bin", 1, 1, 1.0, 0.0, [300])
+seed("ir_clamp.bin", 2, 2, -1.0, 1e6, [0, 1, 0xFFFF, 0x8000])
+PYEOF
+echo "  Created 3 IR frames"
+
+echo "Generating event log corpus..."
+mkdir -p "$CORPUS/event_log"
+# Record layout mirrors dsv4l2_event_t (72 bytes)
+python3 - "$CORPUS/event_log" <<'PYEOF'
+import struct, sys
+out = sys.argv[1]
+def event(ts, dev, etype, sev, aux, layer, role, mission):
+    return struct.pack("<QIHHII16s32s", ts, dev, etype, sev, aux, layer,
+                       role.encode(), mission.encode())
+with open(f"{out}/log_single.bin", "wb") as f:
+    f.write(event(1000, 0x12345678, 0x0001, 1, 0, 3, "camera", "dev"))
+with open(f"{out}/log_capture.bin", "wb") as f:
+    for i in range(8):
+        f.write(event(1000 + i, 0xCAFEBABE, 0x0012, 0, 4096 * i, 3,
+                      "iris_scanner", "exercise"))
+    f.write(event(2000, 0xCAFEBABE, 0x0020, 4, (1 << 16) | 3, 3,
+                  "iris_scanner", "exercise"))
+PYEOF
+echo "  Created 2 event logs"
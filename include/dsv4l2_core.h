@@ -135,6 +135,134 @@ int dsv4l2_get_buffer(dsv4l2_device_t *dev, uint32_t index,
  */
 void dsv4l2_release_buffers(dsv4l2_device_t *dev);
 
+/* ========================================================================
+ * Buffer Lifecycle Statistics
+ * ======================================================================== */
+
+/* Buffers tracked per device (matches the kernel's VIDEO_MAX_FRAME) */
+#define DSV4L2_MAX_BUFFERS 32
+
+/**
+ * Buffer ownership
+ */
+typedef enum {
+    DSV4L2_BUFFER_IDLE     = 0,  /* Mapped, never queued (or returned by STREAMOFF) */
+    DSV4L2_BUFFER_QUEUED   = 1,  /* Owned by the driver */
+    DSV4L2_BUFFER_DEQUEUED = 2,  /* Held by the application */
+} dsv4l2_buffer_state_t;
+
+/**
+ * Lifecycle counters for one buffer index
+ */
+typedef struct {
+    dsv4l2_buffer_state_t state;
+    uint64_t cycles;             /* Completed QBUF -> DQBUF round trips */
+    uint64_t driver_ns_total;    /* Time queued in the driver (QBUF -> DQBUF) */
+    uint64_t driver_ns_max;
+    uint64_t app_ns_total;       /* Time held by the application (DQBUF -> QBUF) */
+    uint64_t app_ns_max;
+    uint64_t age_ns;             /* Time spent in the current state so far */
+} dsv4l2_buffer_stats_t;
+
+/**
+ * Queue statistics for a device
+ *
+ * depth_hist[n] counts the DQBUFs that left n buffers queued in the
+ * driver (the last bin also counts deeper queues). A histogram heavy at
+ * 0 means the driver keeps running dry: either the application holds
+ * buffers too long (see app_ns) or more buffers are needed.
+ */
+typedef struct {
+    uint32_t buffer_count;       /* Buffers allocated (may exceed DSV4L2_MAX_BUFFERS) */
+    uint32_t queued;             /* Currently owned by the driver */
+    uint64_t dequeues;           /* Successful DQBUFs */
+    uint64_t depth_hist[DSV4L2_MAX_BUFFERS];
+    uint64_t starved_gaps;       /* Sequence gaps with no buffer left queued */
+    uint32_t buffers_added;      /* Buffers added live by VIDIOC_CREATE_BUFS */
+    uint32_t buffer_target;      /* Count the next dsv4l2_request_buffers() will use */
+    dsv4l2_buffer_stats_t buffers[DSV4L2_MAX_BUFFERS];
+} dsv4l2_queue_stats_t;
+
+/**
+ * Snapshot buffer lifecycle statistics
+ *
+ * Counters are updated lock-free on the QBUF/DQBUF path, so a snapshot
+ * taken while streaming is approximate.
+ */
+int dsv4l2_get_buffer_stats(dsv4l2_device_t *dev, dsv4l2_queue_stats_t *stats);
+
+/**
+ * Adaptive buffer count
+ *
+ * When frames are dropped in the driver (buf.sequence gaps) while no
+ * buffer was left queued, the application is starving the driver. After
+ * a sustained run of such drops the buffer count is grown, either on the
+ * next dsv4l2_request_buffers() or immediately with VIDIOC_CREATE_BUFS.
+ * Drops with buffers still queued (sensor or bus limits) never grow it.
+ */
+typedef enum {
+    DSV4L2_BUFFER_GROW_OFF        = 0,  /* Fixed buffer count (default) */
+    DSV4L2_BUFFER_GROW_ON_RESTART = 1,  /* Raise the count used by the next REQBUFS */
+    DSV4L2_BUFFER_GROW_LIVE       = 2,  /* Add buffers while streaming (CREATE_BUFS) */
+} dsv4l2_buffer_grow_t;
+
+/**
+ * Configure adaptive buffer growth
+ *
+ * @param max_buffers Upper bound (0 = DSV4L2_MAX_BUFFERS)
+ */
+int dsv4l2_set_buffer_growth(dsv4l2_device_t *dev, dsv4l2_buffer_grow_t mode,
+                             uint32_t max_buffers);
+
+/* ========================================================================
+ * Capture Statistics
+ * ======================================================================== */
+
+/*
+ * Histogram bins are log2 microseconds: bin 0 counts values below 1 µs,
+ * bin n (n >= 1) counts [2^(n-1), 2^n) µs. The last bin also counts
+ * everything larger (~4 s and up).
+ */
+#define DSV4L2_STATS_HIST_BINS 24
+
+/**
+ * Per-device capture statistics
+ *
+ * Updated on every successful DQBUF. Sequence gaps come from
+ * v4l2_buffer.sequence and therefore count frames the driver dropped
+ * (typically because no buffer was queued), not failed ioctls.
+ */
+typedef struct {
+    uint64_t frames;             /* Frames dequeued */
+    uint64_t bytes;              /* Sum of bytesused */
+    uint64_t error_frames;       /* Frames flagged V4L2_BUF_FLAG_ERROR */
+    uint64_t sequence_gaps;      /* Discontinuities in buf.sequence */
+    uint64_t frames_lost;        /* Sequence numbers skipped by the driver */
+    uint32_t last_sequence;      /* Most recent buf.sequence */
+    uint64_t interval_ns;        /* Smoothed inter-frame interval */
+    double   fps;                /* 1e9 / interval_ns (0 until two frames) */
+    uint64_t jitter_hist[DSV4L2_STATS_HIST_BINS];   /* |interval - previous interval| */
+    uint64_t latency_hist[DSV4L2_STATS_HIST_BINS];  /* Driver timestamp -> DQBUF return */
+} dsv4l2_device_stats_t;
+
+/**
+ * Snapshot capture statistics for a device
+ */
+int dsv4l2_get_device_stats(dsv4l2_device_t *dev, dsv4l2_device_stats_t *stats);
+
+/**
+ * Reset capture statistics for a device
+ */
+void dsv4l2_reset_device_stats(dsv4l2_device_t *dev);
+
+/**
+ * Approximate percentile (0-100) of a statistics histogram, in µs
+ *
+ * Returns the upper bound of the bin holding the percentile, or 0 if the
+ * histogram is empty.
+ */
+uint64_t dsv4l2_stats_percentile_us(const uint64_t *hist, double percentile);
+
 /* ========================================================================
  * Capture Operations
  * ======================================================================== */
@@ -149,6 +277,56 @@ int dsv4l2_start_streaming(dsv4l2_device_t *dev);
  */
 int dsv4l2_stop_streaming(dsv4l2_device_t *dev);
 
+/*
+ * dsv4l2_capture_frame_timeout() (dsv4l2_policy.h) waits up to
+ * timeout_ms for a frame instead of returning -EAGAIN at once.
+ */
+
+/* ========================================================================
+ * Stall Watchdog
+ * ======================================================================== */
+
+/**
+ * Stall watchdog configuration
+ *
+ * A stream has stalled when no frame arrived for stall_intervals frame
+ * intervals (at least min_stall_ms) while buffers were queued. The
+ * watchdog runs inside the waiting capture call, so recovery happens on
+ * the thread that owns the stream: first STREAMOFF/requeue/STREAMON,
+ * then, after `restarts` failed attempts, a full close and reopen of the
+ * device node (only while the application holds no buffers). Buffers
+ * may be returned from other threads meanwhile: each recovery attempt
+ * is serialized against dsv4l2_queue_buffer() by a per-device lock.
+ */
+typedef struct {
+    uint32_t stall_intervals;    /* 0 = 10 */
+    uint32_t min_stall_ms;       /* 0 = 1000 */
+    uint32_t restarts;           /* Stream restarts before reopening (0 = 2) */
+} dsv4l2_watchdog_config_t;
+
+/**
+ * Stall watchdog counters
+ */
+typedef struct {
+    uint64_t stalls;             /* Stalls detected */
+    uint64_t restarts;           /* STREAMOFF/STREAMON recoveries attempted */
+    uint64_t reopens;            /* Close/reopen recoveries attempted */
+    uint64_t failures;           /* Recovery attempts that failed outright */
+    uint64_t last_downtime_ms;   /* Last frame before the stall -> first frame after */
+    uint64_t total_downtime_ms;
+    int      stalled;            /* Currently stalled */
+} dsv4l2_watchdog_stats_t;
+
+/**
+ * Enable (cfg != NULL) or disable (cfg == NULL) the stall watchdog
+ */
+int dsv4l2_set_watchdog(dsv4l2_device_t *dev, const dsv4l2_watchdog_config_t *cfg);
+
+/**
+ * Snapshot stall watchdog counters
+ */
+int dsv4l2_get_watchdog_stats(dsv4l2_device_t *dev, dsv4l2_watchdog_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
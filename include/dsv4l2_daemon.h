@@ -0,0 +1,165 @@
+/*
+ * DSV4L2 Capture Daemon
+ *
+ * dsv4l2d opens and owns every camera on the node, applies profiles,
+ * THREATCON and TEMPEST policy in one place, and serves frames to local
+ * clients. Device setup (format negotiation, REQBUFS, mmap) happens once
+ * when the daemon starts, so a client is streaming as soon as it has
+ * attached to a ring.
+ *
+ * Control plane: a Unix SOCK_SEQPACKET socket. The daemon identifies
+ * each client with SO_PEERCRED and checks its clearance against the
+ * device role and classification before handing out anything.
+ *
+ * Data plane: each device publishes into a private shared-memory ring
+ * (dsv4l2_ring.h). Its memfd is passed to a cleared client with
+ * SCM_RIGHTS; it is never reachable by name.
+ *
+ * The server half is a library so it can be embedded or tested without
+ * hardware; bin/dsv4l2d is a thin wrapper around it.
+ */
+
+#ifndef DSV4L2_DAEMON_H
+#define DSV4L2_DAEMON_H
+
+#include "dsv4l2_core.h"
+#include "dsv4l2_dsmil.h"
+#include "dsv4l2_ring.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Default control socket (override with DSV4L2D_SOCKET) */
+#define DSV4L2D_SOCKET_PATH "/run/dsv4l2d.sock"
+
+/* Devices served by one daemon */
+#define DSV4L2D_MAX_DEVICES 16
+
+/* Device id length, including the terminator */
+#define DSV4L2D_ID_MAX 32
+
+/**
+ * Device as seen by a client
+ */
+typedef struct {
+    char     id[DSV4L2D_ID_MAX];
+    char     role[32];
+    char     classification[32];
+    uint32_t layer;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelformat;
+    uint64_t frames;             /* Published so far */
+    int      allowed;            /* Caller's clearance permits subscribing */
+} dsv4l2d_device_info_t;
+
+/**
+ * Daemon status
+ */
+typedef struct {
+    dsmil_threatcon_t threatcon;
+    uint32_t devices;
+    uint32_t clients;
+    char     clearance[32];      /* Clearance the daemon resolved for the caller */
+} dsv4l2d_status_t;
+
+/* ========================================================================
+ * Server
+ * ======================================================================== */
+
+typedef struct dsv4l2d_server dsv4l2d_server_t;
+
+/**
+ * Create a server bound to socket_path (NULL = DSV4L2D_SOCKET_PATH)
+ */
+int dsv4l2d_server_create(const char *socket_path, dsv4l2d_server_t **out);
+
+/**
+ * Take ownership of an open device: negotiate buffers, create its ring
+ * and capture into it once the server is started
+ *
+ * @param buffers V4L2 buffers to request (0 = 4)
+ */
+int dsv4l2d_server_add_device(dsv4l2d_server_t *srv, const char *id,
+                              dsv4l2_device_t *dev, uint32_t buffers);
+
+/**
+ * Serve a ring fed by the caller (synthetic or pre-processed sources)
+ *
+ * The ring must be private (created with a NULL name) and outlive the
+ * server.
+ */
+int dsv4l2d_server_add_source(dsv4l2d_server_t *srv, const char *id,
+                              const char *role, const char *classification,
+                              dsv4l2_ring_pub_t *ring, const dsv4l2_ring_config_t *cfg);
+
+/**
+ * Grant uid an explicit clearance ("SECRET", ...)
+ *
+ * Without one, root is TOP_SECRET and other users get the highest of
+ * their dsv4l2-unclassified / -confidential / -secret / -top-secret
+ * group memberships, or nothing.
+ */
+int dsv4l2d_server_set_clearance(dsv4l2d_server_t *srv, uid_t uid, const char *clearance);
+
+/**
+ * Start capture threads and the control loop
+ */
+int dsv4l2d_server_start(dsv4l2d_server_t *srv);
+
+/**
+ * Stop, close owned devices and remove the socket
+ */
+void dsv4l2d_server_destroy(dsv4l2d_server_t *srv);
+
+/* ========================================================================
+ * Client
+ * ======================================================================== */
+
+typedef struct dsv4l2d_client dsv4l2d_client_t;
+
+/**
+ * Connect to a daemon (NULL = $DSV4L2D_SOCKET or DSV4L2D_SOCKET_PATH)
+ */
+int dsv4l2d_connect(const char *socket_path, dsv4l2d_client_t **out);
+
+/**
+ * List devices
+ */
+int dsv4l2d_list(dsv4l2d_client_t *c, dsv4l2d_device_info_t *devices,
+                 size_t max, size_t *count);
+
+/**
+ * Attach to a device's frame ring
+ *
+ * @return 0 on success, -EPERM if the caller's clearance is too low,
+ *         -ENOENT for an unknown id
+ */
+int dsv4l2d_subscribe(dsv4l2d_client_t *c, const char *id,
+                      dsv4l2_ring_sub_t **out, dsv4l2d_device_info_t *info);
+
+/**
+ * Daemon status
+ */
+int dsv4l2d_status(dsv4l2d_client_t *c, dsv4l2d_status_t *status);
+
+/**
+ * Change THREATCON for every device (daemon owner or root only)
+ */
+int dsv4l2d_set_threatcon(dsv4l2d_client_t *c, dsmil_threatcon_t level);
+
+/**
+ * Close the connection (attached rings stay valid)
+ */
+void dsv4l2d_disconnect(dsv4l2d_client_t *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DSV4L2_DAEMON_H */
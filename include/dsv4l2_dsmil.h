@@ -67,6 +67,12 @@ int dsv4l2_check_capture_allowed(dsv4l2_device_t *dev, const char *context);
  */
 int dsv4l2_check_clearance(const char *role, const char *classification);
 
+/**
+ * Check clearance level for an explicit holder clearance
+ */
+int dsv4l2_check_clearance_as(const char *clearance, const char *role,
+                              const char *classification);
+
 /**
  * Get THREATCON name (for display/logging)
  */
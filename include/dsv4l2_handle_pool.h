@@ -0,0 +1,146 @@
+/*
+ * DSV4L2 Warm Device Handle Pool
+ *
+ * Opening a capture session costs open(), QUERYCAP, profile lookup,
+ * REQBUFS, QUERYBUF and mmap for every buffer and STREAMON, and closing
+ * it undoes all of that. For trigger-driven captures this setup is
+ * longer than the event window.
+ *
+ * The handle pool does the setup once. Each pooled handle stays open
+ * with its buffers mapped and queued; in DSV4L2_WARM_STREAMING mode it
+ * also keeps streaming, and a reaper thread discards frames while the
+ * handle is idle so the driver never runs dry. Clients check a handle
+ * out, capture as usual and check it back in.
+ *
+ * Each handle remembers the format and TEMPEST state it was warmed up
+ * with. A client may change either while it holds the handle; the next
+ * checkout restores them, but only if they actually changed, so the
+ * common checkout is a table lookup plus (when streaming) a flush of
+ * stale frames.
+ */
+
+#ifndef DSV4L2_HANDLE_POOL_H
+#define DSV4L2_HANDLE_POOL_H
+
+#include "dsv4l2_annotations.h"
+#include "dsv4l2_core.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Handles per pool */
+#define DSV4L2_HANDLE_POOL_MAX 32
+
+typedef struct dsv4l2_handle_pool dsv4l2_handle_pool_t;
+
+/**
+ * What an idle handle keeps running
+ */
+typedef enum {
+    DSV4L2_WARM_MAPPED    = 0,  /* Open, buffers mapped and queued; STREAMON at checkout */
+    DSV4L2_WARM_STREAMING = 1,  /* Streaming; idle frames are discarded */
+} dsv4l2_warm_mode_t;
+
+/**
+ * Handle configuration
+ *
+ * Zero width/height/pixelformat keep the driver's current value.
+ */
+typedef struct {
+    const char *path;            /* Device node */
+    const char *role;            /* Role for dsv4l2_open() */
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelformat;
+    uint32_t buffers;            /* 0 = 4 */
+    dsv4l2_warm_mode_t mode;
+} dsv4l2_warm_config_t;
+
+/**
+ * Pool counters
+ */
+typedef struct {
+    uint32_t handles;            /* Handles in the pool */
+    uint32_t checked_out;        /* Currently held by clients */
+    uint64_t checkouts;
+    uint64_t busy;               /* Checkouts refused because every match was held */
+    uint64_t format_resets;      /* Checkouts that had to restore the format */
+    uint64_t tempest_resets;     /* Checkouts that had to restore TEMPEST state */
+    uint64_t frames_discarded;   /* Frames dropped while idle */
+    uint64_t checkout_ns_max;    /* Slowest checkout */
+} dsv4l2_handle_pool_stats_t;
+
+/**
+ * Create an empty pool
+ *
+ * @param out Output pool
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_handle_pool_create(dsv4l2_handle_pool_t **out);
+
+/**
+ * Open, configure and warm up a device
+ *
+ * Runs the full setup (open, S_FMT, REQBUFS, mmap, QBUF and, for
+ * DSV4L2_WARM_STREAMING, STREAMON) now so checkouts do not have to.
+ * The same path may be added more than once only if the driver allows
+ * several streaming opens.
+ *
+ * @param pool Pool
+ * @param cfg Handle configuration
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_handle_pool_add(dsv4l2_handle_pool_t *pool, const dsv4l2_warm_config_t *cfg);
+
+/**
+ * Check out an idle handle
+ *
+ * The handle is streaming on return, with stale frames flushed, its
+ * warm-up format and TEMPEST state restored if a previous client changed
+ * them. Capture with the normal API (dsv4l2_capture_frame(), leases).
+ *
+ * @param pool Pool
+ * @param path Device node to match (NULL = any)
+ * @param role Role to match (NULL = any)
+ * @param out Output device handle
+ * @return 0 on success, -ENOENT if nothing matches, -EBUSY if every
+ *         match is checked out, other negative errno if the reset failed
+ */
+int dsv4l2_handle_checkout(dsv4l2_handle_pool_t *pool, const char *path,
+                           const char *role, dsv4l2_device_t **out);
+
+/**
+ * Return a handle to the pool
+ *
+ * Buffers the client still holds are queued back. In
+ * DSV4L2_WARM_MAPPED mode streaming is stopped.
+ *
+ * @param pool Pool
+ * @param dev Handle from dsv4l2_handle_checkout()
+ * @return 0 on success, -EINVAL if dev is not checked out from pool
+ */
+int dsv4l2_handle_checkin(dsv4l2_handle_pool_t *pool, dsv4l2_device_t *dev);
+
+/**
+ * Snapshot pool counters
+ */
+int dsv4l2_handle_pool_get_stats(dsv4l2_handle_pool_t *pool,
+                                 dsv4l2_handle_pool_stats_t *stats);
+
+/**
+ * Stop, unmap and close every handle
+ *
+ * Handles still checked out are closed too; callers must not use them
+ * afterwards.
+ */
+void dsv4l2_handle_pool_destroy(dsv4l2_handle_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DSV4L2_HANDLE_POOL_H */
@@ -0,0 +1,811 @@
+/*
+ * DSV4L2 Imaging Stages
+ *
+ * Per-frame image analysis and processing that runs as pipeline stages
+ * (see dsv4l2_pipeline.h). Kernels have scalar, SSE2 and AVX2 versions;
+ * the best one the CPU supports is picked at first use.
+ */
+
+#ifndef DSV4L2_IMAGING_H
+#define DSV4L2_IMAGING_H
+
+#include "dsv4l2_annotations.h"
+#include "dsv4l2_pipeline.h"
+#include "dsv4l2_ring.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========================================================================
+ * Frame Layout and Kernel Selection
+ * ======================================================================== */
+
+/**
+ * Frame layout
+ *
+ * Supported pixel formats: V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12,
+ * V4L2_PIX_FMT_GREY and V4L2_PIX_FMT_RGB24.
+ */
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelformat;
+    uint32_t stride;             /* Bytes per line of the first plane (0 = packed) */
+} dsv4l2_image_format_t;
+
+/**
+ * Kernel implementation level
+ */
+typedef enum {
+    DSV4L2_SIMD_SCALAR = 0,
+    DSV4L2_SIMD_SSE2   = 1,
+    DSV4L2_SIMD_AVX2   = 2,
+} dsv4l2_simd_level_t;
+
+/**
+ * Kernel level in use
+ *
+ * Defaults to the best the CPU supports; DSV4L2_SIMD=scalar|sse2|avx2
+ * in the environment caps it.
+ */
+dsv4l2_simd_level_t dsv4l2_simd_level(void);
+
+/**
+ * Cap the kernel level (benchmarks and tests)
+ *
+ * @return Level actually in use (never above what the CPU supports)
+ */
+dsv4l2_simd_level_t dsv4l2_simd_set_level(dsv4l2_simd_level_t level);
+
+/**
+ * Bytes a frame in this layout occupies (0 for unsupported formats)
+ */
+size_t dsv4l2_image_size(const dsv4l2_image_format_t *fmt);
+
+/* ========================================================================
+ * Change Detection
+ * ======================================================================== */
+
+/*
+ * Luma is box-downsampled by `factor` and compared against a running
+ * background (exponential average) in blocks of 8x8 downsampled pixels,
+ * i.e. 8*factor full-resolution pixels square. A block has changed when
+ * its mean absolute difference exceeds `threshold` luma levels.
+ */
+
+typedef struct dsv4l2_change_detector dsv4l2_change_detector_t;
+
+/* Largest block grid (bitmap size); raise factor for bigger frames */
+#define DSV4L2_CHANGE_MAX_BLOCKS 8192
+
+/**
+ * Change detector configuration
+ */
+typedef struct {
+    dsv4l2_image_format_t format;
+    uint32_t factor;             /* Downsampling: 1, 2, 4 or 8 (0 = 4) */
+    uint32_t threshold;          /* Mean abs difference per pixel, luma levels (0 = 12) */
+    uint32_t learn_shift;        /* Background learning rate 1/2^n (0 = 4) */
+    uint32_t min_blocks;         /* Changed blocks for a frame to count as changed (0 = 1) */
+
+    /* Stage behaviour */
+    int      skip_static;        /* Drop (DSV4L2_STAGE_SKIP) static frames */
+    uint32_t keep_every;         /* ... except every Nth in a static run (0 = drop all) */
+} dsv4l2_change_config_t;
+
+/**
+ * Per-frame result
+ *
+ * Bit (row * cols + col) of bitmap is set for each changed block.
+ */
+typedef struct {
+    float    score;              /* Changed blocks / blocks (0..1) */
+    uint32_t changed;
+    uint32_t blocks;
+    uint32_t cols;
+    uint32_t rows;
+    uint32_t mean_diff;          /* Mean abs difference over the frame, luma levels */
+    uint64_t bitmap[DSV4L2_CHANGE_MAX_BLOCKS / 64];
+} dsv4l2_change_result_t;
+
+/**
+ * Create a change detector
+ *
+ * @return 0 on success, -E2BIG if the block grid exceeds
+ *         DSV4L2_CHANGE_MAX_BLOCKS, other negative errno on error
+ */
+int dsv4l2_change_create(const dsv4l2_change_config_t *cfg,
+                         dsv4l2_change_detector_t **out);
+
+/**
+ * Analyse one frame and update the background
+ *
+ * The first frame (and the first after a reset) reports every block as
+ * changed.
+ */
+int dsv4l2_change_analyze(dsv4l2_change_detector_t *det, const uint8_t *data,
+                          size_t len, dsv4l2_change_result_t *result);
+
+/**
+ * Forget the background (e.g. after a camera move)
+ */
+void dsv4l2_change_reset(dsv4l2_change_detector_t *det);
+
+/**
+ * Pipeline stage (ctx = detector)
+ *
+ * Attaches a dsv4l2_change_result_t in DSV4L2_SLOT_CHANGE and tags the
+ * lease DSV4L2_TAG_CHANGED or DSV4L2_TAG_STATIC. Run it with
+ * parallelism 1: the background depends on frame order.
+ */
+int dsv4l2_change_stage(dsv4l2_lease_t *lease, void *ctx);
+
+/**
+ * Free a change detector
+ */
+void dsv4l2_change_destroy(dsv4l2_change_detector_t *det);
+
+/* ========================================================================
+ * Preview Pyramid
+ * ======================================================================== */
+
+/*
+ * 1/2, 1/4 and 1/8 scale images built in one pass over the frame: each
+ * half-scale row is reduced further as soon as its pair is complete, so
+ * the smaller levels come from cache. Every level is a 2x2 box filter
+ * of the one above; odd trailing rows and columns are dropped.
+ */
+
+/* Levels built: 1/2, 1/4, 1/8 */
+#define DSV4L2_PYRAMID_LEVELS 3
+
+/**
+ * Pyramid configuration
+ */
+typedef struct {
+    dsv4l2_image_format_t format;    /* Source frames */
+    uint32_t output;                 /* V4L2_PIX_FMT_GREY or V4L2_PIX_FMT_RGB24 (0 = GREY) */
+    uint32_t levels;                 /* 1 to DSV4L2_PYRAMID_LEVELS (0 = all) */
+} dsv4l2_pyramid_config_t;
+
+/**
+ * One level (packed lines)
+ */
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint8_t *data;
+} dsv4l2_pyramid_level_t;
+
+/**
+ * Built pyramid; one allocation, release with free()
+ */
+typedef struct {
+    uint32_t pixelformat;            /* GREY or RGB24 */
+    uint32_t levels;
+    dsv4l2_pyramid_level_t level[DSV4L2_PYRAMID_LEVELS];   /* [0] is 1/2 scale */
+} dsv4l2_pyramid_t;
+
+typedef struct dsv4l2_pyramid_builder dsv4l2_pyramid_builder_t;
+
+/**
+ * Create a pyramid builder
+ *
+ * @return 0 on success, -EINVAL for unsupported formats or frames too
+ *         small for the requested levels
+ */
+int dsv4l2_pyramid_create(const dsv4l2_pyramid_config_t *cfg,
+                          dsv4l2_pyramid_builder_t **out);
+
+/**
+ * Build a pyramid for one frame (thread-safe)
+ */
+int dsv4l2_pyramid_build(dsv4l2_pyramid_builder_t *pb, const uint8_t *data, size_t len,
+                         dsv4l2_pyramid_t **out);
+
+/**
+ * Pipeline stage (ctx = builder); attaches a dsv4l2_pyramid_t in
+ * DSV4L2_SLOT_PYRAMID. May run with any parallelism.
+ */
+int dsv4l2_pyramid_stage(dsv4l2_lease_t *lease, void *ctx);
+
+/**
+ * Free a pyramid builder
+ */
+void dsv4l2_pyramid_destroy(dsv4l2_pyramid_builder_t *pb);
+
+/**
+ * Preview publisher: copies one pyramid level into a frame ring
+ * (dsv4l2_ring.h), so preview consumers never map full-resolution
+ * frames. Create the ring with that level's geometry.
+ */
+typedef struct {
+    dsv4l2_ring_pub_t *ring;
+    uint32_t level;                  /* Index into dsv4l2_pyramid_t.level */
+} dsv4l2_preview_ring_t;
+
+/**
+ * Pipeline stage (ctx = dsv4l2_preview_ring_t); run after
+ * dsv4l2_pyramid_stage. Frames without a pyramid are passed on.
+ */
+int dsv4l2_preview_ring_stage(dsv4l2_lease_t *lease, void *ctx);
+
+/* ========================================================================
+ * Redaction
+ * ======================================================================== */
+
+/*
+ * Regions are redacted in place on the frame buffer. Chroma of
+ * subsampled formats (YUYV, NV12) is redacted over the covering chroma
+ * samples plus one sample of margin, so no chroma of a redacted pixel
+ * survives. Polygons are even-odd filled, sampled at pixel row centres.
+ */
+
+typedef struct dsv4l2_redactor dsv4l2_redactor_t;
+
+#define DSV4L2_REDACT_MAX_REGIONS  32
+#define DSV4L2_REDACT_MAX_VERTICES 16
+
+/**
+ * Redaction mode
+ */
+typedef enum {
+    DSV4L2_REDACT_FILL     = 0,  /* Solid colour */
+    DSV4L2_REDACT_PIXELATE = 1,  /* Cell averages; param = cell size (0 = 16) */
+    DSV4L2_REDACT_BLUR     = 2,  /* Separable box blur; param = radius, max 64 (0 = 8) */
+} dsv4l2_redact_mode_t;
+
+/**
+ * Region in frame pixels
+ */
+typedef struct {
+    dsv4l2_redact_mode_t mode;
+    uint32_t x;                  /* Rectangle (when vertices == 0) */
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    uint32_t vertices;           /* Polygon vertex count (3 or more; 0 = rectangle) */
+    struct {
+        int32_t x;
+        int32_t y;
+    } vertex[DSV4L2_REDACT_MAX_VERTICES];
+    uint32_t param;
+    uint8_t  color[3];           /* Fill colour, RGB (converted for YUV formats) */
+} dsv4l2_redact_region_t;
+
+/**
+ * Per-frame regions (e.g. from metadata or a detector), attached in
+ * DSV4L2_SLOT_REDACT ahead of the redaction stage
+ */
+typedef struct {
+    uint32_t count;
+    dsv4l2_redact_region_t region[DSV4L2_REDACT_MAX_REGIONS];
+} dsv4l2_redact_list_t;
+
+/**
+ * Redactor configuration
+ */
+typedef struct {
+    dsv4l2_image_format_t format;
+    const dsv4l2_redact_region_t *regions;   /* Standing regions, e.g. from policy (copied) */
+    uint32_t count;
+} dsv4l2_redact_config_t;
+
+/**
+ * Create a redactor
+ */
+int dsv4l2_redact_create(const dsv4l2_redact_config_t *cfg, dsv4l2_redactor_t **out);
+
+/**
+ * Replace the standing regions (takes effect from the next frame)
+ */
+int dsv4l2_redact_set_regions(dsv4l2_redactor_t *r, const dsv4l2_redact_region_t *regions,
+                              uint32_t count);
+
+/**
+ * Redact the standing regions plus `extra` in place
+ *
+ * @return 0 on success, -EMSGSIZE if len is short, -EINVAL for a bad
+ *         region (nothing is guaranteed redacted on error)
+ */
+int dsv4l2_redact_apply(dsv4l2_redactor_t *r, uint8_t *data, size_t len,
+                        const dsv4l2_redact_region_t *extra, uint32_t n_extra);
+
+/**
+ * Pipeline stage (ctx = redactor)
+ *
+ * Redacts standing regions and any list in DSV4L2_SLOT_REDACT, then
+ * tags the lease DSV4L2_TAG_REDACTED. A failure drops the frame.
+ */
+int dsv4l2_redact_stage(dsv4l2_lease_t *lease, void *ctx);
+
+/**
+ * Sink guard stage (ctx unused): drops frames without
+ * DSV4L2_TAG_REDACTED with -EACCES. Place it ahead of any sink that
+ * may only see downgraded imagery.
+ */
+int dsv4l2_redact_require_stage(dsv4l2_lease_t *lease, void *ctx);
+
+/**
+ * Free a redactor
+ */
+void dsv4l2_redact_destroy(dsv4l2_redactor_t *r);
+
+/* ========================================================================
+ * Classification Banner and Burn-in
+ * ======================================================================== */
+
+/*
+ * Banner and timestamp text is rendered into frame-format strips only
+ * when the classification or the wall-clock second changes; every
+ * other frame is a handful of row copies. Text uses a built-in 5x7
+ * font (upper case; '_' is shown as a space) scaled by an integer
+ * factor. Banner colours follow the classification marking: green
+ * UNCLASSIFIED, blue CONFIDENTIAL, red SECRET, orange TOP SECRET.
+ */
+
+typedef struct dsv4l2_overlay dsv4l2_overlay_t;
+
+#define DSV4L2_OVERLAY_BANNER_TOP    (1u << 0)
+#define DSV4L2_OVERLAY_BANNER_BOTTOM (1u << 1)
+#define DSV4L2_OVERLAY_TIMESTAMP     (1u << 2)   /* UTC, bottom left */
+
+/**
+ * Overlay configuration
+ */
+typedef struct {
+    dsv4l2_image_format_t format;
+    const char *classification;  /* Fixed marking; NULL = the lease's device.
+                                    The stage never marks below the device */
+    uint32_t flags;              /* DSV4L2_OVERLAY_*, 0 = all */
+    uint32_t scale;              /* Font scale, 0 = height / 360 (at least 1) */
+} dsv4l2_overlay_config_t;
+
+/**
+ * Create an overlay
+ *
+ * @return 0 on success, -EINVAL if the banners do not fit the frame
+ */
+int dsv4l2_overlay_create(const dsv4l2_overlay_config_t *cfg, dsv4l2_overlay_t **out);
+
+/**
+ * Replace the fixed classification (NULL = follow the lease's device)
+ */
+int dsv4l2_overlay_set_classification(dsv4l2_overlay_t *ov, const char *classification);
+
+/**
+ * Burn banners and timestamp into a frame
+ *
+ * @param classification Marking (NULL = the configured one, else UNCLASSIFIED)
+ * @param realtime_ns Wall-clock time to show (0 = now)
+ */
+int dsv4l2_overlay_apply(dsv4l2_overlay_t *ov, uint8_t *data, size_t len,
+                         const char *classification, uint64_t realtime_ns);
+
+/**
+ * Pipeline stage (ctx = overlay)
+ *
+ * Uses the higher of the configured classification and that of the
+ * device the frame came from, so a configured marking can raise but
+ * never lower it; the timestamp is the capture time converted to UTC.
+ */
+int dsv4l2_overlay_stage(dsv4l2_lease_t *lease, void *ctx);
+
+/**
+ * Free an overlay
+ */
+void dsv4l2_overlay_destroy(dsv4l2_overlay_t *ov);
+
+/* ========================================================================
+ * Frame Quality
+ * ======================================================================== */
+
+/*
+ * Cheap per-frame quality measures on luma sampled at every factor-th
+ * pixel of every factor-th line, so blurred or badly exposed frames can
+ * be dropped before hashing, encryption and storage. Point samples keep
+ * the fine detail focus is judged on, which box filtering would blur.
+ *
+ *   focus     variance of the 4-neighbour Laplacian
+ *   exposure  luma histogram, mean and clipped-pixel fractions
+ *   motion    mean absolute difference to the neighbour at 0, 45, 90
+ *             and 135 degrees; motion blur smears one direction, so
+ *             the weaker of a perpendicular pair over the stronger
+ *             (isotropy) drops towards 0
+ *
+ * The score is the product of three factors in 0..1: focus / focus_ref,
+ * 1 - clipped / clip_limit and isotropy / isotropy_ref, each capped at
+ * 1. Focus scales with scene contrast, so tune focus_ref per camera.
+ * Scenes dominated by one edge direction (blinds, text) score low on
+ * isotropy even when still; give such cameras a small isotropy_ref.
+ */
+
+typedef struct dsv4l2_quality dsv4l2_quality_t;
+
+/* Gradient directions, in dsv4l2_quality_result_t.gradient order */
+#define DSV4L2_QUALITY_DIRECTIONS 4
+
+/**
+ * Quality assessor configuration
+ */
+typedef struct {
+    dsv4l2_image_format_t format;
+    uint32_t factor;             /* Grid spacing in pixels, 1-8 (0 = 2) */
+    uint32_t dark_level;         /* Luma at or below counts as clipped dark (0 = 8) */
+    uint32_t bright_level;       /* Luma at or above counts as clipped bright (0 = 247) */
+    float    focus_ref;          /* Laplacian variance that counts as sharp (0 = 100) */
+    float    clip_limit;         /* Clipped fraction that zeroes exposure (0 = 0.25) */
+    float    isotropy_ref;       /* Isotropy that counts as blur-free (0 = 0.5) */
+
+    /* Stage behaviour */
+    float    min_score;          /* Lower scores are tagged DSV4L2_TAG_LOW_QUALITY */
+    int      skip_low;           /* Drop (DSV4L2_STAGE_SKIP) low-quality frames */
+} dsv4l2_quality_config_t;
+
+/**
+ * Per-frame result
+ */
+typedef struct {
+    float    score;              /* Overall quality (0..1) */
+    float    focus;              /* Laplacian variance */
+    float    mean;               /* Mean luma */
+    float    dark;               /* Fraction at or below dark_level */
+    float    bright;             /* Fraction at or above bright_level */
+    float    isotropy;           /* Weaker / stronger of perpendicular gradients (0..1) */
+    uint32_t blur_angle;         /* Direction of the weakest gradient (smear), degrees */
+    float    gradient[DSV4L2_QUALITY_DIRECTIONS];   /* Mean abs difference at 0/45/90/135 */
+    uint32_t pixels;             /* Samples in the histogram */
+    uint32_t histogram[256];     /* Sampled luma */
+} dsv4l2_quality_result_t;
+
+/**
+ * Create a quality assessor
+ *
+ * @return 0 on success, -EINVAL for unsupported formats or grids
+ *         smaller than 3x3
+ */
+int dsv4l2_quality_create(const dsv4l2_quality_config_t *cfg, dsv4l2_quality_t **out);
+
+/**
+ * Measure one frame (thread-safe)
+ */
+int dsv4l2_quality_analyze(dsv4l2_quality_t *q, const uint8_t *data, size_t len,
+                           dsv4l2_quality_result_t *result);
+
+/**
+ * Pipeline stage (ctx = assessor)
+ *
+ * Attaches a dsv4l2_quality_result_t in DSV4L2_SLOT_QUALITY and tags
+ * frames scoring below min_score DSV4L2_TAG_LOW_QUALITY. Place it ahead
+ * of the expensive stages; with skip_low they never see such frames.
+ * May run with any parallelism.
+ */
+int dsv4l2_quality_stage(dsv4l2_lease_t *lease, void *ctx);
+
+/**
+ * Free a quality assessor
+ */
+void dsv4l2_quality_destroy(dsv4l2_quality_t *q);
+
+/* ========================================================================
+ * Auto Exposure
+ * ======================================================================== */
+
+/*
+ * Software auto-exposure and auto-gain for cameras with poor or no
+ * onboard AE. Each frame's luma is histogrammed on a grid of every
+ * factor-th pixel of every factor-th line (V4L2_PIX_FMT_Y16 thermal
+ * frames are scaled to 8 bits first). A PI controller drives the mean
+ * towards the target, working in EV (log2 of exposure x gain) so a
+ * scene twice too dark takes the same step at any brightness; the
+ * correction goes to exposure first and to gain once exposure is at
+ * its maximum.
+ *
+ * Exposure changes take a frame or two to reach the image, so the
+ * controller only acts again after settle_frames frames and at most
+ * once per min_interval_ms, and both controls go to the device in one
+ * VIDIOC_S_EXT_CTRLS. Nothing is written while the mean is within
+ * tolerance of the target or the new values round to the old ones.
+ */
+
+typedef struct dsv4l2_ae dsv4l2_ae_t;
+
+/**
+ * Auto-exposure configuration
+ *
+ * Control ranges left 0 are queried from the device at attach time;
+ * a configured exposure_max (e.g. the frame period) caps the device's.
+ */
+typedef struct {
+    dsv4l2_image_format_t format;    /* YUYV, NV12, GREY, RGB24 or Y16 */
+    uint32_t factor;             /* Grid spacing in pixels, 1-16 (0 = 8) */
+    uint32_t y16_bits;           /* Significant bits of Y16 samples, 8-16 (0 = 16) */
+    uint32_t target;             /* Mean luma to reach, 8-bit scale (0 = 110) */
+    uint32_t tolerance;          /* Deadband around the target (0 = 6) */
+    float    kp;                 /* Proportional gain (0 = 0.2) */
+    float    ki;                 /* Integral gain, EV per EV of error (0 = 0.8) */
+    uint32_t settle_frames;      /* Frames measured after a write before acting (0 = 2) */
+    uint32_t min_interval_ms;    /* Shortest time between writes (0 = 50) */
+
+    uint32_t exposure_id;        /* Exposure control (0 = V4L2_CID_EXPOSURE_ABSOLUTE) */
+    uint32_t gain_id;            /* Gain control (0 = V4L2_CID_GAIN) */
+    int32_t  exposure_min;       /* Control ranges (0 = from the device) */
+    int32_t  exposure_max;
+    int32_t  gain_min;           /* Gain is taken as linear, unity at gain_min (or 1) */
+    int32_t  gain_max;           /* (equal to gain_min = exposure only) */
+    int32_t  exposure;           /* Starting values (0 = device's current, else minimum) */
+    int32_t  gain;
+} dsv4l2_ae_config_t;
+
+/**
+ * Control values
+ */
+typedef struct {
+    int32_t exposure;
+    int32_t gain;
+} dsv4l2_ae_settings_t;
+
+/**
+ * Controller state and metrics
+ */
+typedef struct {
+    uint64_t frames;             /* Measured */
+    uint64_t updates;            /* Controller steps */
+    uint64_t writes;             /* Control writes issued */
+    uint64_t write_errors;
+    float    mean;               /* Last measured mean luma */
+    float    error_ev;           /* Last error, EV (positive = too dark) */
+    int      converged;          /* Last mean within tolerance */
+    dsv4l2_ae_settings_t settings;   /* Last written */
+} dsv4l2_ae_stats_t;
+
+/**
+ * Create a controller
+ *
+ * @return 0 on success, -EINVAL for unsupported formats or settings
+ */
+int dsv4l2_ae_create(const dsv4l2_ae_config_t *cfg, dsv4l2_ae_t **out);
+
+/**
+ * Take over a device's exposure
+ *
+ * Switches its own AE and auto-gain off, reads the control ranges that
+ * were not configured and starts from the current values.
+ *
+ * @return 0 on success, -ENOTSUP if the exposure control is missing,
+ *         other negative errno on error
+ */
+int dsv4l2_ae_attach(dsv4l2_ae_t *ae, dsv4l2_device_t *dev);
+
+/**
+ * Measure one frame and step the controller
+ *
+ * @param now_ns Monotonic time of the frame
+ * @param out Settings to write when 1 is returned
+ * @return 1 if new settings are due, 0 if not, -ENODEV if no exposure
+ *         range is known, other negative errno on error
+ */
+int dsv4l2_ae_process(dsv4l2_ae_t *ae, const uint8_t *data, size_t len, uint64_t now_ns,
+                      dsv4l2_ae_settings_t *out);
+
+/**
+ * Write exposure and gain in one VIDIOC_S_EXT_CTRLS
+ */
+int dsv4l2_ae_apply(dsv4l2_ae_t *ae, dsv4l2_device_t *dev, const dsv4l2_ae_settings_t *s);
+
+/**
+ * Pipeline stage (ctx = controller; parallelism 1)
+ *
+ * Writes due settings to the attached device, else to the lease's. A
+ * failed write is counted, not fatal: the frame is passed on.
+ */
+int dsv4l2_ae_stage(dsv4l2_lease_t *lease, void *ctx);
+
+/**
+ * Snapshot state and metrics
+ */
+int dsv4l2_ae_get_stats(dsv4l2_ae_t *ae, dsv4l2_ae_stats_t *stats);
+
+/**
+ * Free a controller (the device keeps its last settings)
+ */
+void dsv4l2_ae_destroy(dsv4l2_ae_t *ae);
+
+/* ========================================================================
+ * Thermal AGC
+ * ======================================================================== */
+
+/*
+ * Maps 16-bit IR frames (V4L2_PIX_FMT_Y16, significant bits in the low
+ * end) to 8-bit GREY by plateau histogram equalization: every level's
+ * count is clipped at the plateau before the cumulative histogram
+ * becomes the mapping, so a large uniform background cannot take over
+ * the output range and a few hot pixels cannot compress the rest (as
+ * a linear min/max stretch does). Scenes with few distinct levels get
+ * at most max_gain output steps per occupied level, which keeps sensor
+ * noise in flat scenes from being stretched to full contrast.
+ *
+ * The mapping follows the scene at 1/2^smooth_shift per frame so it
+ * does not flicker. With threads > 1 the frame is split into that many
+ * line bands on the shared pool, each histogrammed into its own tables;
+ * the histograms are summed before the mapping is built.
+ */
+
+typedef struct dsv4l2_agc dsv4l2_agc_t;
+
+/**
+ * AGC configuration
+ */
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;             /* Bytes per Y16 line (0 = width * 2) */
+    uint32_t bits;               /* Significant bits, 8-16 (0 = 16); larger values clamp */
+    uint32_t plateau;            /* Most a level counts (0 = mean count of occupied levels) */
+    uint32_t max_gain;           /* Output steps per occupied level (0 = 4) */
+    uint32_t smooth_shift;       /* Mapping follows at 1/2^n per frame, 1-8 (0 = 2) */
+    uint32_t threads;            /* Line bands run on the shared pool, max 16 (0 = 1) */
+} dsv4l2_agc_config_t;
+
+/**
+ * Create an AGC
+ */
+int dsv4l2_agc_create(const dsv4l2_agc_config_t *cfg, dsv4l2_agc_t **out);
+
+/**
+ * Map one frame to 8 bits and update the mapping
+ *
+ * @param dst width x height output, dst_stride bytes per line
+ * @return 0 on success, -EMSGSIZE if len is short, other negative
+ *         errno on error
+ */
+int dsv4l2_agc_apply(dsv4l2_agc_t *agc, const uint8_t *data, size_t len, uint8_t *dst,
+                     uint32_t dst_stride);
+
+/**
+ * Forget the smoothed mapping (the next frame sets it outright)
+ */
+void dsv4l2_agc_reset(dsv4l2_agc_t *agc);
+
+/**
+ * Pipeline stage (ctx = AGC; parallelism 1)
+ *
+ * Attaches the packed GREY image in DSV4L2_SLOT_CONVERTED; the lease
+ * data keeps the raw 16-bit frame.
+ */
+int dsv4l2_agc_stage(dsv4l2_lease_t *lease, void *ctx);
+
+/**
+ * Free an AGC
+ */
+void dsv4l2_agc_destroy(dsv4l2_agc_t *agc);
+
+/* ========================================================================
+ * IR / Visible Fusion
+ * ======================================================================== */
+
+/*
+ * Blends an IR frame into a visible frame in place. The IR frame is
+ * warped into the visible frame's geometry through a homography from
+ * calibration; the per-pixel source coordinates are computed once per
+ * homography into a remap table, so a frame costs one bilinear lookup
+ * and one blend per pixel.
+ *
+ * BLEND mixes the IR image in as grey; COLORMAP paints IR levels at or
+ * above the threshold with an ironbow palette and leaves cooler pixels
+ * alone. Visible pixels the homography maps outside the IR frame keep
+ * their value.
+ *
+ * Two devices feed one fusion: the IR stage (in the IR device's
+ * pipeline, after dsv4l2_agc_stage() for Y16 sensors) keeps the last
+ * few IR frames, and the fusion stage (in the visible device's
+ * pipeline) pairs each visible frame with the IR frame captured
+ * closest to it. Both devices must stamp frames with the same clock
+ * (V4L2 monotonic timestamps). With pair_once each IR frame is used at
+ * most once and visible frames without a fresh match are dropped, so
+ * fused output runs at the lower of the two frame rates.
+ */
+
+typedef struct dsv4l2_fusion dsv4l2_fusion_t;
+
+/**
+ * Fusion mode
+ */
+typedef enum {
+    DSV4L2_FUSION_BLEND    = 0,  /* IR as grey, weighted by alpha */
+    DSV4L2_FUSION_COLORMAP = 1,  /* Ironbow palette above the threshold */
+} dsv4l2_fusion_mode_t;
+
+/**
+ * Fusion configuration
+ */
+typedef struct {
+    dsv4l2_image_format_t format;  /* Visible frames */
+    uint32_t ir_width;           /* IR frames: packed GREY, at most 4096 x 4096 */
+    uint32_t ir_height;
+    double   homography[9];      /* Visible pixel to IR pixel, row major */
+    dsv4l2_fusion_mode_t mode;
+    uint32_t alpha;              /* IR weight in 1/256, 1-256 (0 = 128) */
+    uint32_t threshold;          /* COLORMAP: lowest IR level painted (0 = 128) */
+    uint64_t max_skew_ns;        /* Largest capture time difference (0 = 20 ms) */
+    int      pair_once;          /* Use each IR frame once; drop unmatched frames */
+} dsv4l2_fusion_config_t;
+
+/**
+ * Fusion counters
+ */
+typedef struct {
+    uint64_t ir_frames;          /* IR frames received */
+    uint64_t ir_unused;          /* IR frames replaced before they were fused */
+    uint64_t fused;              /* Visible frames fused */
+    uint64_t unmatched;          /* Visible frames without an IR frame in time */
+    int64_t  last_skew_ns;       /* IR minus visible capture time, last fused frame */
+} dsv4l2_fusion_stats_t;
+
+/**
+ * Create a fusion and build its remap table
+ *
+ * @return 0 on success, -EINVAL for a bad layout or a singular
+ *         homography, other negative errno on error
+ */
+int dsv4l2_fusion_create(const dsv4l2_fusion_config_t *cfg, dsv4l2_fusion_t **out);
+
+/**
+ * Replace the homography (after recalibration) and rebuild the table
+ */
+int dsv4l2_fusion_set_homography(dsv4l2_fusion_t *fu, const double homography[9]);
+
+/**
+ * Keep an IR frame for pairing
+ *
+ * @return 0 on success, -EMSGSIZE if len is short
+ */
+int dsv4l2_fusion_push_ir(dsv4l2_fusion_t *fu, const uint8_t *ir, size_t len,
+                          uint64_t timestamp_ns);
+
+/**
+ * Fuse one IR frame into one visible frame, in place
+ *
+ * @return 0 on success, -EMSGSIZE if a length is short, other negative
+ *         errno on error
+ */
+int dsv4l2_fusion_apply(dsv4l2_fusion_t *fu, uint8_t *visible, size_t len,
+                        const uint8_t *ir, size_t ir_len);
+
+/**
+ * IR pipeline stage (ctx = fusion)
+ *
+ * Keeps the image in DSV4L2_SLOT_CONVERTED when a stage attached one
+ * (dsv4l2_agc_stage()), else the lease data.
+ */
+int dsv4l2_fusion_ir_stage(dsv4l2_lease_t *lease, void *ctx);
+
+/**
+ * Visible pipeline stage (ctx = fusion)
+ *
+ * Fuses the closest IR frame and sets DSV4L2_TAG_FUSED. Frames without
+ * an IR frame within max_skew_ns pass unfused, or return
+ * DSV4L2_STAGE_SKIP with pair_once.
+ */
+int dsv4l2_fusion_stage(dsv4l2_lease_t *lease, void *ctx);
+
+/**
+ * Read the counters
+ */
+int dsv4l2_fusion_get_stats(dsv4l2_fusion_t *fu, dsv4l2_fusion_stats_t *stats);
+
+/**
+ * Free a fusion
+ */
+void dsv4l2_fusion_destroy(dsv4l2_fusion_t *fu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DSV4L2_IMAGING_H */
@@ -0,0 +1,213 @@
+/*
+ * DSV4L2 Iris Template Matching
+ *
+ * Masked fractional Hamming distance between 2048-bit iris codes, with
+ * a search over +/-N rotations of the probe to absorb head tilt. Only
+ * bits valid in both masks count:
+ *
+ *   HD = popcount((A ^ B) & maskA & maskB) / popcount(maskA & maskB)
+ *
+ * Every comparison runs in DSMIL_SECRET_REGION: the work done, the
+ * memory touched and the branches taken depend only on the number of
+ * rotations, never on template contents. All rotations are scored and
+ * the best is chosen without branching, so a good match takes exactly
+ * as long as a bad one. Kernels use AVX-512 VPOPCNTDQ, AVX-512BW or
+ * AVX2 when the CPU has them (capped by dsv4l2_simd_level()).
+ *
+ * Bit b of a code is bit (b % 64) of word (b / 64). A rotation by one
+ * step moves the probe by `step` bits; lay codes out angle-major and
+ * set step to the bits per angular sample so a step is one sample.
+ *
+ * A gallery holds enrolled templates in a memory-mapped file for 1:N
+ * identification. Templates are stored in blocks of eight, each block
+ * one page of word planes (word w of all eight codes, then of all
+ * eight masks), so one SIMD lane per template scores eight templates
+ * per instruction. Searches split the gallery into block ranges on the
+ * shared pool, each range keeping its own top-k. An optional prefilter scores 4 of the 32 words first and
+ * skips blocks where no template comes close; every comparison is
+ * still constant-time, but the prefilter makes total search time
+ * depend on how many templates pass it.
+ */
+
+#ifndef DSV4L2_IRIS_H
+#define DSV4L2_IRIS_H
+
+#include "dsv4l2_annotations.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DSV4L2_IRIS_CODE_BITS  2048
+#define DSV4L2_IRIS_CODE_WORDS (DSV4L2_IRIS_CODE_BITS / 64)
+
+/* Largest rotation search: +/- this many steps */
+#define DSV4L2_IRIS_MAX_SHIFT 16
+
+/**
+ * Iris template: code bits and validity mask (1 = usable bit)
+ */
+typedef struct {
+    uint64_t code[DSV4L2_IRIS_CODE_WORDS];
+    uint64_t mask[DSV4L2_IRIS_CODE_WORDS];
+} __attribute__((aligned(64))) DSMIL_SECRET("iris_template") dsv4l2_iris_template_t;
+
+/**
+ * Comparison result at the best rotation
+ */
+typedef struct {
+    uint32_t distance;           /* Disagreeing bits valid in both */
+    uint32_t valid;              /* Bits valid in both (0 = no overlap) */
+    int32_t  shift;              /* Best rotation in steps (-max_shift..max_shift) */
+    double   hd;                 /* distance / valid, 1.0 without overlap */
+} dsv4l2_iris_match_t;
+
+/**
+ * Probe prepared for repeated comparison (rotations precomputed)
+ */
+typedef struct dsv4l2_iris_probe dsv4l2_iris_probe_t;
+
+/**
+ * Compare two templates
+ *
+ * @param probe Template to rotate
+ * @param ref Reference template
+ * @param max_shift Rotations searched each way (0..DSV4L2_IRIS_MAX_SHIFT)
+ * @param step Bits per rotation step (1..64)
+ * @param out Best match
+ * @return 0 on success, -EINVAL on bad arguments
+ */
+int dsv4l2_iris_compare(const dsv4l2_iris_template_t *probe,
+                        const dsv4l2_iris_template_t *ref,
+                        int max_shift, int step, dsv4l2_iris_match_t *out);
+
+/**
+ * Precompute the rotations of a probe (1:N verification and search)
+ *
+ * @return 0 on success, -EINVAL on bad arguments, -ENOMEM
+ */
+int dsv4l2_iris_probe_create(const dsv4l2_iris_template_t *probe,
+                             int max_shift, int step, dsv4l2_iris_probe_t **out);
+
+/**
+ * Compare a prepared probe against one reference
+ */
+int dsv4l2_iris_probe_match(const dsv4l2_iris_probe_t *probe,
+                            const dsv4l2_iris_template_t *ref,
+                            dsv4l2_iris_match_t *out);
+
+/**
+ * Wipe and free a prepared probe
+ */
+void dsv4l2_iris_probe_destroy(dsv4l2_iris_probe_t *probe);
+
+/**
+ * Name of the comparison kernel in use ("avx512-vpopcntdq",
+ * "avx512bw", "avx2" or "scalar")
+ */
+const char *dsv4l2_iris_kernel(void);
+
+/* ========================================================================
+ * Gallery
+ * ======================================================================== */
+
+typedef struct dsv4l2_iris_gallery dsv4l2_iris_gallery_t;
+
+/* Most candidates one search returns */
+#define DSV4L2_IRIS_MAX_K 64
+
+/**
+ * Search parameters
+ */
+typedef struct {
+    int      max_shift;          /* Rotations searched each way */
+    int      step;               /* Bits per rotation step (0 = 1) */
+    uint32_t k;                  /* Candidates wanted (1..DSV4L2_IRIS_MAX_K) */
+    uint32_t threads;            /* Block ranges run on the shared pool (0 = one per pool worker) */
+    uint32_t min_valid;          /* Fewer overlapping bits score 1.0 */
+    double   prefilter_hd;       /* Skip blocks whose sub-code HDs all exceed this (0 = off) */
+} dsv4l2_iris_search_t;
+
+/**
+ * Search result
+ */
+typedef struct {
+    uint64_t id;                 /* Caller's identifier from enrollment */
+    uint64_t slot;               /* Position in the gallery */
+    dsv4l2_iris_match_t match;
+} dsv4l2_iris_candidate_t;
+
+/**
+ * Search metrics
+ */
+typedef struct {
+    uint64_t templates;          /* Gallery size searched */
+    uint64_t compared;           /* Fully compared (all, without prefilter) */
+    uint64_t elapsed_ns;
+    uint32_t threads;            /* Block ranges searched */
+} dsv4l2_iris_search_stats_t;
+
+/**
+ * Create a gallery file for up to capacity templates (truncates)
+ *
+ * The file is sized up front (sparse) and created mode 0600.
+ */
+int dsv4l2_iris_gallery_create(const char *path, uint64_t capacity,
+                               dsv4l2_iris_gallery_t **out);
+
+/**
+ * Open a gallery file
+ *
+ * @param writable Nonzero to allow enrollment
+ * @return 0 on success, -EBADMSG if the file is not a gallery, other
+ *         negative errno on error
+ */
+int dsv4l2_iris_gallery_open(const char *path, int writable,
+                             dsv4l2_iris_gallery_t **out);
+
+/**
+ * Append a template
+ *
+ * @param slot Position assigned (may be NULL)
+ * @return 0 on success, -ENOSPC if full, -EROFS if opened read-only
+ */
+int dsv4l2_iris_gallery_enroll(dsv4l2_iris_gallery_t *g, const dsv4l2_iris_template_t *t,
+                               uint64_t id, uint64_t *slot);
+
+/**
+ * Enrolled template count
+ */
+uint64_t dsv4l2_iris_gallery_count(const dsv4l2_iris_gallery_t *g);
+
+/**
+ * Read back an enrolled template
+ */
+int dsv4l2_iris_gallery_get(const dsv4l2_iris_gallery_t *g, uint64_t slot,
+                            dsv4l2_iris_template_t *t, uint64_t *id);
+
+/**
+ * Find the k closest enrolled templates, best first
+ *
+ * @param out At least cfg->k entries
+ * @param stats Metrics (may be NULL)
+ * @return Number of candidates written, negative errno on error
+ */
+int dsv4l2_iris_gallery_search(dsv4l2_iris_gallery_t *g, const dsv4l2_iris_template_t *probe,
+                               const dsv4l2_iris_search_t *cfg, dsv4l2_iris_candidate_t *out,
+                               dsv4l2_iris_search_stats_t *stats);
+
+/**
+ * Flush and close a gallery
+ *
+ * @return 0 on success, negative errno if the flush failed
+ */
+int dsv4l2_iris_gallery_close(dsv4l2_iris_gallery_t *g);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DSV4L2_IRIS_H */
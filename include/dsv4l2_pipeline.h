@@ -0,0 +1,411 @@
+/*
+ * DSV4L2 Frame Processing Pipeline
+ *
+ * Moves per-frame work off the capture thread. Frames travel through the
+ * pipeline as leases: a lease owns one dequeued V4L2 buffer (or a
+ * caller-supplied buffer) until it is released, at which point the
+ * buffer is queued back to the driver.
+ *
+ * A pipeline is a chain of stages connected by bounded queues:
+ *
+ *   capture -> convert -> hash -> encrypt -> sink
+ *
+ * Each stage runs on its own worker threads (configurable parallelism),
+ * can restore input order before handing frames on, and keeps latency
+ * and queue occupancy metrics. The capture thread only acquires leases
+ * and submits them.
+ *
+ * Work inside a single frame (conversion, decode, redaction of a 4K
+ * image) is split into tiles and run on the work-stealing pool.
+ */
+
+#ifndef DSV4L2_PIPELINE_H
+#define DSV4L2_PIPELINE_H
+
+#include "dsv4l2_annotations.h"
+#include "dsv4l2_core.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========================================================================
+ * Frame Leases
+ * ======================================================================== */
+
+/* Per-lease attachment slots (outputs handed from one stage to the next) */
+typedef enum {
+    DSV4L2_SLOT_CONVERTED = 0,   /* Converted / processed image */
+    DSV4L2_SLOT_DIGEST    = 1,   /* Hash or signature */
+    DSV4L2_SLOT_CIPHER    = 2,   /* Encrypted payload */
+    DSV4L2_SLOT_META      = 3,   /* Associated metadata */
+    DSV4L2_SLOT_USER0     = 4,
+    DSV4L2_SLOT_USER1     = 5,
+    DSV4L2_SLOT_CHANGE    = 6,   /* dsv4l2_change_result_t (dsv4l2_imaging.h) */
+    DSV4L2_SLOT_COMPRESSED = 7,  /* Recorder blocks (dsv4l2_recorder.h) */
+    DSV4L2_SLOT_PYRAMID   = 8,   /* dsv4l2_pyramid_t (dsv4l2_imaging.h) */
+    DSV4L2_SLOT_REDACT    = 9,   /* dsv4l2_redact_list_t: per-frame regions (dsv4l2_imaging.h) */
+    DSV4L2_SLOT_QUALITY   = 10,  /* dsv4l2_quality_result_t (dsv4l2_imaging.h) */
+    DSV4L2_SLOT_COUNT     = 11,
+} dsv4l2_lease_slot_t;
+
+/* Lease tags set by library stages (bits 24-31; bits 0-23 are the application's) */
+#define DSV4L2_TAG_CHANGED   (1u << 24)   /* Change detector: scene changed */
+#define DSV4L2_TAG_STATIC    (1u << 25)   /* Change detector: nothing changed */
+#define DSV4L2_TAG_REDACTED  (1u << 26)   /* Redaction stage applied its regions */
+#define DSV4L2_TAG_LOW_QUALITY (1u << 27) /* Quality stage: score below the minimum */
+#define DSV4L2_TAG_FUSED     (1u << 28)   /* Fusion stage: IR frame blended in */
+
+typedef struct dsv4l2_lease dsv4l2_lease_t;
+
+/**
+ * Frame lease
+ *
+ * Fields above the private marker are valid for the lifetime of the
+ * lease. Only one stage touches a lease at a time, so stages may modify
+ * data, tags and attachments without locking.
+ */
+struct dsv4l2_lease {
+    dsv4l2_device_t *dev;        /* Source device (NULL for wrapped memory) */
+    uint32_t  index;             /* V4L2 buffer index */
+    uint8_t  *data;              /* Frame data */
+    size_t    len;               /* Bytes used */
+    uint32_t  sequence;          /* Driver frame sequence */
+    uint64_t  timestamp_ns;      /* Driver capture timestamp */
+    uint64_t  dequeue_ns;        /* Monotonic time of DQBUF */
+    uint32_t  flags;             /* V4L2_BUF_FLAG_* */
+    uint32_t  tags;              /* Application bits and DSV4L2_TAG_* */
+
+    /* Private */
+    struct {
+        void  *ptr;
+        void (*free_fn)(void *);
+    } slots[DSV4L2_SLOT_COUNT];
+    void    (*release_fn)(dsv4l2_lease_t *lease);
+    void     *release_ctx;
+    uint64_t  stage_seq;         /* Input order at the current stage */
+    uint64_t  enqueue_ns;        /* When it entered the current queue */
+    int       active;
+};
+
+/**
+ * Acquire a lease on the next filled buffer (TEMPEST and policy checked)
+ *
+ * The buffer stays dequeued until dsv4l2_lease_release().
+ */
+int dsv4l2_lease_acquire(dsv4l2_device_t *dev, dsv4l2_lease_t **out)
+    DSMIL_REQUIRES_TEMPEST_CHECK;
+
+/**
+ * Wrap caller-owned memory in a lease
+ *
+ * free_fn (optional) is called with data when the lease is released.
+ */
+int dsv4l2_lease_wrap(uint8_t *data, size_t len, void (*free_fn)(void *),
+                      dsv4l2_lease_t **out);
+
+/**
+ * Attach a stage output; free_fn (optional) runs at release
+ */
+int dsv4l2_lease_attach(dsv4l2_lease_t *lease, dsv4l2_lease_slot_t slot,
+                        void *ptr, void (*free_fn)(void *));
+
+/**
+ * Get an attachment (NULL if empty)
+ */
+void *dsv4l2_lease_get(const dsv4l2_lease_t *lease, dsv4l2_lease_slot_t slot);
+
+/**
+ * Release a lease: free attachments and requeue the buffer
+ */
+void dsv4l2_lease_release(dsv4l2_lease_t *lease);
+
+/* ========================================================================
+ * Pipeline
+ * ======================================================================== */
+
+typedef struct dsv4l2_pipeline dsv4l2_pipeline_t;
+
+/* Maximum number of stages in a pipeline */
+#define DSV4L2_PIPELINE_MAX_STAGES 16
+
+/* Stage return value: drop this frame quietly (not an error) */
+#define DSV4L2_STAGE_SKIP 1
+
+/**
+ * Stage function
+ *
+ * @return 0 to pass the frame on, DSV4L2_STAGE_SKIP to drop it,
+ *         negative errno to drop it and count an error
+ */
+typedef int (*dsv4l2_stage_fn)(dsv4l2_lease_t *lease, void *ctx);
+
+/**
+ * What happens when a stage's input queue is full
+ */
+typedef enum {
+    DSV4L2_BACKPRESSURE_DROP  = 0,  /* Release the frame, count a drop (default) */
+    DSV4L2_BACKPRESSURE_BLOCK = 1,  /* Wait for room */
+} dsv4l2_backpressure_t;
+
+/**
+ * Stage configuration
+ */
+typedef struct {
+    const char      *name;         /* Metrics, thread and trace span name (static string) */
+    dsv4l2_stage_fn  fn;
+    void            *ctx;
+    unsigned int     parallelism;  /* Worker threads (0 = 1); 1 for single-producer
+                                      sinks such as dsv4l2_ring_stage */
+    unsigned int     queue_depth;  /* Input queue capacity (0 = 8) */
+    int              ordered;      /* Hand frames on in input order */
+} dsv4l2_stage_config_t;
+
+/**
+ * Per-stage metrics
+ */
+typedef struct {
+    const char *name;
+    uint64_t frames_in;          /* Accepted into the input queue */
+    uint64_t frames_out;         /* Passed on (or completed, for the last stage) */
+    uint64_t skipped;            /* Stage returned DSV4L2_STAGE_SKIP */
+    uint64_t errors;             /* Stage returned an error */
+    uint64_t dropped;            /* Rejected by a full input queue */
+    uint32_t queue_depth;        /* Current occupancy */
+    uint32_t queue_high_water;   /* Maximum occupancy seen */
+    uint32_t queue_capacity;
+    uint64_t wait_hist[DSV4L2_STATS_HIST_BINS];     /* Time queued before a worker took it */
+    uint64_t service_hist[DSV4L2_STATS_HIST_BINS];  /* Time inside the stage function */
+} dsv4l2_stage_stats_t;
+
+/**
+ * Create an empty pipeline
+ */
+int dsv4l2_pipeline_create(dsv4l2_backpressure_t backpressure,
+                           dsv4l2_pipeline_t **out);
+
+/**
+ * Append a stage (before dsv4l2_pipeline_start)
+ */
+int dsv4l2_pipeline_add_stage(dsv4l2_pipeline_t *p, const dsv4l2_stage_config_t *cfg);
+
+/**
+ * Start worker threads
+ */
+int dsv4l2_pipeline_start(dsv4l2_pipeline_t *p);
+
+/**
+ * Submit a lease to the first stage
+ *
+ * The pipeline owns the lease from here on, even on failure. Returns
+ * -EAGAIN if it was dropped by backpressure.
+ */
+int dsv4l2_pipeline_submit(dsv4l2_pipeline_t *p, dsv4l2_lease_t *lease);
+
+/**
+ * Acquire the next frame from a device and submit it
+ */
+int dsv4l2_pipeline_capture(dsv4l2_pipeline_t *p, dsv4l2_device_t *dev);
+
+/**
+ * Drain all queued frames and stop worker threads
+ */
+void dsv4l2_pipeline_stop(dsv4l2_pipeline_t *p);
+
+/**
+ * Stop (if running) and free a pipeline
+ */
+void dsv4l2_pipeline_destroy(dsv4l2_pipeline_t *p);
+
+/**
+ * Number of stages
+ */
+size_t dsv4l2_pipeline_stage_count(const dsv4l2_pipeline_t *p);
+
+/**
+ * Snapshot metrics for one stage
+ */
+int dsv4l2_pipeline_get_stage_stats(dsv4l2_pipeline_t *p, size_t stage,
+                                    dsv4l2_stage_stats_t *stats);
+
+/* ========================================================================
+ * Managed Capture Thread
+ * ======================================================================== */
+
+/*
+ * One thread per device that only polls, dequeues and hands leases to
+ * the application through a lock-free single-producer/single-consumer
+ * queue. DQBUF latency then no longer depends on how busy the
+ * application's threads are. CPU affinity and SCHED_FIFO priority come
+ * from the device profile (capture_cpu, capture_priority) unless
+ * overridden.
+ */
+
+typedef struct dsv4l2_capture_thread dsv4l2_capture_thread_t;
+
+/* Take the value from the device profile */
+#define DSV4L2_CAPTURE_FROM_PROFILE (-2)
+
+/**
+ * Capture thread configuration (NULL = all defaults / profile)
+ */
+typedef struct {
+    uint32_t depth;              /* Handoff queue slots (0 = 8; rounded up to a power of two) */
+    int      cpu;                /* CPU to pin to, -1 = any, or DSV4L2_CAPTURE_FROM_PROFILE */
+    int      priority;           /* SCHED_FIFO 1-99, 0 = normal, or DSV4L2_CAPTURE_FROM_PROFILE */
+} dsv4l2_capture_config_t;
+
+/**
+ * Capture thread metrics
+ */
+typedef struct {
+    uint64_t frames;             /* Leases handed off */
+    uint64_t dropped;            /* Requeued because the handoff queue was full */
+    uint64_t errors;             /* Failed acquires other than -EAGAIN */
+    int      cpu;                /* Effective pinning (-1 = none) */
+    int      priority;           /* Effective SCHED_FIFO priority (0 = normal or not permitted) */
+} dsv4l2_capture_stats_t;
+
+/**
+ * Start a capture thread for a device
+ *
+ * The thread starts streaming on its first acquire. Real-time priority
+ * needs CAP_SYS_NICE; without it the thread runs at normal priority and
+ * stats.priority reports 0.
+ */
+int dsv4l2_capture_thread_start(dsv4l2_device_t *dev, const dsv4l2_capture_config_t *cfg,
+                                dsv4l2_capture_thread_t **out);
+
+/**
+ * Take the next frame (single consumer)
+ *
+ * Leases must be released with dsv4l2_lease_release(); a consumer
+ * that holds them all starves the driver.
+ *
+ * @param timeout_ms 0 = do not wait, -1 = wait forever
+ * @return 0 on success, -EAGAIN (timeout_ms 0) or -ETIMEDOUT if no
+ *         frame arrived, -EPIPE once the thread is being stopped
+ */
+int dsv4l2_capture_thread_next(dsv4l2_capture_thread_t *ct, dsv4l2_lease_t **out,
+                               int timeout_ms);
+
+/**
+ * File descriptor that polls readable while frames are waiting
+ * (for event loops; wakeups may be spurious)
+ */
+int dsv4l2_capture_thread_fd(const dsv4l2_capture_thread_t *ct);
+
+/**
+ * Snapshot capture thread metrics
+ */
+int dsv4l2_capture_thread_get_stats(dsv4l2_capture_thread_t *ct,
+                                    dsv4l2_capture_stats_t *stats);
+
+/**
+ * Stop the thread, release queued frames and free it
+ *
+ * A consumer blocked in dsv4l2_capture_thread_next() returns -EPIPE;
+ * the call waits for it before freeing. The device keeps streaming;
+ * the caller still owns it.
+ */
+void dsv4l2_capture_thread_stop(dsv4l2_capture_thread_t *ct);
+
+/* ========================================================================
+ * Work-Stealing Pool (intra-frame parallelism)
+ * ======================================================================== */
+
+typedef struct dsv4l2_pool dsv4l2_pool_t;
+
+/* Maximum number of pool workers */
+#define DSV4L2_POOL_MAX_WORKERS 256
+
+/**
+ * Pool configuration
+ */
+typedef struct {
+    unsigned int threads;        /* Workers (0 = online CPUs in the affinity mask) */
+    int          pin;            /* Pin each worker to one CPU */
+    int          numa_node;      /* Restrict to one NUMA node (-1 = all) */
+} dsv4l2_pool_config_t;
+
+/**
+ * Pool metrics
+ */
+typedef struct {
+    unsigned int threads;
+    unsigned int numa_nodes;     /* Nodes the workers are spread over */
+    uint64_t     jobs;           /* parallel_for calls */
+    uint64_t     tasks;          /* Ranges executed */
+    uint64_t     steals;         /* Ranges taken from another worker */
+    uint64_t     remote_steals;  /* ... from a worker on another node */
+} dsv4l2_pool_stats_t;
+
+/**
+ * Range body: process items [begin, end)
+ */
+typedef void (*dsv4l2_range_fn)(void *ctx, uint32_t begin, uint32_t end);
+
+/**
+ * Image tile (pixel coordinates)
+ */
+typedef struct {
+    uint32_t x, y;
+    uint32_t width, height;
+} dsv4l2_tile_t;
+
+/**
+ * Tile body
+ */
+typedef void (*dsv4l2_tile_fn)(void *ctx, const dsv4l2_tile_t *tile);
+
+/**
+ * Create a private pool
+ *
+ * Most callers want dsv4l2_pool_shared() instead.
+ */
+int dsv4l2_pool_create(const dsv4l2_pool_config_t *cfg, dsv4l2_pool_t **out);
+
+/**
+ * Stop workers and free a private pool
+ */
+void dsv4l2_pool_destroy(dsv4l2_pool_t *pool);
+
+/**
+ * Process-wide pool shared by every device
+ *
+ * Created on first use. DSV4L2_POOL_THREADS and DSV4L2_POOL_PIN=1 in the
+ * environment override the defaults. Returns NULL if it cannot be created.
+ */
+dsv4l2_pool_t *dsv4l2_pool_shared(void);
+
+/**
+ * Run fn over [0, count) in ranges of at most grain items and wait
+ *
+ * The calling thread helps. Safe to call from inside a pool task.
+ */
+int dsv4l2_parallel_for(dsv4l2_pool_t *pool, uint32_t count, uint32_t grain,
+                        dsv4l2_range_fn fn, void *ctx);
+
+/**
+ * Split a width x height image into cache-sized tiles and run fn on each
+ *
+ * Tiles are full-width row bands sized to half the L2 cache; rows wider
+ * than that are split into columns. Returns -EOVERFLOW if that takes
+ * more than UINT32_MAX tiles.
+ */
+int dsv4l2_parallel_tiles(dsv4l2_pool_t *pool, uint32_t width, uint32_t height,
+                          uint32_t bytes_per_pixel, dsv4l2_tile_fn fn, void *ctx);
+
+/**
+ * Snapshot pool metrics
+ */
+int dsv4l2_pool_get_stats(dsv4l2_pool_t *pool, dsv4l2_pool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DSV4L2_PIPELINE_H */
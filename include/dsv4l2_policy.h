@@ -28,6 +28,12 @@
                          dsv4l2_frame_t *out)
         DSMIL_REQUIRES_TEMPEST_CHECK;
 
+    int
+    dsv4l2_capture_frame_timeout(dsv4l2_device_t *dev,
+                                 dsv4l2_frame_t *out,
+                                 int timeout_ms)
+        DSMIL_REQUIRES_TEMPEST_CHECK;
+
     int
     DSMIL_SECRET_REGION
     dsv4l2_capture_iris(dsv4l2_device_t *dev,
@@ -30,6 +30,10 @@ typedef struct {
     uint32_t height;
     uint32_t fps;
 
+    /* Managed capture thread (dsv4l2_capture_start) */
+    int capture_cpu;                /* CPU to pin to (-1 = any) */
+    int capture_priority;           /* SCHED_FIFO priority (0 = normal scheduling) */
+
     /* Profile metadata */
     char filename[256];
 } dsv4l2_device_profile_t;
@@ -54,6 +58,12 @@ size_t dsv4l2_get_profile_count(void);
  */
 const dsv4l2_device_profile_t *dsv4l2_get_profile(size_t index);
 
+/**
+ * Parse a profile from an in-memory YAML document
+ */
+int dsv4l2_parse_profile(const char *text, size_t len,
+                         dsv4l2_device_profile_t *profile);
+
 #ifdef __cplusplus
 }
 #endif
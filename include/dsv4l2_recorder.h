@@ -0,0 +1,243 @@
+/*
+ * DSV4L2 Frame Recorder
+ *
+ * Records frames from a pipeline into a data file plus a fixed-record
+ * index (path + ".idx"), so any frame can be located with one index
+ * read. The recorder contributes two stages: a parallel, ordered
+ * compression stage and a single writer stage.
+ *
+ * Each frame is split into blocks that are compressed independently
+ * (LZ4 or Zstd when built with HAVE_LZ4 / HAVE_ZSTD); blocks that do
+ * not shrink are stored raw. The compression level
+ * follows the measured cost per frame so the workers keep up with the
+ * configured frame rate.
+ *
+ * With a cipher configured (HAVE_OPENSSL) the same parallel stage also
+ * encrypts every record with AES-256-GCM or ChaCha20-Poly1305; the
+ * per-frame authentication tag and nonce counter live in the index,
+ * which is itself authenticated through each frame's tag. A second
+ * tag per record binds it to its index position and close seals the
+ * frame count, so reordered, dropped or truncated records are
+ * detected. Nothing is written in the clear: the writer refuses
+ * frames that were not sealed. This is the encrypted storage sink for
+ * secret frames.
+ *
+ * Files are written in host byte order.
+ */
+
+#ifndef DSV4L2_RECORDER_H
+#define DSV4L2_RECORDER_H
+
+#include "dsv4l2_pipeline.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct dsv4l2_recorder dsv4l2_recorder_t;
+typedef struct dsv4l2_recording dsv4l2_recording_t;
+
+/* Largest number of blocks per frame */
+#define DSV4L2_RECORD_MAX_BLOCKS 64
+
+/**
+ * Block codec
+ */
+typedef enum {
+    DSV4L2_CODEC_NONE = 0,
+    DSV4L2_CODEC_LZ4  = 1,       /* Needs HAVE_LZ4 */
+    DSV4L2_CODEC_ZSTD = 2,       /* Needs HAVE_ZSTD */
+} dsv4l2_codec_t;
+
+/**
+ * Whether a codec was compiled in
+ */
+int dsv4l2_codec_available(dsv4l2_codec_t codec);
+
+/* Recording key size (bytes) */
+#define DSV4L2_RECORD_KEY_SIZE 32
+
+/**
+ * Record cipher
+ */
+typedef enum {
+    DSV4L2_CIPHER_NONE              = 0,
+    DSV4L2_CIPHER_AES_256_GCM       = 1,   /* Needs HAVE_OPENSSL */
+    DSV4L2_CIPHER_CHACHA20_POLY1305 = 2,   /* Needs HAVE_OPENSSL */
+} dsv4l2_cipher_t;
+
+/**
+ * Whether a cipher was compiled in
+ */
+int dsv4l2_cipher_available(dsv4l2_cipher_t cipher);
+
+/**
+ * Recorder configuration
+ *
+ * Levels run from fastest (1) to strongest: LZ4 1-8 (acceleration
+ * 8 down to 1), Zstd 1-19.
+ */
+typedef struct {
+    const char    *path;         /* Data file; index is path + ".idx" */
+    uint32_t       width;        /* Informational, stored in the index header */
+    uint32_t       height;
+    uint32_t       pixelformat;
+    dsv4l2_codec_t codec;
+    uint32_t       blocks;       /* Independent blocks per frame (0 = 1) */
+    uint32_t       workers;      /* Compression threads (0 = online CPUs) */
+    uint32_t       fps;          /* Incoming frame rate to keep up with (0 = 30) */
+    int            level;        /* Starting level (0 = codec default) */
+    int            level_min;    /* Adaptive range (0 = 1) */
+    int            level_max;    /* (0 = codec maximum; = level_min pins it) */
+    dsv4l2_cipher_t cipher;
+    const uint8_t *key;          /* DSV4L2_RECORD_KEY_SIZE bytes when encrypting (copied) */
+} dsv4l2_recorder_config_t;
+
+/**
+ * Recorder metrics
+ */
+typedef struct {
+    uint64_t frames;             /* Written */
+    uint64_t raw_bytes;
+    uint64_t stored_bytes;       /* Data file bytes, block tables included */
+    uint64_t errors;             /* Write failures */
+    uint64_t level_ups;
+    uint64_t level_downs;
+    uint64_t compress_ns;        /* Smoothed compression time per frame */
+    int      level;              /* Current level */
+} dsv4l2_recorder_stats_t;
+
+/**
+ * Create a recording (truncates existing files)
+ *
+ * @return 0 on success, -ENOTSUP if the codec or cipher is not
+ *         compiled in, other negative errno on error
+ */
+int dsv4l2_recorder_create(const dsv4l2_recorder_config_t *cfg,
+                           dsv4l2_recorder_t **out);
+
+/**
+ * Append the compression and writer stages to a pipeline
+ *
+ * Frames reaching the writer without passing the compression stage
+ * are stored uncompressed (or refused with -EACCES when encrypting).
+ */
+int dsv4l2_recorder_add_stages(dsv4l2_recorder_t *rec, dsv4l2_pipeline_t *p);
+
+/**
+ * Compression and encryption stage (ctx = recorder; run parallel and ordered)
+ */
+int dsv4l2_recorder_compress_stage(dsv4l2_lease_t *lease, void *ctx);
+
+/**
+ * Writer stage (ctx = recorder; parallelism 1)
+ */
+int dsv4l2_recorder_write_stage(dsv4l2_lease_t *lease, void *ctx);
+
+/**
+ * Encrypt and store one frame outside a pipeline
+ *
+ * Safe to call from several threads, also while the recorder's stages
+ * run; frames are numbered in the order their encryption starts.
+ *
+ * @return 0 on success, -EPERM if the recorder does not encrypt,
+ *         other negative errno on error
+ */
+int dsv4l2_store_encrypted(dsv4l2_recorder_t *rec, const void *buf, size_t len,
+                           uint32_t sequence, uint64_t timestamp_ns);
+
+/**
+ * write(2)-style wrapper around dsv4l2_store_encrypted(): buf becomes
+ * the next frame, stamped with the current monotonic time
+ *
+ * @return len on success, negative errno on error
+ */
+ssize_t dsv4l2_encrypted_write(dsv4l2_recorder_t *rec, const void *buf, size_t len);
+
+/**
+ * Snapshot metrics
+ */
+int dsv4l2_recorder_get_stats(dsv4l2_recorder_t *rec, dsv4l2_recorder_stats_t *stats);
+
+/**
+ * Flush to disk and free the recorder (stop the pipeline first)
+ *
+ * @return 0 on success, negative errno if the final sync failed
+ */
+int dsv4l2_recorder_close(dsv4l2_recorder_t *rec);
+
+/* ========================================================================
+ * Playback
+ * ======================================================================== */
+
+/**
+ * Recorded frame description
+ */
+typedef struct {
+    uint32_t       sequence;     /* Driver frame sequence */
+    uint64_t       timestamp_ns;
+    uint32_t       raw_len;      /* Decoded size */
+    uint32_t       stored_len;
+    uint32_t       blocks;
+    dsv4l2_codec_t codec;
+    dsv4l2_cipher_t cipher;
+} dsv4l2_record_frame_t;
+
+/**
+ * Open a recording
+ *
+ * A trailing partial index record (e.g. after a crash) is ignored.
+ */
+int dsv4l2_recording_open(const char *path, dsv4l2_recording_t **out);
+
+/**
+ * Supply the key of an encrypted recording
+ *
+ * The frame count becomes the one sealed at close.
+ *
+ * @return 0 on success, -EKEYREJECTED if the key does not match,
+ *         -EBADMSG if the index is truncated or the recorder was not
+ *         closed (the key is still set and the frames present can be
+ *         read), -EINVAL if the recording is not encrypted
+ */
+int dsv4l2_recording_set_key(dsv4l2_recording_t *rd, const uint8_t *key);
+
+/**
+ * Recorded frame count and stream format
+ */
+uint64_t dsv4l2_recording_frames(const dsv4l2_recording_t *rd);
+void dsv4l2_recording_format(const dsv4l2_recording_t *rd, uint32_t *width,
+                             uint32_t *height, uint32_t *pixelformat);
+
+/**
+ * Describe frame n without reading it
+ */
+int dsv4l2_recording_info(dsv4l2_recording_t *rd, uint64_t n,
+                          dsv4l2_record_frame_t *info);
+
+/**
+ * Read and decode frame n
+ *
+ * @return Decoded length, -ENOSPC if cap is too small, -EBADMSG if
+ *         the frame is corrupt or fails authentication, -ENOKEY if the
+ *         recording is encrypted and no key was set, -ENOTSUP if its
+ *         codec or cipher is not compiled in, other negative errno on
+ *         error
+ */
+ssize_t dsv4l2_recording_read(dsv4l2_recording_t *rd, uint64_t n, uint8_t *buf,
+                              size_t cap, dsv4l2_record_frame_t *info);
+
+/**
+ * Close a recording
+ */
+void dsv4l2_recording_close(dsv4l2_recording_t *rd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DSV4L2_RECORDER_H */
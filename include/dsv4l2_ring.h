@@ -0,0 +1,171 @@
+/*
+ * DSV4L2 Shared-Memory Frame Ring
+ *
+ * Distributes one camera stream to several processes. V4L2 allows a
+ * single streaming owner; that process publishes each frame once into
+ * a memfd-backed ring and any number of consumers (recorder, detector,
+ * operator preview) attach to it by name.
+ *
+ * The producer never waits for consumers. Each slot is protected by a
+ * sequence lock; a consumer that falls more than a ring's worth behind
+ * is moved forward and told how many frames it missed.
+ *
+ * The ring is sealed so that only the producer's own mapping can write
+ * it; consumers can map it read-only and nothing else. They keep their
+ * cursor and a validated copy of the ring geometry in their own memory,
+ * so a misbehaving consumer cannot disturb the producer or other
+ * consumers. Only processes of the same user (or root) can attach.
+ */
+
+#ifndef DSV4L2_RING_H
+#define DSV4L2_RING_H
+
+#include "dsv4l2_pipeline.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximum ring name length ([A-Za-z0-9_.-]) */
+#define DSV4L2_RING_NAME_MAX 64
+
+typedef struct dsv4l2_ring_pub dsv4l2_ring_pub_t;
+typedef struct dsv4l2_ring_sub dsv4l2_ring_sub_t;
+
+/**
+ * Ring geometry and stream format (published to consumers)
+ */
+typedef struct {
+    uint32_t slots;              /* Frames held (0 = 8) */
+    uint32_t slot_size;          /* Largest frame in bytes */
+    uint32_t width;              /* Informational, 0 if unknown */
+    uint32_t height;
+    uint32_t pixelformat;        /* V4L2 fourcc */
+} dsv4l2_ring_config_t;
+
+/**
+ * Frame read from a ring
+ */
+typedef struct {
+    uint64_t seq;                /* Ring sequence (0, 1, 2, ...) */
+    uint32_t sequence;           /* Driver frame sequence */
+    uint64_t timestamp_ns;       /* Driver capture timestamp */
+    uint32_t flags;              /* V4L2_BUF_FLAG_* */
+    size_t   len;                /* Frame length */
+    uint64_t missed;             /* Frames skipped since the previous read */
+} dsv4l2_ring_frame_t;
+
+/**
+ * Publisher metrics
+ */
+typedef struct {
+    uint64_t published;
+    uint64_t attaches;           /* Consumers handed the ring */
+    uint64_t rejected;           /* Attach attempts from other users */
+} dsv4l2_ring_stats_t;
+
+/* ========================================================================
+ * Publisher
+ * ======================================================================== */
+
+/**
+ * Create a ring and start accepting consumers under name
+ *
+ * With name NULL the ring is private: nothing listens, and the owner
+ * hands dsv4l2_ring_fd() to consumers itself (e.g. after its own access
+ * checks).
+ */
+int dsv4l2_ring_create(const char *name, const dsv4l2_ring_config_t *cfg,
+                       dsv4l2_ring_pub_t **out);
+
+/**
+ * Get the next slot to fill in place (avoids an intermediate copy)
+ *
+ * Consumers see the slot as busy until dsv4l2_ring_commit(). Returns
+ * -EBUSY while an earlier reservation is still outstanding.
+ */
+int dsv4l2_ring_reserve(dsv4l2_ring_pub_t *pub, uint8_t **data, size_t *capacity);
+
+/**
+ * Publish the reserved slot
+ */
+int dsv4l2_ring_commit(dsv4l2_ring_pub_t *pub, size_t len, uint32_t sequence,
+                       uint64_t timestamp_ns, uint32_t flags);
+
+/**
+ * Copy a frame into the ring and publish it
+ */
+int dsv4l2_ring_publish(dsv4l2_ring_pub_t *pub, const void *data, size_t len,
+                        uint32_t sequence, uint64_t timestamp_ns, uint32_t flags);
+
+/**
+ * Pipeline stage that publishes each lease (ctx = dsv4l2_ring_pub_t *)
+ *
+ * A ring has one producer: add the stage once, with parallelism 1.
+ * A concurrent publish fails with -EBUSY rather than sharing a slot.
+ */
+int dsv4l2_ring_stage(dsv4l2_lease_t *lease, void *ctx);
+
+/**
+ * Ring memfd (owned by the publisher, sealed so it maps read-only)
+ */
+int dsv4l2_ring_fd(const dsv4l2_ring_pub_t *pub);
+
+/**
+ * Snapshot publisher metrics
+ */
+int dsv4l2_ring_get_stats(dsv4l2_ring_pub_t *pub, dsv4l2_ring_stats_t *stats);
+
+/**
+ * Close the ring (attached consumers drain, then see -EPIPE)
+ */
+void dsv4l2_ring_destroy(dsv4l2_ring_pub_t *pub);
+
+/* ========================================================================
+ * Consumer
+ * ======================================================================== */
+
+/**
+ * Attach to a ring by name (starts at the next published frame)
+ */
+int dsv4l2_ring_attach(const char *name, dsv4l2_ring_sub_t **out);
+
+/**
+ * Attach to a ring from its memfd (caller keeps ownership of fd)
+ */
+int dsv4l2_ring_attach_fd(int fd, dsv4l2_ring_sub_t **out);
+
+/**
+ * Ring geometry and stream format
+ */
+int dsv4l2_ring_get_config(const dsv4l2_ring_sub_t *sub, dsv4l2_ring_config_t *cfg);
+
+/**
+ * Copy the next frame into buf
+ *
+ * @param timeout_ms 0 = do not wait, -1 = wait forever
+ * @return Frame length, -EAGAIN/-ETIMEDOUT if none arrived, -ENOSPC if
+ *         buf is too small (info->len holds the size needed), -EPIPE
+ *         once the publisher has closed the ring and it is drained
+ */
+int dsv4l2_ring_read(dsv4l2_ring_sub_t *sub, void *buf, size_t buflen,
+                     dsv4l2_ring_frame_t *info, int timeout_ms);
+
+/**
+ * Total frames this consumer has missed
+ */
+uint64_t dsv4l2_ring_missed(const dsv4l2_ring_sub_t *sub);
+
+/**
+ * Unmap the ring
+ */
+void dsv4l2_ring_detach(dsv4l2_ring_sub_t *sub);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DSV4L2_RING_H */
@@ -0,0 +1,114 @@
+/*
+ * DSV4L2 Secret-Frame Arena
+ *
+ * Memory for DSMIL_SECRET_REGION data (iris frames and anything derived
+ * from them). The arena is one anonymous mapping carved into fixed-size
+ * blocks, set up once so no allocation pays for it:
+ *
+ *   - mlock()ed, so secret pages are never written to swap
+ *   - MADV_DONTDUMP, so they never appear in core dumps
+ *   - MADV_WIPEONFORK, so a forked child sees zeros
+ *
+ * Blocks are zeroized when freed and the whole arena when destroyed.
+ * Large wipes use non-temporal stores so zeroization does not evict
+ * the capture path's working set from the cache.
+ */
+
+#ifndef DSV4L2_SECRET_H
+#define DSV4L2_SECRET_H
+
+#include "dsv4l2_annotations.h"
+#include "dsv4l2_core.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct dsv4l2_secret_arena dsv4l2_secret_arena_t;
+
+/* Fail creation if the arena cannot be locked (RLIMIT_MEMLOCK) */
+#define DSV4L2_SECRET_REQUIRE_LOCK (1u << 0)
+
+/**
+ * Arena configuration
+ */
+typedef struct {
+    size_t   block_size;         /* Bytes per block (rounded up to 64) */
+    uint32_t blocks;
+    uint32_t flags;              /* DSV4L2_SECRET_* */
+} dsv4l2_secret_arena_config_t;
+
+/**
+ * Arena metrics and protections in effect
+ */
+typedef struct {
+    uint32_t blocks;
+    size_t   block_size;
+    uint32_t in_use;
+    uint32_t peak;
+    uint64_t allocs;
+    uint64_t exhausted;          /* Allocations refused: no free block */
+    int      locked;             /* mlock() succeeded */
+    int      dontdump;           /* MADV_DONTDUMP applied */
+    int      wipeonfork;         /* MADV_WIPEONFORK applied (Linux 4.14+) */
+} dsv4l2_secret_arena_stats_t;
+
+/**
+ * Create an arena
+ *
+ * @return 0 on success, -ENOMEM (or the mlock error with
+ *         DSV4L2_SECRET_REQUIRE_LOCK) on failure
+ */
+int dsv4l2_secret_arena_create(const dsv4l2_secret_arena_config_t *cfg,
+                               dsv4l2_secret_arena_t **out);
+
+/**
+ * Take a block for len bytes
+ *
+ * @return 0 on success, -EMSGSIZE if len exceeds the block size,
+ *         -EAGAIN if every block is in use
+ */
+int dsv4l2_secret_alloc(dsv4l2_secret_arena_t *arena, size_t len, void **out);
+
+/**
+ * Wipe and return a block
+ *
+ * @return 0 on success, -EINVAL if ptr is not a block in use
+ */
+int dsv4l2_secret_free(dsv4l2_secret_arena_t *arena, void *ptr);
+
+/**
+ * Zeroize memory (non-temporal stores for large ranges; never elided)
+ */
+void dsv4l2_secret_wipe(void *ptr, size_t len);
+
+/**
+ * Snapshot metrics
+ */
+int dsv4l2_secret_arena_get_stats(dsv4l2_secret_arena_t *arena,
+                                  dsv4l2_secret_arena_stats_t *stats);
+
+/**
+ * Wipe, unlock and unmap the arena (every block must be free)
+ *
+ * @return 0 on success, -EBUSY if blocks are still in use
+ */
+int dsv4l2_secret_arena_destroy(dsv4l2_secret_arena_t *arena);
+
+/**
+ * Route dsv4l2_capture_iris() through an arena (NULL to stop)
+ *
+ * With an arena attached, each iris frame is copied into an arena block
+ * before its driver buffer is requeued; the caller owns the block and
+ * returns it with dsv4l2_secret_free(arena, frame.data).
+ */
+int dsv4l2_set_secret_arena(dsv4l2_device_t *dev, dsv4l2_secret_arena_t *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DSV4L2_SECRET_H */
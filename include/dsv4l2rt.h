@@ -35,7 +35,9 @@ typedef enum {
     DSV4L2_EVENT_CAPTURE_START        = 0x0010,
     DSV4L2_EVENT_CAPTURE_STOP         = 0x0011,
     DSV4L2_EVENT_FRAME_ACQUIRED       = 0x0012,
-    DSV4L2_EVENT_FRAME_DROPPED        = 0x0013,
+    DSV4L2_EVENT_FRAME_DROPPED        = 0x0013,  // aux: frames lost (sequence gap) or DQBUF errno
+    DSV4L2_EVENT_STREAM_STALL         = 0x0014,  // aux: ms since the last frame
+    DSV4L2_EVENT_STREAM_RECOVERED     = 0x0015,  // aux: downtime in ms
     DSV4L2_EVENT_TEMPEST_TRANSITION   = 0x0020,
     DSV4L2_EVENT_TEMPEST_QUERY        = 0x0021,
     DSV4L2_EVENT_TEMPEST_LOCKDOWN     = 0x0022,
@@ -140,8 +142,14 @@ void dsv4l2rt_shutdown(void);
  */
 dsv4l2_profile_t dsv4l2rt_get_profile(void);
 
+/* Queue depth bins on the stats page (the last bin also counts deeper queues) */
+#define DSV4L2RT_DEPTH_BINS 8
+
 /**
  * Get event buffer stats (for monitoring).
+ *
+ * The buffer_* fields add up the capture buffer lifecycle of every
+ * device in the process (per-device detail: dsv4l2_get_buffer_stats()).
  */
 typedef struct {
     uint64_t events_emitted;
@@ -149,10 +157,120 @@ typedef struct {
     uint64_t events_flushed;
     size_t   buffer_usage;
     size_t   buffer_capacity;
+
+    uint64_t buffer_dequeues;        /* DQBUFs */
+    uint64_t buffer_requeues;        /* QBUFs of a dequeued buffer */
+    uint64_t buffer_driver_ns;       /* Total time queued in drivers (QBUF -> DQBUF) */
+    uint64_t buffer_app_ns;          /* Total time held by the application */
+    uint64_t buffer_app_ns_max;
+    uint64_t buffer_depth_hist[DSV4L2RT_DEPTH_BINS];  /* Buffers left queued at DQBUF */
 } dsv4l2rt_stats_t;
 
 void dsv4l2rt_get_stats(dsv4l2rt_stats_t *stats);
 
+/**
+ * Account one DQBUF on the stats page (called by the core library).
+ *
+ * @param depth Buffers still queued in the driver
+ * @param driver_ns Time the buffer spent queued (0 if unknown)
+ */
+void dsv4l2rt_note_dequeue(uint32_t depth, uint64_t driver_ns);
+
+/**
+ * Account the requeue of a dequeued buffer (called by the core library).
+ *
+ * @param app_ns Time the application held the buffer
+ */
+void dsv4l2rt_note_requeue(uint64_t app_ns);
+
+/* ========================================================================
+ * Pipeline Tracing
+ *
+ * Optional begin/end span recording for the capture pipeline (DQBUF,
+ * policy checks, event emission, sink processing). Spans are written to
+ * per-thread buffers without locks and exported as Chrome trace JSON,
+ * which chrome://tracing and ui.perfetto.dev both load.
+ *
+ * When tracing is off, each instrumentation point costs one predictable
+ * branch on dsv4l2rt_trace_active.
+ * ======================================================================== */
+
+extern volatile int dsv4l2rt_trace_active;
+
+#define DSV4L2_TRACE_BEGIN(name) do { \
+    if (__builtin_expect(dsv4l2rt_trace_active, 0)) \
+        dsv4l2rt_trace_begin(name); \
+} while (0)
+
+#define DSV4L2_TRACE_END(name) do { \
+    if (__builtin_expect(dsv4l2rt_trace_active, 0)) \
+        dsv4l2rt_trace_end(name); \
+} while (0)
+
+/**
+ * Start recording spans.
+ *
+ * Also enabled at runtime init when DSV4L2_TRACE=<path> is set; the
+ * trace is then exported to <path> by dsv4l2rt_shutdown().
+ *
+ * @param spans_per_thread Ring capacity per thread (0 = default 65536)
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2rt_trace_start(size_t spans_per_thread);
+
+/**
+ * Stop recording spans (recorded spans are kept for export).
+ */
+void dsv4l2rt_trace_stop(void);
+
+/**
+ * Open a span on the calling thread. @name must be a string literal
+ * (or otherwise outlive the trace); only the pointer is stored.
+ */
+void dsv4l2rt_trace_begin(const char *name);
+
+/**
+ * Close the innermost open span on the calling thread.
+ */
+void dsv4l2rt_trace_end(const char *name);
+
+/**
+ * Export recorded spans as Chrome trace JSON.
+ *
+ * For an exact trace call after dsv4l2rt_trace_stop(); while recording,
+ * the oldest spans of a busy thread may be overwritten during export.
+ *
+ * @param path Output file path
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2rt_trace_export(const char *path);
+
+/* ========================================================================
+ * Event Log Reader
+ * ======================================================================== */
+
+/**
+ * Parse a binary event log as written by the "file" sink.
+ *
+ * The log is a sequence of raw dsv4l2_event_t records. A trailing partial
+ * record (e.g. from a crash mid-write) is ignored. Records with an invalid
+ * severity are rejected. String fields are always NUL-terminated on output.
+ *
+ * @param data Log contents
+ * @param len Length in bytes
+ * @param events Output event array (caller must free)
+ * @param count Output event count
+ * @return 0 on success, -EBADMSG on a malformed record, -errno on error
+ */
+int dsv4l2rt_parse_event_log(const void *data, size_t len,
+                             dsv4l2_event_t **events, size_t *count);
+
+/**
+ * Read and parse an event log file written by the "file" sink.
+ */
+int dsv4l2rt_read_event_log(const char *path,
+                            dsv4l2_event_t **events, size_t *count);
+
 /* ========================================================================
  * Integration Hooks (for DSMIL fabric)
  * ======================================================================== */
@@ -0,0 +1,938 @@
+/*
+ * DSV4L2 Iris Gallery
+ *
+ * File layout (host byte order):
+ *
+ *   page 0        header
+ *   ids_offset    uint64_t id per slot
+ *   blocks_offset one 4 KiB block per 8 slots:
+ *                   code planes: word w of lanes 0-7 at [w * 8 + lane]
+ *                   mask planes: word w of lanes 0-7 at [(32 + w) * 8 + lane]
+ *
+ * The file is sized for its capacity at creation, so enrollment never
+ * remaps and a search can run while another thread enrolls (it sees
+ * the count at its start).
+ *
+ * Search kernels are vertical: a vector holds one word of every
+ * template in a block, the probe word of each rotation is broadcast,
+ * and ROT_CHUNK (four) rotations accumulate in registers at once. The
+ * probe's rotations are transposed into a word-major table so those
+ * broadcasts are sequential loads. Each block's work depends only on the number
+ * of rotations, and the best rotation per template is picked with
+ * dsv4l2_iris_select().
+ */
+
+#define _GNU_SOURCE  /* MADV_DONTDUMP */
+
+#include "dsv4l2_iris.h"
+#include "dsv4l2_pipeline.h"
+#include "dsv4l2_secret.h"
+#include "iris_internal.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GALLERY_MAGIC    "DSV4IRIS"
+#define GALLERY_VERSION  1
+#define GALLERY_PAGE     4096
+
+#define LANES            8                              /* Templates per block */
+#define BLOCK_WORDS      (2 * IRIS_WORDS * LANES)       /* 4 KiB */
+
+/* Prefilter sub-code: words 0, 8, 16 and 24 (spread over the whole iris) */
+#define PREFILTER_WORDS  4
+#define PREFILTER_STRIDE 8
+
+/* Rotations accumulated in registers per pass; tables are padded to it */
+#define ROT_CHUNK        4
+#define ROT_PADDED       (((IRIS_MAX_ROT + ROT_CHUNK - 1) / ROT_CHUNK) * ROT_CHUNK)
+
+/* Top-k heap: a full binary tree (2^n - 1 slots) at least k big */
+#define HEAP_SLOTS       127
+#define CANDIDATE_WORDS  (sizeof(dsv4l2_iris_candidate_t) / sizeof(uint64_t))
+
+_Static_assert(HEAP_SLOTS >= DSV4L2_IRIS_MAX_K, "heap holds k candidates");
+_Static_assert(sizeof(dsv4l2_iris_candidate_t) % sizeof(uint64_t) == 0, "candidate swaps by word");
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t lanes;
+    uint64_t capacity;           /* Slots, multiple of LANES */
+    uint64_t count;
+    uint64_t ids_offset;
+    uint64_t blocks_offset;
+} gallery_header_t;
+
+struct dsv4l2_iris_gallery {
+    int       fd;
+    int       writable;
+    uint8_t  *map;
+    size_t    map_len;
+    gallery_header_t *hdr;
+    uint64_t *ids;
+    uint64_t *blocks;
+    pthread_mutex_t lock;        /* Enrollment */
+};
+
+struct lane_best;
+
+/*
+ * Score every rotation of the probe table against `words` words
+ * (first, first + stride, ...) of one block and keep the best per lane
+ *
+ * table: word w, rotation r at [(w * r_pad + r) * 2] (code, then mask);
+ * rotations r_pad - 1 down to the last real one are identical
+ */
+typedef void (*gallery_kernel_fn)(const uint64_t *table, uint32_t r_pad, uint32_t rotations,
+                                  const uint64_t *block, uint32_t first, uint32_t words,
+                                  uint32_t stride, struct lane_best *best);
+
+typedef struct {
+    uint64_t  compared;
+    uint64_t  offered;
+    dsv4l2_iris_candidate_t heap[HEAP_SLOTS];   /* Worst on top */
+} search_range_t;
+
+typedef struct {
+    const dsv4l2_iris_gallery_t *g;
+    gallery_kernel_fn kernel;
+    const uint64_t *table;
+    uint32_t rotations;
+    uint32_t r_pad;
+    int      max_shift;
+    uint32_t heap_size;          /* 2^(heap_depth + 1) - 1 >= k */
+    uint32_t heap_depth;
+    uint32_t min_valid;
+    double   prefilter_hd;
+    uint64_t count;
+    uint64_t blocks;
+    uint32_t ranges;
+    search_range_t *range;       /* One per block range, whichever thread runs it */
+} search_ctx_t;
+
+/* ========================================================================
+ * Kernels
+ * ======================================================================== */
+
+/*
+ * Per lane, the raw distance / valid counts at the best rotation and
+ * that rotation's index (see dsv4l2_iris_select())
+ */
+typedef struct lane_best {
+    uint32_t distance[LANES];
+    uint32_t valid[LANES];
+    uint32_t index[LANES];
+} lane_best_t;
+
+DSMIL_SECRET_REGION
+static void scan_scalar(const uint64_t *table, uint32_t r_pad, uint32_t rotations,
+                        const uint64_t *block, uint32_t first, uint32_t words,
+                        uint32_t stride, lane_best_t *best)
+{
+    uint32_t distance[ROT_PADDED * LANES], valid[ROT_PADDED * LANES];
+    dsv4l2_iris_match_t m;
+    uint32_t r, n, l;
+
+    memset(distance, 0, sizeof(distance));
+    memset(valid, 0, sizeof(valid));
+
+    for (n = 0; n < words; n++) {
+        uint32_t w = first + n * stride;
+        const uint64_t *gc = block + w * LANES;
+        const uint64_t *gm = block + (IRIS_WORDS + w) * LANES;
+
+        for (r = 0; r < rotations; r++) {
+            uint64_t pc = table[(w * r_pad + r) * 2];
+            uint64_t pm = table[(w * r_pad + r) * 2 + 1];
+
+            for (l = 0; l < LANES; l++) {
+                uint64_t both = pm & gm[l];
+
+                distance[r * LANES + l] += (uint32_t)dsv4l2_iris_popcount64((pc ^ gc[l]) & both);
+                valid[r * LANES + l] += (uint32_t)dsv4l2_iris_popcount64(both);
+            }
+        }
+    }
+
+    for (l = 0; l < LANES; l++) {
+        dsv4l2_iris_select(distance + l, valid + l, LANES, rotations, 0, &m);
+        best->distance[l] = m.distance;
+        best->valid[l] = m.valid;
+        best->index[l] = (uint32_t)m.shift;
+    }
+
+    dsv4l2_secret_wipe(distance, sizeof(distance));
+    dsv4l2_secret_wipe(valid, sizeof(valid));
+}
+
+#if IRIS_X86
+/*
+ * The SIMD kernels fuse the selection into the scan: each chunk of
+ * ROT_CHUNK rotations is folded into a running per-lane best as soon
+ * as its counts are complete. The best starts as 1 / 0 (worse than
+ * anything) so the first rotation always replaces it; padding
+ * rotations repeat the last one and never win a strict comparison.
+ */
+
+/* Four 64-bit lanes to uint32_t */
+__attribute__((target("avx2")))
+static inline void store_u32x4_avx2(uint32_t *dst, __m256i v)
+{
+    __m256i packed = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+
+    _mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(packed));
+}
+
+/* Half a block (4 lanes) per pass */
+DSMIL_SECRET_REGION
+__attribute__((target("avx2")))
+static void scan_avx2(const uint64_t *table, uint32_t r_pad, uint32_t rotations,
+                      const uint64_t *block, uint32_t first, uint32_t words,
+                      uint32_t stride, lane_best_t *best)
+{
+    const __m256i lut = IRIS_NIBBLE_LUT_AVX2;
+    const __m256i low = _mm256_set1_epi8(0x0F);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi64x(1);
+    uint32_t half, c, n, j;
+
+    (void)rotations;
+
+    for (half = 0; half < LANES; half += 4) {
+        __m256i bd = one, bv = zero, braw = zero, bi = zero;
+
+        for (c = 0; c < r_pad; c += ROT_CHUNK) {
+            __m256i d[ROT_CHUNK], v[ROT_CHUNK];
+
+            for (j = 0; j < ROT_CHUNK; j++) {
+                d[j] = zero;
+                v[j] = zero;
+            }
+
+            for (n = 0; n < words; n++) {
+                uint32_t w = first + n * stride;
+                __m256i gc = _mm256_loadu_si256((const __m256i *)(block + w * LANES + half));
+                __m256i gm = _mm256_loadu_si256((const __m256i *)
+                                                (block + (IRIS_WORDS + w) * LANES + half));
+                const uint64_t *t = table + (w * r_pad + c) * 2;
+
+#pragma GCC unroll 4
+                for (j = 0; j < ROT_CHUNK; j++) {
+                    __m256i pc = _mm256_set1_epi64x((long long)t[2 * j]);
+                    __m256i pm = _mm256_set1_epi64x((long long)t[2 * j + 1]);
+                    __m256i both = _mm256_and_si256(pm, gm);
+                    __m256i diff = _mm256_and_si256(_mm256_xor_si256(pc, gc), both);
+
+                    d[j] = _mm256_add_epi64(d[j], _mm256_sad_epu8(
+                               dsv4l2_iris_popcount8_avx2(diff, lut, low), zero));
+                    v[j] = _mm256_add_epi64(v[j], _mm256_sad_epu8(
+                               dsv4l2_iris_popcount8_avx2(both, lut, low), zero));
+                }
+            }
+
+            for (j = 0; j < ROT_CHUNK; j++) {
+                /* No overlap scores 1 / 1; counts are small, signed compare is exact */
+                __m256i none = _mm256_and_si256(_mm256_cmpeq_epi64(v[j], zero), one);
+                __m256i dn = _mm256_add_epi64(d[j], none);
+                __m256i vn = _mm256_add_epi64(v[j], none);
+                __m256i take = _mm256_cmpgt_epi64(_mm256_mul_epu32(bd, vn),
+                                                  _mm256_mul_epu32(dn, bv));
+
+                bd = _mm256_blendv_epi8(bd, dn, take);
+                bv = _mm256_blendv_epi8(bv, vn, take);
+                braw = _mm256_blendv_epi8(braw, v[j], take);
+                bi = _mm256_blendv_epi8(bi, _mm256_set1_epi64x(c + j), take);
+            }
+        }
+
+        /* Raw distance is 0 where nothing overlapped */
+        store_u32x4_avx2(best->distance + half,
+                         _mm256_andnot_si256(_mm256_cmpeq_epi64(braw, zero), bd));
+        store_u32x4_avx2(best->valid + half, braw);
+        store_u32x4_avx2(best->index + half, bi);
+    }
+}
+
+/* A whole block per vector */
+#define SCAN_AVX512(popcount64)                                                     \
+    do {                                                                            \
+        const __m512i zero = _mm512_setzero_si512();                                \
+        const __m512i one = _mm512_set1_epi64(1);                                   \
+        __m512i bd = one, bv = zero, braw = zero, bi = zero;                        \
+        uint32_t c, n, j;                                                           \
+                                                                                    \
+        (void)rotations;                                                            \
+                                                                                    \
+        for (c = 0; c < r_pad; c += ROT_CHUNK) {                                    \
+            __m512i d[ROT_CHUNK], v[ROT_CHUNK];                                     \
+                                                                                    \
+            for (j = 0; j < ROT_CHUNK; j++) {                                       \
+                d[j] = zero;                                                        \
+                v[j] = zero;                                                        \
+            }                                                                       \
+                                                                                    \
+            for (n = 0; n < words; n++) {                                           \
+                uint32_t w = first + n * stride;                                    \
+                __m512i gc = _mm512_loadu_si512((const void *)(block + w * LANES)); \
+                __m512i gm = _mm512_loadu_si512((const void *)                      \
+                                                (block + (IRIS_WORDS + w) * LANES)); \
+                const uint64_t *t = table + (w * r_pad + c) * 2;                    \
+                                                                                    \
+                _Pragma("GCC unroll 4")                                             \
+                for (j = 0; j < ROT_CHUNK; j++) {                                   \
+                    __m512i pc = _mm512_set1_epi64((long long)t[2 * j]);            \
+                    __m512i pm = _mm512_set1_epi64((long long)t[2 * j + 1]);        \
+                    __m512i both = _mm512_and_si512(pm, gm);                        \
+                                                                                    \
+                    d[j] = _mm512_add_epi64(d[j], popcount64(                       \
+                               _mm512_and_si512(_mm512_xor_si512(pc, gc), both)));  \
+                    v[j] = _mm512_add_epi64(v[j], popcount64(both));                \
+                }                                                                   \
+            }                                                                       \
+                                                                                    \
+            for (j = 0; j < ROT_CHUNK; j++) {                                       \
+                __mmask8 none = _mm512_cmpeq_epi64_mask(v[j], zero);                \
+                __m512i dn = _mm512_mask_add_epi64(d[j], none, d[j], one);          \
+                __m512i vn = _mm512_mask_add_epi64(v[j], none, v[j], one);          \
+                __mmask8 take = _mm512_cmplt_epu64_mask(_mm512_mul_epu32(dn, bv),   \
+                                                        _mm512_mul_epu32(bd, vn));  \
+                                                                                    \
+                bd = _mm512_mask_mov_epi64(bd, take, dn);                           \
+                bv = _mm512_mask_mov_epi64(bv, take, vn);                           \
+                braw = _mm512_mask_mov_epi64(braw, take, v[j]);                     \
+                bi = _mm512_mask_mov_epi64(bi, take, _mm512_set1_epi64(c + j));     \
+            }                                                                       \
+        }                                                                           \
+                                                                                    \
+        _mm256_storeu_si256((__m256i *)best->distance, _mm512_cvtepi64_epi32(       \
+            _mm512_maskz_mov_epi64(_mm512_test_epi64_mask(braw, braw), bd)));       \
+        _mm256_storeu_si256((__m256i *)best->valid, _mm512_cvtepi64_epi32(braw));   \
+        _mm256_storeu_si256((__m256i *)best->index, _mm512_cvtepi64_epi32(bi));     \
+    } while (0)
+
+DSMIL_SECRET_REGION
+__attribute__((target("avx512f,avx512bw")))
+static void scan_avx512bw(const uint64_t *table, uint32_t r_pad, uint32_t rotations,
+                          const uint64_t *block, uint32_t first, uint32_t words,
+                          uint32_t stride, lane_best_t *best)
+{
+    SCAN_AVX512(dsv4l2_iris_popcount64_avx512bw);
+}
+
+DSMIL_SECRET_REGION
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static void scan_avx512_vpopcnt(const uint64_t *table, uint32_t r_pad, uint32_t rotations,
+                                const uint64_t *block, uint32_t first, uint32_t words,
+                                uint32_t stride, lane_best_t *best)
+{
+    SCAN_AVX512(_mm512_popcnt_epi64);
+}
+#endif
+
+static gallery_kernel_fn select_kernel(void)
+{
+    switch (dsv4l2_iris_isa()) {
+#if IRIS_X86
+    case IRIS_ISA_AVX512_VPOPCNT:
+        return scan_avx512_vpopcnt;
+    case IRIS_ISA_AVX512BW:
+        return scan_avx512bw;
+    case IRIS_ISA_AVX2:
+        return scan_avx2;
+#endif
+    default:
+        return scan_scalar;
+    }
+}
+
+/* ========================================================================
+ * Files
+ * ======================================================================== */
+
+static size_t round_page(uint64_t n)
+{
+    return (size_t)((n + GALLERY_PAGE - 1) & ~(uint64_t)(GALLERY_PAGE - 1));
+}
+
+static int gallery_map(int fd, size_t len, int writable, dsv4l2_iris_gallery_t **out)
+{
+    dsv4l2_iris_gallery_t *g;
+    void *map;
+
+    map = mmap(NULL, len, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return -errno;
+    }
+
+    /* Enrolled templates are biometric data: keep them out of core dumps */
+    madvise(map, len, MADV_DONTDUMP);
+
+    g = calloc(1, sizeof(*g));
+    if (!g) {
+        munmap(map, len);
+        return -ENOMEM;
+    }
+
+    g->fd = fd;
+    g->writable = writable;
+    g->map = map;
+    g->map_len = len;
+    g->hdr = map;
+    pthread_mutex_init(&g->lock, NULL);
+
+    *out = g;
+    return 0;
+}
+
+/**
+ * Create a gallery file
+ *
+ * @param path File path
+ * @param capacity Templates it can hold
+ * @param out Gallery
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_iris_gallery_create(const char *path, uint64_t capacity,
+                               dsv4l2_iris_gallery_t **out)
+{
+    dsv4l2_iris_gallery_t *g;
+    gallery_header_t hdr;
+    size_t len;
+    int fd, rc;
+
+    if (!path || !out || capacity == 0 || capacity > (UINT64_C(1) << 40)) {
+        return -EINVAL;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, GALLERY_MAGIC, sizeof(hdr.magic));
+    hdr.version = GALLERY_VERSION;
+    hdr.lanes = LANES;
+    hdr.capacity = (capacity + LANES - 1) / LANES * LANES;
+    hdr.ids_offset = GALLERY_PAGE;
+    hdr.blocks_offset = hdr.ids_offset + round_page(hdr.capacity * sizeof(uint64_t));
+    len = (size_t)(hdr.blocks_offset + hdr.capacity / LANES * BLOCK_WORDS * sizeof(uint64_t));
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    if (ftruncate(fd, (off_t)len) < 0) {
+        rc = -errno;
+        close(fd);
+        return rc;
+    }
+
+    rc = gallery_map(fd, len, 1, &g);
+    if (rc < 0) {
+        close(fd);
+        return rc;
+    }
+
+    memcpy(g->hdr, &hdr, sizeof(hdr));
+    g->ids = (uint64_t *)(g->map + hdr.ids_offset);
+    g->blocks = (uint64_t *)(g->map + hdr.blocks_offset);
+
+    *out = g;
+    return 0;
+}
+
+/**
+ * Open a gallery file
+ *
+ * @param path File path
+ * @param writable Nonzero to allow enrollment
+ * @param out Gallery
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_iris_gallery_open(const char *path, int writable,
+                             dsv4l2_iris_gallery_t **out)
+{
+    dsv4l2_iris_gallery_t *g;
+    const gallery_header_t *hdr;
+    struct stat st;
+    uint64_t blocks_len;
+    int fd, rc;
+
+    if (!path || !out) {
+        return -EINVAL;
+    }
+
+    fd = open(path, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    if (fstat(fd, &st) < 0) {
+        rc = -errno;
+        close(fd);
+        return rc;
+    }
+    if ((uint64_t)st.st_size < GALLERY_PAGE) {
+        close(fd);
+        return -EBADMSG;
+    }
+
+    rc = gallery_map(fd, (size_t)st.st_size, writable, &g);
+    if (rc < 0) {
+        close(fd);
+        return rc;
+    }
+
+    hdr = g->hdr;
+    blocks_len = hdr->capacity / LANES * BLOCK_WORDS * sizeof(uint64_t);
+    if (memcmp(hdr->magic, GALLERY_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != GALLERY_VERSION || hdr->lanes != LANES ||
+        hdr->capacity == 0 || hdr->capacity % LANES != 0 || hdr->count > hdr->capacity ||
+        hdr->capacity > (UINT64_C(1) << 40) ||
+        hdr->ids_offset != GALLERY_PAGE ||
+        hdr->blocks_offset != hdr->ids_offset + round_page(hdr->capacity * sizeof(uint64_t)) ||
+        hdr->blocks_offset + blocks_len > (uint64_t)st.st_size) {
+        dsv4l2_iris_gallery_close(g);
+        return -EBADMSG;
+    }
+
+    g->ids = (uint64_t *)(g->map + hdr->ids_offset);
+    g->blocks = (uint64_t *)(g->map + hdr->blocks_offset);
+
+    *out = g;
+    return 0;
+}
+
+/**
+ * Append a template
+ *
+ * @param g Gallery
+ * @param t Template
+ * @param id Caller's identifier
+ * @param slot Position assigned (may be NULL)
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_iris_gallery_enroll(dsv4l2_iris_gallery_t *g, const dsv4l2_iris_template_t *t,
+                               uint64_t id, uint64_t *slot)
+{
+    uint64_t *block;
+    uint64_t n;
+    uint32_t w, lane;
+
+    if (!g || !t) {
+        return -EINVAL;
+    }
+    if (!g->writable) {
+        return -EROFS;
+    }
+
+    pthread_mutex_lock(&g->lock);
+
+    n = g->hdr->count;
+    if (n >= g->hdr->capacity) {
+        pthread_mutex_unlock(&g->lock);
+        return -ENOSPC;
+    }
+
+    block = g->blocks + n / LANES * BLOCK_WORDS;
+    lane = (uint32_t)(n % LANES);
+    for (w = 0; w < IRIS_WORDS; w++) {
+        block[w * LANES + lane] = t->code[w];
+        block[(IRIS_WORDS + w) * LANES + lane] = t->mask[w];
+    }
+    g->ids[n] = id;
+
+    /* Searches read the count first: publish the slot after its data */
+    __atomic_store_n(&g->hdr->count, n + 1, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&g->lock);
+
+    if (slot) {
+        *slot = n;
+    }
+    return 0;
+}
+
+/**
+ * Enrolled template count
+ *
+ * @param g Gallery
+ * @return Count
+ */
+uint64_t dsv4l2_iris_gallery_count(const dsv4l2_iris_gallery_t *g)
+{
+    return g ? __atomic_load_n(&g->hdr->count, __ATOMIC_ACQUIRE) : 0;
+}
+
+/**
+ * Read back an enrolled template
+ *
+ * @param g Gallery
+ * @param slot Position
+ * @param t Template (may be NULL)
+ * @param id Identifier (may be NULL)
+ * @return 0 on success, -ENOENT if slot is not enrolled
+ */
+int dsv4l2_iris_gallery_get(const dsv4l2_iris_gallery_t *g, uint64_t slot,
+                            dsv4l2_iris_template_t *t, uint64_t *id)
+{
+    const uint64_t *block;
+    uint32_t w, lane;
+
+    if (!g) {
+        return -EINVAL;
+    }
+    if (slot >= dsv4l2_iris_gallery_count(g)) {
+        return -ENOENT;
+    }
+
+    if (t) {
+        block = g->blocks + slot / LANES * BLOCK_WORDS;
+        lane = (uint32_t)(slot % LANES);
+        for (w = 0; w < IRIS_WORDS; w++) {
+            t->code[w] = block[w * LANES + lane];
+            t->mask[w] = block[(IRIS_WORDS + w) * LANES + lane];
+        }
+    }
+    if (id) {
+        *id = g->ids[slot];
+    }
+    return 0;
+}
+
+/**
+ * Flush and close a gallery
+ *
+ * @param g Gallery
+ * @return 0 on success, negative errno if the flush failed
+ */
+int dsv4l2_iris_gallery_close(dsv4l2_iris_gallery_t *g)
+{
+    int rc = 0;
+
+    if (!g) {
+        return -EINVAL;
+    }
+
+    if (g->writable && msync(g->map, g->map_len, MS_SYNC) < 0) {
+        rc = -errno;
+    }
+    munmap(g->map, g->map_len);
+    close(g->fd);
+    pthread_mutex_destroy(&g->lock);
+    free(g);
+
+    return rc;
+}
+
+/* ========================================================================
+ * Search
+ * ======================================================================== */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Ranking: lower HD first, then lower slot
+ *
+ * HDs are never negative, so their bit patterns order like the values
+ * and compare as integers; (b - a) >> 63 is a > b for values below 2^63.
+ */
+static uint64_t candidate_worse(const dsv4l2_iris_candidate_t *a, const dsv4l2_iris_candidate_t *b)
+{
+    uint64_t ha, hb, hd_gt, hd_lt, slot_gt;
+
+    memcpy(&ha, &a->match.hd, sizeof(ha));
+    memcpy(&hb, &b->match.hd, sizeof(hb));
+    hd_gt = (hb - ha) >> 63;
+    hd_lt = (ha - hb) >> 63;
+    slot_gt = (b->slot - a->slot) >> 63;
+
+    return hd_gt | ((1 ^ (hd_gt | hd_lt)) & slot_gt);
+}
+
+static int candidate_cmp(const void *a, const void *b)
+{
+    return candidate_worse(a, b) ? 1 : (candidate_worse(b, a) ? -1 : 0);
+}
+
+/*
+ * Exchange a and b when swap is 1, touching both either way
+ */
+static void candidate_cswap(dsv4l2_iris_candidate_t *a, dsv4l2_iris_candidate_t *b,
+                            uint64_t swap)
+{
+    uint8_t *pa = (uint8_t *)a, *pb = (uint8_t *)b;
+    uint64_t wa, wb, mask = 0 - swap, t;
+    uint32_t i;
+
+    for (i = 0; i < CANDIDATE_WORDS; i++) {
+        memcpy(&wa, pa + i * sizeof(wa), sizeof(wa));
+        memcpy(&wb, pb + i * sizeof(wb), sizeof(wb));
+        t = (wa ^ wb) & mask;
+        wa ^= t;
+        wb ^= t;
+        memcpy(pa + i * sizeof(wa), &wa, sizeof(wa));
+        memcpy(pb + i * sizeof(wb), &wb, sizeof(wb));
+    }
+}
+
+/*
+ * Heap slots start as sentinels ranked below any real candidate, so the
+ * heap is always full
+ */
+static void heap_init(search_range_t *range, uint32_t size)
+{
+    uint32_t i;
+
+    memset(range->heap, 0, size * sizeof(range->heap[0]));
+    for (i = 0; i < size; i++) {
+        range->heap[i].slot = UINT64_MAX >> 1;
+        range->heap[i].match.hd = 2.0;
+    }
+}
+
+/*
+ * Keep the best heap_size in a max-heap ordered by candidate_worse()
+ *
+ * The candidate replaces the root when it is better (a conditional
+ * swap, so c is clobbered), then sifts down every level of the full
+ * tree with conditional swaps: the same work whatever the scores.
+ */
+static void heap_offer(const search_ctx_t *ctx, search_range_t *range,
+                       dsv4l2_iris_candidate_t *c)
+{
+    dsv4l2_iris_candidate_t *heap = range->heap;
+    uint32_t i = 0, level, child;
+
+    range->offered++;
+    candidate_cswap(&heap[0], c, candidate_worse(&heap[0], c));
+
+    for (level = 0; level < ctx->heap_depth; level++) {
+        child = 2 * i + 1;
+        child += (uint32_t)candidate_worse(&heap[child + 1], &heap[child]);
+        candidate_cswap(&heap[i], &heap[child], candidate_worse(&heap[child], &heap[i]));
+        i = child;
+    }
+}
+
+static void lane_match(const lane_best_t *best, uint32_t l, int max_shift,
+                       dsv4l2_iris_match_t *m)
+{
+    uint32_t none = (uint32_t)(((uint64_t)best->valid[l] - 1) >> 63);
+
+    m->distance = best->distance[l];
+    m->valid = best->valid[l];
+    m->shift = (int32_t)best->index[l] - max_shift;
+    m->hd = (double)(m->distance + none) / (double)(m->valid + none);
+}
+
+/*
+ * Does any enrolled template of the block come close on the sub-code?
+ */
+static int block_passes(const search_ctx_t *ctx, const uint64_t *block, uint32_t lanes)
+{
+    lane_best_t best;
+    dsv4l2_iris_match_t m;
+    uint32_t l;
+
+    ctx->kernel(ctx->table, ctx->r_pad, ctx->rotations, block, 0, PREFILTER_WORDS,
+                PREFILTER_STRIDE, &best);
+
+    for (l = 0; l < lanes; l++) {
+        lane_match(&best, l, ctx->max_shift, &m);
+        /* Nothing overlapping in the sub-code is no evidence either way */
+        if (m.valid == 0 || m.hd <= ctx->prefilter_hd) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Search block ranges [begin, end) of ctx->blocks split ctx->ranges ways
+ */
+DSMIL_SECRET_REGION
+static void search_ranges(void *arg, uint32_t begin, uint32_t end)
+{
+    const search_ctx_t *ctx = arg;
+    const double one = 1.0;
+    dsv4l2_iris_candidate_t c;
+    lane_best_t best;
+    uint64_t b, hd, one_bits, low;
+    uint32_t r, l, lanes;
+
+    memcpy(&one_bits, &one, sizeof(one_bits));
+
+    for (r = begin; r < end; r++) {
+        search_range_t *range = &ctx->range[r];
+
+        heap_init(range, ctx->heap_size);
+
+        for (b = ctx->blocks * r / ctx->ranges; b < ctx->blocks * (r + 1) / ctx->ranges; b++) {
+            const uint64_t *block = ctx->g->blocks + b * BLOCK_WORDS;
+
+            lanes = ctx->count - b * LANES < LANES ? (uint32_t)(ctx->count - b * LANES) : LANES;
+
+            if (ctx->prefilter_hd > 0 && !block_passes(ctx, block, lanes)) {
+                continue;
+            }
+
+            ctx->kernel(ctx->table, ctx->r_pad, ctx->rotations, block, 0, IRIS_WORDS, 1, &best);
+            range->compared += lanes;
+
+            for (l = 0; l < lanes; l++) {
+                lane_match(&best, l, ctx->max_shift, &c.match);
+
+                /* Too little overlap scores 1.0 (mask select, as in dsv4l2_iris_select) */
+                low = 0 - (((uint64_t)c.match.valid - ctx->min_valid) >> 63);
+                memcpy(&hd, &c.match.hd, sizeof(hd));
+                hd = (hd & ~low) | (one_bits & low);
+                memcpy(&c.match.hd, &hd, sizeof(hd));
+
+                c.slot = b * LANES + l;
+                c.id = ctx->g->ids[c.slot];
+                heap_offer(ctx, range, &c);
+            }
+        }
+    }
+
+    dsv4l2_secret_wipe(&c, sizeof(c));
+    dsv4l2_secret_wipe(&best, sizeof(best));
+}
+
+/*
+ * Word-major probe table: word w of rotation r at [(w * r_pad + r) * 2],
+ * mask word next to it; padding rotations repeat the last one
+ */
+static void build_table(const uint64_t *rot, uint32_t rotations, uint32_t r_pad,
+                        uint64_t *table)
+{
+    uint32_t w, r;
+
+    for (w = 0; w < IRIS_WORDS; w++) {
+        for (r = 0; r < r_pad; r++) {
+            const uint64_t *src = rot + (r < rotations ? r : rotations - 1) * IRIS_ROT_WORDS;
+
+            table[(w * r_pad + r) * 2] = src[w];
+            table[(w * r_pad + r) * 2 + 1] = src[IRIS_WORDS + w];
+        }
+    }
+}
+
+/**
+ * Find the k closest enrolled templates
+ *
+ * @param g Gallery
+ * @param probe Captured template
+ * @param cfg Search parameters
+ * @param out At least cfg->k entries, best first
+ * @param stats Metrics (may be NULL)
+ * @return Number of candidates written, negative errno on error
+ */
+DSMIL_SECRET_REGION
+int dsv4l2_iris_gallery_search(dsv4l2_iris_gallery_t *g, const dsv4l2_iris_template_t *probe,
+                               const dsv4l2_iris_search_t *cfg, dsv4l2_iris_candidate_t *out,
+                               dsv4l2_iris_search_stats_t *stats)
+{
+    uint64_t rot[IRIS_MAX_ROT * IRIS_ROT_WORDS] __attribute__((aligned(64)));
+    uint64_t table[IRIS_WORDS * ROT_PADDED * 2] __attribute__((aligned(64)));
+    dsv4l2_pool_t *pool = dsv4l2_pool_shared();
+    dsv4l2_pool_stats_t pool_stats;
+    dsv4l2_iris_candidate_t *all;
+    search_ctx_t ctx;
+    uint64_t start = now_ns(), compared = 0, offered = 0;
+    uint32_t i, total = 0;
+    int step, rc;
+
+    if (!g || !probe || !cfg || !out) {
+        return -EINVAL;
+    }
+
+    step = cfg->step ? cfg->step : 1;
+    if (dsv4l2_iris_check_search(cfg->max_shift, step) < 0 ||
+        cfg->k == 0 || cfg->k > DSV4L2_IRIS_MAX_K) {
+        return -EINVAL;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.g = g;
+    ctx.kernel = select_kernel();
+    ctx.rotations = (uint32_t)(2 * cfg->max_shift + 1);
+    ctx.r_pad = (ctx.rotations + ROT_CHUNK - 1) / ROT_CHUNK * ROT_CHUNK;
+    ctx.max_shift = cfg->max_shift;
+    ctx.min_valid = cfg->min_valid;
+    ctx.prefilter_hd = cfg->prefilter_hd;
+    ctx.count = dsv4l2_iris_gallery_count(g);
+    ctx.table = table;
+    while ((2u << ctx.heap_depth) - 1 < cfg->k) {
+        ctx.heap_depth++;
+    }
+    ctx.heap_size = (2u << ctx.heap_depth) - 1;
+
+    /*
+     * A fixed split, so each range owns one heap whichever pool thread
+     * runs it (and the result never depends on scheduling)
+     */
+    ctx.blocks = (ctx.count + LANES - 1) / LANES;
+    ctx.ranges = cfg->threads;
+    if (ctx.ranges == 0) {
+        ctx.ranges = pool && dsv4l2_pool_get_stats(pool, &pool_stats) == 0 ?
+                     pool_stats.threads : 1;
+    }
+    if (ctx.ranges > DSV4L2_POOL_MAX_WORKERS) {
+        ctx.ranges = DSV4L2_POOL_MAX_WORKERS;
+    }
+    if (ctx.ranges > ctx.blocks) {
+        ctx.ranges = ctx.blocks ? (uint32_t)ctx.blocks : 1;
+    }
+
+    ctx.range = calloc(ctx.ranges, sizeof(*ctx.range));
+    all = calloc((size_t)ctx.ranges * ctx.heap_size, sizeof(*all));
+    if (!ctx.range || !all) {
+        free(ctx.range);
+        free(all);
+        return -ENOMEM;
+    }
+
+    dsv4l2_iris_rotate(probe, cfg->max_shift, step, rot);
+    build_table(rot, ctx.rotations, ctx.r_pad, table);
+
+    dsv4l2_parallel_for(pool, ctx.ranges, 1, search_ranges, &ctx);
+
+    /* Sentinels rank last, so the first min(offered, k) are real */
+    for (i = 0; i < ctx.ranges; i++) {
+        memcpy(all + total, ctx.range[i].heap, ctx.heap_size * sizeof(*all));
+        total += ctx.heap_size;
+        compared += ctx.range[i].compared;
+        offered += ctx.range[i].offered;
+    }
+    qsort(all, total, sizeof(*all), candidate_cmp);
+    rc = (int)(offered < cfg->k ? offered : cfg->k);
+    memcpy(out, all, (size_t)rc * sizeof(*out));
+
+    dsv4l2_secret_wipe(rot, sizeof(rot));
+    dsv4l2_secret_wipe(table, sizeof(table));
+    dsv4l2_secret_wipe(ctx.range, ctx.ranges * sizeof(*ctx.range));
+    dsv4l2_secret_wipe(all, (size_t)total * sizeof(*all));
+    free(ctx.range);
+    free(all);
+
+    if (stats) {
+        stats->templates = ctx.count;
+        stats->compared = compared;
+        stats->elapsed_ns = now_ns() - start;
+        stats->threads = ctx.ranges;
+    }
+    return rc;
+}
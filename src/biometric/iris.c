@@ -0,0 +1,430 @@
+/*
+ * DSV4L2 Iris Template Matching
+ *
+ * A probe is prepared once: each searched rotation of its code and mask
+ * is materialised (512 bytes per rotation, so +/-16 rotations stay in
+ * L1). Scoring a reference is then straight-line work per rotation:
+ *
+ *   distance = popcount((P ^ R) & Pm & Rm)
+ *   valid    = popcount(Pm & Rm)
+ *
+ * over all rotations, followed by a branch-free minimum over the
+ * distance / valid fractions (compared by cross-multiplication, no
+ * division). Rotation counts and shift amounts are public; nothing the
+ * kernels branch on or index with is derived from template bits.
+ *
+ * Popcount never goes through a table in memory: VPOPCNTDQ, an
+ * in-register nibble shuffle (AVX-512BW / AVX2), or SWAR arithmetic in
+ * the scalar path.
+ */
+
+#include "dsv4l2_iris.h"
+#include "dsv4l2_imaging.h"
+#include "dsv4l2_secret.h"
+#include "iris_internal.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Score every rotation of a probe against one code/mask pair
+ */
+typedef void (*iris_kernel_fn)(const uint64_t *rot, uint32_t rotations,
+                               const uint64_t *code, const uint64_t *mask,
+                               uint32_t *distance, uint32_t *valid);
+
+struct dsv4l2_iris_probe {
+    uint64_t      *rot;          /* rotations x IRIS_ROT_WORDS, 64-byte aligned */
+    uint32_t       rotations;
+    int            max_shift;
+    iris_kernel_fn kernel;
+};
+
+/* ========================================================================
+ * Kernels
+ * ======================================================================== */
+
+DSMIL_SECRET_REGION
+static void score_scalar(const uint64_t *rot, uint32_t rotations,
+                         const uint64_t *code, const uint64_t *mask,
+                         uint32_t *distance, uint32_t *valid)
+{
+    uint32_t r, i;
+
+    for (r = 0; r < rotations; r++, rot += IRIS_ROT_WORDS) {
+        uint64_t d = 0, v = 0;
+
+        for (i = 0; i < IRIS_WORDS; i++) {
+            uint64_t both = rot[IRIS_WORDS + i] & mask[i];
+
+            d += dsv4l2_iris_popcount64((rot[i] ^ code[i]) & both);
+            v += dsv4l2_iris_popcount64(both);
+        }
+        distance[r] = (uint32_t)d;
+        valid[r] = (uint32_t)v;
+    }
+}
+
+#if IRIS_X86
+__attribute__((target("avx2")))
+static inline uint32_t hsum_sad_avx2(__m256i bytes)
+{
+    __m256i s = _mm256_sad_epu8(bytes, _mm256_setzero_si256());
+    __m128i t = _mm_add_epi64(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+
+    return (uint32_t)(_mm_cvtsi128_si64(t) + _mm_extract_epi64(t, 1));
+}
+
+DSMIL_SECRET_REGION
+__attribute__((target("avx2")))
+static void score_avx2(const uint64_t *rot, uint32_t rotations,
+                       const uint64_t *code, const uint64_t *mask,
+                       uint32_t *distance, uint32_t *valid)
+{
+    const __m256i lut = IRIS_NIBBLE_LUT_AVX2;
+    const __m256i low = _mm256_set1_epi8(0x0F);
+    uint32_t r, i;
+
+    /* Per-byte counts of 8 vectors fit in a byte (8 x 8): sum bytes, widen once */
+    for (r = 0; r < rotations; r++, rot += IRIS_ROT_WORDS) {
+        __m256i d = _mm256_setzero_si256();
+        __m256i v = _mm256_setzero_si256();
+
+        for (i = 0; i < IRIS_WORDS; i += 4) {
+            __m256i pc = _mm256_loadu_si256((const __m256i *)(rot + i));
+            __m256i pm = _mm256_loadu_si256((const __m256i *)(rot + IRIS_WORDS + i));
+            __m256i rc = _mm256_loadu_si256((const __m256i *)(code + i));
+            __m256i rm = _mm256_loadu_si256((const __m256i *)(mask + i));
+            __m256i both = _mm256_and_si256(pm, rm);
+
+            d = _mm256_add_epi8(d, dsv4l2_iris_popcount8_avx2(
+                    _mm256_and_si256(_mm256_xor_si256(pc, rc), both), lut, low));
+            v = _mm256_add_epi8(v, dsv4l2_iris_popcount8_avx2(both, lut, low));
+        }
+        distance[r] = hsum_sad_avx2(d);
+        valid[r] = hsum_sad_avx2(v);
+    }
+}
+
+/* The reference stays in registers (4 + 4 zmm) across all rotations */
+#define SCORE_AVX512(popcount64, reduce)                                            \
+    do {                                                                            \
+        __m512i rc[4], rm[4];                                                       \
+        uint32_t r, i;                                                              \
+                                                                                    \
+        for (i = 0; i < 4; i++) {                                                   \
+            rc[i] = _mm512_loadu_si512((const void *)(code + 8 * i));               \
+            rm[i] = _mm512_loadu_si512((const void *)(mask + 8 * i));               \
+        }                                                                           \
+        for (r = 0; r < rotations; r++, rot += IRIS_ROT_WORDS) {                    \
+            __m512i d = _mm512_setzero_si512();                                     \
+            __m512i v = _mm512_setzero_si512();                                     \
+                                                                                    \
+            for (i = 0; i < 4; i++) {                                               \
+                __m512i pc = _mm512_loadu_si512((const void *)(rot + 8 * i));       \
+                __m512i pm = _mm512_loadu_si512((const void *)(rot + IRIS_WORDS + 8 * i)); \
+                __m512i both = _mm512_and_si512(pm, rm[i]);                         \
+                                                                                    \
+                d = _mm512_add_epi64(d, popcount64(                                 \
+                        _mm512_and_si512(_mm512_xor_si512(pc, rc[i]), both)));      \
+                v = _mm512_add_epi64(v, popcount64(both));                          \
+            }                                                                       \
+            distance[r] = (uint32_t)reduce(d);                                      \
+            valid[r] = (uint32_t)reduce(v);                                         \
+        }                                                                           \
+    } while (0)
+
+DSMIL_SECRET_REGION
+__attribute__((target("avx512f,avx512bw")))
+static void score_avx512bw(const uint64_t *rot, uint32_t rotations,
+                           const uint64_t *code, const uint64_t *mask,
+                           uint32_t *distance, uint32_t *valid)
+{
+    SCORE_AVX512(dsv4l2_iris_popcount64_avx512bw, _mm512_reduce_add_epi64);
+}
+
+DSMIL_SECRET_REGION
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static void score_avx512_vpopcnt(const uint64_t *rot, uint32_t rotations,
+                                 const uint64_t *code, const uint64_t *mask,
+                                 uint32_t *distance, uint32_t *valid)
+{
+    SCORE_AVX512(_mm512_popcnt_epi64, _mm512_reduce_add_epi64);
+}
+#endif
+
+/**
+ * Best kernel family for this CPU, capped by dsv4l2_simd_level()
+ *
+ * @return IRIS_ISA_*
+ */
+int dsv4l2_iris_isa(void)
+{
+#if IRIS_X86
+    if (dsv4l2_simd_level() >= DSV4L2_SIMD_AVX2) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq")) {
+            return IRIS_ISA_AVX512_VPOPCNT;
+        }
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+            return IRIS_ISA_AVX512BW;
+        }
+        return IRIS_ISA_AVX2;
+    }
+#endif
+    return IRIS_ISA_SCALAR;
+}
+
+static iris_kernel_fn select_kernel(void)
+{
+    switch (dsv4l2_iris_isa()) {
+#if IRIS_X86
+    case IRIS_ISA_AVX512_VPOPCNT:
+        return score_avx512_vpopcnt;
+    case IRIS_ISA_AVX512BW:
+        return score_avx512bw;
+    case IRIS_ISA_AVX2:
+        return score_avx2;
+#endif
+    default:
+        return score_scalar;
+    }
+}
+
+/* ========================================================================
+ * Rotation and selection
+ * ======================================================================== */
+
+/*
+ * dst bit j = src bit (j + bits) mod 2048
+ */
+static void rotate_bits(const uint64_t *src, int bits, uint64_t *dst)
+{
+    uint32_t s = (uint32_t)(((bits % DSV4L2_IRIS_CODE_BITS) + DSV4L2_IRIS_CODE_BITS) %
+                            DSV4L2_IRIS_CODE_BITS);
+    uint32_t q = s / 64, r = s % 64, i;
+
+    for (i = 0; i < IRIS_WORDS; i++) {
+        uint64_t lo = src[(i + q) % IRIS_WORDS];
+        uint64_t hi = src[(i + q + 1) % IRIS_WORDS];
+
+        /* Two-step left shift: hi << 64 would be undefined for r = 0 */
+        dst[i] = (lo >> r) | ((hi << 1) << (63 - r));
+    }
+}
+
+/**
+ * Write every searched rotation of a template
+ *
+ * @param t Template
+ * @param max_shift Rotations each way
+ * @param step Bits per rotation step
+ * @param rot Output, (2 * max_shift + 1) x IRIS_ROT_WORDS words
+ */
+void dsv4l2_iris_rotate(const dsv4l2_iris_template_t *t, int max_shift, int step,
+                        uint64_t *rot)
+{
+    int k;
+
+    for (k = -max_shift; k <= max_shift; k++, rot += IRIS_ROT_WORDS) {
+        rotate_bits(t->code, k * step, rot);
+        rotate_bits(t->mask, k * step, rot + IRIS_WORDS);
+    }
+}
+
+/**
+ * Branch-free minimum of distance / valid over all rotations
+ *
+ * Fractions are compared as d1 * v2 < d2 * v1; with at most 2048 bits
+ * the products stay below 2^22, so the sign of the 64-bit difference
+ * is the comparison. No overlap (valid = 0) scores as 1 / 1.
+ *
+ * @param distance Disagreeing bits, rotation r at [r * stride]
+ * @param valid Overlapping bits, rotation r at [r * stride]
+ * @param stride Entries between rotations
+ * @param rotations Rotation count
+ * @param max_shift Shift of rotation 0 is -max_shift
+ * @param out Best match
+ */
+DSMIL_SECRET_REGION
+void dsv4l2_iris_select(const uint32_t *distance, const uint32_t *valid, uint32_t stride,
+                        uint32_t rotations, int max_shift, dsv4l2_iris_match_t *out)
+{
+    uint64_t none = ((uint64_t)valid[0] - 1) >> 63;
+    uint64_t best_d = distance[0] + none, best_v = valid[0] + none, best_i = 0;
+    uint64_t raw_d = distance[0], raw_v = valid[0];
+    uint32_t i;
+
+    for (i = 1; i < rotations; i++) {
+        uint64_t d, v, take;
+
+        distance += stride;
+        valid += stride;
+        none = ((uint64_t)valid[0] - 1) >> 63;
+        d = distance[0] + none;
+        v = valid[0] + none;
+        take = 0 - ((d * best_v - best_d * v) >> 63);
+
+        best_d = (best_d & ~take) | (d & take);
+        best_v = (best_v & ~take) | (v & take);
+        best_i = (best_i & ~take) | (i & take);
+        raw_d = (raw_d & ~take) | (distance[0] & take);
+        raw_v = (raw_v & ~take) | (valid[0] & take);
+    }
+
+    out->distance = (uint32_t)raw_d;
+    out->valid = (uint32_t)raw_v;
+    out->shift = (int32_t)best_i - max_shift;
+    out->hd = (double)best_d / (double)best_v;
+}
+
+/**
+ * Validate a rotation search
+ *
+ * @param max_shift Rotations each way
+ * @param step Bits per rotation step
+ * @return 0 if usable, -EINVAL otherwise
+ */
+int dsv4l2_iris_check_search(int max_shift, int step)
+{
+    if (max_shift < 0 || max_shift > DSV4L2_IRIS_MAX_SHIFT || step < 1 || step > 64) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/* ========================================================================
+ * API
+ * ======================================================================== */
+
+/**
+ * Compare two templates
+ *
+ * @param probe Template to rotate
+ * @param ref Reference template
+ * @param max_shift Rotations searched each way
+ * @param step Bits per rotation step
+ * @param out Best match
+ * @return 0 on success, negative errno on error
+ */
+DSMIL_SECRET_REGION
+int dsv4l2_iris_compare(const dsv4l2_iris_template_t *probe,
+                        const dsv4l2_iris_template_t *ref,
+                        int max_shift, int step, dsv4l2_iris_match_t *out)
+{
+    uint64_t rot[IRIS_MAX_ROT * IRIS_ROT_WORDS] __attribute__((aligned(64)));
+    uint32_t distance[IRIS_MAX_ROT], valid[IRIS_MAX_ROT];
+    uint32_t rotations = (uint32_t)(2 * max_shift + 1);
+
+    if (!probe || !ref || !out || dsv4l2_iris_check_search(max_shift, step) < 0) {
+        return -EINVAL;
+    }
+
+    dsv4l2_iris_rotate(probe, max_shift, step, rot);
+    select_kernel()(rot, rotations, ref->code, ref->mask, distance, valid);
+    dsv4l2_iris_select(distance, valid, 1, rotations, max_shift, out);
+
+    dsv4l2_secret_wipe(rot, rotations * IRIS_ROT_WORDS * sizeof(uint64_t));
+    dsv4l2_secret_wipe(distance, rotations * sizeof(distance[0]));
+    dsv4l2_secret_wipe(valid, rotations * sizeof(valid[0]));
+    return 0;
+}
+
+/**
+ * Precompute the rotations of a probe
+ *
+ * @param probe Template
+ * @param max_shift Rotations searched each way
+ * @param step Bits per rotation step
+ * @param out Prepared probe
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_iris_probe_create(const dsv4l2_iris_template_t *probe,
+                             int max_shift, int step, dsv4l2_iris_probe_t **out)
+{
+    dsv4l2_iris_probe_t *p;
+
+    if (!probe || !out || dsv4l2_iris_check_search(max_shift, step) < 0) {
+        return -EINVAL;
+    }
+
+    p = calloc(1, sizeof(*p));
+    if (!p) {
+        return -ENOMEM;
+    }
+
+    p->rotations = (uint32_t)(2 * max_shift + 1);
+    p->max_shift = max_shift;
+    p->kernel = select_kernel();
+    if (posix_memalign((void **)&p->rot, 64,
+                       p->rotations * IRIS_ROT_WORDS * sizeof(uint64_t)) != 0) {
+        free(p);
+        return -ENOMEM;
+    }
+
+    dsv4l2_iris_rotate(probe, max_shift, step, p->rot);
+
+    *out = p;
+    return 0;
+}
+
+/**
+ * Compare a prepared probe against one reference
+ *
+ * @param probe Prepared probe
+ * @param ref Reference template
+ * @param out Best match
+ * @return 0 on success, negative errno on error
+ */
+DSMIL_SECRET_REGION
+int dsv4l2_iris_probe_match(const dsv4l2_iris_probe_t *probe,
+                            const dsv4l2_iris_template_t *ref,
+                            dsv4l2_iris_match_t *out)
+{
+    uint32_t distance[IRIS_MAX_ROT], valid[IRIS_MAX_ROT];
+
+    if (!probe || !ref || !out) {
+        return -EINVAL;
+    }
+
+    probe->kernel(probe->rot, probe->rotations, ref->code, ref->mask, distance, valid);
+    dsv4l2_iris_select(distance, valid, 1, probe->rotations, probe->max_shift, out);
+
+    dsv4l2_secret_wipe(distance, probe->rotations * sizeof(distance[0]));
+    dsv4l2_secret_wipe(valid, probe->rotations * sizeof(valid[0]));
+    return 0;
+}
+
+/**
+ * Wipe and free a prepared probe
+ *
+ * @param probe Prepared probe
+ */
+void dsv4l2_iris_probe_destroy(dsv4l2_iris_probe_t *probe)
+{
+    if (!probe) {
+        return;
+    }
+
+    dsv4l2_secret_wipe(probe->rot, probe->rotations * IRIS_ROT_WORDS * sizeof(uint64_t));
+    free(probe->rot);
+    free(probe);
+}
+
+/**
+ * Name of the comparison kernel in use
+ *
+ * @return Kernel name
+ */
+const char *dsv4l2_iris_kernel(void)
+{
+    static const char *const names[] = {
+        [IRIS_ISA_SCALAR]         = "scalar",
+        [IRIS_ISA_AVX2]           = "avx2",
+        [IRIS_ISA_AVX512BW]       = "avx512bw",
+        [IRIS_ISA_AVX512_VPOPCNT] = "avx512-vpopcntdq",
+    };
+
+    return names[dsv4l2_iris_isa()];
+}
@@ -0,0 +1,112 @@
+/*
+ * DSV4L2 Iris Matching - Internal Helpers
+ *
+ * Shared by the 1:1 matcher (iris.c) and the gallery search
+ * (gallery.c): probe rotation, branch-free best-rotation selection and
+ * table-free popcount. Not installed.
+ */
+
+#ifndef DSV4L2_IRIS_INTERNAL_H
+#define DSV4L2_IRIS_INTERNAL_H
+
+#include "dsv4l2_iris.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__x86_64__)
+#define IRIS_X86 1
+#include <immintrin.h>
+#else
+#define IRIS_X86 0
+#endif
+
+#define IRIS_WORDS      DSV4L2_IRIS_CODE_WORDS
+#define IRIS_ROT_WORDS  (2 * IRIS_WORDS)         /* Code then mask */
+#define IRIS_MAX_ROT    (2 * DSV4L2_IRIS_MAX_SHIFT + 1)
+
+/**
+ * Popcount by SWAR arithmetic (__builtin_popcountll may become a
+ * libgcc table lookup without -mpopcnt)
+ */
+static inline uint64_t dsv4l2_iris_popcount64(uint64_t x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+}
+
+/* Kernel families, best last */
+#define IRIS_ISA_SCALAR          0
+#define IRIS_ISA_AVX2            1
+#define IRIS_ISA_AVX512BW        2
+#define IRIS_ISA_AVX512_VPOPCNT  3
+
+/**
+ * Best kernel family for this CPU, capped by dsv4l2_simd_level()
+ */
+int dsv4l2_iris_isa(void);
+
+#if IRIS_X86
+#define IRIS_NIBBLE_LUT_AVX2 \
+    _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, \
+                     0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4)
+
+/**
+ * Per-byte popcount by in-register nibble shuffle
+ */
+__attribute__((target("avx2")))
+static inline __m256i dsv4l2_iris_popcount8_avx2(__m256i v, __m256i lut, __m256i low)
+{
+    __m256i lo = _mm256_and_si256(v, low);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+
+    return _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo), _mm256_shuffle_epi8(lut, hi));
+}
+
+/**
+ * Per-qword popcount without VPOPCNTDQ (nibble shuffle, then SAD)
+ */
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i dsv4l2_iris_popcount64_avx512bw(__m512i v)
+{
+    const __m512i lut = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                                             1, 2, 2, 3, 2, 3, 3, 4));
+    const __m512i low = _mm512_set1_epi8(0x0F);
+    __m512i lo = _mm512_and_si512(v, low);
+    __m512i hi = _mm512_and_si512(_mm512_srli_epi16(v, 4), low);
+    __m512i bytes = _mm512_add_epi8(_mm512_shuffle_epi8(lut, lo), _mm512_shuffle_epi8(lut, hi));
+
+    return _mm512_sad_epu8(bytes, _mm512_setzero_si512());
+}
+#endif
+
+/**
+ * Validate a rotation search
+ *
+ * @return 0 if usable, -EINVAL otherwise
+ */
+int dsv4l2_iris_check_search(int max_shift, int step);
+
+/**
+ * Write the 2 * max_shift + 1 rotations of a template, each as
+ * IRIS_ROT_WORDS words (code, then mask), shift -max_shift first
+ */
+void dsv4l2_iris_rotate(const dsv4l2_iris_template_t *t, int max_shift, int step,
+                        uint64_t *rot);
+
+/**
+ * Branch-free best rotation
+ *
+ * @param distance Disagreeing bits of rotation r at [r * stride]
+ * @param valid Overlapping bits of rotation r at [r * stride]
+ * @param stride Entries between rotations
+ * @param rotations Rotation count
+ * @param max_shift Shift of rotation 0 is -max_shift
+ * @param out Best match
+ */
+void dsv4l2_iris_select(const uint32_t *distance, const uint32_t *valid, uint32_t stride,
+                        uint32_t rotations, int max_shift, dsv4l2_iris_match_t *out);
+
+#endif /* DSV4L2_IRIS_INTERNAL_H */
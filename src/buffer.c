@@ -8,6 +8,7 @@
 #include "dsv4l2_annotations.h"
 #include "dsv4l2_policy.h"
 #include "dsv4l2rt.h"
+#include "dsv4l2_internal.h"
 
 #include <linux/videodev2.h>
 #include <sys/ioctl.h>
@@ -16,31 +17,260 @@
 #include <string.h>
 #include <stdlib.h>
 
-/* Forward declarations */
-typedef struct dsv4l2_device_internal dsv4l2_device_internal_t;
-extern dsv4l2_device_internal_t *dsv4l2_get_internal(dsv4l2_device_t *dev);
-
-/* Buffer structure */
-typedef struct {
-    void *start;
-    size_t length;
-} dsv4l2_buffer_t;
-
-/* Internal device structure (partial - just what we need) */
-struct dsv4l2_device_internal {
-    dsv4l2_device_t public;
-    struct v4l2_capability cap;
-    dsv4l2_tempest_state_t tempest;
-    int tempest_ctrl_id;
-    char *profile_path;
-    char *classification;
-    int streaming;
-    uint32_t dev_id;
-
-    /* Buffer management (added here) */
-    dsv4l2_buffer_t *buffers;
-    uint32_t buffer_count;
-};
+/* Adaptive growth: this many starved gaps within the window trigger growth */
+#define GROW_STARVED_GAPS   3
+#define GROW_WINDOW_FRAMES  300
+#define GROW_STEP           2
+
+/**
+ * Keep a secret device's mapped buffers out of core dumps
+ */
+static void buffer_protect(dsv4l2_device_internal_t *internal, void *start, size_t length)
+{
+#ifdef MADV_DONTDUMP
+    if (internal->classification && strstr(internal->classification, "SECRET")) {
+        madvise(start, length, MADV_DONTDUMP);
+    }
+#else
+    (void)internal;
+    (void)start;
+    (void)length;
+#endif
+}
+
+/* ========================================================================
+ * Lifecycle accounting
+ *
+ * A buffer index is owned by exactly one side at a time (driver between
+ * QBUF and DQBUF, application otherwise), so its own fields are only
+ * written by whoever is moving it. QBUF, DQBUF and recovery are
+ * serialized by queue_lock; the device-wide counters are also read
+ * without it (stats snapshots) and so use relaxed atomics. Every DQBUF
+ * and requeue is also added to the runtime stats page
+ * (dsv4l2rt_get_stats()).
+ * ======================================================================== */
+
+/**
+ * Record a successful QBUF
+ */
+static void buffer_mark_queued(dsv4l2_device_internal_t *internal, uint32_t index)
+{
+    dsv4l2_buffer_t *b = &internal->buffers[index];
+    uint64_t now = dsv4l2_now_ns();
+
+    if (b->state == DSV4L2_BUFFER_DEQUEUED) {
+        uint64_t held = now - b->dqbuf_ns;
+
+        b->app_ns_total += held;
+        if (held > b->app_ns_max) {
+            b->app_ns_max = held;
+        }
+        dsv4l2rt_note_requeue(held);
+    }
+
+    b->qbuf_ns = now;
+    b->state = DSV4L2_BUFFER_QUEUED;
+
+    __atomic_fetch_add(&internal->buffers_queued, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Record a successful DQBUF and sample the remaining queue depth
+ *
+ * @return Buffers still queued in the driver
+ */
+static uint32_t buffer_mark_dequeued(dsv4l2_device_internal_t *internal, uint32_t index,
+                                 uint64_t now)
+{
+    dsv4l2_buffer_t *b;
+    uint64_t in_driver = 0;
+    uint32_t depth;
+
+    depth = __atomic_sub_fetch(&internal->buffers_queued, 1, __ATOMIC_RELAXED);
+    if (depth >= internal->buffer_count) {
+        /* Buffer was queued behind our back (raw ioctl); resync */
+        depth = 0;
+        __atomic_store_n(&internal->buffers_queued, 0, __ATOMIC_RELAXED);
+    }
+    if (depth >= DSV4L2_MAX_BUFFERS) {
+        depth = DSV4L2_MAX_BUFFERS - 1;
+    }
+
+    __atomic_fetch_add(&internal->depth_hist[depth], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&internal->dequeues, 1, __ATOMIC_RELAXED);
+
+    if (!internal->buffers || index >= internal->buffer_count) {
+        dsv4l2rt_note_dequeue(depth, 0);
+        return depth;
+    }
+
+    b = &internal->buffers[index];
+    if (b->state == DSV4L2_BUFFER_QUEUED) {
+        in_driver = now - b->qbuf_ns;
+
+        b->driver_ns_total += in_driver;
+        if (in_driver > b->driver_ns_max) {
+            b->driver_ns_max = in_driver;
+        }
+        b->cycles++;
+    }
+
+    b->dqbuf_ns = now;
+    b->state = DSV4L2_BUFFER_DEQUEUED;
+    dsv4l2rt_note_dequeue(depth, in_driver);
+
+    return depth;
+}
+
+/* ========================================================================
+ * Adaptive buffer count
+ * ======================================================================== */
+
+/**
+ * Add buffers to a streaming device with VIDIOC_CREATE_BUFS
+ *
+ * The tracking array is allocated for DSV4L2_MAX_BUFFERS up front, so
+ * new slots are filled in place and published by bumping buffer_count;
+ * concurrent QBUF/get_buffer callers never see the array move.
+ *
+ * @return Buffers added, or negative errno
+ */
+static int buffer_grow_live(dsv4l2_device_t *dev, dsv4l2_device_internal_t *internal,
+                            uint32_t count)
+{
+    struct v4l2_create_buffers create;
+    uint32_t i;
+
+    memset(&create, 0, sizeof(create));
+    create.count = count;
+    create.memory = V4L2_MEMORY_MMAP;
+    create.format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    if (ioctl(dev->fd, VIDIOC_G_FMT, &create.format) < 0) {
+        return -errno;
+    }
+    if (ioctl(dev->fd, VIDIOC_CREATE_BUFS, &create) < 0) {
+        return -errno;
+    }
+
+    for (i = 0; i < create.count; i++) {
+        uint32_t index = create.index + i;
+        dsv4l2_buffer_t *b;
+        struct v4l2_buffer buf;
+
+        if (index != internal->buffer_count || index >= DSV4L2_MAX_BUFFERS) {
+            break;  /* Not contiguous with what we track */
+        }
+
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = index;
+
+        if (ioctl(dev->fd, VIDIOC_QUERYBUF, &buf) < 0) {
+            break;
+        }
+
+        b = &internal->buffers[index];
+        memset(b, 0, sizeof(*b));
+        b->length = buf.length;
+        b->start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        dev->fd, buf.m.offset);
+        if (b->start == MAP_FAILED) {
+            b->start = NULL;
+            break;
+        }
+        buffer_protect(internal, b->start, b->length);
+
+        __atomic_store_n(&internal->buffer_count, index + 1, __ATOMIC_RELEASE);
+
+        if (dsv4l2_queue_buffer(dev, index) < 0) {
+            break;
+        }
+    }
+
+    return (int)i;
+}
+
+/**
+ * Feed a sequence gap to the adaptive buffer controller
+ *
+ * Only gaps where the driver had no buffer left (depth 0 after this
+ * DQBUF) count as starvation; GROW_STARVED_GAPS of them within
+ * GROW_WINDOW_FRAMES dequeues grow the buffer count by GROW_STEP.
+ */
+static void buffer_on_gap(dsv4l2_device_t *dev, dsv4l2_device_internal_t *internal,
+                          uint32_t depth)
+{
+    uint32_t target;
+    int added;
+
+    if (depth != 0) {
+        return;  /* Buffers were available: not starvation */
+    }
+
+    internal->starved_gaps++;
+
+    if (internal->grow_mode == DSV4L2_BUFFER_GROW_OFF) {
+        return;
+    }
+
+    if (internal->dequeues - internal->starve_window_start > GROW_WINDOW_FRAMES) {
+        internal->starve_window_start = internal->dequeues;
+        internal->starve_count = 0;
+    }
+
+    if (++internal->starve_count < GROW_STARVED_GAPS) {
+        return;
+    }
+
+    internal->starve_window_start = internal->dequeues;
+    internal->starve_count = 0;
+
+    target = internal->buffer_count + GROW_STEP;
+    if (target > internal->grow_max) {
+        target = internal->grow_max;
+    }
+    if (target <= internal->buffer_count) {
+        return;  /* Already at the cap */
+    }
+
+    if (target > internal->buffer_target) {
+        internal->buffer_target = target;
+    }
+
+    if (internal->grow_mode == DSV4L2_BUFFER_GROW_LIVE) {
+        added = buffer_grow_live(dev, internal, target - internal->buffer_count);
+        if (added > 0) {
+            internal->buffers_added += added;
+        }
+    }
+}
+
+/**
+ * Configure adaptive buffer growth
+ *
+ * @param dev Device handle
+ * @param mode Growth mode
+ * @param max_buffers Upper bound on the buffer count (0 = DSV4L2_MAX_BUFFERS)
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_set_buffer_growth(dsv4l2_device_t *dev, dsv4l2_buffer_grow_t mode,
+                             uint32_t max_buffers)
+{
+    dsv4l2_device_internal_t *internal;
+
+    if (!dev || mode > DSV4L2_BUFFER_GROW_LIVE || max_buffers > DSV4L2_MAX_BUFFERS) {
+        return -EINVAL;
+    }
+
+    internal = dsv4l2_get_internal(dev);
+    internal->grow_mode = mode;
+    internal->grow_max = max_buffers ? max_buffers : DSV4L2_MAX_BUFFERS;
+    internal->starve_count = 0;
+
+    return 0;
+}
 
 /**
  * Request buffers from the device
@@ -53,6 +283,7 @@ int dsv4l2_request_buffers(dsv4l2_device_t *dev, uint32_t count)
 {
     dsv4l2_device_internal_t *internal;
     struct v4l2_requestbuffers req;
+    int rc = 0;
 
     if (!dev || count == 0) {
         return -EINVAL;
@@ -60,25 +291,41 @@ int dsv4l2_request_buffers(dsv4l2_device_t *dev, uint32_t count)
 
     internal = dsv4l2_get_internal(dev);
 
+    /* Adaptive growth raised the count after an earlier starved stream */
+    if (internal->grow_mode != DSV4L2_BUFFER_GROW_OFF &&
+        internal->buffer_target > count) {
+        count = internal->buffer_target;
+    }
+
     /* Request buffers */
     memset(&req, 0, sizeof(req));
     req.count = count;
     req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     req.memory = V4L2_MEMORY_MMAP;
 
+    pthread_mutex_lock(&internal->queue_lock);
+
     if (ioctl(dev->fd, VIDIOC_REQBUFS, &req) < 0) {
-        return -errno;
+        rc = -errno;
+        goto out;
     }
 
-    /* Allocate buffer tracking array */
-    internal->buffers = calloc(req.count, sizeof(dsv4l2_buffer_t));
+    /* Allocate buffer tracking array (room for live growth) */
+    internal->buffers = calloc(req.count > DSV4L2_MAX_BUFFERS ? req.count : DSV4L2_MAX_BUFFERS,
+                               sizeof(dsv4l2_buffer_t));
     if (!internal->buffers) {
-        return -ENOMEM;
+        rc = -ENOMEM;
+        goto out;
     }
 
     internal->buffer_count = req.count;
+    internal->buffers_queued = 0;
+    internal->dequeues = 0;
+    memset(internal->depth_hist, 0, sizeof(internal->depth_hist));
 
-    return 0;
+out:
+    pthread_mutex_unlock(&internal->queue_lock);
+    return rc;
 }
 
 /**
@@ -124,6 +371,7 @@ int dsv4l2_mmap_buffers(dsv4l2_device_t *dev)
         if (internal->buffers[i].start == MAP_FAILED) {
             return -errno;
         }
+        buffer_protect(internal, internal->buffers[i].start, buf.length);
     }
 
     return 0;
@@ -140,6 +388,7 @@ int dsv4l2_queue_buffer(dsv4l2_device_t *dev, uint32_t index)
 {
     dsv4l2_device_internal_t *internal;
     struct v4l2_buffer buf;
+    int rc = 0;
 
     if (!dev) {
         return -EINVAL;
@@ -147,20 +396,24 @@ int dsv4l2_queue_buffer(dsv4l2_device_t *dev, uint32_t index)
 
     internal = dsv4l2_get_internal(dev);
 
-    if (index >= internal->buffer_count) {
-        return -EINVAL;
-    }
-
     memset(&buf, 0, sizeof(buf));
     buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     buf.memory = V4L2_MEMORY_MMAP;
     buf.index = index;
 
-    if (ioctl(dev->fd, VIDIOC_QBUF, &buf) < 0) {
-        return -errno;
+    /* Not while recovery has the stream off or the buffers torn down */
+    pthread_mutex_lock(&internal->queue_lock);
+
+    if (index >= internal->buffer_count) {
+        rc = -EINVAL;
+    } else if (ioctl(dev->fd, VIDIOC_QBUF, &buf) < 0) {
+        rc = -errno;
+    } else {
+        buffer_mark_queued(internal, index);
     }
 
-    return 0;
+    pthread_mutex_unlock(&internal->queue_lock);
+    return rc;
 }
 
 /**
@@ -172,18 +425,42 @@ int dsv4l2_queue_buffer(dsv4l2_device_t *dev, uint32_t index)
  */
 int dsv4l2_dequeue_buffer(dsv4l2_device_t *dev, struct v4l2_buffer *buf)
 {
+    dsv4l2_device_internal_t *internal;
+    uint32_t depth, lost;
+    uint64_t now;
+
     if (!dev || !buf) {
         return -EINVAL;
     }
 
+    internal = dsv4l2_get_internal(dev);
+
     memset(buf, 0, sizeof(*buf));
     buf->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     buf->memory = V4L2_MEMORY_MMAP;
 
+    pthread_mutex_lock(&internal->queue_lock);
+
     if (ioctl(dev->fd, VIDIOC_DQBUF, buf) < 0) {
-        return -errno;
+        int rc = -errno;
+
+        pthread_mutex_unlock(&internal->queue_lock);
+        return rc;
     }
 
+    now = dsv4l2_now_ns();
+    depth = buffer_mark_dequeued(internal, buf->index, now);
+    lost = dsv4l2_stats_on_dequeue(internal, buf, now);
+    dsv4l2_watchdog_on_frame(internal, now);
+
+    if (lost > 0) {
+        /* One event per gap, however many frames it spans */
+        dsv4l2rt_emit_simple(internal->dev_id, DSV4L2_EVENT_FRAME_DROPPED,
+                             DSV4L2_SEV_MEDIUM, lost);
+        buffer_on_gap(dev, internal, depth);
+    }
+
+    pthread_mutex_unlock(&internal->queue_lock);
     return 0;
 }
 
@@ -233,19 +510,109 @@ void dsv4l2_release_buffers(dsv4l2_device_t *dev)
 
     internal = dsv4l2_get_internal(dev);
 
+    pthread_mutex_lock(&internal->queue_lock);
+
+    if (internal->buffers) {
+        /* Unmap all buffers */
+        for (i = 0; i < internal->buffer_count; i++) {
+            if (internal->buffers[i].start != NULL &&
+                internal->buffers[i].start != MAP_FAILED) {
+                munmap(internal->buffers[i].start, internal->buffers[i].length);
+            }
+        }
+
+        free(internal->buffers);
+        internal->buffers = NULL;
+        internal->buffer_count = 0;
+        internal->buffers_queued = 0;
+    }
+
+    pthread_mutex_unlock(&internal->queue_lock);
+}
+
+/**
+ * Mark every buffer as returned to the application by STREAMOFF
+ *
+ * STREAMOFF implicitly dequeues all buffers without completing them, so
+ * the time they spent queued is not counted as a driver cycle.
+ *
+ * @param internal Internal device structure
+ */
+void dsv4l2_buffers_stream_off(dsv4l2_device_internal_t *internal)
+{
+    uint32_t i;
+
     if (!internal->buffers) {
         return;
     }
 
-    /* Unmap all buffers */
     for (i = 0; i < internal->buffer_count; i++) {
-        if (internal->buffers[i].start != NULL &&
-            internal->buffers[i].start != MAP_FAILED) {
-            munmap(internal->buffers[i].start, internal->buffers[i].length);
+        if (internal->buffers[i].state == DSV4L2_BUFFER_QUEUED) {
+            internal->buffers[i].state = DSV4L2_BUFFER_IDLE;
         }
     }
 
-    free(internal->buffers);
-    internal->buffers = NULL;
-    internal->buffer_count = 0;
+    __atomic_store_n(&internal->buffers_queued, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * Snapshot buffer lifecycle statistics
+ *
+ * @param dev Device handle
+ * @param stats Output statistics
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_get_buffer_stats(dsv4l2_device_t *dev, dsv4l2_queue_stats_t *stats)
+{
+    dsv4l2_device_internal_t *internal;
+    uint64_t now;
+    uint32_t i, n;
+
+    if (!dev || !stats) {
+        return -EINVAL;
+    }
+
+    internal = dsv4l2_get_internal(dev);
+    now = dsv4l2_now_ns();
+
+    memset(stats, 0, sizeof(*stats));
+    stats->buffer_count = internal->buffer_count;
+    stats->queued = __atomic_load_n(&internal->buffers_queued, __ATOMIC_RELAXED);
+    stats->dequeues = __atomic_load_n(&internal->dequeues, __ATOMIC_RELAXED);
+    stats->starved_gaps = internal->starved_gaps;
+    stats->buffers_added = internal->buffers_added;
+    stats->buffer_target = internal->buffer_target > internal->buffer_count ?
+                           internal->buffer_target : internal->buffer_count;
+
+    for (i = 0; i < DSV4L2_MAX_BUFFERS; i++) {
+        stats->depth_hist[i] = __atomic_load_n(&internal->depth_hist[i],
+                                               __ATOMIC_RELAXED);
+    }
+
+    if (!internal->buffers) {
+        return 0;
+    }
+
+    n = internal->buffer_count < DSV4L2_MAX_BUFFERS ?
+        internal->buffer_count : DSV4L2_MAX_BUFFERS;
+
+    for (i = 0; i < n; i++) {
+        const dsv4l2_buffer_t *b = &internal->buffers[i];
+        dsv4l2_buffer_stats_t *out = &stats->buffers[i];
+
+        out->state = b->state;
+        out->cycles = b->cycles;
+        out->driver_ns_total = b->driver_ns_total;
+        out->driver_ns_max = b->driver_ns_max;
+        out->app_ns_total = b->app_ns_total;
+        out->app_ns_max = b->app_ns_max;
+
+        if (b->state == DSV4L2_BUFFER_QUEUED && now > b->qbuf_ns) {
+            out->age_ns = now - b->qbuf_ns;
+        } else if (b->state == DSV4L2_BUFFER_DEQUEUED && now > b->dqbuf_ns) {
+            out->age_ns = now - b->dqbuf_ns;
+        }
+    }
+
+    return 0;
 }
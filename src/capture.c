@@ -11,36 +11,20 @@
 #include "dsv4l2_annotations.h"
 #include "dsv4l2_policy.h"
 #include "dsv4l2rt.h"
+#include "dsv4l2_internal.h"
+#include "dsv4l2_secret.h"
 
 #include <linux/videodev2.h>
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <string.h>
 
-/* Forward declarations */
-typedef struct dsv4l2_device_internal dsv4l2_device_internal_t;
-extern dsv4l2_device_internal_t *dsv4l2_get_internal(dsv4l2_device_t *dev);
-
 /* Buffer management functions */
 extern int dsv4l2_dequeue_buffer(dsv4l2_device_t *dev, struct v4l2_buffer *buf);
 extern int dsv4l2_queue_buffer(dsv4l2_device_t *dev, uint32_t index);
 extern int dsv4l2_get_buffer(dsv4l2_device_t *dev, uint32_t index,
                               void **start, size_t *length);
 
-/* Internal device structure (partial) */
-struct dsv4l2_device_internal {
-    dsv4l2_device_t public;
-    struct v4l2_capability cap;
-    dsv4l2_tempest_state_t tempest;
-    int tempest_ctrl_id;
-    char *profile_path;
-    char *classification;
-    int streaming;
-    uint32_t dev_id;
-    void *buffers;
-    uint32_t buffer_count;
-};
-
 /**
  * Start streaming
  *
@@ -58,16 +42,26 @@ int dsv4l2_start_streaming(dsv4l2_device_t *dev)
 
     internal = dsv4l2_get_internal(dev);
 
+    pthread_mutex_lock(&internal->queue_lock);
+
     if (internal->streaming) {
+        pthread_mutex_unlock(&internal->queue_lock);
         return 0;  /* Already streaming */
     }
 
     type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     if (ioctl(dev->fd, VIDIOC_STREAMON, &type) < 0) {
-        return -errno;
+        int rc = -errno;
+
+        pthread_mutex_unlock(&internal->queue_lock);
+        return rc;
     }
 
     internal->streaming = 1;
+    dsv4l2_stats_on_stream_on(internal);
+    dsv4l2_watchdog_on_stream_on(internal);
+
+    pthread_mutex_unlock(&internal->queue_lock);
 
     /* Emit streaming start event */
     dsv4l2rt_emit_simple(internal->dev_id, DSV4L2_EVENT_CAPTURE_START,
@@ -93,16 +87,26 @@ int dsv4l2_stop_streaming(dsv4l2_device_t *dev)
 
     internal = dsv4l2_get_internal(dev);
 
+    pthread_mutex_lock(&internal->queue_lock);
+
     if (!internal->streaming) {
+        pthread_mutex_unlock(&internal->queue_lock);
         return 0;  /* Not streaming */
     }
 
     type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     if (ioctl(dev->fd, VIDIOC_STREAMOFF, &type) < 0) {
-        return -errno;
+        int rc = -errno;
+
+        pthread_mutex_unlock(&internal->queue_lock);
+        return rc;
     }
 
+    /* A QBUF racing this lands either before (and is undone here) or after */
     internal->streaming = 0;
+    dsv4l2_buffers_stream_off(internal);
+
+    pthread_mutex_unlock(&internal->queue_lock);
 
     /* Emit streaming stop event */
     dsv4l2rt_emit_simple(internal->dev_id, DSV4L2_EVENT_CAPTURE_STOP,
@@ -140,8 +144,11 @@ int dsv4l2_capture_frame(dsv4l2_device_t *dev, dsv4l2_frame_t *out)
     internal = dsv4l2_get_internal(dev);
 
     /* CRITICAL: TEMPEST state check (REQUIRED by DSLLVM) */
+    DSV4L2_TRACE_BEGIN("policy_check");
     dsv4l2_tempest_state_t state = dsv4l2_get_tempest_state(dev);
-    if (dsv4l2_policy_check(state, "capture_frame") != 0) {
+    rc = dsv4l2_policy_check(state, "capture_frame");
+    DSV4L2_TRACE_END("policy_check");
+    if (rc != 0) {
         /* Policy violation: emit event */
         dsv4l2rt_emit_simple(internal->dev_id, DSV4L2_EVENT_POLICY_VIOLATION,
                              DSV4L2_SEV_CRITICAL, state);
@@ -157,11 +164,16 @@ int dsv4l2_capture_frame(dsv4l2_device_t *dev, dsv4l2_frame_t *out)
     }
 
     /* Dequeue buffer */
+    DSV4L2_TRACE_BEGIN("dqbuf");
     rc = dsv4l2_dequeue_buffer(dev, &buf);
+    DSV4L2_TRACE_END("dqbuf");
     if (rc < 0) {
-        /* Emit frame dropped event */
-        dsv4l2rt_emit_simple(internal->dev_id, DSV4L2_EVENT_FRAME_DROPPED,
-                             DSV4L2_SEV_MEDIUM, -rc);
+        /* DQBUF failure (no frame ready yet is not a drop; driver-side
+         * drops are reported from the sequence gap on the next DQBUF) */
+        if (rc != -EAGAIN) {
+            dsv4l2rt_emit_simple(internal->dev_id, DSV4L2_EVENT_FRAME_DROPPED,
+                                 DSV4L2_SEV_MEDIUM, -rc);
+        }
         return rc;
     }
 
@@ -181,11 +193,81 @@ int dsv4l2_capture_frame(dsv4l2_device_t *dev, dsv4l2_frame_t *out)
                          DSV4L2_SEV_INFO, buf.bytesused);
 
     /* Requeue buffer */
+    DSV4L2_TRACE_BEGIN("qbuf");
     dsv4l2_queue_buffer(dev, buf.index);
+    DSV4L2_TRACE_END("qbuf");
 
     return 0;
 }
 
+/**
+ * Capture a single frame, waiting up to timeout_ms for it
+ *
+ * The device fd is non-blocking, so dsv4l2_capture_frame() returns
+ * -EAGAIN when no frame is ready. This waits in poll() instead, with
+ * the stall watchdog (if enabled) detecting and recovering a stream
+ * that stopped delivering while we wait.
+ *
+ * @param dev Device handle
+ * @param out Output frame buffer
+ * @param timeout_ms Maximum wait (0 = do not wait, -1 = no limit)
+ * @return 0 on success, -ETIMEDOUT if no frame arrived in time,
+ *         other negative errno on error
+ */
+DSV4L2_SENSOR("camera", "L3", "UNCLASSIFIED")
+DSMIL_REQUIRES_TEMPEST_CHECK
+int dsv4l2_capture_frame_timeout(dsv4l2_device_t *dev, dsv4l2_frame_t *out,
+                                 int timeout_ms)
+{
+    dsv4l2_device_internal_t *internal;
+    uint64_t deadline = 0, now;
+    int wait_ms = -1;
+    int rc;
+
+    if (!dev || !out) {
+        return -EINVAL;
+    }
+
+    internal = dsv4l2_get_internal(dev);
+
+    /* CRITICAL: TEMPEST state check (REQUIRED by DSLLVM) */
+    DSV4L2_TRACE_BEGIN("policy_check");
+    dsv4l2_tempest_state_t state = dsv4l2_get_tempest_state(dev);
+    rc = dsv4l2_policy_check(state, "capture_frame");
+    DSV4L2_TRACE_END("policy_check");
+    if (rc != 0) {
+        dsv4l2rt_emit_simple(internal->dev_id, DSV4L2_EVENT_POLICY_VIOLATION,
+                             DSV4L2_SEV_CRITICAL, state);
+        return -EPERM;
+    }
+
+    if (timeout_ms > 0) {
+        deadline = dsv4l2_now_ns() + (uint64_t)timeout_ms * 1000000ULL;
+    }
+
+    for (;;) {
+        rc = dsv4l2_capture_frame(dev, out);
+        if (rc != -EAGAIN || timeout_ms == 0) {
+            return rc;
+        }
+
+        if (timeout_ms > 0) {
+            now = dsv4l2_now_ns();
+            if (now >= deadline) {
+                return -ETIMEDOUT;
+            }
+            wait_ms = (int)((deadline - now + 999999) / 1000000);
+        }
+
+        DSV4L2_TRACE_BEGIN("wait_frame");
+        rc = dsv4l2_wait_frame(dev, wait_ms, -1);
+        DSV4L2_TRACE_END("wait_frame");
+        if (rc < 0) {
+            return rc;
+        }
+    }
+}
+
 /**
  * Capture iris frame (biometric mode)
  *
@@ -200,6 +282,10 @@ int dsv4l2_capture_frame(dsv4l2_device_t *dev, dsv4l2_frame_t *out)
  * - No logging/network egress of biometric data
  * - TEMPEST check before capture
  *
+ * With a secret arena attached (dsv4l2_set_secret_arena()) the frame is
+ * copied into an arena block that the caller must dsv4l2_secret_free();
+ * otherwise out points into the driver buffer.
+ *
  * @param dev Device handle
  * @param out Output frame buffer (tagged as dsmil_secret)
  * @return 0 on success, negative errno on error
@@ -226,7 +312,9 @@ int dsv4l2_capture_iris(dsv4l2_device_t *dev, dsv4l2_frame_t *out)
                          DSV4L2_SEV_HIGH, 0);
 
     /* CRITICAL: TEMPEST check is MANDATORY for biometric capture */
+    DSV4L2_TRACE_BEGIN("policy_check");
     dsv4l2_tempest_state_t state = dsv4l2_get_tempest_state(dev);
+    DSV4L2_TRACE_END("policy_check");
 
     /* LOCKDOWN specifically blocks biometric capture */
     if (state == DSV4L2_TEMPEST_LOCKDOWN) {
@@ -251,7 +339,9 @@ int dsv4l2_capture_iris(dsv4l2_device_t *dev, dsv4l2_frame_t *out)
     }
 
     /* Dequeue buffer (in secret region - constant-time enforced) */
+    DSV4L2_TRACE_BEGIN("dqbuf");
     rc = dsv4l2_dequeue_buffer(dev, &buf);
+    DSV4L2_TRACE_END("dqbuf");
     if (rc < 0) {
         return rc;
     }
@@ -268,7 +358,20 @@ int dsv4l2_capture_iris(dsv4l2_device_t *dev, dsv4l2_frame_t *out)
      * - printf/fprintf/syslog of this data
      * - send/sendto/write without encryption
      * - storage without dsv4l2_store_encrypted() */
-    out->data = (uint8_t *)buffer_start;
+    if (internal->secret_arena) {
+        /* Copy into a locked, non-dumpable block; the driver buffer goes back now */
+        void *block;
+
+        rc = dsv4l2_secret_alloc(internal->secret_arena, buf.bytesused, &block);
+        if (rc < 0) {
+            dsv4l2_queue_buffer(dev, buf.index);
+            return rc;
+        }
+        memcpy(block, buffer_start, buf.bytesused);
+        out->data = block;
+    } else {
+        out->data = (uint8_t *)buffer_start;
+    }
     out->len = buf.bytesused;
 
     /* Requeue buffer */
@@ -217,6 +217,87 @@ static int cmd_info(int argc, char **argv)
     return 0;
 }
 
+/**
+ * Print capture statistics for a device
+ */
+static void print_device_stats(dsv4l2_device_t *dev)
+{
+    dsv4l2_device_stats_t stats;
+
+    if (dsv4l2_get_device_stats(dev, &stats) != 0) {
+        return;
+    }
+
+    printf("\nCapture Statistics:\n");
+    printf("  Frames:         %llu (%llu bytes)\n",
+           (unsigned long long)stats.frames, (unsigned long long)stats.bytes);
+    printf("  Frame rate:     %.2f fps (interval %.3f ms)\n",
+           stats.fps, stats.interval_ns / 1e6);
+    printf("  Sequence gaps:  %llu (%llu frames lost in driver)\n",
+           (unsigned long long)stats.sequence_gaps,
+           (unsigned long long)stats.frames_lost);
+    printf("  Error frames:   %llu\n", (unsigned long long)stats.error_frames);
+    printf("  Jitter:         p50 < %llu us, p99 < %llu us\n",
+           (unsigned long long)dsv4l2_stats_percentile_us(stats.jitter_hist, 50.0),
+           (unsigned long long)dsv4l2_stats_percentile_us(stats.jitter_hist, 99.0));
+    printf("  Latency:        p50 < %llu us, p99 < %llu us\n",
+           (unsigned long long)dsv4l2_stats_percentile_us(stats.latency_hist, 50.0),
+           (unsigned long long)dsv4l2_stats_percentile_us(stats.latency_hist, 99.0));
+}
+
+/**
+ * Print buffer lifecycle statistics for a streaming device
+ */
+static void print_buffer_stats(dsv4l2_device_t *dev)
+{
+    dsv4l2_queue_stats_t stats;
+    uint64_t starved;
+    uint32_t i, n;
+
+    if (dsv4l2_get_buffer_stats(dev, &stats) != 0) {
+        return;
+    }
+
+    n = stats.buffer_count < DSV4L2_MAX_BUFFERS ? stats.buffer_count : DSV4L2_MAX_BUFFERS;
+
+    printf("\nBuffer Statistics (%u buffers, %u queued, %llu dequeues):\n",
+           stats.buffer_count, stats.queued, (unsigned long long)stats.dequeues);
+    printf("  %-5s %-9s %8s %12s %12s %12s %12s\n",
+           "Index", "State", "Cycles", "Driver avg", "Driver max", "App avg", "App max");
+
+    for (i = 0; i < n; i++) {
+        const dsv4l2_buffer_stats_t *b = &stats.buffers[i];
+        const char *state = b->state == DSV4L2_BUFFER_QUEUED   ? "driver" :
+                            b->state == DSV4L2_BUFFER_DEQUEUED ? "app" : "idle";
+        uint64_t cycles = b->cycles ? b->cycles : 1;
+
+        printf("  %-5u %-9s %8llu %9.3f ms %9.3f ms %9.3f ms %9.3f ms\n",
+               i, state, (unsigned long long)b->cycles,
+               b->driver_ns_total / cycles / 1e6, b->driver_ns_max / 1e6,
+               b->app_ns_total / cycles / 1e6, b->app_ns_max / 1e6);
+    }
+
+    printf("  Queue depth at DQBUF:\n");
+    for (i = 0; i < DSV4L2_MAX_BUFFERS; i++) {
+        if (stats.depth_hist[i] > 0) {
+            printf("    %2u%s left queued: %llu\n", i,
+                   i == DSV4L2_MAX_BUFFERS - 1 ? "+" : " ",
+                   (unsigned long long)stats.depth_hist[i]);
+        }
+    }
+
+    printf("  Starved drops:  %llu (buffers added live: %u, next request: %u)\n",
+           (unsigned long long)stats.starved_gaps, stats.buffers_added,
+           stats.buffer_target);
+
+    starved = stats.depth_hist[0];
+    if (stats.dequeues > 0 && starved * 10 > stats.dequeues) {
+        printf("  Note: driver ran dry on %.0f%% of dequeues - raise the buffer count "
+               "or shorten the time frames are held\n",
+               100.0 * starved / stats.dequeues);
+    }
+}
+
 /**
  * Capture command - acquire frames
  */
@@ -228,6 +309,11 @@ static int cmd_capture(int argc, char **argv)
     dsv4l2_device_t *dev = NULL;
     dsv4l2_frame_t frame;
     int num_frames = 1;
+    int num_buffers = 4;
+    int show_stats = 0;
+    dsv4l2_buffer_grow_t grow = DSV4L2_BUFFER_GROW_OFF;
+    void *buf_start;
+    size_t buf_len;
     int rc;
     int i;
 
@@ -237,11 +323,14 @@ static int cmd_capture(int argc, char **argv)
         {"role",    required_argument, 0, 'r'},
         {"output",  required_argument, 0, 'o'},
         {"count",   required_argument, 0, 'n'},
+        {"buffers", required_argument, 0, 'b'},
+        {"stats",   no_argument,       0, 's'},
+        {"grow",    required_argument, 0, 'g'},
         {0, 0, 0, 0}
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "d:r:o:n:", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "d:r:o:n:b:sg:", long_options, NULL)) != -1) {
         switch (opt) {
             case 'd':
                 device_path = optarg;
@@ -255,8 +344,21 @@ static int cmd_capture(int argc, char **argv)
             case 'n':
                 num_frames = atoi(optarg);
                 break;
+            case 'b':
+                num_buffers = atoi(optarg);
+                break;
+            case 's':
+                show_stats = 1;
+                break;
+            case 'g':
+                if (strcmp(optarg, "live") == 0) {
+                    grow = DSV4L2_BUFFER_GROW_LIVE;
+                } else if (strcmp(optarg, "restart") == 0) {
+                    grow = DSV4L2_BUFFER_GROW_ON_RESTART;
+                }
+                break;
             default:
-                fprintf(stderr, "Usage: %s capture [-d device] [-r role] [-o output] [-n count]\n", argv[0]);
+                fprintf(stderr, "Usage: %s capture [-d device] [-r role] [-o output] [-n count] [-b buffers] [-s] [-g live|restart]\n", argv[0]);
                 return 1;
         }
     }
@@ -270,10 +372,28 @@ static int cmd_capture(int argc, char **argv)
         return 1;
     }
 
+    dsv4l2_set_buffer_growth(dev, grow, 0);
+
+    /* Allocate, map and queue capture buffers */
+    rc = dsv4l2_request_buffers(dev, num_buffers > 0 ? (uint32_t)num_buffers : 4);
+    if (rc == 0) {
+        rc = dsv4l2_mmap_buffers(dev);
+    }
+    for (i = 0; rc == 0 && dsv4l2_get_buffer(dev, i, &buf_start, &buf_len) == 0; i++) {
+        rc = dsv4l2_queue_buffer(dev, i);
+    }
+    if (rc != 0) {
+        fprintf(stderr, "Error: Failed to set up buffers: %s\n", strerror(-rc));
+        dsv4l2_release_buffers(dev);
+        dsv4l2_close(dev);
+        return 1;
+    }
+
     /* Start streaming */
     rc = dsv4l2_start_streaming(dev);
     if (rc != 0) {
         fprintf(stderr, "Error: Failed to start streaming: %s\n", strerror(-rc));
+        dsv4l2_release_buffers(dev);
         dsv4l2_close(dev);
         return 1;
     }
@@ -296,14 +416,17 @@ static int cmd_capture(int argc, char **argv)
                 fclose(f);
             }
         }
+    }
 
-        /* Free frame data */
-        free(frame.data);
+    if (show_stats) {
+        print_device_stats(dev);
+        print_buffer_stats(dev);
     }
 
     /* Stop streaming */
     dsv4l2_stop_streaming(dev);
 
+    dsv4l2_release_buffers(dev);
     dsv4l2_close(dev);
 
     if (output_file) {
@@ -313,6 +436,39 @@ static int cmd_capture(int argc, char **argv)
     return 0;
 }
 
+/**
+ * Print the capture buffer lifecycle section of the runtime stats
+ */
+static void print_runtime_buffer_stats(const dsv4l2rt_stats_t *stats)
+{
+    int i;
+
+    printf("\nCapture Buffers (all devices):\n");
+    printf("  Dequeues:       %llu\n", (unsigned long long)stats->buffer_dequeues);
+    printf("  Requeues:       %llu\n", (unsigned long long)stats->buffer_requeues);
+
+    if (stats->buffer_dequeues == 0) {
+        return;
+    }
+
+    printf("  In driver:      %.2f ms avg\n",
+           stats->buffer_driver_ns / (double)stats->buffer_dequeues / 1e6);
+    if (stats->buffer_requeues > 0) {
+        printf("  In application: %.2f ms avg, %.2f ms max\n",
+               stats->buffer_app_ns / (double)stats->buffer_requeues / 1e6,
+               stats->buffer_app_ns_max / 1e6);
+    }
+
+    printf("  Queue depth at DQBUF:\n");
+    for (i = 0; i < DSV4L2RT_DEPTH_BINS; i++) {
+        if (stats->buffer_depth_hist[i] == 0) {
+            continue;
+        }
+        printf("    %d%s: %llu\n", i, i == DSV4L2RT_DEPTH_BINS - 1 ? "+" : "",
+               (unsigned long long)stats->buffer_depth_hist[i]);
+    }
+}
+
 /**
  * Monitor command - watch runtime events
  */
@@ -345,6 +501,7 @@ static int cmd_monitor(int argc, char **argv)
     printf("  Events Dropped: %llu\n", (unsigned long long)stats.events_dropped);
     printf("  Events Flushed: %llu\n", (unsigned long long)stats.events_flushed);
     printf("  Buffer Usage:   %zu / %zu\n", stats.buffer_usage, stats.buffer_capacity);
+    print_runtime_buffer_stats(&stats);
 
     dsv4l2rt_shutdown();
 
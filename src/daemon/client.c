@@ -0,0 +1,301 @@
+/*
+ * DSV4L2 Capture Daemon - Client
+ *
+ * Thin synchronous wrapper around the control protocol: one request,
+ * one reply per call.
+ */
+
+#define _GNU_SOURCE  /* MSG_CMSG_CLOEXEC */
+
+#include "dsv4l2_daemon.h"
+#include "dsv4l2d_proto.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+struct dsv4l2d_client {
+    int fd;
+};
+
+/**
+ * Send a request and wait for its reply (and optional fd)
+ */
+static int transact(dsv4l2d_client_t *c, const dsv4l2d_request_t *req,
+                    dsv4l2d_reply_t *reply, int *fd_out)
+{
+    struct iovec iov = { .iov_base = reply, .iov_len = sizeof(*reply) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ssize_t n;
+
+    if (fd_out) {
+        *fd_out = -1;
+    }
+
+    if (send(c->fd, req, sizeof(*req), MSG_NOSIGNAL) != (ssize_t)sizeof(*req)) {
+        return -errno;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    n = recvmsg(c->fd, &msg, MSG_CMSG_CLOEXEC);
+    if (n < 0) {
+        return -errno;
+    }
+    if (n != (ssize_t)sizeof(*reply) || reply->version != DSV4L2D_PROTO_VERSION) {
+        return -EPROTO;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+            int fd;
+
+            memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+            if (fd_out) {
+                *fd_out = fd;
+            } else {
+                close(fd);
+            }
+        }
+    }
+
+    return reply->status;
+}
+
+static dsv4l2d_reply_t *alloc_reply(void)
+{
+    return calloc(1, sizeof(dsv4l2d_reply_t));
+}
+
+/**
+ * Connect to a daemon
+ *
+ * @param socket_path Control socket (NULL = $DSV4L2D_SOCKET or the default)
+ * @param out Output connection
+ * @return 0 on success, negative errno on error (-ENOENT if no daemon)
+ */
+int dsv4l2d_connect(const char *socket_path, dsv4l2d_client_t **out)
+{
+    dsv4l2d_client_t *c;
+    struct sockaddr_un addr;
+    int fd, rc;
+
+    if (!out) {
+        return -EINVAL;
+    }
+    if (!socket_path) {
+        socket_path = getenv("DSV4L2D_SOCKET");
+    }
+    if (!socket_path || !*socket_path) {
+        socket_path = DSV4L2D_SOCKET_PATH;
+    }
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        return -ENAMETOOLONG;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -errno;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        rc = errno == ECONNREFUSED ? -ENOENT : -errno;
+        close(fd);
+        return rc;
+    }
+
+    c = calloc(1, sizeof(*c));
+    if (!c) {
+        close(fd);
+        return -ENOMEM;
+    }
+    c->fd = fd;
+
+    *out = c;
+    return 0;
+}
+
+/**
+ * List devices
+ *
+ * @param c Connection
+ * @param devices Output array
+ * @param max Capacity of devices
+ * @param count Output: devices the daemon serves (may exceed max)
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2d_list(dsv4l2d_client_t *c, dsv4l2d_device_info_t *devices,
+                 size_t max, size_t *count)
+{
+    dsv4l2d_request_t req;
+    dsv4l2d_reply_t *reply;
+    size_t n;
+    int rc;
+
+    if (!c || (!devices && max > 0) || !count) {
+        return -EINVAL;
+    }
+
+    reply = alloc_reply();
+    if (!reply) {
+        return -ENOMEM;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.version = DSV4L2D_PROTO_VERSION;
+    req.op = DSV4L2D_OP_LIST;
+
+    rc = transact(c, &req, reply, NULL);
+    if (rc == 0) {
+        n = reply->count < DSV4L2D_MAX_DEVICES ? reply->count : DSV4L2D_MAX_DEVICES;
+        memcpy(devices, reply->devices, (n < max ? n : max) * sizeof(*devices));
+        *count = n;
+    }
+
+    free(reply);
+    return rc;
+}
+
+/**
+ * Attach to a device's frame ring
+ *
+ * @param c Connection
+ * @param id Device id
+ * @param out Output ring consumer
+ * @param info Output device info (optional)
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2d_subscribe(dsv4l2d_client_t *c, const char *id,
+                      dsv4l2_ring_sub_t **out, dsv4l2d_device_info_t *info)
+{
+    dsv4l2d_request_t req;
+    dsv4l2d_reply_t *reply;
+    int fd, rc;
+
+    if (!c || !id || !out || strlen(id) >= DSV4L2D_ID_MAX) {
+        return -EINVAL;
+    }
+
+    reply = alloc_reply();
+    if (!reply) {
+        return -ENOMEM;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.version = DSV4L2D_PROTO_VERSION;
+    req.op = DSV4L2D_OP_SUBSCRIBE;
+    snprintf(req.id, sizeof(req.id), "%s", id);
+
+    rc = transact(c, &req, reply, &fd);
+    if (rc == 0) {
+        if (fd < 0) {
+            rc = -EPROTO;
+        } else {
+            rc = dsv4l2_ring_attach_fd(fd, out);
+            if (rc == 0 && info) {
+                *info = reply->devices[0];
+            }
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    free(reply);
+    return rc;
+}
+
+/**
+ * Daemon status
+ *
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2d_status(dsv4l2d_client_t *c, dsv4l2d_status_t *status)
+{
+    dsv4l2d_request_t req;
+    dsv4l2d_reply_t *reply;
+    int rc;
+
+    if (!c || !status) {
+        return -EINVAL;
+    }
+
+    reply = alloc_reply();
+    if (!reply) {
+        return -ENOMEM;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.version = DSV4L2D_PROTO_VERSION;
+    req.op = DSV4L2D_OP_STATUS;
+
+    rc = transact(c, &req, reply, NULL);
+    if (rc == 0) {
+        *status = reply->daemon;
+    }
+
+    free(reply);
+    return rc;
+}
+
+/**
+ * Change THREATCON for every device the daemon owns
+ *
+ * @return 0 on success, -EPERM unless the caller is root or the daemon user
+ */
+int dsv4l2d_set_threatcon(dsv4l2d_client_t *c, dsmil_threatcon_t level)
+{
+    dsv4l2d_request_t req;
+    dsv4l2d_reply_t *reply;
+    int rc;
+
+    if (!c) {
+        return -EINVAL;
+    }
+
+    reply = alloc_reply();
+    if (!reply) {
+        return -ENOMEM;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.version = DSV4L2D_PROTO_VERSION;
+    req.op = DSV4L2D_OP_SET_THREATCON;
+    req.arg = (uint32_t)level;
+
+    rc = transact(c, &req, reply, NULL);
+    free(reply);
+    return rc;
+}
+
+/**
+ * Close the connection
+ *
+ * @param c Connection
+ */
+void dsv4l2d_disconnect(dsv4l2d_client_t *c)
+{
+    if (!c) {
+        return;
+    }
+
+    close(c->fd);
+    free(c);
+}
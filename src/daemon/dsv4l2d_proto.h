@@ -0,0 +1,41 @@
+/*
+ * DSV4L2 Daemon Wire Protocol
+ *
+ * One request, one reply, each a single SOCK_SEQPACKET message. A
+ * SUBSCRIBE reply carries the ring memfd as SCM_RIGHTS ancillary data.
+ * Both ends are built from this tree, so the structs go over the wire
+ * as-is; the version field catches mismatched builds.
+ */
+
+#ifndef DSV4L2D_PROTO_H
+#define DSV4L2D_PROTO_H
+
+#include "dsv4l2_daemon.h"
+
+#include <stdint.h>
+
+#define DSV4L2D_PROTO_VERSION 1
+
+typedef enum {
+    DSV4L2D_OP_LIST          = 1,
+    DSV4L2D_OP_SUBSCRIBE     = 2,
+    DSV4L2D_OP_STATUS        = 3,
+    DSV4L2D_OP_SET_THREATCON = 4,
+} dsv4l2d_op_t;
+
+typedef struct {
+    uint32_t version;
+    uint32_t op;
+    uint32_t arg;                          /* SET_THREATCON: level */
+    char     id[DSV4L2D_ID_MAX];           /* SUBSCRIBE: device id */
+} dsv4l2d_request_t;
+
+typedef struct {
+    uint32_t version;
+    int32_t  status;                       /* 0 or negative errno */
+    uint32_t count;                        /* Valid entries in devices[] */
+    dsv4l2d_status_t      daemon;          /* STATUS */
+    dsv4l2d_device_info_t devices[DSV4L2D_MAX_DEVICES];
+} dsv4l2d_reply_t;
+
+#endif /* DSV4L2D_PROTO_H */
@@ -0,0 +1,218 @@
+/*
+ * dsv4l2d - DSV4L2 Capture Daemon
+ *
+ * Opens and owns the cameras given on the command line and serves
+ * their frames to local clients (see dsv4l2_daemon.h).
+ *
+ * Usage:
+ *   dsv4l2d -d /dev/video0[:role[:id]] [-d ...] [-s socket] [-b buffers]
+ *           [-t threatcon] [-c uid:clearance ...]
+ */
+
+#include "dsv4l2_core.h"
+#include "dsv4l2_dsmil.h"
+#include "dsv4l2_daemon.h"
+#include "dsv4l2rt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <getopt.h>
+
+static void print_usage(const char *progname)
+{
+    printf("Usage: %s -d DEVICE[:ROLE[:ID]] [options]\n\n", progname);
+    printf("DSV4L2 capture daemon - owns cameras and serves frames to local clients\n\n");
+    printf("Options:\n");
+    printf("  -d, --device PATH[:ROLE[:ID]]  Camera to own (repeatable; ID defaults to videoN)\n");
+    printf("  -s, --socket PATH              Control socket (default %s)\n", DSV4L2D_SOCKET_PATH);
+    printf("  -b, --buffers N                V4L2 buffers per device (default 4)\n");
+    printf("  -t, --threatcon LEVEL          Initial THREATCON (NORMAL..EMERGENCY)\n");
+    printf("  -c, --clearance UID:LEVEL      Grant a user an explicit clearance (repeatable)\n");
+    printf("  -h, --help                     Show this help\n");
+}
+
+static int parse_threatcon(const char *name, dsmil_threatcon_t *level)
+{
+    int i;
+
+    for (i = THREATCON_NORMAL; i <= THREATCON_EMERGENCY; i++) {
+        if (strcasecmp(name, dsv4l2_threatcon_name((dsmil_threatcon_t)i)) == 0) {
+            *level = (dsmil_threatcon_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Open PATH[:ROLE[:ID]] and hand it to the server
+ */
+static int add_device(dsv4l2d_server_t *srv, char *spec, uint32_t buffers)
+{
+    char *path = spec;
+    char *role = "camera";
+    char *id = NULL;
+    char *sep;
+    char default_id[DSV4L2D_ID_MAX];
+    dsv4l2_device_t *dev;
+    int rc;
+
+    sep = strchr(path, ':');
+    if (sep) {
+        *sep = '\0';
+        role = sep + 1;
+        sep = strchr(role, ':');
+        if (sep) {
+            *sep = '\0';
+            id = sep + 1;
+        }
+    }
+    if (!id) {
+        const char *base = strrchr(path, '/');
+        snprintf(default_id, sizeof(default_id), "%s", base ? base + 1 : path);
+        id = default_id;
+    }
+
+    rc = dsv4l2_open(path, role, &dev);
+    if (rc != 0) {
+        fprintf(stderr, "dsv4l2d: %s: open failed: %s\n", path, strerror(-rc));
+        return rc;
+    }
+
+    rc = dsv4l2d_server_add_device(srv, id, dev, buffers);
+    if (rc != 0) {
+        fprintf(stderr, "dsv4l2d: %s: setup failed: %s\n", path, strerror(-rc));
+        dsv4l2_close(dev);
+        return rc;
+    }
+
+    printf("dsv4l2d: serving %s as '%s' (role %s)\n", path, id, role);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct option long_options[] = {
+        {"device",    required_argument, 0, 'd'},
+        {"socket",    required_argument, 0, 's'},
+        {"buffers",   required_argument, 0, 'b'},
+        {"threatcon", required_argument, 0, 't'},
+        {"clearance", required_argument, 0, 'c'},
+        {"help",      no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    char *devices[DSV4L2D_MAX_DEVICES];
+    char *grants[32];
+    int ndevices = 0, ngrants = 0, served = 0;
+    const char *socket_path = NULL;
+    uint32_t buffers = 0;
+    dsv4l2rt_config_t config;
+    dsv4l2d_server_t *srv;
+    dsmil_threatcon_t level;
+    sigset_t stop_signals;
+    int opt, i, rc, sig;
+
+    while ((opt = getopt_long(argc, argv, "d:s:b:t:c:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'd':
+                if (ndevices < DSV4L2D_MAX_DEVICES) {
+                    devices[ndevices++] = optarg;
+                }
+                break;
+            case 's':
+                socket_path = optarg;
+                break;
+            case 'b':
+                buffers = (uint32_t)atoi(optarg);
+                break;
+            case 't':
+                if (parse_threatcon(optarg, &level) != 0) {
+                    fprintf(stderr, "dsv4l2d: unknown THREATCON '%s'\n", optarg);
+                    return 1;
+                }
+                dsv4l2_set_threatcon(level);
+                break;
+            case 'c':
+                if (ngrants < 32) {
+                    grants[ngrants++] = optarg;
+                }
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (ndevices == 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    memset(&config, 0, sizeof(config));
+    config.profile = DSV4L2_PROFILE_OPS;
+    dsv4l2rt_init(&config);
+
+    rc = dsv4l2d_server_create(socket_path, &srv);
+    if (rc != 0) {
+        fprintf(stderr, "dsv4l2d: cannot listen on %s: %s\n",
+                socket_path ? socket_path : DSV4L2D_SOCKET_PATH, strerror(-rc));
+        dsv4l2rt_shutdown();
+        return 1;
+    }
+
+    for (i = 0; i < ngrants; i++) {
+        char *sep = strchr(grants[i], ':');
+
+        if (!sep) {
+            fprintf(stderr, "dsv4l2d: bad clearance grant '%s' (want UID:LEVEL)\n", grants[i]);
+            continue;
+        }
+        *sep = '\0';
+        dsv4l2d_server_set_clearance(srv, (uid_t)strtoul(grants[i], NULL, 10), sep + 1);
+    }
+
+    for (i = 0; i < ndevices; i++) {
+        if (add_device(srv, devices[i], buffers) == 0) {
+            served++;
+        }
+    }
+
+    if (served == 0) {
+        fprintf(stderr, "dsv4l2d: no usable devices\n");
+        dsv4l2d_server_destroy(srv);
+        dsv4l2rt_shutdown();
+        return 1;
+    }
+
+    /* Block before any thread starts so only sigwait() below sees them */
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    rc = dsv4l2d_server_start(srv);
+    if (rc != 0) {
+        fprintf(stderr, "dsv4l2d: start failed: %s\n", strerror(-rc));
+        dsv4l2d_server_destroy(srv);
+        dsv4l2rt_shutdown();
+        return 1;
+    }
+
+    printf("dsv4l2d: %d device(s), THREATCON %s\n", served,
+           dsv4l2_threatcon_name(dsv4l2_get_threatcon()));
+
+    sigwait(&stop_signals, &sig);
+
+    printf("dsv4l2d: shutting down\n");
+    dsv4l2d_server_destroy(srv);
+    dsv4l2rt_shutdown();
+    return 0;
+}
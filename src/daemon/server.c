@@ -0,0 +1,772 @@
+/*
+ * DSV4L2 Capture Daemon - Server
+ *
+ * One control thread polls the listening socket and every client
+ * connection; each owned device has a capture thread that moves frames
+ * from leases into the device's private ring. Requests are small and
+ * answered inline, so the control thread never blocks on a device.
+ * Client sockets are non-blocking: a client that stops reading its
+ * replies is dropped rather than allowed to stall everyone else.
+ *
+ * Devices and sources are registered before dsv4l2d_server_start() and
+ * never change afterwards, so the control thread reads them unlocked.
+ */
+
+#define _GNU_SOURCE  /* SO_PEERCRED, struct ucred, getgrouplist */
+
+#include "dsv4l2_daemon.h"
+#include "dsv4l2_pipeline.h"
+#include "dsv4l2rt.h"
+#include "dsv4l2d_proto.h"
+#include "../dsv4l2_internal.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <pthread.h>
+#include <poll.h>
+#include <pwd.h>
+#include <grp.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define SERVER_MAX_CLIENTS   64
+#define SERVER_MAX_GRANTS    32
+#define DEFAULT_BUFFERS      4
+#define DEFAULT_RING_SLOTS   8
+
+/* Stall watchdog for owned devices (all zero: library defaults) */
+static const dsv4l2_watchdog_config_t watchdog_defaults;
+
+typedef struct {
+    dsv4l2d_server_t     *srv;
+    char                  id[DSV4L2D_ID_MAX];
+    char                  role[32];
+    char                  classification[32];
+    uint32_t              layer;
+    dsv4l2_ring_config_t  cfg;
+    dsv4l2_ring_pub_t    *ring;
+    int                   ring_fd;   /* Read-only reopen handed to subscribers */
+    dsv4l2_device_t      *dev;       /* NULL for caller-fed sources */
+    pthread_t             thread;
+    int                   thread_started;
+} served_device_t;
+
+typedef struct {
+    int   fd;
+    uid_t uid;
+    pid_t pid;
+    char  clearance[32];
+} client_t;
+
+struct dsv4l2d_server {
+    char              path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    int               listen_fd;
+    int               wake[2];       /* Self-pipe: stop the control loop */
+    pthread_t         thread;
+    int               started;
+    int               stop;
+
+    served_device_t   devices[DSV4L2D_MAX_DEVICES];
+    size_t            ndevices;
+
+    struct {
+        uid_t uid;
+        char  clearance[32];
+    } grants[SERVER_MAX_GRANTS];
+    size_t            ngrants;
+
+    client_t          clients[SERVER_MAX_CLIENTS];
+    uint32_t          nclients;
+};
+
+/* Clearance groups, highest first */
+static const struct {
+    const char *group;
+    const char *clearance;
+} g_clearance_groups[] = {
+    { "dsv4l2-top-secret",   "TOP_SECRET" },
+    { "dsv4l2-secret",       "SECRET" },
+    { "dsv4l2-confidential", "CONFIDENTIAL" },
+    { "dsv4l2-unclassified", "UNCLASSIFIED" },
+    { NULL, NULL }
+};
+
+static void copy_str(char *dst, size_t size, const char *src)
+{
+    snprintf(dst, size, "%s", src ? src : "");
+}
+
+/**
+ * Resolve the clearance of a connecting user
+ */
+static void resolve_clearance(dsv4l2d_server_t *srv, uid_t uid, char *out, size_t size)
+{
+    struct passwd pw, *pwp = NULL;
+    gid_t groups[256];
+    int ngroups = 256;
+    char buf[4096];
+    size_t i;
+    int g, k;
+
+    for (i = 0; i < srv->ngrants; i++) {
+        if (srv->grants[i].uid == uid) {
+            copy_str(out, size, srv->grants[i].clearance);
+            return;
+        }
+    }
+
+    if (uid == 0) {
+        copy_str(out, size, "TOP_SECRET");
+        return;
+    }
+
+    copy_str(out, size, "NONE");
+
+    if (getpwuid_r(uid, &pw, buf, sizeof(buf), &pwp) != 0 || !pwp ||
+        getgrouplist(pw.pw_name, pw.pw_gid, groups, &ngroups) < 0) {
+        return;
+    }
+
+    for (k = 0; g_clearance_groups[k].group; k++) {
+        struct group gr, *grp = NULL;
+        char gbuf[4096];
+
+        if (getgrnam_r(g_clearance_groups[k].group, &gr, gbuf, sizeof(gbuf), &grp) != 0 ||
+            !grp) {
+            continue;
+        }
+        for (g = 0; g < ngroups; g++) {
+            if (groups[g] == grp->gr_gid) {
+                copy_str(out, size, g_clearance_groups[k].clearance);
+                return;
+            }
+        }
+    }
+}
+
+static served_device_t *find_device(dsv4l2d_server_t *srv, const char *id)
+{
+    size_t i;
+
+    for (i = 0; i < srv->ndevices; i++) {
+        if (strncmp(srv->devices[i].id, id, DSV4L2D_ID_MAX) == 0) {
+            return &srv->devices[i];
+        }
+    }
+    return NULL;
+}
+
+static void fill_info(const served_device_t *sd, const client_t *cl,
+                      dsv4l2d_device_info_t *info)
+{
+    dsv4l2_ring_stats_t stats;
+
+    memset(info, 0, sizeof(*info));
+    copy_str(info->id, sizeof(info->id), sd->id);
+    copy_str(info->role, sizeof(info->role), sd->role);
+    copy_str(info->classification, sizeof(info->classification), sd->classification);
+    info->layer = sd->layer;
+    info->width = sd->cfg.width;
+    info->height = sd->cfg.height;
+    info->pixelformat = sd->cfg.pixelformat;
+    if (dsv4l2_ring_get_stats(sd->ring, &stats) == 0) {
+        info->frames = stats.published;
+    }
+    info->allowed = dsv4l2_check_clearance_as(cl->clearance, sd->role,
+                                              sd->classification) == 0;
+}
+
+/* ========================================================================
+ * Capture
+ * ======================================================================== */
+
+/**
+ * Capture thread: leases from the device into its ring
+ */
+static void *device_capture(void *arg)
+{
+    served_device_t *sd = arg;
+
+    while (!__atomic_load_n(&sd->srv->stop, __ATOMIC_ACQUIRE)) {
+        dsv4l2_lease_t *lease;
+        int rc = dsv4l2_lease_acquire(sd->dev, &lease);
+
+        if (rc == 0) {
+            dsv4l2_ring_stage(lease, sd->ring);
+            dsv4l2_lease_release(lease);
+        } else if (rc == -EAGAIN) {
+            /* Bounded so the stop flag is noticed; also runs the watchdog */
+            dsv4l2_wait_frame(sd->dev, 100, -1);
+        } else {
+            /* Policy block (e.g. LOCKDOWN) or device error: back off */
+            usleep(100000);
+        }
+    }
+
+    return NULL;
+}
+
+/* ========================================================================
+ * Control
+ * ======================================================================== */
+
+static int send_reply(int fd, dsv4l2d_reply_t *reply, int pass_fd)
+{
+    struct iovec iov = { .iov_base = reply, .iov_len = sizeof(*reply) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (pass_fd >= 0) {
+        struct cmsghdr *cmsg;
+
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+    }
+
+    /* Never wait on a client: a full socket (-EAGAIN) drops it */
+    return sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) == (ssize_t)sizeof(*reply) ? 0
+                                                                                       : -errno;
+}
+
+/**
+ * Answer one request
+ *
+ * @return 0 to keep the connection, negative to drop it
+ */
+static int handle_request(dsv4l2d_server_t *srv, client_t *cl)
+{
+    dsv4l2d_request_t req;
+    dsv4l2d_reply_t *reply;
+    served_device_t *sd;
+    ssize_t n;
+    int pass_fd = -1;
+    int rc;
+    size_t i;
+
+    n = recv(cl->fd, &req, sizeof(req), 0);
+    if (n != (ssize_t)sizeof(req)) {
+        return -1;  /* Closed, error or malformed */
+    }
+
+    reply = calloc(1, sizeof(*reply));
+    if (!reply) {
+        return -1;
+    }
+    reply->version = DSV4L2D_PROTO_VERSION;
+
+    if (req.version != DSV4L2D_PROTO_VERSION) {
+        reply->status = -EPROTO;
+        goto out;
+    }
+    req.id[DSV4L2D_ID_MAX - 1] = '\0';
+
+    switch (req.op) {
+    case DSV4L2D_OP_LIST:
+        for (i = 0; i < srv->ndevices; i++) {
+            fill_info(&srv->devices[i], cl, &reply->devices[i]);
+        }
+        reply->count = (uint32_t)srv->ndevices;
+        break;
+
+    case DSV4L2D_OP_SUBSCRIBE:
+        sd = find_device(srv, req.id);
+        if (!sd) {
+            reply->status = -ENOENT;
+            break;
+        }
+        if (dsv4l2_check_clearance_as(cl->clearance, sd->role, sd->classification) != 0) {
+            /* Audit: uid in aux */
+            dsv4l2rt_emit_simple(0, DSV4L2_EVENT_POLICY_VIOLATION,
+                                 DSV4L2_SEV_HIGH, (uint32_t)cl->uid);
+            reply->status = -EPERM;
+            break;
+        }
+        fill_info(sd, cl, &reply->devices[0]);
+        reply->count = 1;
+        pass_fd = sd->ring_fd;
+        break;
+
+    case DSV4L2D_OP_STATUS:
+        reply->daemon.threatcon = dsv4l2_get_threatcon();
+        reply->daemon.devices = (uint32_t)srv->ndevices;
+        reply->daemon.clients = srv->nclients;
+        copy_str(reply->daemon.clearance, sizeof(reply->daemon.clearance), cl->clearance);
+        break;
+
+    case DSV4L2D_OP_SET_THREATCON:
+        if (cl->uid != 0 && cl->uid != geteuid()) {
+            reply->status = -EPERM;
+            break;
+        }
+        rc = dsv4l2_set_threatcon((dsmil_threatcon_t)req.arg);
+        if (rc == 0) {
+            for (i = 0; i < srv->ndevices; i++) {
+                if (srv->devices[i].dev) {
+                    dsv4l2_apply_threatcon(srv->devices[i].dev);
+                }
+            }
+        }
+        reply->status = rc;
+        break;
+
+    default:
+        reply->status = -EOPNOTSUPP;
+        break;
+    }
+
+out:
+    rc = send_reply(cl->fd, reply, pass_fd);
+    free(reply);
+    return rc;
+}
+
+static void accept_client(dsv4l2d_server_t *srv)
+{
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    client_t *cl;
+    int fd;
+
+    fd = accept4(srv->listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0) {
+        return;
+    }
+
+    if (srv->nclients >= SERVER_MAX_CLIENTS ||
+        getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+        close(fd);
+        return;
+    }
+
+    cl = &srv->clients[srv->nclients];
+    cl->fd = fd;
+    cl->uid = cred.uid;
+    cl->pid = cred.pid;
+    resolve_clearance(srv, cred.uid, cl->clearance, sizeof(cl->clearance));
+    __atomic_store_n(&srv->nclients, srv->nclients + 1, __ATOMIC_RELAXED);
+}
+
+static void drop_client(dsv4l2d_server_t *srv, uint32_t index)
+{
+    close(srv->clients[index].fd);
+    srv->clients[index] = srv->clients[srv->nclients - 1];
+    __atomic_store_n(&srv->nclients, srv->nclients - 1, __ATOMIC_RELAXED);
+}
+
+static void *control_loop(void *arg)
+{
+    dsv4l2d_server_t *srv = arg;
+    struct pollfd pfds[SERVER_MAX_CLIENTS + 2];
+
+    for (;;) {
+        uint32_t i, n = srv->nclients;
+
+        pfds[0].fd = srv->wake[0];
+        pfds[0].events = POLLIN;
+        pfds[1].fd = srv->listen_fd;
+        pfds[1].events = POLLIN;
+        for (i = 0; i < n; i++) {
+            pfds[i + 2].fd = srv->clients[i].fd;
+            pfds[i + 2].events = POLLIN;
+        }
+
+        if (poll(pfds, n + 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (pfds[0].revents) {
+            break;
+        }
+
+        /* Walk backwards: drop_client() moves the last client down */
+        for (i = n; i > 0; i--) {
+            if (pfds[i + 1].revents && handle_request(srv, &srv->clients[i - 1]) < 0) {
+                drop_client(srv, i - 1);
+            }
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            accept_client(srv);
+        }
+    }
+
+    return NULL;
+}
+
+/* ========================================================================
+ * Public API
+ * ======================================================================== */
+
+/**
+ * Create a server bound to socket_path
+ *
+ * Refuses to take over a socket another daemon is still answering on;
+ * a stale socket file is replaced.
+ *
+ * @param socket_path Control socket path (NULL for the default)
+ * @param out Output server
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2d_server_create(const char *socket_path, dsv4l2d_server_t **out)
+{
+    dsv4l2d_server_t *srv;
+    struct sockaddr_un addr;
+    int probe, rc;
+
+    if (!out) {
+        return -EINVAL;
+    }
+    if (!socket_path) {
+        socket_path = DSV4L2D_SOCKET_PATH;
+    }
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        return -ENAMETOOLONG;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    copy_str(addr.sun_path, sizeof(addr.sun_path), socket_path);
+
+    /* Live daemon on this path? */
+    probe = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (probe >= 0) {
+        rc = connect(probe, (struct sockaddr *)&addr, sizeof(addr));
+        close(probe);
+        if (rc == 0) {
+            return -EADDRINUSE;
+        }
+    }
+    unlink(socket_path);
+
+    srv = calloc(1, sizeof(*srv));
+    if (!srv) {
+        return -ENOMEM;
+    }
+    srv->wake[0] = srv->wake[1] = -1;
+    copy_str(srv->path, sizeof(srv->path), socket_path);
+
+    srv->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (srv->listen_fd < 0) {
+        rc = -errno;
+        free(srv);
+        return rc;
+    }
+
+    if (bind(srv->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(srv->listen_fd, 16) != 0 || pipe2(srv->wake, O_CLOEXEC) != 0) {
+        rc = -errno;
+        close(srv->listen_fd);
+        srv->listen_fd = -1;
+        unlink(socket_path);
+        dsv4l2d_server_destroy(srv);
+        return rc;
+    }
+
+    /* Anyone may connect; clearance decides what they get */
+    chmod(socket_path, 0666);
+
+    *out = srv;
+    return 0;
+}
+
+static served_device_t *new_entry(dsv4l2d_server_t *srv, const char *id, int *rc)
+{
+    served_device_t *sd;
+
+    *rc = 0;
+    if (!srv || !id || !*id || strlen(id) >= DSV4L2D_ID_MAX) {
+        *rc = -EINVAL;
+    } else if (srv->started) {
+        *rc = -EBUSY;
+    } else if (find_device(srv, id)) {
+        *rc = -EEXIST;
+    } else if (srv->ndevices >= DSV4L2D_MAX_DEVICES) {
+        *rc = -ENOSPC;
+    }
+    if (*rc) {
+        return NULL;
+    }
+
+    sd = &srv->devices[srv->ndevices];
+    memset(sd, 0, sizeof(*sd));
+    sd->srv = srv;
+    sd->ring_fd = -1;
+    copy_str(sd->id, sizeof(sd->id), id);
+    return sd;
+}
+
+/**
+ * Open a read-only descriptor for the ring that subscribers receive
+ *
+ * The ring is already sealed against writable mappings; handing out an
+ * O_RDONLY file as well means the fd itself grants nothing more.
+ *
+ * @return 0 on success, negative errno on error
+ */
+static int open_ring_fd(served_device_t *sd)
+{
+    char path[64];
+
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", dsv4l2_ring_fd(sd->ring));
+    sd->ring_fd = open(path, O_RDONLY | O_CLOEXEC);
+    return sd->ring_fd < 0 ? -errno : 0;
+}
+
+/**
+ * Take ownership of an open device
+ *
+ * Negotiates buffers and creates the device's ring once; clients only
+ * ever attach to the ring. The device is closed by
+ * dsv4l2d_server_destroy().
+ *
+ * @param srv Server
+ * @param id Device id clients subscribe by
+ * @param dev Open device
+ * @param buffers V4L2 buffers to request (0 = 4)
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2d_server_add_device(dsv4l2d_server_t *srv, const char *id,
+                              dsv4l2_device_t *dev, uint32_t buffers)
+{
+    dsv4l2_device_internal_t *internal;
+    served_device_t *sd;
+    struct v4l2_format fmt;
+    uint32_t i;
+    int rc;
+
+    if (!dev) {
+        return -EINVAL;
+    }
+    sd = new_entry(srv, id, &rc);
+    if (!sd) {
+        return rc;
+    }
+    internal = dsv4l2_get_internal(dev);
+
+    rc = dsv4l2_get_format(dev, &fmt);
+    if (rc < 0) {
+        return rc;
+    }
+
+    rc = dsv4l2_request_buffers(dev, buffers ? buffers : DEFAULT_BUFFERS);
+    if (rc < 0) {
+        return rc;
+    }
+    rc = dsv4l2_mmap_buffers(dev);
+    if (rc < 0) {
+        return rc;
+    }
+    for (i = 0; i < internal->buffer_count; i++) {
+        dsv4l2_queue_buffer(dev, i);
+    }
+
+    sd->cfg.slots = DEFAULT_RING_SLOTS;
+    sd->cfg.width = fmt.fmt.pix.width;
+    sd->cfg.height = fmt.fmt.pix.height;
+    sd->cfg.pixelformat = fmt.fmt.pix.pixelformat;
+    sd->cfg.slot_size = fmt.fmt.pix.sizeimage ? fmt.fmt.pix.sizeimage
+                                              : fmt.fmt.pix.width * fmt.fmt.pix.height * 4;
+
+    rc = dsv4l2_ring_create(NULL, &sd->cfg, &sd->ring);
+    if (rc < 0) {
+        return rc;
+    }
+    rc = open_ring_fd(sd);
+    if (rc < 0) {
+        dsv4l2_ring_destroy(sd->ring);
+        return rc;
+    }
+
+    sd->dev = dev;
+    copy_str(sd->role, sizeof(sd->role), dev->role);
+    copy_str(sd->classification, sizeof(sd->classification),
+             internal->classification ? internal->classification : "UNCLASSIFIED");
+    sd->layer = dev->layer;
+
+    /* Current THREATCON decides the starting TEMPEST state */
+    dsv4l2_apply_threatcon(dev);
+
+    /* Nobody is around to restart a stalled camera by hand */
+    dsv4l2_set_watchdog(dev, &watchdog_defaults);
+
+    srv->ndevices++;
+    return 0;
+}
+
+/**
+ * Serve a caller-fed ring
+ *
+ * @param srv Server
+ * @param id Source id clients subscribe by
+ * @param role Role used for clearance checks
+ * @param classification Classification used for clearance checks
+ * @param ring Private ring (owned by the caller)
+ * @param cfg Format reported to clients
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2d_server_add_source(dsv4l2d_server_t *srv, const char *id,
+                              const char *role, const char *classification,
+                              dsv4l2_ring_pub_t *ring, const dsv4l2_ring_config_t *cfg)
+{
+    served_device_t *sd;
+    int rc;
+
+    if (!role || !classification || !ring || !cfg) {
+        return -EINVAL;
+    }
+    sd = new_entry(srv, id, &rc);
+    if (!sd) {
+        return rc;
+    }
+
+    sd->ring = ring;
+    rc = open_ring_fd(sd);
+    if (rc < 0) {
+        return rc;
+    }
+    sd->cfg = *cfg;
+    copy_str(sd->role, sizeof(sd->role), role);
+    copy_str(sd->classification, sizeof(sd->classification), classification);
+
+    srv->ndevices++;
+    return 0;
+}
+
+/**
+ * Grant uid an explicit clearance
+ *
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2d_server_set_clearance(dsv4l2d_server_t *srv, uid_t uid, const char *clearance)
+{
+    size_t i;
+
+    if (!srv || !clearance || srv->started) {
+        return -EINVAL;
+    }
+
+    for (i = 0; i < srv->ngrants; i++) {
+        if (srv->grants[i].uid == uid) {
+            break;
+        }
+    }
+    if (i == SERVER_MAX_GRANTS) {
+        return -ENOSPC;
+    }
+
+    srv->grants[i].uid = uid;
+    copy_str(srv->grants[i].clearance, sizeof(srv->grants[i].clearance), clearance);
+    if (i == srv->ngrants) {
+        srv->ngrants++;
+    }
+    return 0;
+}
+
+/**
+ * Start capture threads and the control loop
+ *
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2d_server_start(dsv4l2d_server_t *srv)
+{
+    size_t i;
+    int rc;
+
+    if (!srv || srv->started) {
+        return -EINVAL;
+    }
+
+    for (i = 0; i < srv->ndevices; i++) {
+        served_device_t *sd = &srv->devices[i];
+
+        if (!sd->dev) {
+            continue;
+        }
+        if (pthread_create(&sd->thread, NULL, device_capture, sd) == 0) {
+            sd->thread_started = 1;
+        }
+    }
+
+    rc = pthread_create(&srv->thread, NULL, control_loop, srv);
+    if (rc != 0) {
+        return -rc;
+    }
+
+    srv->started = 1;
+    return 0;
+}
+
+/**
+ * Stop, close owned devices and remove the socket
+ *
+ * @param srv Server
+ */
+void dsv4l2d_server_destroy(dsv4l2d_server_t *srv)
+{
+    size_t i;
+    char byte = 0;
+
+    if (!srv) {
+        return;
+    }
+
+    __atomic_store_n(&srv->stop, 1, __ATOMIC_RELEASE);
+    if (srv->started) {
+        if (write(srv->wake[1], &byte, 1) < 0) {
+            /* Pipe cannot be full here; nothing else to do */
+        }
+        pthread_join(srv->thread, NULL);
+    }
+
+    for (i = 0; i < srv->ndevices; i++) {
+        served_device_t *sd = &srv->devices[i];
+
+        if (sd->thread_started) {
+            pthread_join(sd->thread, NULL);
+        }
+        if (sd->ring_fd >= 0) {
+            close(sd->ring_fd);
+        }
+        if (sd->dev) {
+            dsv4l2_stop_streaming(sd->dev);
+            dsv4l2_release_buffers(sd->dev);
+            dsv4l2_ring_destroy(sd->ring);
+            dsv4l2_close(sd->dev);
+        }
+    }
+
+    for (i = 0; i < srv->nclients; i++) {
+        close(srv->clients[i].fd);
+    }
+    if (srv->listen_fd >= 0) {
+        close(srv->listen_fd);
+        unlink(srv->path);
+    }
+    if (srv->wake[0] >= 0) {
+        close(srv->wake[0]);
+        close(srv->wake[1]);
+    }
+
+    free(srv);
+}
@@ -13,6 +13,7 @@
 #include "dsv4l2rt.h"
 #include "dsv4l2_profiles.h"
 #include "dsv4l2_dsmil.h"
+#include "dsv4l2_internal.h"
 
 #include <linux/videodev2.h>
 #include <sys/ioctl.h>
@@ -25,24 +26,6 @@
 #include <stdio.h>
 #include <dirent.h>
 
-/* Internal device structure (extends public dsv4l2_device_t) */
-typedef struct dsv4l2_device_internal {
-    dsv4l2_device_t public;          /* Public device handle */
-
-    /* Internal state */
-    struct v4l2_capability cap;      /* Device capabilities */
-    dsv4l2_tempest_state_t tempest;  /* Current TEMPEST state */
-    int tempest_ctrl_id;             /* v4l2 control ID for TEMPEST */
-
-    /* Profile information */
-    char *profile_path;              /* Path to loaded profile */
-    char *classification;            /* Security classification */
-
-    /* Runtime state */
-    int streaming;                   /* 1 if streaming active */
-    uint32_t dev_id;                 /* Device ID (hash) */
-} dsv4l2_device_internal_t;
-
 /* Forward declarations */
 static uint32_t hash_device_path(const char *path);
 static int load_device_profile(const char *path, const char *role,
@@ -61,6 +44,7 @@ int dsv4l2_open(const char *path, const char *role, dsv4l2_device_t **out)
 {
     int rc;
     dsv4l2_device_internal_t *dev = NULL;
+    pthread_mutexattr_t attr;
 
     if (!path || !role || !out) {
         return -EINVAL;
@@ -123,6 +107,12 @@ int dsv4l2_open(const char *path, const char *role, dsv4l2_device_t **out)
         return -EPERM;
     }
 
+    /* Recovery re-enters queue/stream calls while holding it */
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&dev->queue_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
     /* Initialize TEMPEST state to DISABLED */
     dev->tempest = DSV4L2_TEMPEST_DISABLED;
     dev->tempest_ctrl_id = 0x9a0902;  /* Default control ID */
@@ -164,6 +154,8 @@ void dsv4l2_close(dsv4l2_device_t *dev)
     free((void *)dev->role);
     free(internal->profile_path);
     free(internal->classification);
+    free(internal->leases);
+    pthread_mutex_destroy(&internal->queue_lock);
     free(internal);
 }
 
@@ -352,10 +344,15 @@ static int load_device_profile(const char *path, const char *role,
         dev->classification = strdup(profile->classification);
         dev->tempest_ctrl_id = profile->tempest_ctrl_id;
         dev->profile_path = strdup(profile->filename);
+        dev->capture_cpu = profile->capture_cpu;
+        dev->capture_priority = profile->capture_priority;
         return 0;
     }
 
     /* No profile found - use defaults based on role */
+    dev->capture_cpu = -1;
+    dev->capture_priority = 0;
+
     if (strcmp(role, "iris_scanner") == 0) {
         dev->classification = strdup("SECRET_BIOMETRIC");
         dev->tempest_ctrl_id = 0x9a0902;
@@ -0,0 +1,176 @@
+/*
+ * DSV4L2 Internal Device State
+ *
+ * Private definitions shared by the core library modules. The device
+ * handle handed to callers is the `public` member of
+ * struct dsv4l2_device_internal; every module that needs more than the
+ * public fields includes this header instead of redeclaring the struct.
+ *
+ * Not installed - nothing outside src/ may depend on this layout.
+ */
+
+#ifndef DSV4L2_INTERNAL_H
+#define DSV4L2_INTERNAL_H
+
+#include "dsv4l2_annotations.h"
+#include "dsv4l2_policy.h"
+#include "dsv4l2_core.h"
+
+#include <linux/videodev2.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+/* Mapped capture buffer and its lifecycle accounting */
+typedef struct {
+    void *start;
+    size_t length;
+
+    dsv4l2_buffer_state_t state;     /* Who currently owns the buffer */
+    uint64_t qbuf_ns;                /* Last QBUF (monotonic) */
+    uint64_t dqbuf_ns;               /* Last DQBUF (monotonic) */
+    uint64_t cycles;                 /* Completed QBUF -> DQBUF round trips */
+    uint64_t driver_ns_total;        /* Time spent queued in the driver */
+    uint64_t driver_ns_max;
+    uint64_t app_ns_total;           /* Time spent held by the application */
+    uint64_t app_ns_max;
+} dsv4l2_buffer_t;
+
+/* Capture statistics (stats.c) */
+typedef struct {
+    /* Counters: relaxed atomics, read by dsv4l2_get_device_stats() */
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t error_frames;
+    uint64_t sequence_gaps;
+    uint64_t frames_lost;
+    uint64_t jitter_hist[DSV4L2_STATS_HIST_BINS];
+    uint64_t latency_hist[DSV4L2_STATS_HIST_BINS];
+    uint32_t last_sequence;
+    uint64_t interval_ns;            /* EWMA of frame interval */
+
+    /* Dequeue-side state */
+    int      have_last;              /* last_sequence/last_ts_ns are valid */
+    uint64_t last_ts_ns;             /* Previous frame timestamp */
+    uint64_t last_interval_ns;       /* Previous raw frame interval */
+} dsv4l2_stream_stats_t;
+
+/* Stall watchdog state (watchdog.c) */
+typedef struct {
+    int enabled;
+    dsv4l2_watchdog_config_t cfg;
+    struct v4l2_format fmt;          /* Format to restore after a reopen */
+    uint64_t last_frame_ns;          /* Last DQBUF (or STREAMON) */
+    uint64_t stall_start_ns;         /* Last frame before the current stall */
+    uint32_t attempts;               /* Recovery attempts in the current stall */
+    dsv4l2_watchdog_stats_t stats;
+} dsv4l2_watchdog_state_t;
+
+/* Internal device structure (extends public dsv4l2_device_t) */
+typedef struct dsv4l2_device_internal {
+    dsv4l2_device_t public;          /* Public device handle */
+
+    /* Internal state */
+    struct v4l2_capability cap;      /* Device capabilities */
+    dsv4l2_tempest_state_t tempest;  /* Current TEMPEST state */
+    int tempest_ctrl_id;             /* v4l2 control ID for TEMPEST */
+
+    /* Profile information */
+    char *profile_path;              /* Path to loaded profile */
+    char *classification;            /* Security classification */
+
+    /* Capture thread scheduling from the profile (pipeline/capture_thread.c) */
+    int capture_cpu;                 /* -1 = any */
+    int capture_priority;            /* SCHED_FIFO priority, 0 = normal */
+
+    /* Runtime state */
+    int streaming;                   /* 1 if streaming active */
+    uint32_t dev_id;                 /* Device ID (hash) */
+
+    /*
+     * Serializes QBUF/DQBUF, buffer (re)allocation, STREAMON/STREAMOFF
+     * and watchdog recovery, so a consumer releasing a lease on one
+     * thread never interleaves with a restart on the capture thread.
+     * Recursive: recovery calls back into the stream and queue paths.
+     */
+    pthread_mutex_t queue_lock;
+
+    /* Buffer management */
+    dsv4l2_buffer_t *buffers;        /* Mapped buffers (buffer.c) */
+    uint32_t buffer_count;
+    uint32_t buffers_queued;         /* Buffers currently owned by the driver */
+    uint64_t dequeues;               /* Successful DQBUFs */
+    uint64_t depth_hist[DSV4L2_MAX_BUFFERS];  /* Buffers left queued at DQBUF */
+
+    /* Adaptive buffer count (buffer.c) */
+    dsv4l2_buffer_grow_t grow_mode;
+    uint32_t grow_max;               /* Upper bound on buffer_count */
+    uint32_t buffer_target;          /* Minimum count for the next REQBUFS */
+    uint64_t starve_window_start;    /* Dequeue count when the window opened */
+    uint32_t starve_count;           /* Starved gaps in the current window */
+    uint64_t starved_gaps;
+    uint32_t buffers_added;
+
+    /* Capture statistics */
+    dsv4l2_stream_stats_t stats;
+
+    /* Stall detection and recovery */
+    dsv4l2_watchdog_state_t watchdog;
+
+    /* Frame leases, indexed by buffer index (pipeline/lease.c) */
+    struct dsv4l2_lease *leases;
+
+    /* Locked arena iris frames are copied into (secret_arena.c) */
+    struct dsv4l2_secret_arena *secret_arena;
+} dsv4l2_device_internal_t;
+
+/* Implemented in device.c */
+dsv4l2_device_internal_t *dsv4l2_get_internal(dsv4l2_device_t *dev);
+
+/* Implemented in buffer.c: mark every buffer as returned by STREAMOFF */
+void dsv4l2_buffers_stream_off(dsv4l2_device_internal_t *internal);
+
+/* Implemented in stats.c: account a dequeued frame (returns frames the
+ * driver dropped since the previous one) / a new stream */
+uint32_t dsv4l2_stats_on_dequeue(dsv4l2_device_internal_t *internal,
+                                 const struct v4l2_buffer *buf, uint64_t now_ns);
+void dsv4l2_stats_on_stream_on(dsv4l2_device_internal_t *internal);
+
+/* Implemented in watchdog.c: note a frame / a stream start, and wait
+ * for the device (or wake_fd, -1 for none) to become readable while
+ * running stall detection and recovery. Returns 0 when there may be a
+ * frame, -ETIMEDOUT, or -EIO if the device fails without a watchdog. */
+void dsv4l2_watchdog_on_frame(dsv4l2_device_internal_t *internal, uint64_t now_ns);
+void dsv4l2_watchdog_on_stream_on(dsv4l2_device_internal_t *internal);
+int dsv4l2_wait_frame(dsv4l2_device_t *dev, int timeout_ms, int wake_fd);
+
+/**
+ * Monotonic timestamp in nanoseconds
+ */
+static inline uint64_t dsv4l2_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Map a duration to its log2-microsecond histogram bin
+ * (see DSV4L2_STATS_HIST_BINS)
+ */
+static inline unsigned int dsv4l2_hist_bin(uint64_t ns)
+{
+    uint64_t us = ns / 1000;
+    unsigned int bin;
+
+    if (us == 0) {
+        return 0;
+    }
+
+    bin = 64 - (unsigned int)__builtin_clzll(us);
+    return bin < DSV4L2_STATS_HIST_BINS ? bin : DSV4L2_STATS_HIST_BINS - 1;
+}
+
+#endif /* DSV4L2_INTERNAL_H */
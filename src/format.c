@@ -11,6 +11,7 @@
 #include "dsv4l2_annotations.h"
 #include "dsv4l2_policy.h"
 #include "dsv4l2rt.h"
+#include "dsv4l2_internal.h"
 
 #include <linux/videodev2.h>
 #include <sys/ioctl.h>
@@ -18,24 +19,6 @@
 #include <string.h>
 #include <stdlib.h>
 
-/* Forward declarations */
-typedef struct dsv4l2_device_internal dsv4l2_device_internal_t;
-extern dsv4l2_device_internal_t *dsv4l2_get_internal(dsv4l2_device_t *dev);
-
-/* Internal device structure (partial) */
-struct dsv4l2_device_internal {
-    dsv4l2_device_t public;
-    struct v4l2_capability cap;
-    dsv4l2_tempest_state_t tempest;
-    int tempest_ctrl_id;
-    char *profile_path;
-    char *classification;
-    int streaming;
-    uint32_t dev_id;
-    void *buffers;
-    uint32_t buffer_count;
-};
-
 /**
  * Enumerate supported pixel formats
  *
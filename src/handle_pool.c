@@ -0,0 +1,590 @@
+/*
+ * DSV4L2 Warm Device Handle Pool
+ *
+ * Keeps devices open, mapped and (optionally) streaming between capture
+ * sessions. See dsv4l2_handle_pool.h.
+ *
+ * Locking: pool->lock guards the handle table and counters. A handle
+ * marked checked_out belongs to its client and is never touched by the
+ * reaper; checkout/checkin do their ioctls outside the lock once the
+ * flag is set.
+ */
+
+#define _GNU_SOURCE  /* pipe2 */
+
+#include "dsv4l2_handle_pool.h"
+#include "dsv4l2rt.h"
+#include "dsv4l2_internal.h"
+
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+#include <pthread.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define DEFAULT_BUFFERS 4
+
+typedef struct {
+    dsv4l2_device_t *dev;
+    dsv4l2_warm_mode_t mode;
+    uint32_t buffers;
+    struct v4l2_format fmt;          /* Warm-up format */
+    dsv4l2_tempest_state_t tempest;  /* Warm-up TEMPEST state */
+
+    int checked_out;
+    int format_dirty;                /* Client changed format or buffers */
+    int tempest_dirty;               /* Client changed TEMPEST state */
+    int reap_failed;                 /* poll() reported an error while idle */
+} warm_handle_t;
+
+struct dsv4l2_handle_pool {
+    pthread_mutex_t lock;
+    warm_handle_t   handles[DSV4L2_HANDLE_POOL_MAX];
+    uint32_t        count;
+
+    pthread_t reaper;
+    int       wake[2];               /* Self-pipe: handle set changed */
+    int       stop;
+
+    dsv4l2_handle_pool_stats_t stats;
+};
+
+/* ========================================================================
+ * Helpers
+ * ======================================================================== */
+
+static void wake_reaper(dsv4l2_handle_pool_t *pool)
+{
+    char byte = 1;
+
+    /* Non-blocking pipe: a full pipe already means "wake up" */
+    if (write(pool->wake[1], &byte, 1) < 0) {
+        return;
+    }
+}
+
+/**
+ * Queue every buffer the driver does not own
+ */
+static void requeue_all(dsv4l2_device_t *dev)
+{
+    dsv4l2_device_internal_t *internal = dsv4l2_get_internal(dev);
+    uint32_t i;
+
+    for (i = 0; i < internal->buffer_count; i++) {
+        if (internal->buffers[i].state != DSV4L2_BUFFER_QUEUED) {
+            dsv4l2_queue_buffer(dev, i);
+        }
+    }
+}
+
+/**
+ * Dequeue and requeue every completed frame
+ *
+ * @return Frames discarded
+ */
+static uint64_t discard_frames(dsv4l2_device_t *dev)
+{
+    struct v4l2_buffer buf;
+    uint64_t n = 0;
+
+    while (dsv4l2_dequeue_buffer(dev, &buf) == 0) {
+        dsv4l2_queue_buffer(dev, buf.index);
+        n++;
+    }
+
+    return n;
+}
+
+/**
+ * Allocate, map and queue buffers for the current format
+ */
+static int setup_buffers(dsv4l2_device_t *dev, uint32_t count)
+{
+    int rc;
+
+    rc = dsv4l2_request_buffers(dev, count);
+    if (rc < 0) {
+        return rc;
+    }
+
+    rc = dsv4l2_mmap_buffers(dev);
+    if (rc < 0) {
+        dsv4l2_release_buffers(dev);
+        return rc;
+    }
+
+    requeue_all(dev);
+    return 0;
+}
+
+/**
+ * Free the driver's buffers so the format can change
+ */
+static void teardown_buffers(dsv4l2_device_t *dev)
+{
+    struct v4l2_requestbuffers req;
+
+    dsv4l2_stop_streaming(dev);
+    dsv4l2_release_buffers(dev);
+
+    memset(&req, 0, sizeof(req));
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    ioctl(dev->fd, VIDIOC_REQBUFS, &req);
+}
+
+/**
+ * Restore the warm-up format (and the buffers that go with it)
+ */
+static int restore_format(warm_handle_t *h)
+{
+    struct v4l2_format fmt = h->fmt;
+
+    teardown_buffers(h->dev);
+
+    if (dsv4l2_set_format(h->dev, &fmt) < 0) {
+        return -EIO;
+    }
+
+    return setup_buffers(h->dev, h->buffers);
+}
+
+static int format_matches(dsv4l2_device_t *dev, const struct v4l2_format *want)
+{
+    struct v4l2_format fmt;
+
+    if (dsv4l2_get_format(dev, &fmt) < 0) {
+        return 0;
+    }
+
+    return fmt.fmt.pix.width == want->fmt.pix.width &&
+           fmt.fmt.pix.height == want->fmt.pix.height &&
+           fmt.fmt.pix.pixelformat == want->fmt.pix.pixelformat;
+}
+
+static warm_handle_t *find_handle(dsv4l2_handle_pool_t *pool, dsv4l2_device_t *dev)
+{
+    uint32_t i;
+
+    for (i = 0; i < pool->count; i++) {
+        if (pool->handles[i].dev == dev) {
+            return &pool->handles[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* ========================================================================
+ * Reaper
+ * ======================================================================== */
+
+/**
+ * Discard frames on idle streaming handles
+ *
+ * Sleeps in poll() on every idle streaming handle plus the wake pipe, so
+ * an idle pool costs nothing but the dequeue/requeue per frame.
+ */
+static void *reaper_main(void *arg)
+{
+    dsv4l2_handle_pool_t *pool = arg;
+    struct pollfd pfds[DSV4L2_HANDLE_POOL_MAX + 1];
+    warm_handle_t *polled[DSV4L2_HANDLE_POOL_MAX + 1];
+    char drain[64];
+    nfds_t n, i;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        if (pool->stop) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        pfds[0].fd = pool->wake[0];
+        pfds[0].events = POLLIN;
+        n = 1;
+        for (i = 0; i < pool->count; i++) {
+            warm_handle_t *h = &pool->handles[i];
+
+            if (h->mode != DSV4L2_WARM_STREAMING || h->checked_out || h->reap_failed) {
+                continue;
+            }
+            pfds[n].fd = h->dev->fd;
+            pfds[n].events = POLLIN;
+            polled[n] = h;
+            n++;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        if (poll(pfds, n, -1) < 0) {
+            continue;
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            while (read(pool->wake[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        for (i = 1; i < n; i++) {
+            warm_handle_t *h = polled[i];
+
+            /* Checked out since the set was built: hands off */
+            if (h->checked_out || !pfds[i].revents) {
+                continue;
+            }
+            if (pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                h->reap_failed = 1;  /* Retried after the next checkin */
+                continue;
+            }
+            pool->stats.frames_discarded += discard_frames(h->dev);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+/* ========================================================================
+ * Public API
+ * ======================================================================== */
+
+/**
+ * Create an empty pool
+ *
+ * @param out Output pool
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_handle_pool_create(dsv4l2_handle_pool_t **out)
+{
+    dsv4l2_handle_pool_t *pool;
+    int rc;
+
+    if (!out) {
+        return -EINVAL;
+    }
+
+    pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        return -ENOMEM;
+    }
+
+    if (pipe2(pool->wake, O_CLOEXEC | O_NONBLOCK) != 0) {
+        rc = -errno;
+        free(pool);
+        return rc;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+
+    rc = pthread_create(&pool->reaper, NULL, reaper_main, pool);
+    if (rc != 0) {
+        pthread_mutex_destroy(&pool->lock);
+        close(pool->wake[0]);
+        close(pool->wake[1]);
+        free(pool);
+        return -rc;
+    }
+
+    *out = pool;
+    return 0;
+}
+
+/**
+ * Open, configure and warm up a device
+ *
+ * @param pool Pool
+ * @param cfg Handle configuration
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_handle_pool_add(dsv4l2_handle_pool_t *pool, const dsv4l2_warm_config_t *cfg)
+{
+    warm_handle_t h;
+    struct v4l2_format fmt;
+    int rc;
+
+    if (!pool || !cfg || !cfg->path || !cfg->role) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    rc = pool->count < DSV4L2_HANDLE_POOL_MAX ? 0 : -ENOSPC;
+    pthread_mutex_unlock(&pool->lock);
+    if (rc < 0) {
+        return rc;
+    }
+
+    memset(&h, 0, sizeof(h));
+    h.mode = cfg->mode;
+    h.buffers = cfg->buffers ? cfg->buffers : DEFAULT_BUFFERS;
+
+    DSV4L2_TRACE_BEGIN("handle_warmup");
+    rc = dsv4l2_open(cfg->path, cfg->role, &h.dev);
+    if (rc < 0) {
+        DSV4L2_TRACE_END("handle_warmup");
+        return rc;
+    }
+
+    rc = dsv4l2_get_format(h.dev, &fmt);
+    if (rc == 0 && (cfg->width || cfg->height || cfg->pixelformat)) {
+        if (cfg->width) {
+            fmt.fmt.pix.width = cfg->width;
+        }
+        if (cfg->height) {
+            fmt.fmt.pix.height = cfg->height;
+        }
+        if (cfg->pixelformat) {
+            fmt.fmt.pix.pixelformat = cfg->pixelformat;
+        }
+        rc = dsv4l2_set_format(h.dev, &fmt);
+    }
+    if (rc == 0) {
+        /* Record what the driver actually settled on */
+        rc = dsv4l2_get_format(h.dev, &h.fmt);
+    }
+    if (rc == 0) {
+        rc = setup_buffers(h.dev, h.buffers);
+    }
+    if (rc == 0 && h.mode == DSV4L2_WARM_STREAMING) {
+        rc = dsv4l2_start_streaming(h.dev);
+    }
+    DSV4L2_TRACE_END("handle_warmup");
+
+    if (rc < 0) {
+        teardown_buffers(h.dev);
+        dsv4l2_close(h.dev);
+        return rc;
+    }
+
+    h.tempest = dsv4l2_get_tempest_state(h.dev);
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count < DSV4L2_HANDLE_POOL_MAX) {
+        pool->handles[pool->count++] = h;
+        pool->stats.handles = pool->count;
+        rc = 0;
+    } else {
+        rc = -ENOSPC;  /* Filled up while we were warming */
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (rc < 0) {
+        teardown_buffers(h.dev);
+        dsv4l2_close(h.dev);
+        return rc;
+    }
+
+    wake_reaper(pool);
+    return 0;
+}
+
+/**
+ * Check out an idle handle
+ *
+ * @param pool Pool
+ * @param path Device node to match (NULL = any)
+ * @param role Role to match (NULL = any)
+ * @param out Output device handle
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_handle_checkout(dsv4l2_handle_pool_t *pool, const char *path,
+                           const char *role, dsv4l2_device_t **out)
+{
+    warm_handle_t *h = NULL;
+    uint64_t start, elapsed;
+    int matched = 0;
+    uint32_t i;
+    int rc = 0;
+
+    if (!pool || !out) {
+        return -EINVAL;
+    }
+
+    start = dsv4l2_now_ns();
+
+    pthread_mutex_lock(&pool->lock);
+    for (i = 0; i < pool->count; i++) {
+        warm_handle_t *cand = &pool->handles[i];
+
+        if ((path && strcmp(cand->dev->dev_path, path) != 0) ||
+            (role && strcmp(cand->dev->role, role) != 0)) {
+            continue;
+        }
+        matched = 1;
+        if (!cand->checked_out) {
+            h = cand;
+            break;
+        }
+    }
+    if (!h) {
+        if (matched) {
+            pool->stats.busy++;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        return matched ? -EBUSY : -ENOENT;
+    }
+    h->checked_out = 1;
+    pthread_mutex_unlock(&pool->lock);
+
+    /* The reaper may still be polling this fd; have it rebuild its set */
+    wake_reaper(pool);
+
+    DSV4L2_TRACE_BEGIN("handle_checkout");
+    if (h->format_dirty) {
+        rc = restore_format(h);
+    }
+    if (rc == 0 && h->tempest_dirty) {
+        rc = dsv4l2_set_tempest_state(h->dev, h->tempest);
+    }
+    if (rc == 0) {
+        if (dsv4l2_get_internal(h->dev)->streaming) {
+            /* Frames captured before the trigger are not the client's */
+            discard_frames(h->dev);
+        } else {
+            rc = dsv4l2_start_streaming(h->dev);
+        }
+    }
+    DSV4L2_TRACE_END("handle_checkout");
+
+    elapsed = dsv4l2_now_ns() - start;
+
+    pthread_mutex_lock(&pool->lock);
+    if (rc < 0) {
+        h->checked_out = 0;
+    } else {
+        pool->stats.checkouts++;
+        pool->stats.checked_out++;
+        if (h->format_dirty) {
+            pool->stats.format_resets++;
+        }
+        if (h->tempest_dirty) {
+            pool->stats.tempest_resets++;
+        }
+        if (elapsed > pool->stats.checkout_ns_max) {
+            pool->stats.checkout_ns_max = elapsed;
+        }
+        h->format_dirty = 0;
+        h->tempest_dirty = 0;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (rc < 0) {
+        return rc;
+    }
+
+    *out = h->dev;
+    return 0;
+}
+
+/**
+ * Return a handle to the pool
+ *
+ * Only notes what the client changed; restoring it is left to the next
+ * checkout so a handle that is never used again costs nothing.
+ *
+ * @param pool Pool
+ * @param dev Handle from dsv4l2_handle_checkout()
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_handle_checkin(dsv4l2_handle_pool_t *pool, dsv4l2_device_t *dev)
+{
+    dsv4l2_device_internal_t *internal;
+    warm_handle_t *h;
+
+    if (!pool || !dev) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    h = find_handle(pool, dev);
+    pthread_mutex_unlock(&pool->lock);
+    if (!h || !h->checked_out) {
+        return -EINVAL;
+    }
+
+    internal = dsv4l2_get_internal(dev);
+
+    if (internal->tempest_ctrl_id != 0 && internal->tempest != h->tempest) {
+        h->tempest_dirty = 1;
+    }
+
+    if (!internal->buffers || internal->buffer_count == 0 ||
+        !format_matches(dev, &h->fmt)) {
+        /* Keep the client's buffers idle until checkout restores the format */
+        h->format_dirty = 1;
+        dsv4l2_stop_streaming(dev);
+    } else if (h->mode == DSV4L2_WARM_MAPPED) {
+        dsv4l2_stop_streaming(dev);
+        requeue_all(dev);
+    } else {
+        requeue_all(dev);
+        if (!internal->streaming && dsv4l2_start_streaming(dev) < 0) {
+            h->format_dirty = 1;  /* Full re-setup at checkout */
+        }
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    h->checked_out = 0;
+    h->reap_failed = 0;
+    pool->stats.checked_out--;
+    pthread_mutex_unlock(&pool->lock);
+
+    wake_reaper(pool);
+    return 0;
+}
+
+/**
+ * Snapshot pool counters
+ *
+ * @param pool Pool
+ * @param stats Output counters
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_handle_pool_get_stats(dsv4l2_handle_pool_t *pool,
+                                 dsv4l2_handle_pool_stats_t *stats)
+{
+    if (!pool || !stats) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+
+    return 0;
+}
+
+/**
+ * Stop, unmap and close every handle
+ *
+ * @param pool Pool
+ */
+void dsv4l2_handle_pool_destroy(dsv4l2_handle_pool_t *pool)
+{
+    uint32_t i;
+
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_mutex_unlock(&pool->lock);
+    wake_reaper(pool);
+    pthread_join(pool->reaper, NULL);
+
+    for (i = 0; i < pool->count; i++) {
+        teardown_buffers(pool->handles[i].dev);
+        dsv4l2_close(pool->handles[i].dev);
+    }
+
+    close(pool->wake[0]);
+    close(pool->wake[1]);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
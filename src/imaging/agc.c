@@ -0,0 +1,403 @@
+/*
+ * DSV4L2 Imaging - Thermal AGC
+ *
+ * The mapping is kept as 8.8 fixed point per input level so smoothing
+ * does not stall on rounding, and an 8-bit copy is what frames are
+ * mapped through. The 8-bit table has three bytes of padding: the AVX2
+ * kernel gathers 32-bit words at byte offsets and keeps the low byte,
+ * which avoids widening the table to 32 bits (a 256 KiB table for 16
+ * bits would fall out of L2 next to the histograms).
+ *
+ * Both phases run on the shared pool: the histogram over a fixed split
+ * into line bands, each counting into its own tables, and the mapping
+ * over lines in band-sized ranges.
+ */
+
+#include "imaging_internal.h"
+#include "dsv4l2rt.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Most line bands (each owns a pair of histogram tables) */
+#define AGC_MAX_BANDS 16
+
+struct dsv4l2_agc {
+    dsv4l2_agc_config_t cfg;
+    size_t    frame_size;
+    uint32_t  levels;            /* 1 << bits */
+
+    uint32_t *hist[AGC_MAX_BANDS];     /* Per band: even and odd pixels, summed into [0] */
+    uint16_t *lut16;             /* Smoothed mapping, 8.8 fixed point */
+    uint8_t  *lut8;              /* levels + 3 bytes */
+    int       have_lut;
+    pthread_mutex_t lock;
+};
+
+/* ========================================================================
+ * Kernels
+ * ======================================================================== */
+
+/*
+ * Even and odd pixels count into separate tables: runs of equal values
+ * (a uniform background) would otherwise make every increment wait for
+ * the previous one to the same counter.
+ */
+static void histogram_lines(const uint8_t *src, uint32_t stride, uint32_t width,
+                            uint32_t lines, uint32_t max, uint32_t *even, uint32_t *odd)
+{
+    uint32_t x, y;
+
+    for (y = 0; y < lines; y++) {
+        const uint8_t *line = src + (size_t)y * stride;
+
+        for (x = 0; x + 2 <= width; x += 2) {
+            uint32_t a = (uint32_t)line[2 * x] | ((uint32_t)line[2 * x + 1] << 8);
+            uint32_t b = (uint32_t)line[2 * x + 2] | ((uint32_t)line[2 * x + 3] << 8);
+
+            even[a < max ? a : max]++;
+            odd[b < max ? b : max]++;
+        }
+        if (x < width) {
+            uint32_t a = (uint32_t)line[2 * x] | ((uint32_t)line[2 * x + 1] << 8);
+
+            even[a < max ? a : max]++;
+        }
+    }
+}
+
+static void map_line_scalar(const uint8_t *src, uint32_t width, uint32_t max,
+                            const uint8_t *lut, uint8_t *dst)
+{
+    uint32_t x;
+
+    for (x = 0; x < width; x++) {
+        uint32_t v = (uint32_t)src[2 * x] | ((uint32_t)src[2 * x + 1] << 8);
+
+        dst[x] = lut[v < max ? v : max];
+    }
+}
+
+#if DSV4L2_HAVE_X86_SIMD
+DSV4L2_TARGET_AVX2
+static void map_line_avx2(const uint8_t *src, uint32_t width, uint32_t max,
+                          const uint8_t *lut, uint8_t *dst)
+{
+    const __m256i vmax = _mm256_set1_epi16((int16_t)max);
+    const __m256i low = _mm256_set1_epi32(0xff);
+    uint32_t x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m256i v = _mm256_min_epu16(_mm256_loadu_si256((const __m256i *)(src + 2 * x)), vmax);
+        __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+        __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+        __m256i g0 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)lut, lo, 1), low);
+        __m256i g1 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)lut, hi, 1), low);
+        __m256i w = _mm256_permute4x64_epi64(_mm256_packus_epi32(g0, g1), 0xd8);
+
+        _mm_storeu_si128((__m128i *)(dst + x),
+                         _mm_packus_epi16(_mm256_castsi256_si128(w),
+                                          _mm256_extracti128_si256(w, 1)));
+    }
+
+    map_line_scalar(src + 2 * x, width - x, max, lut, dst + x);
+}
+#endif
+
+typedef void (*map_line_fn)(const uint8_t *, uint32_t, uint32_t, const uint8_t *, uint8_t *);
+
+static map_line_fn select_map_line(void)
+{
+#if DSV4L2_HAVE_X86_SIMD
+    if (dsv4l2_simd_level() == DSV4L2_SIMD_AVX2) {
+        return map_line_avx2;
+    }
+#endif
+    return map_line_scalar;
+}
+
+/* ========================================================================
+ * Pool Jobs
+ * ======================================================================== */
+
+typedef struct {
+    const dsv4l2_agc_t *agc;
+    const uint8_t *src;
+    uint8_t  *dst;
+    uint32_t  dst_stride;
+    uint32_t  bands;
+    map_line_fn map_line;
+} agc_job_t;
+
+/*
+ * Histogram bands [begin, end) into their own tables
+ */
+static void hist_bands(void *ctx, uint32_t begin, uint32_t end)
+{
+    const agc_job_t *job = ctx;
+    const dsv4l2_agc_t *agc = job->agc;
+    uint32_t i, y0, y1;
+
+    for (i = begin; i < end; i++) {
+        y0 = (uint32_t)((uint64_t)agc->cfg.height * i / job->bands);
+        y1 = (uint32_t)((uint64_t)agc->cfg.height * (i + 1) / job->bands);
+
+        memset(agc->hist[i], 0, 2 * agc->levels * sizeof(*agc->hist[i]));
+        histogram_lines(job->src + (size_t)y0 * agc->cfg.stride, agc->cfg.stride,
+                        agc->cfg.width, y1 - y0, agc->levels - 1,
+                        agc->hist[i], agc->hist[i] + agc->levels);
+    }
+}
+
+/*
+ * Map lines [begin, end)
+ */
+static void map_lines(void *ctx, uint32_t begin, uint32_t end)
+{
+    const agc_job_t *job = ctx;
+    const dsv4l2_agc_t *agc = job->agc;
+    const uint8_t *src = job->src + (size_t)begin * agc->cfg.stride;
+    uint32_t y;
+
+    for (y = begin; y < end; y++, src += agc->cfg.stride) {
+        job->map_line(src, agc->cfg.width, agc->levels - 1, agc->lut8,
+                      job->dst + (size_t)y * job->dst_stride);
+    }
+}
+
+/* ========================================================================
+ * AGC
+ * ======================================================================== */
+
+/**
+ * Create an AGC
+ *
+ * @param cfg Configuration
+ * @param out AGC
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_agc_create(const dsv4l2_agc_config_t *cfg, dsv4l2_agc_t **out)
+{
+    dsv4l2_agc_t *agc;
+    uint32_t i;
+
+    if (!cfg || !out) {
+        return -EINVAL;
+    }
+
+    if (cfg->width == 0 || cfg->height == 0 ||
+        (cfg->stride && cfg->stride < cfg->width * 2) ||
+        (cfg->bits && (cfg->bits < 8 || cfg->bits > 16)) ||
+        cfg->smooth_shift > 8 || cfg->threads > AGC_MAX_BANDS) {
+        return -EINVAL;
+    }
+
+    agc = calloc(1, sizeof(*agc));
+    if (!agc) {
+        return -ENOMEM;
+    }
+
+    pthread_mutex_init(&agc->lock, NULL);
+    agc->cfg = *cfg;
+    if (!agc->cfg.stride)       agc->cfg.stride = cfg->width * 2;
+    if (!agc->cfg.bits)         agc->cfg.bits = 16;
+    if (!agc->cfg.max_gain)     agc->cfg.max_gain = 4;
+    if (!agc->cfg.smooth_shift) agc->cfg.smooth_shift = 2;
+    if (!agc->cfg.threads)      agc->cfg.threads = 1;
+    if (agc->cfg.threads > cfg->height) agc->cfg.threads = cfg->height;
+
+    agc->frame_size = (size_t)agc->cfg.stride * (cfg->height - 1) + cfg->width * 2;
+    agc->levels = 1u << agc->cfg.bits;
+
+    for (i = 0; i < agc->cfg.threads; i++) {
+        agc->hist[i] = malloc(2 * agc->levels * sizeof(*agc->hist[i]));
+        if (!agc->hist[i]) {
+            dsv4l2_agc_destroy(agc);
+            return -ENOMEM;
+        }
+    }
+    agc->lut16 = calloc(agc->levels, sizeof(*agc->lut16));
+    agc->lut8 = calloc(agc->levels + 3, 1);
+    if (!agc->lut16 || !agc->lut8) {
+        dsv4l2_agc_destroy(agc);
+        return -ENOMEM;
+    }
+
+    *out = agc;
+    return 0;
+}
+
+/**
+ * Build the plateau-equalized mapping from hist[0] and fold it into
+ * the smoothed one (caller holds the lock)
+ */
+static void update_mapping(dsv4l2_agc_t *agc)
+{
+    const uint32_t *hist = agc->hist[0];
+    uint32_t v, occupied = 0, plateau, span, base;
+    uint64_t total = 0, clipped = 0, cum = 0;
+
+    for (v = 0; v < agc->levels; v++) {
+        if (hist[v]) {
+            occupied++;
+            total += hist[v];
+        }
+    }
+
+    plateau = agc->cfg.plateau ? agc->cfg.plateau
+                               : (uint32_t)((total + occupied - 1) / occupied);
+    for (v = 0; v < agc->levels; v++) {
+        clipped += hist[v] < plateau ? hist[v] : plateau;
+    }
+
+    /* Few distinct levels: a narrower band around mid-grey */
+    span = (uint64_t)occupied * agc->cfg.max_gain < 255 ? occupied * agc->cfg.max_gain : 255;
+    base = (255 - span) / 2;
+
+    for (v = 0; v < agc->levels; v++) {
+        uint32_t count = hist[v] < plateau ? hist[v] : plateau;
+        /* Centre of this level's share of the cumulative histogram, 8.8 */
+        uint32_t target = (uint32_t)(((uint64_t)base << 8) +
+                                     (((2 * cum + count) * span) << 7) / clipped);
+        int32_t cur = agc->lut16[v];
+
+        cum += count;
+
+        if (!agc->have_lut) {
+            agc->lut16[v] = (uint16_t)target;
+        } else {
+            agc->lut16[v] = (uint16_t)(cur + (((int32_t)target - cur) >> agc->cfg.smooth_shift));
+        }
+        agc->lut8[v] = (uint8_t)((agc->lut16[v] + 128) >> 8);
+    }
+
+    agc->have_lut = 1;
+}
+
+/**
+ * Map one frame to 8 bits and update the mapping
+ *
+ * @param agc AGC
+ * @param data Y16 frame
+ * @param len Frame bytes
+ * @param dst Output
+ * @param dst_stride Bytes per output line
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_agc_apply(dsv4l2_agc_t *agc, const uint8_t *data, size_t len, uint8_t *dst,
+                     uint32_t dst_stride)
+{
+    dsv4l2_pool_t *pool = dsv4l2_pool_shared();
+    agc_job_t job;
+    uint32_t i, n, v;
+
+    if (!agc || !data || !dst || dst_stride < agc->cfg.width) {
+        return -EINVAL;
+    }
+
+    if (len < agc->frame_size) {
+        return -EMSGSIZE;
+    }
+
+    DSV4L2_TRACE_BEGIN("agc_apply");
+    pthread_mutex_lock(&agc->lock);
+
+    n = agc->cfg.threads;
+    job.agc = agc;
+    job.src = data;
+    job.dst = dst;
+    job.dst_stride = dst_stride;
+    job.bands = n;
+    job.map_line = select_map_line();
+
+    dsv4l2_parallel_for(pool, n, 1, hist_bands, &job);
+
+    for (i = 0; i < n; i++) {
+        const uint32_t *even = agc->hist[i], *odd = agc->hist[i] + agc->levels;
+
+        for (v = 0; v < agc->levels; v++) {
+            agc->hist[0][v] = (i ? agc->hist[0][v] + even[v] : even[v]) + odd[v];
+        }
+    }
+
+    update_mapping(agc);
+
+    dsv4l2_parallel_for(pool, agc->cfg.height, (agc->cfg.height + n - 1) / n, map_lines, &job);
+
+    pthread_mutex_unlock(&agc->lock);
+    DSV4L2_TRACE_END("agc_apply");
+    return 0;
+}
+
+/**
+ * Forget the smoothed mapping
+ *
+ * @param agc AGC
+ */
+void dsv4l2_agc_reset(dsv4l2_agc_t *agc)
+{
+    if (!agc) {
+        return;
+    }
+
+    pthread_mutex_lock(&agc->lock);
+    agc->have_lut = 0;
+    pthread_mutex_unlock(&agc->lock);
+}
+
+/**
+ * Pipeline stage
+ *
+ * @param lease Y16 frame
+ * @param ctx AGC
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_agc_stage(dsv4l2_lease_t *lease, void *ctx)
+{
+    dsv4l2_agc_t *agc = ctx;
+    uint8_t *grey;
+    int rc;
+
+    if (!lease || !agc) {
+        return -EINVAL;
+    }
+
+    grey = malloc((size_t)agc->cfg.width * agc->cfg.height);
+    if (!grey) {
+        return -ENOMEM;
+    }
+
+    rc = dsv4l2_agc_apply(agc, lease->data, lease->len, grey, agc->cfg.width);
+    if (rc == 0) {
+        rc = dsv4l2_lease_attach(lease, DSV4L2_SLOT_CONVERTED, grey, free);
+    }
+    if (rc < 0) {
+        free(grey);
+    }
+
+    return rc;
+}
+
+/**
+ * Free an AGC
+ *
+ * @param agc AGC
+ */
+void dsv4l2_agc_destroy(dsv4l2_agc_t *agc)
+{
+    uint32_t i;
+
+    if (!agc) {
+        return;
+    }
+
+    pthread_mutex_destroy(&agc->lock);
+    for (i = 0; i < AGC_MAX_BANDS; i++) {
+        free(agc->hist[i]);
+    }
+    free(agc->lut16);
+    free(agc->lut8);
+    free(agc);
+}
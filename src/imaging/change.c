@@ -0,0 +1,373 @@
+/*
+ * DSV4L2 Imaging - Frame Change Detection
+ *
+ * Downsampled luma is held in planes padded to whole 8x8 blocks (and
+ * 32-byte lines) so the SAD kernels never need an edge case: padding is
+ * zero in both the current frame and the background and contributes
+ * nothing. _mm_sad_epu8 sums 8 bytes per 64-bit lane, which is exactly
+ * one block row per lane.
+ */
+
+#include "imaging_internal.h"
+#include "dsv4l2rt.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK 8
+
+struct dsv4l2_change_detector {
+    dsv4l2_change_config_t cfg;
+    size_t    frame_size;
+    uint32_t  dw, dh;            /* Downsampled size */
+    uint32_t  cols, rows;        /* Block grid */
+    uint32_t  pw, ph;            /* Padded plane size */
+
+    uint8_t  *cur;               /* Current frame, downsampled */
+    uint8_t  *bg8;               /* Background, integer part */
+    uint16_t *bg16;              /* Background, 8.8 fixed point */
+    uint16_t *acc;               /* Downsampling scratch */
+    uint32_t *sad;               /* Per-block SAD for one block row */
+
+    int       have_bg;
+    uint32_t  static_run;
+    pthread_mutex_t lock;
+};
+
+/* ========================================================================
+ * Block SAD kernels: one block row, sad[c] for every padded column
+ * ======================================================================== */
+
+static void sad_row_scalar(const uint8_t *a, const uint8_t *b, uint32_t stride,
+                           uint32_t width, uint32_t *sad)
+{
+    uint32_t x, y;
+
+    memset(sad, 0, (width / BLOCK) * sizeof(*sad));
+    for (y = 0; y < BLOCK; y++) {
+        for (x = 0; x < width; x++) {
+            int d = (int)a[y * stride + x] - (int)b[y * stride + x];
+
+            sad[x / BLOCK] += (uint32_t)(d < 0 ? -d : d);
+        }
+    }
+}
+
+#if DSV4L2_HAVE_X86_SIMD
+static void sad_row_sse2(const uint8_t *a, const uint8_t *b, uint32_t stride,
+                         uint32_t width, uint32_t *sad)
+{
+    uint32_t x, y;
+
+    for (x = 0; x < width; x += 16) {
+        __m128i sum = _mm_setzero_si128();
+
+        for (y = 0; y < BLOCK; y++) {
+            __m128i va = _mm_load_si128((const __m128i *)(a + y * stride + x));
+            __m128i vb = _mm_load_si128((const __m128i *)(b + y * stride + x));
+
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(va, vb));
+        }
+        sad[x / BLOCK]     = (uint32_t)_mm_cvtsi128_si32(sum);
+        sad[x / BLOCK + 1] = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+    }
+}
+
+DSV4L2_TARGET_AVX2
+static void sad_row_avx2(const uint8_t *a, const uint8_t *b, uint32_t stride,
+                         uint32_t width, uint32_t *sad)
+{
+    uint32_t x, y;
+
+    for (x = 0; x < width; x += 32) {
+        __m256i sum = _mm256_setzero_si256();
+
+        for (y = 0; y < BLOCK; y++) {
+            __m256i va = _mm256_load_si256((const __m256i *)(a + y * stride + x));
+            __m256i vb = _mm256_load_si256((const __m256i *)(b + y * stride + x));
+
+            sum = _mm256_add_epi64(sum, _mm256_sad_epu8(va, vb));
+        }
+        sad[x / BLOCK]     = (uint32_t)_mm256_extract_epi64(sum, 0);
+        sad[x / BLOCK + 1] = (uint32_t)_mm256_extract_epi64(sum, 1);
+        sad[x / BLOCK + 2] = (uint32_t)_mm256_extract_epi64(sum, 2);
+        sad[x / BLOCK + 3] = (uint32_t)_mm256_extract_epi64(sum, 3);
+    }
+}
+#endif
+
+typedef void (*sad_row_fn)(const uint8_t *, const uint8_t *, uint32_t, uint32_t,
+                           uint32_t *);
+
+static sad_row_fn select_sad_row(void)
+{
+#if DSV4L2_HAVE_X86_SIMD
+    switch (dsv4l2_simd_level()) {
+        case DSV4L2_SIMD_AVX2: return sad_row_avx2;
+        case DSV4L2_SIMD_SSE2: return sad_row_sse2;
+        default:               break;
+    }
+#endif
+    return sad_row_scalar;
+}
+
+/* ========================================================================
+ * Detector
+ * ======================================================================== */
+
+/**
+ * Create a change detector
+ *
+ * @param cfg Configuration (format required)
+ * @param out Detector
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_change_create(const dsv4l2_change_config_t *cfg,
+                         dsv4l2_change_detector_t **out)
+{
+    dsv4l2_change_detector_t *det;
+    uint32_t factor;
+    size_t plane;
+
+    if (!cfg || !out) {
+        return -EINVAL;
+    }
+
+    factor = cfg->factor ? cfg->factor : 4;
+    if (factor > 8 || (factor & (factor - 1)) != 0) {
+        return -EINVAL;
+    }
+
+    if (dsv4l2_image_size(&cfg->format) == 0 ||
+        cfg->format.width < factor || cfg->format.height < factor) {
+        return -EINVAL;
+    }
+
+    det = calloc(1, sizeof(*det));
+    if (!det) {
+        return -ENOMEM;
+    }
+
+    pthread_mutex_init(&det->lock, NULL);
+    det->cfg = *cfg;
+    det->cfg.factor = factor;
+    if (!det->cfg.threshold)   det->cfg.threshold = 12;
+    if (!det->cfg.learn_shift) det->cfg.learn_shift = 4;
+    if (!det->cfg.min_blocks)  det->cfg.min_blocks = 1;
+    if (det->cfg.learn_shift > 8) det->cfg.learn_shift = 8;
+
+    det->frame_size = dsv4l2_image_size(&cfg->format);
+    det->dw = cfg->format.width / factor;
+    det->dh = cfg->format.height / factor;
+    det->cols = (det->dw + BLOCK - 1) / BLOCK;
+    det->rows = (det->dh + BLOCK - 1) / BLOCK;
+
+    if ((size_t)det->cols * det->rows > DSV4L2_CHANGE_MAX_BLOCKS) {
+        dsv4l2_change_destroy(det);
+        return -E2BIG;
+    }
+
+    det->pw = (det->cols * BLOCK + 31) & ~31u;
+    det->ph = det->rows * BLOCK;
+    plane = (size_t)det->pw * det->ph;
+
+    det->cur = aligned_alloc(32, plane);
+    det->bg8 = aligned_alloc(32, plane);
+    det->bg16 = calloc(plane, sizeof(*det->bg16));
+    det->acc = calloc(cfg->format.width, sizeof(*det->acc));
+    det->sad = calloc(det->pw / BLOCK, sizeof(*det->sad));
+    if (!det->cur || !det->bg8 || !det->bg16 || !det->acc || !det->sad) {
+        dsv4l2_change_destroy(det);
+        return -ENOMEM;
+    }
+
+    memset(det->cur, 0, plane);
+    memset(det->bg8, 0, plane);
+
+    *out = det;
+    return 0;
+}
+
+/**
+ * Move the background towards the current frame
+ */
+static void update_background(dsv4l2_change_detector_t *det)
+{
+    size_t i, n = (size_t)det->pw * det->ph;
+    uint32_t shift = det->cfg.learn_shift;
+
+    if (!det->have_bg) {
+        for (i = 0; i < n; i++) {
+            det->bg16[i] = (uint16_t)(det->cur[i] << 8);
+            det->bg8[i] = det->cur[i];
+        }
+        det->have_bg = 1;
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        int32_t bg = det->bg16[i];
+
+        bg += (((int32_t)det->cur[i] << 8) - bg) >> shift;
+        det->bg16[i] = (uint16_t)bg;
+        det->bg8[i] = (uint8_t)(bg >> 8);
+    }
+}
+
+/**
+ * Analyse one frame and update the background
+ *
+ * @param det Detector
+ * @param data Frame
+ * @param len Frame bytes (at least the configured frame size)
+ * @param result Output
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_change_analyze(dsv4l2_change_detector_t *det, const uint8_t *data,
+                          size_t len, dsv4l2_change_result_t *result)
+{
+    sad_row_fn sad_row;
+    uint64_t total = 0;
+    uint32_t r, c;
+
+    if (!det || !data || !result) {
+        return -EINVAL;
+    }
+
+    if (len < det->frame_size) {
+        return -EMSGSIZE;
+    }
+
+    DSV4L2_TRACE_BEGIN("change_analyze");
+    sad_row = select_sad_row();
+
+    pthread_mutex_lock(&det->lock);
+
+    dsv4l2_luma_downsample(data, &det->cfg.format, det->cfg.factor,
+                           det->cur, det->pw, det->acc);
+
+    memset(result, 0, sizeof(*result));
+    result->cols = det->cols;
+    result->rows = det->rows;
+    result->blocks = det->cols * det->rows;
+
+    for (r = 0; r < det->rows; r++) {
+        size_t off = (size_t)r * BLOCK * det->pw;
+        uint32_t bh = det->dh - r * BLOCK < BLOCK ? det->dh - r * BLOCK : BLOCK;
+
+        sad_row(det->cur + off, det->bg8 + off, det->pw, det->pw, det->sad);
+
+        for (c = 0; c < det->cols; c++) {
+            uint32_t bw = det->dw - c * BLOCK < BLOCK ? det->dw - c * BLOCK : BLOCK;
+            uint32_t bit = r * det->cols + c;
+
+            total += det->sad[c];
+
+            /* Every block counts as changed until there is a background */
+            if (!det->have_bg || det->sad[c] > det->cfg.threshold * bw * bh) {
+                result->bitmap[bit / 64] |= 1ULL << (bit % 64);
+                result->changed++;
+            }
+        }
+    }
+
+    result->mean_diff = (uint32_t)(total / ((uint64_t)det->dw * det->dh));
+    result->score = (float)result->changed / (float)result->blocks;
+
+    update_background(det);
+
+    pthread_mutex_unlock(&det->lock);
+    DSV4L2_TRACE_END("change_analyze");
+    return 0;
+}
+
+/**
+ * Forget the background
+ *
+ * @param det Detector
+ */
+void dsv4l2_change_reset(dsv4l2_change_detector_t *det)
+{
+    if (!det) {
+        return;
+    }
+
+    pthread_mutex_lock(&det->lock);
+    det->have_bg = 0;
+    det->static_run = 0;
+    pthread_mutex_unlock(&det->lock);
+}
+
+/**
+ * Pipeline stage
+ *
+ * @param lease Frame
+ * @param ctx Detector
+ * @return 0, DSV4L2_STAGE_SKIP for dropped static frames, or negative errno
+ */
+int dsv4l2_change_stage(dsv4l2_lease_t *lease, void *ctx)
+{
+    dsv4l2_change_detector_t *det = ctx;
+    dsv4l2_change_result_t *result;
+    uint32_t run;
+    int rc;
+
+    if (!lease || !det) {
+        return -EINVAL;
+    }
+
+    result = malloc(sizeof(*result));
+    if (!result) {
+        return -ENOMEM;
+    }
+
+    rc = dsv4l2_change_analyze(det, lease->data, lease->len, result);
+    if (rc < 0) {
+        free(result);
+        return rc;
+    }
+
+    rc = dsv4l2_lease_attach(lease, DSV4L2_SLOT_CHANGE, result, free);
+    if (rc < 0) {
+        free(result);
+        return rc;
+    }
+
+    if (result->changed >= det->cfg.min_blocks) {
+        lease->tags = (lease->tags & ~DSV4L2_TAG_STATIC) | DSV4L2_TAG_CHANGED;
+        __atomic_store_n(&det->static_run, 0, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    lease->tags = (lease->tags & ~DSV4L2_TAG_CHANGED) | DSV4L2_TAG_STATIC;
+    run = __atomic_add_fetch(&det->static_run, 1, __ATOMIC_RELAXED);
+
+    if (det->cfg.skip_static &&
+        !(det->cfg.keep_every && run % det->cfg.keep_every == 0)) {
+        return DSV4L2_STAGE_SKIP;
+    }
+
+    return 0;
+}
+
+/**
+ * Free a change detector
+ *
+ * @param det Detector
+ */
+void dsv4l2_change_destroy(dsv4l2_change_detector_t *det)
+{
+    if (!det) {
+        return;
+    }
+
+    pthread_mutex_destroy(&det->lock);
+    free(det->cur);
+    free(det->bg8);
+    free(det->bg16);
+    free(det->acc);
+    free(det->sad);
+    free(det);
+}
@@ -0,0 +1,572 @@
+/*
+ * DSV4L2 Imaging - Software Auto Exposure
+ *
+ * The controller's state is the brightness factor `level`, exposure
+ * times linear gain in exposure units; each step multiplies it by
+ * 2^delta, where delta comes from a velocity-form PI on the EV error.
+ * Clamping the level to what the controls can reach keeps the integral
+ * from winding up. The first step after a long quiet spell is
+ * (kp + ki) x error, i.e. nearly the whole correction at once.
+ *
+ * Only 1/factor^2 of the pixels are read, so the cost per frame is a
+ * few microseconds; log2 and exp2 are low-order approximations (a few
+ * thousandths of an EV), far below what one control step resolves.
+ */
+
+#include "imaging_internal.h"
+#include "../dsv4l2_internal.h"
+#include "dsv4l2rt.h"
+
+#include <linux/videodev2.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+/* Largest correction per step, EV */
+#define MAX_STEP_EV 3.0f
+
+struct dsv4l2_ae {
+    dsv4l2_ae_config_t cfg;
+    size_t    frame_size;
+    uint32_t  stride;            /* Source bytes per line */
+    uint32_t  dw, dh;            /* Sample grid size */
+    uint32_t  y16_shift;         /* Y16 sample to 8 bits */
+    dsv4l2_device_t *dev;
+
+    float     level;             /* Exposure x gain factor */
+    float     prev_error;
+    dsv4l2_ae_settings_t cur;    /* Last handed out (or starting) values */
+    uint32_t  since_write;       /* Frames since then */
+    uint64_t  last_write_ns;
+    int       have_write;
+    int       have_start;        /* Starting values known */
+
+    dsv4l2_ae_stats_t stats;
+    pthread_mutex_t lock;
+};
+
+/* ========================================================================
+ * Approximations
+ * ======================================================================== */
+
+typedef union {
+    float    f;
+    uint32_t u;
+} float_bits_t;
+
+/**
+ * log2(x) for x > 0, within 0.005
+ */
+static float log2_approx(float x)
+{
+    float_bits_t v = { .f = x };
+    float e = (float)((int32_t)((v.u >> 23) & 0xff) - 128);
+
+    v.u = (v.u & 0x007fffffu) | 0x3f800000u;     /* Mantissa in [1, 2); fit is log2(m) + 1 */
+    return e + (-0.34484843f * v.f + 2.02466578f) * v.f - 0.67487759f;
+}
+
+/**
+ * 2^x for |x| < 126, within 0.2%
+ */
+static float exp2_approx(float x)
+{
+    float_bits_t scale;
+    int32_t i = (int32_t)x;
+    float f;
+
+    if ((float)i > x) {
+        i--;
+    }
+    f = x - (float)i;
+
+    scale.u = (uint32_t)(i + 127) << 23;
+    return scale.f * (1.0f + f * (0.65685425f + 0.34314575f * f));
+}
+
+/* ========================================================================
+ * Controller
+ * ======================================================================== */
+
+/**
+ * Gain value that multiplies brightness by one
+ */
+static int32_t unity_gain(const dsv4l2_ae_config_t *cfg)
+{
+    return cfg->gain_min > 1 ? cfg->gain_min : 1;
+}
+
+/**
+ * Brightness factor of a pair of control values
+ */
+static float settings_level(const dsv4l2_ae_config_t *cfg, const dsv4l2_ae_settings_t *s)
+{
+    int32_t gain = s->gain > unity_gain(cfg) ? s->gain : unity_gain(cfg);
+    int32_t exposure = s->exposure > 1 ? s->exposure : 1;
+
+    return (float)exposure * (float)gain / (float)unity_gain(cfg);
+}
+
+/**
+ * Split a brightness factor into control values: exposure first, then gain
+ */
+static void split_level(const dsv4l2_ae_config_t *cfg, float level, dsv4l2_ae_settings_t *s)
+{
+    int32_t unity = unity_gain(cfg);
+    int32_t gain_max = cfg->gain_max > unity ? cfg->gain_max : unity;
+
+    if (level <= (float)cfg->exposure_max) {
+        s->exposure = (int32_t)(level + 0.5f);
+        if (s->exposure < cfg->exposure_min) s->exposure = cfg->exposure_min;
+        if (s->exposure > cfg->exposure_max) s->exposure = cfg->exposure_max;
+        s->gain = unity < cfg->gain_min ? cfg->gain_min : unity;
+        return;
+    }
+
+    s->exposure = cfg->exposure_max;
+    s->gain = (int32_t)((float)unity * level / (float)cfg->exposure_max + 0.5f);
+    if (s->gain > gain_max) s->gain = gain_max;
+}
+
+/**
+ * Brightness range the controls can reach
+ */
+static void level_range(const dsv4l2_ae_config_t *cfg, float *lo, float *hi)
+{
+    dsv4l2_ae_settings_t s;
+
+    s.exposure = cfg->exposure_min;
+    s.gain = cfg->gain_min;
+    *lo = settings_level(cfg, &s);
+    s.exposure = cfg->exposure_max;
+    s.gain = cfg->gain_max;
+    *hi = settings_level(cfg, &s);
+}
+
+/**
+ * Fill in starting values from the configuration (caller holds the lock)
+ */
+static void init_start(dsv4l2_ae_t *ae)
+{
+    dsv4l2_ae_config_t *cfg = &ae->cfg;
+
+    ae->cur.exposure = cfg->exposure ? cfg->exposure : cfg->exposure_min;
+    ae->cur.gain = cfg->gain ? cfg->gain : cfg->gain_min;
+    ae->level = settings_level(cfg, &ae->cur);
+    ae->have_start = 1;
+}
+
+/**
+ * Create a controller
+ *
+ * @param cfg Configuration (format required)
+ * @param out Controller
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_ae_create(const dsv4l2_ae_config_t *cfg, dsv4l2_ae_t **out)
+{
+    dsv4l2_ae_t *ae;
+    uint32_t factor, stride;
+    size_t size;
+
+    if (!cfg || !out) {
+        return -EINVAL;
+    }
+
+    factor = cfg->factor ? cfg->factor : 8;
+    if (factor > 16 || (cfg->y16_bits && (cfg->y16_bits < 8 || cfg->y16_bits > 16)) ||
+        cfg->target > 255 || cfg->exposure_min < 0 ||
+        (cfg->exposure_max && cfg->exposure_max < cfg->exposure_min) ||
+        (cfg->gain_max && cfg->gain_max < cfg->gain_min)) {
+        return -EINVAL;
+    }
+
+    if (cfg->format.pixelformat == V4L2_PIX_FMT_Y16) {
+        stride = cfg->format.stride ? cfg->format.stride : cfg->format.width * 2;
+        size = (size_t)stride * cfg->format.height;
+    } else {
+        stride = dsv4l2_image_stride(&cfg->format);
+        size = dsv4l2_image_size(&cfg->format);
+    }
+
+    if (size == 0 || cfg->format.width < factor || cfg->format.height < factor) {
+        return -EINVAL;
+    }
+
+    ae = calloc(1, sizeof(*ae));
+    if (!ae) {
+        return -ENOMEM;
+    }
+
+    pthread_mutex_init(&ae->lock, NULL);
+    ae->cfg = *cfg;
+    ae->cfg.factor = factor;
+    if (!ae->cfg.y16_bits)          ae->cfg.y16_bits = 16;
+    if (!ae->cfg.target)            ae->cfg.target = 110;
+    if (!ae->cfg.tolerance)         ae->cfg.tolerance = 6;
+    if (ae->cfg.kp <= 0.0f)         ae->cfg.kp = 0.2f;
+    if (ae->cfg.ki <= 0.0f)         ae->cfg.ki = 0.8f;
+    if (!ae->cfg.settle_frames)     ae->cfg.settle_frames = 2;
+    if (!ae->cfg.min_interval_ms)   ae->cfg.min_interval_ms = 50;
+    if (!ae->cfg.exposure_id)       ae->cfg.exposure_id = V4L2_CID_EXPOSURE_ABSOLUTE;
+    if (!ae->cfg.gain_id)           ae->cfg.gain_id = V4L2_CID_GAIN;
+
+    ae->frame_size = size;
+    ae->stride = stride;
+    ae->dw = cfg->format.width / factor;
+    ae->dh = cfg->format.height / factor;
+    ae->y16_shift = ae->cfg.y16_bits - 8;
+
+    if (ae->cfg.exposure_max > 0) {
+        init_start(ae);
+    }
+
+    *out = ae;
+    return 0;
+}
+
+/**
+ * Query a control's range and current value
+ */
+static int query_control(dsv4l2_device_t *dev, uint32_t id, int32_t *min, int32_t *max,
+                         int32_t *value)
+{
+    struct v4l2_queryctrl qc;
+    struct v4l2_control ctrl;
+
+    memset(&qc, 0, sizeof(qc));
+    qc.id = id;
+    if (ioctl(dev->fd, VIDIOC_QUERYCTRL, &qc) < 0) {
+        return -errno;
+    }
+    if (qc.flags & V4L2_CTRL_FLAG_DISABLED) {
+        return -ENOTSUP;
+    }
+
+    memset(&ctrl, 0, sizeof(ctrl));
+    ctrl.id = id;
+    if (ioctl(dev->fd, VIDIOC_G_CTRL, &ctrl) < 0) {
+        return -errno;
+    }
+
+    *min = qc.minimum;
+    *max = qc.maximum;
+    *value = ctrl.value;
+    return 0;
+}
+
+/**
+ * Take over a device's exposure
+ *
+ * @param ae Controller
+ * @param dev Device
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_ae_attach(dsv4l2_ae_t *ae, dsv4l2_device_t *dev)
+{
+    dsv4l2_ae_config_t *cfg;
+    struct v4l2_control ctrl;
+    int32_t emin, emax, exposure, gmin, gmax, gain;
+    int rc;
+
+    if (!ae || !dev) {
+        return -EINVAL;
+    }
+
+    /* Camera AE off (manual mode), auto-gain off; not every camera has them */
+    memset(&ctrl, 0, sizeof(ctrl));
+    ctrl.id = V4L2_CID_EXPOSURE_AUTO;
+    ctrl.value = V4L2_EXPOSURE_MANUAL;
+    ioctl(dev->fd, VIDIOC_S_CTRL, &ctrl);
+    ctrl.id = V4L2_CID_AUTOGAIN;
+    ctrl.value = 0;
+    ioctl(dev->fd, VIDIOC_S_CTRL, &ctrl);
+
+    rc = query_control(dev, ae->cfg.exposure_id, &emin, &emax, &exposure);
+    if (rc < 0) {
+        return rc == -EINVAL ? -ENOTSUP : rc;
+    }
+
+    /* Without a gain control, exposure alone */
+    if (query_control(dev, ae->cfg.gain_id, &gmin, &gmax, &gain) < 0) {
+        gmin = gmax = gain = 0;
+    }
+
+    pthread_mutex_lock(&ae->lock);
+    cfg = &ae->cfg;
+
+    if (!cfg->exposure_min || cfg->exposure_min < emin) cfg->exposure_min = emin;
+    if (!cfg->exposure_max || cfg->exposure_max > emax) cfg->exposure_max = emax;
+    if (cfg->exposure_max < cfg->exposure_min)         cfg->exposure_max = cfg->exposure_min;
+    if (!cfg->gain_min && !cfg->gain_max) {
+        cfg->gain_min = gmin;
+        cfg->gain_max = gmax;
+    }
+    if (!cfg->exposure) cfg->exposure = exposure;
+    if (!cfg->gain)     cfg->gain = gain;
+
+    ae->dev = dev;
+    ae->have_write = 0;
+    ae->prev_error = 0.0f;
+    init_start(ae);
+    pthread_mutex_unlock(&ae->lock);
+
+    return 0;
+}
+
+/**
+ * Mean luma of the sample grid, 8-bit scale
+ */
+static float measure(const dsv4l2_ae_t *ae, const uint8_t *data)
+{
+    uint32_t hist[256];
+    uint32_t pitch, x, y, i;
+    uint64_t sum = 0;
+
+    memset(hist, 0, sizeof(hist));
+    pitch = ae->cfg.factor;
+
+    for (y = 0; y < ae->dh; y++) {
+        const uint8_t *line = data + (size_t)y * pitch * ae->stride;
+
+        switch (ae->cfg.format.pixelformat) {
+            case V4L2_PIX_FMT_YUYV:
+                for (x = 0; x < ae->dw; x++) {
+                    hist[line[2 * pitch * x]]++;
+                }
+                break;
+            case V4L2_PIX_FMT_RGB24:
+                for (x = 0; x < ae->dw; x++) {
+                    hist[dsv4l2_rgb_to_grey(line + 3 * pitch * x)]++;
+                }
+                break;
+            case V4L2_PIX_FMT_Y16:
+                for (x = 0; x < ae->dw; x++) {
+                    const uint8_t *p = line + 2 * pitch * x;
+                    uint32_t v = (uint32_t)(p[0] | (p[1] << 8)) >> ae->y16_shift;
+
+                    hist[v > 255 ? 255 : v]++;
+                }
+                break;
+            default:  /* GREY, NV12 luma plane */
+                for (x = 0; x < ae->dw; x++) {
+                    hist[line[pitch * x]]++;
+                }
+                break;
+        }
+    }
+
+    for (i = 0; i < 256; i++) {
+        sum += (uint64_t)i * hist[i];
+    }
+    return (float)sum / (float)(ae->dw * ae->dh);
+}
+
+/**
+ * Measure one frame and step the controller
+ *
+ * @param ae Controller
+ * @param data Frame
+ * @param len Frame bytes (at least the configured frame size)
+ * @param now_ns Monotonic time of the frame
+ * @param out Settings to write
+ * @return 1 if new settings are due, 0 if not, negative errno on error
+ */
+int dsv4l2_ae_process(dsv4l2_ae_t *ae, const uint8_t *data, size_t len, uint64_t now_ns,
+                      dsv4l2_ae_settings_t *out)
+{
+    dsv4l2_ae_config_t *cfg;
+    dsv4l2_ae_settings_t next;
+    float mean, error, delta, lo, hi;
+    int rc = 0;
+
+    if (!ae || !data || !out) {
+        return -EINVAL;
+    }
+
+    if (len < ae->frame_size) {
+        return -EMSGSIZE;
+    }
+
+    DSV4L2_TRACE_BEGIN("ae_process");
+    mean = measure(ae, data);
+
+    pthread_mutex_lock(&ae->lock);
+    cfg = &ae->cfg;
+
+    ae->stats.frames++;
+    ae->stats.mean = mean;
+    ae->since_write++;
+
+    if (!ae->have_start) {
+        rc = -ENODEV;
+        goto out;
+    }
+
+    error = log2_approx((float)cfg->target / (mean > 0.5f ? mean : 0.5f));
+    ae->stats.error_ev = error;
+    ae->stats.converged = mean >= (float)cfg->target - (float)cfg->tolerance &&
+                          mean <= (float)cfg->target + (float)cfg->tolerance;
+
+    if (ae->stats.converged) {
+        ae->prev_error = 0.0f;
+        goto out;
+    }
+
+    /* The last write may not have reached the image yet */
+    if (ae->have_write &&
+        (ae->since_write <= cfg->settle_frames ||
+         now_ns - ae->last_write_ns < (uint64_t)cfg->min_interval_ms * 1000000ULL)) {
+        goto out;
+    }
+
+    if (error > MAX_STEP_EV)  error = MAX_STEP_EV;
+    if (error < -MAX_STEP_EV) error = -MAX_STEP_EV;
+
+    ae->stats.updates++;
+    delta = cfg->kp * (error - ae->prev_error) + cfg->ki * error;
+    ae->prev_error = error;
+
+    level_range(cfg, &lo, &hi);
+    ae->level *= exp2_approx(delta);
+    if (ae->level < lo) ae->level = lo;
+    if (ae->level > hi) ae->level = hi;
+
+    split_level(cfg, ae->level, &next);
+    if (next.exposure == ae->cur.exposure && next.gain == ae->cur.gain) {
+        goto out;
+    }
+
+    ae->cur = next;
+    ae->since_write = 0;
+    ae->last_write_ns = now_ns;
+    ae->have_write = 1;
+    ae->stats.writes++;
+    ae->stats.settings = next;
+    *out = next;
+    rc = 1;
+
+out:
+    pthread_mutex_unlock(&ae->lock);
+    DSV4L2_TRACE_END("ae_process");
+    return rc;
+}
+
+/**
+ * Write exposure and gain in one VIDIOC_S_EXT_CTRLS
+ *
+ * @param ae Controller
+ * @param dev Device
+ * @param s Settings
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_ae_apply(dsv4l2_ae_t *ae, dsv4l2_device_t *dev, const dsv4l2_ae_settings_t *s)
+{
+    struct v4l2_ext_controls ctrls;
+    struct v4l2_ext_control ctrl[2];
+    int rc = 0;
+
+    if (!ae || !dev || !s) {
+        return -EINVAL;
+    }
+
+    memset(&ctrls, 0, sizeof(ctrls));
+    memset(ctrl, 0, sizeof(ctrl));
+    ctrl[0].id = ae->cfg.exposure_id;
+    ctrl[0].value = s->exposure;
+    ctrl[1].id = ae->cfg.gain_id;
+    ctrl[1].value = s->gain;
+
+    ctrls.which = V4L2_CTRL_WHICH_CUR_VAL;
+    ctrls.count = ae->cfg.gain_max > ae->cfg.gain_min ? 2 : 1;
+    ctrls.controls = ctrl;
+
+    DSV4L2_TRACE_BEGIN("ae_apply");
+    if (ioctl(dev->fd, VIDIOC_S_EXT_CTRLS, &ctrls) < 0) {
+        rc = -errno;
+    }
+    DSV4L2_TRACE_END("ae_apply");
+
+    if (rc < 0) {
+        pthread_mutex_lock(&ae->lock);
+        ae->stats.write_errors++;
+        pthread_mutex_unlock(&ae->lock);
+    }
+
+    return rc;
+}
+
+/**
+ * Pipeline stage
+ *
+ * @param lease Frame
+ * @param ctx Controller
+ * @return 0, or negative errno for frames that cannot be measured
+ */
+int dsv4l2_ae_stage(dsv4l2_lease_t *lease, void *ctx)
+{
+    dsv4l2_ae_t *ae = ctx;
+    dsv4l2_ae_settings_t s;
+    dsv4l2_device_t *dev;
+    int rc;
+
+    if (!lease || !ae) {
+        return -EINVAL;
+    }
+
+    rc = dsv4l2_ae_process(ae, lease->data, lease->len,
+                           lease->dequeue_ns ? lease->dequeue_ns : dsv4l2_now_ns(), &s);
+    if (rc == -ENODEV) {
+        return 0;
+    }
+    if (rc <= 0) {
+        return rc;
+    }
+
+    dev = ae->dev ? ae->dev : lease->dev;
+    if (dev) {
+        dsv4l2_ae_apply(ae, dev, &s);
+    }
+
+    return 0;
+}
+
+/**
+ * Snapshot state and metrics
+ *
+ * @param ae Controller
+ * @param stats Output
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_ae_get_stats(dsv4l2_ae_t *ae, dsv4l2_ae_stats_t *stats)
+{
+    if (!ae || !stats) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&ae->lock);
+    *stats = ae->stats;
+    if (!ae->have_write) {
+        stats->settings = ae->cur;
+    }
+    pthread_mutex_unlock(&ae->lock);
+
+    return 0;
+}
+
+/**
+ * Free a controller
+ *
+ * @param ae Controller
+ */
+void dsv4l2_ae_destroy(dsv4l2_ae_t *ae)
+{
+    if (!ae) {
+        return;
+    }
+
+    pthread_mutex_destroy(&ae->lock);
+    free(ae);
+}
@@ -0,0 +1,833 @@
+/*
+ * DSV4L2 Imaging - IR / Visible Fusion
+ *
+ * The remap table holds one 32-bit word per visible pixel: the IR
+ * source position in 12.4 fixed point, x in the low half and y in the
+ * high half, or FUSION_OUTSIDE. IR frames are kept with one replicated
+ * column and line of padding so the bilinear lookup never needs an
+ * edge test; the AVX2 warp gathers 32-bit words, so buffers it reads
+ * from have three more bytes.
+ *
+ * A line is fused in three passes: warp (IR level and blend weight per
+ * pixel), expand (palette values and weights laid out like the frame's
+ * bytes) and a byte-wise blend, which is the SIMD part. Weights are in
+ * 1/128 so a blended byte fits 16 bits. Frames are split into tiles on
+ * the shared pool; each tile works through its lines in chunks small
+ * enough for stack scratch.
+ */
+
+#include "imaging_internal.h"
+#include "dsv4l2rt.h"
+
+#include <linux/videodev2.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* IR frames kept for pairing */
+#define FUSION_HISTORY 4
+
+/* Largest IR width or height (12-bit integer part) */
+#define FUSION_MAX_IR 4096
+
+#define FUSION_OUTSIDE 0xffffffffu
+
+/* Pixels fused per pass over a line (even, so chroma pairs stay whole) */
+#define FUSION_CHUNK 256
+
+typedef struct {
+    uint8_t  *data;              /* Padded copy */
+    uint64_t  timestamp_ns;
+    uint64_t  seq;               /* Arrival order; 0 = empty */
+    int       used;
+    int       busy;              /* Being fused */
+} ir_frame_t;
+
+struct dsv4l2_fusion {
+    dsv4l2_fusion_config_t cfg;
+    uint32_t  stride;            /* Visible bytes per line */
+    uint32_t  row_bytes;         /* Visible bytes per line of pixels */
+    size_t    frame_size;
+    size_t    ir_size;           /* Packed IR frame */
+    uint32_t  ir_stride;         /* Padded copies: ir_width + 1 */
+
+    uint32_t *map;               /* Remap table, width x height */
+    uint8_t   pal[3][256];       /* Palette in the visible format's channels */
+    uint8_t   weight[256 + 3];   /* Blend weight per IR level, 0-128; gather padding */
+
+    uint8_t  *ir_copy;           /* dsv4l2_fusion_apply() input */
+    pthread_mutex_t lock;        /* Table and ir_copy */
+
+    ir_frame_t history[FUSION_HISTORY];
+    uint64_t  seq;
+    dsv4l2_fusion_stats_t stats;
+    pthread_mutex_t ir_lock;     /* History and counters */
+};
+
+/* ========================================================================
+ * Palettes
+ * ======================================================================== */
+
+static const struct {
+    uint8_t level;
+    uint8_t rgb[3];
+} ironbow[] = {
+    {   0, {   0,   0,   0 } },
+    {  40, {  32,   0, 112 } },
+    {  90, { 140,   0, 150 } },
+    { 140, { 220,  40,  60 } },
+    { 190, { 250, 140,   0 } },
+    { 230, { 255, 220,  40 } },
+    { 255, { 255, 255, 255 } },
+};
+
+static void palette_rgb(dsv4l2_fusion_mode_t mode, uint32_t v, uint8_t rgb[3])
+{
+    uint32_t i, c;
+
+    if (mode == DSV4L2_FUSION_BLEND) {
+        rgb[0] = rgb[1] = rgb[2] = (uint8_t)v;
+        return;
+    }
+
+    for (i = 1; v > ironbow[i].level; i++) {
+    }
+
+    for (c = 0; c < 3; c++) {
+        uint32_t lo = ironbow[i - 1].level, span = ironbow[i].level - lo;
+        int32_t a = ironbow[i - 1].rgb[c], b = ironbow[i].rgb[c];
+
+        rgb[c] = (uint8_t)(a + ((b - a) * (int32_t)(v - lo) + (int32_t)span / 2) /
+                               (int32_t)span);
+    }
+}
+
+/* Palette in the frame's channels and the weight of each IR level */
+static void build_tables(dsv4l2_fusion_t *fu)
+{
+    uint32_t a = (fu->cfg.alpha + 1) >> 1, v;
+    uint8_t rgb[3], ycc[3];
+
+    for (v = 0; v < 256; v++) {
+        palette_rgb(fu->cfg.mode, v, rgb);
+
+        switch (fu->cfg.format.pixelformat) {
+            case V4L2_PIX_FMT_RGB24:
+                memcpy(ycc, rgb, 3);
+                break;
+            case V4L2_PIX_FMT_GREY:
+                ycc[0] = ycc[1] = ycc[2] = dsv4l2_rgb_to_grey(rgb);
+                break;
+            default:
+                dsv4l2_rgb_to_ycbcr(rgb, ycc);
+                break;
+        }
+
+        fu->pal[0][v] = ycc[0];
+        fu->pal[1][v] = ycc[1];
+        fu->pal[2][v] = ycc[2];
+        fu->weight[v] = (uint8_t)(fu->cfg.mode == DSV4L2_FUSION_COLORMAP &&
+                                  v < fu->cfg.threshold ? 0 : a);
+    }
+}
+
+/* ========================================================================
+ * Remap table
+ * ======================================================================== */
+
+static int homography_valid(const double h[9])
+{
+    double det;
+    int i;
+
+    for (i = 0; i < 9; i++) {
+        /* NaN and infinities */
+        if (!(h[i] - h[i] == 0.0)) {
+            return 0;
+        }
+    }
+
+    det = h[0] * (h[4] * h[8] - h[5] * h[7]) -
+          h[1] * (h[3] * h[8] - h[5] * h[6]) +
+          h[2] * (h[3] * h[7] - h[4] * h[6]);
+
+    return det != 0.0;
+}
+
+static void build_map(dsv4l2_fusion_t *fu, const double h[9])
+{
+    const double xmax = (double)(fu->cfg.ir_width - 1) * 16.0 + 1.0;
+    const double ymax = (double)(fu->cfg.ir_height - 1) * 16.0 + 1.0;
+    uint32_t x, y, *map = fu->map;
+
+    for (y = 0; y < fu->cfg.format.height; y++) {
+        double X = h[1] * y + h[2], Y = h[4] * y + h[5], W = h[7] * y + h[8];
+
+        for (x = 0; x < fu->cfg.format.width; x++, X += h[0], Y += h[3], W += h[6]) {
+            double sx, sy;
+
+            if (!(W > 0.0)) {
+                *map++ = FUSION_OUTSIDE;
+                continue;
+            }
+
+            sx = X / W * 16.0 + 0.5;
+            sy = Y / W * 16.0 + 0.5;
+            if (!(sx >= 0.0 && sx < xmax && sy >= 0.0 && sy < ymax)) {
+                *map++ = FUSION_OUTSIDE;
+                continue;
+            }
+
+            *map++ = (uint32_t)sx | ((uint32_t)sy << 16);
+        }
+    }
+}
+
+/* ========================================================================
+ * Kernels
+ * ======================================================================== */
+
+/* Bilinear IR level and blend weight of each pixel on a line */
+static void warp_line(const uint32_t *map, uint32_t width, const uint8_t *ir,
+                      uint32_t ir_stride, const uint8_t *weight, uint8_t *level, uint8_t *lw)
+{
+    uint32_t x;
+
+    for (x = 0; x < width; x++) {
+        uint32_t m = map[x], fx, fy;
+        const uint8_t *p;
+        int32_t top, bottom, v;
+
+        if (m == FUSION_OUTSIDE) {
+            level[x] = 0;
+            lw[x] = 0;
+            continue;
+        }
+
+        fx = m & 15;
+        fy = (m >> 16) & 15;
+        p = ir + (size_t)(m >> 20) * ir_stride + ((m & 0xffff) >> 4);
+
+        top = p[0] * 16 + (p[1] - p[0]) * (int32_t)fx;
+        bottom = p[ir_stride] * 16 + (p[ir_stride + 1] - p[ir_stride]) * (int32_t)fx;
+        v = (top * 16 + (bottom - top) * (int32_t)fy + 128) >> 8;
+
+        level[x] = (uint8_t)v;
+        lw[x] = weight[v];
+    }
+}
+
+static void blend_scalar(uint8_t *dst, const uint8_t *tgt, const uint8_t *w, uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = (uint8_t)((dst[i] * (128 - w[i]) + tgt[i] * w[i] + 64) >> 7);
+    }
+}
+
+#if DSV4L2_HAVE_X86_SIMD
+static inline __m128i blend_half_sse2(__m128i d, __m128i t, __m128i w)
+{
+    const __m128i full = _mm_set1_epi16(128), round = _mm_set1_epi16(64);
+
+    return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(d, _mm_sub_epi16(full, w)),
+                                                      _mm_mullo_epi16(t, w)),
+                                        round), 7);
+}
+
+static void blend_sse2(uint8_t *dst, const uint8_t *tgt, const uint8_t *w, uint32_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i t = _mm_loadu_si128((const __m128i *)(tgt + i));
+        __m128i k = _mm_loadu_si128((const __m128i *)(w + i));
+        __m128i lo = blend_half_sse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(t, zero),
+                                     _mm_unpacklo_epi8(k, zero));
+        __m128i hi = blend_half_sse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(t, zero),
+                                     _mm_unpackhi_epi8(k, zero));
+
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+
+    blend_scalar(dst + i, tgt + i, w + i, n - i);
+}
+
+DSV4L2_TARGET_AVX2
+static inline __m256i blend_half_avx2(__m256i d, __m256i t, __m256i w)
+{
+    const __m256i full = _mm256_set1_epi16(128), round = _mm256_set1_epi16(64);
+
+    return _mm256_srli_epi16(
+        _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(d, _mm256_sub_epi16(full, w)),
+                                          _mm256_mullo_epi16(t, w)),
+                         round), 7);
+}
+
+DSV4L2_TARGET_AVX2
+static void blend_avx2(uint8_t *dst, const uint8_t *tgt, const uint8_t *w, uint32_t n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t i = 0;
+
+    /* Unpack and pack both work per 128-bit lane, so byte order holds */
+    for (; i + 32 <= n; i += 32) {
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i t = _mm256_loadu_si256((const __m256i *)(tgt + i));
+        __m256i k = _mm256_loadu_si256((const __m256i *)(w + i));
+        __m256i lo = blend_half_avx2(_mm256_unpacklo_epi8(d, zero),
+                                     _mm256_unpacklo_epi8(t, zero),
+                                     _mm256_unpacklo_epi8(k, zero));
+        __m256i hi = blend_half_avx2(_mm256_unpackhi_epi8(d, zero),
+                                     _mm256_unpackhi_epi8(t, zero),
+                                     _mm256_unpackhi_epi8(k, zero));
+
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    blend_sse2(dst + i, tgt + i, w + i, n - i);
+}
+#endif
+
+#if DSV4L2_HAVE_X86_SIMD
+/*
+ * Eight pixels at a time: each gather fetches a 32-bit word at the
+ * left neighbour, so one gather per IR line gives both neighbours.
+ */
+DSV4L2_TARGET_AVX2
+static void warp_line_avx2(const uint32_t *map, uint32_t width, const uint8_t *ir,
+                           uint32_t ir_stride, const uint8_t *weight, uint8_t *level,
+                           uint8_t *lw)
+{
+    const __m256i low4 = _mm256_set1_epi32(15), byte = _mm256_set1_epi32(0xff);
+    const __m256i sixteen = _mm256_set1_epi32(16), round = _mm256_set1_epi32(128);
+    const __m256i vstride = _mm256_set1_epi32((int)ir_stride);
+    const __m256i spread = _mm256_setr_epi8(0, -1, 1, -1, 4, -1, 5, -1, 8, -1, 9, -1,
+                                            12, -1, 13, -1, 0, -1, 1, -1, 4, -1, 5, -1,
+                                            8, -1, 9, -1, 12, -1, 13, -1);
+    uint32_t x = 0;
+
+    for (; x + 8 <= width; x += 8) {
+        __m256i m = _mm256_loadu_si256((const __m256i *)(map + x));
+        __m256i outside = _mm256_cmpeq_epi32(m, _mm256_set1_epi32(-1));
+        __m256i fx, fy, off, top, bottom, v, w;
+        __m128i packed;
+
+        m = _mm256_andnot_si256(outside, m);
+        fx = _mm256_and_si256(m, low4);
+        fy = _mm256_and_si256(_mm256_srli_epi32(m, 16), low4);
+        off = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(m, 20), vstride),
+                               _mm256_srli_epi32(_mm256_and_si256(m, _mm256_set1_epi32(0xffff)), 4));
+
+        /* (16 - f, f) word pairs against (left, right) word pairs */
+        fx = _mm256_or_si256(_mm256_sub_epi32(sixteen, fx), _mm256_slli_epi32(fx, 16));
+        fy = _mm256_or_si256(_mm256_sub_epi32(sixteen, fy), _mm256_slli_epi32(fy, 16));
+        top = _mm256_madd_epi16(
+            _mm256_shuffle_epi8(_mm256_i32gather_epi32((const int *)ir, off, 1), spread), fx);
+        bottom = _mm256_madd_epi16(
+            _mm256_shuffle_epi8(_mm256_i32gather_epi32((const int *)(ir + ir_stride), off, 1),
+                                spread), fx);
+        v = _mm256_madd_epi16(_mm256_or_si256(top, _mm256_slli_epi32(bottom, 16)), fy);
+        v = _mm256_andnot_si256(outside, _mm256_srli_epi32(_mm256_add_epi32(v, round), 8));
+        w = _mm256_and_si256(_mm256_i32gather_epi32((const int *)weight, v, 1), byte);
+        w = _mm256_andnot_si256(outside, w);
+
+        /* Levels and weights to bytes: v0-7 then w0-7 */
+        v = _mm256_permute4x64_epi64(_mm256_packus_epi32(v, w), 0xd8);
+        packed = _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        _mm_storel_epi64((__m128i *)(level + x), packed);
+        _mm_storel_epi64((__m128i *)(lw + x), _mm_unpackhi_epi64(packed, packed));
+    }
+
+    warp_line(map + x, width - x, ir, ir_stride, weight, level + x, lw + x);
+}
+#endif
+
+typedef void (*warp_fn)(const uint32_t *, uint32_t, const uint8_t *, uint32_t,
+                        const uint8_t *, uint8_t *, uint8_t *);
+
+static warp_fn select_warp(void)
+{
+#if DSV4L2_HAVE_X86_SIMD
+    if (dsv4l2_simd_level() == DSV4L2_SIMD_AVX2) {
+        return warp_line_avx2;
+    }
+#endif
+    return warp_line;
+}
+
+typedef void (*blend_fn)(uint8_t *, const uint8_t *, const uint8_t *, uint32_t);
+
+static blend_fn select_blend(void)
+{
+#if DSV4L2_HAVE_X86_SIMD
+    switch (dsv4l2_simd_level()) {
+        case DSV4L2_SIMD_AVX2: return blend_avx2;
+        case DSV4L2_SIMD_SSE2: return blend_sse2;
+        default:               break;
+    }
+#endif
+    return blend_scalar;
+}
+
+typedef struct {
+    dsv4l2_fusion_t *fu;
+    uint8_t         *frame;
+    const uint8_t   *ir;
+    warp_fn          warp;
+    blend_fn         blend;
+} fuse_job_t;
+
+/* Fuse pixels [x, x + n) of line y; x and n are even for YUYV and NV12 */
+static void fuse_chunk(const fuse_job_t *job, uint32_t y, uint32_t x, uint32_t n)
+{
+    const dsv4l2_fusion_t *fu = job->fu;
+    const uint32_t width = fu->cfg.format.width, height = fu->cfg.format.height;
+    uint8_t *line = job->frame + (size_t)y * fu->stride;
+    uint8_t level[FUSION_CHUNK], lw[FUSION_CHUNK];
+    uint8_t tgt[3 * FUSION_CHUNK], tw[3 * FUSION_CHUNK];
+    uint32_t i;
+
+    job->warp(fu->map + (size_t)y * width + x, n, job->ir, fu->ir_stride, fu->weight,
+              level, lw);
+
+    switch (fu->cfg.format.pixelformat) {
+        case V4L2_PIX_FMT_RGB24:
+            for (i = 0; i < n; i++) {
+                tgt[3 * i] = fu->pal[0][level[i]];
+                tgt[3 * i + 1] = fu->pal[1][level[i]];
+                tgt[3 * i + 2] = fu->pal[2][level[i]];
+                tw[3 * i] = tw[3 * i + 1] = tw[3 * i + 2] = lw[i];
+            }
+            job->blend(line + 3 * (size_t)x, tgt, tw, 3 * n);
+            break;
+
+        case V4L2_PIX_FMT_YUYV:
+            for (i = 0; i + 1 < n; i += 2) {
+                tgt[2 * i] = fu->pal[0][level[i]];
+                tgt[2 * i + 1] = fu->pal[1][level[i]];
+                tgt[2 * i + 2] = fu->pal[0][level[i + 1]];
+                tgt[2 * i + 3] = fu->pal[2][level[i]];
+                tw[2 * i] = tw[2 * i + 1] = tw[2 * i + 3] = lw[i];
+                tw[2 * i + 2] = lw[i + 1];
+            }
+            job->blend(line + 2 * (size_t)x, tgt, tw, 2 * n);
+            break;
+
+        case V4L2_PIX_FMT_NV12:
+            for (i = 0; i < n; i++) {
+                tgt[i] = fu->pal[0][level[i]];
+            }
+            job->blend(line + x, tgt, lw, n);
+
+            if ((y & 1) == 0) {
+                uint8_t *uv = job->frame + (size_t)fu->stride * height +
+                              (size_t)(y / 2) * fu->stride;
+
+                for (i = 0; i + 1 < n; i += 2) {
+                    tgt[i] = fu->pal[1][level[i]];
+                    tgt[i + 1] = fu->pal[2][level[i]];
+                    tw[i] = tw[i + 1] = lw[i];
+                }
+                job->blend(uv + x, tgt, tw, n & ~1u);
+            }
+            break;
+
+        default:
+            for (i = 0; i < n; i++) {
+                tgt[i] = fu->pal[0][level[i]];
+            }
+            job->blend(line + x, tgt, lw, n);
+            break;
+    }
+}
+
+/* Tile in pixel pairs, so chroma pairs never straddle two tiles */
+static void fuse_tile(void *ctx, const dsv4l2_tile_t *tile)
+{
+    const fuse_job_t *job = ctx;
+    const uint32_t width = job->fu->cfg.format.width;
+    uint32_t x0 = 2 * tile->x;
+    uint32_t x1 = 2 * (tile->x + tile->width) < width ? 2 * (tile->x + tile->width) : width;
+    uint32_t x, y;
+
+    for (y = tile->y; y < tile->y + tile->height; y++) {
+        for (x = x0; x < x1; x += FUSION_CHUNK) {
+            fuse_chunk(job, y, x, x1 - x < FUSION_CHUNK ? x1 - x : FUSION_CHUNK);
+        }
+    }
+}
+
+/*
+ * Fuse a frame (caller holds the lock). Chroma takes the IR level of
+ * the first pixel its sample covers.
+ */
+static void fuse_frame(dsv4l2_fusion_t *fu, uint8_t *frame, const uint8_t *ir)
+{
+    fuse_job_t job;
+
+    job.fu = fu;
+    job.frame = frame;
+    job.ir = ir;
+    job.warp = select_warp();
+    job.blend = select_blend();
+
+    /* Sized by the frame bytes plus the remap word of each pixel pair */
+    dsv4l2_parallel_tiles(dsv4l2_pool_shared(), (fu->cfg.format.width + 1) / 2,
+                          fu->cfg.format.height,
+                          2 * (fu->row_bytes / fu->cfg.format.width + sizeof(*fu->map)),
+                          fuse_tile, &job);
+}
+
+/* Copy a packed IR frame with a replicated last column and line */
+static void pad_ir(const dsv4l2_fusion_t *fu, const uint8_t *src, uint8_t *dst)
+{
+    uint32_t w = fu->cfg.ir_width, y;
+
+    for (y = 0; y < fu->cfg.ir_height; y++) {
+        memcpy(dst + (size_t)y * fu->ir_stride, src + (size_t)y * w, w);
+        dst[(size_t)y * fu->ir_stride + w] = src[(size_t)y * w + w - 1];
+    }
+    memcpy(dst + (size_t)fu->cfg.ir_height * fu->ir_stride,
+           dst + (size_t)(fu->cfg.ir_height - 1) * fu->ir_stride, fu->ir_stride);
+}
+
+/* ========================================================================
+ * Fusion
+ * ======================================================================== */
+
+/**
+ * Create a fusion and build its remap table
+ *
+ * @param cfg Configuration
+ * @param out Fusion
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_fusion_create(const dsv4l2_fusion_config_t *cfg, dsv4l2_fusion_t **out)
+{
+    dsv4l2_image_format_t packed;
+    dsv4l2_fusion_t *fu;
+    size_t ir_padded;
+    uint32_t i;
+
+    if (!cfg || !out) {
+        return -EINVAL;
+    }
+
+    switch (cfg->format.pixelformat) {
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_NV12:
+        case V4L2_PIX_FMT_GREY:
+        case V4L2_PIX_FMT_RGB24:
+            break;
+        default:
+            return -EINVAL;
+    }
+
+    /* Chroma of YUYV and NV12 covers pixel pairs */
+    if (cfg->format.pixelformat != V4L2_PIX_FMT_GREY &&
+        cfg->format.pixelformat != V4L2_PIX_FMT_RGB24 && (cfg->format.width & 1)) {
+        return -EINVAL;
+    }
+
+    if (cfg->format.width == 0 || cfg->format.height == 0 ||
+        cfg->ir_width == 0 || cfg->ir_height == 0 ||
+        cfg->ir_width > FUSION_MAX_IR || cfg->ir_height > FUSION_MAX_IR ||
+        cfg->alpha > 256 || cfg->threshold > 255 ||
+        (cfg->mode != DSV4L2_FUSION_BLEND && cfg->mode != DSV4L2_FUSION_COLORMAP) ||
+        !homography_valid(cfg->homography)) {
+        return -EINVAL;
+    }
+
+    fu = calloc(1, sizeof(*fu));
+    if (!fu) {
+        return -ENOMEM;
+    }
+
+    pthread_mutex_init(&fu->lock, NULL);
+    pthread_mutex_init(&fu->ir_lock, NULL);
+    fu->cfg = *cfg;
+    if (!fu->cfg.alpha)       fu->cfg.alpha = 128;
+    if (!fu->cfg.threshold)   fu->cfg.threshold = 128;
+    if (!fu->cfg.max_skew_ns) fu->cfg.max_skew_ns = 20000000ULL;
+
+    packed = cfg->format;
+    packed.stride = 0;
+    fu->row_bytes = dsv4l2_image_stride(&packed);
+    fu->stride = dsv4l2_image_stride(&cfg->format);
+    if (fu->stride < fu->row_bytes) {
+        dsv4l2_fusion_destroy(fu);
+        return -EINVAL;
+    }
+    fu->frame_size = dsv4l2_image_size(&cfg->format);
+    fu->ir_size = (size_t)cfg->ir_width * cfg->ir_height;
+    fu->ir_stride = cfg->ir_width + 1;
+    /* Three bytes past the padding line for the gathers */
+    ir_padded = (size_t)fu->ir_stride * (cfg->ir_height + 1) + 3;
+
+    fu->map = malloc((size_t)cfg->format.width * cfg->format.height * sizeof(*fu->map));
+    fu->ir_copy = malloc(ir_padded);
+    if (!fu->map || !fu->ir_copy) {
+        dsv4l2_fusion_destroy(fu);
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < FUSION_HISTORY; i++) {
+        fu->history[i].data = malloc(ir_padded);
+        if (!fu->history[i].data) {
+            dsv4l2_fusion_destroy(fu);
+            return -ENOMEM;
+        }
+    }
+
+    build_tables(fu);
+    build_map(fu, cfg->homography);
+
+    *out = fu;
+    return 0;
+}
+
+/**
+ * Replace the homography and rebuild the table
+ *
+ * @param fu Fusion
+ * @param homography Visible pixel to IR pixel, row major
+ * @return 0 on success, -EINVAL for a singular homography
+ */
+int dsv4l2_fusion_set_homography(dsv4l2_fusion_t *fu, const double homography[9])
+{
+    if (!fu || !homography || !homography_valid(homography)) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&fu->lock);
+    memcpy(fu->cfg.homography, homography, sizeof(fu->cfg.homography));
+    build_map(fu, homography);
+    pthread_mutex_unlock(&fu->lock);
+
+    return 0;
+}
+
+/**
+ * Keep an IR frame for pairing
+ *
+ * Replaces the oldest frame not being fused.
+ *
+ * @param fu Fusion
+ * @param ir Packed GREY frame
+ * @param len Frame bytes
+ * @param timestamp_ns Capture time
+ * @return 0 on success, -EBUSY if every kept frame is being fused,
+ *         other negative errno on error
+ */
+int dsv4l2_fusion_push_ir(dsv4l2_fusion_t *fu, const uint8_t *ir, size_t len,
+                          uint64_t timestamp_ns)
+{
+    ir_frame_t *slot = NULL;
+    uint32_t i;
+
+    if (!fu || !ir) {
+        return -EINVAL;
+    }
+
+    if (len < fu->ir_size) {
+        return -EMSGSIZE;
+    }
+
+    pthread_mutex_lock(&fu->ir_lock);
+
+    for (i = 0; i < FUSION_HISTORY; i++) {
+        ir_frame_t *f = &fu->history[i];
+
+        if (!f->busy && (!slot || f->seq < slot->seq)) {
+            slot = f;
+        }
+    }
+
+    if (!slot) {
+        pthread_mutex_unlock(&fu->ir_lock);
+        return -EBUSY;
+    }
+
+    if (slot->seq && !slot->used) {
+        fu->stats.ir_unused++;
+    }
+
+    pad_ir(fu, ir, slot->data);
+    slot->timestamp_ns = timestamp_ns;
+    slot->seq = ++fu->seq;
+    slot->used = 0;
+    fu->stats.ir_frames++;
+
+    pthread_mutex_unlock(&fu->ir_lock);
+    return 0;
+}
+
+/**
+ * Fuse one IR frame into one visible frame
+ *
+ * @param fu Fusion
+ * @param visible Visible frame, fused in place
+ * @param len Visible frame bytes
+ * @param ir Packed GREY IR frame
+ * @param ir_len IR frame bytes
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_fusion_apply(dsv4l2_fusion_t *fu, uint8_t *visible, size_t len,
+                        const uint8_t *ir, size_t ir_len)
+{
+    if (!fu || !visible || !ir) {
+        return -EINVAL;
+    }
+
+    if (len < fu->frame_size || ir_len < fu->ir_size) {
+        return -EMSGSIZE;
+    }
+
+    DSV4L2_TRACE_BEGIN("fusion_apply");
+    pthread_mutex_lock(&fu->lock);
+    pad_ir(fu, ir, fu->ir_copy);
+    fuse_frame(fu, visible, fu->ir_copy);
+    pthread_mutex_unlock(&fu->lock);
+    DSV4L2_TRACE_END("fusion_apply");
+
+    return 0;
+}
+
+/**
+ * IR pipeline stage
+ *
+ * @param lease IR frame
+ * @param ctx Fusion
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_fusion_ir_stage(dsv4l2_lease_t *lease, void *ctx)
+{
+    dsv4l2_fusion_t *fu = ctx;
+    const uint8_t *grey;
+
+    if (!lease || !fu) {
+        return -EINVAL;
+    }
+
+    grey = dsv4l2_lease_get(lease, DSV4L2_SLOT_CONVERTED);
+    if (grey) {
+        return dsv4l2_fusion_push_ir(fu, grey, fu->ir_size, lease->timestamp_ns);
+    }
+
+    return dsv4l2_fusion_push_ir(fu, lease->data, lease->len, lease->timestamp_ns);
+}
+
+/**
+ * Visible pipeline stage
+ *
+ * @param lease Visible frame
+ * @param ctx Fusion
+ * @return 0 on success, DSV4L2_STAGE_SKIP for an unmatched frame with
+ *         pair_once, negative errno on error
+ */
+int dsv4l2_fusion_stage(dsv4l2_lease_t *lease, void *ctx)
+{
+    dsv4l2_fusion_t *fu = ctx;
+    ir_frame_t *match = NULL;
+    uint64_t best = 0;
+    uint32_t i;
+
+    if (!lease || !fu) {
+        return -EINVAL;
+    }
+
+    if (lease->len < fu->frame_size) {
+        return -EMSGSIZE;
+    }
+
+    pthread_mutex_lock(&fu->ir_lock);
+
+    for (i = 0; i < FUSION_HISTORY; i++) {
+        ir_frame_t *f = &fu->history[i];
+        uint64_t skew;
+
+        if (!f->seq || f->busy || (fu->cfg.pair_once && f->used)) {
+            continue;
+        }
+
+        skew = f->timestamp_ns > lease->timestamp_ns ? f->timestamp_ns - lease->timestamp_ns
+                                                     : lease->timestamp_ns - f->timestamp_ns;
+        if (skew <= fu->cfg.max_skew_ns && (!match || skew < best)) {
+            match = f;
+            best = skew;
+        }
+    }
+
+    if (!match) {
+        fu->stats.unmatched++;
+        pthread_mutex_unlock(&fu->ir_lock);
+        return fu->cfg.pair_once ? DSV4L2_STAGE_SKIP : 0;
+    }
+
+    match->busy = 1;
+    match->used = 1;
+    fu->stats.last_skew_ns = (int64_t)(match->timestamp_ns - lease->timestamp_ns);
+    pthread_mutex_unlock(&fu->ir_lock);
+
+    DSV4L2_TRACE_BEGIN("fusion_stage");
+    pthread_mutex_lock(&fu->lock);
+    fuse_frame(fu, lease->data, match->data);
+    pthread_mutex_unlock(&fu->lock);
+    DSV4L2_TRACE_END("fusion_stage");
+
+    pthread_mutex_lock(&fu->ir_lock);
+    match->busy = 0;
+    fu->stats.fused++;
+    pthread_mutex_unlock(&fu->ir_lock);
+
+    lease->tags |= DSV4L2_TAG_FUSED;
+    return 0;
+}
+
+/**
+ * Read the counters
+ *
+ * @param fu Fusion
+ * @param stats Output
+ * @return 0 on success, -EINVAL on bad arguments
+ */
+int dsv4l2_fusion_get_stats(dsv4l2_fusion_t *fu, dsv4l2_fusion_stats_t *stats)
+{
+    if (!fu || !stats) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&fu->ir_lock);
+    *stats = fu->stats;
+    pthread_mutex_unlock(&fu->ir_lock);
+
+    return 0;
+}
+
+/**
+ * Free a fusion
+ *
+ * @param fu Fusion
+ */
+void dsv4l2_fusion_destroy(dsv4l2_fusion_t *fu)
+{
+    uint32_t i;
+
+    if (!fu) {
+        return;
+    }
+
+    pthread_mutex_destroy(&fu->lock);
+    pthread_mutex_destroy(&fu->ir_lock);
+    for (i = 0; i < FUSION_HISTORY; i++) {
+        free(fu->history[i].data);
+    }
+    free(fu->map);
+    free(fu->ir_copy);
+    free(fu);
+}
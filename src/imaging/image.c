@@ -0,0 +1,180 @@
+/*
+ * DSV4L2 Imaging - Frame Layout, Luma and Kernel Selection
+ */
+
+#include "imaging_internal.h"
+
+#include <linux/videodev2.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/* -1 until first use */
+static int g_simd_level = -1;
+
+static dsv4l2_simd_level_t cpu_simd_level(void)
+{
+#if DSV4L2_HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return DSV4L2_SIMD_AVX2;
+    }
+    return DSV4L2_SIMD_SSE2;
+#else
+    return DSV4L2_SIMD_SCALAR;
+#endif
+}
+
+/**
+ * Kernel level in use
+ *
+ * @return Best level the CPU supports, capped by $DSV4L2_SIMD
+ */
+dsv4l2_simd_level_t dsv4l2_simd_level(void)
+{
+    int level = __atomic_load_n(&g_simd_level, __ATOMIC_RELAXED);
+    const char *env;
+
+    if (level >= 0) {
+        return (dsv4l2_simd_level_t)level;
+    }
+
+    level = cpu_simd_level();
+    env = getenv("DSV4L2_SIMD");
+    if (env) {
+        if (strcasecmp(env, "scalar") == 0) {
+            level = DSV4L2_SIMD_SCALAR;
+        } else if (strcasecmp(env, "sse2") == 0 && level > DSV4L2_SIMD_SSE2) {
+            level = DSV4L2_SIMD_SSE2;
+        }
+    }
+
+    /* Every thread computes the same value; last store wins harmlessly */
+    __atomic_store_n(&g_simd_level, level, __ATOMIC_RELAXED);
+    return (dsv4l2_simd_level_t)level;
+}
+
+/**
+ * Cap the kernel level
+ *
+ * @param level Requested level
+ * @return Level actually in use
+ */
+dsv4l2_simd_level_t dsv4l2_simd_set_level(dsv4l2_simd_level_t level)
+{
+    dsv4l2_simd_level_t max = cpu_simd_level();
+
+    if (level > max) {
+        level = max;
+    }
+
+    __atomic_store_n(&g_simd_level, (int)level, __ATOMIC_RELAXED);
+    return level;
+}
+
+/**
+ * Bytes per line of the first plane
+ *
+ * @param fmt Frame layout
+ * @return Stride in bytes (0 for unsupported formats)
+ */
+uint32_t dsv4l2_image_stride(const dsv4l2_image_format_t *fmt)
+{
+    if (fmt->stride) {
+        return fmt->stride;
+    }
+
+    switch (fmt->pixelformat) {
+        case V4L2_PIX_FMT_YUYV:  return fmt->width * 2;
+        case V4L2_PIX_FMT_NV12:  return fmt->width;
+        case V4L2_PIX_FMT_GREY:  return fmt->width;
+        case V4L2_PIX_FMT_RGB24: return fmt->width * 3;
+        default:                 return 0;
+    }
+}
+
+/**
+ * Bytes a frame in this layout occupies
+ *
+ * @param fmt Frame layout
+ * @return Size in bytes (0 for unsupported formats)
+ */
+size_t dsv4l2_image_size(const dsv4l2_image_format_t *fmt)
+{
+    size_t plane;
+
+    if (!fmt) {
+        return 0;
+    }
+
+    plane = (size_t)dsv4l2_image_stride(fmt) * fmt->height;
+
+    /* NV12: interleaved CbCr plane at half height */
+    if (fmt->pixelformat == V4L2_PIX_FMT_NV12) {
+        return plane + plane / 2;
+    }
+
+    return plane;
+}
+
+/**
+ * Add one source line's luma into the accumulator
+ */
+static void accumulate_line(const uint8_t *line, uint32_t pixelformat,
+                            uint32_t width, uint16_t *acc)
+{
+    uint32_t x;
+
+    switch (pixelformat) {
+        case V4L2_PIX_FMT_YUYV:
+            for (x = 0; x < width; x++) {
+                acc[x] += line[2 * x];
+            }
+            break;
+        case V4L2_PIX_FMT_RGB24:
+            for (x = 0; x < width; x++) {
+                /* BT.601 luma, 8-bit fixed point */
+                acc[x] += (uint16_t)((77 * line[3 * x] + 150 * line[3 * x + 1] +
+                                      29 * line[3 * x + 2]) >> 8);
+            }
+            break;
+        default:  /* GREY, NV12 luma plane */
+            for (x = 0; x < width; x++) {
+                acc[x] += line[x];
+            }
+            break;
+    }
+}
+
+/**
+ * Box-downsample luma by factor
+ */
+void dsv4l2_luma_downsample(const uint8_t *src, const dsv4l2_image_format_t *fmt,
+                            uint32_t factor, uint8_t *dst, uint32_t dst_stride,
+                            uint16_t *acc)
+{
+    uint32_t stride = dsv4l2_image_stride(fmt);
+    uint32_t dw = fmt->width / factor;
+    uint32_t dh = fmt->height / factor;
+    uint32_t shift = 2 * (uint32_t)__builtin_ctz(factor);
+    uint32_t round = (1u << shift) >> 1;
+    uint32_t used = dw * factor;
+    uint32_t x, y, i, k;
+
+    for (y = 0; y < dh; y++) {
+        memset(acc, 0, used * sizeof(*acc));
+        for (i = 0; i < factor; i++) {
+            accumulate_line(src + (size_t)(y * factor + i) * stride, fmt->pixelformat,
+                            used, acc);
+        }
+
+        for (x = 0; x < dw; x++) {
+            uint32_t sum = 0;
+
+            for (k = 0; k < factor; k++) {
+                sum += acc[x * factor + k];
+            }
+            dst[(size_t)y * dst_stride + x] = (uint8_t)((sum + round) >> shift);
+        }
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * DSV4L2 Imaging - Internal Helpers
+ *
+ * Shared by the imaging stages: frame layout helpers, luma extraction
+ * and the SIMD target macros. Not installed.
+ *
+ * SSE2 is part of the x86-64 baseline and is used unconditionally
+ * there; AVX2 kernels are compiled with a target attribute and only
+ * called when dsv4l2_simd_level() says the CPU has it.
+ */
+
+#ifndef DSV4L2_IMAGING_INTERNAL_H
+#define DSV4L2_IMAGING_INTERNAL_H
+
+#include "dsv4l2_imaging.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__x86_64__)
+#define DSV4L2_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#define DSV4L2_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define DSV4L2_HAVE_X86_SIMD 0
+#endif
+
+/**
+ * Bytes per line of the first plane
+ */
+uint32_t dsv4l2_image_stride(const dsv4l2_image_format_t *fmt);
+
+/**
+ * Box-downsample luma by factor (power of two, 1-8)
+ *
+ * Writes (width / factor) x (height / factor) pixels; trailing source
+ * pixels that do not fill a box are ignored.
+ *
+ * @param src Frame (first plane)
+ * @param fmt Frame layout
+ * @param factor Box size
+ * @param dst Output plane
+ * @param dst_stride Bytes per output line
+ * @param acc Scratch, fmt->width entries
+ */
+void dsv4l2_luma_downsample(const uint8_t *src, const dsv4l2_image_format_t *fmt,
+                            uint32_t factor, uint8_t *dst, uint32_t dst_stride,
+                            uint16_t *acc);
+
+/**
+ * BT.601 limited-range RGB to Y, Cb, Cr
+ */
+static inline void dsv4l2_rgb_to_ycbcr(const uint8_t rgb[3], uint8_t ycc[3])
+{
+    int r = rgb[0], g = rgb[1], b = rgb[2];
+
+    ycc[0] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    ycc[1] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    ycc[2] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+/**
+ * Full-range luma of an RGB pixel (GREY frames)
+ */
+static inline uint8_t dsv4l2_rgb_to_grey(const uint8_t rgb[3])
+{
+    return (uint8_t)((77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2]) >> 8);
+}
+
+#endif /* DSV4L2_IMAGING_INTERNAL_H */
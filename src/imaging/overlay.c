@@ -0,0 +1,590 @@
+/*
+ * DSV4L2 Imaging - Classification Banner and Burn-in
+ *
+ * Text is rendered once into strips already in the frame's pixel
+ * format (YUYV pairs, NV12 luma and CbCr lines, ...), so the per-frame
+ * work is a memcpy per strip line. A strip is re-rendered only when its
+ * text changes: banners on a classification change, the timestamp once
+ * per second.
+ *
+ * Rendering goes through an RGB scratch strip: glyphs come from an
+ * atlas of 0/1 coverage masks pre-scaled at create time, then the strip
+ * is converted to the frame format in one pass.
+ */
+
+#include "imaging_internal.h"
+#include "../dsv4l2_internal.h"
+#include "dsv4l2rt.h"
+
+#include <linux/videodev2.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define GLYPH_W     5
+#define GLYPH_H     7
+#define GLYPH_FIRST 0x20
+#define GLYPH_COUNT 64
+#define CELL_W      (GLYPH_W + 1)            /* One column of spacing */
+#define BANNER_H    (GLYPH_H + 4)            /* Two rows of padding above and below */
+
+#define CLASS_MAX   64
+#define TIME_CHARS  20                       /* "YYYY-MM-DD HH:MM:SSZ" */
+
+/* 5x7 font, ' ' to '_', one byte per row, bit 4 is the leftmost column */
+static const uint8_t font5x7[GLYPH_COUNT][GLYPH_H] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },  /* ' ' */
+    { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 },  /* '!' */
+    { 0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00 },  /* '"' */
+    { 0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a },  /* '#' */
+    { 0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04 },  /* '$' */
+    { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },  /* '%' */
+    { 0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d },  /* '&' */
+    { 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 },  /* ''' */
+    { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },  /* '(' */
+    { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },  /* ')' */
+    { 0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00 },  /* '*' */
+    { 0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00 },  /* '+' */
+    { 0x00, 0x00, 0x00, 0x00, 0x06, 0x04, 0x08 },  /* ',' */
+    { 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00 },  /* '-' */
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c },  /* '.' */
+    { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },  /* '/' */
+    { 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e },  /* '0' */
+    { 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e },  /* '1' */
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f },  /* '2' */
+    { 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e },  /* '3' */
+    { 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02 },  /* '4' */
+    { 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e },  /* '5' */
+    { 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e },  /* '6' */
+    { 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },  /* '7' */
+    { 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e },  /* '8' */
+    { 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c },  /* '9' */
+    { 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00 },  /* ':' */
+    { 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08 },  /* ';' */
+    { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 },  /* '<' */
+    { 0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00 },  /* '=' */
+    { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 },  /* '>' */
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 },  /* '?' */
+    { 0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e },  /* '@' */
+    { 0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 },  /* 'A' */
+    { 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e },  /* 'B' */
+    { 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e },  /* 'C' */
+    { 0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c },  /* 'D' */
+    { 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f },  /* 'E' */
+    { 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10 },  /* 'F' */
+    { 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f },  /* 'G' */
+    { 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 },  /* 'H' */
+    { 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e },  /* 'I' */
+    { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c },  /* 'J' */
+    { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },  /* 'K' */
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f },  /* 'L' */
+    { 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11 },  /* 'M' */
+    { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },  /* 'N' */
+    { 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e },  /* 'O' */
+    { 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10 },  /* 'P' */
+    { 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d },  /* 'Q' */
+    { 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11 },  /* 'R' */
+    { 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e },  /* 'S' */
+    { 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },  /* 'T' */
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e },  /* 'U' */
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04 },  /* 'V' */
+    { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a },  /* 'W' */
+    { 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11 },  /* 'X' */
+    { 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04 },  /* 'Y' */
+    { 0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f },  /* 'Z' */
+    { 0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e },  /* '[' */
+    { 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 },  /* '\\' */
+    { 0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e },  /* ']' */
+    { 0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00 },  /* '^' */
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f },  /* '_' */
+};
+
+typedef struct {
+    uint32_t x, y;               /* Frame pixels, both even */
+    uint32_t w, h;               /* Both even */
+    uint32_t row_bytes;          /* First-plane bytes per line */
+    uint8_t *data;               /* h first-plane lines, then h / 2 NV12 CbCr lines */
+} strip_t;
+
+struct dsv4l2_overlay {
+    dsv4l2_image_format_t format;
+    size_t   frame_size;
+    uint32_t stride;
+    uint32_t bpp;                /* First-plane bytes per pixel */
+    uint32_t flags;
+    uint32_t scale;
+
+    pthread_mutex_t lock;
+    char     fixed[CLASS_MAX];   /* Configured marking, "" = per frame */
+    char     shown[CLASS_MAX];   /* Marking the strips were rendered for */
+    int64_t  shown_second;
+    uint8_t  bg[3], fg[3];
+
+    uint8_t *atlas;              /* GLYPH_COUNT masks of (5 * scale) x (7 * scale) */
+    uint8_t *rgb;                /* Render scratch, one banner */
+    strip_t  top, bottom, stamp;
+};
+
+/* ========================================================================
+ * Rendering
+ * ======================================================================== */
+
+static void build_atlas(dsv4l2_overlay_t *ov)
+{
+    uint32_t s = ov->scale, gw = GLYPH_W * s, gh = GLYPH_H * s;
+    uint32_t c, x, y;
+
+    for (c = 0; c < GLYPH_COUNT; c++) {
+        uint8_t *mask = ov->atlas + (size_t)c * gw * gh;
+
+        for (y = 0; y < gh; y++) {
+            uint8_t bits = font5x7[c][y / s];
+
+            for (x = 0; x < gw; x++) {
+                mask[y * gw + x] = (bits >> (GLYPH_W - 1 - x / s)) & 1;
+            }
+        }
+    }
+}
+
+static uint32_t glyph_index(char ch)
+{
+    if (ch >= 'a' && ch <= 'z') {
+        ch = (char)(ch - 'a' + 'A');
+    }
+    if (ch == '_') {
+        ch = ' ';
+    }
+    if ((unsigned char)ch < GLYPH_FIRST || (unsigned char)ch >= GLYPH_FIRST + GLYPH_COUNT) {
+        ch = '?';
+    }
+
+    return (uint32_t)((unsigned char)ch - GLYPH_FIRST);
+}
+
+/* Marking colours (background, text) */
+static void marking_colours(const char *marking, uint8_t bg[3], uint8_t fg[3])
+{
+    static const struct {
+        const char *prefix;
+        uint8_t bg[3];
+        uint8_t fg[3];
+    } colours[] = {
+        { "TOP SECRET",   { 255, 140, 0 },  { 0, 0, 0 } },
+        { "TOP_SECRET",   { 255, 140, 0 },  { 0, 0, 0 } },
+        { "SECRET",       { 200, 16, 46 },  { 255, 255, 255 } },
+        { "CONFIDENTIAL", { 0, 51, 160 },   { 255, 255, 255 } },
+        { "UNCLASSIFIED", { 0, 122, 51 },   { 255, 255, 255 } },
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(colours) / sizeof(colours[0]); i++) {
+        if (strncmp(marking, colours[i].prefix, strlen(colours[i].prefix)) == 0) {
+            memcpy(bg, colours[i].bg, 3);
+            memcpy(fg, colours[i].fg, 3);
+            return;
+        }
+    }
+
+    /* Unknown markings: black banner, white text */
+    memset(bg, 0, 3);
+    memset(fg, 255, 3);
+}
+
+/* Rank of a marking, 0 for unknown (same prefixes as the colours) */
+static int marking_level(const char *marking)
+{
+    if (strncmp(marking, "TOP SECRET", 10) == 0 || strncmp(marking, "TOP_SECRET", 10) == 0) {
+        return 4;
+    }
+    if (strncmp(marking, "SECRET", 6) == 0) {
+        return 3;
+    }
+    if (strncmp(marking, "CONFIDENTIAL", 12) == 0) {
+        return 2;
+    }
+    if (strncmp(marking, "UNCLASSIFIED", 12) == 0) {
+        return 1;
+    }
+    return 0;
+}
+
+/* Convert the RGB scratch (strip->w x strip->h) into the frame format */
+static void encode_strip(dsv4l2_overlay_t *ov, strip_t *st)
+{
+    const uint8_t *rgb = ov->rgb;
+    uint8_t *out = st->data;
+    uint32_t x, y, w = st->w;
+    uint8_t a[3], b[3];
+
+    switch (ov->format.pixelformat) {
+        case V4L2_PIX_FMT_RGB24:
+            memcpy(out, rgb, (size_t)w * st->h * 3);
+            break;
+
+        case V4L2_PIX_FMT_GREY:
+            for (x = 0; x < w * st->h; x++) {
+                out[x] = dsv4l2_rgb_to_grey(rgb + 3 * x);
+            }
+            break;
+
+        case V4L2_PIX_FMT_YUYV:
+            for (x = 0; x < w * st->h; x += 2) {
+                dsv4l2_rgb_to_ycbcr(rgb + 3 * x, a);
+                dsv4l2_rgb_to_ycbcr(rgb + 3 * x + 3, b);
+                out[2 * x] = a[0];
+                out[2 * x + 1] = (uint8_t)((a[1] + b[1] + 1) >> 1);
+                out[2 * x + 2] = b[0];
+                out[2 * x + 3] = (uint8_t)((a[2] + b[2] + 1) >> 1);
+            }
+            break;
+
+        case V4L2_PIX_FMT_NV12:
+            for (y = 0; y < st->h; y += 2) {
+                uint8_t *uv = out + (size_t)st->h * w + (size_t)(y / 2) * w;
+
+                for (x = 0; x < w; x += 2) {
+                    uint32_t cb = 0, cr = 0, i;
+
+                    for (i = 0; i < 4; i++) {
+                        uint32_t px = (y + i / 2) * w + x + i % 2;
+
+                        dsv4l2_rgb_to_ycbcr(rgb + 3 * px, a);
+                        out[px] = a[0];
+                        cb += a[1];
+                        cr += a[2];
+                    }
+                    uv[x] = (uint8_t)((cb + 2) >> 2);
+                    uv[x + 1] = (uint8_t)((cr + 2) >> 2);
+                }
+            }
+            break;
+    }
+}
+
+/*
+ * Render text into a strip: centred in the columns from `left` on when
+ * centre is set, else left aligned after two cells of padding. Text
+ * that does not fit is cut.
+ */
+static void render_strip(dsv4l2_overlay_t *ov, strip_t *st, const char *text, int centre,
+                         uint32_t left)
+{
+    uint32_t s = ov->scale, gw = GLYPH_W * s, gh = GLYPH_H * s;
+    uint32_t len = (uint32_t)strlen(text), fit, x0, y0, i, x, y;
+
+    for (i = 0; i < st->w * st->h; i++) {
+        memcpy(ov->rgb + 3 * i, ov->bg, 3);
+    }
+
+    fit = st->w > left + 2 * s ? (st->w - left - 2 * s) / (CELL_W * s) : 0;
+    if (len > fit) {
+        len = fit;
+    }
+
+    x0 = centre ? left + (st->w - left - len * CELL_W * s) / 2 : 2 * s;
+    y0 = 2 * s;
+
+    for (i = 0; i < len; i++) {
+        const uint8_t *mask = ov->atlas + (size_t)glyph_index(text[i]) * gw * gh;
+        uint8_t *dst = ov->rgb + 3 * ((size_t)y0 * st->w + x0 + i * CELL_W * s);
+
+        for (y = 0; y < gh; y++) {
+            for (x = 0; x < gw; x++) {
+                if (mask[y * gw + x]) {
+                    memcpy(dst + 3 * ((size_t)y * st->w + x), ov->fg, 3);
+                }
+            }
+        }
+    }
+
+    encode_strip(ov, st);
+}
+
+static void blit_strip(const dsv4l2_overlay_t *ov, const strip_t *st, uint8_t *frame)
+{
+    const uint8_t *src = st->data;
+    uint8_t *dst = frame + (size_t)st->y * ov->stride + (size_t)st->x * ov->bpp;
+    uint32_t y;
+
+    for (y = 0; y < st->h; y++) {
+        memcpy(dst + (size_t)y * ov->stride, src + (size_t)y * st->row_bytes, st->row_bytes);
+    }
+
+    if (ov->format.pixelformat == V4L2_PIX_FMT_NV12) {
+        src += (size_t)st->h * st->row_bytes;
+        dst = frame + (size_t)ov->stride * ov->format.height +
+              (size_t)(st->y / 2) * ov->stride + st->x;
+        for (y = 0; y < st->h / 2; y++) {
+            memcpy(dst + (size_t)y * ov->stride, src + (size_t)y * st->w, st->w);
+        }
+    }
+}
+
+static int strip_init(dsv4l2_overlay_t *ov, strip_t *st, uint32_t x, uint32_t y,
+                      uint32_t w, uint32_t h)
+{
+    size_t bytes;
+
+    st->x = x;
+    st->y = y;
+    st->w = w;
+    st->h = h;
+    st->row_bytes = w * ov->bpp;
+
+    bytes = (size_t)st->row_bytes * h;
+    if (ov->format.pixelformat == V4L2_PIX_FMT_NV12) {
+        bytes += (size_t)w * h / 2;
+    }
+
+    st->data = malloc(bytes);
+    return st->data ? 0 : -ENOMEM;
+}
+
+/* ========================================================================
+ * Overlay
+ * ======================================================================== */
+
+/**
+ * Create an overlay
+ *
+ * @param cfg Configuration
+ * @param out Overlay
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_overlay_create(const dsv4l2_overlay_config_t *cfg, dsv4l2_overlay_t **out)
+{
+    dsv4l2_overlay_t *ov;
+    uint32_t w, h, s, bh, tw;
+    int rc = 0;
+
+    if (!cfg || !out || dsv4l2_image_size(&cfg->format) == 0) {
+        return -EINVAL;
+    }
+
+    w = cfg->format.width;
+    h = cfg->format.height;
+    s = cfg->scale ? cfg->scale : (h / 360 ? h / 360 : 1);
+    bh = (BANNER_H * s + 1) & ~1u;
+    tw = ((TIME_CHARS * CELL_W + 3) * s + 1) & ~1u;
+
+    if (s > 64 || 2 * bh > h || tw > (w & ~1u)) {
+        return -EINVAL;
+    }
+
+    ov = calloc(1, sizeof(*ov));
+    if (!ov) {
+        return -ENOMEM;
+    }
+
+    pthread_mutex_init(&ov->lock, NULL);
+    ov->format = cfg->format;
+    ov->frame_size = dsv4l2_image_size(&cfg->format);
+    ov->stride = dsv4l2_image_stride(&cfg->format);
+    ov->bpp = cfg->format.pixelformat == V4L2_PIX_FMT_YUYV ? 2 :
+              cfg->format.pixelformat == V4L2_PIX_FMT_RGB24 ? 3 : 1;
+    ov->flags = cfg->flags ? cfg->flags :
+                DSV4L2_OVERLAY_BANNER_TOP | DSV4L2_OVERLAY_BANNER_BOTTOM | DSV4L2_OVERLAY_TIMESTAMP;
+    ov->scale = s;
+    ov->shown_second = -1;
+
+    ov->atlas = malloc((size_t)GLYPH_COUNT * GLYPH_W * GLYPH_H * s * s);
+    ov->rgb = malloc((size_t)(w & ~1u) * bh * 3);
+    if (!ov->atlas || !ov->rgb) {
+        rc = -ENOMEM;
+    }
+
+    /* Banners span the (even) width; the timestamp sits on the bottom banner */
+    if (rc == 0 && (ov->flags & DSV4L2_OVERLAY_BANNER_TOP)) {
+        rc = strip_init(ov, &ov->top, 0, 0, w & ~1u, bh);
+    }
+    if (rc == 0 && (ov->flags & DSV4L2_OVERLAY_BANNER_BOTTOM)) {
+        rc = strip_init(ov, &ov->bottom, 0, (h - bh) & ~1u, w & ~1u, bh);
+    }
+    if (rc == 0 && (ov->flags & DSV4L2_OVERLAY_TIMESTAMP)) {
+        rc = strip_init(ov, &ov->stamp, 0, (h - bh) & ~1u, tw, bh);
+    }
+    if (rc == 0) {
+        rc = dsv4l2_overlay_set_classification(ov, cfg->classification);
+    }
+    if (rc < 0) {
+        dsv4l2_overlay_destroy(ov);
+        return rc;
+    }
+
+    build_atlas(ov);
+
+    *out = ov;
+    return 0;
+}
+
+/**
+ * Replace the fixed classification
+ *
+ * @param ov Overlay
+ * @param classification Marking, NULL to follow the lease's device
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_overlay_set_classification(dsv4l2_overlay_t *ov, const char *classification)
+{
+    if (!ov || (classification && strlen(classification) >= CLASS_MAX)) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&ov->lock);
+    snprintf(ov->fixed, sizeof(ov->fixed), "%s", classification ? classification : "");
+    pthread_mutex_unlock(&ov->lock);
+
+    return 0;
+}
+
+/*
+ * Marking precedence: override, then the higher of the configured one
+ * and fallback (the frame's device), then UNCLASSIFIED. A configured
+ * marking never labels a frame below the device it came from.
+ */
+static int burn(dsv4l2_overlay_t *ov, uint8_t *data, size_t len, const char *override,
+                const char *fallback, uint64_t realtime_ns)
+{
+    const char *marking;
+    int64_t second;
+
+    if (len < ov->frame_size) {
+        return -EMSGSIZE;
+    }
+
+    if (realtime_ns == 0) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        realtime_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    }
+    second = (int64_t)(realtime_ns / 1000000000ULL);
+
+    DSV4L2_TRACE_BEGIN("overlay");
+    pthread_mutex_lock(&ov->lock);
+
+    if (override && override[0]) {
+        marking = override;
+    } else if (ov->fixed[0] && (!fallback || !fallback[0] ||
+                                marking_level(ov->fixed) >= marking_level(fallback))) {
+        marking = ov->fixed;
+    } else {
+        marking = fallback && fallback[0] ? fallback : "UNCLASSIFIED";
+    }
+
+    /* Re-render only on change */
+    if (strncmp(marking, ov->shown, CLASS_MAX - 1) != 0) {
+        snprintf(ov->shown, sizeof(ov->shown), "%s", marking);
+        marking_colours(ov->shown, ov->bg, ov->fg);
+        if (ov->top.data) {
+            render_strip(ov, &ov->top, ov->shown, 1, 0);
+        }
+        if (ov->bottom.data) {
+            /* Keep the marking clear of the timestamp */
+            render_strip(ov, &ov->bottom, ov->shown, 1, ov->stamp.w);
+        }
+        ov->shown_second = -1;
+    }
+
+    if (ov->stamp.data && second != ov->shown_second) {
+        time_t t = (time_t)second;
+        struct tm tm;
+        char text[32];
+
+        gmtime_r(&t, &tm);
+        strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%SZ", &tm);
+        render_strip(ov, &ov->stamp, text, 0, 0);
+        ov->shown_second = second;
+    }
+
+    if (ov->top.data) {
+        blit_strip(ov, &ov->top, data);
+    }
+    if (ov->bottom.data) {
+        blit_strip(ov, &ov->bottom, data);
+    }
+    if (ov->stamp.data) {
+        blit_strip(ov, &ov->stamp, data);
+    }
+
+    pthread_mutex_unlock(&ov->lock);
+    DSV4L2_TRACE_END("overlay");
+
+    return 0;
+}
+
+/**
+ * Burn banners and timestamp into a frame
+ *
+ * @param ov Overlay
+ * @param data Frame
+ * @param len Frame bytes
+ * @param classification Marking (NULL = configured, else UNCLASSIFIED)
+ * @param realtime_ns Wall-clock time, 0 = now
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_overlay_apply(dsv4l2_overlay_t *ov, uint8_t *data, size_t len,
+                         const char *classification, uint64_t realtime_ns)
+{
+    if (!ov || !data) {
+        return -EINVAL;
+    }
+
+    return burn(ov, data, len, classification, NULL, realtime_ns);
+}
+
+/**
+ * Pipeline stage
+ *
+ * @param lease Frame
+ * @param ctx Overlay
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_overlay_stage(dsv4l2_lease_t *lease, void *ctx)
+{
+    const char *device_marking = NULL;
+    uint64_t realtime_ns = 0;
+    struct timespec ts;
+
+    if (!lease || !ctx || !lease->data) {
+        return -EINVAL;
+    }
+
+    if (lease->dev) {
+        device_marking = dsv4l2_get_internal(lease->dev)->classification;
+    }
+
+    /* Capture timestamps are monotonic: shift them onto the wall clock */
+    if (lease->timestamp_ns) {
+        int64_t age = (int64_t)(dsv4l2_now_ns() - lease->timestamp_ns);
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        realtime_ns = (uint64_t)((int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec - age);
+    }
+
+    return burn(ctx, lease->data, lease->len, NULL, device_marking, realtime_ns);
+}
+
+/**
+ * Free an overlay
+ *
+ * @param ov Overlay
+ */
+void dsv4l2_overlay_destroy(dsv4l2_overlay_t *ov)
+{
+    if (!ov) {
+        return;
+    }
+
+    pthread_mutex_destroy(&ov->lock);
+    free(ov->atlas);
+    free(ov->rgb);
+    free(ov->top.data);
+    free(ov->bottom.data);
+    free(ov->stamp.data);
+    free(ov);
+}
@@ -0,0 +1,566 @@
+/*
+ * DSV4L2 Imaging - Preview Pyramid
+ *
+ * Level 1 is filtered straight from the frame; levels 2 and 3 are
+ * cascaded row by row while the rows they need are still in cache.
+ * Frames are split into tiles on the shared pool. Tiles are whole
+ * blocks of 2^(levels-1) level 1 pixels, so every cascaded pixel is
+ * built from rows and columns of its own tile.
+ * All box filters round to nearest: (a + b + c + d + 2) >> 2. The SIMD
+ * kernels widen to 16 bits (32 for YUYV) so they match the scalar ones
+ * bit for bit.
+ */
+
+#include "imaging_internal.h"
+#include "dsv4l2rt.h"
+
+#include <linux/videodev2.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef void (*box_row_fn)(const uint8_t *r0, const uint8_t *r1, uint8_t *dst,
+                           uint32_t n);
+
+struct dsv4l2_pyramid_builder {
+    dsv4l2_pyramid_config_t cfg;
+    size_t   frame_size;
+    uint32_t stride;             /* Source stride */
+    uint32_t bpp;                /* Output bytes per pixel */
+    uint32_t width[DSV4L2_PYRAMID_LEVELS];
+    uint32_t height[DSV4L2_PYRAMID_LEVELS];
+    size_t   alloc;              /* Pyramid header plus pixels */
+    box_row_fn grey_box;         /* 8-bit 2x2 box (levels 2+, GREY/NV12 level 1) */
+    box_row_fn yuyv_luma_box;    /* YUYV luma 2x2 box (level 1) */
+};
+
+/* ========================================================================
+ * 2x2 box kernels
+ * ======================================================================== */
+
+static void grey_box_scalar(const uint8_t *r0, const uint8_t *r1, uint8_t *dst,
+                            uint32_t n)
+{
+    uint32_t x;
+
+    for (x = 0; x < n; x++) {
+        dst[x] = (uint8_t)((r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2);
+    }
+}
+
+static void yuyv_luma_box_scalar(const uint8_t *r0, const uint8_t *r1, uint8_t *dst,
+                                 uint32_t n)
+{
+    uint32_t x;
+
+    for (x = 0; x < n; x++) {
+        dst[x] = (uint8_t)((r0[4 * x] + r0[4 * x + 2] + r1[4 * x] + r1[4 * x + 2] + 2) >> 2);
+    }
+}
+
+#if DSV4L2_HAVE_X86_SIMD
+/* Sum horizontal byte pairs of a and b into 16-bit lanes */
+static inline __m128i pair_sum_sse2(__m128i a, __m128i b)
+{
+    const __m128i lo = _mm_set1_epi16(0x00ff);
+
+    return _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, lo), _mm_srli_epi16(a, 8)),
+                         _mm_add_epi16(_mm_and_si128(b, lo), _mm_srli_epi16(b, 8)));
+}
+
+static void grey_box_sse2(const uint8_t *r0, const uint8_t *r1, uint8_t *dst,
+                          uint32_t n)
+{
+    const __m128i two = _mm_set1_epi16(2);
+    uint32_t x = 0;
+
+    for (; x + 16 <= n; x += 16) {
+        __m128i s0 = pair_sum_sse2(_mm_loadu_si128((const __m128i *)(r0 + 2 * x)),
+                                   _mm_loadu_si128((const __m128i *)(r1 + 2 * x)));
+        __m128i s1 = pair_sum_sse2(_mm_loadu_si128((const __m128i *)(r0 + 2 * x + 16)),
+                                   _mm_loadu_si128((const __m128i *)(r1 + 2 * x + 16)));
+
+        s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+        s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(s0, s1));
+    }
+
+    grey_box_scalar(r0 + 2 * x, r1 + 2 * x, dst + x, n - x);
+}
+
+/* Y0 + Y1 of each YUYV macropixel of a and b, in 32-bit lanes */
+static inline __m128i yuyv_sum_sse2(__m128i a, __m128i b)
+{
+    const __m128i y = _mm_set1_epi32(0x00ff00ff);
+    const __m128i lo = _mm_set1_epi32(0xffff);
+
+    a = _mm_and_si128(a, y);
+    b = _mm_and_si128(b, y);
+    return _mm_add_epi32(_mm_add_epi32(_mm_and_si128(a, lo), _mm_srli_epi32(a, 16)),
+                         _mm_add_epi32(_mm_and_si128(b, lo), _mm_srli_epi32(b, 16)));
+}
+
+static void yuyv_luma_box_sse2(const uint8_t *r0, const uint8_t *r1, uint8_t *dst,
+                               uint32_t n)
+{
+    const __m128i two = _mm_set1_epi32(2);
+    __m128i s[4];
+    uint32_t x = 0;
+    int i;
+
+    for (; x + 16 <= n; x += 16) {
+        for (i = 0; i < 4; i++) {
+            s[i] = yuyv_sum_sse2(_mm_loadu_si128((const __m128i *)(r0 + 4 * x + 16 * i)),
+                                 _mm_loadu_si128((const __m128i *)(r1 + 4 * x + 16 * i)));
+            s[i] = _mm_srli_epi32(_mm_add_epi32(s[i], two), 2);
+        }
+        _mm_storeu_si128((__m128i *)(dst + x),
+                         _mm_packus_epi16(_mm_packs_epi32(s[0], s[1]),
+                                          _mm_packs_epi32(s[2], s[3])));
+    }
+
+    yuyv_luma_box_scalar(r0 + 4 * x, r1 + 4 * x, dst + x, n - x);
+}
+
+DSV4L2_TARGET_AVX2
+static inline __m256i pair_sum_avx2(__m256i a, __m256i b)
+{
+    const __m256i lo = _mm256_set1_epi16(0x00ff);
+
+    return _mm256_add_epi16(_mm256_add_epi16(_mm256_and_si256(a, lo), _mm256_srli_epi16(a, 8)),
+                            _mm256_add_epi16(_mm256_and_si256(b, lo), _mm256_srli_epi16(b, 8)));
+}
+
+DSV4L2_TARGET_AVX2
+static void grey_box_avx2(const uint8_t *r0, const uint8_t *r1, uint8_t *dst,
+                          uint32_t n)
+{
+    const __m256i two = _mm256_set1_epi16(2);
+    uint32_t x = 0;
+
+    for (; x + 32 <= n; x += 32) {
+        __m256i s0 = pair_sum_avx2(_mm256_loadu_si256((const __m256i *)(r0 + 2 * x)),
+                                   _mm256_loadu_si256((const __m256i *)(r1 + 2 * x)));
+        __m256i s1 = pair_sum_avx2(_mm256_loadu_si256((const __m256i *)(r0 + 2 * x + 32)),
+                                   _mm256_loadu_si256((const __m256i *)(r1 + 2 * x + 32)));
+
+        s0 = _mm256_srli_epi16(_mm256_add_epi16(s0, two), 2);
+        s1 = _mm256_srli_epi16(_mm256_add_epi16(s1, two), 2);
+
+        /* packus works per 128-bit lane; restore output order */
+        _mm256_storeu_si256((__m256i *)(dst + x),
+                            _mm256_permute4x64_epi64(_mm256_packus_epi16(s0, s1), 0xd8));
+    }
+
+    grey_box_sse2(r0 + 2 * x, r1 + 2 * x, dst + x, n - x);
+}
+
+DSV4L2_TARGET_AVX2
+static inline __m256i yuyv_sum_avx2(__m256i a, __m256i b)
+{
+    const __m256i y = _mm256_set1_epi32(0x00ff00ff);
+    const __m256i lo = _mm256_set1_epi32(0xffff);
+
+    a = _mm256_and_si256(a, y);
+    b = _mm256_and_si256(b, y);
+    return _mm256_add_epi32(_mm256_add_epi32(_mm256_and_si256(a, lo), _mm256_srli_epi32(a, 16)),
+                            _mm256_add_epi32(_mm256_and_si256(b, lo), _mm256_srli_epi32(b, 16)));
+}
+
+DSV4L2_TARGET_AVX2
+static void yuyv_luma_box_avx2(const uint8_t *r0, const uint8_t *r1, uint8_t *dst,
+                               uint32_t n)
+{
+    const __m256i two = _mm256_set1_epi32(2);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    __m256i s[4];
+    uint32_t x = 0;
+    int i;
+
+    for (; x + 32 <= n; x += 32) {
+        for (i = 0; i < 4; i++) {
+            s[i] = yuyv_sum_avx2(_mm256_loadu_si256((const __m256i *)(r0 + 4 * x + 32 * i)),
+                                 _mm256_loadu_si256((const __m256i *)(r1 + 4 * x + 32 * i)));
+            s[i] = _mm256_srli_epi32(_mm256_add_epi32(s[i], two), 2);
+        }
+        _mm256_storeu_si256((__m256i *)(dst + x),
+                            _mm256_permutevar8x32_epi32(
+                                _mm256_packus_epi16(_mm256_packs_epi32(s[0], s[1]),
+                                                    _mm256_packs_epi32(s[2], s[3])),
+                                order));
+    }
+
+    yuyv_luma_box_sse2(r0 + 4 * x, r1 + 4 * x, dst + x, n - x);
+}
+#endif
+
+/* ========================================================================
+ * Scalar level 1 paths (RGB output, RGB24 source)
+ * ======================================================================== */
+
+static inline uint8_t clamp_u8(int v)
+{
+    return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+/* BT.601 limited range YCbCr to RGB */
+static inline void yuv_to_rgb(int y, int u, int v, uint8_t *rgb)
+{
+    int c = 298 * (y - 16);
+    int d = u - 128;
+    int e = v - 128;
+
+    rgb[0] = clamp_u8((c + 409 * e + 128) >> 8);
+    rgb[1] = clamp_u8((c - 100 * d - 208 * e + 128) >> 8);
+    rgb[2] = clamp_u8((c + 516 * d + 128) >> 8);
+}
+
+static inline int rgb_luma(const uint8_t *p)
+{
+    /* Same weights as dsv4l2_luma_downsample() */
+    return (77 * p[0] + 150 * p[1] + 29 * p[2]) >> 8;
+}
+
+static void rgb_box_row(const uint8_t *r0, const uint8_t *r1, uint8_t *dst, uint32_t n)
+{
+    uint32_t x, c;
+
+    for (x = 0; x < n; x++) {
+        for (c = 0; c < 3; c++) {
+            dst[3 * x + c] = (uint8_t)((r0[6 * x + c] + r0[6 * x + 3 + c] +
+                                        r1[6 * x + c] + r1[6 * x + 3 + c] + 2) >> 2);
+        }
+    }
+}
+
+/* Bytes per frame pixel of the 8-bit formats (NV12: luma plane) */
+static uint32_t source_bpp(uint32_t fmt)
+{
+    switch (fmt) {
+        case V4L2_PIX_FMT_YUYV:  return 2;
+        case V4L2_PIX_FMT_RGB24: return 3;
+        default:                 return 1;
+    }
+}
+
+/* Level 1 pixels [x0, x0 + n) of row y from the source frame */
+static void level1_row(const dsv4l2_pyramid_builder_t *pb, const uint8_t *frame,
+                       uint32_t y, uint32_t x0, uint32_t n, uint8_t *dst)
+{
+    uint32_t fmt = pb->cfg.format.pixelformat;
+    const uint8_t *r0 = frame + (size_t)(2 * y) * pb->stride +
+                        (size_t)(2 * x0) * source_bpp(fmt);
+    const uint8_t *r1 = r0 + pb->stride;
+    const uint8_t *uv;
+    uint8_t grey;
+    uint32_t x;
+
+    dst += (size_t)x0 * pb->bpp;
+
+    if (pb->cfg.output == V4L2_PIX_FMT_GREY) {
+        switch (fmt) {
+            case V4L2_PIX_FMT_YUYV:
+                pb->yuyv_luma_box(r0, r1, dst, n);
+                break;
+            case V4L2_PIX_FMT_RGB24:
+                for (x = 0; x < n; x++) {
+                    dst[x] = (uint8_t)((rgb_luma(r0 + 6 * x) + rgb_luma(r0 + 6 * x + 3) +
+                                        rgb_luma(r1 + 6 * x) + rgb_luma(r1 + 6 * x + 3) +
+                                        2) >> 2);
+                }
+                break;
+            default:  /* GREY, NV12 luma plane */
+                pb->grey_box(r0, r1, dst, n);
+                break;
+        }
+        return;
+    }
+
+    switch (fmt) {
+        case V4L2_PIX_FMT_YUYV:
+            for (x = 0; x < n; x++) {
+                const uint8_t *a = r0 + 4 * x;
+                const uint8_t *b = r1 + 4 * x;
+
+                yuv_to_rgb((a[0] + a[2] + b[0] + b[2] + 2) >> 2,
+                           (a[1] + b[1] + 1) >> 1, (a[3] + b[3] + 1) >> 1, dst + 3 * x);
+            }
+            break;
+        case V4L2_PIX_FMT_NV12:
+            /* Chroma is already half resolution: one CbCr pair per output pixel */
+            uv = frame + (size_t)pb->stride * pb->cfg.format.height + (size_t)y * pb->stride +
+                 (size_t)(2 * x0);
+            for (x = 0; x < n; x++) {
+                yuv_to_rgb((r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2,
+                           uv[2 * x], uv[2 * x + 1], dst + 3 * x);
+            }
+            break;
+        case V4L2_PIX_FMT_RGB24:
+            rgb_box_row(r0, r1, dst, n);
+            break;
+        default:  /* GREY */
+            for (x = 0; x < n; x++) {
+                grey = (uint8_t)((r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2);
+                dst[3 * x] = dst[3 * x + 1] = dst[3 * x + 2] = grey;
+            }
+            break;
+    }
+}
+
+/* ========================================================================
+ * Builder
+ * ======================================================================== */
+
+/**
+ * Create a pyramid builder
+ *
+ * @param cfg Configuration
+ * @param out Builder
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_pyramid_create(const dsv4l2_pyramid_config_t *cfg,
+                          dsv4l2_pyramid_builder_t **out)
+{
+    dsv4l2_pyramid_builder_t *pb;
+    uint32_t levels, output, i;
+    size_t size;
+
+    if (!cfg || !out) {
+        return -EINVAL;
+    }
+
+    levels = cfg->levels ? cfg->levels : DSV4L2_PYRAMID_LEVELS;
+    output = cfg->output ? cfg->output : V4L2_PIX_FMT_GREY;
+
+    if (levels > DSV4L2_PYRAMID_LEVELS ||
+        (output != V4L2_PIX_FMT_GREY && output != V4L2_PIX_FMT_RGB24) ||
+        dsv4l2_image_size(&cfg->format) == 0 ||
+        (cfg->format.width >> levels) == 0 || (cfg->format.height >> levels) == 0) {
+        return -EINVAL;
+    }
+
+    pb = calloc(1, sizeof(*pb));
+    if (!pb) {
+        return -ENOMEM;
+    }
+
+    pb->cfg = *cfg;
+    pb->cfg.levels = levels;
+    pb->cfg.output = output;
+    pb->frame_size = dsv4l2_image_size(&cfg->format);
+    pb->stride = dsv4l2_image_stride(&cfg->format);
+    pb->bpp = output == V4L2_PIX_FMT_RGB24 ? 3 : 1;
+
+    size = sizeof(dsv4l2_pyramid_t);
+    for (i = 0; i < levels; i++) {
+        pb->width[i] = cfg->format.width >> (i + 1);
+        pb->height[i] = cfg->format.height >> (i + 1);
+        size += (size_t)pb->width[i] * pb->height[i] * pb->bpp;
+    }
+    pb->alloc = size;
+
+    pb->grey_box = grey_box_scalar;
+    pb->yuyv_luma_box = yuyv_luma_box_scalar;
+#if DSV4L2_HAVE_X86_SIMD
+    switch (dsv4l2_simd_level()) {
+        case DSV4L2_SIMD_AVX2:
+            pb->grey_box = grey_box_avx2;
+            pb->yuyv_luma_box = yuyv_luma_box_avx2;
+            break;
+        case DSV4L2_SIMD_SSE2:
+            pb->grey_box = grey_box_sse2;
+            pb->yuyv_luma_box = yuyv_luma_box_sse2;
+            break;
+        default:
+            break;
+    }
+#endif
+
+    *out = pb;
+    return 0;
+}
+
+typedef struct {
+    const dsv4l2_pyramid_builder_t *pb;
+    const uint8_t    *data;
+    dsv4l2_pyramid_t *pyr;
+    uint32_t          block;     /* Level 1 pixels per tile unit */
+} build_job_t;
+
+/* 2x2 box of level rows r0 and r1, output pixels [x0, x1) */
+static void box_row(const dsv4l2_pyramid_builder_t *pb, const dsv4l2_pyramid_level_t *src,
+                    uint32_t r0, dsv4l2_pyramid_level_t *dst, uint32_t y, uint32_t x0,
+                    uint32_t x1)
+{
+    const uint8_t *a = src->data + (size_t)r0 * src->stride + (size_t)(2 * x0) * pb->bpp;
+    uint8_t *d = dst->data + (size_t)y * dst->stride + (size_t)x0 * pb->bpp;
+
+    if (pb->bpp == 3) {
+        rgb_box_row(a, a + src->stride, d, x1 - x0);
+    } else {
+        pb->grey_box(a, a + src->stride, d, x1 - x0);
+    }
+}
+
+/* Build one tile (in blocks) of every level */
+static void build_tile(void *ctx, const dsv4l2_tile_t *tile)
+{
+    const build_job_t *job = ctx;
+    const dsv4l2_pyramid_builder_t *pb = job->pb;
+    dsv4l2_pyramid_level_t *l = job->pyr->level;
+    uint32_t levels = job->pyr->levels;
+    uint32_t x0 = tile->x * job->block;
+    uint32_t x1 = (tile->x + tile->width) * job->block;
+    uint32_t y0 = tile->y * job->block;
+    uint32_t y1 = (tile->y + tile->height) * job->block;
+    uint32_t y, y2;
+
+    /* Tile edges are block aligned, so halving them stays exact */
+    if (x1 > l[0].width)  x1 = l[0].width;
+    if (y1 > l[0].height) y1 = l[0].height;
+
+    for (y = y0; y < y1; y++) {
+        level1_row(pb, job->data, y, x0, x1 - x0, l[0].data + (size_t)y * l[0].stride);
+
+        /* Cascade as soon as a row pair is complete */
+        y2 = y / 2;
+        if (levels < 2 || !(y & 1) || y2 >= l[1].height) {
+            continue;
+        }
+        box_row(pb, &l[0], y - 1, &l[1], y2, x0 / 2, x1 / 2);
+
+        if (levels < 3 || !(y2 & 1) || y2 / 2 >= l[2].height) {
+            continue;
+        }
+        box_row(pb, &l[1], y2 - 1, &l[2], y2 / 2, x0 / 4, x1 / 4);
+    }
+}
+
+/**
+ * Build a pyramid for one frame
+ *
+ * @param pb Builder
+ * @param data Frame
+ * @param len Frame bytes
+ * @param out Pyramid (free with free())
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_pyramid_build(dsv4l2_pyramid_builder_t *pb, const uint8_t *data, size_t len,
+                         dsv4l2_pyramid_t **out)
+{
+    dsv4l2_pyramid_t *pyr;
+    dsv4l2_pyramid_level_t *l;
+    build_job_t job;
+    uint8_t *pixels;
+    uint32_t i;
+
+    if (!pb || !data || !out) {
+        return -EINVAL;
+    }
+
+    if (len < pb->frame_size) {
+        return -EMSGSIZE;
+    }
+
+    pyr = malloc(pb->alloc);
+    if (!pyr) {
+        return -ENOMEM;
+    }
+
+    DSV4L2_TRACE_BEGIN("pyramid_build");
+
+    memset(pyr, 0, sizeof(*pyr));
+    pyr->pixelformat = pb->cfg.output;
+    pyr->levels = pb->cfg.levels;
+
+    pixels = (uint8_t *)(pyr + 1);
+    for (i = 0; i < pyr->levels; i++) {
+        l = &pyr->level[i];
+        l->width = pb->width[i];
+        l->height = pb->height[i];
+        l->stride = pb->width[i] * pb->bpp;
+        l->data = pixels;
+        pixels += (size_t)l->stride * l->height;
+    }
+
+    job.pb = pb;
+    job.data = data;
+    job.pyr = pyr;
+    job.block = 1u << (pyr->levels - 1);
+
+    dsv4l2_parallel_tiles(dsv4l2_pool_shared(),
+                          (pb->width[0] + job.block - 1) / job.block,
+                          (pb->height[0] + job.block - 1) / job.block,
+                          job.block * job.block * pb->bpp, build_tile, &job);
+
+    DSV4L2_TRACE_END("pyramid_build");
+
+    *out = pyr;
+    return 0;
+}
+
+/**
+ * Pipeline stage
+ *
+ * @param lease Frame
+ * @param ctx Builder
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_pyramid_stage(dsv4l2_lease_t *lease, void *ctx)
+{
+    dsv4l2_pyramid_t *pyr;
+    int rc;
+
+    if (!lease || !ctx) {
+        return -EINVAL;
+    }
+
+    rc = dsv4l2_pyramid_build(ctx, lease->data, lease->len, &pyr);
+    if (rc < 0) {
+        return rc;
+    }
+
+    rc = dsv4l2_lease_attach(lease, DSV4L2_SLOT_PYRAMID, pyr, free);
+    if (rc < 0) {
+        free(pyr);
+    }
+
+    return rc;
+}
+
+/**
+ * Free a pyramid builder
+ *
+ * @param pb Builder
+ */
+void dsv4l2_pyramid_destroy(dsv4l2_pyramid_builder_t *pb)
+{
+    free(pb);
+}
+
+/**
+ * Preview publisher stage
+ *
+ * @param lease Frame
+ * @param ctx dsv4l2_preview_ring_t
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_preview_ring_stage(dsv4l2_lease_t *lease, void *ctx)
+{
+    const dsv4l2_preview_ring_t *pr = ctx;
+    const dsv4l2_pyramid_t *pyr;
+    const dsv4l2_pyramid_level_t *l;
+
+    if (!lease || !pr || !pr->ring) {
+        return -EINVAL;
+    }
+
+    pyr = dsv4l2_lease_get(lease, DSV4L2_SLOT_PYRAMID);
+    if (!pyr || pr->level >= pyr->levels) {
+        return 0;
+    }
+
+    l = &pyr->level[pr->level];
+    return dsv4l2_ring_publish(pr->ring, l->data, (size_t)l->stride * l->height,
+                               lease->sequence, lease->timestamp_ns, lease->flags);
+}
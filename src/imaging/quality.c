@@ -0,0 +1,546 @@
+/*
+ * DSV4L2 Imaging - Frame Quality
+ *
+ * Luma is sampled one grid line at a time into a three-line ring, and
+ * each line is measured as soon as the line below it exists, so only
+ * every factor-th source line is read and the scratch is three lines.
+ * Kernels cover pixels 1..dw-2 of a line: the Laplacian needs both
+ * horizontal neighbours, the gradients the pixel to the right and the
+ * line below.
+ *
+ * Gradients are sums of absolute differences between a line and the
+ * same line shifted one pixel, or the line below: _mm_sad_epu8 does 16
+ * of them per instruction.
+ */
+
+#include "imaging_internal.h"
+#include "dsv4l2rt.h"
+
+#include <linux/videodev2.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct dsv4l2_quality {
+    dsv4l2_quality_config_t cfg;
+    size_t    frame_size;
+    uint32_t  stride;            /* Source bytes per line */
+    uint32_t  dw, dh;            /* Sample grid size */
+};
+
+/**
+ * Sums over one line
+ */
+typedef struct {
+    int64_t  lap;                /* Laplacian */
+    uint64_t lap_sq;             /* Laplacian squared */
+    uint64_t grad[DSV4L2_QUALITY_DIRECTIONS];   /* 0, 45, 90, 135 degrees */
+} line_sums_t;
+
+/* ========================================================================
+ * Line kernels: p, c, n are the lines above, at and below; [x0, x1)
+ * ======================================================================== */
+
+static inline uint32_t absdiff(uint8_t a, uint8_t b)
+{
+    return a > b ? (uint32_t)(a - b) : (uint32_t)(b - a);
+}
+
+static void line_scalar(const uint8_t *p, const uint8_t *c, const uint8_t *n,
+                        uint32_t x0, uint32_t x1, line_sums_t *s)
+{
+    uint32_t x;
+
+    for (x = x0; x < x1; x++) {
+        int32_t lap = 4 * (int32_t)c[x] - c[x - 1] - c[x + 1] - p[x] - n[x];
+
+        s->lap += lap;
+        s->lap_sq += (uint64_t)(lap * lap);
+        s->grad[0] += absdiff(c[x], c[x + 1]);
+        s->grad[1] += absdiff(n[x], c[x + 1]);
+        s->grad[2] += absdiff(c[x], n[x]);
+        s->grad[3] += absdiff(c[x], n[x + 1]);
+    }
+}
+
+#if DSV4L2_HAVE_X86_SIMD
+/* Squared sums are flushed to 64 bits before int32 lanes can overflow */
+#define FLUSH_EVERY 256
+
+static inline uint64_t hsum_epi64_sse2(__m128i v)
+{
+    return (uint64_t)_mm_cvtsi128_si64(v) +
+           (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v));
+}
+
+static inline int64_t hsum_epi32_sse2(__m128i v)
+{
+    int32_t lane[4];
+    int64_t sum = 0;
+    int i;
+
+    _mm_storeu_si128((__m128i *)lane, v);
+    for (i = 0; i < 4; i++) {
+        sum += lane[i];
+    }
+    return sum;
+}
+
+static inline __m128i laplacian_sse2(__m128i c, __m128i l, __m128i r, __m128i u,
+                                     __m128i d)
+{
+    return _mm_sub_epi16(_mm_slli_epi16(c, 2),
+                         _mm_add_epi16(_mm_add_epi16(l, r), _mm_add_epi16(u, d)));
+}
+
+static void line_sse2(const uint8_t *p, const uint8_t *c, const uint8_t *n,
+                      uint32_t x0, uint32_t x1, line_sums_t *s)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    __m128i g0 = zero, g1 = zero, g2 = zero, g3 = zero;
+    __m128i lap = zero, sq = zero;
+    uint32_t x = x0, iter = 0;
+
+    for (; x + 16 <= x1; x += 16) {
+        __m128i vc = _mm_loadu_si128((const __m128i *)(c + x));
+        __m128i vl = _mm_loadu_si128((const __m128i *)(c + x - 1));
+        __m128i vr = _mm_loadu_si128((const __m128i *)(c + x + 1));
+        __m128i vu = _mm_loadu_si128((const __m128i *)(p + x));
+        __m128i vd = _mm_loadu_si128((const __m128i *)(n + x));
+        __m128i vdr = _mm_loadu_si128((const __m128i *)(n + x + 1));
+        __m128i lo, hi;
+
+        g0 = _mm_add_epi64(g0, _mm_sad_epu8(vc, vr));
+        g1 = _mm_add_epi64(g1, _mm_sad_epu8(vd, vr));
+        g2 = _mm_add_epi64(g2, _mm_sad_epu8(vc, vd));
+        g3 = _mm_add_epi64(g3, _mm_sad_epu8(vc, vdr));
+
+        lo = laplacian_sse2(_mm_unpacklo_epi8(vc, zero), _mm_unpacklo_epi8(vl, zero),
+                            _mm_unpacklo_epi8(vr, zero), _mm_unpacklo_epi8(vu, zero),
+                            _mm_unpacklo_epi8(vd, zero));
+        hi = laplacian_sse2(_mm_unpackhi_epi8(vc, zero), _mm_unpackhi_epi8(vl, zero),
+                            _mm_unpackhi_epi8(vr, zero), _mm_unpackhi_epi8(vu, zero),
+                            _mm_unpackhi_epi8(vd, zero));
+
+        lap = _mm_add_epi32(lap, _mm_madd_epi16(_mm_add_epi16(lo, hi), one));
+        sq = _mm_add_epi32(sq, _mm_add_epi32(_mm_madd_epi16(lo, lo),
+                                             _mm_madd_epi16(hi, hi)));
+
+        if (++iter == FLUSH_EVERY) {
+            s->lap_sq += (uint64_t)hsum_epi32_sse2(sq);
+            sq = zero;
+            iter = 0;
+        }
+    }
+
+    s->lap += hsum_epi32_sse2(lap);
+    s->lap_sq += (uint64_t)hsum_epi32_sse2(sq);
+    s->grad[0] += hsum_epi64_sse2(g0);
+    s->grad[1] += hsum_epi64_sse2(g1);
+    s->grad[2] += hsum_epi64_sse2(g2);
+    s->grad[3] += hsum_epi64_sse2(g3);
+
+    line_scalar(p, c, n, x, x1, s);
+}
+
+DSV4L2_TARGET_AVX2
+static inline uint64_t hsum_epi64_avx2(__m256i v)
+{
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+
+    return (uint64_t)_mm_cvtsi128_si64(s) +
+           (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(s, s));
+}
+
+DSV4L2_TARGET_AVX2
+static inline int64_t hsum_epi32_avx2(__m256i v)
+{
+    __m256i wide = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)),
+                                    _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+
+    return (int64_t)hsum_epi64_avx2(wide);
+}
+
+DSV4L2_TARGET_AVX2
+static inline __m256i laplacian_avx2(__m128i c, __m128i l, __m128i r, __m128i u,
+                                     __m128i d)
+{
+    __m256i side = _mm256_add_epi16(_mm256_add_epi16(_mm256_cvtepu8_epi16(l),
+                                                     _mm256_cvtepu8_epi16(r)),
+                                    _mm256_add_epi16(_mm256_cvtepu8_epi16(u),
+                                                     _mm256_cvtepu8_epi16(d)));
+
+    return _mm256_sub_epi16(_mm256_slli_epi16(_mm256_cvtepu8_epi16(c), 2), side);
+}
+
+DSV4L2_TARGET_AVX2
+static void line_avx2(const uint8_t *p, const uint8_t *c, const uint8_t *n,
+                      uint32_t x0, uint32_t x1, line_sums_t *s)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+    __m256i g0 = zero, g1 = zero, g2 = zero, g3 = zero;
+    __m256i lap = zero, sq = zero;
+    uint32_t x = x0, iter = 0;
+
+    for (; x + 32 <= x1; x += 32) {
+        __m256i vc = _mm256_loadu_si256((const __m256i *)(c + x));
+        __m256i vl = _mm256_loadu_si256((const __m256i *)(c + x - 1));
+        __m256i vr = _mm256_loadu_si256((const __m256i *)(c + x + 1));
+        __m256i vu = _mm256_loadu_si256((const __m256i *)(p + x));
+        __m256i vd = _mm256_loadu_si256((const __m256i *)(n + x));
+        __m256i vdr = _mm256_loadu_si256((const __m256i *)(n + x + 1));
+        __m256i lo, hi;
+
+        g0 = _mm256_add_epi64(g0, _mm256_sad_epu8(vc, vr));
+        g1 = _mm256_add_epi64(g1, _mm256_sad_epu8(vd, vr));
+        g2 = _mm256_add_epi64(g2, _mm256_sad_epu8(vc, vd));
+        g3 = _mm256_add_epi64(g3, _mm256_sad_epu8(vc, vdr));
+
+        lo = laplacian_avx2(_mm256_castsi256_si128(vc), _mm256_castsi256_si128(vl),
+                            _mm256_castsi256_si128(vr), _mm256_castsi256_si128(vu),
+                            _mm256_castsi256_si128(vd));
+        hi = laplacian_avx2(_mm256_extracti128_si256(vc, 1), _mm256_extracti128_si256(vl, 1),
+                            _mm256_extracti128_si256(vr, 1), _mm256_extracti128_si256(vu, 1),
+                            _mm256_extracti128_si256(vd, 1));
+
+        lap = _mm256_add_epi32(lap, _mm256_madd_epi16(_mm256_add_epi16(lo, hi), one));
+        sq = _mm256_add_epi32(sq, _mm256_add_epi32(_mm256_madd_epi16(lo, lo),
+                                                   _mm256_madd_epi16(hi, hi)));
+
+        if (++iter == FLUSH_EVERY) {
+            s->lap_sq += (uint64_t)hsum_epi32_avx2(sq);
+            sq = zero;
+            iter = 0;
+        }
+    }
+
+    s->lap += hsum_epi32_avx2(lap);
+    s->lap_sq += (uint64_t)hsum_epi32_avx2(sq);
+    s->grad[0] += hsum_epi64_avx2(g0);
+    s->grad[1] += hsum_epi64_avx2(g1);
+    s->grad[2] += hsum_epi64_avx2(g2);
+    s->grad[3] += hsum_epi64_avx2(g3);
+
+    line_scalar(p, c, n, x, x1, s);
+}
+#endif
+
+typedef void (*line_fn)(const uint8_t *, const uint8_t *, const uint8_t *,
+                        uint32_t, uint32_t, line_sums_t *);
+
+static line_fn select_line(void)
+{
+#if DSV4L2_HAVE_X86_SIMD
+    switch (dsv4l2_simd_level()) {
+        case DSV4L2_SIMD_AVX2: return line_avx2;
+        case DSV4L2_SIMD_SSE2: return line_sse2;
+        default:               break;
+    }
+#endif
+    return line_scalar;
+}
+
+/* ========================================================================
+ * Assessor
+ * ======================================================================== */
+
+#if DSV4L2_HAVE_X86_SIMD
+/* Even bytes of two vectors */
+static inline __m128i even_bytes_sse2(__m128i a, __m128i b)
+{
+    const __m128i low = _mm_set1_epi16(0x00ff);
+
+    return _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low));
+}
+#endif
+
+/**
+ * Copy every pitch-th byte (1, 2 or 4); returns how many were copied
+ */
+static uint32_t pick_bytes(const uint8_t *src, uint32_t pitch, uint32_t n, uint8_t *dst)
+{
+    uint32_t x = 0;
+
+    if (pitch == 1) {
+        memcpy(dst, src, n);
+        return n;
+    }
+
+#if DSV4L2_HAVE_X86_SIMD
+    if (pitch == 2) {
+        for (; x + 16 <= n; x += 16) {
+            const uint8_t *p = src + 2 * x;
+
+            _mm_storeu_si128((__m128i *)(dst + x),
+                             even_bytes_sse2(_mm_loadu_si128((const __m128i *)p),
+                                             _mm_loadu_si128((const __m128i *)(p + 16))));
+        }
+    } else if (pitch == 4) {
+        for (; x + 16 <= n; x += 16) {
+            const uint8_t *p = src + 4 * x;
+            __m128i lo = even_bytes_sse2(_mm_loadu_si128((const __m128i *)p),
+                                         _mm_loadu_si128((const __m128i *)(p + 16)));
+            __m128i hi = even_bytes_sse2(_mm_loadu_si128((const __m128i *)(p + 32)),
+                                         _mm_loadu_si128((const __m128i *)(p + 48)));
+
+            _mm_storeu_si128((__m128i *)(dst + x), even_bytes_sse2(lo, hi));
+        }
+    }
+#endif
+
+    return x;
+}
+
+/**
+ * Luma of every step-th pixel of one source line
+ */
+static void sample_line(const uint8_t *line, uint32_t pixelformat, uint32_t step,
+                        uint32_t n, uint8_t *dst)
+{
+    uint32_t x;
+
+    switch (pixelformat) {
+        case V4L2_PIX_FMT_YUYV:
+            x = 2 * step <= 4 ? pick_bytes(line, 2 * step, n, dst) : 0;
+            for (; x < n; x++) {
+                dst[x] = line[2 * step * x];
+            }
+            break;
+        case V4L2_PIX_FMT_RGB24:
+            for (x = 0; x < n; x++) {
+                dst[x] = dsv4l2_rgb_to_grey(line + 3 * step * x);
+            }
+            break;
+        default:  /* GREY, NV12 luma plane */
+            x = step <= 4 && step != 3 ? pick_bytes(line, step, n, dst) : 0;
+            for (; x < n; x++) {
+                dst[x] = line[step * x];
+            }
+            break;
+    }
+}
+
+/**
+ * Create a quality assessor
+ *
+ * @param cfg Configuration (format required)
+ * @param out Assessor
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_quality_create(const dsv4l2_quality_config_t *cfg, dsv4l2_quality_t **out)
+{
+    dsv4l2_quality_t *q;
+    uint32_t factor;
+
+    if (!cfg || !out) {
+        return -EINVAL;
+    }
+
+    factor = cfg->factor ? cfg->factor : 2;
+    if (factor > 8) {
+        return -EINVAL;
+    }
+
+    if (dsv4l2_image_size(&cfg->format) == 0 ||
+        cfg->format.width / factor < 3 || cfg->format.height / factor < 3) {
+        return -EINVAL;
+    }
+
+    q = calloc(1, sizeof(*q));
+    if (!q) {
+        return -ENOMEM;
+    }
+
+    q->cfg = *cfg;
+    q->cfg.factor = factor;
+    if (!q->cfg.dark_level)            q->cfg.dark_level = 8;
+    if (!q->cfg.bright_level)          q->cfg.bright_level = 247;
+    if (q->cfg.bright_level > 255)     q->cfg.bright_level = 255;
+    if (q->cfg.focus_ref <= 0.0f)      q->cfg.focus_ref = 100.0f;
+    if (q->cfg.clip_limit <= 0.0f)     q->cfg.clip_limit = 0.25f;
+    if (q->cfg.isotropy_ref <= 0.0f)   q->cfg.isotropy_ref = 0.5f;
+
+    q->frame_size = dsv4l2_image_size(&cfg->format);
+    q->stride = dsv4l2_image_stride(&cfg->format);
+    q->dw = cfg->format.width / factor;
+    q->dh = cfg->format.height / factor;
+
+    *out = q;
+    return 0;
+}
+
+static inline float clamp01(float v)
+{
+    return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+}
+
+/**
+ * Turn the accumulated sums into metrics and a score
+ */
+static void finish(const dsv4l2_quality_t *q, const line_sums_t *s, uint64_t luma,
+                   dsv4l2_quality_result_t *result)
+{
+    const dsv4l2_quality_config_t *cfg = &q->cfg;
+    double n = (double)(q->dw - 2) * (double)(q->dh - 2);
+    double mean_lap = (double)s->lap / n;
+    uint32_t i, dark = 0, bright = 0;
+
+    result->focus = (float)((double)s->lap_sq / n - mean_lap * mean_lap);
+    result->mean = (float)((double)luma / result->pixels);
+
+    for (i = 0; i <= cfg->dark_level && i < 256; i++) {
+        dark += result->histogram[i];
+    }
+    for (i = cfg->bright_level; i < 256; i++) {
+        bright += result->histogram[i];
+    }
+    result->dark = (float)dark / (float)result->pixels;
+    result->bright = (float)bright / (float)result->pixels;
+
+    for (i = 0; i < DSV4L2_QUALITY_DIRECTIONS; i++) {
+        result->gradient[i] = (float)((double)s->grad[i] / n);
+    }
+
+    /*
+     * Compare perpendicular directions only (0/90 and 45/135): diagonal
+     * neighbours are further apart, so their differences are not
+     * comparable with the axis-aligned ones.
+     */
+    result->isotropy = 1.0f;
+    for (i = 0; i < 2; i++) {
+        float a = result->gradient[i], b = result->gradient[i + 2];
+        float lo = a < b ? a : b, hi = a < b ? b : a;
+        float ratio = hi > 0.0f ? lo / hi : 0.0f;
+
+        if (ratio < result->isotropy) {
+            result->isotropy = ratio;
+            result->blur_angle = (a < b ? i : i + 2) * 45;
+        }
+    }
+
+    result->score = clamp01(result->focus / cfg->focus_ref) *
+                    clamp01(1.0f - (result->dark + result->bright) / cfg->clip_limit) *
+                    clamp01(result->isotropy / cfg->isotropy_ref);
+}
+
+/**
+ * Measure one frame
+ *
+ * @param q Assessor
+ * @param data Frame
+ * @param len Frame bytes (at least the configured frame size)
+ * @param result Output
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_quality_analyze(dsv4l2_quality_t *q, const uint8_t *data, size_t len,
+                           dsv4l2_quality_result_t *result)
+{
+    line_sums_t sums;
+    line_fn line;
+    uint8_t *ring, *lines[3];
+    uint64_t luma = 0;
+    uint32_t factor, x, y;
+
+    if (!q || !data || !result) {
+        return -EINVAL;
+    }
+
+    if (len < q->frame_size) {
+        return -EMSGSIZE;
+    }
+
+    factor = q->cfg.factor;
+    ring = malloc(3 * (size_t)q->dw);
+    if (!ring) {
+        return -ENOMEM;
+    }
+
+    DSV4L2_TRACE_BEGIN("quality_analyze");
+    line = select_line();
+
+    memset(result, 0, sizeof(*result));
+    memset(&sums, 0, sizeof(sums));
+    result->pixels = q->dw * q->dh;
+
+    for (y = 0; y < q->dh; y++) {
+        uint8_t *cur = ring + (size_t)(y % 3) * q->dw;
+
+        sample_line(data + (size_t)y * factor * q->stride, q->cfg.format.pixelformat,
+                    factor, q->dw, cur);
+
+        for (x = 0; x < q->dw; x++) {
+            result->histogram[cur[x]]++;
+            luma += cur[x];
+        }
+
+        /* Line y completes the neighbourhood of line y - 1 */
+        if (y >= 2) {
+            lines[0] = ring + (size_t)((y - 2) % 3) * q->dw;
+            lines[1] = ring + (size_t)((y - 1) % 3) * q->dw;
+            lines[2] = cur;
+            line(lines[0], lines[1], lines[2], 1, q->dw - 1, &sums);
+        }
+    }
+
+    finish(q, &sums, luma, result);
+
+    DSV4L2_TRACE_END("quality_analyze");
+    free(ring);
+    return 0;
+}
+
+/**
+ * Pipeline stage
+ *
+ * @param lease Frame
+ * @param ctx Assessor
+ * @return 0, DSV4L2_STAGE_SKIP for dropped low-quality frames, or
+ *         negative errno
+ */
+int dsv4l2_quality_stage(dsv4l2_lease_t *lease, void *ctx)
+{
+    dsv4l2_quality_t *q = ctx;
+    dsv4l2_quality_result_t *result;
+    int rc;
+
+    if (!lease || !q) {
+        return -EINVAL;
+    }
+
+    result = malloc(sizeof(*result));
+    if (!result) {
+        return -ENOMEM;
+    }
+
+    rc = dsv4l2_quality_analyze(q, lease->data, lease->len, result);
+    if (rc < 0) {
+        free(result);
+        return rc;
+    }
+
+    rc = dsv4l2_lease_attach(lease, DSV4L2_SLOT_QUALITY, result, free);
+    if (rc < 0) {
+        free(result);
+        return rc;
+    }
+
+    if (result->score >= q->cfg.min_score) {
+        lease->tags &= ~DSV4L2_TAG_LOW_QUALITY;
+        return 0;
+    }
+
+    lease->tags |= DSV4L2_TAG_LOW_QUALITY;
+    return q->cfg.skip_low ? DSV4L2_STAGE_SKIP : 0;
+}
+
+/**
+ * Free a quality assessor
+ *
+ * @param q Assessor
+ */
+void dsv4l2_quality_destroy(dsv4l2_quality_t *q)
+{
+    free(q);
+}
@@ -0,0 +1,918 @@
+/*
+ * DSV4L2 Imaging - Region Redaction
+ *
+ * Every format is handled as a set of 8-bit component planes (Y, Cb, Cr
+ * or R, G, B) described by base, pixel step, line stride and
+ * subsampling, so each mode is written once. Region geometry is
+ * converted to per-row spans in each plane's own coordinates.
+ *
+ * Blur gathers the region (plus a clamped margin) into a contiguous
+ * scratch plane, runs a horizontal running-sum pass and a vertical
+ * pass that is vectorised across columns, then writes back only the
+ * pixels inside the region. Division by the window size is a 16-bit
+ * reciprocal multiply in every kernel so all SIMD levels agree.
+ *
+ * Each pass runs on the shared pool: fills, write-backs and the row
+ * passes over tiles of the region's bounding box, the vertical blur
+ * pass over column ranges and pixelation over bands of cells.
+ */
+
+#include "imaging_internal.h"
+#include "dsv4l2rt.h"
+
+#include <linux/videodev2.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_BLUR_RADIUS 64
+
+/* Columns per range of the vertical blur pass */
+#define VBOX_GRAIN 256
+
+/* Merged spans for one plane row (subsampled rows merge several luma rows) */
+#define MAX_SPANS (4 * DSV4L2_REDACT_MAX_VERTICES)
+
+/* Spans polygon_row() may return: centre-line pairs plus one per edge */
+#define POLY_ROW_SPANS (DSV4L2_REDACT_MAX_VERTICES / 2 + DSV4L2_REDACT_MAX_VERTICES)
+
+typedef struct {
+    uint8_t *base;
+    uint32_t step;               /* Bytes between horizontally adjacent samples */
+    uint32_t stride;
+    uint32_t xs, ys;             /* Subsampling relative to frame pixels */
+    uint32_t w, h;
+    uint8_t  fill;
+} plane_t;
+
+typedef struct {
+    uint32_t x0, x1;
+} span_t;
+
+typedef void (*vbox_step_fn)(uint16_t *sums, const uint8_t *add, const uint8_t *sub,
+                             uint8_t *out, uint32_t w, uint16_t half, uint16_t m);
+
+struct dsv4l2_redactor {
+    dsv4l2_image_format_t format;
+    size_t   frame_size;
+    uint32_t stride;
+
+    pthread_mutex_t lock;        /* Regions and scratch */
+    dsv4l2_redact_region_t regions[DSV4L2_REDACT_MAX_REGIONS];
+    uint32_t count;
+
+    uint8_t  *gather;            /* Region plus blur margin */
+    uint8_t  *hpass;
+    uint8_t  *vpass;
+    uint16_t *sums;
+    vbox_step_fn vbox_step;
+};
+
+/* One plane of one region, shared by the tiles of a pass */
+typedef struct {
+    dsv4l2_redactor_t *r;
+    const dsv4l2_redact_region_t *reg;
+    const plane_t *p;
+    span_t   cols, rows;         /* Bounding box in plane samples */
+    uint32_t cw, ch, ncells;     /* Pixelate cell size; cells per band */
+    uint32_t radius, win, bw, ew;
+    uint16_t half, m;            /* Blur rounding and reciprocal */
+} redact_job_t;
+
+/* ========================================================================
+ * Vertical box pass kernels
+ *
+ * Emit one output row from the column sums, then slide the window:
+ * sums += add - sub (skipped when add is NULL).
+ * ======================================================================== */
+
+static void vbox_step_scalar(uint16_t *sums, const uint8_t *add, const uint8_t *sub,
+                             uint8_t *out, uint32_t w, uint16_t half, uint16_t m)
+{
+    uint32_t x;
+
+    for (x = 0; x < w; x++) {
+        out[x] = (uint8_t)(((uint32_t)(uint16_t)(sums[x] + half) * m) >> 16);
+        if (add) {
+            sums[x] = (uint16_t)(sums[x] + add[x] - sub[x]);
+        }
+    }
+}
+
+#if DSV4L2_HAVE_X86_SIMD
+static void vbox_step_sse2(uint16_t *sums, const uint8_t *add, const uint8_t *sub,
+                           uint8_t *out, uint32_t w, uint16_t half, uint16_t m)
+{
+    const __m128i vhalf = _mm_set1_epi16((short)half);
+    const __m128i vm = _mm_set1_epi16((short)m);
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t x = 0;
+
+    for (; x + 8 <= w; x += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(sums + x));
+        __m128i o = _mm_mulhi_epu16(_mm_add_epi16(s, vhalf), vm);
+
+        _mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(o, o));
+        if (add) {
+            __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(add + x)), zero);
+            __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(sub + x)), zero);
+
+            _mm_storeu_si128((__m128i *)(sums + x), _mm_sub_epi16(_mm_add_epi16(s, a), b));
+        }
+    }
+
+    vbox_step_scalar(sums + x, add ? add + x : NULL, sub ? sub + x : NULL,
+                     out + x, w - x, half, m);
+}
+
+DSV4L2_TARGET_AVX2
+static void vbox_step_avx2(uint16_t *sums, const uint8_t *add, const uint8_t *sub,
+                           uint8_t *out, uint32_t w, uint16_t half, uint16_t m)
+{
+    const __m256i vhalf = _mm256_set1_epi16((short)half);
+    const __m256i vm = _mm256_set1_epi16((short)m);
+    uint32_t x = 0;
+
+    for (; x + 16 <= w; x += 16) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(sums + x));
+        __m256i o = _mm256_mulhi_epu16(_mm256_add_epi16(s, vhalf), vm);
+
+        /* packus is per 128-bit lane; gather both lanes' bytes into the low half */
+        o = _mm256_permute4x64_epi64(_mm256_packus_epi16(o, o), 0xd8);
+        _mm_storeu_si128((__m128i *)(out + x), _mm256_castsi256_si128(o));
+        if (add) {
+            __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(add + x)));
+            __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(sub + x)));
+
+            _mm256_storeu_si256((__m256i *)(sums + x),
+                                _mm256_sub_epi16(_mm256_add_epi16(s, a), b));
+        }
+    }
+
+    vbox_step_sse2(sums + x, add ? add + x : NULL, sub ? sub + x : NULL,
+                   out + x, w - x, half, m);
+}
+#endif
+
+/* ========================================================================
+ * Geometry
+ * ======================================================================== */
+
+static uint32_t frame_planes(const dsv4l2_redactor_t *r, uint8_t *data,
+                             const uint8_t rgb[3], plane_t *p)
+{
+    const dsv4l2_image_format_t *f = &r->format;
+    uint8_t ycc[3];
+    uint8_t y, u, v;
+    uint32_t i;
+
+    dsv4l2_rgb_to_ycbcr(rgb, ycc);
+    y = ycc[0];
+    u = ycc[1];
+    v = ycc[2];
+
+    for (i = 0; i < 3; i++) {
+        p[i].stride = r->stride;
+        p[i].xs = p[i].ys = 1;
+        p[i].w = f->width;
+        p[i].h = f->height;
+    }
+
+    switch (f->pixelformat) {
+        case V4L2_PIX_FMT_YUYV:
+            p[0].base = data;     p[0].step = 2; p[0].fill = y;
+            p[1].base = data + 1; p[1].step = 4; p[1].fill = u;
+            p[2].base = data + 3; p[2].step = 4; p[2].fill = v;
+            for (i = 1; i < 3; i++) {
+                p[i].xs = 2;
+                p[i].w = f->width / 2;
+            }
+            return 3;
+
+        case V4L2_PIX_FMT_NV12:
+            p[0].base = data; p[0].step = 1; p[0].fill = y;
+            p[1].base = data + (size_t)r->stride * f->height;
+            p[2].base = p[1].base + 1;
+            p[1].fill = u;
+            p[2].fill = v;
+            for (i = 1; i < 3; i++) {
+                p[i].step = 2;
+                p[i].xs = p[i].ys = 2;
+                p[i].w = f->width / 2;
+                p[i].h = f->height / 2;
+            }
+            return 3;
+
+        case V4L2_PIX_FMT_RGB24:
+            for (i = 0; i < 3; i++) {
+                p[i].base = data + i;
+                p[i].step = 3;
+                p[i].fill = rgb[i];
+            }
+            return 3;
+
+        default:  /* GREY */
+            p[0].base = data;
+            p[0].step = 1;
+            p[0].fill = dsv4l2_rgb_to_grey(rgb);
+            return 1;
+    }
+}
+
+static int region_valid(const dsv4l2_redact_region_t *reg)
+{
+    if ((unsigned int)reg->mode > DSV4L2_REDACT_BLUR) {
+        return 0;
+    }
+
+    if (reg->vertices != 0 &&
+        (reg->vertices < 3 || reg->vertices > DSV4L2_REDACT_MAX_VERTICES)) {
+        return 0;
+    }
+
+    return reg->mode != DSV4L2_REDACT_BLUR || reg->param <= MAX_BLUR_RADIUS;
+}
+
+/* Region bounds in frame pixels, clipped; 0 if empty */
+static int frame_bbox(const dsv4l2_redact_region_t *reg, const dsv4l2_image_format_t *f,
+                      int64_t *x0, int64_t *y0, int64_t *x1, int64_t *y1)
+{
+    uint32_t i;
+
+    if (reg->vertices == 0) {
+        *x0 = reg->x;
+        *y0 = reg->y;
+        *x1 = (int64_t)reg->x + reg->width;
+        *y1 = (int64_t)reg->y + reg->height;
+    } else {
+        *x0 = *x1 = reg->vertex[0].x;
+        *y0 = *y1 = reg->vertex[0].y;
+        for (i = 1; i < reg->vertices; i++) {
+            if (reg->vertex[i].x < *x0) *x0 = reg->vertex[i].x;
+            if (reg->vertex[i].x > *x1) *x1 = reg->vertex[i].x;
+            if (reg->vertex[i].y < *y0) *y0 = reg->vertex[i].y;
+            if (reg->vertex[i].y > *y1) *y1 = reg->vertex[i].y;
+        }
+    }
+
+    if (*x0 < 0) *x0 = 0;
+    if (*y0 < 0) *y0 = 0;
+    if (*x1 > f->width)  *x1 = f->width;
+    if (*y1 > f->height) *y1 = f->height;
+
+    return *x0 < *x1 && *y0 < *y1;
+}
+
+/* Frame-pixel column range [x0, x1) to plane samples, with chroma margin */
+static void to_plane_x(const plane_t *p, int64_t x0, int64_t x1, span_t *s)
+{
+    int64_t m = p->xs > 1 || p->ys > 1;
+    int64_t a = x0 / p->xs - m;
+    int64_t b = (x1 + p->xs - 1) / p->xs + m;
+
+    s->x0 = (uint32_t)(a < 0 ? 0 : a);
+    s->x1 = (uint32_t)(b > p->w ? p->w : b);
+}
+
+/* Plane bounding box; 0 if empty */
+static int plane_bbox(const dsv4l2_redact_region_t *reg, const dsv4l2_image_format_t *f,
+                      const plane_t *p, span_t *cols, span_t *rows)
+{
+    int64_t x0, y0, x1, y1, m, a, b;
+
+    if (!frame_bbox(reg, f, &x0, &y0, &x1, &y1)) {
+        return 0;
+    }
+
+    to_plane_x(p, x0, x1, cols);
+
+    m = p->xs > 1 || p->ys > 1;
+    a = y0 / p->ys - m;
+    b = (y1 + p->ys - 1) / p->ys + m;
+    rows->x0 = (uint32_t)(a < 0 ? 0 : a);
+    rows->x1 = (uint32_t)(b > p->h ? p->h : b);
+
+    return cols->x0 < cols->x1 && rows->x0 < rows->x1;
+}
+
+/* floor/ceil without pulling in libm */
+static int64_t floor_i64(double v)
+{
+    int64_t i = (int64_t)v;
+
+    return (double)i > v ? i - 1 : i;
+}
+
+static int64_t ceil_i64(double v)
+{
+    int64_t i = (int64_t)v;
+
+    return (double)i < v ? i + 1 : i;
+}
+
+/*
+ * Even-odd polygon spans on frame row ly, in frame pixels (any overlap
+ * counts; spans may overlap, the caller merges them)
+ *
+ * A pixel the polygon touches either lies wholly inside it - its centre
+ * is inside, so the centre-line crossings cover it - or has an edge
+ * passing through it, so the x extent of that edge clipped to
+ * [ly, ly + 1] covers it. The extents matter for shallow edges, which
+ * cross many pixels of a row away from where they meet the centre line.
+ */
+static uint32_t polygon_row(const dsv4l2_redact_region_t *reg, int64_t ly,
+                            int64_t *xa, int64_t *xb)
+{
+    double xs[DSV4L2_REDACT_MAX_VERTICES];
+    double yc = (double)ly + 0.5;
+    double top = (double)ly, bottom = (double)ly + 1.0;
+    uint32_t i, j, k, n = 0, spans;
+
+    for (i = 0; i < reg->vertices; i++) {
+        double x0 = reg->vertex[i].x, y0 = reg->vertex[i].y;
+        double x1, y1;
+
+        j = (i + 1) % reg->vertices;
+        x1 = reg->vertex[j].x;
+        y1 = reg->vertex[j].y;
+
+        if ((y0 <= yc) != (y1 <= yc)) {
+            double x = x0 + (yc - y0) * (x1 - x0) / (y1 - y0);
+
+            for (k = n; k > 0 && xs[k - 1] > x; k--) {
+                xs[k] = xs[k - 1];
+            }
+            xs[k] = x;
+            n++;
+        }
+    }
+
+    for (i = 0; i + 1 < n; i += 2) {
+        xa[i / 2] = floor_i64(xs[i]);
+        xb[i / 2] = ceil_i64(xs[i + 1]);
+    }
+    spans = n / 2;
+
+    for (i = 0; i < reg->vertices; i++) {
+        double x0 = reg->vertex[i].x, y0 = reg->vertex[i].y;
+        double x1, y1, lo, hi, ya, yb;
+
+        j = (i + 1) % reg->vertices;
+        x1 = reg->vertex[j].x;
+        y1 = reg->vertex[j].y;
+
+        if ((y0 <= top && y1 <= top) || (y0 >= bottom && y1 >= bottom)) {
+            continue;  /* Misses the row (or only touches its border) */
+        }
+
+        if (y0 == y1) {
+            lo = x0;
+            hi = x1;
+        } else {
+            /* Clip to the row: crossings at its borders, or the vertex inside it */
+            ya = y0 < y1 ? y0 : y1;
+            yb = y0 < y1 ? y1 : y0;
+            ya = ya < top ? top : ya;
+            yb = yb > bottom ? bottom : yb;
+            lo = x0 + (ya - y0) * (x1 - x0) / (y1 - y0);
+            hi = x0 + (yb - y0) * (x1 - x0) / (y1 - y0);
+        }
+        if (lo > hi) {
+            double t = lo;
+            lo = hi;
+            hi = t;
+        }
+
+        xa[spans] = floor_i64(lo);
+        xb[spans] = ceil_i64(hi);
+        if (xa[spans] < xb[spans]) {
+            spans++;  /* An edge along a pixel border covers nothing */
+        }
+    }
+
+    return spans;
+}
+
+/* Merge sorted, overlapping spans in place; returns the new count */
+static uint32_t merge_spans(span_t *s, uint32_t n)
+{
+    uint32_t i, k;
+
+    for (i = 0, k = 0; i < n; i++) {
+        if (k > 0 && s[i].x0 <= s[k - 1].x1) {
+            if (s[i].x1 > s[k - 1].x1) {
+                s[k - 1].x1 = s[i].x1;
+            }
+        } else {
+            s[k++] = s[i];
+        }
+    }
+
+    return k;
+}
+
+/* Spans of the region on one plane row, merged and sorted */
+static uint32_t row_spans(const dsv4l2_redact_region_t *reg, const dsv4l2_image_format_t *f,
+                          const plane_t *p, const span_t *cols, uint32_t row, span_t *out)
+{
+    int64_t xa[POLY_ROW_SPANS], xb[POLY_ROW_SPANS];
+    int64_t m = p->xs > 1 || p->ys > 1;
+    int64_t ly, ly_end;
+    span_t s;
+    uint32_t n = 0, i, k, c;
+
+    if (reg->vertices == 0) {
+        out[0] = *cols;
+        return 1;
+    }
+
+    /* Every frame row this plane row covers, plus the margin */
+    ly = (int64_t)row * p->ys - m;
+    ly_end = (int64_t)(row + 1) * p->ys + m;
+    if (ly < 0) ly = 0;
+    if (ly_end > f->height) ly_end = f->height;
+
+    for (; ly < ly_end; ly++) {
+        c = polygon_row(reg, ly, xa, xb);
+        for (i = 0; i < c; i++) {
+            to_plane_x(p, xa[i] < 0 ? 0 : xa[i], xb[i] > f->width ? f->width : xb[i], &s);
+            if (s.x0 >= s.x1) {
+                continue;
+            }
+            if (n == MAX_SPANS) {
+                n = merge_spans(out, n);
+            }
+            if (n == MAX_SPANS) {
+                /* Still full: cover the whole extent rather than drop a span */
+                out[0].x0 = s.x0 < out[0].x0 ? s.x0 : out[0].x0;
+                out[0].x1 = s.x1 > out[n - 1].x1 ? s.x1 : out[n - 1].x1;
+                n = 1;
+                continue;
+            }
+            for (k = n; k > 0 && out[k - 1].x0 > s.x0; k--) {
+                out[k] = out[k - 1];
+            }
+            out[k] = s;
+            n++;
+        }
+    }
+
+    return merge_spans(out, n);
+}
+
+/* ========================================================================
+ * Modes
+ * ======================================================================== */
+
+/*
+ * Row spans of plane row `row` clipped to the columns [x0, x1) of a
+ * tile; returns the number left
+ */
+static uint32_t tile_spans(const redact_job_t *job, uint32_t row, uint32_t x0, uint32_t x1,
+                           span_t *spans)
+{
+    uint32_t n, i, k = 0;
+
+    n = row_spans(job->reg, &job->r->format, job->p, &job->cols, row, spans);
+    for (i = 0; i < n; i++) {
+        uint32_t a = spans[i].x0 > x0 ? spans[i].x0 : x0;
+        uint32_t b = spans[i].x1 < x1 ? spans[i].x1 : x1;
+
+        if (a < b) {
+            spans[k].x0 = a;
+            spans[k].x1 = b;
+            k++;
+        }
+    }
+
+    return k;
+}
+
+static void fill_tile(void *ctx, const dsv4l2_tile_t *tile)
+{
+    const redact_job_t *job = ctx;
+    const plane_t *p = job->p;
+    uint32_t x0 = job->cols.x0 + tile->x, x1 = x0 + tile->width;
+    span_t spans[MAX_SPANS];
+    uint32_t row, n, i, x;
+
+    for (row = job->rows.x0 + tile->y; row < job->rows.x0 + tile->y + tile->height; row++) {
+        uint8_t *line = p->base + (size_t)row * p->stride;
+
+        n = tile_spans(job, row, x0, x1, spans);
+        for (i = 0; i < n; i++) {
+            if (p->step == 1) {
+                memset(line + spans[i].x0, p->fill, spans[i].x1 - spans[i].x0);
+                continue;
+            }
+            for (x = spans[i].x0; x < spans[i].x1; x++) {
+                line[(size_t)x * p->step] = p->fill;
+            }
+        }
+    }
+}
+
+/* Pixelate bands [begin, end); band b keeps its cells at vpass + b * ncells */
+static void pixelate_bands(void *ctx, uint32_t begin, uint32_t end)
+{
+    const redact_job_t *job = ctx;
+    const plane_t *p = job->p;
+    const span_t *cols = &job->cols;
+    uint32_t cw = job->cw, ch = job->ch;
+    span_t spans[MAX_SPANS];
+    uint32_t b, band, band_end, row, cx, cx_end, x, n, i;
+
+    for (b = begin; b < end; b++) {
+        uint8_t *cells = job->r->vpass + (size_t)b * job->ncells;
+
+        band = job->rows.x0 + b * ch;
+        band_end = band + ch < job->rows.x1 ? band + ch : job->rows.x1;
+
+        /* Average every cell of the band (over the whole cell in the bbox) */
+        for (cx = cols->x0; cx < cols->x1; cx = cx_end) {
+            uint32_t sum = 0, count;
+
+            cx_end = cx + cw < cols->x1 ? cx + cw : cols->x1;
+            for (row = band; row < band_end; row++) {
+                const uint8_t *line = p->base + (size_t)row * p->stride;
+
+                for (x = cx; x < cx_end; x++) {
+                    sum += line[(size_t)x * p->step];
+                }
+            }
+            count = (cx_end - cx) * (band_end - band);
+            cells[(cx - cols->x0) / cw] = (uint8_t)((sum + count / 2) / count);
+        }
+
+        for (row = band; row < band_end; row++) {
+            uint8_t *line = p->base + (size_t)row * p->stride;
+
+            n = row_spans(job->reg, &job->r->format, p, cols, row, spans);
+            for (i = 0; i < n; i++) {
+                for (x = spans[i].x0; x < spans[i].x1; x++) {
+                    line[(size_t)x * p->step] = cells[(x - cols->x0) / cw];
+                }
+            }
+        }
+    }
+}
+
+/* Gather with edge clamping so every window is full */
+static void blur_gather_tile(void *ctx, const dsv4l2_tile_t *tile)
+{
+    const redact_job_t *job = ctx;
+    const plane_t *p = job->p;
+    uint32_t x, y;
+
+    for (y = tile->y; y < tile->y + tile->height; y++) {
+        int64_t sy = (int64_t)job->rows.x0 - job->radius + y;
+        const uint8_t *line;
+
+        sy = sy < 0 ? 0 : sy >= p->h ? p->h - 1 : sy;
+        line = p->base + (size_t)sy * p->stride;
+        for (x = tile->x; x < tile->x + tile->width; x++) {
+            int64_t sx = (int64_t)job->cols.x0 - job->radius + x;
+
+            sx = sx < 0 ? 0 : sx >= p->w ? p->w - 1 : sx;
+            job->r->gather[(size_t)y * job->ew + x] = line[(size_t)sx * p->step];
+        }
+    }
+}
+
+/* Horizontal running sum; each tile starts its own window */
+static void blur_hpass_tile(void *ctx, const dsv4l2_tile_t *tile)
+{
+    const redact_job_t *job = ctx;
+    uint32_t x, y, x_end = tile->x + tile->width;
+
+    for (y = tile->y; y < tile->y + tile->height; y++) {
+        const uint8_t *src = job->r->gather + (size_t)y * job->ew;
+        uint8_t *dst = job->r->hpass + (size_t)y * job->bw;
+        uint32_t sum = 0;
+
+        for (x = tile->x; x < tile->x + job->win; x++) {
+            sum += src[x];
+        }
+        for (x = tile->x; x < x_end; x++) {
+            dst[x] = (uint8_t)(((sum + job->half) * job->m) >> 16);
+            if (x + 1 < x_end) {
+                sum += src[x + job->win] - src[x];
+            }
+        }
+    }
+}
+
+/* Vertical pass over columns [begin, end), all rows */
+static void blur_vpass_cols(void *ctx, uint32_t begin, uint32_t end)
+{
+    const redact_job_t *job = ctx;
+    dsv4l2_redactor_t *r = job->r;
+    uint32_t bw = job->bw, bh = job->rows.x1 - job->rows.x0;
+    uint32_t x, y;
+
+    memset(r->sums + begin, 0, (end - begin) * sizeof(*r->sums));
+    for (y = 0; y < job->win; y++) {
+        for (x = begin; x < end; x++) {
+            r->sums[x] = (uint16_t)(r->sums[x] + r->hpass[(size_t)y * bw + x]);
+        }
+    }
+    for (y = 0; y < bh; y++) {
+        r->vbox_step(r->sums + begin,
+                     y + 1 < bh ? r->hpass + (size_t)(y + job->win) * bw + begin : NULL,
+                     r->hpass + (size_t)y * bw + begin,
+                     r->vpass + (size_t)y * bw + begin, end - begin, job->half, job->m);
+    }
+}
+
+/* Write back inside the region only */
+static void blur_write_tile(void *ctx, const dsv4l2_tile_t *tile)
+{
+    const redact_job_t *job = ctx;
+    const plane_t *p = job->p;
+    uint32_t x0 = job->cols.x0 + tile->x, x1 = x0 + tile->width;
+    span_t spans[MAX_SPANS];
+    uint32_t y, n, i, x;
+
+    for (y = job->rows.x0 + tile->y; y < job->rows.x0 + tile->y + tile->height; y++) {
+        uint8_t *line = p->base + (size_t)y * p->stride;
+        const uint8_t *src = job->r->vpass + (size_t)(y - job->rows.x0) * job->bw;
+
+        n = tile_spans(job, y, x0, x1, spans);
+        for (i = 0; i < n; i++) {
+            for (x = spans[i].x0; x < spans[i].x1; x++) {
+                line[(size_t)x * p->step] = src[x - job->cols.x0];
+            }
+        }
+    }
+}
+
+static void blur_plane(redact_job_t *job)
+{
+    dsv4l2_pool_t *pool = dsv4l2_pool_shared();
+    uint32_t radius = (job->reg->param ? job->reg->param : 8) / job->p->xs;
+    uint32_t bh = job->rows.x1 - job->rows.x0;
+
+    if (radius == 0) {
+        radius = 1;
+    }
+
+    job->radius = radius;
+    job->win = 2 * radius + 1;
+    job->half = (uint16_t)(job->win / 2);
+    job->m = (uint16_t)(65536 / job->win);   /* Rounds down, so 255 never overflows */
+    job->bw = job->cols.x1 - job->cols.x0;
+    job->ew = job->bw + 2 * radius;
+
+    dsv4l2_parallel_tiles(pool, job->ew, bh + 2 * radius, 1, blur_gather_tile, job);
+    dsv4l2_parallel_tiles(pool, job->bw, bh + 2 * radius, 1, blur_hpass_tile, job);
+    dsv4l2_parallel_for(pool, job->bw, VBOX_GRAIN, blur_vpass_cols, job);
+    dsv4l2_parallel_tiles(pool, job->bw, bh, job->p->step, blur_write_tile, job);
+}
+
+static void redact_region(dsv4l2_redactor_t *r, uint8_t *data,
+                          const dsv4l2_redact_region_t *reg)
+{
+    dsv4l2_pool_t *pool = dsv4l2_pool_shared();
+    plane_t planes[3];
+    redact_job_t job;
+    uint32_t cell, bw, bh, n, i;
+
+    n = frame_planes(r, data, reg->color, planes);
+    for (i = 0; i < n; i++) {
+        memset(&job, 0, sizeof(job));
+        job.r = r;
+        job.reg = reg;
+        job.p = &planes[i];
+        if (!plane_bbox(reg, &r->format, &planes[i], &job.cols, &job.rows)) {
+            continue;
+        }
+        bw = job.cols.x1 - job.cols.x0;
+        bh = job.rows.x1 - job.rows.x0;
+
+        switch (reg->mode) {
+            case DSV4L2_REDACT_PIXELATE:
+                cell = reg->param ? reg->param : 16;
+                job.cw = cell / planes[i].xs ? cell / planes[i].xs : 1;
+                job.ch = cell / planes[i].ys ? cell / planes[i].ys : 1;
+                job.ncells = (bw - 1) / job.cw + 1;
+                dsv4l2_parallel_for(pool, (bh - 1) / job.ch + 1, 1, pixelate_bands, &job);
+                break;
+            case DSV4L2_REDACT_BLUR:
+                blur_plane(&job);
+                break;
+            default:
+                dsv4l2_parallel_tiles(pool, bw, bh, planes[i].step, fill_tile, &job);
+                break;
+        }
+    }
+}
+
+/* ========================================================================
+ * Redactor
+ * ======================================================================== */
+
+/**
+ * Create a redactor
+ *
+ * @param cfg Configuration
+ * @param out Redactor
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_redact_create(const dsv4l2_redact_config_t *cfg, dsv4l2_redactor_t **out)
+{
+    dsv4l2_redactor_t *r;
+    size_t ew, eh;
+    int rc;
+
+    if (!cfg || !out || dsv4l2_image_size(&cfg->format) == 0) {
+        return -EINVAL;
+    }
+
+    r = calloc(1, sizeof(*r));
+    if (!r) {
+        return -ENOMEM;
+    }
+
+    pthread_mutex_init(&r->lock, NULL);
+    r->format = cfg->format;
+    r->frame_size = dsv4l2_image_size(&cfg->format);
+    r->stride = dsv4l2_image_stride(&cfg->format);
+
+    /* Largest blur: the whole frame plus the margin on each side */
+    ew = (size_t)cfg->format.width + 2 * MAX_BLUR_RADIUS;
+    eh = (size_t)cfg->format.height + 2 * MAX_BLUR_RADIUS;
+    r->gather = malloc(ew * eh);
+    r->hpass = malloc(ew * eh);
+    /* Blur output, or the cells of every pixelate band */
+    r->vpass = malloc((size_t)cfg->format.width * cfg->format.height);
+    r->sums = malloc(ew * sizeof(*r->sums));
+    if (!r->gather || !r->hpass || !r->vpass || !r->sums) {
+        dsv4l2_redact_destroy(r);
+        return -ENOMEM;
+    }
+
+    r->vbox_step = vbox_step_scalar;
+#if DSV4L2_HAVE_X86_SIMD
+    switch (dsv4l2_simd_level()) {
+        case DSV4L2_SIMD_AVX2: r->vbox_step = vbox_step_avx2; break;
+        case DSV4L2_SIMD_SSE2: r->vbox_step = vbox_step_sse2; break;
+        default:               break;
+    }
+#endif
+
+    rc = dsv4l2_redact_set_regions(r, cfg->regions, cfg->count);
+    if (rc < 0) {
+        dsv4l2_redact_destroy(r);
+        return rc;
+    }
+
+    *out = r;
+    return 0;
+}
+
+/**
+ * Replace the standing regions
+ *
+ * @param r Redactor
+ * @param regions Regions (copied)
+ * @param count Number of regions
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_redact_set_regions(dsv4l2_redactor_t *r, const dsv4l2_redact_region_t *regions,
+                              uint32_t count)
+{
+    uint32_t i;
+
+    if (!r || (count && !regions) || count > DSV4L2_REDACT_MAX_REGIONS) {
+        return -EINVAL;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (!region_valid(&regions[i])) {
+            return -EINVAL;
+        }
+    }
+
+    pthread_mutex_lock(&r->lock);
+    if (count) {
+        memcpy(r->regions, regions, count * sizeof(*regions));
+    }
+    r->count = count;
+    pthread_mutex_unlock(&r->lock);
+
+    return 0;
+}
+
+/**
+ * Redact standing regions plus extra in place
+ *
+ * @param r Redactor
+ * @param data Frame
+ * @param len Frame bytes
+ * @param extra Additional regions for this frame (optional)
+ * @param n_extra Number of additional regions
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_redact_apply(dsv4l2_redactor_t *r, uint8_t *data, size_t len,
+                        const dsv4l2_redact_region_t *extra, uint32_t n_extra)
+{
+    uint32_t i;
+
+    if (!r || !data || (n_extra && !extra)) {
+        return -EINVAL;
+    }
+
+    if (len < r->frame_size) {
+        return -EMSGSIZE;
+    }
+
+    /* Validate everything first: never redact half a frame */
+    for (i = 0; i < n_extra; i++) {
+        if (!region_valid(&extra[i])) {
+            return -EINVAL;
+        }
+    }
+
+    DSV4L2_TRACE_BEGIN("redact");
+    pthread_mutex_lock(&r->lock);
+
+    for (i = 0; i < r->count; i++) {
+        redact_region(r, data, &r->regions[i]);
+    }
+    for (i = 0; i < n_extra; i++) {
+        redact_region(r, data, &extra[i]);
+    }
+
+    pthread_mutex_unlock(&r->lock);
+    DSV4L2_TRACE_END("redact");
+
+    return 0;
+}
+
+/**
+ * Pipeline stage
+ *
+ * @param lease Frame
+ * @param ctx Redactor
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_redact_stage(dsv4l2_lease_t *lease, void *ctx)
+{
+    const dsv4l2_redact_list_t *list;
+    int rc;
+
+    if (!lease || !ctx) {
+        return -EINVAL;
+    }
+
+    list = dsv4l2_lease_get(lease, DSV4L2_SLOT_REDACT);
+    if (list && list->count > DSV4L2_REDACT_MAX_REGIONS) {
+        return -EINVAL;
+    }
+
+    rc = dsv4l2_redact_apply(ctx, lease->data, lease->len,
+                             list ? list->region : NULL, list ? list->count : 0);
+    if (rc == 0) {
+        lease->tags |= DSV4L2_TAG_REDACTED;
+    }
+
+    return rc;
+}
+
+/**
+ * Sink guard stage
+ *
+ * @param lease Frame
+ * @param ctx Unused
+ * @return 0 if the frame was redacted, -EACCES otherwise
+ */
+int dsv4l2_redact_require_stage(dsv4l2_lease_t *lease, void *ctx)
+{
+    (void)ctx;
+
+    if (!lease) {
+        return -EINVAL;
+    }
+
+    return (lease->tags & DSV4L2_TAG_REDACTED) ? 0 : -EACCES;
+}
+
+/**
+ * Free a redactor
+ *
+ * @param r Redactor
+ */
+void dsv4l2_redact_destroy(dsv4l2_redactor_t *r)
+{
+    if (!r) {
+        return;
+    }
+
+    pthread_mutex_destroy(&r->lock);
+    free(r->gather);
+    free(r->hpass);
+    free(r->vpass);
+    free(r->sums);
+    free(r);
+}
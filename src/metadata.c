@@ -399,6 +399,12 @@ int dsv4l2_decode_ir_radiometric(const uint16_t *raw_data,
         return -EINVAL;
     }
 
+    /* Reject empty frames and sizes whose pixel count would wrap */
+    if (width == 0 || height == 0 || height > UINT32_MAX / width ||
+        (size_t)width * height > SIZE_MAX / sizeof(uint16_t)) {
+        return -EINVAL;
+    }
+
     num_pixels = width * height;
 
     /* Allocate temperature map */
@@ -419,8 +425,8 @@ int dsv4l2_decode_ir_radiometric(const uint16_t *raw_data,
         /* Simple linear calibration: T = c1 * raw + c2 */
         temp_kelvin = c1 * raw_val + c2;
 
-        /* Clamp to reasonable range (0-500K) */
-        if (temp_kelvin < 0.0f) temp_kelvin = 0.0f;
+        /* Clamp to reasonable range (0-500K); NaN clamps to 0 */
+        if (!(temp_kelvin >= 0.0f)) temp_kelvin = 0.0f;
         if (temp_kelvin > 500.0f) temp_kelvin = 500.0f;
 
         out->temp_map[i] = (uint16_t)(temp_kelvin * 100.0f);
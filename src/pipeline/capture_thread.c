@@ -0,0 +1,404 @@
+/*
+ * DSV4L2 Managed Capture Thread
+ *
+ * One thread per device does nothing but poll, DQBUF (through
+ * dsv4l2_lease_acquire, so the TEMPEST/policy check still runs per
+ * frame) and push the lease into a single-producer/single-consumer ring.
+ * The application takes leases off the other end.
+ *
+ * The ring is lock-free. An eventfd wakes the consumer: the producer
+ * only signals when it pushes into an empty ring, and the head/tail
+ * stores and the cross-loads are sequentially consistent so either the
+ * producer sees the ring empty (and signals) or the consumer sees the
+ * new tail - no lost wakeups.
+ */
+
+#define _GNU_SOURCE  /* pthread_setaffinity_np, pthread_setname_np, CPU_* */
+
+#include "dsv4l2_pipeline.h"
+#include "dsv4l2rt.h"
+#include "../dsv4l2_internal.h"
+
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define DEFAULT_DEPTH   8
+#define ERROR_BACKOFF_MS 100
+
+#define METRIC_ADD(field, n) __atomic_fetch_add(&(field), (n), __ATOMIC_RELAXED)
+#define METRIC_LOAD(field)   __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+struct dsv4l2_capture_thread {
+    /* Consumer side */
+    uint32_t head __attribute__((aligned(64)));
+
+    /* Producer side */
+    uint32_t tail __attribute__((aligned(64)));
+
+    dsv4l2_lease_t **slots __attribute__((aligned(64)));
+    uint32_t mask;
+
+    dsv4l2_device_t *dev;
+    pthread_t thread;
+    int ready_fd;                /* eventfd: frames waiting */
+    int stop_fd;                 /* eventfd: stop requested */
+    int stop;
+    int waiters;                 /* Consumers inside _next() */
+    int cpu;                     /* Requested */
+    int priority;
+
+    dsv4l2_capture_stats_t stats;
+};
+
+/* ========================================================================
+ * SPSC ring
+ * ======================================================================== */
+
+/**
+ * Producer: push a lease
+ *
+ * @return 0, or -ENOBUFS if the ring is full
+ */
+static int ring_push(dsv4l2_capture_thread_t *ct, dsv4l2_lease_t *lease)
+{
+    uint32_t tail = __atomic_load_n(&ct->tail, __ATOMIC_RELAXED);
+    uint64_t one = 1;
+
+    if (tail - __atomic_load_n(&ct->head, __ATOMIC_ACQUIRE) > ct->mask) {
+        return -ENOBUFS;
+    }
+
+    ct->slots[tail & ct->mask] = lease;
+    __atomic_store_n(&ct->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+    /* Ring was empty before this push: the consumer may be asleep */
+    if (__atomic_load_n(&ct->head, __ATOMIC_SEQ_CST) == tail) {
+        if (write(ct->ready_fd, &one, sizeof(one)) < 0) {
+            /* Counter saturated: already readable */
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Consumer: pop a lease (NULL if empty)
+ */
+static dsv4l2_lease_t *ring_pop(dsv4l2_capture_thread_t *ct)
+{
+    uint32_t head = __atomic_load_n(&ct->head, __ATOMIC_RELAXED);
+    dsv4l2_lease_t *lease;
+
+    if (__atomic_load_n(&ct->tail, __ATOMIC_SEQ_CST) == head) {
+        return NULL;
+    }
+
+    lease = ct->slots[head & ct->mask];
+    __atomic_store_n(&ct->head, head + 1, __ATOMIC_SEQ_CST);
+    return lease;
+}
+
+/* ========================================================================
+ * Capture thread
+ * ======================================================================== */
+
+/**
+ * Apply CPU affinity and SCHED_FIFO priority to the calling thread
+ */
+static void apply_scheduling(dsv4l2_capture_thread_t *ct)
+{
+    struct sched_param param;
+    int cpu = -1, priority = 0;
+
+    if (ct->cpu >= 0 && ct->cpu < CPU_SETSIZE) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(ct->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+            cpu = ct->cpu;
+        }
+    }
+
+    if (ct->priority > 0) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = ct->priority;
+        if (param.sched_priority > sched_get_priority_max(SCHED_FIFO)) {
+            param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+        }
+        /* Needs CAP_SYS_NICE (or RLIMIT_RTPRIO); fall back to normal */
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0) {
+            priority = param.sched_priority;
+        }
+    }
+
+    __atomic_store_n(&ct->stats.cpu, cpu, __ATOMIC_RELAXED);
+    __atomic_store_n(&ct->stats.priority, priority, __ATOMIC_RELAXED);
+}
+
+/**
+ * Sleep until the stop eventfd is readable or timeout_ms passes
+ */
+static void backoff(dsv4l2_capture_thread_t *ct, int timeout_ms)
+{
+    struct pollfd pfd = { .fd = ct->stop_fd, .events = POLLIN };
+
+    poll(&pfd, 1, timeout_ms);
+}
+
+static void *capture_main(void *arg)
+{
+    dsv4l2_capture_thread_t *ct = arg;
+    dsv4l2_lease_t *lease;
+    int rc;
+
+    pthread_setname_np(pthread_self(), "dsv4l2-capture");
+    apply_scheduling(ct);
+
+    while (!__atomic_load_n(&ct->stop, __ATOMIC_ACQUIRE)) {
+        rc = dsv4l2_lease_acquire(ct->dev, &lease);
+        if (rc == 0) {
+            if (ring_push(ct, lease) == 0) {
+                METRIC_ADD(ct->stats.frames, 1);
+            } else {
+                /* Consumer is behind: give the buffer straight back */
+                dsv4l2_lease_release(lease);
+                METRIC_ADD(ct->stats.dropped, 1);
+            }
+        } else if (rc == -EAGAIN) {
+            /* Runs the stall watchdog if the device has one; recovery
+             * locks out the consumer's concurrent lease releases */
+            if (dsv4l2_wait_frame(ct->dev, -1, ct->stop_fd) == -EIO) {
+                METRIC_ADD(ct->stats.errors, 1);
+                backoff(ct, ERROR_BACKOFF_MS);
+            }
+        } else {
+            /* Policy denial, device error: don't spin on it */
+            METRIC_ADD(ct->stats.errors, 1);
+            backoff(ct, ERROR_BACKOFF_MS);
+        }
+    }
+
+    return NULL;
+}
+
+/* ========================================================================
+ * Public API
+ * ======================================================================== */
+
+/**
+ * Start a capture thread for a device
+ *
+ * @param dev Device (buffers requested and mapped)
+ * @param cfg Configuration (NULL = defaults and profile scheduling)
+ * @param out Output capture thread
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_capture_thread_start(dsv4l2_device_t *dev, const dsv4l2_capture_config_t *cfg,
+                                dsv4l2_capture_thread_t **out)
+{
+    dsv4l2_device_internal_t *internal;
+    dsv4l2_capture_thread_t *ct;
+    uint32_t depth;
+    int rc;
+
+    if (!dev || !out) {
+        return -EINVAL;
+    }
+
+    internal = dsv4l2_get_internal(dev);
+
+    depth = cfg && cfg->depth ? cfg->depth : DEFAULT_DEPTH;
+    if (depth > 1024) {
+        return -EINVAL;
+    }
+    depth = depth < 2 ? 2 : 1u << (32 - __builtin_clz(depth - 1));
+
+    ct = calloc(1, sizeof(*ct));
+    if (!ct) {
+        return -ENOMEM;
+    }
+
+    ct->slots = calloc(depth, sizeof(*ct->slots));
+    if (!ct->slots) {
+        free(ct);
+        return -ENOMEM;
+    }
+    ct->mask = depth - 1;
+    ct->dev = dev;
+    ct->cpu = !cfg || cfg->cpu == DSV4L2_CAPTURE_FROM_PROFILE ? internal->capture_cpu : cfg->cpu;
+    ct->priority = !cfg || cfg->priority == DSV4L2_CAPTURE_FROM_PROFILE ?
+                   internal->capture_priority : cfg->priority;
+    ct->stats.cpu = -1;
+
+    ct->ready_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    ct->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (ct->ready_fd < 0 || ct->stop_fd < 0) {
+        rc = -errno;
+        goto fail;
+    }
+
+    rc = pthread_create(&ct->thread, NULL, capture_main, ct);
+    if (rc != 0) {
+        rc = -rc;
+        goto fail;
+    }
+
+    *out = ct;
+    return 0;
+
+fail:
+    if (ct->ready_fd >= 0) {
+        close(ct->ready_fd);
+    }
+    if (ct->stop_fd >= 0) {
+        close(ct->stop_fd);
+    }
+    free(ct->slots);
+    free(ct);
+    return rc;
+}
+
+/**
+ * Take the next frame (single consumer)
+ *
+ * @param ct Capture thread
+ * @param out Output lease (release with dsv4l2_lease_release)
+ * @param timeout_ms 0 = do not wait, -1 = wait forever
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_capture_thread_next(dsv4l2_capture_thread_t *ct, dsv4l2_lease_t **out,
+                               int timeout_ms)
+{
+    uint64_t deadline = 0, now, counter;
+    struct pollfd pfds[2];
+    int wait_ms, rc;
+
+    if (!ct || !out) {
+        return -EINVAL;
+    }
+
+    if (timeout_ms > 0) {
+        deadline = dsv4l2_now_ns() + (uint64_t)timeout_ms * 1000000ULL;
+    }
+
+    /* dsv4l2_capture_thread_stop() waits for this to drop back to zero */
+    __atomic_fetch_add(&ct->waiters, 1, __ATOMIC_ACQ_REL);
+
+    for (;;) {
+        *out = ring_pop(ct);
+        if (*out) {
+            rc = 0;
+            break;
+        }
+        if (__atomic_load_n(&ct->stop, __ATOMIC_ACQUIRE)) {
+            rc = -EPIPE;
+            break;
+        }
+        if (timeout_ms == 0) {
+            rc = -EAGAIN;
+            break;
+        }
+
+        wait_ms = -1;
+        if (timeout_ms > 0) {
+            now = dsv4l2_now_ns();
+            if (now >= deadline) {
+                rc = -ETIMEDOUT;
+                break;
+            }
+            wait_ms = (int)((deadline - now + 999999) / 1000000);
+        }
+
+        pfds[0].fd = ct->ready_fd;
+        pfds[0].events = POLLIN;
+        pfds[1].fd = ct->stop_fd;
+        pfds[1].events = POLLIN;
+        if (poll(pfds, 2, wait_ms) > 0 && (pfds[0].revents & POLLIN)) {
+            if (read(ct->ready_fd, &counter, sizeof(counter)) < 0) {
+                /* Raced with another reset: nothing to do */
+            }
+        }
+    }
+
+    __atomic_fetch_sub(&ct->waiters, 1, __ATOMIC_RELEASE);
+    return rc;
+}
+
+/**
+ * File descriptor that polls readable while frames are waiting
+ *
+ * @param ct Capture thread
+ * @return eventfd, or -EINVAL
+ */
+int dsv4l2_capture_thread_fd(const dsv4l2_capture_thread_t *ct)
+{
+    return ct ? ct->ready_fd : -EINVAL;
+}
+
+/**
+ * Snapshot capture thread metrics
+ *
+ * @param ct Capture thread
+ * @param stats Output metrics
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_capture_thread_get_stats(dsv4l2_capture_thread_t *ct,
+                                    dsv4l2_capture_stats_t *stats)
+{
+    if (!ct || !stats) {
+        return -EINVAL;
+    }
+
+    stats->frames = METRIC_LOAD(ct->stats.frames);
+    stats->dropped = METRIC_LOAD(ct->stats.dropped);
+    stats->errors = METRIC_LOAD(ct->stats.errors);
+    stats->cpu = METRIC_LOAD(ct->stats.cpu);
+    stats->priority = METRIC_LOAD(ct->stats.priority);
+
+    return 0;
+}
+
+/**
+ * Stop the thread, release queued frames and free it
+ *
+ * A consumer blocked in dsv4l2_capture_thread_next() on another thread
+ * returns -EPIPE; ct is not freed until it has left.
+ *
+ * @param ct Capture thread
+ */
+void dsv4l2_capture_thread_stop(dsv4l2_capture_thread_t *ct)
+{
+    dsv4l2_lease_t *lease;
+    uint64_t one = 1;
+
+    if (!ct) {
+        return;
+    }
+
+    __atomic_store_n(&ct->stop, 1, __ATOMIC_RELEASE);
+    if (write(ct->stop_fd, &one, sizeof(one)) < 0) {
+        /* Counter saturated: already readable */
+    }
+    pthread_join(ct->thread, NULL);
+
+    /* stop_fd stays readable, so a blocked consumer is already on its way out */
+    while (__atomic_load_n(&ct->waiters, __ATOMIC_ACQUIRE) != 0) {
+        sched_yield();
+    }
+
+    while ((lease = ring_pop(ct)) != NULL) {
+        dsv4l2_lease_release(lease);
+    }
+
+    close(ct->ready_fd);
+    close(ct->stop_fd);
+    free(ct->slots);
+    free(ct);
+}
@@ -0,0 +1,271 @@
+/*
+ * DSV4L2 Frame Leases
+ *
+ * A lease holds one dequeued V4L2 buffer until it is released, so a
+ * frame can be processed off the capture thread without the driver
+ * overwriting it. Device leases live in a per-device table indexed by
+ * buffer index (an index can only be dequeued once at a time), so
+ * acquiring a lease never allocates.
+ */
+
+#include "dsv4l2_annotations.h"
+#include "dsv4l2_policy.h"
+#include "dsv4l2_core.h"
+#include "dsv4l2_pipeline.h"
+#include "dsv4l2rt.h"
+#include "../dsv4l2_internal.h"
+
+#include <linux/videodev2.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+/**
+ * Release hook for device leases: requeue the buffer
+ */
+static void lease_requeue(dsv4l2_lease_t *lease)
+{
+    dsv4l2_queue_buffer(lease->dev, lease->index);
+}
+
+/**
+ * Release hook for wrapped memory
+ */
+static void lease_free_wrapped(dsv4l2_lease_t *lease)
+{
+    void (*free_fn)(void *) = (void (*)(void *))lease->release_ctx;
+
+    if (free_fn) {
+        free_fn(lease->data);
+    }
+    free(lease);
+}
+
+/**
+ * Get (or lazily create) the device's lease table
+ */
+static dsv4l2_lease_t *lease_table(dsv4l2_device_internal_t *internal)
+{
+    dsv4l2_lease_t *table = __atomic_load_n(&internal->leases, __ATOMIC_ACQUIRE);
+    dsv4l2_lease_t *expected = NULL;
+
+    if (table) {
+        return table;
+    }
+
+    table = calloc(DSV4L2_MAX_BUFFERS, sizeof(dsv4l2_lease_t));
+    if (!table) {
+        return NULL;
+    }
+
+    if (!__atomic_compare_exchange_n(&internal->leases, &expected, table, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(table);
+        table = expected;  /* Another thread won */
+    }
+
+    return table;
+}
+
+/**
+ * Acquire a lease on the next filled buffer
+ *
+ * Same enforcement as dsv4l2_capture_frame(): TEMPEST query and policy
+ * check before the buffer is touched.
+ *
+ * @param dev Device handle
+ * @param out Output lease
+ * @return 0 on success, negative errno on error
+ */
+DSV4L2_SENSOR("camera", "L3", "UNCLASSIFIED")
+DSMIL_REQUIRES_TEMPEST_CHECK
+int dsv4l2_lease_acquire(dsv4l2_device_t *dev, dsv4l2_lease_t **out)
+{
+    dsv4l2_device_internal_t *internal;
+    dsv4l2_lease_t *table, *lease;
+    struct v4l2_buffer buf;
+    void *start;
+    size_t length;
+    int rc;
+
+    if (!dev || !out) {
+        return -EINVAL;
+    }
+
+    internal = dsv4l2_get_internal(dev);
+
+    /* CRITICAL: TEMPEST state check (REQUIRED by DSLLVM) */
+    DSV4L2_TRACE_BEGIN("policy_check");
+    dsv4l2_tempest_state_t state = dsv4l2_get_tempest_state(dev);
+    rc = dsv4l2_policy_check(state, "lease_acquire");
+    DSV4L2_TRACE_END("policy_check");
+    if (rc != 0) {
+        dsv4l2rt_emit_simple(internal->dev_id, DSV4L2_EVENT_POLICY_VIOLATION,
+                             DSV4L2_SEV_CRITICAL, state);
+        return -EPERM;
+    }
+
+    table = lease_table(internal);
+    if (!table) {
+        return -ENOMEM;
+    }
+
+    if (!internal->streaming) {
+        rc = dsv4l2_start_streaming(dev);
+        if (rc < 0) {
+            return rc;
+        }
+    }
+
+    DSV4L2_TRACE_BEGIN("dqbuf");
+    rc = dsv4l2_dequeue_buffer(dev, &buf);
+    DSV4L2_TRACE_END("dqbuf");
+    if (rc < 0) {
+        if (rc != -EAGAIN) {
+            dsv4l2rt_emit_simple(internal->dev_id, DSV4L2_EVENT_FRAME_DROPPED,
+                                 DSV4L2_SEV_MEDIUM, -rc);
+        }
+        return rc;
+    }
+
+    if (buf.index >= DSV4L2_MAX_BUFFERS) {
+        dsv4l2_queue_buffer(dev, buf.index);
+        return -ENOBUFS;
+    }
+
+    rc = dsv4l2_get_buffer(dev, buf.index, &start, &length);
+    if (rc < 0) {
+        dsv4l2_queue_buffer(dev, buf.index);
+        return rc;
+    }
+
+    lease = &table[buf.index];
+    memset(lease, 0, sizeof(*lease));
+    lease->dev = dev;
+    lease->index = buf.index;
+    lease->data = (uint8_t *)start;
+    lease->len = buf.bytesused;
+    lease->sequence = buf.sequence;
+    lease->timestamp_ns = (uint64_t)buf.timestamp.tv_sec * 1000000000ULL +
+                          (uint64_t)buf.timestamp.tv_usec * 1000ULL;
+    lease->dequeue_ns = internal->buffers[buf.index].dqbuf_ns;
+    lease->flags = buf.flags;
+    lease->release_fn = lease_requeue;
+    lease->active = 1;
+
+    dsv4l2rt_emit_simple(internal->dev_id, DSV4L2_EVENT_FRAME_ACQUIRED,
+                         DSV4L2_SEV_INFO, buf.bytesused);
+
+    *out = lease;
+    return 0;
+}
+
+/**
+ * Wrap caller-owned memory in a lease
+ *
+ * @param data Frame data
+ * @param len Frame length
+ * @param free_fn Called with data on release (optional)
+ * @param out Output lease
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_lease_wrap(uint8_t *data, size_t len, void (*free_fn)(void *),
+                      dsv4l2_lease_t **out)
+{
+    dsv4l2_lease_t *lease;
+
+    if ((!data && len > 0) || !out) {
+        return -EINVAL;
+    }
+
+    lease = calloc(1, sizeof(*lease));
+    if (!lease) {
+        return -ENOMEM;
+    }
+
+    lease->data = data;
+    lease->len = len;
+    lease->timestamp_ns = dsv4l2_now_ns();
+    lease->dequeue_ns = lease->timestamp_ns;
+    lease->release_fn = lease_free_wrapped;
+    lease->release_ctx = (void *)free_fn;
+    lease->active = 1;
+
+    *out = lease;
+    return 0;
+}
+
+/**
+ * Attach a stage output to a lease
+ *
+ * Replaces (and frees) any previous attachment in the slot.
+ *
+ * @param lease Lease
+ * @param slot Attachment slot
+ * @param ptr Attachment
+ * @param free_fn Called with ptr on release or replacement (optional)
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_lease_attach(dsv4l2_lease_t *lease, dsv4l2_lease_slot_t slot,
+                        void *ptr, void (*free_fn)(void *))
+{
+    if (!lease || (unsigned int)slot >= DSV4L2_SLOT_COUNT) {
+        return -EINVAL;
+    }
+
+    if (lease->slots[slot].ptr && lease->slots[slot].free_fn &&
+        lease->slots[slot].ptr != ptr) {
+        lease->slots[slot].free_fn(lease->slots[slot].ptr);
+    }
+
+    lease->slots[slot].ptr = ptr;
+    lease->slots[slot].free_fn = free_fn;
+
+    return 0;
+}
+
+/**
+ * Get an attachment
+ *
+ * @param lease Lease
+ * @param slot Attachment slot
+ * @return Attachment, or NULL if empty
+ */
+void *dsv4l2_lease_get(const dsv4l2_lease_t *lease, dsv4l2_lease_slot_t slot)
+{
+    if (!lease || (unsigned int)slot >= DSV4L2_SLOT_COUNT) {
+        return NULL;
+    }
+
+    return lease->slots[slot].ptr;
+}
+
+/**
+ * Release a lease
+ *
+ * Frees attachments, then hands the buffer back (requeue for device
+ * leases, free_fn for wrapped memory). Releasing a device lease twice
+ * is a no-op; a wrapped lease is freed by its first release.
+ *
+ * @param lease Lease
+ */
+void dsv4l2_lease_release(dsv4l2_lease_t *lease)
+{
+    int i;
+
+    if (!lease || !__atomic_exchange_n(&lease->active, 0, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    for (i = 0; i < DSV4L2_SLOT_COUNT; i++) {
+        if (lease->slots[i].ptr && lease->slots[i].free_fn) {
+            lease->slots[i].free_fn(lease->slots[i].ptr);
+        }
+        lease->slots[i].ptr = NULL;
+        lease->slots[i].free_fn = NULL;
+    }
+
+    if (lease->release_fn) {
+        lease->release_fn(lease);
+    }
+}
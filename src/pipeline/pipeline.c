@@ -0,0 +1,617 @@
+/*
+ * DSV4L2 Frame Processing Pipeline
+ *
+ * Stages are connected by bounded MPMC queues (mutex + two condition
+ * variables). Each stage owns its worker threads; a lease is touched by
+ * exactly one worker at a time, so stage functions need no locking of
+ * their own.
+ *
+ * Ordered stages tag every input with a per-stage sequence number and
+ * park completed frames in a reorder window until all earlier frames
+ * have completed. Workers do not take frames that would fall outside
+ * the window, which bounds the number of parked frames.
+ *
+ * Shutdown drains front to back: stage N's queue is closed only after
+ * stage N-1's workers have exited, so every accepted frame is either
+ * delivered or released.
+ */
+
+#define _GNU_SOURCE  /* pthread_setname_np */
+
+#include "dsv4l2_pipeline.h"
+#include "dsv4l2rt.h"
+#include "../dsv4l2_internal.h"
+
+#include <pthread.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define STAGE_DEFAULT_QUEUE_DEPTH 8
+#define STAGE_MAX_PARALLELISM     64
+
+#define METRIC_ADD(field, n) __atomic_fetch_add(&(field), (n), __ATOMIC_RELAXED)
+#define METRIC_LOAD(field)   __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+/* Reorder window entry */
+typedef struct {
+    dsv4l2_lease_t *lease;
+    int             done;       /* Completed, waiting for earlier frames */
+    int             pass;       /* Stage returned 0 */
+} reorder_slot_t;
+
+typedef struct pipeline_stage {
+    dsv4l2_pipeline_t   *pipeline;
+    struct pipeline_stage *next;
+    char                 name[32];
+    const char          *trace_name;  /* Caller's (static) name for spans */
+    dsv4l2_stage_fn      fn;
+    void                *ctx;
+    unsigned int         parallelism;
+    int                  ordered;
+
+    /* Input queue */
+    pthread_mutex_t      lock;
+    pthread_cond_t       not_empty;
+    pthread_cond_t       not_full;
+    dsv4l2_lease_t     **ring;
+    uint32_t             capacity;
+    uint32_t             head;
+    uint32_t             count;
+    uint64_t             next_in_seq;
+    int                  closed;
+
+    /* Reorder window (ordered stages) */
+    pthread_mutex_t      reorder_lock;
+    reorder_slot_t      *window;
+    uint32_t             window_size;
+    uint64_t             next_out_seq;
+
+    /* Workers */
+    pthread_t           *workers;
+    unsigned int         workers_started;
+
+    /* Metrics */
+    uint64_t             frames_in;
+    uint64_t             frames_out;
+    uint64_t             skipped;
+    uint64_t             errors;
+    uint64_t             dropped;
+    uint32_t             high_water;
+    uint64_t             wait_hist[DSV4L2_STATS_HIST_BINS];
+    uint64_t             service_hist[DSV4L2_STATS_HIST_BINS];
+} pipeline_stage_t;
+
+struct dsv4l2_pipeline {
+    dsv4l2_backpressure_t backpressure;
+    pipeline_stage_t     *stages[DSV4L2_PIPELINE_MAX_STAGES];
+    size_t                stage_count;
+    int                   running;
+    int                   stopped;
+};
+
+/* ========================================================================
+ * Queues
+ * ======================================================================== */
+
+/**
+ * Put a lease on a stage's input queue
+ *
+ * Takes ownership: on failure the lease is released and counted as
+ * dropped.
+ *
+ * @return 0, -EAGAIN (full, DROP mode) or -EPIPE (stage closed)
+ */
+static int stage_enqueue(pipeline_stage_t *stage, dsv4l2_lease_t *lease)
+{
+    int block = stage->pipeline->backpressure == DSV4L2_BACKPRESSURE_BLOCK;
+    int rc = 0;
+
+    pthread_mutex_lock(&stage->lock);
+
+    while (!stage->closed && stage->count == stage->capacity && block) {
+        pthread_cond_wait(&stage->not_full, &stage->lock);
+    }
+
+    if (stage->closed) {
+        rc = -EPIPE;
+    } else if (stage->count == stage->capacity) {
+        rc = -EAGAIN;
+    } else {
+        lease->stage_seq = stage->next_in_seq++;
+        lease->enqueue_ns = dsv4l2_now_ns();
+        stage->ring[(stage->head + stage->count) % stage->capacity] = lease;
+        stage->count++;
+        if (stage->count > stage->high_water) {
+            __atomic_store_n(&stage->high_water, stage->count, __ATOMIC_RELAXED);
+        }
+        METRIC_ADD(stage->frames_in, 1);
+
+        if (stage->ordered) {
+            pthread_cond_broadcast(&stage->not_empty);
+        } else {
+            pthread_cond_signal(&stage->not_empty);
+        }
+    }
+
+    pthread_mutex_unlock(&stage->lock);
+
+    if (rc != 0) {
+        METRIC_ADD(stage->dropped, 1);
+        dsv4l2_lease_release(lease);
+    }
+
+    return rc;
+}
+
+/**
+ * Can a worker take the head of the queue? (caller holds stage->lock)
+ */
+static int stage_can_take(pipeline_stage_t *stage)
+{
+    uint64_t next_out;
+
+    if (stage->count == 0) {
+        return 0;
+    }
+    if (!stage->ordered) {
+        return 1;
+    }
+
+    /* Keep the frame inside the reorder window */
+    next_out = __atomic_load_n(&stage->next_out_seq, __ATOMIC_ACQUIRE);
+    return stage->ring[stage->head]->stage_seq - next_out < stage->window_size;
+}
+
+/**
+ * Take the next lease (blocks); NULL once closed and drained
+ */
+static dsv4l2_lease_t *stage_dequeue(pipeline_stage_t *stage)
+{
+    dsv4l2_lease_t *lease;
+
+    pthread_mutex_lock(&stage->lock);
+
+    while (!stage_can_take(stage) && !(stage->closed && stage->count == 0)) {
+        pthread_cond_wait(&stage->not_empty, &stage->lock);
+    }
+
+    if (stage->count == 0) {
+        pthread_mutex_unlock(&stage->lock);
+        return NULL;
+    }
+
+    lease = stage->ring[stage->head];
+    stage->head = (stage->head + 1) % stage->capacity;
+    stage->count--;
+    pthread_cond_signal(&stage->not_full);
+
+    pthread_mutex_unlock(&stage->lock);
+
+    return lease;
+}
+
+/* ========================================================================
+ * Workers
+ * ======================================================================== */
+
+/**
+ * Hand a processed lease on: next stage, or release after the last one
+ */
+static void stage_forward(pipeline_stage_t *stage, dsv4l2_lease_t *lease, int pass)
+{
+    if (!pass) {
+        dsv4l2_lease_release(lease);
+        return;
+    }
+
+    METRIC_ADD(stage->frames_out, 1);
+
+    if (stage->next) {
+        stage_enqueue(stage->next, lease);
+    } else {
+        dsv4l2_lease_release(lease);
+    }
+}
+
+/**
+ * Complete a lease on an ordered stage: park it, then flush every frame
+ * that is now in order
+ */
+static void stage_complete_ordered(pipeline_stage_t *stage, dsv4l2_lease_t *lease,
+                                   int pass)
+{
+    reorder_slot_t *slot;
+    int advanced = 0;
+
+    pthread_mutex_lock(&stage->reorder_lock);
+
+    slot = &stage->window[lease->stage_seq % stage->window_size];
+    slot->lease = lease;
+    slot->pass = pass;
+    slot->done = 1;
+
+    /* Forward under the lock so frames reach the next queue in order */
+    for (;;) {
+        slot = &stage->window[stage->next_out_seq % stage->window_size];
+        if (!slot->done) {
+            break;
+        }
+
+        lease = slot->lease;
+        pass = slot->pass;
+        slot->done = 0;
+        slot->lease = NULL;
+
+        stage_forward(stage, lease, pass);
+        __atomic_store_n(&stage->next_out_seq, stage->next_out_seq + 1,
+                         __ATOMIC_RELEASE);
+        advanced = 1;
+    }
+
+    pthread_mutex_unlock(&stage->reorder_lock);
+
+    /* Workers may be waiting for the window to move */
+    if (advanced) {
+        pthread_mutex_lock(&stage->lock);
+        pthread_cond_broadcast(&stage->not_empty);
+        pthread_mutex_unlock(&stage->lock);
+    }
+}
+
+/**
+ * Stage worker thread
+ */
+static void *stage_worker(void *arg)
+{
+    pipeline_stage_t *stage = arg;
+    dsv4l2_lease_t *lease;
+
+    while ((lease = stage_dequeue(stage)) != NULL) {
+        uint64_t start = dsv4l2_now_ns();
+        uint64_t end;
+        int rc;
+
+        METRIC_ADD(stage->wait_hist[dsv4l2_hist_bin(start - lease->enqueue_ns)], 1);
+
+        DSV4L2_TRACE_BEGIN(stage->trace_name);
+        rc = stage->fn(lease, stage->ctx);
+        DSV4L2_TRACE_END(stage->trace_name);
+
+        end = dsv4l2_now_ns();
+        METRIC_ADD(stage->service_hist[dsv4l2_hist_bin(end - start)], 1);
+
+        if (rc == DSV4L2_STAGE_SKIP) {
+            METRIC_ADD(stage->skipped, 1);
+        } else if (rc < 0) {
+            METRIC_ADD(stage->errors, 1);
+        }
+
+        if (stage->ordered) {
+            stage_complete_ordered(stage, lease, rc == 0);
+        } else {
+            stage_forward(stage, lease, rc == 0);
+        }
+    }
+
+    return NULL;
+}
+
+/* ========================================================================
+ * Pipeline API
+ * ======================================================================== */
+
+/**
+ * Create an empty pipeline
+ *
+ * @param backpressure Behaviour when a stage's input queue is full
+ * @param out Output pipeline
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_pipeline_create(dsv4l2_backpressure_t backpressure,
+                           dsv4l2_pipeline_t **out)
+{
+    dsv4l2_pipeline_t *p;
+
+    if (!out || backpressure > DSV4L2_BACKPRESSURE_BLOCK) {
+        return -EINVAL;
+    }
+
+    p = calloc(1, sizeof(*p));
+    if (!p) {
+        return -ENOMEM;
+    }
+
+    p->backpressure = backpressure;
+
+    *out = p;
+    return 0;
+}
+
+/**
+ * Free a stage (workers must not be running)
+ */
+static void stage_free(pipeline_stage_t *stage)
+{
+    pthread_mutex_destroy(&stage->lock);
+    pthread_mutex_destroy(&stage->reorder_lock);
+    pthread_cond_destroy(&stage->not_empty);
+    pthread_cond_destroy(&stage->not_full);
+    free(stage->ring);
+    free(stage->window);
+    free(stage->workers);
+    free(stage);
+}
+
+/**
+ * Append a stage
+ *
+ * @param p Pipeline (not yet started)
+ * @param cfg Stage configuration
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_pipeline_add_stage(dsv4l2_pipeline_t *p, const dsv4l2_stage_config_t *cfg)
+{
+    pipeline_stage_t *stage;
+
+    if (!p || !cfg || !cfg->fn || cfg->parallelism > STAGE_MAX_PARALLELISM) {
+        return -EINVAL;
+    }
+    if (p->running || p->stopped) {
+        return -EBUSY;
+    }
+    if (p->stage_count >= DSV4L2_PIPELINE_MAX_STAGES) {
+        return -ENOSPC;
+    }
+
+    stage = calloc(1, sizeof(*stage));
+    if (!stage) {
+        return -ENOMEM;
+    }
+
+    stage->pipeline = p;
+    snprintf(stage->name, sizeof(stage->name), "%s",
+             cfg->name ? cfg->name : "stage");
+    stage->trace_name = cfg->name ? cfg->name : "stage";
+    stage->fn = cfg->fn;
+    stage->ctx = cfg->ctx;
+    stage->parallelism = cfg->parallelism ? cfg->parallelism : 1;
+    stage->ordered = cfg->ordered;
+    stage->capacity = cfg->queue_depth ? cfg->queue_depth : STAGE_DEFAULT_QUEUE_DEPTH;
+
+    pthread_mutex_init(&stage->lock, NULL);
+    pthread_mutex_init(&stage->reorder_lock, NULL);
+    pthread_cond_init(&stage->not_empty, NULL);
+    pthread_cond_init(&stage->not_full, NULL);
+
+    stage->ring = calloc(stage->capacity, sizeof(dsv4l2_lease_t *));
+    stage->workers = calloc(stage->parallelism, sizeof(pthread_t));
+
+    /* Frames in flight on this stage never exceed queue + workers */
+    if (stage->ordered) {
+        stage->window_size = stage->capacity + stage->parallelism;
+        stage->window = calloc(stage->window_size, sizeof(reorder_slot_t));
+    }
+
+    if (!stage->ring || !stage->workers || (stage->ordered && !stage->window)) {
+        stage_free(stage);
+        return -ENOMEM;
+    }
+
+    if (p->stage_count > 0) {
+        p->stages[p->stage_count - 1]->next = stage;
+    }
+    p->stages[p->stage_count++] = stage;
+
+    return 0;
+}
+
+/**
+ * Close a stage's input and wait for its workers to drain it
+ */
+static void stage_drain(pipeline_stage_t *stage)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&stage->lock);
+    stage->closed = 1;
+    pthread_cond_broadcast(&stage->not_empty);
+    pthread_cond_broadcast(&stage->not_full);
+    pthread_mutex_unlock(&stage->lock);
+
+    for (i = 0; i < stage->workers_started; i++) {
+        pthread_join(stage->workers[i], NULL);
+    }
+    stage->workers_started = 0;
+}
+
+/**
+ * Start worker threads
+ *
+ * @param p Pipeline
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_pipeline_start(dsv4l2_pipeline_t *p)
+{
+    size_t s;
+    unsigned int i;
+
+    if (!p || p->stage_count == 0) {
+        return -EINVAL;
+    }
+    if (p->running || p->stopped) {
+        return -EBUSY;
+    }
+
+    for (s = 0; s < p->stage_count; s++) {
+        pipeline_stage_t *stage = p->stages[s];
+
+        for (i = 0; i < stage->parallelism; i++) {
+            char thread_name[16];
+            int rc = pthread_create(&stage->workers[i], NULL, stage_worker, stage);
+
+            if (rc != 0) {
+                p->running = 1;
+                dsv4l2_pipeline_stop(p);
+                return -rc;
+            }
+            stage->workers_started++;
+
+            snprintf(thread_name, sizeof(thread_name), "dsv4l2-%.8s", stage->name);
+            pthread_setname_np(stage->workers[i], thread_name);
+        }
+    }
+
+    p->running = 1;
+    return 0;
+}
+
+/**
+ * Submit a lease to the first stage
+ *
+ * @param p Pipeline
+ * @param lease Lease (owned by the pipeline from here on)
+ * @return 0 on success, -EAGAIN if dropped by backpressure, negative errno
+ */
+int dsv4l2_pipeline_submit(dsv4l2_pipeline_t *p, dsv4l2_lease_t *lease)
+{
+    if (!lease) {
+        return -EINVAL;
+    }
+    if (!p || p->stage_count == 0) {
+        dsv4l2_lease_release(lease);
+        return -EINVAL;
+    }
+
+    return stage_enqueue(p->stages[0], lease);
+}
+
+/**
+ * Acquire the next frame from a device and submit it
+ *
+ * @param p Pipeline
+ * @param dev Device handle
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_pipeline_capture(dsv4l2_pipeline_t *p, dsv4l2_device_t *dev)
+{
+    dsv4l2_lease_t *lease;
+    int rc;
+
+    if (!p || !dev) {
+        return -EINVAL;
+    }
+
+    rc = dsv4l2_lease_acquire(dev, &lease);
+    if (rc < 0) {
+        return rc;
+    }
+
+    return dsv4l2_pipeline_submit(p, lease);
+}
+
+/**
+ * Drain all queued frames and stop worker threads
+ *
+ * Stages are drained front to back so frames still in flight reach the
+ * end of the pipeline. Later submissions are released with -EPIPE.
+ *
+ * @param p Pipeline
+ */
+void dsv4l2_pipeline_stop(dsv4l2_pipeline_t *p)
+{
+    size_t s;
+
+    if (!p || !p->running) {
+        return;
+    }
+
+    for (s = 0; s < p->stage_count; s++) {
+        stage_drain(p->stages[s]);
+    }
+
+    p->running = 0;
+    p->stopped = 1;
+}
+
+/**
+ * Stop (if running) and free a pipeline
+ *
+ * @param p Pipeline
+ */
+void dsv4l2_pipeline_destroy(dsv4l2_pipeline_t *p)
+{
+    size_t s;
+
+    if (!p) {
+        return;
+    }
+
+    dsv4l2_pipeline_stop(p);
+
+    for (s = 0; s < p->stage_count; s++) {
+        pipeline_stage_t *stage = p->stages[s];
+
+        /* Never started: release anything submitted */
+        while (stage->count > 0) {
+            dsv4l2_lease_release(stage->ring[stage->head]);
+            stage->head = (stage->head + 1) % stage->capacity;
+            stage->count--;
+        }
+
+        stage_free(stage);
+    }
+
+    free(p);
+}
+
+/**
+ * Number of stages
+ *
+ * @param p Pipeline
+ * @return Stage count
+ */
+size_t dsv4l2_pipeline_stage_count(const dsv4l2_pipeline_t *p)
+{
+    return p ? p->stage_count : 0;
+}
+
+/**
+ * Snapshot metrics for one stage
+ *
+ * @param p Pipeline
+ * @param stage Stage index
+ * @param stats Output metrics
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_pipeline_get_stage_stats(dsv4l2_pipeline_t *p, size_t stage,
+                                    dsv4l2_stage_stats_t *stats)
+{
+    pipeline_stage_t *st;
+    int i;
+
+    if (!p || !stats || stage >= p->stage_count) {
+        return -EINVAL;
+    }
+
+    st = p->stages[stage];
+
+    memset(stats, 0, sizeof(*stats));
+    stats->name = st->name;
+    stats->frames_in = METRIC_LOAD(st->frames_in);
+    stats->frames_out = METRIC_LOAD(st->frames_out);
+    stats->skipped = METRIC_LOAD(st->skipped);
+    stats->errors = METRIC_LOAD(st->errors);
+    stats->dropped = METRIC_LOAD(st->dropped);
+    stats->queue_depth = METRIC_LOAD(st->count);
+    stats->queue_high_water = METRIC_LOAD(st->high_water);
+    stats->queue_capacity = st->capacity;
+
+    for (i = 0; i < DSV4L2_STATS_HIST_BINS; i++) {
+        stats->wait_hist[i] = METRIC_LOAD(st->wait_hist[i]);
+        stats->service_hist[i] = METRIC_LOAD(st->service_hist[i]);
+    }
+
+    return 0;
+}
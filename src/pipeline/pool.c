@@ -0,0 +1,980 @@
+/*
+ * DSV4L2 Work-Stealing Pool
+ *
+ * Each worker owns a fixed-size Chase-Lev deque of ranges. A worker
+ * executing a range larger than the job's grain splits it, pushes the
+ * right half onto its own deque and keeps going with the left half;
+ * idle workers steal the oldest (largest) ranges from the top of other
+ * workers' deques, trying workers on their own NUMA node first.
+ *
+ * Threads outside the pool submit through a small mutex-protected
+ * injection queue and help until their job completes. Threads inside
+ * the pool (nested parallel_for from a task) push onto their own deque
+ * and keep executing tasks while they wait, so nesting cannot deadlock.
+ *
+ * Workers are laid out node by node over the CPUs in the process
+ * affinity mask (topology from /sys/devices/system/node) and can be
+ * pinned one per CPU.
+ */
+
+#define _GNU_SOURCE  /* pthread_setaffinity_np, pthread_setname_np, CPU_* */
+
+#include "dsv4l2_pipeline.h"
+#include "dsv4l2rt.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define DEQUE_SIZE     1024          /* Per-worker capacity (power of two) */
+#define INJECT_SIZE    256           /* External submission capacity */
+#define IDLE_SPINS     64            /* Failed steal rounds before sleeping */
+#define DEFAULT_L2     (256 * 1024)
+
+#define METRIC_ADD(field, n) __atomic_fetch_add(&(field), (n), __ATOMIC_RELAXED)
+#define METRIC_LOAD(field)   __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+typedef struct pool_job {
+    dsv4l2_range_fn fn;
+    void           *ctx;
+    uint32_t        grain;
+    uint32_t        pending;         /* Items not yet executed */
+} pool_job_t;
+
+typedef struct {
+    pool_job_t *job;
+    uint32_t    begin;
+    uint32_t    end;
+} pool_task_t;
+
+typedef struct pool_worker {
+    /* Deque indices on their own cache lines (owner vs thieves) */
+    int64_t      top __attribute__((aligned(64)));
+    int64_t      bottom __attribute__((aligned(64)));
+    pool_task_t  tasks[DEQUE_SIZE];
+
+    dsv4l2_pool_t *pool;
+    pthread_t    thread;
+    unsigned int id;
+    int          cpu;                /* -1 if unknown */
+    int          node;
+    uint32_t     rng;                /* Victim selection */
+
+    uint64_t     tasks_run;
+    uint64_t     steals;
+    uint64_t     remote_steals;
+} pool_worker_t;
+
+struct dsv4l2_pool {
+    pool_worker_t  *workers;
+    unsigned int    nworkers;
+    unsigned int    started;
+    unsigned int    numa_nodes;
+
+    /* External submissions */
+    pthread_mutex_t inject_lock;
+    pool_task_t     inject[INJECT_SIZE];
+    uint32_t        inject_head;
+    uint32_t        inject_count;
+
+    /* Idle workers */
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+    int             sleepers;
+    int             stop;
+
+    /* External callers waiting for completion */
+    pthread_mutex_t done_lock;
+    pthread_cond_t  done;
+
+    uint64_t        jobs;
+    uint64_t        external_tasks;
+};
+
+/* Worker the current thread belongs to (NULL outside any pool) */
+static __thread pool_worker_t *tls_worker;
+
+/* ========================================================================
+ * Chase-Lev deque
+ * ======================================================================== */
+
+static void task_store(pool_task_t *slot, const pool_task_t *t)
+{
+    __atomic_store_n(&slot->job, t->job, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->begin, t->begin, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->end, t->end, __ATOMIC_RELAXED);
+}
+
+static void task_load(pool_task_t *slot, pool_task_t *t)
+{
+    t->job = __atomic_load_n(&slot->job, __ATOMIC_RELAXED);
+    t->begin = __atomic_load_n(&slot->begin, __ATOMIC_RELAXED);
+    t->end = __atomic_load_n(&slot->end, __ATOMIC_RELAXED);
+}
+
+/**
+ * Owner: push onto the bottom (fails when full)
+ */
+static int deque_push(pool_worker_t *w, const pool_task_t *t)
+{
+    int64_t b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED);
+    int64_t top = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+
+    if (b - top >= DEQUE_SIZE) {
+        return -1;
+    }
+
+    task_store(&w->tasks[b & (DEQUE_SIZE - 1)], t);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * Owner: pop from the bottom
+ */
+static int deque_pop(pool_worker_t *w, pool_task_t *t)
+{
+    int64_t b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED) - 1;
+    int64_t top;
+    int ok = 1;
+
+    __atomic_store_n(&w->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    top = __atomic_load_n(&w->top, __ATOMIC_RELAXED);
+
+    if (top > b) {
+        __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    task_load(&w->tasks[b & (DEQUE_SIZE - 1)], t);
+    if (top == b) {
+        /* Last entry: race thieves for it */
+        ok = __atomic_compare_exchange_n(&w->top, &top, top + 1, 0,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+
+    return ok;
+}
+
+/**
+ * Thief: take from the top
+ */
+static int deque_steal(pool_worker_t *w, pool_task_t *t)
+{
+    int64_t top = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+    int64_t b;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&w->bottom, __ATOMIC_ACQUIRE);
+
+    if (top >= b) {
+        return 0;
+    }
+
+    task_load(&w->tasks[top & (DEQUE_SIZE - 1)], t);
+    return __atomic_compare_exchange_n(&w->top, &top, top + 1, 0,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static int deque_empty(pool_worker_t *w)
+{
+    return __atomic_load_n(&w->top, __ATOMIC_ACQUIRE) >=
+           __atomic_load_n(&w->bottom, __ATOMIC_ACQUIRE);
+}
+
+/* ========================================================================
+ * Scheduling
+ * ======================================================================== */
+
+static int inject_push(dsv4l2_pool_t *pool, const pool_task_t *t)
+{
+    int rc = -1;
+
+    pthread_mutex_lock(&pool->inject_lock);
+    if (pool->inject_count < INJECT_SIZE) {
+        pool->inject[(pool->inject_head + pool->inject_count) % INJECT_SIZE] = *t;
+        __atomic_store_n(&pool->inject_count, pool->inject_count + 1, __ATOMIC_SEQ_CST);
+        rc = 0;
+    }
+    pthread_mutex_unlock(&pool->inject_lock);
+
+    return rc;
+}
+
+/**
+ * Take from the injection queue
+ *
+ * Workers take the oldest (largest) range. External threads take the
+ * newest, so their splitting stays depth-first like a worker's deque
+ * and the queue holds O(log n) entries per job rather than O(n).
+ */
+static int inject_pop(dsv4l2_pool_t *pool, pool_task_t *t, int newest)
+{
+    int ok = 0;
+
+    if (__atomic_load_n(&pool->inject_count, __ATOMIC_SEQ_CST) == 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&pool->inject_lock);
+    if (pool->inject_count > 0) {
+        if (newest) {
+            *t = pool->inject[(pool->inject_head + pool->inject_count - 1) % INJECT_SIZE];
+        } else {
+            *t = pool->inject[pool->inject_head];
+            pool->inject_head = (pool->inject_head + 1) % INJECT_SIZE;
+        }
+        __atomic_store_n(&pool->inject_count, pool->inject_count - 1, __ATOMIC_SEQ_CST);
+        ok = 1;
+    }
+    pthread_mutex_unlock(&pool->inject_lock);
+
+    return ok;
+}
+
+/**
+ * Wake one sleeping worker after publishing work
+ */
+static void pool_notify(dsv4l2_pool_t *pool)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static uint32_t xorshift(uint32_t *state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/**
+ * Steal from another worker, same NUMA node first
+ *
+ * @param pool Pool
+ * @param self Calling worker (NULL for an external thread)
+ * @param t Output task
+ * @return 1 if a task was stolen
+ */
+static int pool_steal(dsv4l2_pool_t *pool, pool_worker_t *self, pool_task_t *t)
+{
+    static __thread uint32_t ext_rng = 0x9e3779b9u;
+    uint32_t *rng = self ? &self->rng : &ext_rng;
+    unsigned int n = pool->nworkers;
+    unsigned int start = xorshift(rng) % n;
+    unsigned int pass, i;
+
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0; i < n; i++) {
+            pool_worker_t *victim = &pool->workers[(start + i) % n];
+            int local;
+
+            if (victim == self) {
+                continue;
+            }
+
+            /* Pass 0: same node only. Pass 1: everything else. */
+            local = !self || victim->node == self->node;
+            if ((pass == 0) != local) {
+                continue;
+            }
+
+            if (deque_steal(victim, t)) {
+                if (self) {
+                    METRIC_ADD(self->steals, 1);
+                    if (!local) {
+                        METRIC_ADD(self->remote_steals, 1);
+                    }
+                }
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int pool_find_task(dsv4l2_pool_t *pool, pool_worker_t *self, pool_task_t *t)
+{
+    if (self && deque_pop(self, t)) {
+        return 1;
+    }
+    if (inject_pop(pool, t, self == NULL)) {
+        return 1;
+    }
+    return pool_steal(pool, self, t);
+}
+
+static int pool_has_work(dsv4l2_pool_t *pool)
+{
+    unsigned int i;
+
+    if (__atomic_load_n(&pool->inject_count, __ATOMIC_SEQ_CST) > 0) {
+        return 1;
+    }
+    for (i = 0; i < pool->nworkers; i++) {
+        if (!deque_empty(&pool->workers[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Execute a range, splitting off right halves while it exceeds the grain
+ *
+ * Workers push the halves onto their own deque; external threads put
+ * them back on the injection queue so workers can pick them up.
+ */
+static void pool_run_task(dsv4l2_pool_t *pool, pool_worker_t *self, pool_task_t *t)
+{
+    pool_job_t *job = t->job;
+    uint32_t begin = t->begin;
+    uint32_t end = t->end;
+    int split = 0;
+
+    while (end - begin > job->grain) {
+        uint32_t mid = begin + (end - begin) / 2;
+        pool_task_t half;
+
+        /* Keep split points on grain boundaries */
+        mid -= (mid - begin) % job->grain;
+        if (mid == begin) {
+            mid = begin + job->grain;
+        }
+
+        half.job = job;
+        half.begin = mid;
+        half.end = end;
+        if (self ? deque_push(self, &half) : inject_push(pool, &half)) {
+            break;  /* Full: run the rest here */
+        }
+        end = mid;
+        split = 1;
+    }
+
+    if (split) {
+        pool_notify(pool);
+    }
+
+    while (end - begin > job->grain) {
+        job->fn(job->ctx, begin, begin + job->grain);
+        begin += job->grain;
+        __atomic_sub_fetch(&job->pending, job->grain, __ATOMIC_ACQ_REL);
+    }
+
+    job->fn(job->ctx, begin, end);
+
+    if (self) {
+        METRIC_ADD(self->tasks_run, 1);
+    } else {
+        METRIC_ADD(pool->external_tasks, 1);
+    }
+
+    if (__atomic_sub_fetch(&job->pending, end - begin, __ATOMIC_ACQ_REL) == 0) {
+        /* The job may be gone once pending hits zero; only touch the pool */
+        pthread_mutex_lock(&pool->done_lock);
+        pthread_cond_broadcast(&pool->done);
+        pthread_mutex_unlock(&pool->done_lock);
+    }
+}
+
+static void *pool_worker_main(void *arg)
+{
+    pool_worker_t *w = arg;
+    dsv4l2_pool_t *pool = w->pool;
+    pool_task_t t;
+    int idle = 0;
+
+    tls_worker = w;
+
+    for (;;) {
+        if (pool_find_task(pool, w, &t)) {
+            pool_run_task(pool, w, &t);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < IDLE_SPINS) {
+            sched_yield();
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        __atomic_fetch_add(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        if (!pool->stop && !pool_has_work(pool)) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        __atomic_fetch_sub(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        if (pool->stop) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        idle = 0;
+    }
+
+    tls_worker = NULL;
+    return NULL;
+}
+
+/* ========================================================================
+ * Topology
+ * ======================================================================== */
+
+/**
+ * Parse a sysfs cpulist ("0-3,8-11") into a CPU set
+ */
+static void parse_cpulist(const char *s, cpu_set_t *set)
+{
+    while (*s) {
+        char *endp;
+        long lo = strtol(s, &endp, 10);
+        long hi = lo;
+
+        if (endp == s) {
+            break;
+        }
+        s = endp;
+        if (*s == '-') {
+            hi = strtol(s + 1, &endp, 10);
+            s = endp;
+        }
+        for (; lo <= hi && lo < CPU_SETSIZE; lo++) {
+            if (lo >= 0) {
+                CPU_SET((int)lo, set);
+            }
+        }
+        if (*s == ',') {
+            s++;
+        } else {
+            break;
+        }
+    }
+}
+
+/**
+ * Fill node_of[cpu] from /sys/devices/system/node (all 0 without NUMA)
+ */
+static void read_numa_topology(int *node_of)
+{
+    DIR *dir;
+    struct dirent *de;
+    int cpu;
+
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        node_of[cpu] = 0;
+    }
+
+    dir = opendir("/sys/devices/system/node");
+    if (!dir) {
+        return;
+    }
+
+    while ((de = readdir(dir)) != NULL) {
+        char path[300], buf[1024];
+        cpu_set_t set;
+        FILE *f;
+        int node;
+
+        if (sscanf(de->d_name, "node%d", &node) != 1) {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "/sys/devices/system/node/%s/cpulist", de->d_name);
+        f = fopen(path, "r");
+        if (!f) {
+            continue;
+        }
+        if (fgets(buf, sizeof(buf), f)) {
+            CPU_ZERO(&set);
+            parse_cpulist(buf, &set);
+            for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &set)) {
+                    node_of[cpu] = node;
+                }
+            }
+        }
+        fclose(f);
+    }
+
+    closedir(dir);
+}
+
+/**
+ * Assign a CPU and node to every worker, grouped node by node
+ */
+static void pool_layout(dsv4l2_pool_t *pool, const dsv4l2_pool_config_t *cfg,
+                        int *cpus, int ncpus, const int *node_of)
+{
+    uint64_t seen_nodes[4] = {0};
+    unsigned int i;
+
+    for (i = 0; i < pool->nworkers; i++) {
+        pool_worker_t *w = &pool->workers[i];
+
+        w->cpu = ncpus > 0 ? cpus[i % ncpus] : -1;
+        w->node = w->cpu >= 0 ? node_of[w->cpu] : 0;
+        if (cfg->numa_node >= 0) {
+            w->node = cfg->numa_node;
+        }
+        if (w->node >= 0 && w->node < 256 &&
+            !(seen_nodes[w->node / 64] & (1ULL << (w->node % 64)))) {
+            seen_nodes[w->node / 64] |= 1ULL << (w->node % 64);
+            pool->numa_nodes++;
+        }
+    }
+}
+
+/**
+ * Apply CPU affinity to a started worker
+ */
+static void pool_set_affinity(pool_worker_t *w, const dsv4l2_pool_config_t *cfg,
+                              const int *cpus, int ncpus)
+{
+    cpu_set_t set;
+    int i;
+
+    CPU_ZERO(&set);
+    if (cfg->pin && w->cpu >= 0) {
+        CPU_SET(w->cpu, &set);
+    } else if (cfg->numa_node >= 0) {
+        for (i = 0; i < ncpus; i++) {
+            CPU_SET(cpus[i], &set);
+        }
+    } else {
+        return;
+    }
+
+    /* Best effort: an unpinned worker is still correct */
+    pthread_setaffinity_np(w->thread, sizeof(set), &set);
+}
+
+/* ========================================================================
+ * Public API
+ * ======================================================================== */
+
+/**
+ * Create a private pool
+ *
+ * @param cfg Configuration (NULL for defaults)
+ * @param out Output pool
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_pool_create(const dsv4l2_pool_config_t *cfg, dsv4l2_pool_t **out)
+{
+    dsv4l2_pool_config_t defaults = { .threads = 0, .pin = 0, .numa_node = -1 };
+    dsv4l2_pool_t *pool;
+    cpu_set_t allowed;
+    int *node_of, *cpus;
+    int ncpus = 0, cpu, node, max_node = 0;
+    unsigned int i;
+
+    if (!out) {
+        return -EINVAL;
+    }
+    if (!cfg) {
+        cfg = &defaults;
+    }
+    if (cfg->threads > DSV4L2_POOL_MAX_WORKERS) {
+        return -EINVAL;
+    }
+
+    node_of = calloc(CPU_SETSIZE, sizeof(int));
+    cpus = calloc(CPU_SETSIZE, sizeof(int));
+    pool = calloc(1, sizeof(*pool));
+    if (!node_of || !cpus || !pool) {
+        free(node_of);
+        free(cpus);
+        free(pool);
+        return -ENOMEM;
+    }
+
+    /* Usable CPUs, ordered node by node */
+    read_numa_topology(node_of);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+    }
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && node_of[cpu] > max_node) {
+            max_node = node_of[cpu];
+        }
+    }
+    for (node = 0; node <= max_node; node++) {
+        if (cfg->numa_node >= 0 && node != cfg->numa_node) {
+            continue;
+        }
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed) && node_of[cpu] == node) {
+                cpus[ncpus++] = cpu;
+            }
+        }
+    }
+
+    if (cfg->numa_node >= 0 && ncpus == 0) {
+        free(node_of);
+        free(cpus);
+        free(pool);
+        return -ENODEV;
+    }
+
+    pool->nworkers = cfg->threads ? cfg->threads : (ncpus > 0 ? (unsigned int)ncpus : 1);
+    if (pool->nworkers > DSV4L2_POOL_MAX_WORKERS) {
+        pool->nworkers = DSV4L2_POOL_MAX_WORKERS;
+    }
+
+    /* Deques are cache-line aligned */
+    if (posix_memalign((void **)&pool->workers, 64,
+                       pool->nworkers * sizeof(pool_worker_t)) != 0) {
+        free(node_of);
+        free(cpus);
+        free(pool);
+        return -ENOMEM;
+    }
+    memset(pool->workers, 0, pool->nworkers * sizeof(pool_worker_t));
+
+    pthread_mutex_init(&pool->inject_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_mutex_init(&pool->done_lock, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    pool_layout(pool, cfg, cpus, ncpus, node_of);
+
+    for (i = 0; i < pool->nworkers; i++) {
+        pool_worker_t *w = &pool->workers[i];
+        char thread_name[16];
+
+        w->pool = pool;
+        w->id = i;
+        w->rng = 0x9e3779b9u ^ (i * 2654435761u) ^ 1u;
+
+        if (pthread_create(&w->thread, NULL, pool_worker_main, w) != 0) {
+            break;
+        }
+        pool->started++;
+
+        snprintf(thread_name, sizeof(thread_name), "dsv4l2-pool%u", (unsigned char)i);
+        pthread_setname_np(w->thread, thread_name);
+        pool_set_affinity(w, cfg, cpus, ncpus);
+    }
+
+    free(node_of);
+    free(cpus);
+
+    /* Slots of workers that failed to start stay empty and are harmless */
+    if (pool->started == 0) {
+        dsv4l2_pool_destroy(pool);
+        return -EAGAIN;
+    }
+
+    *out = pool;
+    return 0;
+}
+
+static dsv4l2_pool_t *g_shared_pool;
+static pthread_once_t g_shared_once = PTHREAD_ONCE_INIT;
+
+static void shared_pool_init(void)
+{
+    dsv4l2_pool_config_t cfg = { .threads = 0, .pin = 0, .numa_node = -1 };
+    const char *env;
+
+    env = getenv("DSV4L2_POOL_THREADS");
+    if (env && *env) {
+        cfg.threads = (unsigned int)strtoul(env, NULL, 10);
+    }
+    env = getenv("DSV4L2_POOL_PIN");
+    if (env && strcmp(env, "1") == 0) {
+        cfg.pin = 1;
+    }
+
+    if (dsv4l2_pool_create(&cfg, &g_shared_pool) != 0) {
+        g_shared_pool = NULL;
+    }
+}
+
+/**
+ * Process-wide pool shared by every device
+ *
+ * @return Shared pool, or NULL if it could not be created
+ */
+dsv4l2_pool_t *dsv4l2_pool_shared(void)
+{
+    pthread_once(&g_shared_once, shared_pool_init);
+    return g_shared_pool;
+}
+
+/**
+ * Stop workers and free a private pool (the shared pool is never freed)
+ *
+ * @param pool Pool
+ */
+void dsv4l2_pool_destroy(dsv4l2_pool_t *pool)
+{
+    unsigned int i;
+
+    if (!pool || pool == g_shared_pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->started; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    pthread_mutex_destroy(&pool->inject_lock);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->done_lock);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool);
+}
+
+/**
+ * Run fn over [0, count) in parallel and wait for it
+ *
+ * @param pool Pool (NULL runs serially on the calling thread)
+ * @param count Number of items
+ * @param grain Largest range handed to fn (0 = 1)
+ * @param fn Range body
+ * @param ctx Passed to fn
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_parallel_for(dsv4l2_pool_t *pool, uint32_t count, uint32_t grain,
+                        dsv4l2_range_fn fn, void *ctx)
+{
+    pool_worker_t *self = tls_worker;
+    pool_job_t job;
+    pool_task_t t;
+
+    if (!fn) {
+        return -EINVAL;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+
+    if (!pool || count <= grain) {
+        fn(ctx, 0, count);
+        return 0;
+    }
+
+    if (self && self->pool != pool) {
+        self = NULL;  /* Worker of a different pool: act as an outsider */
+    }
+
+    DSV4L2_TRACE_BEGIN("parallel_for");
+    METRIC_ADD(pool->jobs, 1);
+
+    job.fn = fn;
+    job.ctx = ctx;
+    job.grain = grain;
+    job.pending = count;
+
+    t.job = &job;
+    t.begin = 0;
+    t.end = count;
+
+    /* Start splitting here; halves go where other threads can take them */
+    pool_run_task(pool, self, &t);
+
+    while (__atomic_load_n(&job.pending, __ATOMIC_ACQUIRE) != 0) {
+        if (pool_find_task(pool, self, &t)) {
+            pool_run_task(pool, self, &t);
+            continue;
+        }
+
+        if (self) {
+            /* Never block a worker: its deque may be all that is left */
+            sched_yield();
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->done_lock);
+        if (__atomic_load_n(&job.pending, __ATOMIC_ACQUIRE) != 0 && !pool_has_work(pool)) {
+            pthread_cond_wait(&pool->done, &pool->done_lock);
+        }
+        pthread_mutex_unlock(&pool->done_lock);
+    }
+
+    DSV4L2_TRACE_END("parallel_for");
+    return 0;
+}
+
+/**
+ * L2 data cache size of CPU 0 (bytes)
+ */
+static size_t l2_cache_size(void)
+{
+    static size_t cached;
+    size_t size = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+    char buf[32];
+    FILE *f;
+
+    if (size) {
+        return size;
+    }
+
+    size = DEFAULT_L2;
+    f = fopen("/sys/devices/system/cpu/cpu0/cache/index2/size", "r");
+    if (f) {
+        if (fgets(buf, sizeof(buf), f)) {
+            char *endp;
+            unsigned long v = strtoul(buf, &endp, 10);
+
+            if (*endp == 'K') {
+                v *= 1024;
+            } else if (*endp == 'M') {
+                v *= 1024 * 1024;
+            }
+            if (v >= 16 * 1024) {
+                size = v;
+            }
+        }
+        fclose(f);
+    }
+
+    __atomic_store_n(&cached, size, __ATOMIC_RELAXED);
+    return size;
+}
+
+typedef struct {
+    dsv4l2_tile_fn fn;
+    void          *ctx;
+    uint32_t       width;
+    uint32_t       height;
+    uint32_t       tile_w;
+    uint32_t       tile_h;
+    uint32_t       cols;
+} tile_job_t;
+
+static void tile_range(void *arg, uint32_t begin, uint32_t end)
+{
+    tile_job_t *tj = arg;
+    uint32_t i;
+
+    for (i = begin; i < end; i++) {
+        dsv4l2_tile_t tile;
+
+        tile.x = (i % tj->cols) * tj->tile_w;
+        tile.y = (i / tj->cols) * tj->tile_h;
+        tile.width = tj->width - tile.x < tj->tile_w ? tj->width - tile.x : tj->tile_w;
+        tile.height = tj->height - tile.y < tj->tile_h ? tj->height - tile.y : tj->tile_h;
+        tj->fn(tj->ctx, &tile);
+    }
+}
+
+/**
+ * Split an image into cache-sized tiles and process them in parallel
+ *
+ * @param pool Pool (NULL runs serially)
+ * @param width Image width in pixels
+ * @param height Image height in pixels
+ * @param bytes_per_pixel Bytes per pixel (sizes the tiles)
+ * @param fn Tile body
+ * @param ctx Passed to fn
+ * @return 0 on success, -EOVERFLOW if the image needs more than
+ *         UINT32_MAX tiles, negative errno on other errors
+ */
+int dsv4l2_parallel_tiles(dsv4l2_pool_t *pool, uint32_t width, uint32_t height,
+                          uint32_t bytes_per_pixel, dsv4l2_tile_fn fn, void *ctx)
+{
+    size_t budget = l2_cache_size() / 2;
+    uint64_t row_bytes, rows, tiles;
+    tile_job_t tj;
+
+    if (!fn || bytes_per_pixel == 0) {
+        return -EINVAL;
+    }
+    if (width == 0 || height == 0) {
+        return 0;
+    }
+
+    tj.fn = fn;
+    tj.ctx = ctx;
+    tj.width = width;
+    tj.height = height;
+
+    row_bytes = (uint64_t)width * bytes_per_pixel;
+    if (row_bytes <= budget) {
+        tj.tile_w = width;
+        tj.tile_h = (uint32_t)(budget / row_bytes);
+        if (tj.tile_h > height) {
+            tj.tile_h = height;
+        }
+    } else {
+        /* Very wide rows: split into 64-pixel aligned columns */
+        tj.tile_w = (uint32_t)(budget / bytes_per_pixel);
+        if (tj.tile_w >= 64) {
+            tj.tile_w &= ~63u;
+        }
+        if (tj.tile_w == 0) {
+            tj.tile_w = 1;
+        }
+        tj.tile_h = 1;
+    }
+
+    /* Round up without width + tile_w - 1 wrapping; cols <= width */
+    tj.cols = (width - 1) / tj.tile_w + 1;
+    rows = (uint64_t)(height - 1) / tj.tile_h + 1;
+    tiles = (uint64_t)tj.cols * rows;
+    if (tiles > UINT32_MAX) {
+        return -EOVERFLOW;  /* parallel_for indexes items with uint32_t */
+    }
+
+    return dsv4l2_parallel_for(pool, (uint32_t)tiles, 1, tile_range, &tj);
+}
+
+/**
+ * Snapshot pool metrics
+ *
+ * @param pool Pool
+ * @param stats Output metrics
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_pool_get_stats(dsv4l2_pool_t *pool, dsv4l2_pool_stats_t *stats)
+{
+    unsigned int i;
+
+    if (!pool || !stats) {
+        return -EINVAL;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    stats->threads = pool->nworkers;
+    stats->numa_nodes = pool->numa_nodes;
+    stats->jobs = METRIC_LOAD(pool->jobs);
+    stats->tasks = METRIC_LOAD(pool->external_tasks);
+
+    for (i = 0; i < pool->nworkers; i++) {
+        stats->tasks += METRIC_LOAD(pool->workers[i].tasks_run);
+        stats->steals += METRIC_LOAD(pool->workers[i].steals);
+        stats->remote_steals += METRIC_LOAD(pool->workers[i].remote_steals);
+    }
+
+    return 0;
+}
@@ -0,0 +1,836 @@
+/*
+ * DSV4L2 Shared-Memory Frame Ring
+ *
+ * Layout of the memfd (all offsets fixed at creation, size sealed):
+ *
+ *   ring_header_t                        128 bytes
+ *   slot 0: ring_slot_t + data           slot_stride bytes (64-aligned)
+ *   slot 1: ...
+ *
+ * Frame n lives in slot n % slots. The producer marks the slot busy
+ * (odd lock), writes it, marks it stable (even lock), then advances
+ * head and wakes futex waiters. Frames [head - slots + 1, head) are
+ * always readable; a consumer further behind than that is moved up to
+ * the oldest readable frame and the difference is reported as missed.
+ * A consumer that loses a race with the producer mid-copy notices the
+ * changed lock and retries from the new position.
+ *
+ * The fd is handed out over an abstract unix socket named after the
+ * ring ("\0dsv4l2-ring-<name>") with SCM_RIGHTS. The socket goes away
+ * with the publisher, so no file in /dev/shm can be left behind.
+ *
+ * Once the producer has its own writable mapping the memfd is sealed
+ * with F_SEAL_FUTURE_WRITE: every later mapping, from any fd or any
+ * reopen of it, can only be read-only, and write() fails. Consumers
+ * copy the geometry at attach and never index the ring with values
+ * re-read from shared memory.
+ */
+
+#define _GNU_SOURCE  /* memfd_create, SO_PEERCRED, F_ADD_SEALS */
+
+#include "dsv4l2_ring.h"
+#include "../dsv4l2_internal.h"
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define RING_MAGIC          0x52345644u  /* "DV4R" */
+#define RING_VERSION        1
+#define RING_DEFAULT_SLOTS  8
+#define RING_SOCKET_PREFIX  "dsv4l2-ring-"
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010   /* Linux 5.1 */
+#endif
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t slot_size;              /* Data capacity per slot */
+    uint32_t slot_stride;            /* Bytes per slot including ring_slot_t */
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelformat;
+    uint32_t closed;                 /* Publisher is gone */
+    uint32_t futex;                  /* Low 32 bits of head, futex word */
+    uint64_t head __attribute__((aligned(64)));  /* Next frame to publish */
+} __attribute__((aligned(64))) ring_header_t;
+
+typedef struct {
+    uint32_t lock;                   /* Seqlock: odd while being written */
+    uint32_t sequence;               /* Driver frame sequence */
+    uint64_t seq;                    /* Ring sequence of the frame in the slot */
+    uint64_t timestamp_ns;
+    uint64_t len;
+    uint32_t flags;
+} __attribute__((aligned(64))) ring_slot_t;
+
+struct dsv4l2_ring_pub {
+    ring_header_t *hdr;
+    size_t         map_size;
+    uint32_t       slots;
+    uint32_t       slot_size;
+    uint32_t       slot_stride;
+    int            memfd;
+    int            listen_fd;
+    pthread_t      acceptor;
+    int            acceptor_started;
+    uint64_t       next;             /* Ring sequence of the next frame */
+    uint32_t       reserved;         /* Slot for `next` is marked busy (claimed by CAS) */
+    uint64_t       attaches;
+    uint64_t       rejected;
+};
+
+struct dsv4l2_ring_sub {
+    const ring_header_t *hdr;
+    size_t         map_size;
+    uint32_t       slots;            /* Geometry as validated at attach */
+    uint32_t       slot_size;
+    uint32_t       slot_stride;
+    uint64_t       cursor;           /* Next frame to read */
+    uint64_t       missed;
+};
+
+/**
+ * Slot holding frame n, located with the caller's private copy of the
+ * geometry (never with values read back from the shared header)
+ */
+static ring_slot_t *ring_slot(const ring_header_t *hdr, uint32_t slots, uint32_t stride,
+                              uint64_t n)
+{
+    return (ring_slot_t *)((uint8_t *)hdr + sizeof(ring_header_t) +
+                           (size_t)(n % slots) * stride);
+}
+
+static long futex(uint32_t *uaddr, int op, uint32_t val, const struct timespec *ts)
+{
+    return syscall(SYS_futex, uaddr, op, val, ts, NULL, 0);
+}
+
+/**
+ * Build the abstract socket address for a ring name
+ */
+static int ring_address(const char *name, struct sockaddr_un *addr, socklen_t *len)
+{
+    size_t n, i;
+
+    if (!name) {
+        return -EINVAL;
+    }
+
+    n = strlen(name);
+    if (n == 0 || n > DSV4L2_RING_NAME_MAX) {
+        return -EINVAL;
+    }
+    for (i = 0; i < n; i++) {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c == '_' || c == '.' || c == '-')) {
+            return -EINVAL;
+        }
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    /* sun_path[0] = '\0' selects the abstract namespace */
+    snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1, RING_SOCKET_PREFIX "%s", name);
+    *len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 +
+                       strlen(RING_SOCKET_PREFIX) + n);
+    return 0;
+}
+
+/* ========================================================================
+ * Publisher
+ * ======================================================================== */
+
+/**
+ * Hand the memfd to one consumer
+ */
+static void ring_send_fd(dsv4l2_ring_pub_t *pub, int conn)
+{
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    char byte = 'R';
+    struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0 ||
+        (cred.uid != geteuid() && cred.uid != 0)) {
+        __atomic_fetch_add(&pub->rejected, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &pub->memfd, sizeof(int));
+
+    if (sendmsg(conn, &msg, MSG_NOSIGNAL) == 1) {
+        __atomic_fetch_add(&pub->attaches, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void *ring_acceptor(void *arg)
+{
+    dsv4l2_ring_pub_t *pub = arg;
+
+    for (;;) {
+        int conn = accept4(pub->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;  /* Listening socket shut down */
+        }
+
+        ring_send_fd(pub, conn);
+        close(conn);
+    }
+
+    return NULL;
+}
+
+/**
+ * Create a ring and start accepting consumers
+ *
+ * @param name Ring name consumers attach by (NULL for a private ring)
+ * @param cfg Geometry and stream format
+ * @param out Output publisher
+ * @return 0 on success, negative errno on error (-EADDRINUSE if the
+ *         name is taken)
+ */
+int dsv4l2_ring_create(const char *name, const dsv4l2_ring_config_t *cfg,
+                       dsv4l2_ring_pub_t **out)
+{
+    dsv4l2_ring_pub_t *pub;
+    struct sockaddr_un addr;
+    socklen_t addr_len;
+    uint32_t slots, stride;
+    uint64_t size;
+    int rc;
+
+    if (!cfg || !out || cfg->slot_size == 0) {
+        return -EINVAL;
+    }
+
+    if (name) {
+        rc = ring_address(name, &addr, &addr_len);
+        if (rc < 0) {
+            return rc;
+        }
+    }
+
+    slots = cfg->slots ? cfg->slots : RING_DEFAULT_SLOTS;
+    stride = (uint32_t)((sizeof(ring_slot_t) + (uint64_t)cfg->slot_size + 63) & ~63ULL);
+    size = sizeof(ring_header_t) + (uint64_t)slots * stride;
+    if (slots < 2 || cfg->slot_size > INT_MAX - 128 || size > SIZE_MAX / 2) {
+        return -EINVAL;
+    }
+
+    pub = calloc(1, sizeof(*pub));
+    if (!pub) {
+        return -ENOMEM;
+    }
+    pub->memfd = -1;
+    pub->listen_fd = -1;
+    pub->map_size = (size_t)size;
+    pub->slots = slots;
+    pub->slot_size = cfg->slot_size;
+    pub->slot_stride = stride;
+
+    pub->memfd = memfd_create("dsv4l2-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (pub->memfd < 0 || ftruncate(pub->memfd, (off_t)size) != 0) {
+        rc = -errno;
+        goto fail;
+    }
+
+    /* Consumers may rely on the size never changing under them */
+    if (fcntl(pub->memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) != 0) {
+        rc = -errno;
+        goto fail;
+    }
+
+    pub->hdr = mmap(NULL, pub->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    pub->memfd, 0);
+    if (pub->hdr == MAP_FAILED) {
+        pub->hdr = NULL;
+        rc = -errno;
+        goto fail;
+    }
+
+    /*
+     * Only this mapping may write: any fd handed out from here on maps
+     * read-only, so a consumer cannot touch frames, seqlocks or the
+     * header of the others. Refuse to run on kernels without the seal
+     * rather than hand out a writable ring.
+     */
+    if (fcntl(pub->memfd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) != 0) {
+        rc = -errno;
+        goto fail;
+    }
+
+    pub->hdr->slots = slots;
+    pub->hdr->slot_size = cfg->slot_size;
+    pub->hdr->slot_stride = stride;
+    pub->hdr->width = cfg->width;
+    pub->hdr->height = cfg->height;
+    pub->hdr->pixelformat = cfg->pixelformat;
+    pub->hdr->version = RING_VERSION;
+    __atomic_store_n(&pub->hdr->magic, RING_MAGIC, __ATOMIC_RELEASE);
+
+    if (!name) {
+        *out = pub;  /* Private ring: handed out with dsv4l2_ring_fd() */
+        return 0;
+    }
+
+    pub->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (pub->listen_fd < 0) {
+        rc = -errno;
+        goto fail;
+    }
+    if (bind(pub->listen_fd, (struct sockaddr *)&addr, addr_len) != 0 ||
+        listen(pub->listen_fd, 16) != 0) {
+        rc = -errno;
+        goto fail;
+    }
+
+    rc = pthread_create(&pub->acceptor, NULL, ring_acceptor, pub);
+    if (rc != 0) {
+        rc = -rc;
+        goto fail;
+    }
+    pub->acceptor_started = 1;
+
+    *out = pub;
+    return 0;
+
+fail:
+    dsv4l2_ring_destroy(pub);
+    return rc;
+}
+
+/**
+ * Get the next slot to fill in place
+ *
+ * The ring has a single producer: a second reservation before the
+ * first is committed fails rather than handing out the same slot.
+ *
+ * @param pub Publisher
+ * @param data Output slot data
+ * @param capacity Output slot capacity
+ * @return 0 on success, -EBUSY if a reservation is outstanding,
+ *         negative errno on error
+ */
+int dsv4l2_ring_reserve(dsv4l2_ring_pub_t *pub, uint8_t **data, size_t *capacity)
+{
+    ring_slot_t *slot;
+    uint32_t idle = 0;
+
+    if (!pub || !data) {
+        return -EINVAL;
+    }
+    if (!__atomic_compare_exchange_n(&pub->reserved, &idle, 1, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return -EBUSY;
+    }
+
+    slot = ring_slot(pub->hdr, pub->slots, pub->slot_stride, pub->next);
+
+    /* Odd lock: readers of the frame previously here will retry */
+    __atomic_store_n(&slot->lock, slot->lock + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    *data = (uint8_t *)(slot + 1);
+    if (capacity) {
+        *capacity = pub->slot_size;
+    }
+    return 0;
+}
+
+/**
+ * Publish the reserved slot
+ *
+ * @param pub Publisher
+ * @param len Frame length
+ * @param sequence Driver frame sequence
+ * @param timestamp_ns Capture timestamp
+ * @param flags V4L2_BUF_FLAG_*
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_ring_commit(dsv4l2_ring_pub_t *pub, size_t len, uint32_t sequence,
+                       uint64_t timestamp_ns, uint32_t flags)
+{
+    ring_header_t *hdr;
+    ring_slot_t *slot;
+
+    if (!pub || !__atomic_load_n(&pub->reserved, __ATOMIC_ACQUIRE)) {
+        return -EINVAL;
+    }
+    hdr = pub->hdr;
+    if (len > pub->slot_size) {
+        return -EMSGSIZE;
+    }
+
+    slot = ring_slot(hdr, pub->slots, pub->slot_stride, pub->next);
+    slot->seq = pub->next;
+    slot->sequence = sequence;
+    slot->timestamp_ns = timestamp_ns;
+    slot->len = len;
+    slot->flags = flags;
+    __atomic_store_n(&slot->lock, slot->lock + 1, __ATOMIC_RELEASE);
+
+    pub->next++;
+    __atomic_store_n(&hdr->head, pub->next, __ATOMIC_RELEASE);
+    __atomic_store_n(&hdr->futex, (uint32_t)pub->next, __ATOMIC_RELEASE);
+    futex(&hdr->futex, FUTEX_WAKE, INT_MAX, NULL);
+    __atomic_store_n(&pub->reserved, 0, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/**
+ * Copy a frame into the ring and publish it
+ *
+ * @return 0 on success, negative errno on error (-EMSGSIZE if the
+ *         frame is larger than a slot)
+ */
+int dsv4l2_ring_publish(dsv4l2_ring_pub_t *pub, const void *data, size_t len,
+                        uint32_t sequence, uint64_t timestamp_ns, uint32_t flags)
+{
+    uint8_t *dst;
+    size_t capacity;
+    int rc;
+
+    if (!pub || (!data && len > 0)) {
+        return -EINVAL;
+    }
+    if (len > pub->slot_size) {
+        return -EMSGSIZE;
+    }
+
+    rc = dsv4l2_ring_reserve(pub, &dst, &capacity);
+    if (rc < 0) {
+        return rc;
+    }
+    if (len > 0) {
+        memcpy(dst, data, len);
+    }
+
+    return dsv4l2_ring_commit(pub, len, sequence, timestamp_ns, flags);
+}
+
+/**
+ * Pipeline stage: publish the lease's frame
+ *
+ * @param lease Frame
+ * @param ctx Publisher
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_ring_stage(dsv4l2_lease_t *lease, void *ctx)
+{
+    return dsv4l2_ring_publish(ctx, lease->data, lease->len, lease->sequence,
+                               lease->timestamp_ns, lease->flags);
+}
+
+/**
+ * Ring memfd, for handing to a consumer over a channel of the caller's
+ * choosing (the fd stays owned by the publisher)
+ *
+ * The memfd is sealed against new writable mappings and write(), so
+ * whoever receives it can only read the ring.
+ *
+ * @param pub Publisher
+ * @return fd, or -EINVAL
+ */
+int dsv4l2_ring_fd(const dsv4l2_ring_pub_t *pub)
+{
+    return pub ? pub->memfd : -EINVAL;
+}
+
+/**
+ * Snapshot publisher metrics
+ *
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_ring_get_stats(dsv4l2_ring_pub_t *pub, dsv4l2_ring_stats_t *stats)
+{
+    if (!pub || !stats) {
+        return -EINVAL;
+    }
+
+    stats->published = __atomic_load_n(&pub->hdr->head, __ATOMIC_RELAXED);
+    stats->attaches = __atomic_load_n(&pub->attaches, __ATOMIC_RELAXED);
+    stats->rejected = __atomic_load_n(&pub->rejected, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * Close the ring
+ *
+ * Consumers keep their mapping until they detach; they read what is
+ * left and then get -EPIPE.
+ *
+ * @param pub Publisher
+ */
+void dsv4l2_ring_destroy(dsv4l2_ring_pub_t *pub)
+{
+    if (!pub) {
+        return;
+    }
+
+    if (pub->listen_fd >= 0) {
+        /* Wakes the acceptor out of accept() */
+        shutdown(pub->listen_fd, SHUT_RDWR);
+    }
+    if (pub->acceptor_started) {
+        pthread_join(pub->acceptor, NULL);
+    }
+    if (pub->listen_fd >= 0) {
+        close(pub->listen_fd);
+    }
+
+    if (pub->hdr) {
+        __atomic_store_n(&pub->hdr->closed, 1, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&pub->hdr->futex, 1, __ATOMIC_RELEASE);
+        futex(&pub->hdr->futex, FUTEX_WAKE, INT_MAX, NULL);
+        munmap(pub->hdr, pub->map_size);
+    }
+    if (pub->memfd >= 0) {
+        close(pub->memfd);
+    }
+
+    free(pub);
+}
+
+/* ========================================================================
+ * Consumer
+ * ======================================================================== */
+
+/**
+ * Receive the ring memfd from its publisher
+ */
+static int ring_recv_fd(int sock)
+{
+    char byte;
+    struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    int fd = -1;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1) {
+        /* Closed without a fd: rejected */
+        return -EACCES;
+    }
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(int))) {
+        return -EPROTO;
+    }
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+    return fd;
+}
+
+/**
+ * Attach to a ring by name
+ *
+ * @param name Ring name
+ * @param out Output consumer
+ * @return 0 on success, negative errno on error (-ENOENT if no such ring)
+ */
+int dsv4l2_ring_attach(const char *name, dsv4l2_ring_sub_t **out)
+{
+    struct sockaddr_un addr;
+    socklen_t addr_len;
+    int sock, fd, rc;
+
+    if (!out) {
+        return -EINVAL;
+    }
+
+    rc = ring_address(name, &addr, &addr_len);
+    if (rc < 0) {
+        return rc;
+    }
+
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return -errno;
+    }
+    if (connect(sock, (struct sockaddr *)&addr, addr_len) != 0) {
+        rc = errno == ECONNREFUSED ? -ENOENT : -errno;
+        close(sock);
+        return rc;
+    }
+
+    fd = ring_recv_fd(sock);
+    close(sock);
+    if (fd < 0) {
+        return fd;
+    }
+
+    rc = dsv4l2_ring_attach_fd(fd, out);
+    close(fd);
+    return rc;
+}
+
+/**
+ * Attach to a ring from its memfd
+ *
+ * The mapping does not keep fd in use; the caller may close it.
+ *
+ * @param fd Ring memfd (from dsv4l2_ring_fd() in the publisher)
+ * @param out Output consumer
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_ring_attach_fd(int fd, dsv4l2_ring_sub_t **out)
+{
+    dsv4l2_ring_sub_t *sub;
+    const ring_header_t *hdr;
+    uint32_t slots, slot_size, slot_stride;
+    struct stat st;
+
+    if (fd < 0 || !out) {
+        return -EINVAL;
+    }
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ring_header_t)) {
+        return -EPROTO;
+    }
+
+    hdr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED) {
+        return -errno;
+    }
+
+    /* Read the geometry once; check and keep that copy, not the header */
+    slots = __atomic_load_n(&hdr->slots, __ATOMIC_RELAXED);
+    slot_size = __atomic_load_n(&hdr->slot_size, __ATOMIC_RELAXED);
+    slot_stride = __atomic_load_n(&hdr->slot_stride, __ATOMIC_RELAXED);
+
+    /* Never trust the geometry beyond what was mapped */
+    if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != RING_MAGIC ||
+        hdr->version != RING_VERSION || slots < 2 ||
+        slot_stride < sizeof(ring_slot_t) + (uint64_t)slot_size ||
+        sizeof(ring_header_t) + (uint64_t)slots * slot_stride > (uint64_t)st.st_size) {
+        munmap((void *)hdr, (size_t)st.st_size);
+        return -EPROTO;
+    }
+
+    sub = calloc(1, sizeof(*sub));
+    if (!sub) {
+        munmap((void *)hdr, (size_t)st.st_size);
+        return -ENOMEM;
+    }
+
+    sub->hdr = hdr;
+    sub->map_size = (size_t)st.st_size;
+    sub->slots = slots;
+    sub->slot_size = slot_size;
+    sub->slot_stride = slot_stride;
+    sub->cursor = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+
+    *out = sub;
+    return 0;
+}
+
+/**
+ * Ring geometry and stream format
+ *
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_ring_get_config(const dsv4l2_ring_sub_t *sub, dsv4l2_ring_config_t *cfg)
+{
+    if (!sub || !cfg) {
+        return -EINVAL;
+    }
+
+    cfg->slots = sub->slots;
+    cfg->slot_size = sub->slot_size;
+    cfg->width = sub->hdr->width;
+    cfg->height = sub->hdr->height;
+    cfg->pixelformat = sub->hdr->pixelformat;
+    return 0;
+}
+
+/**
+ * Wait for head to move past cursor
+ *
+ * @return 0 if woken, -ETIMEDOUT when the deadline passes
+ */
+static int ring_wait(dsv4l2_ring_sub_t *sub, uint32_t seen, int timeout_ms,
+                     uint64_t deadline_ns)
+{
+    struct timespec ts, *tsp = NULL;
+
+    if (timeout_ms > 0) {
+        uint64_t now = dsv4l2_now_ns();
+
+        if (now >= deadline_ns) {
+            return -ETIMEDOUT;
+        }
+        ts.tv_sec = (time_t)((deadline_ns - now) / 1000000000ULL);
+        ts.tv_nsec = (long)((deadline_ns - now) % 1000000000ULL);
+        tsp = &ts;
+    }
+
+    /* Shared (non-private) futex: the producer is another process */
+    futex((uint32_t *)&sub->hdr->futex, FUTEX_WAIT, seen, tsp);
+    return 0;
+}
+
+/**
+ * Copy the next frame into buf
+ *
+ * @param sub Consumer
+ * @param buf Destination
+ * @param buflen Destination size
+ * @param info Output frame info (optional)
+ * @param timeout_ms 0 = do not wait, -1 = wait forever
+ * @return Frame length on success, negative errno on error
+ */
+int dsv4l2_ring_read(dsv4l2_ring_sub_t *sub, void *buf, size_t buflen,
+                     dsv4l2_ring_frame_t *info, int timeout_ms)
+{
+    const ring_header_t *hdr;
+    uint64_t deadline_ns = 0;
+    uint64_t skipped = 0;
+
+    if (!sub || (!buf && buflen > 0)) {
+        return -EINVAL;
+    }
+    hdr = sub->hdr;
+
+    if (timeout_ms > 0) {
+        deadline_ns = dsv4l2_now_ns() + (uint64_t)timeout_ms * 1000000ULL;
+    }
+
+    for (;;) {
+        uint32_t seen = __atomic_load_n(&hdr->futex, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+        const ring_slot_t *slot;
+        uint32_t s1, s2;
+        uint64_t len;
+
+        if (sub->cursor >= head) {
+            if (__atomic_load_n(&hdr->closed, __ATOMIC_ACQUIRE)) {
+                return -EPIPE;
+            }
+            if (timeout_ms == 0) {
+                return -EAGAIN;
+            }
+            if (ring_wait(sub, seen, timeout_ms, deadline_ns) == -ETIMEDOUT) {
+                return -ETIMEDOUT;
+            }
+            continue;
+        }
+
+        /* Too far behind: jump to the oldest frame that cannot be in flight */
+        if (head - sub->cursor >= sub->slots) {
+            uint64_t oldest = head - sub->slots + 1;
+
+            skipped += oldest - sub->cursor;
+            sub->cursor = oldest;
+        }
+
+        slot = ring_slot(hdr, sub->slots, sub->slot_stride, sub->cursor);
+        s1 = __atomic_load_n(&slot->lock, __ATOMIC_ACQUIRE);
+        if ((s1 & 1) || __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != sub->cursor) {
+            continue;  /* Overwritten since head was read */
+        }
+
+        len = __atomic_load_n(&slot->len, __ATOMIC_RELAXED);
+        if (len > sub->slot_size) {
+            continue;  /* Torn read */
+        }
+
+        if (info) {
+            info->seq = sub->cursor;
+            info->sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+            info->timestamp_ns = __atomic_load_n(&slot->timestamp_ns, __ATOMIC_RELAXED);
+            info->flags = __atomic_load_n(&slot->flags, __ATOMIC_RELAXED);
+            info->len = (size_t)len;
+            info->missed = skipped;
+        }
+
+        if (len > buflen) {
+            sub->missed += skipped;
+            return -ENOSPC;  /* Cursor stays: caller can retry with a bigger buffer */
+        }
+
+        if (len > 0) {
+            memcpy(buf, slot + 1, (size_t)len);
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        s2 = __atomic_load_n(&slot->lock, __ATOMIC_RELAXED);
+        if (s1 != s2) {
+            continue;  /* Producer lapped us mid-copy */
+        }
+
+        sub->missed += skipped;
+        sub->cursor++;
+        return (int)len;
+    }
+}
+
+/**
+ * Total frames this consumer has missed
+ */
+uint64_t dsv4l2_ring_missed(const dsv4l2_ring_sub_t *sub)
+{
+    return sub ? sub->missed : 0;
+}
+
+/**
+ * Unmap the ring
+ *
+ * @param sub Consumer
+ */
+void dsv4l2_ring_detach(dsv4l2_ring_sub_t *sub)
+{
+    if (!sub) {
+        return;
+    }
+
+    munmap((void *)sub->hdr, sub->map_size);
+    free(sub);
+}
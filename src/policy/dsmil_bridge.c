@@ -309,27 +309,14 @@ static clearance_level_t get_role_clearance_requirement(const char *role)
 }
 
 /**
- * Check clearance level
- *
- * Verifies user has sufficient clearance for device role and classification
- *
- * @param role Device role
- * @param classification Required classification level
- * @return 0 if authorized, -EPERM if denied
+ * Compare a holder clearance against role and classification requirements
  */
-int dsv4l2_check_clearance(const char *role, const char *classification)
+static int check_clearance_level(clearance_level_t user_clearance,
+                                 const char *role, const char *classification)
 {
-    clearance_level_t user_clearance;
     clearance_level_t required_clearance;
     clearance_level_t role_clearance;
 
-    if (!role || !classification) {
-        return -EINVAL;
-    }
-
-    /* Get user's clearance */
-    user_clearance = get_user_clearance();
-
     /* Get classification requirement */
     required_clearance = get_clearance_from_classification(classification);
 
@@ -350,6 +337,47 @@ int dsv4l2_check_clearance(const char *role, const char *classification)
     return 0;
 }
 
+/**
+ * Check clearance level
+ *
+ * Verifies user has sufficient clearance for device role and classification
+ *
+ * @param role Device role
+ * @param classification Required classification level
+ * @return 0 if authorized, -EPERM if denied
+ */
+int dsv4l2_check_clearance(const char *role, const char *classification)
+{
+    if (!role || !classification) {
+        return -EINVAL;
+    }
+
+    return check_clearance_level(get_user_clearance(), role, classification);
+}
+
+/**
+ * Check clearance level on behalf of another principal
+ *
+ * Same rules as dsv4l2_check_clearance(), but with an explicit holder
+ * clearance instead of DSV4L2_CLEARANCE (used by the capture daemon
+ * for each client connection).
+ *
+ * @param clearance Holder clearance ("SECRET", ...)
+ * @param role Device role
+ * @param classification Required classification level
+ * @return 0 if authorized, -EPERM if denied
+ */
+int dsv4l2_check_clearance_as(const char *clearance, const char *role,
+                              const char *classification)
+{
+    if (!clearance || !role || !classification) {
+        return -EINVAL;
+    }
+
+    return check_clearance_level(get_clearance_from_classification(clearance),
+                                 role, classification);
+}
+
 /**
  * Get THREATCON name (for display/logging)
  */
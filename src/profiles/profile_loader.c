@@ -7,6 +7,7 @@
 
 #include "dsv4l2_annotations.h"
 #include "dsv4l2_policy.h"
+#include "dsv4l2_profiles.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,26 +19,6 @@
 #define MAX_LINE 1024
 #define MAX_PROFILES 64
 
-/* Profile structure */
-typedef struct {
-    char id[32];                    /* USB VID:PID or identifier */
-    char vendor[64];
-    char model[128];
-    char role[32];
-    char classification[32];
-    uint32_t layer;
-    int tempest_ctrl_id;
-
-    /* Format settings */
-    char pixel_format[8];
-    uint32_t width;
-    uint32_t height;
-    uint32_t fps;
-
-    /* Profile metadata */
-    char filename[256];
-} dsv4l2_device_profile_t;
-
 /* Global profile cache */
 static dsv4l2_device_profile_t g_profiles[MAX_PROFILES];
 static size_t g_profile_count = 0;
@@ -45,6 +26,7 @@ static int g_profiles_loaded = 0;
 
 /* Forward declarations */
 static int load_profile_file(const char *path, dsv4l2_device_profile_t *profile);
+static int parse_profile_stream(FILE *fp, dsv4l2_device_profile_t *profile);
 static void trim_whitespace(char *str);
 static int parse_key_value(const char *line, char *key, char *value);
 
@@ -173,31 +155,77 @@ const dsv4l2_device_profile_t *dsv4l2_get_profile(size_t index)
     return &g_profiles[index];
 }
 
+/**
+ * Parse a profile from an in-memory YAML document
+ *
+ * Same grammar as the files under profiles/. Used by tools that receive
+ * profiles over a channel other than the filesystem, and by the fuzzers.
+ *
+ * @param text Profile text (need not be NUL-terminated)
+ * @param len Text length in bytes
+ * @param profile Output profile
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_parse_profile(const char *text, size_t len,
+                         dsv4l2_device_profile_t *profile)
+{
+    FILE *fp;
+    int rc;
+
+    if (!text || len == 0 || !profile) {
+        return -EINVAL;
+    }
+
+    fp = fmemopen((void *)text, len, "r");
+    if (!fp) {
+        return -errno;
+    }
+
+    rc = parse_profile_stream(fp, profile);
+    fclose(fp);
+
+    return rc;
+}
+
 /**
  * Load a single profile file
  */
 static int load_profile_file(const char *path, dsv4l2_device_profile_t *profile)
 {
     FILE *fp;
-    char line[MAX_LINE];
-    char key[128], value[512];
+    int rc;
 
     if (!path || !profile) {
         return -EINVAL;
     }
 
+    fp = fopen(path, "r");
+    if (!fp) {
+        return -errno;
+    }
+
+    rc = parse_profile_stream(fp, profile);
+    fclose(fp);
+
+    return rc;
+}
+
+/**
+ * Parse profile key/value lines from an open stream
+ */
+static int parse_profile_stream(FILE *fp, dsv4l2_device_profile_t *profile)
+{
+    char line[MAX_LINE];
+    char key[128], value[512];
+
     memset(profile, 0, sizeof(*profile));
 
     /* Set defaults */
     profile->layer = 3;  /* L3 = sensor layer */
     profile->tempest_ctrl_id = 0x9a0902;  /* Default TEMPEST control ID */
+    profile->capture_cpu = -1;
     strncpy(profile->classification, "UNCLASSIFIED", sizeof(profile->classification) - 1);
 
-    fp = fopen(path, "r");
-    if (!fp) {
-        return -errno;
-    }
-
     while (fgets(line, sizeof(line), fp)) {
         /* Skip comments and empty lines */
         trim_whitespace(line);
@@ -241,11 +269,15 @@ static int load_profile_file(const char *path, dsv4l2_device_profile_t *profile)
                     profile->tempest_ctrl_id = atoi(value);
                 }
             }
+            /* Capture thread scheduling */
+            else if (strcmp(key, "capture_cpu") == 0) {
+                profile->capture_cpu = atoi(value);
+            } else if (strcmp(key, "capture_priority") == 0) {
+                profile->capture_priority = atoi(value);
+            }
         }
     }
 
-    fclose(fp);
-
     /* Validate required fields */
     if (profile->id[0] == '\0' || profile->role[0] == '\0') {
         return -EINVAL;
@@ -0,0 +1,188 @@
+/*
+ * DSV4L2 Recorder - Block Codecs
+ *
+ * LZ4 and Zstd are optional (HAVE_LZ4, HAVE_ZSTD). Zstd compression
+ * contexts are per thread so pipeline workers never share one.
+ */
+
+#include "recorder_internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef HAVE_ZSTD
+static pthread_key_t zstd_key;
+static pthread_once_t zstd_once = PTHREAD_ONCE_INIT;
+
+static void zstd_free_ctx(void *ctx)
+{
+    ZSTD_freeCCtx(ctx);
+}
+
+static void zstd_key_init(void)
+{
+    pthread_key_create(&zstd_key, zstd_free_ctx);
+}
+
+static ZSTD_CCtx *zstd_thread_ctx(void)
+{
+    ZSTD_CCtx *ctx;
+
+    pthread_once(&zstd_once, zstd_key_init);
+    ctx = pthread_getspecific(zstd_key);
+    if (!ctx) {
+        ctx = ZSTD_createCCtx();
+        if (ctx) {
+            pthread_setspecific(zstd_key, ctx);
+        }
+    }
+
+    return ctx;
+}
+#endif
+
+/**
+ * Whether a codec was compiled in
+ *
+ * @param codec Codec
+ * @return 1 if available, 0 otherwise
+ */
+int dsv4l2_codec_available(dsv4l2_codec_t codec)
+{
+    switch (codec) {
+        case DSV4L2_CODEC_NONE:
+            return 1;
+#ifdef HAVE_LZ4
+        case DSV4L2_CODEC_LZ4:
+            return 1;
+#endif
+#ifdef HAVE_ZSTD
+        case DSV4L2_CODEC_ZSTD:
+            return 1;
+#endif
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Codec level range and default
+ */
+void dsv4l2_codec_levels(dsv4l2_codec_t codec, int *min, int *max, int *def)
+{
+    *min = 1;
+
+    switch (codec) {
+        case DSV4L2_CODEC_LZ4:
+            *max = 8;
+            *def = 8;
+            break;
+        case DSV4L2_CODEC_ZSTD:
+            *max = 19;
+            *def = 3;
+            break;
+        default:
+            *max = 1;
+            *def = 1;
+            break;
+    }
+}
+
+/**
+ * Worst-case compressed size of len bytes
+ */
+size_t dsv4l2_codec_bound(dsv4l2_codec_t codec, size_t len)
+{
+    switch (codec) {
+#ifdef HAVE_LZ4
+        case DSV4L2_CODEC_LZ4:
+            return (size_t)LZ4_compressBound((int)len);
+#endif
+#ifdef HAVE_ZSTD
+        case DSV4L2_CODEC_ZSTD:
+            return ZSTD_compressBound(len);
+#endif
+        default:
+            return len;
+    }
+}
+
+/**
+ * Compress one block
+ */
+ssize_t dsv4l2_codec_compress(dsv4l2_codec_t codec, int level, const uint8_t *src,
+                              size_t len, uint8_t *dst, size_t cap)
+{
+    (void)level;
+    (void)src;
+    (void)len;
+    (void)dst;
+    (void)cap;
+
+    switch (codec) {
+#ifdef HAVE_LZ4
+        case DSV4L2_CODEC_LZ4: {
+            /* Level 8 = acceleration 1 (best ratio), level 1 = acceleration 8 */
+            int n = LZ4_compress_fast((const char *)src, (char *)dst, (int)len,
+                                      (int)cap, 9 - level);
+
+            return n > 0 ? n : -ENOSPC;
+        }
+#endif
+#ifdef HAVE_ZSTD
+        case DSV4L2_CODEC_ZSTD: {
+            ZSTD_CCtx *ctx = zstd_thread_ctx();
+            size_t n;
+
+            if (!ctx) {
+                return -ENOMEM;
+            }
+
+            n = ZSTD_compressCCtx(ctx, dst, cap, src, len, level);
+            return ZSTD_isError(n) ? -ENOSPC : (ssize_t)n;
+        }
+#endif
+        default:
+            return -ENOTSUP;
+    }
+}
+
+/**
+ * Decompress one block into exactly raw bytes
+ */
+int dsv4l2_codec_decompress(dsv4l2_codec_t codec, const uint8_t *src, size_t len,
+                            uint8_t *dst, size_t raw)
+{
+    (void)src;
+    (void)len;
+    (void)dst;
+    (void)raw;
+
+    switch (codec) {
+#ifdef HAVE_LZ4
+        case DSV4L2_CODEC_LZ4: {
+            int n = LZ4_decompress_safe((const char *)src, (char *)dst, (int)len, (int)raw);
+
+            return n == (int)raw ? 0 : -EBADMSG;
+        }
+#endif
+#ifdef HAVE_ZSTD
+        case DSV4L2_CODEC_ZSTD: {
+            size_t n = ZSTD_decompress(dst, raw, src, len);
+
+            return !ZSTD_isError(n) && n == raw ? 0 : -EBADMSG;
+        }
+#endif
+        default:
+            return -ENOTSUP;
+    }
+}
@@ -0,0 +1,526 @@
+/*
+ * DSV4L2 Recorder - Playback
+ *
+ * Frame n is located with a single index read; raw blocks are read
+ * straight into the caller's buffer, compressed blocks through one
+ * scratch buffer per call (so a recording can be read from several
+ * threads). Encrypted records are read whole, authenticated and
+ * decrypted in the scratch buffer, then decoded from memory; the
+ * record's link tag ties it to its index position first.
+ */
+
+#include "recorder_internal.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+
+struct dsv4l2_recording {
+    int      data_fd;
+    int      index_fd;
+    uint64_t frames;
+    size_t   index_base;         /* First index record */
+    size_t   index_record;       /* Bytes per index record */
+    dsv4l2_record_header_t hdr;
+    dsv4l2_record_crypto_t crypto;
+    int      keyed;
+    uint8_t  key[DSV4L2_RECORD_KEY_SIZE];
+};
+
+static int pread_all(int fd, void *buf, size_t len, uint64_t off)
+{
+    uint8_t *p = buf;
+
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, (off_t)off);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (n == 0) {
+            return -EBADMSG;  /* Truncated */
+        }
+        p += n;
+        len -= (size_t)n;
+        off += (uint64_t)n;
+    }
+
+    return 0;
+}
+
+/**
+ * Open a recording
+ *
+ * @param path Data file path (as given to the recorder)
+ * @param out Recording
+ * @return 0 on success, -EBADMSG if the index is not a recording index,
+ *         other negative errno on error
+ */
+int dsv4l2_recording_open(const char *path, dsv4l2_recording_t **out)
+{
+    dsv4l2_recording_t *rd;
+    char index_path[PATH_MAX];
+    struct stat st;
+    int rc;
+
+    if (!path || !out) {
+        return -EINVAL;
+    }
+
+    if (snprintf(index_path, sizeof(index_path), "%s.idx", path) >=
+        (int)sizeof(index_path)) {
+        return -ENAMETOOLONG;
+    }
+
+    rd = calloc(1, sizeof(*rd));
+    if (!rd) {
+        return -ENOMEM;
+    }
+
+    rd->data_fd = open(path, O_RDONLY | O_CLOEXEC);
+    rd->index_fd = open(index_path, O_RDONLY | O_CLOEXEC);
+    if (rd->data_fd < 0 || rd->index_fd < 0) {
+        rc = -errno;
+        goto fail;
+    }
+
+    rc = pread_all(rd->index_fd, &rd->hdr, sizeof(rd->hdr), 0);
+    if (rc < 0) {
+        goto fail;
+    }
+
+    if (memcmp(rd->hdr.magic, DSV4L2_RECORD_MAGIC, sizeof(rd->hdr.magic)) != 0 ||
+        rd->hdr.version != DSV4L2_RECORD_VERSION ||
+        rd->hdr.cipher > DSV4L2_CIPHER_CHACHA20_POLY1305) {
+        rc = -EBADMSG;
+        goto fail;
+    }
+
+    rd->index_base = sizeof(rd->hdr);
+    rd->index_record = sizeof(dsv4l2_record_entry_t);
+    if (rd->hdr.cipher != DSV4L2_CIPHER_NONE) {
+        rc = pread_all(rd->index_fd, &rd->crypto, sizeof(rd->crypto), sizeof(rd->hdr));
+        if (rc < 0) {
+            goto fail;
+        }
+        rd->index_base += sizeof(rd->crypto);
+        rd->index_record += sizeof(dsv4l2_record_seal_t);
+    }
+
+    if (fstat(rd->index_fd, &st) < 0) {
+        rc = -errno;
+        goto fail;
+    }
+
+    rd->frames = (uint64_t)st.st_size > rd->index_base ?
+                 ((uint64_t)st.st_size - rd->index_base) / rd->index_record : 0;
+
+    *out = rd;
+    return 0;
+
+fail:
+    if (rd->index_fd >= 0) close(rd->index_fd);
+    if (rd->data_fd >= 0) close(rd->data_fd);
+    free(rd);
+    return rc;
+}
+
+/* Check the sealed frame count against the index */
+static int check_count(dsv4l2_recording_t *rd)
+{
+    dsv4l2_record_count_aad_t aad;
+    uint8_t none;
+    int rc;
+
+    memset(&aad, 0, sizeof(aad));
+    aad.hdr = rd->hdr;
+    aad.frames = rd->crypto.frames;
+    rc = dsv4l2_seal_decrypt((dsv4l2_cipher_t)rd->hdr.cipher, rd->key,
+                             DSV4L2_SEAL_COUNT_COUNTER, &aad, sizeof(aad),
+                             &none, 0, rd->crypto.count_tag);
+    if (rc < 0) {
+        return rc;
+    }
+
+    /* Records past the sealed count were not written by the recorder */
+    if (rd->frames > rd->crypto.frames) {
+        rd->frames = rd->crypto.frames;
+    }
+
+    return rd->frames < rd->crypto.frames ? -EBADMSG : 0;
+}
+
+/**
+ * Supply the key of an encrypted recording
+ *
+ * @param rd Recording
+ * @param key DSV4L2_RECORD_KEY_SIZE bytes
+ * @return 0 on success, -EKEYREJECTED if the key does not match,
+ *         -EBADMSG if the index is truncated or its frame count is
+ *         not sealed (recorder not closed); the key is still set, so
+ *         the frames present can be read. -ENOTSUP if the cipher is
+ *         not compiled in, other negative errno on error
+ */
+int dsv4l2_recording_set_key(dsv4l2_recording_t *rd, const uint8_t *key)
+{
+    uint8_t derived[DSV4L2_RECORD_KEY_SIZE];
+    uint8_t none;
+    int rc;
+
+    if (!rd || !key || rd->hdr.cipher == DSV4L2_CIPHER_NONE) {
+        return -EINVAL;
+    }
+
+    if (!dsv4l2_cipher_available((dsv4l2_cipher_t)rd->hdr.cipher)) {
+        return -ENOTSUP;
+    }
+
+    rc = dsv4l2_seal_derive(key, rd->crypto.salt, derived);
+    if (rc == 0) {
+        rc = dsv4l2_seal_decrypt((dsv4l2_cipher_t)rd->hdr.cipher, derived,
+                                 DSV4L2_SEAL_CHECK_COUNTER, &rd->hdr, sizeof(rd->hdr),
+                                 &none, 0, rd->crypto.check);
+    }
+
+    if (rc == 0) {
+        memcpy(rd->key, derived, sizeof(rd->key));
+        rd->keyed = 1;
+    }
+    dsv4l2_seal_wipe(derived, sizeof(derived));
+
+    if (rc == -EBADMSG) {
+        return -EKEYREJECTED;
+    }
+
+    return rc < 0 ? rc : check_count(rd);
+}
+
+/**
+ * Recorded frame count
+ */
+uint64_t dsv4l2_recording_frames(const dsv4l2_recording_t *rd)
+{
+    return rd ? rd->frames : 0;
+}
+
+/**
+ * Stream format from the index header
+ */
+void dsv4l2_recording_format(const dsv4l2_recording_t *rd, uint32_t *width,
+                             uint32_t *height, uint32_t *pixelformat)
+{
+    if (!rd) {
+        return;
+    }
+
+    if (width)       *width = rd->hdr.width;
+    if (height)      *height = rd->hdr.height;
+    if (pixelformat) *pixelformat = rd->hdr.pixelformat;
+}
+
+static int read_entry(dsv4l2_recording_t *rd, uint64_t n, dsv4l2_record_entry_t *entry,
+                      dsv4l2_record_seal_t *seal)
+{
+    struct {
+        dsv4l2_record_entry_t entry;
+        dsv4l2_record_seal_t  seal;
+    } record;
+    int rc;
+
+    if (n >= rd->frames) {
+        return -ERANGE;
+    }
+
+    rc = pread_all(rd->index_fd, &record, rd->index_record,
+                   rd->index_base + n * rd->index_record);
+    if (rc == 0) {
+        *entry = record.entry;
+        if (seal) {
+            *seal = record.seal;
+        }
+    }
+
+    return rc;
+}
+
+static void fill_info(const dsv4l2_record_entry_t *entry, dsv4l2_record_frame_t *info)
+{
+    info->sequence = entry->sequence;
+    info->timestamp_ns = entry->timestamp_ns;
+    info->raw_len = entry->raw;
+    info->stored_len = entry->stored;
+    info->blocks = entry->blocks;
+    info->codec = (dsv4l2_codec_t)entry->codec;
+}
+
+/*
+ * Check a block table against the entry; sets *scratch_len to the
+ * largest compressed block
+ */
+static int check_table(const dsv4l2_record_entry_t *entry, const uint32_t *table,
+                       size_t *scratch_len)
+{
+    size_t off = entry->blocks * sizeof(uint32_t);
+    uint32_t i;
+
+    *scratch_len = 0;
+    for (i = 0; i < entry->blocks; i++) {
+        size_t len = table[i] & ~DSV4L2_RECORD_BLOCK_RAW;
+        size_t raw = dsv4l2_record_block_start(entry->raw, entry->blocks, i + 1) -
+                     dsv4l2_record_block_start(entry->raw, entry->blocks, i);
+
+        if (raw == 0 || ((table[i] & DSV4L2_RECORD_BLOCK_RAW) && len != raw)) {
+            return -EBADMSG;
+        }
+        if (!(table[i] & DSV4L2_RECORD_BLOCK_RAW) && len > *scratch_len) {
+            *scratch_len = len;
+        }
+        off += len;
+    }
+
+    return off == entry->stored ? 0 : -EBADMSG;
+}
+
+/* Check that record n's link tag ties its tag to position n */
+static int check_link(dsv4l2_recording_t *rd, uint64_t n, const dsv4l2_record_seal_t *seal)
+{
+    dsv4l2_record_link_aad_t aad;
+    uint8_t none;
+
+    if (seal->counter & DSV4L2_SEAL_LINK) {
+        return -EBADMSG;
+    }
+
+    memset(&aad, 0, sizeof(aad));
+    aad.hdr = rd->hdr;
+    aad.position = n;
+    memcpy(aad.tag, seal->tag, sizeof(aad.tag));
+
+    return dsv4l2_seal_decrypt((dsv4l2_cipher_t)rd->hdr.cipher, rd->key,
+                               DSV4L2_SEAL_LINK | seal->counter, &aad, sizeof(aad),
+                               &none, 0, seal->link);
+}
+
+/* Authenticate, decrypt and decode sealed record n */
+static int read_sealed(dsv4l2_recording_t *rd, uint64_t n, const dsv4l2_record_entry_t *entry,
+                       const dsv4l2_record_seal_t *seal, uint8_t *buf)
+{
+    dsv4l2_record_aad_t aad;
+    const uint32_t *table;
+    const uint8_t *pos;
+    uint8_t *record;
+    size_t unused;
+    uint32_t i;
+    int rc;
+
+    if (!dsv4l2_cipher_available((dsv4l2_cipher_t)rd->hdr.cipher)) {
+        return -ENOTSUP;
+    }
+
+    if (!rd->keyed) {
+        return -ENOKEY;
+    }
+
+    rc = check_link(rd, n, seal);
+    if (rc < 0) {
+        return rc;
+    }
+
+    record = malloc(entry->stored ? entry->stored : 1);
+    if (!record) {
+        return -ENOMEM;
+    }
+
+    rc = pread_all(rd->data_fd, record, entry->stored, entry->offset);
+
+    if (rc == 0) {
+        memset(&aad, 0, sizeof(aad));
+        aad.hdr = rd->hdr;
+        aad.entry = *entry;
+        aad.entry.offset = 0;
+        aad.counter = seal->counter;
+        rc = dsv4l2_seal_decrypt((dsv4l2_cipher_t)rd->hdr.cipher, rd->key, seal->counter,
+                                 &aad, sizeof(aad), record, entry->stored, seal->tag);
+    }
+
+    /* Authenticated from here on, but still check the layout */
+    if (rc == 0 && entry->raw) {
+        table = (const uint32_t *)record;
+        if (entry->blocks == 0 || entry->blocks > DSV4L2_RECORD_MAX_BLOCKS ||
+            entry->stored < entry->blocks * sizeof(uint32_t)) {
+            rc = -EBADMSG;
+        } else {
+            rc = check_table(entry, table, &unused);
+        }
+
+        pos = record + entry->blocks * sizeof(uint32_t);
+        for (i = 0; i < entry->blocks && rc == 0; i++) {
+            size_t len = table[i] & ~DSV4L2_RECORD_BLOCK_RAW;
+            size_t raw_off = dsv4l2_record_block_start(entry->raw, entry->blocks, i);
+            size_t raw = dsv4l2_record_block_start(entry->raw, entry->blocks, i + 1) - raw_off;
+
+            if (table[i] & DSV4L2_RECORD_BLOCK_RAW) {
+                memcpy(buf + raw_off, pos, raw);
+            } else {
+                rc = dsv4l2_codec_decompress((dsv4l2_codec_t)entry->codec, pos, len,
+                                             buf + raw_off, raw);
+            }
+            pos += len;
+        }
+    }
+
+    dsv4l2_seal_wipe(record, entry->stored);
+    free(record);
+    return rc;
+}
+
+/**
+ * Describe frame n without reading it
+ *
+ * @param rd Recording
+ * @param n Frame number
+ * @param info Output
+ * @return 0 on success, -ERANGE past the end, other negative errno on error
+ */
+int dsv4l2_recording_info(dsv4l2_recording_t *rd, uint64_t n,
+                          dsv4l2_record_frame_t *info)
+{
+    dsv4l2_record_entry_t entry;
+    int rc;
+
+    if (!rd || !info) {
+        return -EINVAL;
+    }
+
+    rc = read_entry(rd, n, &entry, NULL);
+    if (rc == 0) {
+        fill_info(&entry, info);
+        info->cipher = (dsv4l2_cipher_t)rd->hdr.cipher;
+    }
+
+    return rc;
+}
+
+/**
+ * Read and decode frame n
+ *
+ * @param rd Recording
+ * @param n Frame number
+ * @param buf Output
+ * @param cap Output capacity
+ * @param info Frame description (optional)
+ * @return Decoded length, or negative errno on error
+ */
+ssize_t dsv4l2_recording_read(dsv4l2_recording_t *rd, uint64_t n, uint8_t *buf,
+                              size_t cap, dsv4l2_record_frame_t *info)
+{
+    dsv4l2_record_entry_t entry;
+    dsv4l2_record_seal_t seal;
+    uint32_t table[DSV4L2_RECORD_MAX_BLOCKS];
+    uint8_t *scratch = NULL;
+    size_t scratch_len = 0, table_len;
+    uint64_t pos;
+    uint32_t i;
+    int rc;
+
+    if (!rd || (!buf && cap)) {
+        return -EINVAL;
+    }
+
+    rc = read_entry(rd, n, &entry, &seal);
+    if (rc < 0) {
+        return rc;
+    }
+
+    if (info) {
+        fill_info(&entry, info);
+        info->cipher = (dsv4l2_cipher_t)rd->hdr.cipher;
+    }
+
+    if (entry.raw > cap) {
+        return -ENOSPC;
+    }
+
+    if (rd->hdr.cipher != DSV4L2_CIPHER_NONE) {
+        rc = read_sealed(rd, n, &entry, &seal, buf);
+        return rc < 0 ? rc : (ssize_t)entry.raw;
+    }
+
+    if (entry.raw == 0) {
+        return 0;
+    }
+
+    if (entry.blocks == 0 || entry.blocks > DSV4L2_RECORD_MAX_BLOCKS) {
+        return -EBADMSG;
+    }
+
+    table_len = entry.blocks * sizeof(uint32_t);
+    if (entry.stored < table_len) {
+        return -EBADMSG;
+    }
+
+    rc = pread_all(rd->data_fd, table, table_len, entry.offset);
+    if (rc < 0) {
+        return rc;
+    }
+
+    /* Validate the table before touching any block */
+    rc = check_table(&entry, table, &scratch_len);
+    if (rc < 0) {
+        return rc;
+    }
+
+    if (scratch_len) {
+        scratch = malloc(scratch_len);
+        if (!scratch) {
+            return -ENOMEM;
+        }
+    }
+
+    pos = entry.offset + table_len;
+    for (i = 0; i < entry.blocks && rc == 0; i++) {
+        size_t len = table[i] & ~DSV4L2_RECORD_BLOCK_RAW;
+        size_t raw_off = dsv4l2_record_block_start(entry.raw, entry.blocks, i);
+        size_t raw = dsv4l2_record_block_start(entry.raw, entry.blocks, i + 1) - raw_off;
+
+        if (table[i] & DSV4L2_RECORD_BLOCK_RAW) {
+            rc = pread_all(rd->data_fd, buf + raw_off, raw, pos);
+        } else {
+            rc = pread_all(rd->data_fd, scratch, len, pos);
+            if (rc == 0) {
+                rc = dsv4l2_codec_decompress((dsv4l2_codec_t)entry.codec, scratch, len,
+                                             buf + raw_off, raw);
+            }
+        }
+
+        pos += len;
+    }
+
+    free(scratch);
+    return rc < 0 ? rc : (ssize_t)entry.raw;
+}
+
+/**
+ * Close a recording
+ *
+ * @param rd Recording
+ */
+void dsv4l2_recording_close(dsv4l2_recording_t *rd)
+{
+    if (!rd) {
+        return;
+    }
+
+    close(rd->index_fd);
+    close(rd->data_fd);
+    dsv4l2_seal_wipe(rd->key, sizeof(rd->key));
+    free(rd);
+}
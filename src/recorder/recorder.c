@@ -0,0 +1,713 @@
+/*
+ * DSV4L2 Recorder - Compression and Writer Stages
+ *
+ * The compression stage runs on several pipeline workers (ordered), so
+ * frames reach the single writer in capture order and the data file
+ * and index are only ever appended by one thread at a time.
+ *
+ * When encrypting, the same stage seals each record after compressing
+ * it, so encryption scales with the workers. Nonces come from a
+ * recorder-wide frame counter rather than the driver sequence, which
+ * restarts with every stream and must never repeat under one key.
+ * Counters follow the order sealing starts, not the index order, so
+ * the writer links each record to its index position and close seals
+ * the frame count.
+ */
+
+#include "recorder_internal.h"
+#include "dsv4l2rt.h"
+#include "../dsv4l2_internal.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <unistd.h>
+#include <errno.h>
+
+/* Workers used when the config leaves it to us */
+#define RECORDER_MAX_WORKERS 16
+
+/* Frames between level changes, so the cost average can settle */
+#define LEVEL_SETTLE_FRAMES 16
+
+/* Compressed (and possibly sealed) frame handed to the writer */
+typedef struct {
+    uint32_t raw;
+    uint32_t stored;             /* Bytes of data[] used */
+    uint16_t blocks;
+    uint8_t  level;
+    uint8_t  codec;
+    dsv4l2_record_seal_t seal;   /* Encrypted recordings */
+    uint8_t  data[];             /* Block table, then blocks */
+} compressed_frame_t;
+
+struct dsv4l2_recorder {
+    dsv4l2_recorder_config_t cfg;
+    dsv4l2_record_header_t hdr;
+    int       data_fd;
+    int       index_fd;
+    size_t    index_base;        /* First index record */
+    size_t    index_record;      /* Bytes per index record */
+    uint64_t  offset;            /* Data file append position */
+    uint64_t  indexed;           /* Index records written */
+    uint64_t  budget_ns;         /* Compression time one frame may take */
+    int       level;             /* Current level (atomic) */
+    uint64_t  counter;           /* Next frame nonce (atomic) */
+    uint8_t   key[DSV4L2_RECORD_KEY_SIZE];   /* Recording key */
+    dsv4l2_record_crypto_t crypto;           /* Encrypted recordings */
+
+    pthread_mutex_t write_lock;  /* Data file and index appends */
+    pthread_mutex_t lock;        /* Level controller and stats */
+    uint32_t  since_change;
+    dsv4l2_recorder_stats_t stats;
+};
+
+static int pwrite_all(int fd, const void *buf, size_t len, uint64_t off)
+{
+    const uint8_t *p = buf;
+
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, (off_t)off);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        p += n;
+        len -= (size_t)n;
+        off += (uint64_t)n;
+    }
+
+    return 0;
+}
+
+/**
+ * Create a recording
+ *
+ * @param cfg Configuration
+ * @param out Recorder
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_recorder_create(const dsv4l2_recorder_config_t *cfg,
+                           dsv4l2_recorder_t **out)
+{
+    dsv4l2_recorder_t *rec;
+    char index_path[PATH_MAX];
+    int min, max, def;
+    long cpus;
+    int rc;
+
+    if (!cfg || !cfg->path || !out || cfg->blocks > DSV4L2_RECORD_MAX_BLOCKS ||
+        (cfg->cipher != DSV4L2_CIPHER_NONE && !cfg->key)) {
+        return -EINVAL;
+    }
+
+    if (!dsv4l2_codec_available(cfg->codec) || !dsv4l2_cipher_available(cfg->cipher)) {
+        return -ENOTSUP;
+    }
+
+    if (snprintf(index_path, sizeof(index_path), "%s.idx", cfg->path) >=
+        (int)sizeof(index_path)) {
+        return -ENAMETOOLONG;
+    }
+
+    rec = calloc(1, sizeof(*rec));
+    if (!rec) {
+        return -ENOMEM;
+    }
+
+    rec->cfg = *cfg;
+    rec->cfg.path = NULL;
+    rec->cfg.key = NULL;
+    rec->data_fd = rec->index_fd = -1;
+    if (!rec->cfg.blocks) rec->cfg.blocks = 1;
+    if (!rec->cfg.fps)    rec->cfg.fps = 30;
+
+    if (!rec->cfg.workers) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        rec->cfg.workers = cpus < 1 ? 1 :
+                           cpus > RECORDER_MAX_WORKERS ? RECORDER_MAX_WORKERS : (uint32_t)cpus;
+    }
+
+    dsv4l2_codec_levels(cfg->codec, &min, &max, &def);
+    if (rec->cfg.level_min < min || rec->cfg.level_min > max) rec->cfg.level_min = min;
+    if (!rec->cfg.level_max || rec->cfg.level_max > max) rec->cfg.level_max = max;
+    if (rec->cfg.level_max < rec->cfg.level_min) rec->cfg.level_max = rec->cfg.level_min;
+    if (!rec->cfg.level) rec->cfg.level = def;
+    if (rec->cfg.level < rec->cfg.level_min) rec->cfg.level = rec->cfg.level_min;
+    if (rec->cfg.level > rec->cfg.level_max) rec->cfg.level = rec->cfg.level_max;
+
+    rec->level = rec->cfg.level;
+    rec->stats.level = rec->level;
+
+    /* Each worker has workers frame intervals for its frame */
+    rec->budget_ns = 1000000000ULL / rec->cfg.fps * rec->cfg.workers;
+
+    memset(&rec->hdr, 0, sizeof(rec->hdr));
+    memcpy(rec->hdr.magic, DSV4L2_RECORD_MAGIC, sizeof(rec->hdr.magic));
+    rec->hdr.version = DSV4L2_RECORD_VERSION;
+    rec->hdr.width = cfg->width;
+    rec->hdr.height = cfg->height;
+    rec->hdr.pixelformat = cfg->pixelformat;
+    rec->hdr.codec = (uint32_t)cfg->codec;
+    rec->hdr.cipher = (uint32_t)cfg->cipher;
+
+    rec->index_base = sizeof(rec->hdr);
+    rec->index_record = sizeof(dsv4l2_record_entry_t);
+
+    /* Fresh recording key, plus a tag over the header to detect a wrong key */
+    if (cfg->cipher != DSV4L2_CIPHER_NONE) {
+        if (getrandom(rec->crypto.salt, sizeof(rec->crypto.salt), 0) !=
+            (ssize_t)sizeof(rec->crypto.salt)) {
+            rc = -EIO;
+            goto fail;
+        }
+        rc = dsv4l2_seal_derive(cfg->key, rec->crypto.salt, rec->key);
+        if (rc == 0) {
+            rc = dsv4l2_seal_encrypt(cfg->cipher, rec->key, DSV4L2_SEAL_CHECK_COUNTER,
+                                     &rec->hdr, sizeof(rec->hdr), NULL, 0, NULL, 0,
+                                     NULL, rec->crypto.check);
+        }
+        if (rc < 0) {
+            goto fail;
+        }
+
+        rec->index_base += sizeof(rec->crypto);
+        rec->index_record += sizeof(dsv4l2_record_seal_t);
+    }
+
+    rec->data_fd = open(cfg->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (rec->data_fd < 0) {
+        rc = -errno;
+        goto fail;
+    }
+
+    rec->index_fd = open(index_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (rec->index_fd < 0) {
+        rc = -errno;
+        goto fail;
+    }
+
+    rc = pwrite_all(rec->index_fd, &rec->hdr, sizeof(rec->hdr), 0);
+    if (rc == 0 && cfg->cipher != DSV4L2_CIPHER_NONE) {
+        rc = pwrite_all(rec->index_fd, &rec->crypto, sizeof(rec->crypto), sizeof(rec->hdr));
+    }
+    if (rc < 0) {
+        goto fail;
+    }
+
+    pthread_mutex_init(&rec->write_lock, NULL);
+    pthread_mutex_init(&rec->lock, NULL);
+
+    *out = rec;
+    return 0;
+
+fail:
+    if (rec->index_fd >= 0) close(rec->index_fd);
+    if (rec->data_fd >= 0) close(rec->data_fd);
+    dsv4l2_seal_wipe(rec->key, sizeof(rec->key));
+    free(rec);
+    return rc;
+}
+
+/**
+ * Append the compression and writer stages to a pipeline
+ *
+ * @param rec Recorder
+ * @param p Pipeline (not yet started)
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_recorder_add_stages(dsv4l2_recorder_t *rec, dsv4l2_pipeline_t *p)
+{
+    dsv4l2_stage_config_t stage;
+    int rc;
+
+    if (!rec || !p) {
+        return -EINVAL;
+    }
+
+    if (rec->cfg.codec != DSV4L2_CODEC_NONE || rec->cfg.cipher != DSV4L2_CIPHER_NONE) {
+        memset(&stage, 0, sizeof(stage));
+        stage.name = "record_compress";
+        stage.fn = dsv4l2_recorder_compress_stage;
+        stage.ctx = rec;
+        stage.parallelism = rec->cfg.workers;
+        stage.queue_depth = rec->cfg.workers * 2;
+        stage.ordered = 1;
+
+        rc = dsv4l2_pipeline_add_stage(p, &stage);
+        if (rc < 0) {
+            return rc;
+        }
+    }
+
+    memset(&stage, 0, sizeof(stage));
+    stage.name = "record_write";
+    stage.fn = dsv4l2_recorder_write_stage;
+    stage.ctx = rec;
+    stage.parallelism = 1;
+
+    return dsv4l2_pipeline_add_stage(p, &stage);
+}
+
+/**
+ * Feed one frame's compression time to the level controller
+ *
+ * Lowers the level when the smoothed cost nears the budget and raises
+ * it when there is plenty of headroom.
+ */
+static void adapt_level(dsv4l2_recorder_t *rec, uint64_t ns)
+{
+    dsv4l2_recorder_stats_t *s = &rec->stats;
+
+    pthread_mutex_lock(&rec->lock);
+
+    s->compress_ns = s->compress_ns ? (s->compress_ns * 7 + ns) / 8 : ns;
+
+    if (++rec->since_change >= LEVEL_SETTLE_FRAMES) {
+        if (s->compress_ns > rec->budget_ns * 3 / 4 && s->level > rec->cfg.level_min) {
+            s->level--;
+            s->level_downs++;
+            rec->since_change = 0;
+        } else if (s->compress_ns < rec->budget_ns * 3 / 8 && s->level < rec->cfg.level_max) {
+            s->level++;
+            s->level_ups++;
+            rec->since_change = 0;
+        }
+        __atomic_store_n(&rec->level, s->level, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&rec->lock);
+}
+
+/* Index entry for a frame (offset is the writer's) */
+static void frame_entry(const dsv4l2_lease_t *lease, const compressed_frame_t *cf,
+                        dsv4l2_record_entry_t *entry)
+{
+    memset(entry, 0, sizeof(*entry));
+    entry->raw = (uint32_t)lease->len;
+    entry->timestamp_ns = lease->timestamp_ns;
+    entry->sequence = lease->sequence;
+    entry->stored = cf->stored;
+    entry->codec = cf->codec;
+    entry->level = cf->level;
+    entry->blocks = cf->blocks;
+}
+
+/* Compress lease data into blocks; NULL on allocation failure */
+static compressed_frame_t *compress_frame(dsv4l2_recorder_t *rec, const dsv4l2_lease_t *lease)
+{
+    compressed_frame_t *cf;
+    uint32_t *table;
+    uint8_t *out;
+    size_t cap;
+    uint32_t blocks, i;
+    uint64_t t0;
+    int level;
+
+    t0 = dsv4l2_now_ns();
+    level = __atomic_load_n(&rec->level, __ATOMIC_RELAXED);
+
+    blocks = dsv4l2_record_blocks(lease->len, rec->cfg.blocks);
+
+    cap = blocks * sizeof(uint32_t);
+    for (i = 0; i < blocks; i++) {
+        cap += dsv4l2_codec_bound(rec->cfg.codec,
+                                  dsv4l2_record_block_start(lease->len, blocks, i + 1) -
+                                  dsv4l2_record_block_start(lease->len, blocks, i));
+    }
+
+    cf = calloc(1, sizeof(*cf) + cap);
+    if (!cf) {
+        return NULL;
+    }
+
+    DSV4L2_TRACE_BEGIN("record_compress");
+
+    table = (uint32_t *)cf->data;
+    out = cf->data + blocks * sizeof(uint32_t);
+
+    for (i = 0; i < blocks; i++) {
+        size_t off = dsv4l2_record_block_start(lease->len, blocks, i);
+        size_t len = dsv4l2_record_block_start(lease->len, blocks, i + 1) - off;
+        const uint8_t *src = lease->data + off;
+        ssize_t n;
+
+        n = dsv4l2_codec_compress(rec->cfg.codec, level, src, len, out,
+                                  dsv4l2_codec_bound(rec->cfg.codec, len));
+
+        if (n <= 0 || (size_t)n >= len) {
+            /* Incompressible (or codec failure): keep the block raw */
+            memcpy(out, src, len);
+            table[i] = (uint32_t)len | DSV4L2_RECORD_BLOCK_RAW;
+            n = (ssize_t)len;
+        } else {
+            table[i] = (uint32_t)n;
+        }
+
+        out += n;
+    }
+
+    cf->raw = (uint32_t)lease->len;
+    cf->stored = (uint32_t)(out - cf->data);
+    cf->blocks = (uint16_t)blocks;
+    cf->level = (uint8_t)level;
+    cf->codec = (uint8_t)rec->cfg.codec;
+
+    DSV4L2_TRACE_END("record_compress");
+
+    adapt_level(rec, dsv4l2_now_ns() - t0);
+
+    return cf;
+}
+
+/*
+ * Encrypt a record: the compressed record in place, or for
+ * uncompressed recordings a raw block table plus the frame straight
+ * from the lease (so the plaintext is never copied)
+ */
+static compressed_frame_t *seal_frame(dsv4l2_recorder_t *rec, const dsv4l2_lease_t *lease,
+                                      compressed_frame_t *cf, int *rc)
+{
+    dsv4l2_record_aad_t aad;
+    uint32_t table = 0;
+    const uint8_t *head = NULL, *body;
+    size_t head_len = 0, body_len;
+
+    if (!cf) {
+        cf = calloc(1, sizeof(*cf) + (lease->len ? sizeof(table) + lease->len : 0));
+        if (!cf) {
+            *rc = -ENOMEM;
+            return NULL;
+        }
+        if (lease->len) {
+            table = (uint32_t)lease->len | DSV4L2_RECORD_BLOCK_RAW;
+            head = (const uint8_t *)&table;
+            head_len = sizeof(table);
+            cf->stored = (uint32_t)(sizeof(table) + lease->len);
+            cf->blocks = 1;
+        }
+        cf->raw = (uint32_t)lease->len;
+        cf->codec = DSV4L2_CODEC_NONE;
+        body = lease->data;
+        body_len = lease->len;
+    } else {
+        body = cf->data;
+        body_len = cf->stored;
+    }
+
+    cf->seal.counter = __atomic_fetch_add(&rec->counter, 1, __ATOMIC_RELAXED);
+
+    memset(&aad, 0, sizeof(aad));
+    aad.hdr = rec->hdr;
+    frame_entry(lease, cf, &aad.entry);
+    aad.counter = cf->seal.counter;
+
+    DSV4L2_TRACE_BEGIN("record_seal");
+    *rc = dsv4l2_seal_encrypt(rec->cfg.cipher, rec->key, cf->seal.counter, &aad, sizeof(aad),
+                              head, head_len, body, body_len, cf->data, cf->seal.tag);
+    DSV4L2_TRACE_END("record_seal");
+
+    if (*rc < 0) {
+        free(cf);
+        return NULL;
+    }
+
+    return cf;
+}
+
+/**
+ * Compression (and encryption) stage
+ *
+ * @param lease Frame
+ * @param ctx Recorder
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_recorder_compress_stage(dsv4l2_lease_t *lease, void *ctx)
+{
+    dsv4l2_recorder_t *rec = ctx;
+    compressed_frame_t *cf = NULL;
+    int rc = 0;
+
+    if (!lease || !rec) {
+        return -EINVAL;
+    }
+
+    if (lease->len > UINT32_MAX / 2) {
+        return -EFBIG;
+    }
+
+    if (rec->cfg.codec != DSV4L2_CODEC_NONE && lease->len > 0) {
+        cf = compress_frame(rec, lease);
+        if (!cf) {
+            return -ENOMEM;
+        }
+    }
+
+    if (rec->cfg.cipher != DSV4L2_CIPHER_NONE) {
+        cf = seal_frame(rec, lease, cf, &rc);
+        if (!cf) {
+            return rc;
+        }
+    }
+
+    if (!cf) {
+        return 0;
+    }
+
+    rc = dsv4l2_lease_attach(lease, DSV4L2_SLOT_COMPRESSED, cf, free);
+    if (rc < 0) {
+        free(cf);
+    }
+
+    return rc;
+}
+
+/* Tag binding a sealed record to its index position */
+static int link_record(dsv4l2_recorder_t *rec, uint64_t position, dsv4l2_record_seal_t *seal)
+{
+    dsv4l2_record_link_aad_t aad;
+
+    memset(&aad, 0, sizeof(aad));
+    aad.hdr = rec->hdr;
+    aad.position = position;
+    memcpy(aad.tag, seal->tag, sizeof(aad.tag));
+
+    return dsv4l2_seal_encrypt(rec->cfg.cipher, rec->key, DSV4L2_SEAL_LINK | seal->counter,
+                               &aad, sizeof(aad), NULL, 0, NULL, 0, NULL, seal->link);
+}
+
+/**
+ * Writer stage
+ *
+ * @param lease Frame
+ * @param ctx Recorder
+ * @return 0 on success, -EACCES for an unsealed frame of an encrypted
+ *         recording, other negative errno on error
+ */
+int dsv4l2_recorder_write_stage(dsv4l2_lease_t *lease, void *ctx)
+{
+    dsv4l2_recorder_t *rec = ctx;
+    compressed_frame_t *cf;
+    struct {
+        dsv4l2_record_entry_t entry;
+        dsv4l2_record_seal_t  seal;
+    } record;
+    dsv4l2_record_entry_t *entry = &record.entry;
+    uint32_t table;
+    int rc;
+
+    if (!lease || !rec) {
+        return -EINVAL;
+    }
+
+    if (lease->len > UINT32_MAX / 2) {
+        return -EFBIG;
+    }
+
+    cf = dsv4l2_lease_get(lease, DSV4L2_SLOT_COMPRESSED);
+    if (rec->cfg.cipher != DSV4L2_CIPHER_NONE && !cf) {
+        /* Never store a frame of an encrypted recording in the clear */
+        rc = -EACCES;
+        goto out_stats;
+    }
+
+    pthread_mutex_lock(&rec->write_lock);
+
+    if (cf) {
+        frame_entry(lease, cf, entry);
+        entry->offset = rec->offset;
+        record.seal = cf->seal;
+        rc = 0;
+        if (rec->cfg.cipher != DSV4L2_CIPHER_NONE) {
+            rc = link_record(rec, rec->indexed, &record.seal);
+        }
+        if (rc == 0) {
+            rc = pwrite_all(rec->data_fd, cf->data, cf->stored, rec->offset);
+        }
+    } else {
+        /* Uncompressed: one raw block */
+        memset(entry, 0, sizeof(*entry));
+        entry->offset = rec->offset;
+        entry->raw = (uint32_t)lease->len;
+        entry->timestamp_ns = lease->timestamp_ns;
+        entry->sequence = lease->sequence;
+        table = (uint32_t)lease->len | DSV4L2_RECORD_BLOCK_RAW;
+        entry->stored = lease->len ? (uint32_t)(sizeof(table) + lease->len) : 0;
+        entry->codec = DSV4L2_CODEC_NONE;
+        entry->blocks = lease->len ? 1 : 0;
+        rc = 0;
+        if (lease->len) {
+            rc = pwrite_all(rec->data_fd, &table, sizeof(table), rec->offset);
+            if (rc == 0) {
+                rc = pwrite_all(rec->data_fd, lease->data, lease->len,
+                                rec->offset + sizeof(table));
+            }
+        }
+    }
+
+    /* Data before index: an index entry never points past the data */
+    if (rc == 0) {
+        rc = pwrite_all(rec->index_fd, &record, rec->index_record,
+                        rec->index_base + rec->indexed * rec->index_record);
+    }
+    if (rc == 0) {
+        rec->offset += entry->stored;
+        rec->indexed++;
+    }
+
+    pthread_mutex_unlock(&rec->write_lock);
+
+out_stats:
+    pthread_mutex_lock(&rec->lock);
+    if (rc < 0) {
+        rec->stats.errors++;
+    } else {
+        rec->stats.frames++;
+        rec->stats.raw_bytes += entry->raw;
+        rec->stats.stored_bytes += entry->stored;
+    }
+    pthread_mutex_unlock(&rec->lock);
+
+    return rc;
+}
+
+/**
+ * Encrypt and store one frame outside a pipeline
+ *
+ * @param rec Encrypting recorder
+ * @param buf Frame
+ * @param len Frame bytes
+ * @param sequence Frame sequence to record
+ * @param timestamp_ns Capture time to record
+ * @return 0 on success, -EPERM if the recorder does not encrypt,
+ *         other negative errno on error
+ */
+int dsv4l2_store_encrypted(dsv4l2_recorder_t *rec, const void *buf, size_t len,
+                           uint32_t sequence, uint64_t timestamp_ns)
+{
+    dsv4l2_lease_t *lease;
+    int rc;
+
+    if (!rec || (!buf && len)) {
+        return -EINVAL;
+    }
+
+    if (rec->cfg.cipher == DSV4L2_CIPHER_NONE) {
+        return -EPERM;
+    }
+
+    /* The stages only read lease data */
+    rc = dsv4l2_lease_wrap((uint8_t *)(uintptr_t)buf, len, NULL, &lease);
+    if (rc < 0) {
+        return rc;
+    }
+
+    lease->sequence = sequence;
+    lease->timestamp_ns = timestamp_ns;
+
+    rc = dsv4l2_recorder_compress_stage(lease, rec);
+    if (rc == 0) {
+        rc = dsv4l2_recorder_write_stage(lease, rec);
+    }
+
+    dsv4l2_lease_release(lease);
+    return rc;
+}
+
+/**
+ * write(2)-style encrypted store
+ *
+ * @param rec Encrypting recorder
+ * @param buf Frame
+ * @param len Frame bytes
+ * @return len on success, negative errno on error
+ */
+ssize_t dsv4l2_encrypted_write(dsv4l2_recorder_t *rec, const void *buf, size_t len)
+{
+    uint32_t sequence;
+    int rc;
+
+    if (!rec) {
+        return -EINVAL;
+    }
+
+    if (len > SSIZE_MAX) {
+        return -EFBIG;
+    }
+
+    sequence = (uint32_t)__atomic_load_n(&rec->counter, __ATOMIC_RELAXED);
+    rc = dsv4l2_store_encrypted(rec, buf, len, sequence, dsv4l2_now_ns());
+
+    return rc < 0 ? rc : (ssize_t)len;
+}
+
+/**
+ * Snapshot metrics
+ *
+ * @param rec Recorder
+ * @param stats Output
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_recorder_get_stats(dsv4l2_recorder_t *rec, dsv4l2_recorder_stats_t *stats)
+{
+    if (!rec || !stats) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&rec->lock);
+    *stats = rec->stats;
+    pthread_mutex_unlock(&rec->lock);
+
+    return 0;
+}
+
+/**
+ * Flush to disk and free the recorder
+ *
+ * @param rec Recorder
+ * @return 0 on success, negative errno if the final sync failed
+ */
+int dsv4l2_recorder_close(dsv4l2_recorder_t *rec)
+{
+    dsv4l2_record_count_aad_t aad;
+    int rc = 0;
+
+    if (!rec) {
+        return -EINVAL;
+    }
+
+    /* Seal the frame count, so a truncated index is detected */
+    if (rec->cfg.cipher != DSV4L2_CIPHER_NONE) {
+        memset(&aad, 0, sizeof(aad));
+        aad.hdr = rec->hdr;
+        aad.frames = rec->indexed;
+        rec->crypto.frames = rec->indexed;
+        rc = dsv4l2_seal_encrypt(rec->cfg.cipher, rec->key, DSV4L2_SEAL_COUNT_COUNTER,
+                                 &aad, sizeof(aad), NULL, 0, NULL, 0, NULL,
+                                 rec->crypto.count_tag);
+        if (rc == 0) {
+            rc = pwrite_all(rec->index_fd, &rec->crypto, sizeof(rec->crypto),
+                            sizeof(rec->hdr));
+        }
+    }
+
+    if ((fsync(rec->data_fd) < 0 || fsync(rec->index_fd) < 0) && rc == 0) {
+        rc = -errno;
+    }
+
+    close(rec->index_fd);
+    close(rec->data_fd);
+    pthread_mutex_destroy(&rec->write_lock);
+    pthread_mutex_destroy(&rec->lock);
+    dsv4l2_seal_wipe(rec->key, sizeof(rec->key));
+    free(rec);
+
+    return rc;
+}
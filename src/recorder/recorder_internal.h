@@ -0,0 +1,198 @@
+/*
+ * DSV4L2 Recorder - On-Disk Format and Codec Helpers
+ *
+ * Index file (path + ".idx"):
+ *   dsv4l2_record_header_t, then one dsv4l2_record_entry_t per frame.
+ *
+ * Data file (path): frame records back to back. A record is a table
+ * of `blocks` uint32 stored block lengths followed by the blocks. Bit
+ * 31 of a length marks a block stored raw. Block i decodes to bytes
+ * [dsv4l2_record_block_start(raw, blocks, i),
+ *  dsv4l2_record_block_start(raw, blocks, i + 1)) of the frame.
+ *
+ * Encrypted recordings (header cipher != 0) have a
+ * dsv4l2_record_crypto_t after the header and a dsv4l2_record_seal_t
+ * after every entry. Each record is encrypted whole; the additional
+ * data binds it to the header and its entry (offset excluded). Records
+ * are sealed in parallel, before their index position is known, so
+ * the writer adds a link tag binding the record's tag to its position,
+ * and close seals the final frame count into the crypto header: a
+ * swapped, dropped or truncated record fails authentication.
+ */
+
+#ifndef DSV4L2_RECORDER_INTERNAL_H
+#define DSV4L2_RECORDER_INTERNAL_H
+
+#include "dsv4l2_recorder.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DSV4L2_RECORD_MAGIC   "DSV4IDX1"
+#define DSV4L2_RECORD_VERSION 1
+
+/* Block table flag: stored uncompressed */
+#define DSV4L2_RECORD_BLOCK_RAW 0x80000000u
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelformat;
+    uint32_t codec;
+    uint32_t cipher;             /* dsv4l2_cipher_t (0 in plain recordings) */
+} dsv4l2_record_header_t;
+
+typedef struct {
+    uint64_t offset;             /* Record start in the data file */
+    uint32_t stored;             /* Record length, block table included */
+    uint32_t raw;                /* Decoded frame length */
+    uint64_t timestamp_ns;
+    uint32_t sequence;
+    uint8_t  codec;
+    uint8_t  level;
+    uint16_t blocks;
+} dsv4l2_record_entry_t;
+
+#define DSV4L2_SEAL_SALT_SIZE  16
+#define DSV4L2_SEAL_NONCE_SIZE 12
+#define DSV4L2_SEAL_TAG_SIZE   16
+
+/*
+ * Nonce counters: frames count up from 0, a frame's link tag uses its
+ * counter with DSV4L2_SEAL_LINK set, and the two header tags sit at
+ * the top of the range
+ */
+#define DSV4L2_SEAL_CHECK_COUNTER UINT64_MAX
+#define DSV4L2_SEAL_COUNT_COUNTER (UINT64_MAX - 1)
+#define DSV4L2_SEAL_LINK          (1ULL << 63)
+
+typedef struct {
+    uint8_t  salt[DSV4L2_SEAL_SALT_SIZE];    /* HKDF salt of the recording key */
+    uint8_t  check[DSV4L2_SEAL_TAG_SIZE];    /* Tag over the headers: wrong-key check */
+    uint64_t frames;                         /* Final frame count (0 until closed) */
+    uint8_t  count_tag[DSV4L2_SEAL_TAG_SIZE];
+    uint64_t reserved;
+} dsv4l2_record_crypto_t;
+
+typedef struct {
+    uint64_t counter;            /* Frame nonce counter */
+    uint8_t  tag[DSV4L2_SEAL_TAG_SIZE];
+    uint8_t  link[DSV4L2_SEAL_TAG_SIZE];     /* Tag over position and tag */
+} dsv4l2_record_seal_t;
+
+/* Additional authenticated data of a sealed record */
+typedef struct {
+    dsv4l2_record_header_t hdr;
+    dsv4l2_record_entry_t  entry;            /* offset = 0 */
+    uint64_t counter;
+} dsv4l2_record_aad_t;
+
+/* Additional authenticated data of a link tag */
+typedef struct {
+    dsv4l2_record_header_t hdr;
+    uint64_t position;                       /* Index record number */
+    uint8_t  tag[DSV4L2_SEAL_TAG_SIZE];      /* The record's tag */
+} dsv4l2_record_link_aad_t;
+
+/* Additional authenticated data of the frame count tag */
+typedef struct {
+    dsv4l2_record_header_t hdr;
+    uint64_t frames;
+} dsv4l2_record_count_aad_t;
+
+_Static_assert(sizeof(dsv4l2_record_header_t) == 32, "record header layout");
+_Static_assert(sizeof(dsv4l2_record_entry_t) == 32, "record entry layout");
+_Static_assert(sizeof(dsv4l2_record_crypto_t) == 64, "record crypto header layout");
+_Static_assert(sizeof(dsv4l2_record_seal_t) == 40, "record seal layout");
+_Static_assert(sizeof(dsv4l2_record_aad_t) == 72, "record aad layout");
+_Static_assert(sizeof(dsv4l2_record_link_aad_t) == 56, "record link aad layout");
+_Static_assert(sizeof(dsv4l2_record_count_aad_t) == 40, "record count aad layout");
+
+/**
+ * Blocks to split a raw frame into (each at least 64 bytes)
+ */
+static inline uint32_t dsv4l2_record_blocks(size_t raw, uint32_t wanted)
+{
+    size_t most = raw / 64 ? raw / 64 : 1;
+
+    return wanted < most ? wanted : (uint32_t)most;
+}
+
+/**
+ * Frame offset where block i starts (i == blocks gives raw)
+ *
+ * Boundaries are cache-line aligned; with blocks from
+ * dsv4l2_record_blocks() no block is empty.
+ */
+static inline size_t dsv4l2_record_block_start(size_t raw, uint32_t blocks, uint32_t i)
+{
+    if (i >= blocks) {
+        return raw;
+    }
+
+    return (size_t)((uint64_t)raw * i / blocks) & ~(size_t)63;
+}
+
+/**
+ * Worst-case compressed size of len bytes
+ */
+size_t dsv4l2_codec_bound(dsv4l2_codec_t codec, size_t len);
+
+/**
+ * Compress one block
+ *
+ * @return Compressed length, or negative errno (e.g. output too small)
+ */
+ssize_t dsv4l2_codec_compress(dsv4l2_codec_t codec, int level, const uint8_t *src,
+                              size_t len, uint8_t *dst, size_t cap);
+
+/**
+ * Decompress one block into exactly raw bytes
+ *
+ * @return 0 on success, -EBADMSG if the block is corrupt
+ */
+int dsv4l2_codec_decompress(dsv4l2_codec_t codec, const uint8_t *src, size_t len,
+                            uint8_t *dst, size_t raw);
+
+/**
+ * Codec level range and default
+ */
+void dsv4l2_codec_levels(dsv4l2_codec_t codec, int *min, int *max, int *def);
+
+/**
+ * Derive a recording key: HKDF-SHA256(master, salt)
+ *
+ * @return 0 on success, -ENOTSUP without OpenSSL, -EIO on failure
+ */
+int dsv4l2_seal_derive(const uint8_t *master, const uint8_t *salt, uint8_t *key);
+
+/**
+ * Encrypt head then body into dst and produce the tag
+ *
+ * dst may equal body when head is empty.
+ *
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_seal_encrypt(dsv4l2_cipher_t cipher, const uint8_t *key, uint64_t counter,
+                        const void *aad, size_t aad_len,
+                        const uint8_t *head, size_t head_len,
+                        const uint8_t *body, size_t body_len,
+                        uint8_t *dst, uint8_t *tag);
+
+/**
+ * Decrypt in place and check the tag (buf is wiped on failure)
+ *
+ * @return 0 on success, -EBADMSG if authentication fails
+ */
+int dsv4l2_seal_decrypt(dsv4l2_cipher_t cipher, const uint8_t *key, uint64_t counter,
+                        const void *aad, size_t aad_len,
+                        uint8_t *buf, size_t len, const uint8_t *tag);
+
+/**
+ * Wipe key material
+ */
+void dsv4l2_seal_wipe(void *buf, size_t len);
+
+#endif /* DSV4L2_RECORDER_INTERNAL_H */
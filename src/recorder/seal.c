@@ -0,0 +1,252 @@
+/*
+ * DSV4L2 Recorder - Frame Sealing
+ *
+ * Authenticated encryption of frame records with OpenSSL EVP
+ * (HAVE_OPENSSL). EVP picks the AES-NI / VAES / CLMUL code paths on
+ * its own; cipher contexts are per thread so pipeline workers never
+ * share one.
+ *
+ * Each recording encrypts under its own key, HKDF-SHA256 of the
+ * caller's key and a random salt, so the per-frame nonce (four zero
+ * bytes and a big-endian frame counter) never repeats under one key.
+ */
+
+#include "recorder_internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
+#ifdef HAVE_OPENSSL
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#endif
+
+#define SEAL_INFO "dsv4l2 recording key v1"
+
+#ifdef HAVE_OPENSSL
+static pthread_key_t evp_key;
+static pthread_once_t evp_once = PTHREAD_ONCE_INIT;
+
+static void evp_free_ctx(void *ctx)
+{
+    EVP_CIPHER_CTX_free(ctx);
+}
+
+static void evp_key_init(void)
+{
+    pthread_key_create(&evp_key, evp_free_ctx);
+}
+
+static EVP_CIPHER_CTX *evp_thread_ctx(void)
+{
+    EVP_CIPHER_CTX *ctx;
+
+    pthread_once(&evp_once, evp_key_init);
+    ctx = pthread_getspecific(evp_key);
+    if (!ctx) {
+        ctx = EVP_CIPHER_CTX_new();
+        if (ctx) {
+            pthread_setspecific(evp_key, ctx);
+        }
+    }
+
+    return ctx;
+}
+
+static const EVP_CIPHER *evp_cipher(dsv4l2_cipher_t cipher)
+{
+    switch (cipher) {
+        case DSV4L2_CIPHER_AES_256_GCM:       return EVP_aes_256_gcm();
+        case DSV4L2_CIPHER_CHACHA20_POLY1305: return EVP_chacha20_poly1305();
+        default:                              return NULL;
+    }
+}
+
+static void make_nonce(uint64_t counter, uint8_t nonce[DSV4L2_SEAL_NONCE_SIZE])
+{
+    int i;
+
+    memset(nonce, 0, 4);
+    for (i = 0; i < 8; i++) {
+        nonce[4 + i] = (uint8_t)(counter >> (56 - 8 * i));
+    }
+}
+
+/* Set up ctx for one record; enc = 1 to encrypt */
+static EVP_CIPHER_CTX *seal_begin(dsv4l2_cipher_t cipher, const uint8_t *key,
+                                  uint64_t counter, const void *aad, size_t aad_len, int enc)
+{
+    const EVP_CIPHER *evp = evp_cipher(cipher);
+    EVP_CIPHER_CTX *ctx = evp_thread_ctx();
+    uint8_t nonce[DSV4L2_SEAL_NONCE_SIZE];
+    int n;
+
+    if (!evp || !ctx) {
+        return NULL;
+    }
+
+    make_nonce(counter, nonce);
+
+    if (EVP_CipherInit_ex(ctx, evp, NULL, key, nonce, enc) != 1 ||
+        (aad_len && EVP_CipherUpdate(ctx, NULL, &n, aad, (int)aad_len) != 1)) {
+        return NULL;
+    }
+
+    return ctx;
+}
+#endif
+
+/**
+ * Whether a cipher was compiled in
+ *
+ * @param cipher Cipher
+ * @return 1 if available, 0 otherwise
+ */
+int dsv4l2_cipher_available(dsv4l2_cipher_t cipher)
+{
+    switch (cipher) {
+        case DSV4L2_CIPHER_NONE:
+            return 1;
+#ifdef HAVE_OPENSSL
+        case DSV4L2_CIPHER_AES_256_GCM:
+        case DSV4L2_CIPHER_CHACHA20_POLY1305:
+            return 1;
+#endif
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Derive a recording key: HKDF-SHA256(master, salt)
+ *
+ * @return 0 on success, -ENOTSUP without OpenSSL, -EIO on failure
+ */
+int dsv4l2_seal_derive(const uint8_t *master, const uint8_t *salt, uint8_t *key)
+{
+#ifdef HAVE_OPENSSL
+    EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL);
+    size_t len = DSV4L2_RECORD_KEY_SIZE;
+    int ok;
+
+    ok = pctx &&
+         EVP_PKEY_derive_init(pctx) == 1 &&
+         EVP_PKEY_CTX_set_hkdf_md(pctx, EVP_sha256()) == 1 &&
+         EVP_PKEY_CTX_set1_hkdf_salt(pctx, salt, DSV4L2_SEAL_SALT_SIZE) == 1 &&
+         EVP_PKEY_CTX_set1_hkdf_key(pctx, master, DSV4L2_RECORD_KEY_SIZE) == 1 &&
+         EVP_PKEY_CTX_add1_hkdf_info(pctx, (const unsigned char *)SEAL_INFO,
+                                     sizeof(SEAL_INFO) - 1) == 1 &&
+         EVP_PKEY_derive(pctx, key, &len) == 1 &&
+         len == DSV4L2_RECORD_KEY_SIZE;
+
+    EVP_PKEY_CTX_free(pctx);
+    return ok ? 0 : -EIO;
+#else
+    (void)master;
+    (void)salt;
+    (void)key;
+    return -ENOTSUP;
+#endif
+}
+
+/**
+ * Encrypt head then body into dst (dst may equal body when head is
+ * empty, and may be NULL when both are) and produce the tag
+ *
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_seal_encrypt(dsv4l2_cipher_t cipher, const uint8_t *key, uint64_t counter,
+                        const void *aad, size_t aad_len,
+                        const uint8_t *head, size_t head_len,
+                        const uint8_t *body, size_t body_len,
+                        uint8_t *dst, uint8_t *tag)
+{
+#ifdef HAVE_OPENSSL
+    EVP_CIPHER_CTX *ctx;
+    uint8_t tail[EVP_MAX_BLOCK_LENGTH];   /* Final output; empty for AEAD modes */
+    int n;
+
+    if (head_len + body_len > INT32_MAX) {
+        return -EFBIG;
+    }
+
+    ctx = seal_begin(cipher, key, counter, aad, aad_len, 1);
+    if (!ctx) {
+        return -EIO;
+    }
+
+    if ((head_len && EVP_EncryptUpdate(ctx, dst, &n, head, (int)head_len) != 1) ||
+        (body_len && EVP_EncryptUpdate(ctx, dst + head_len, &n, body, (int)body_len) != 1) ||
+        EVP_EncryptFinal_ex(ctx, tail, &n) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, DSV4L2_SEAL_TAG_SIZE, tag) != 1) {
+        return -EIO;
+    }
+
+    return 0;
+#else
+    (void)cipher; (void)key; (void)counter; (void)aad; (void)aad_len;
+    (void)head; (void)head_len; (void)body; (void)body_len; (void)dst; (void)tag;
+    return -ENOTSUP;
+#endif
+}
+
+/**
+ * Decrypt in place and check the tag
+ *
+ * @return 0 on success, -EBADMSG if authentication fails
+ */
+int dsv4l2_seal_decrypt(dsv4l2_cipher_t cipher, const uint8_t *key, uint64_t counter,
+                        const void *aad, size_t aad_len,
+                        uint8_t *buf, size_t len, const uint8_t *tag)
+{
+#ifdef HAVE_OPENSSL
+    EVP_CIPHER_CTX *ctx;
+    uint8_t expect[DSV4L2_SEAL_TAG_SIZE];
+    int n;
+
+    if (len > INT32_MAX) {
+        return -EFBIG;
+    }
+
+    ctx = seal_begin(cipher, key, counter, aad, aad_len, 0);
+    if (!ctx) {
+        return -EIO;
+    }
+
+    memcpy(expect, tag, sizeof(expect));
+    if ((len && EVP_DecryptUpdate(ctx, buf, &n, buf, (int)len) != 1) ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, DSV4L2_SEAL_TAG_SIZE, expect) != 1) {
+        return -EIO;
+    }
+
+    if (EVP_DecryptFinal_ex(ctx, buf + len, &n) != 1) {
+        /* Never hand back unauthenticated plaintext */
+        OPENSSL_cleanse(buf, len);
+        return -EBADMSG;
+    }
+
+    return 0;
+#else
+    (void)cipher; (void)key; (void)counter; (void)aad; (void)aad_len;
+    (void)buf; (void)len; (void)tag;
+    return -ENOTSUP;
+#endif
+}
+
+/**
+ * Wipe key material
+ */
+void dsv4l2_seal_wipe(void *buf, size_t len)
+{
+#ifdef HAVE_OPENSSL
+    OPENSSL_cleanse(buf, len);
+#else
+    volatile uint8_t *p = buf;
+
+    while (len--) {
+        *p++ = 0;
+    }
+#endif
+}
@@ -49,6 +49,14 @@ static struct {
     uint64_t             events_dropped;
     uint64_t             events_flushed;
 
+    /* Capture buffer lifecycle, all devices (relaxed atomics, no lock) */
+    uint64_t             buffer_dequeues;
+    uint64_t             buffer_requeues;
+    uint64_t             buffer_driver_ns;
+    uint64_t             buffer_app_ns;
+    uint64_t             buffer_app_ns_max;
+    uint64_t             buffer_depth_hist[DSV4L2RT_DEPTH_BINS];
+
     /* Flush thread */
     pthread_t            flush_thread;
     int                  flush_running;
@@ -60,6 +68,9 @@ static struct {
     /* File sink */
     int                  file_sink_fd;
     char                 file_sink_path[256];
+
+    /* Trace export path (DSV4L2_TRACE) */
+    char                 trace_path[256];
 } runtime = {
     .initialized = 0,
     .profile = DSV4L2_PROFILE_OFF,
@@ -207,7 +218,9 @@ static void *flush_thread_fn(void *arg)
         count = buffer_get_events(&runtime.buffer, batch, 256);
         if (count > 0) {
             /* Emit to all sinks */
+            DSV4L2_TRACE_BEGIN("sink_flush");
             emit_to_sinks(batch, count);
+            DSV4L2_TRACE_END("sink_flush");
             runtime.events_flushed += count;
         }
     }
@@ -232,7 +245,9 @@ static int emit_to_sinks(const dsv4l2_event_t *events, size_t count)
     pthread_mutex_lock(&runtime.sink_lock);
 
     for (sink = runtime.sinks; sink != NULL; sink = sink->next) {
+        DSV4L2_TRACE_BEGIN("sink_callback");
         sink->callback(events, count, sink->user_data);
+        DSV4L2_TRACE_END("sink_callback");
     }
 
     pthread_mutex_unlock(&runtime.sink_lock);
@@ -297,6 +312,13 @@ int dsv4l2rt_init(const dsv4l2rt_config_t *config)
     runtime.tpm_enabled = (config && config->enable_tpm_sign);
     runtime.chunk_sequence = 0;
 
+    /* Optional span tracing, exported at shutdown */
+    const char *env_trace = getenv("DSV4L2_TRACE");
+    if (env_trace && env_trace[0] != '\0') {
+        strncpy(runtime.trace_path, env_trace, sizeof(runtime.trace_path) - 1);
+        dsv4l2rt_trace_start(0);
+    }
+
     /* Start flush thread */
     runtime.flush_running = 1;
     rc = pthread_create(&runtime.flush_thread, NULL, flush_thread_fn, NULL);
@@ -335,7 +357,9 @@ void dsv4l2rt_emit(const dsv4l2_event_t *ev)
     __sync_fetch_and_add(&runtime.events_emitted, 1);
 
     /* Add to buffer */
+    DSV4L2_TRACE_BEGIN("event_emit");
     buffer_add_event(&runtime.buffer, ev);
+    DSV4L2_TRACE_END("event_emit");
 
     /* In exercise/forensic mode, also print to stderr */
     if (runtime.profile >= DSV4L2_PROFILE_EXERCISE) {
@@ -350,6 +374,8 @@ void dsv4l2rt_emit(const dsv4l2_event_t *ev)
             case DSV4L2_EVENT_CAPTURE_STOP:         event_name = "CAPTURE_STOP"; break;
             case DSV4L2_EVENT_FRAME_ACQUIRED:       event_name = "FRAME_ACQUIRED"; break;
             case DSV4L2_EVENT_FRAME_DROPPED:        event_name = "FRAME_DROPPED"; break;
+            case DSV4L2_EVENT_STREAM_STALL:         event_name = "STREAM_STALL"; break;
+            case DSV4L2_EVENT_STREAM_RECOVERED:     event_name = "STREAM_RECOVERED"; break;
             case DSV4L2_EVENT_TEMPEST_TRANSITION:   event_name = "TEMPEST_TRANSITION"; break;
             case DSV4L2_EVENT_TEMPEST_QUERY:        event_name = "TEMPEST_QUERY"; break;
             case DSV4L2_EVENT_TEMPEST_LOCKDOWN:     event_name = "TEMPEST_LOCKDOWN"; break;
@@ -429,6 +455,7 @@ void dsv4l2rt_flush(void)
 void dsv4l2rt_shutdown(void)
 {
     event_sink_t *sink, *next;
+    int i;
 
     if (!runtime.initialized) {
         return;
@@ -463,10 +490,27 @@ void dsv4l2rt_shutdown(void)
         runtime.file_sink_fd = -1;
     }
 
+    /* Export trace requested via DSV4L2_TRACE */
+    if (runtime.trace_path[0] != '\0') {
+        dsv4l2rt_trace_stop();
+        if (dsv4l2rt_trace_export(runtime.trace_path) != 0) {
+            fprintf(stderr, "Warning: failed to write trace to %s\n", runtime.trace_path);
+        }
+        runtime.trace_path[0] = '\0';
+    }
+
     /* Reset statistics */
     runtime.events_emitted = 0;
     runtime.events_dropped = 0;
     runtime.events_flushed = 0;
+    __atomic_store_n(&runtime.buffer_dequeues, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&runtime.buffer_requeues, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&runtime.buffer_driver_ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&runtime.buffer_app_ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&runtime.buffer_app_ns_max, 0, __ATOMIC_RELAXED);
+    for (i = 0; i < DSV4L2RT_DEPTH_BINS; i++) {
+        __atomic_store_n(&runtime.buffer_depth_hist[i], 0, __ATOMIC_RELAXED);
+    }
 
     runtime.initialized = 0;
 }
@@ -484,6 +528,8 @@ dsv4l2_profile_t dsv4l2rt_get_profile(void)
  */
 void dsv4l2rt_get_stats(dsv4l2rt_stats_t *stats)
 {
+    int i;
+
     if (!stats) {
         return;
     }
@@ -495,6 +541,46 @@ void dsv4l2rt_get_stats(dsv4l2rt_stats_t *stats)
     stats->buffer_usage = runtime.buffer.count;
     stats->buffer_capacity = runtime.buffer.capacity;
     pthread_mutex_unlock(&runtime.buffer.lock);
+
+    stats->buffer_dequeues = __atomic_load_n(&runtime.buffer_dequeues, __ATOMIC_RELAXED);
+    stats->buffer_requeues = __atomic_load_n(&runtime.buffer_requeues, __ATOMIC_RELAXED);
+    stats->buffer_driver_ns = __atomic_load_n(&runtime.buffer_driver_ns, __ATOMIC_RELAXED);
+    stats->buffer_app_ns = __atomic_load_n(&runtime.buffer_app_ns, __ATOMIC_RELAXED);
+    stats->buffer_app_ns_max = __atomic_load_n(&runtime.buffer_app_ns_max, __ATOMIC_RELAXED);
+    for (i = 0; i < DSV4L2RT_DEPTH_BINS; i++) {
+        stats->buffer_depth_hist[i] = __atomic_load_n(&runtime.buffer_depth_hist[i],
+                                                      __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Account one DQBUF
+ */
+void dsv4l2rt_note_dequeue(uint32_t depth, uint64_t driver_ns)
+{
+    if (depth >= DSV4L2RT_DEPTH_BINS) {
+        depth = DSV4L2RT_DEPTH_BINS - 1;
+    }
+
+    __atomic_fetch_add(&runtime.buffer_dequeues, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&runtime.buffer_driver_ns, driver_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&runtime.buffer_depth_hist[depth], 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Account the requeue of a dequeued buffer
+ */
+void dsv4l2rt_note_requeue(uint64_t app_ns)
+{
+    uint64_t max = __atomic_load_n(&runtime.buffer_app_ns_max, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&runtime.buffer_requeues, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&runtime.buffer_app_ns, app_ns, __ATOMIC_RELAXED);
+
+    while (app_ns > max &&
+           !__atomic_compare_exchange_n(&runtime.buffer_app_ns_max, &max, app_ns, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
 }
 
 /**
@@ -8,6 +8,7 @@
  */
 
 #include "dsv4l2rt.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -83,6 +84,8 @@ void dsv4l2rt_emit(const dsv4l2_event_t *ev)
             case DSV4L2_EVENT_CAPTURE_STOP:         event_name = "CAPTURE_STOP"; break;
             case DSV4L2_EVENT_FRAME_ACQUIRED:       event_name = "FRAME_ACQUIRED"; break;
             case DSV4L2_EVENT_FRAME_DROPPED:        event_name = "FRAME_DROPPED"; break;
+            case DSV4L2_EVENT_STREAM_STALL:         event_name = "STREAM_STALL"; break;
+            case DSV4L2_EVENT_STREAM_RECOVERED:     event_name = "STREAM_RECOVERED"; break;
             case DSV4L2_EVENT_TEMPEST_TRANSITION:   event_name = "TEMPEST_TRANSITION"; break;
             case DSV4L2_EVENT_TEMPEST_QUERY:        event_name = "TEMPEST_QUERY"; break;
             case DSV4L2_EVENT_TEMPEST_LOCKDOWN:     event_name = "TEMPEST_LOCKDOWN"; break;
@@ -177,6 +180,27 @@ void dsv4l2rt_get_stats(dsv4l2rt_stats_t *stats)
     stats->buffer_usage = 0;
     stats->buffer_capacity = 0;
     pthread_mutex_unlock(&runtime.lock);
+
+    /* Stub doesn't account buffers */
+    memset(&stats->buffer_dequeues, 0,
+           sizeof(*stats) - offsetof(dsv4l2rt_stats_t, buffer_dequeues));
+}
+
+/**
+ * Account one DQBUF (stub - not accounted)
+ */
+void dsv4l2rt_note_dequeue(uint32_t depth, uint64_t driver_ns)
+{
+    (void)depth;
+    (void)driver_ns;
+}
+
+/**
+ * Account a requeue (stub - not accounted)
+ */
+void dsv4l2rt_note_requeue(uint64_t app_ns)
+{
+    (void)app_ns;
 }
 
 /**
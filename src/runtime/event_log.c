@@ -0,0 +1,113 @@
+/*
+ * DSV4L2 Runtime - Event Log Reader
+ *
+ * Reads back the binary event logs produced by the file sink for
+ * forensic export and offline analysis.
+ */
+
+#include "dsv4l2rt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* Upper bound on a log we are willing to load in one go (256 MB) */
+#define EVENT_LOG_MAX_SIZE (256UL * 1024 * 1024)
+
+/**
+ * Parse a binary event log
+ */
+int dsv4l2rt_parse_event_log(const void *data, size_t len,
+                             dsv4l2_event_t **events, size_t *count)
+{
+    const uint8_t *bytes = data;
+    dsv4l2_event_t *out;
+    size_t n, i;
+
+    if ((!data && len > 0) || !events || !count) {
+        return -EINVAL;
+    }
+
+    /* Only complete records are considered */
+    n = len / sizeof(dsv4l2_event_t);
+
+    *events = NULL;
+    *count = 0;
+
+    if (n == 0) {
+        return 0;
+    }
+
+    out = malloc(n * sizeof(dsv4l2_event_t));
+    if (!out) {
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < n; i++) {
+        dsv4l2_event_t *ev = &out[i];
+
+        /* Records may be unaligned inside the caller's buffer */
+        memcpy(ev, bytes + i * sizeof(dsv4l2_event_t), sizeof(*ev));
+
+        if (ev->severity > DSV4L2_SEV_CRITICAL) {
+            free(out);
+            return -EBADMSG;
+        }
+
+        /* Never trust on-disk strings to be terminated */
+        ev->role[sizeof(ev->role) - 1] = '\0';
+        ev->mission[sizeof(ev->mission) - 1] = '\0';
+    }
+
+    *events = out;
+    *count = n;
+    return 0;
+}
+
+/**
+ * Read and parse an event log file
+ */
+int dsv4l2rt_read_event_log(const char *path,
+                            dsv4l2_event_t **events, size_t *count)
+{
+    FILE *fp;
+    uint8_t *data;
+    long size;
+    size_t got;
+    int rc;
+
+    if (!path || !events || !count) {
+        return -EINVAL;
+    }
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        return -errno;
+    }
+
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0) {
+        rc = -errno;
+        fclose(fp);
+        return rc;
+    }
+    rewind(fp);
+
+    if ((unsigned long)size > EVENT_LOG_MAX_SIZE) {
+        fclose(fp);
+        return -EFBIG;
+    }
+
+    data = malloc(size > 0 ? (size_t)size : 1);
+    if (!data) {
+        fclose(fp);
+        return -ENOMEM;
+    }
+
+    got = fread(data, 1, (size_t)size, fp);
+    fclose(fp);
+
+    rc = dsv4l2rt_parse_event_log(data, got, events, count);
+    free(data);
+
+    return rc;
+}
@@ -0,0 +1,285 @@
+/*
+ * DSV4L2 Runtime - Pipeline Tracing
+ *
+ * Records begin/end spans into per-thread ring buffers and exports them
+ * as Chrome trace JSON ("X" complete events).
+ *
+ * Each thread owns its buffer: only the owner writes spans, publishing
+ * them with a release store of the head counter, so the recording path
+ * takes no locks. Buffers are registered once per thread on a lock-free
+ * list and kept after the thread exits so its spans can still be
+ * exported.
+ */
+
+#define _GNU_SOURCE  /* pthread_getname_np */
+
+#include "dsv4l2rt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+
+#define TRACE_DEFAULT_SPANS 65536
+#define TRACE_MAX_DEPTH     32
+
+/* Completed span */
+typedef struct {
+    const char *name;
+    uint64_t    start_ns;
+    uint64_t    dur_ns;
+} trace_span_t;
+
+/* Per-thread span buffer */
+typedef struct trace_thread {
+    trace_span_t        *spans;
+    size_t               capacity;
+    uint64_t             head;          /* Spans written (release-published) */
+    uint32_t             generation;    /* Trace session this buffer belongs to */
+
+    /* Open spans (owner thread only) */
+    const char          *open_name[TRACE_MAX_DEPTH];
+    uint64_t             open_start[TRACE_MAX_DEPTH];
+    int                  depth;
+
+    pid_t                tid;
+    char                 thread_name[16];
+    struct trace_thread *next;
+} trace_thread_t;
+
+/* Global trace state */
+static struct {
+    trace_thread_t *threads;            /* Registered buffers (push-only list) */
+    size_t          capacity;           /* Spans per thread for this session */
+    uint32_t        generation;         /* Bumped on every start */
+} g_trace;
+
+volatile int dsv4l2rt_trace_active = 0;
+
+static __thread trace_thread_t *tls_trace;
+
+/**
+ * Monotonic timestamp in nanoseconds
+ */
+static uint64_t trace_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Get (or lazily create) the calling thread's buffer for this session
+ */
+static trace_thread_t *trace_thread_get(void)
+{
+    trace_thread_t *t = tls_trace;
+    uint32_t generation = __atomic_load_n(&g_trace.generation, __ATOMIC_ACQUIRE);
+    size_t capacity = g_trace.capacity;
+
+    if (t && t->generation == generation) {
+        return t;
+    }
+
+    if (!t) {
+        t = calloc(1, sizeof(*t));
+        if (!t) {
+            return NULL;
+        }
+
+        t->tid = (pid_t)syscall(SYS_gettid);
+        if (pthread_getname_np(pthread_self(), t->thread_name,
+                               sizeof(t->thread_name)) != 0) {
+            snprintf(t->thread_name, sizeof(t->thread_name), "tid-%d", t->tid);
+        }
+
+        /* Lock-free push onto the registry */
+        t->next = __atomic_load_n(&g_trace.threads, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&g_trace.threads, &t->next, t, 0,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            /* t->next refreshed by the failed CAS */
+        }
+
+        tls_trace = t;
+    }
+
+    /* New session: resize if needed and drop spans from the previous one */
+    if (t->capacity != capacity) {
+        trace_span_t *spans = calloc(capacity, sizeof(trace_span_t));
+        if (!spans) {
+            return NULL;
+        }
+        free(t->spans);
+        t->spans = spans;
+        t->capacity = capacity;
+    }
+
+    t->depth = 0;
+    __atomic_store_n(&t->head, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&t->generation, generation, __ATOMIC_RELEASE);
+
+    return t;
+}
+
+/**
+ * Start recording spans
+ */
+int dsv4l2rt_trace_start(size_t spans_per_thread)
+{
+    if (dsv4l2rt_trace_active) {
+        return 0;  /* Already recording */
+    }
+
+    g_trace.capacity = spans_per_thread ? spans_per_thread : TRACE_DEFAULT_SPANS;
+    __atomic_add_fetch(&g_trace.generation, 1, __ATOMIC_RELEASE);
+
+    dsv4l2rt_trace_active = 1;
+    return 0;
+}
+
+/**
+ * Stop recording spans
+ */
+void dsv4l2rt_trace_stop(void)
+{
+    dsv4l2rt_trace_active = 0;
+}
+
+/**
+ * Open a span on the calling thread
+ */
+void dsv4l2rt_trace_begin(const char *name)
+{
+    trace_thread_t *t = trace_thread_get();
+
+    if (!t) {
+        return;
+    }
+
+    if (t->depth < TRACE_MAX_DEPTH) {
+        t->open_name[t->depth] = name;
+        t->open_start[t->depth] = trace_now_ns();
+    }
+    t->depth++;
+}
+
+/**
+ * Close the innermost open span on the calling thread
+ */
+void dsv4l2rt_trace_end(const char *name)
+{
+    trace_thread_t *t = trace_thread_get();
+    trace_span_t *span;
+    uint64_t head;
+
+    (void)name;  /* Span is named at begin; spans nest strictly */
+
+    if (!t || t->depth == 0) {
+        return;  /* Begin happened before tracing was enabled */
+    }
+
+    t->depth--;
+    if (t->depth >= TRACE_MAX_DEPTH) {
+        return;  /* Nested too deep to have been recorded */
+    }
+
+    head = t->head;
+    span = &t->spans[head % t->capacity];
+    span->name = t->open_name[t->depth];
+    span->start_ns = t->open_start[t->depth];
+    span->dur_ns = trace_now_ns() - span->start_ns;
+
+    __atomic_store_n(&t->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Write a JSON string literal (names are normally plain identifiers)
+ */
+static void trace_write_string(FILE *fp, const char *str)
+{
+    fputc('"', fp);
+    for (; str && *str; str++) {
+        unsigned char c = (unsigned char)*str;
+
+        if (c == '"' || c == '\\') {
+            fputc('\\', fp);
+            fputc(c, fp);
+        } else if (c < 0x20) {
+            fprintf(fp, "\\u%04x", c);
+        } else {
+            fputc(c, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+/**
+ * Export recorded spans as Chrome trace JSON
+ */
+int dsv4l2rt_trace_export(const char *path)
+{
+    trace_thread_t *t;
+    uint32_t generation;
+    pid_t pid = getpid();
+    FILE *fp;
+    int first = 1;
+    int rc = 0;
+
+    if (!path) {
+        return -EINVAL;
+    }
+
+    fp = fopen(path, "w");
+    if (!fp) {
+        return -errno;
+    }
+
+    generation = __atomic_load_n(&g_trace.generation, __ATOMIC_ACQUIRE);
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+
+    for (t = __atomic_load_n(&g_trace.threads, __ATOMIC_ACQUIRE);
+         t != NULL; t = t->next) {
+        uint64_t head, i;
+
+        if (__atomic_load_n(&t->generation, __ATOMIC_ACQUIRE) != generation) {
+            continue;  /* Thread recorded nothing this session */
+        }
+
+        head = __atomic_load_n(&t->head, __ATOMIC_ACQUIRE);
+
+        /* Thread name metadata */
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", pid, t->tid);
+        trace_write_string(fp, t->thread_name);
+        fprintf(fp, "}}");
+        first = 0;
+
+        i = head > t->capacity ? head - t->capacity : 0;
+        for (; i < head; i++) {
+            const trace_span_t *span = &t->spans[i % t->capacity];
+
+            fprintf(fp, ",\n{\"name\":");
+            trace_write_string(fp, span->name);
+            fprintf(fp, ",\"cat\":\"dsv4l2\",\"ph\":\"X\",\"ts\":%.3f,"
+                    "\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                    span->start_ns / 1000.0, span->dur_ns / 1000.0,
+                    pid, t->tid);
+        }
+    }
+
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+    if (ferror(fp)) {
+        rc = -EIO;
+    }
+    if (fclose(fp) != 0 && rc == 0) {
+        rc = -errno;
+    }
+
+    return rc;
+}
@@ -0,0 +1,363 @@
+/*
+ * DSV4L2 Secret-Frame Arena
+ *
+ * One private anonymous mapping, locked and excluded from dumps and
+ * forks at creation, handed out as fixed-size blocks from a free stack.
+ * Every block carries the length it was allocated for, so a free only
+ * wipes what could hold secret data.
+ *
+ * Wipes of at least WIPE_NT_MIN bytes use streaming stores (AVX or SSE2,
+ * chosen by dsv4l2_simd_level() so DSV4L2_SIMD caps them like every
+ * other kernel) followed by an sfence; smaller ones, and the scalar
+ * level, use explicit_bzero, which is cheaper when the lines are cached
+ * anyway.
+ */
+
+#define _GNU_SOURCE  /* MADV_DONTDUMP, MADV_WIPEONFORK, explicit_bzero */
+
+#include "dsv4l2_secret.h"
+#include "dsv4l2_imaging.h"
+#include "dsv4l2rt.h"
+#include "dsv4l2_internal.h"
+
+#include <sys/mman.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define BLOCK_ALIGN  64
+#define WIPE_NT_MIN  4096
+
+struct dsv4l2_secret_arena {
+    uint8_t  *base;
+    size_t    map_len;
+    size_t    block_size;
+    uint32_t  blocks;
+
+    pthread_mutex_t lock;
+    uint32_t *free_stack;        /* Free block indices */
+    uint32_t  free_top;
+    size_t   *used;              /* Allocated length per block, 0 = free */
+    dsv4l2_secret_arena_stats_t stats;
+};
+
+/* ========================================================================
+ * Wipe
+ * ======================================================================== */
+
+#if defined(__x86_64__)
+static void wipe_stream_sse2(uint8_t *p, size_t len)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; len >= 64; p += 64, len -= 64) {
+        _mm_stream_si128((__m128i *)p, zero);
+        _mm_stream_si128((__m128i *)(p + 16), zero);
+        _mm_stream_si128((__m128i *)(p + 32), zero);
+        _mm_stream_si128((__m128i *)(p + 48), zero);
+    }
+    _mm_sfence();
+}
+
+__attribute__((target("avx")))
+static void wipe_stream_avx(uint8_t *p, size_t len)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (; len >= 64; p += 64, len -= 64) {
+        _mm256_stream_si256((__m256i *)p, zero);
+        _mm256_stream_si256((__m256i *)(p + 32), zero);
+    }
+    _mm_sfence();
+}
+#endif
+
+/**
+ * Zeroize memory
+ *
+ * @param ptr Memory
+ * @param len Bytes
+ */
+void dsv4l2_secret_wipe(void *ptr, size_t len)
+{
+    uint8_t *p = ptr;
+
+    if (!p || len == 0) {
+        return;
+    }
+
+#if defined(__x86_64__)
+    dsv4l2_simd_level_t level = dsv4l2_simd_level();
+
+    if (len >= WIPE_NT_MIN && level != DSV4L2_SIMD_SCALAR) {
+        size_t head = (BLOCK_ALIGN - ((uintptr_t)p & (BLOCK_ALIGN - 1))) & (BLOCK_ALIGN - 1);
+        size_t body = (len - head) & ~(size_t)(BLOCK_ALIGN - 1);
+
+        explicit_bzero(p, head);
+        if (level == DSV4L2_SIMD_AVX2) {
+            wipe_stream_avx(p + head, body);
+        } else {
+            wipe_stream_sse2(p + head, body);
+        }
+        explicit_bzero(p + head + body, len - head - body);
+
+        /* The streaming stores must not be treated as dead */
+        __asm__ __volatile__("" : : "r"(p) : "memory");
+        return;
+    }
+#endif
+
+    explicit_bzero(p, len);
+}
+
+/* ========================================================================
+ * Arena
+ * ======================================================================== */
+
+/**
+ * Create an arena
+ *
+ * @param cfg Configuration
+ * @param out Arena
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_secret_arena_create(const dsv4l2_secret_arena_config_t *cfg,
+                               dsv4l2_secret_arena_t **out)
+{
+    dsv4l2_secret_arena_t *arena;
+    size_t block_size;
+    uint32_t i;
+    int rc;
+
+    if (!cfg || !out || cfg->block_size == 0 || cfg->blocks == 0) {
+        return -EINVAL;
+    }
+
+    block_size = (cfg->block_size + BLOCK_ALIGN - 1) & ~(size_t)(BLOCK_ALIGN - 1);
+    if (block_size < cfg->block_size || block_size > SIZE_MAX / cfg->blocks) {
+        return -EINVAL;
+    }
+
+    arena = calloc(1, sizeof(*arena));
+    if (!arena) {
+        return -ENOMEM;
+    }
+
+    arena->block_size = block_size;
+    arena->blocks = cfg->blocks;
+    arena->map_len = block_size * cfg->blocks;
+    arena->free_stack = malloc(cfg->blocks * sizeof(*arena->free_stack));
+    arena->used = calloc(cfg->blocks, sizeof(*arena->used));
+    if (!arena->free_stack || !arena->used) {
+        rc = -ENOMEM;
+        goto fail;
+    }
+
+    arena->base = mmap(NULL, arena->map_len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena->base == MAP_FAILED) {
+        arena->base = NULL;
+        rc = -ENOMEM;
+        goto fail;
+    }
+
+    /* Keep secrets out of core files and forked children before touching them */
+    arena->stats.dontdump = madvise(arena->base, arena->map_len, MADV_DONTDUMP) == 0;
+#ifdef MADV_WIPEONFORK
+    arena->stats.wipeonfork = madvise(arena->base, arena->map_len, MADV_WIPEONFORK) == 0;
+#endif
+
+    /* mlock also faults every page in, so no allocation takes a page fault */
+    if (mlock(arena->base, arena->map_len) == 0) {
+        arena->stats.locked = 1;
+    } else if (cfg->flags & DSV4L2_SECRET_REQUIRE_LOCK) {
+        rc = -errno;
+        goto fail;
+    }
+
+    for (i = 0; i < cfg->blocks; i++) {
+        arena->free_stack[i] = cfg->blocks - 1 - i;   /* Block 0 on top */
+    }
+    arena->free_top = cfg->blocks;
+
+    arena->stats.blocks = cfg->blocks;
+    arena->stats.block_size = block_size;
+    pthread_mutex_init(&arena->lock, NULL);
+
+    *out = arena;
+    return 0;
+
+fail:
+    if (arena->base) {
+        munmap(arena->base, arena->map_len);
+    }
+    free(arena->free_stack);
+    free(arena->used);
+    free(arena);
+    return rc;
+}
+
+/**
+ * Take a block
+ *
+ * @param arena Arena
+ * @param len Bytes needed
+ * @param out Block
+ * @return 0 on success, -EMSGSIZE if too large, -EAGAIN if exhausted
+ */
+int dsv4l2_secret_alloc(dsv4l2_secret_arena_t *arena, size_t len, void **out)
+{
+    uint32_t index;
+
+    if (!arena || !out) {
+        return -EINVAL;
+    }
+
+    if (len > arena->block_size) {
+        return -EMSGSIZE;
+    }
+
+    pthread_mutex_lock(&arena->lock);
+
+    if (arena->free_top == 0) {
+        arena->stats.exhausted++;
+        pthread_mutex_unlock(&arena->lock);
+        return -EAGAIN;
+    }
+
+    index = arena->free_stack[--arena->free_top];
+    arena->used[index] = len ? len : 1;
+
+    arena->stats.allocs++;
+    arena->stats.in_use++;
+    if (arena->stats.in_use > arena->stats.peak) {
+        arena->stats.peak = arena->stats.in_use;
+    }
+
+    pthread_mutex_unlock(&arena->lock);
+
+    *out = arena->base + (size_t)index * arena->block_size;
+    return 0;
+}
+
+/**
+ * Wipe and return a block
+ *
+ * @param arena Arena
+ * @param ptr Block from dsv4l2_secret_alloc()
+ * @return 0 on success, -EINVAL if ptr is not a block in use
+ */
+int dsv4l2_secret_free(dsv4l2_secret_arena_t *arena, void *ptr)
+{
+    uint8_t *p = ptr;
+    size_t off, used;
+    uint32_t index;
+
+    if (!arena || p < arena->base || p >= arena->base + arena->map_len) {
+        return -EINVAL;
+    }
+
+    off = (size_t)(p - arena->base);
+    if (off % arena->block_size != 0) {
+        return -EINVAL;
+    }
+    index = (uint32_t)(off / arena->block_size);
+
+    /* Claim the block first so a double free cannot wipe a reused block */
+    pthread_mutex_lock(&arena->lock);
+    used = arena->used[index];
+    arena->used[index] = 0;
+    pthread_mutex_unlock(&arena->lock);
+
+    if (used == 0) {
+        return -EINVAL;
+    }
+
+    DSV4L2_TRACE_BEGIN("secret_wipe");
+    dsv4l2_secret_wipe(p, used);
+    DSV4L2_TRACE_END("secret_wipe");
+
+    pthread_mutex_lock(&arena->lock);
+    arena->free_stack[arena->free_top++] = index;
+    arena->stats.in_use--;
+    pthread_mutex_unlock(&arena->lock);
+
+    return 0;
+}
+
+/**
+ * Snapshot metrics
+ *
+ * @param arena Arena
+ * @param stats Output
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_secret_arena_get_stats(dsv4l2_secret_arena_t *arena,
+                                  dsv4l2_secret_arena_stats_t *stats)
+{
+    if (!arena || !stats) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&arena->lock);
+    *stats = arena->stats;
+    pthread_mutex_unlock(&arena->lock);
+
+    return 0;
+}
+
+/**
+ * Wipe, unlock and unmap the arena
+ *
+ * @param arena Arena
+ * @return 0 on success, -EBUSY if blocks are still in use
+ */
+int dsv4l2_secret_arena_destroy(dsv4l2_secret_arena_t *arena)
+{
+    if (!arena) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&arena->lock);
+    if (arena->stats.in_use) {
+        pthread_mutex_unlock(&arena->lock);
+        return -EBUSY;
+    }
+    pthread_mutex_unlock(&arena->lock);
+
+    /* Blocks were wiped on free; wipe everything again in case of misuse */
+    dsv4l2_secret_wipe(arena->base, arena->map_len);
+    if (arena->stats.locked) {
+        munlock(arena->base, arena->map_len);
+    }
+    munmap(arena->base, arena->map_len);
+
+    pthread_mutex_destroy(&arena->lock);
+    free(arena->free_stack);
+    free(arena->used);
+    free(arena);
+
+    return 0;
+}
+
+/**
+ * Route iris captures through an arena
+ *
+ * @param dev Device handle
+ * @param arena Arena, NULL to capture into driver buffers again
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_set_secret_arena(dsv4l2_device_t *dev, dsv4l2_secret_arena_t *arena)
+{
+    if (!dev) {
+        return -EINVAL;
+    }
+
+    dsv4l2_get_internal(dev)->secret_arena = arena;
+    return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * DSV4L2 Capture Statistics
+ *
+ * Per-device counters maintained on the dequeue path:
+ * - Frames, bytes and V4L2_BUF_FLAG_ERROR frames
+ * - Sequence gaps (frames the driver dropped)
+ * - Inter-frame jitter and capture latency histograms
+ * - Smoothed frame interval / fps
+ *
+ * Only the thread dequeuing a device writes its statistics; readers take
+ * unsynchronised snapshots, so all shared fields use relaxed atomics.
+ */
+
+#include "dsv4l2_annotations.h"
+#include "dsv4l2_policy.h"
+#include "dsv4l2_core.h"
+#include "dsv4l2_internal.h"
+
+#include <linux/videodev2.h>
+#include <errno.h>
+#include <string.h>
+
+#define STAT_ADD(field, n)   __atomic_fetch_add(&(field), (n), __ATOMIC_RELAXED)
+#define STAT_LOAD(field)     __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define STAT_STORE(field, v) __atomic_store_n(&(field), (v), __ATOMIC_RELAXED)
+
+/* Smoothing factor for the frame interval EWMA (1/8) */
+#define INTERVAL_EWMA_SHIFT 3
+
+/**
+ * Driver timestamp of a buffer in nanoseconds
+ */
+static uint64_t stats_buffer_ts_ns(const struct v4l2_buffer *buf)
+{
+    return (uint64_t)buf->timestamp.tv_sec * 1000000000ULL +
+           (uint64_t)buf->timestamp.tv_usec * 1000ULL;
+}
+
+/**
+ * Account a successfully dequeued frame
+ *
+ * @param internal Internal device structure
+ * @param buf Dequeued buffer
+ * @param now_ns Monotonic time the DQBUF returned
+ * @return Frames dropped by the driver since the previous frame
+ */
+uint32_t dsv4l2_stats_on_dequeue(dsv4l2_device_internal_t *internal,
+                                 const struct v4l2_buffer *buf, uint64_t now_ns)
+{
+    dsv4l2_stream_stats_t *s = &internal->stats;
+    uint32_t lost = 0;
+    int monotonic;
+    uint64_t ts;
+
+    STAT_ADD(s->frames, 1);
+    STAT_ADD(s->bytes, buf->bytesused);
+
+    if (buf->flags & V4L2_BUF_FLAG_ERROR) {
+        STAT_ADD(s->error_frames, 1);
+    }
+
+    /* Sequence gaps: frames the driver completed without a buffer */
+    if (s->have_last) {
+        uint32_t expected = s->last_sequence + 1;
+        uint32_t gap = buf->sequence - expected;
+
+        /* Backwards jumps (driver restart) just resynchronise */
+        if (gap != 0 && gap < 0x80000000u) {
+            STAT_ADD(s->sequence_gaps, 1);
+            STAT_ADD(s->frames_lost, gap);
+            lost = gap;
+        }
+    }
+    STAT_STORE(s->last_sequence, buf->sequence);
+
+    /* Prefer the driver's capture timestamp; fall back to DQBUF time */
+    monotonic = (buf->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+                V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+    ts = stats_buffer_ts_ns(buf);
+
+    if (monotonic && ts != 0 && now_ns >= ts) {
+        STAT_ADD(s->latency_hist[dsv4l2_hist_bin(now_ns - ts)], 1);
+    } else {
+        ts = now_ns;
+    }
+
+    if (s->have_last && ts > s->last_ts_ns) {
+        uint64_t interval = ts - s->last_ts_ns;
+        uint64_t ewma = STAT_LOAD(s->interval_ns);
+
+        if (s->last_interval_ns != 0) {
+            uint64_t jitter = interval > s->last_interval_ns ?
+                              interval - s->last_interval_ns :
+                              s->last_interval_ns - interval;
+            STAT_ADD(s->jitter_hist[dsv4l2_hist_bin(jitter)], 1);
+        }
+
+        if (ewma == 0) {
+            ewma = interval;
+        } else if (interval > ewma) {
+            ewma += (interval - ewma) >> INTERVAL_EWMA_SHIFT;
+        } else {
+            ewma -= (ewma - interval) >> INTERVAL_EWMA_SHIFT;
+        }
+        STAT_STORE(s->interval_ns, ewma);
+
+        s->last_interval_ns = interval;
+    }
+
+    s->last_ts_ns = ts;
+    s->have_last = 1;
+
+    return lost;
+}
+
+/**
+ * Start a new stream: sequence numbers and timestamps restart
+ *
+ * @param internal Internal device structure
+ */
+void dsv4l2_stats_on_stream_on(dsv4l2_device_internal_t *internal)
+{
+    internal->stats.have_last = 0;
+    internal->stats.last_interval_ns = 0;
+}
+
+/**
+ * Snapshot capture statistics for a device
+ *
+ * @param dev Device handle
+ * @param stats Output statistics
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_get_device_stats(dsv4l2_device_t *dev, dsv4l2_device_stats_t *stats)
+{
+    dsv4l2_stream_stats_t *s;
+    int i;
+
+    if (!dev || !stats) {
+        return -EINVAL;
+    }
+
+    s = &dsv4l2_get_internal(dev)->stats;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->frames = STAT_LOAD(s->frames);
+    stats->bytes = STAT_LOAD(s->bytes);
+    stats->error_frames = STAT_LOAD(s->error_frames);
+    stats->sequence_gaps = STAT_LOAD(s->sequence_gaps);
+    stats->frames_lost = STAT_LOAD(s->frames_lost);
+    stats->last_sequence = STAT_LOAD(s->last_sequence);
+    stats->interval_ns = STAT_LOAD(s->interval_ns);
+    stats->fps = stats->interval_ns ? 1e9 / (double)stats->interval_ns : 0.0;
+
+    for (i = 0; i < DSV4L2_STATS_HIST_BINS; i++) {
+        stats->jitter_hist[i] = STAT_LOAD(s->jitter_hist[i]);
+        stats->latency_hist[i] = STAT_LOAD(s->latency_hist[i]);
+    }
+
+    return 0;
+}
+
+/**
+ * Reset capture statistics for a device
+ *
+ * Not synchronised with a concurrent dequeue; intended for use between
+ * measurement intervals.
+ *
+ * @param dev Device handle
+ */
+void dsv4l2_reset_device_stats(dsv4l2_device_t *dev)
+{
+    if (!dev) {
+        return;
+    }
+
+    memset(&dsv4l2_get_internal(dev)->stats, 0, sizeof(dsv4l2_stream_stats_t));
+}
+
+/**
+ * Approximate percentile of a statistics histogram
+ *
+ * @param hist Histogram with DSV4L2_STATS_HIST_BINS bins
+ * @param percentile Percentile in [0, 100]
+ * @return Upper bound in µs of the bin holding the percentile, 0 if empty
+ */
+uint64_t dsv4l2_stats_percentile_us(const uint64_t *hist, double percentile)
+{
+    uint64_t total = 0, target, seen = 0;
+    int i;
+
+    if (!hist) {
+        return 0;
+    }
+
+    for (i = 0; i < DSV4L2_STATS_HIST_BINS; i++) {
+        total += hist[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    if (percentile < 0.0) {
+        percentile = 0.0;
+    } else if (percentile > 100.0) {
+        percentile = 100.0;
+    }
+
+    target = (uint64_t)((double)total * percentile / 100.0 + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+
+    for (i = 0; i < DSV4L2_STATS_HIST_BINS; i++) {
+        seen += hist[i];
+        if (seen >= target) {
+            break;
+        }
+    }
+
+    return 1ULL << (i < DSV4L2_STATS_HIST_BINS ? i : DSV4L2_STATS_HIST_BINS - 1);
+}
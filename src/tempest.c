@@ -12,28 +12,13 @@
 #include "dsv4l2_annotations.h"
 #include "dsv4l2_policy.h"
 #include "dsv4l2rt.h"
+#include "dsv4l2_internal.h"
 
 #include <linux/videodev2.h>
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <string.h>
 
-/* Forward declaration of internal device structure */
-typedef struct dsv4l2_device_internal dsv4l2_device_internal_t;
-extern dsv4l2_device_internal_t *dsv4l2_get_internal(dsv4l2_device_t *dev);
-
-/* Internal accessor for TEMPEST state */
-struct dsv4l2_device_internal {
-    dsv4l2_device_t public;
-    struct v4l2_capability cap;
-    dsv4l2_tempest_state_t tempest;
-    int tempest_ctrl_id;
-    char *profile_path;
-    char *classification;
-    int streaming;
-    uint32_t dev_id;
-};
-
 /**
  * Get current TEMPEST state of a device
  *
@@ -48,6 +33,7 @@ dsv4l2_tempest_state_t dsv4l2_get_tempest_state(dsv4l2_device_t *dev)
 {
     dsv4l2_device_internal_t *internal;
     struct v4l2_control ctrl;
+    int rc;
 
     if (!dev) {
         return DSV4L2_TEMPEST_DISABLED;
@@ -64,7 +50,10 @@ dsv4l2_tempest_state_t dsv4l2_get_tempest_state(dsv4l2_device_t *dev)
     memset(&ctrl, 0, sizeof(ctrl));
     ctrl.id = internal->tempest_ctrl_id;
 
-    if (ioctl(dev->fd, VIDIOC_G_CTRL, &ctrl) < 0) {
+    DSV4L2_TRACE_BEGIN("tempest_query");
+    rc = ioctl(dev->fd, VIDIOC_G_CTRL, &ctrl);
+    DSV4L2_TRACE_END("tempest_query");
+    if (rc < 0) {
         /* If control read fails, return cached state */
         return internal->tempest;
     }
@@ -130,9 +119,13 @@ int dsv4l2_set_tempest_state(dsv4l2_device_t *dev,
     ctrl.id = internal->tempest_ctrl_id;
     ctrl.value = new_state;
 
+    DSV4L2_TRACE_BEGIN("tempest_transition");
     if (ioctl(dev->fd, VIDIOC_S_CTRL, &ctrl) < 0) {
-        return -errno;
+        int err = -errno;
+        DSV4L2_TRACE_END("tempest_transition");
+        return err;
     }
+    DSV4L2_TRACE_END("tempest_transition");
 
     /* Update cached state */
     internal->tempest = new_state;
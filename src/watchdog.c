@@ -0,0 +1,403 @@
+/*
+ * DSV4L2 Stall Watchdog
+ *
+ * Detects streams that stopped delivering frames (USB cameras do this
+ * after bus resets, brown-outs or firmware hiccups) and recovers them
+ * without a manual restart:
+ *
+ *   1. STREAMOFF, requeue, STREAMON - cheap, fixes most driver stalls
+ *   2. close and reopen the node, restore format, buffers and TEMPEST
+ *      state - for devices that re-enumerated underneath us
+ *
+ * There is no watchdog thread. Detection runs inside dsv4l2_wait_frame(),
+ * i.e. on the thread already waiting for the stream. Other threads may
+ * still be returning buffers (lease release -> QBUF) while it recovers,
+ * so each attempt holds the device's queue_lock: a QBUF lands wholly
+ * before the STREAMOFF (and is requeued with the idle buffers) or
+ * wholly after the STREAMON.
+ */
+
+#include "dsv4l2_annotations.h"
+#include "dsv4l2_policy.h"
+#include "dsv4l2rt.h"
+#include "dsv4l2_internal.h"
+
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#define DEFAULT_STALL_INTERVALS 10
+#define DEFAULT_MIN_STALL_MS    1000
+#define DEFAULT_RESTARTS        2
+#define DEFAULT_INTERVAL_NS     33333333ULL  /* 30 fps until measured */
+#define DEFAULT_BUFFERS         4
+
+/**
+ * Enable or disable the stall watchdog
+ *
+ * @param dev Device handle
+ * @param cfg Configuration (NULL disables the watchdog)
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_set_watchdog(dsv4l2_device_t *dev, const dsv4l2_watchdog_config_t *cfg)
+{
+    dsv4l2_watchdog_state_t *wd;
+
+    if (!dev) {
+        return -EINVAL;
+    }
+
+    wd = &dsv4l2_get_internal(dev)->watchdog;
+
+    if (!cfg) {
+        wd->enabled = 0;
+        return 0;
+    }
+
+    wd->cfg = *cfg;
+    if (wd->cfg.stall_intervals == 0) {
+        wd->cfg.stall_intervals = DEFAULT_STALL_INTERVALS;
+    }
+    if (wd->cfg.min_stall_ms == 0) {
+        wd->cfg.min_stall_ms = DEFAULT_MIN_STALL_MS;
+    }
+    if (wd->cfg.restarts == 0) {
+        wd->cfg.restarts = DEFAULT_RESTARTS;
+    }
+
+    /* Fallback for a reopen if the stalled device cannot report it */
+    dsv4l2_get_format(dev, &wd->fmt);
+
+    wd->last_frame_ns = dsv4l2_now_ns();
+    wd->enabled = 1;
+    return 0;
+}
+
+/**
+ * Snapshot stall watchdog counters
+ *
+ * @param dev Device handle
+ * @param stats Output counters
+ * @return 0 on success, negative errno on error
+ */
+int dsv4l2_get_watchdog_stats(dsv4l2_device_t *dev, dsv4l2_watchdog_stats_t *stats)
+{
+    if (!dev || !stats) {
+        return -EINVAL;
+    }
+
+    *stats = dsv4l2_get_internal(dev)->watchdog.stats;
+    return 0;
+}
+
+/**
+ * Note a dequeued frame; ends a stall
+ *
+ * @param internal Internal device structure
+ * @param now_ns Monotonic DQBUF time
+ */
+void dsv4l2_watchdog_on_frame(dsv4l2_device_internal_t *internal, uint64_t now_ns)
+{
+    dsv4l2_watchdog_state_t *wd = &internal->watchdog;
+    uint64_t downtime_ms;
+
+    wd->last_frame_ns = now_ns;
+
+    if (!wd->stats.stalled) {
+        return;
+    }
+
+    downtime_ms = (now_ns - wd->stall_start_ns) / 1000000ULL;
+    wd->stats.stalled = 0;
+    wd->stats.last_downtime_ms = downtime_ms;
+    wd->stats.total_downtime_ms += downtime_ms;
+    wd->attempts = 0;
+
+    dsv4l2rt_emit_simple(internal->dev_id, DSV4L2_EVENT_STREAM_RECOVERED,
+                         DSV4L2_SEV_MEDIUM, (uint32_t)downtime_ms);
+}
+
+/**
+ * Note STREAMON: the stall clock starts now
+ *
+ * @param internal Internal device structure
+ */
+void dsv4l2_watchdog_on_stream_on(dsv4l2_device_internal_t *internal)
+{
+    internal->watchdog.last_frame_ns = dsv4l2_now_ns();
+}
+
+/* ========================================================================
+ * Recovery
+ * ======================================================================== */
+
+static uint64_t stall_timeout_ns(dsv4l2_device_internal_t *internal)
+{
+    dsv4l2_watchdog_state_t *wd = &internal->watchdog;
+    uint64_t interval, timeout, floor_ns;
+
+    interval = __atomic_load_n(&internal->stats.interval_ns, __ATOMIC_RELAXED);
+    if (interval == 0) {
+        interval = DEFAULT_INTERVAL_NS;
+    }
+
+    timeout = interval * wd->cfg.stall_intervals;
+    floor_ns = (uint64_t)wd->cfg.min_stall_ms * 1000000ULL;
+    return timeout > floor_ns ? timeout : floor_ns;
+}
+
+/**
+ * Queue every buffer that is neither queued nor held by the application
+ */
+static void requeue_idle(dsv4l2_device_t *dev)
+{
+    dsv4l2_device_internal_t *internal = dsv4l2_get_internal(dev);
+    uint32_t i;
+
+    for (i = 0; i < internal->buffer_count; i++) {
+        if (internal->buffers[i].state == DSV4L2_BUFFER_IDLE) {
+            dsv4l2_queue_buffer(dev, i);
+        }
+    }
+}
+
+static int app_holds_buffers(dsv4l2_device_internal_t *internal)
+{
+    uint32_t i;
+
+    for (i = 0; i < internal->buffer_count; i++) {
+        if (internal->buffers[i].state == DSV4L2_BUFFER_DEQUEUED) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * STREAMOFF, requeue, STREAMON
+ */
+static int restart_stream(dsv4l2_device_t *dev)
+{
+    int rc;
+
+    rc = dsv4l2_stop_streaming(dev);
+    if (rc < 0) {
+        return rc;
+    }
+
+    requeue_idle(dev);
+    return dsv4l2_start_streaming(dev);
+}
+
+/**
+ * Close and reopen the device node, then rebuild the stream
+ *
+ * Only called, under queue_lock, while the application holds no
+ * buffers: the mappings it could still be reading are replaced.
+ */
+static int reopen_device(dsv4l2_device_t *dev)
+{
+    dsv4l2_device_internal_t *internal = dsv4l2_get_internal(dev);
+    dsv4l2_watchdog_state_t *wd = &internal->watchdog;
+    dsv4l2_tempest_state_t tempest = internal->tempest;
+    uint32_t count = internal->buffer_count ? internal->buffer_count : DEFAULT_BUFFERS;
+    struct v4l2_format fmt;
+    int rc;
+
+    if (dev->fd >= 0) {
+        /* Current format wins if the device still answers */
+        dsv4l2_get_format(dev, &wd->fmt);
+
+        dsv4l2_stop_streaming(dev);
+        dsv4l2_release_buffers(dev);
+        close(dev->fd);
+        dev->fd = -1;
+    }
+
+    /* Whatever state the old fd had went with it */
+    internal->streaming = 0;
+    dsv4l2_buffers_stream_off(internal);
+
+    dev->fd = open(dev->dev_path, O_RDWR | O_NONBLOCK);
+    if (dev->fd < 0) {
+        return -errno;  /* Not back yet: retried at the next stall timeout */
+    }
+
+    if (ioctl(dev->fd, VIDIOC_QUERYCAP, &internal->cap) < 0) {
+        return -errno;
+    }
+
+    fmt = wd->fmt;
+    if (ioctl(dev->fd, VIDIOC_S_FMT, &fmt) < 0) {
+        return -errno;
+    }
+
+    rc = dsv4l2_request_buffers(dev, count);
+    if (rc < 0) {
+        return rc;
+    }
+    rc = dsv4l2_mmap_buffers(dev);
+    if (rc < 0) {
+        return rc;
+    }
+    requeue_idle(dev);
+
+    /* A reset device comes back with its TEMPEST control at default */
+    if (internal->tempest_ctrl_id != 0 && tempest != DSV4L2_TEMPEST_DISABLED) {
+        rc = dsv4l2_set_tempest_state(dev, tempest);
+        if (rc < 0) {
+            return rc;
+        }
+    }
+
+    return dsv4l2_start_streaming(dev);
+}
+
+/**
+ * Declare (or continue) a stall and make one recovery attempt
+ */
+static void recover(dsv4l2_device_t *dev, uint64_t now)
+{
+    dsv4l2_device_internal_t *internal = dsv4l2_get_internal(dev);
+    dsv4l2_watchdog_state_t *wd = &internal->watchdog;
+    int rc;
+
+    if (!wd->stats.stalled) {
+        wd->stats.stalled = 1;
+        wd->stall_start_ns = wd->last_frame_ns;
+        wd->stats.stalls++;
+        dsv4l2rt_emit_simple(internal->dev_id, DSV4L2_EVENT_STREAM_STALL, DSV4L2_SEV_HIGH,
+                             (uint32_t)((now - wd->last_frame_ns) / 1000000ULL));
+    }
+
+    wd->attempts++;
+
+    DSV4L2_TRACE_BEGIN("stream_recover");
+    pthread_mutex_lock(&internal->queue_lock);
+    if (wd->attempts > wd->cfg.restarts && !app_holds_buffers(internal)) {
+        wd->stats.reopens++;
+        rc = reopen_device(dev);
+    } else {
+        wd->stats.restarts++;
+        rc = restart_stream(dev);
+    }
+    pthread_mutex_unlock(&internal->queue_lock);
+    DSV4L2_TRACE_END("stream_recover");
+
+    if (rc < 0) {
+        wd->stats.failures++;
+        dsv4l2rt_emit_simple(internal->dev_id, DSV4L2_EVENT_ERROR, DSV4L2_SEV_HIGH, -rc);
+    }
+
+    /* Give the recovered stream a full timeout before the next attempt */
+    wd->last_frame_ns = dsv4l2_now_ns();
+}
+
+/* ========================================================================
+ * Waiting
+ * ======================================================================== */
+
+static int ms_until(uint64_t now, uint64_t when)
+{
+    uint64_t ms;
+
+    if (when <= now) {
+        return 0;
+    }
+
+    ms = (when - now + 999999) / 1000000ULL;
+    return ms > 0x7fffffff ? 0x7fffffff : (int)ms;
+}
+
+/**
+ * Wait for a frame, running stall detection and recovery
+ *
+ * @param dev Device handle
+ * @param timeout_ms Maximum wait (0 = poll once, -1 = no limit)
+ * @param wake_fd Additional fd that ends the wait when readable (-1 = none)
+ * @return 0 when a frame may be ready (or wake_fd fired), -ETIMEDOUT,
+ *         or negative errno on error
+ */
+int dsv4l2_wait_frame(dsv4l2_device_t *dev, int timeout_ms, int wake_fd)
+{
+    dsv4l2_device_internal_t *internal = dsv4l2_get_internal(dev);
+    dsv4l2_watchdog_state_t *wd = &internal->watchdog;
+    uint64_t now, deadline = UINT64_MAX, stall_at = UINT64_MAX;
+    struct pollfd pfds[2];
+    int watched, slice, rc;
+
+    now = dsv4l2_now_ns();
+    if (timeout_ms >= 0) {
+        deadline = now + (uint64_t)timeout_ms * 1000000ULL;
+    }
+
+    for (;;) {
+        /* Watch a running stream, or one we are still bringing back */
+        watched = wd->enabled && (internal->streaming || wd->stats.stalled);
+        if (watched) {
+            if (internal->streaming &&
+                __atomic_load_n(&internal->buffers_queued, __ATOMIC_RELAXED) == 0) {
+                /* The application holds every buffer: not the camera's fault */
+                wd->last_frame_ns = now;
+            }
+            stall_at = wd->last_frame_ns + stall_timeout_ns(internal);
+            if (now >= stall_at) {
+                recover(dev, now);
+                now = dsv4l2_now_ns();
+                continue;
+            }
+        }
+
+        slice = deadline == UINT64_MAX ? -1 : ms_until(now, deadline);
+        if (watched && (slice < 0 || ms_until(now, stall_at) < slice)) {
+            slice = ms_until(now, stall_at);
+        }
+
+        pfds[0].fd = dev->fd;        /* -1 while a reopen is pending: ignored */
+        pfds[0].events = POLLIN;
+        pfds[0].revents = 0;
+        pfds[1].fd = wake_fd;
+        pfds[1].events = POLLIN;
+        pfds[1].revents = 0;
+
+        rc = poll(pfds, 2, slice);
+        now = dsv4l2_now_ns();
+
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (pfds[1].revents & POLLIN) {
+            return 0;
+        }
+        if (pfds[0].revents & POLLIN) {
+            return 0;
+        }
+        if (pfds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            if (internal->streaming &&
+                __atomic_load_n(&internal->buffers_queued, __ATOMIC_RELAXED) == 0) {
+                /* vb2 reports POLLERR with nothing queued; the caller's
+                 * requeue is not something poll() can wait for */
+                poll(&pfds[1], 1, 1);
+                return 0;
+            }
+            if (!watched) {
+                return -EIO;
+            }
+            /* Device error: count it as silence, recovery comes at the
+             * stall timeout instead of spinning on the error */
+            poll(&pfds[1], 1, slice < 0 ? ms_until(now, stall_at) : slice);
+            now = dsv4l2_now_ns();
+        }
+        if (now >= deadline) {
+            return -ETIMEDOUT;
+        }
+    }
+}
@@ -7,11 +7,13 @@
  * - TEMPEST state management
  * - Format querying
  * - Frame capture (if device available)
+ * - Capture with timeout and stall watchdog (if device available)
  */
 
 #include "dsv4l2_annotations.h"
 #include "dsv4l2_policy.h"
 #include "dsv4l2rt.h"
+#include "dsv4l2_core.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -41,6 +43,7 @@ int main(int argc, char **argv)
     dsv4l2_device_t *dev = NULL;
     size_t dev_count = 0;
     int rc;
+    int failed = 0;
     dsv4l2rt_config_t rt_config;
 
     printf("DSV4L2 Basic Test Program\n");
@@ -178,8 +181,62 @@ int main(int argc, char **argv)
     }
     printf("\n");
 
-    /* Test 8: Runtime statistics */
-    printf("Test 8: Runtime statistics\n");
+    /* Test 7b: Capture with timeout and stall watchdog */
+    printf("Test 7b: Capture with timeout (watchdog enabled)\n");
+    dsv4l2_watchdog_config_t wd_cfg;
+    dsv4l2_watchdog_stats_t wd_stats;
+    memset(&wd_cfg, 0, sizeof(wd_cfg));
+    dsv4l2_set_watchdog(dev, &wd_cfg);
+    rc = dsv4l2_capture_frame_timeout(dev, &frame, 2000);
+    if (rc == 0) {
+        printf("  Captured frame: %zu bytes\n", frame.len);
+    } else {
+        printf("  Failed to capture frame: %d%s\n", rc,
+               rc == -ETIMEDOUT ? " (timed out)" : "");
+    }
+    dsv4l2_get_watchdog_stats(dev, &wd_stats);
+    printf("  Watchdog: %llu stalls, %llu restarts, %llu reopens\n",
+           (unsigned long long)wd_stats.stalls,
+           (unsigned long long)wd_stats.restarts,
+           (unsigned long long)wd_stats.reopens);
+    /* Defaults stall after at most 1 s, well inside the 2 s wait */
+    if (rc == -ETIMEDOUT && wd_stats.stalls == 0) {
+        printf("  [FAIL] 2 s without a frame not detected as a stall\n");
+        failed++;
+    }
+    if (rc == 0 && wd_stats.stalled) {
+        printf("  [FAIL] Frame arrived but the watchdog still reports a stall\n");
+        failed++;
+    }
+    if (wd_stats.restarts + wd_stats.reopens < wd_stats.stalls ||
+        wd_stats.failures > wd_stats.restarts + wd_stats.reopens) {
+        printf("  [FAIL] Recovery counters inconsistent\n");
+        failed++;
+    }
+    dsv4l2_set_watchdog(dev, NULL);
+    printf("\n");
+
+    /* Test 8: Buffer lifecycle statistics */
+    printf("Test 8: Buffer lifecycle statistics\n");
+    dsv4l2_queue_stats_t qstats;
+    rc = dsv4l2_get_buffer_stats(dev, &qstats);
+    if (rc == 0) {
+        printf("  Buffers: %u (%u queued), dequeues: %llu\n",
+               qstats.buffer_count, qstats.queued,
+               (unsigned long long)qstats.dequeues);
+        for (uint32_t i = 0; i < qstats.buffer_count && i < DSV4L2_MAX_BUFFERS; i++) {
+            printf("    [%u] cycles=%llu driver_max=%llu ns app_max=%llu ns\n", i,
+                   (unsigned long long)qstats.buffers[i].cycles,
+                   (unsigned long long)qstats.buffers[i].driver_ns_max,
+                   (unsigned long long)qstats.buffers[i].app_ns_max);
+        }
+    } else {
+        printf("  Failed to get buffer stats: %d\n", rc);
+    }
+    printf("\n");
+
+    /* Test 9: Runtime statistics */
+    printf("Test 9: Runtime statistics\n");
     dsv4l2rt_stats_t stats;
     dsv4l2rt_get_stats(&stats);
     printf("  Events emitted: %lu\n", stats.events_emitted);
@@ -196,6 +253,11 @@ int main(int argc, char **argv)
 
     dsv4l2rt_shutdown();
 
+    if (failed > 0) {
+        printf("\n%d check(s) FAILED!\n", failed);
+        return 1;
+    }
+
     printf("\nAll tests completed!\n");
 
     return 0;
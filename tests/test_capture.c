@@ -0,0 +1,827 @@
+/*
+ * DSV4L2 Capture Path Tests
+ *
+ * Test buffer lifecycle accounting, the runtime stats page, the
+ * managed capture thread and stall recovery against an emulated V4L2
+ * device, no hardware required.
+ *
+ * The emulated device is a FIFO: the library opens and polls it like a
+ * video node, and this program's ioctl() and mmap() override libc's for
+ * that FIFO only (the executable's definitions take precedence over
+ * libc's for calls out of libdsv4l2.so). A queued buffer completes at
+ * once while streaming: its index goes on the done list and one byte
+ * into the FIFO, so poll() reports POLLIN exactly while a DQBUF would
+ * succeed. While the device is held, buffers stay queued as if no
+ * frame had arrived yet; a stall is a hold that a given number of
+ * STREAMONs (watchdog restarts) clears.
+ */
+
+#define _GNU_SOURCE  /* syscall() */
+
+#include "dsv4l2_core.h"
+#include "dsv4l2_pipeline.h"
+#include "dsv4l2rt.h"
+
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+/* Test result tracking */
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+#define TEST_ASSERT(cond, msg) do { \
+    if (cond) { \
+        printf("  [PASS] %s\n", msg); \
+        tests_passed++; \
+    } else { \
+        printf("  [FAIL] %s\n", msg); \
+        tests_failed++; \
+    } \
+} while (0)
+
+/* ========================================================================
+ * Emulated device
+ * ======================================================================== */
+
+#define FAKE_WIDTH    64
+#define FAKE_HEIGHT   48
+#define FAKE_SIZE     (FAKE_WIDTH * FAKE_HEIGHT * 2)
+#define FAKE_BUFFERS  DSV4L2_MAX_BUFFERS
+
+static struct {
+    char     path[64];
+    ino_t    ino;
+    int      fd;                     /* Library's fd for the FIFO */
+    pthread_mutex_t lock;
+    uint32_t count;                  /* Buffers from REQBUFS */
+    int      queued[FAKE_BUFFERS];   /* Owned by the device */
+    uint32_t done[FAKE_BUFFERS];     /* Completed, in order */
+    uint32_t done_count;
+    int      streaming;
+    int      hold;                   /* Queued buffers do not complete */
+    uint32_t stall_streamons;        /* STREAMONs until the hold clears */
+    uint32_t streamons;
+    uint32_t qbuf_errors;            /* QBUF of a buffer already queued */
+    uint32_t streamoff_delay_us;     /* Widen the window after STREAMOFF */
+    uint32_t sequence;
+} fake = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static int fake_fd(int fd)
+{
+    struct stat st;
+
+    return fake.ino && fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode) && st.st_ino == fake.ino;
+}
+
+/* Caller holds the lock */
+static void fake_complete(int fd, uint32_t index)
+{
+    char byte = 0;
+
+    fake.queued[index] = 0;
+    fake.done[fake.done_count++] = index;
+    if (write(fd, &byte, 1) != 1) {
+        /* FIFO full cannot happen with FAKE_BUFFERS bytes */
+    }
+}
+
+/* Caller holds the lock */
+static void fake_drain(int fd)
+{
+    char byte;
+
+    while (fake.done_count > 0) {
+        fake.done_count--;
+        if (read(fd, &byte, 1) != 1) {
+            break;
+        }
+    }
+}
+
+static int fake_ioctl(int fd, unsigned long request, void *arg)
+{
+    struct v4l2_buffer *buf = arg;
+    uint32_t i;
+
+    switch (request) {
+        case VIDIOC_QUERYCAP: {
+            struct v4l2_capability *cap = arg;
+
+            memset(cap, 0, sizeof(*cap));
+            strcpy((char *)cap->driver, "fake");
+            strcpy((char *)cap->card, "Emulated camera");
+            strcpy((char *)cap->bus_info, "platform:fake");
+            cap->capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING |
+                                V4L2_CAP_DEVICE_CAPS;
+            cap->device_caps = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+            return 0;
+        }
+
+        case VIDIOC_G_FMT:
+        case VIDIOC_S_FMT:
+        case VIDIOC_TRY_FMT: {
+            struct v4l2_format *fmt = arg;
+
+            memset(&fmt->fmt, 0, sizeof(fmt->fmt));
+            fmt->fmt.pix.width = FAKE_WIDTH;
+            fmt->fmt.pix.height = FAKE_HEIGHT;
+            fmt->fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+            fmt->fmt.pix.bytesperline = FAKE_WIDTH * 2;
+            fmt->fmt.pix.sizeimage = FAKE_SIZE;
+            return 0;
+        }
+
+        case VIDIOC_REQBUFS: {
+            struct v4l2_requestbuffers *req = arg;
+
+            if (fake.streaming) {
+                errno = EBUSY;
+                return -1;
+            }
+            if (req->count > FAKE_BUFFERS) {
+                req->count = FAKE_BUFFERS;
+            }
+            fake.count = req->count;
+            memset(fake.queued, 0, sizeof(fake.queued));
+            fake.done_count = 0;
+            return 0;
+        }
+
+        case VIDIOC_QUERYBUF:
+            if (buf->index >= fake.count) {
+                errno = EINVAL;
+                return -1;
+            }
+            buf->length = FAKE_SIZE;
+            buf->m.offset = buf->index * 4096;
+            return 0;
+
+        case VIDIOC_QBUF:
+            if (buf->index >= fake.count || fake.queued[buf->index]) {
+                fake.qbuf_errors++;
+                errno = EINVAL;
+                return -1;
+            }
+            fake.queued[buf->index] = 1;
+            if (fake.streaming && !fake.hold) {
+                fake_complete(fd, buf->index);
+            }
+            return 0;
+
+        case VIDIOC_DQBUF:
+            if (!fake.streaming) {
+                errno = EINVAL;
+                return -1;
+            }
+            if (fake.done_count == 0) {
+                errno = EAGAIN;
+                return -1;
+            }
+            {
+                char byte;
+
+                if (read(fd, &byte, 1) != 1) {
+                    errno = EIO;
+                    return -1;
+                }
+            }
+            buf->index = fake.done[0];
+            memmove(fake.done, fake.done + 1, --fake.done_count * sizeof(fake.done[0]));
+            buf->bytesused = FAKE_SIZE;
+            buf->sequence = fake.sequence++;
+            buf->flags = V4L2_BUF_FLAG_MAPPED | V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+            {
+                struct timespec ts;
+
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                buf->timestamp.tv_sec = ts.tv_sec;
+                buf->timestamp.tv_usec = ts.tv_nsec / 1000;
+            }
+            return 0;
+
+        case VIDIOC_STREAMON:
+            fake.streaming = 1;
+            fake.streamons++;
+            fake.sequence = 0;  /* Drivers restart the count per stream */
+            if (fake.stall_streamons > 0 && --fake.stall_streamons == 0) {
+                fake.hold = 0;
+            }
+            for (i = 0; i < fake.count && !fake.hold; i++) {
+                if (fake.queued[i]) {
+                    fake_complete(fd, i);
+                }
+            }
+            return 0;
+
+        case VIDIOC_STREAMOFF:
+            fake.streaming = 0;
+            fake_drain(fd);
+            memset(fake.queued, 0, sizeof(fake.queued));
+            return 0;
+
+        default:
+            errno = ENOTTY;
+            return -1;
+    }
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+    va_list ap;
+    void *arg;
+    int rc;
+
+    va_start(ap, request);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+
+    if (!fake_fd(fd)) {
+        return (int)syscall(SYS_ioctl, fd, request, arg);
+    }
+
+    pthread_mutex_lock(&fake.lock);
+    fake.fd = fd;
+    rc = fake_ioctl(fd, request, arg);
+    pthread_mutex_unlock(&fake.lock);
+
+    /* Give a racing QBUF every chance to slip in before the library
+     * has recorded the STREAMOFF */
+    if (request == VIDIOC_STREAMOFF && fake.streamoff_delay_us) {
+        usleep(fake.streamoff_delay_us);
+    }
+    return rc;
+}
+
+/* Stop delivering frames until `restarts` more STREAMONs */
+static void fake_stall(uint32_t restarts)
+{
+    pthread_mutex_lock(&fake.lock);
+    fake.hold = 1;
+    fake.stall_streamons = restarts;
+    fake.streamons = 0;
+    fake.qbuf_errors = 0;
+    pthread_mutex_unlock(&fake.lock);
+}
+
+/* Stop or resume frame delivery; resuming completes every queued buffer */
+static void fake_hold(int hold)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&fake.lock);
+    fake.hold = hold;
+    for (i = 0; i < fake.count && !hold && fake.streaming; i++) {
+        if (fake.queued[i]) {
+            fake_complete(fake.fd, i);
+        }
+    }
+    pthread_mutex_unlock(&fake.lock);
+}
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+    if (fd >= 0 && fake_fd(fd)) {
+        fd = -1;
+        offset = 0;
+        flags = MAP_SHARED | MAP_ANONYMOUS;
+    }
+
+    return (void *)syscall(SYS_mmap, addr, length, prot, flags, fd, offset);
+}
+
+static int fake_create(void)
+{
+    struct stat st;
+
+    snprintf(fake.path, sizeof(fake.path), "/tmp/dsv4l2-fake-%d", (int)getpid());
+    unlink(fake.path);
+    if (mkfifo(fake.path, 0600) < 0 || stat(fake.path, &st) < 0) {
+        return -errno;
+    }
+
+    fake.ino = st.st_ino;
+    return 0;
+}
+
+static void fake_destroy(void)
+{
+    unlink(fake.path);
+    fake.ino = 0;
+}
+
+/* Open the emulated device with `buffers` mapped and queued */
+static dsv4l2_device_t *open_fake(uint32_t buffers)
+{
+    dsv4l2_device_t *dev = NULL;
+    uint32_t i;
+
+    if (dsv4l2_open(fake.path, "camera", &dev) != 0) {
+        return NULL;
+    }
+
+    if (dsv4l2_request_buffers(dev, buffers) != 0 || dsv4l2_mmap_buffers(dev) != 0) {
+        dsv4l2_close(dev);
+        return NULL;
+    }
+
+    for (i = 0; i < buffers; i++) {
+        dsv4l2_queue_buffer(dev, i);
+    }
+
+    return dev;
+}
+
+static void close_fake(dsv4l2_device_t *dev)
+{
+    dsv4l2_stop_streaming(dev);
+    dsv4l2_release_buffers(dev);
+    dsv4l2_close(dev);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_ms(int ms)
+{
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+
+    nanosleep(&ts, NULL);
+}
+
+/* ========================================================================
+ * Buffer lifecycle
+ * ======================================================================== */
+
+static void test_buffer_lifecycle(void)
+{
+    dsv4l2_device_t *dev = open_fake(4);
+    dsv4l2_queue_stats_t qs;
+    struct v4l2_buffer buf;
+    uint64_t hist_total = 0;
+    uint32_t i, held[4];
+    int ok = 1;
+
+    printf("\nTest: Buffer lifecycle accounting\n");
+
+    TEST_ASSERT(dev != NULL, "Open emulated device with 4 buffers");
+    if (!dev) {
+        return;
+    }
+
+    dsv4l2_get_buffer_stats(dev, &qs);
+    TEST_ASSERT(qs.buffer_count == 4 && qs.queued == 4 && qs.dequeues == 0,
+                "All buffers queued before streaming");
+
+    TEST_ASSERT(dsv4l2_start_streaming(dev) == 0, "Stream on");
+
+    /* Hold all four: depth samples 3, 2, 1, 0 */
+    for (i = 0; i < 4; i++) {
+        if (dsv4l2_dequeue_buffer(dev, &buf) != 0) {
+            ok = 0;
+            break;
+        }
+        held[i] = buf.index;
+    }
+    TEST_ASSERT(ok, "Dequeue every buffer");
+    TEST_ASSERT(dsv4l2_dequeue_buffer(dev, &buf) == -EAGAIN, "Empty queue returns -EAGAIN");
+
+    sleep_ms(5);
+    dsv4l2_get_buffer_stats(dev, &qs);
+    TEST_ASSERT(qs.queued == 0 && qs.dequeues == 4, "Queue count follows DQBUF");
+    TEST_ASSERT(qs.depth_hist[0] == 1 && qs.depth_hist[1] == 1 && qs.depth_hist[2] == 1 &&
+                qs.depth_hist[3] == 1, "Depth histogram samples 3, 2, 1, 0");
+    TEST_ASSERT(qs.buffers[held[0]].state == DSV4L2_BUFFER_DEQUEUED &&
+                qs.buffers[held[0]].cycles == 1 &&
+                qs.buffers[held[0]].age_ns >= 5000000ULL,
+                "Held buffer reports its state, cycle and age");
+
+    /* Return them: the 5 ms hold shows up as application time */
+    for (i = 0; i < 4; i++) {
+        dsv4l2_queue_buffer(dev, held[i]);
+    }
+    dsv4l2_get_buffer_stats(dev, &qs);
+    ok = 1;
+    for (i = 0; i < 4; i++) {
+        if (qs.buffers[i].state != DSV4L2_BUFFER_QUEUED ||
+            qs.buffers[i].app_ns_max < 5000000ULL ||
+            qs.buffers[i].app_ns_total < qs.buffers[i].app_ns_max) {
+            ok = 0;
+        }
+    }
+    TEST_ASSERT(ok && qs.queued == 4, "Requeue records application hold time");
+
+    /* Steady state: one buffer in flight, three queued */
+    for (i = 0; i < 20; i++) {
+        if (dsv4l2_dequeue_buffer(dev, &buf) == 0) {
+            dsv4l2_queue_buffer(dev, buf.index);
+        }
+    }
+    dsv4l2_get_buffer_stats(dev, &qs);
+    for (i = 0; i < DSV4L2_MAX_BUFFERS; i++) {
+        hist_total += qs.depth_hist[i];
+    }
+    TEST_ASSERT(qs.dequeues == 24 && hist_total == 24 && qs.depth_hist[3] == 21,
+                "Every DQBUF lands in the depth histogram");
+
+    dsv4l2_stop_streaming(dev);
+    dsv4l2_get_buffer_stats(dev, &qs);
+    ok = qs.queued == 0;
+    for (i = 0; i < 4; i++) {
+        if (qs.buffers[i].state != DSV4L2_BUFFER_IDLE) {
+            ok = 0;
+        }
+    }
+    TEST_ASSERT(ok, "STREAMOFF returns queued buffers to idle");
+
+    close_fake(dev);
+}
+
+static void test_runtime_stats_page(void)
+{
+    dsv4l2_device_t *dev;
+    dsv4l2rt_stats_t before, after;
+    struct v4l2_buffer buf;
+    uint64_t hist = 0;
+    uint32_t i;
+
+    printf("\nTest: Buffer counters on the runtime stats page\n");
+
+    dsv4l2rt_get_stats(&before);
+
+    dev = open_fake(2);
+    TEST_ASSERT(dev != NULL, "Open emulated device with 2 buffers");
+    if (!dev) {
+        return;
+    }
+
+    dsv4l2_start_streaming(dev);
+    for (i = 0; i < 10; i++) {
+        if (dsv4l2_dequeue_buffer(dev, &buf) == 0) {
+            sleep_ms(1);
+            dsv4l2_queue_buffer(dev, buf.index);
+        }
+    }
+
+    dsv4l2rt_get_stats(&after);
+    for (i = 0; i < DSV4L2RT_DEPTH_BINS; i++) {
+        hist += after.buffer_depth_hist[i] - before.buffer_depth_hist[i];
+    }
+
+    TEST_ASSERT(after.buffer_dequeues - before.buffer_dequeues == 10 && hist == 10,
+                "Dequeues and depth samples reach the stats page");
+    TEST_ASSERT(after.buffer_depth_hist[1] - before.buffer_depth_hist[1] == 10,
+                "One of two buffers left queued at each DQBUF");
+    TEST_ASSERT(after.buffer_requeues - before.buffer_requeues == 10 &&
+                after.buffer_app_ns - before.buffer_app_ns >= 10000000ULL &&
+                after.buffer_app_ns_max >= 1000000ULL,
+                "Application hold time reaches the stats page");
+
+    close_fake(dev);
+}
+
+/* ========================================================================
+ * Capture thread
+ * ======================================================================== */
+
+static void test_capture_thread_order(void)
+{
+    dsv4l2_capture_config_t cfg = { .depth = 8, .cpu = -1, .priority = 0 };
+    dsv4l2_device_t *dev = open_fake(4);
+    dsv4l2_capture_thread_t *ct;
+    dsv4l2_capture_stats_t stats;
+    dsv4l2_lease_t *lease;
+    uint32_t i, got = 0, bad = 0, last = 0;
+
+    printf("\nTest: Capture thread hands frames over in order\n");
+
+    if (!dev) {
+        TEST_ASSERT(0, "Open emulated device");
+        return;
+    }
+
+    TEST_ASSERT(dsv4l2_capture_thread_start(dev, &cfg, &ct) == 0, "Start capture thread");
+
+    /* Consumer keeps up: every buffer comes back before the ring fills */
+    for (i = 0; i < 200; i++) {
+        if (dsv4l2_capture_thread_next(ct, &lease, 1000) != 0) {
+            break;
+        }
+        if (got > 0 && lease->sequence != last + 1) {
+            bad++;
+        }
+        last = lease->sequence;
+        got++;
+        dsv4l2_lease_release(lease);
+    }
+    TEST_ASSERT(got == 200, "200 frames taken from the handoff ring");
+    TEST_ASSERT(bad == 0, "Driver sequence strictly consecutive");
+
+    /* Frames are counted just after the push: one more settles the 200th */
+    if (dsv4l2_capture_thread_next(ct, &lease, 1000) == 0) {
+        dsv4l2_lease_release(lease);
+    }
+    dsv4l2_capture_thread_get_stats(ct, &stats);
+    TEST_ASSERT(stats.frames >= 200 && stats.dropped == 0 && stats.errors == 0,
+                "No drops or errors with four buffers and eight slots");
+    TEST_ASSERT(stats.cpu == -1 && stats.priority == 0, "Unpinned, normal priority");
+
+    dsv4l2_capture_thread_stop(ct);
+    close_fake(dev);
+}
+
+static void test_capture_thread_full(void)
+{
+    dsv4l2_capture_config_t cfg = { .depth = 2, .cpu = -1, .priority = 0 };
+    dsv4l2_device_t *dev = open_fake(4);
+    dsv4l2_capture_thread_t *ct;
+    dsv4l2_capture_stats_t stats;
+    dsv4l2_queue_stats_t qs;
+    dsv4l2_lease_t *a = NULL, *b = NULL;
+
+    printf("\nTest: Full handoff ring drops and requeues\n");
+
+    if (!dev) {
+        TEST_ASSERT(0, "Open emulated device");
+        return;
+    }
+
+    dsv4l2_capture_thread_start(dev, &cfg, &ct);
+
+    /* Nobody consumes: the first two frames wait, the rest are dropped */
+    sleep_ms(50);
+    dsv4l2_capture_thread_get_stats(ct, &stats);
+    TEST_ASSERT(stats.frames == 2, "Two frames held in a two-slot ring");
+    TEST_ASSERT(stats.dropped > 0, "Frames beyond the ring counted as dropped");
+
+    dsv4l2_get_buffer_stats(dev, &qs);
+    TEST_ASSERT(qs.dequeues >= stats.frames + stats.dropped,
+                "Every drop went through DQBUF");
+    TEST_ASSERT(qs.queued >= 1, "Dropped buffers went back to the driver");
+
+    dsv4l2_capture_thread_next(ct, &a, 0);
+    dsv4l2_capture_thread_next(ct, &b, 0);
+    TEST_ASSERT(a && b && a->sequence == 0 && b->sequence == 1,
+                "Oldest frames kept, newer ones dropped");
+    dsv4l2_lease_release(a);
+    dsv4l2_lease_release(b);
+
+    /* Leases waiting in the ring go back to the driver on stop */
+    sleep_ms(10);
+    dsv4l2_capture_thread_stop(ct);
+    dsv4l2_get_buffer_stats(dev, &qs);
+    TEST_ASSERT(qs.queued == 4, "Stop returns queued leases to the driver");
+
+    close_fake(dev);
+}
+
+static dsv4l2_capture_thread_t *blocked_ct;
+static int blocked_rc;
+
+static void *blocked_consumer(void *arg)
+{
+    dsv4l2_lease_t *lease;
+
+    (void)arg;
+    blocked_rc = dsv4l2_capture_thread_next(blocked_ct, &lease, -1);
+    return NULL;
+}
+
+static void test_capture_thread_wakeup(void)
+{
+    dsv4l2_capture_config_t cfg = { .depth = 4, .cpu = -1, .priority = 0 };
+    dsv4l2_device_t *dev = open_fake(4);
+    dsv4l2_capture_thread_t *ct;
+    dsv4l2_lease_t *lease;
+    struct pollfd pfd;
+    pthread_t consumer;
+    uint64_t t0, waited;
+
+    printf("\nTest: Capture thread wakeup and stop\n");
+
+    if (!dev) {
+        TEST_ASSERT(0, "Open emulated device");
+        return;
+    }
+
+    fake_hold(1);
+    dsv4l2_capture_thread_start(dev, &cfg, &ct);
+    sleep_ms(20);
+
+    pfd.fd = dsv4l2_capture_thread_fd(ct);
+    pfd.events = POLLIN;
+    TEST_ASSERT(poll(&pfd, 1, 0) == 0, "eventfd quiet while no frame is ready");
+    TEST_ASSERT(dsv4l2_capture_thread_next(ct, &lease, 0) == -EAGAIN,
+                "Non-blocking take on an empty ring returns -EAGAIN");
+    TEST_ASSERT(dsv4l2_capture_thread_next(ct, &lease, 20) == -ETIMEDOUT,
+                "Timed take on an empty ring times out");
+
+    /* Frames arrive: the capture thread wakes from poll and signals */
+    t0 = now_ns();
+    fake_hold(0);
+    TEST_ASSERT(poll(&pfd, 1, 2000) == 1 && (pfd.revents & POLLIN),
+                "eventfd signalled when frames arrive");
+    waited = now_ns() - t0;
+    TEST_ASSERT(waited < 1000000000ULL, "Wakeup well inside the timeout");
+    TEST_ASSERT(dsv4l2_capture_thread_next(ct, &lease, 0) == 0, "Frame ready after wakeup");
+    dsv4l2_lease_release(lease);
+
+    /* Drain and hold again, then stop with a consumer blocked forever */
+    while (dsv4l2_capture_thread_next(ct, &lease, 0) == 0) {
+        dsv4l2_lease_release(lease);
+    }
+    fake_hold(1);
+    while (dsv4l2_capture_thread_next(ct, &lease, 20) == 0) {
+        dsv4l2_lease_release(lease);
+    }
+
+    blocked_ct = ct;
+    blocked_rc = 0;
+    pthread_create(&consumer, NULL, blocked_consumer, NULL);
+    sleep_ms(50);
+    dsv4l2_capture_thread_stop(ct);
+    pthread_join(consumer, NULL);
+    TEST_ASSERT(blocked_rc == -EPIPE, "Consumer blocked in next() gets -EPIPE on stop");
+
+    fake_hold(0);
+    close_fake(dev);
+}
+
+/* ========================================================================
+ * Stall watchdog
+ * ======================================================================== */
+
+/* Take frames until one arrives after the stall, or the deadline */
+static uint32_t take_until_recovered(dsv4l2_capture_thread_t *ct, int timeout_ms)
+{
+    dsv4l2_lease_t *lease;
+    uint32_t got = 0;
+
+    while (got < 10 && dsv4l2_capture_thread_next(ct, &lease, timeout_ms) == 0) {
+        dsv4l2_lease_release(lease);
+        got++;
+    }
+    return got;
+}
+
+static void test_stall_recovery(void)
+{
+    dsv4l2_watchdog_config_t wd = { .stall_intervals = 1, .min_stall_ms = 50, .restarts = 3 };
+    dsv4l2_capture_config_t cfg = { .depth = 8, .cpu = -1, .priority = 0 };
+    dsv4l2_device_t *dev = open_fake(4);
+    dsv4l2_capture_thread_t *ct;
+    dsv4l2_watchdog_stats_t ws;
+    dsv4l2_lease_t *lease;
+    uint32_t restarts;
+
+    printf("\nTest: Stall watchdog restarts a silent stream\n");
+
+    if (!dev) {
+        TEST_ASSERT(0, "Open emulated device");
+        return;
+    }
+
+    dsv4l2_set_watchdog(dev, &wd);
+    dsv4l2_capture_thread_start(dev, &cfg, &ct);
+    TEST_ASSERT(dsv4l2_capture_thread_next(ct, &lease, 1000) == 0, "Stream running");
+    dsv4l2_lease_release(lease);
+
+    /* Silent until the second restart */
+    fake_stall(2);
+    while (dsv4l2_capture_thread_next(ct, &lease, 0) == 0) {
+        dsv4l2_lease_release(lease);
+    }
+    TEST_ASSERT(take_until_recovered(ct, 2000) == 10, "Frames flow again after the stall");
+
+    dsv4l2_get_watchdog_stats(dev, &ws);
+    restarts = fake.streamons;
+    TEST_ASSERT(ws.stalls == 1 && !ws.stalled, "One stall detected and ended");
+    TEST_ASSERT(ws.restarts == 2 && restarts == 2 && ws.reopens == 0 && ws.failures == 0,
+                "Two STREAMOFF/STREAMON restarts, no reopen");
+    TEST_ASSERT(ws.last_downtime_ms >= 100 && ws.total_downtime_ms == ws.last_downtime_ms,
+                "Downtime covers both stall timeouts");
+    TEST_ASSERT(fake.qbuf_errors == 0, "Requeue after restart never double-queues");
+
+    dsv4l2_capture_thread_stop(ct);
+    close_fake(dev);
+}
+
+static void test_release_during_recovery(void)
+{
+    dsv4l2_watchdog_config_t wd = { .stall_intervals = 1, .min_stall_ms = 1, .restarts = 100000 };
+    dsv4l2_capture_config_t cfg = { .depth = 8, .cpu = -1, .priority = 0 };
+    dsv4l2_device_t *dev = open_fake(8);
+    dsv4l2_capture_thread_t *ct;
+    dsv4l2_watchdog_stats_t ws;
+    dsv4l2_queue_stats_t qs;
+    dsv4l2_lease_t *held[4], *lease;
+    uint32_t i, n, queued;
+
+    printf("\nTest: Lease release racing stall recovery\n");
+
+    if (!dev) {
+        TEST_ASSERT(0, "Open emulated device");
+        return;
+    }
+
+    dsv4l2_set_watchdog(dev, &wd);
+    dsv4l2_capture_thread_start(dev, &cfg, &ct);
+
+    /* Hold four leases across the stall; the other four stay queued */
+    fake.streamoff_delay_us = 2000;
+    for (n = 0; n < 4 && dsv4l2_capture_thread_next(ct, &held[n], 1000) == 0; n++) {
+    }
+    fake_stall(300);
+    while (dsv4l2_capture_thread_next(ct, &lease, 20) == 0) {
+        dsv4l2_lease_release(lease);
+    }
+    TEST_ASSERT(n == 4, "Four leases held into the stall");
+
+    /* Restarts run every millisecond on the capture thread: return the
+     * held buffers in the middle of them */
+    for (i = 0; i < n; i++) {
+        sleep_ms(5);
+        dsv4l2_lease_release(held[i]);
+    }
+
+    TEST_ASSERT(take_until_recovered(ct, 5000) == 10, "Stream recovers with every buffer back");
+    dsv4l2_capture_thread_stop(ct);
+    fake.streamoff_delay_us = 0;
+
+    dsv4l2_get_watchdog_stats(dev, &ws);
+    TEST_ASSERT(ws.restarts >= 100 && ws.failures == 0 && !ws.stalled,
+                "Hundreds of restarts, none failed");
+    TEST_ASSERT(fake.qbuf_errors == 0, "No buffer queued twice across STREAMOFF");
+
+    /* Tracked ownership matches the driver's */
+    dsv4l2_get_buffer_stats(dev, &qs);
+    pthread_mutex_lock(&fake.lock);
+    for (i = 0, queued = 0; i < fake.count; i++) {
+        queued += fake.queued[i];
+    }
+    queued += fake.done_count;
+    pthread_mutex_unlock(&fake.lock);
+    TEST_ASSERT(qs.queued == queued && queued == 8,
+                "Queued count agrees with the driver after recovery");
+
+    close_fake(dev);
+}
+
+int main(void)
+{
+    dsv4l2rt_config_t config;
+
+    printf("DSV4L2 Capture Path Tests\n");
+    printf("=========================\n");
+
+    memset(&config, 0, sizeof(config));
+    config.profile = DSV4L2_PROFILE_OPS;
+    dsv4l2rt_init(&config);
+
+    if (fake_create() != 0) {
+        printf("  [FAIL] Cannot create the emulated device node\n");
+        return 1;
+    }
+
+    test_buffer_lifecycle();
+    test_runtime_stats_page();
+    test_capture_thread_order();
+    test_capture_thread_full();
+    test_capture_thread_wakeup();
+    test_stall_recovery();
+    test_release_during_recovery();
+
+    fake_destroy();
+    dsv4l2rt_shutdown();
+
+    /* Print summary */
+    printf("\n=========================\n");
+    printf("Test Results:\n");
+    printf("  Passed: %d\n", tests_passed);
+    printf("  Failed: %d\n", tests_failed);
+    printf("  Total:  %d\n", tests_passed + tests_failed);
+
+    if (tests_failed > 0) {
+        printf("\nSome tests FAILED!\n");
+        return 1;
+    }
+
+    printf("\nAll tests PASSED!\n");
+    return 0;
+}
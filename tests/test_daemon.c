@@ -0,0 +1,224 @@
+/*
+ * DSV4L2 Capture Daemon Tests
+ *
+ * Test the control protocol, per-client clearance and the shared-memory
+ * data plane using caller-fed sources (no hardware required)
+ */
+
+#include "dsv4l2_daemon.h"
+#include "../src/daemon/dsv4l2d_proto.h"  /* Raw protocol for misbehaving clients */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Test result tracking */
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+#define TEST_ASSERT(cond, msg) do { \
+    if (cond) { \
+        printf("  [PASS] %s\n", msg); \
+        tests_passed++; \
+    } else { \
+        printf("  [FAIL] %s\n", msg); \
+        tests_failed++; \
+    } \
+} while (0)
+
+#define FRAME_SIZE 1024
+
+static char socket_path[64];
+
+/* Connect without the client library */
+static int raw_connect(void)
+{
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+static int raw_send(int fd, uint32_t op, const char *id)
+{
+    dsv4l2d_request_t req;
+
+    memset(&req, 0, sizeof(req));
+    req.version = DSV4L2D_PROTO_VERSION;
+    req.op = op;
+    snprintf(req.id, sizeof(req.id), "%s", id ? id : "");
+    return send(fd, &req, sizeof(req), MSG_NOSIGNAL | MSG_DONTWAIT) == (ssize_t)sizeof(req)
+               ? 0 : -errno;
+}
+
+/* Receive one reply; returns the passed fd (or -1) */
+static int raw_recv(int fd, int32_t *status)
+{
+    static dsv4l2d_reply_t reply;
+    struct iovec iov = { .iov_base = &reply, .iov_len = sizeof(reply) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    int passed = -1;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    if (recvmsg(fd, &msg, MSG_CMSG_CLOEXEC) != (ssize_t)sizeof(reply)) {
+        return -1;
+    }
+    *status = reply.status;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_type == SCM_RIGHTS) {
+        memcpy(&passed, CMSG_DATA(cmsg), sizeof(int));
+    }
+    return passed;
+}
+
+int main(void)
+{
+    dsv4l2_ring_config_t cfg = { .slots = 4, .slot_size = FRAME_SIZE,
+                                 .width = 32, .height = 16, .pixelformat = 0x56595559 };
+    dsv4l2d_server_t *srv, *dup;
+    dsv4l2d_client_t *c;
+    dsv4l2_ring_pub_t *cam, *iris;
+    dsv4l2_ring_sub_t *sub;
+    dsv4l2d_device_info_t devs[DSV4L2D_MAX_DEVICES], info;
+    dsv4l2d_status_t status;
+    dsv4l2_ring_frame_t frame;
+    uint8_t data[FRAME_SIZE], out[FRAME_SIZE];
+    size_t count = 0;
+    int32_t st = -1;
+    int rc, raw, ring_fd, i;
+
+    printf("DSV4L2 Capture Daemon Tests\n");
+    printf("===========================\n");
+
+    snprintf(socket_path, sizeof(socket_path), "/tmp/dsv4l2d-test-%d.sock", (int)getpid());
+
+    printf("\nTest: Server setup\n");
+
+    TEST_ASSERT(dsv4l2d_connect(socket_path, &c) == -ENOENT, "No daemon yet");
+    TEST_ASSERT(dsv4l2d_server_create(socket_path, &srv) == 0, "Create server");
+
+    dsv4l2_ring_create(NULL, &cfg, &cam);
+    dsv4l2_ring_create(NULL, &cfg, &iris);
+    TEST_ASSERT(dsv4l2d_server_add_source(srv, "cam0", "generic_webcam", "UNCLASSIFIED",
+                                          cam, &cfg) == 0, "Add webcam source");
+    TEST_ASSERT(dsv4l2d_server_add_source(srv, "iris0", "iris_scanner", "SECRET",
+                                          iris, &cfg) == 0, "Add iris source");
+    TEST_ASSERT(dsv4l2d_server_add_source(srv, "cam0", "generic_webcam", "UNCLASSIFIED",
+                                          cam, &cfg) == -EEXIST, "Duplicate id rejected");
+
+    /* This process is only cleared for CONFIDENTIAL */
+    dsv4l2d_server_set_clearance(srv, getuid(), "CONFIDENTIAL");
+    TEST_ASSERT(dsv4l2d_server_start(srv) == 0, "Start server");
+    TEST_ASSERT(dsv4l2d_server_create(socket_path, &dup) == -EADDRINUSE,
+                "Second daemon on a live socket refused");
+
+    printf("\nTest: Control protocol\n");
+
+    TEST_ASSERT(dsv4l2d_connect(socket_path, &c) == 0, "Client connects");
+    TEST_ASSERT(dsv4l2d_status(c, &status) == 0 && status.devices == 2 &&
+                status.clients == 1, "Status reports devices and clients");
+    TEST_ASSERT(strcmp(status.clearance, "CONFIDENTIAL") == 0,
+                "Clearance resolved from peer credentials");
+
+    rc = dsv4l2d_list(c, devs, DSV4L2D_MAX_DEVICES, &count);
+    TEST_ASSERT(rc == 0 && count == 2, "List devices");
+    TEST_ASSERT(strcmp(devs[0].id, "cam0") == 0 && devs[0].allowed &&
+                devs[0].width == 32 && devs[0].pixelformat == 0x56595559,
+                "Webcam listed as allowed with its format");
+    TEST_ASSERT(strcmp(devs[1].role, "iris_scanner") == 0 && !devs[1].allowed,
+                "Iris scanner listed as not allowed");
+
+    TEST_ASSERT(dsv4l2d_subscribe(c, "nope", &sub, NULL) == -ENOENT, "Unknown id rejected");
+    TEST_ASSERT(dsv4l2d_subscribe(c, "iris0", &sub, NULL) == -EPERM,
+                "Insufficient clearance refused");
+
+    printf("\nTest: Shared-memory data plane\n");
+
+    rc = dsv4l2d_subscribe(c, "cam0", &sub, &info);
+    TEST_ASSERT(rc == 0 && strcmp(info.id, "cam0") == 0, "Subscribe to webcam");
+
+    if (rc == 0) {
+        memset(data, 0xa5, sizeof(data));
+        dsv4l2_ring_publish(cam, data, sizeof(data), 42, 1000, 0);
+        rc = dsv4l2_ring_read(sub, out, sizeof(out), &frame, 1000);
+        TEST_ASSERT(rc == FRAME_SIZE && frame.sequence == 42 &&
+                    memcmp(out, data, sizeof(data)) == 0, "Frame delivered through the daemon ring");
+        dsv4l2_ring_detach(sub);
+    }
+
+    rc = dsv4l2d_list(c, devs, DSV4L2D_MAX_DEVICES, &count);
+    TEST_ASSERT(rc == 0 && devs[0].frames == 1, "Frame counter visible in list");
+
+    raw = raw_connect();
+    ring_fd = -1;
+    if (raw >= 0 && raw_send(raw, DSV4L2D_OP_SUBSCRIBE, "cam0") == 0) {
+        ring_fd = raw_recv(raw, &st);
+    }
+    TEST_ASSERT(ring_fd >= 0 && st == 0 && (fcntl(ring_fd, F_GETFL) & O_ACCMODE) == O_RDONLY,
+                "Subscribers receive a read-only ring fd");
+    if (ring_fd >= 0) {
+        TEST_ASSERT(dsv4l2_ring_attach_fd(ring_fd, &sub) == 0, "Read-only fd attaches");
+        dsv4l2_ring_detach(sub);
+        close(ring_fd);
+    }
+
+    printf("\nTest: Client that never reads its replies\n");
+
+    /* Keep asking without reading: the reply queue fills up */
+    for (i = 0; i < 256 && raw_send(raw, DSV4L2D_OP_STATUS, NULL) == 0; i++) {
+        usleep(1000);
+    }
+    TEST_ASSERT(dsv4l2d_status(c, &status) == 0 && status.clients == 1,
+                "Stalled client dropped, control loop still answering");
+    close(raw);
+
+    TEST_ASSERT(dsv4l2d_set_threatcon(c, THREATCON_BRAVO) == 0,
+                "Daemon user may change THREATCON");
+    TEST_ASSERT(dsv4l2d_status(c, &status) == 0 && status.threatcon == THREATCON_BRAVO,
+                "THREATCON applied");
+    dsv4l2d_set_threatcon(c, THREATCON_NORMAL);
+
+    dsv4l2d_disconnect(c);
+    dsv4l2d_server_destroy(srv);
+    TEST_ASSERT(access(socket_path, F_OK) != 0, "Socket removed on shutdown");
+
+    dsv4l2_ring_destroy(cam);
+    dsv4l2_ring_destroy(iris);
+
+    /* Print summary */
+    printf("\n===========================\n");
+    printf("Test Results:\n");
+    printf("  Passed: %d\n", tests_passed);
+    printf("  Failed: %d\n", tests_failed);
+    printf("  Total:  %d\n", tests_passed + tests_failed);
+
+    if (tests_failed > 0) {
+        printf("\nSome tests FAILED!\n");
+        return 1;
+    }
+
+    printf("\nAll tests PASSED!\n");
+    return 0;
+}
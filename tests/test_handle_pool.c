@@ -0,0 +1,155 @@
+/*
+ * DSV4L2 Warm Handle Pool Tests
+ *
+ * Test pool bookkeeping without hardware; if /dev/video0 is present,
+ * also time a warm checkout against a cold open
+ */
+
+#include "dsv4l2_handle_pool.h"
+#include "dsv4l2rt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+/* Test result tracking */
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+#define TEST_ASSERT(cond, msg) do { \
+    if (cond) { \
+        printf("  [PASS] %s\n", msg); \
+        tests_passed++; \
+    } else { \
+        printf("  [FAIL] %s\n", msg); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static void test_bookkeeping(void)
+{
+    dsv4l2_handle_pool_t *pool;
+    dsv4l2_handle_pool_stats_t stats;
+    dsv4l2_warm_config_t cfg;
+    dsv4l2_device_t *dev;
+
+    printf("\nTest: Pool bookkeeping\n");
+
+    TEST_ASSERT(dsv4l2_handle_pool_create(&pool) == 0, "Create pool");
+    TEST_ASSERT(dsv4l2_handle_checkout(pool, NULL, NULL, &dev) == -ENOENT,
+                "Checkout from an empty pool");
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.role = "camera";
+    TEST_ASSERT(dsv4l2_handle_pool_add(pool, &cfg) == -EINVAL, "Config without path rejected");
+
+    cfg.path = "/dev/dsv4l2-no-such-device";
+    TEST_ASSERT(dsv4l2_handle_pool_add(pool, &cfg) == -ENOENT, "Missing device not pooled");
+
+    dev = (dsv4l2_device_t *)&cfg;
+    TEST_ASSERT(dsv4l2_handle_checkin(pool, dev) == -EINVAL, "Foreign handle checkin rejected");
+
+    TEST_ASSERT(dsv4l2_handle_pool_get_stats(pool, &stats) == 0 &&
+                stats.handles == 0 && stats.checkouts == 0, "Stats stay empty");
+
+    dsv4l2_handle_pool_destroy(pool);
+}
+
+static void test_device(const char *path)
+{
+    dsv4l2_handle_pool_t *pool;
+    dsv4l2_handle_pool_stats_t stats;
+    dsv4l2_warm_config_t cfg;
+    dsv4l2_device_t *dev, *other;
+    uint64_t t0, warm_us;
+    int rc;
+
+    printf("\nTest: Warm checkout (%s)\n", path);
+
+    dsv4l2_handle_pool_create(&pool);
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.path = path;
+    cfg.role = "camera";
+    cfg.mode = DSV4L2_WARM_STREAMING;
+
+    t0 = now_us();
+    rc = dsv4l2_handle_pool_add(pool, &cfg);
+    if (rc < 0) {
+        printf("  Device not usable (%d), skipping\n", rc);
+        dsv4l2_handle_pool_destroy(pool);
+        return;
+    }
+    printf("  Warm-up: %llu us\n", (unsigned long long)(now_us() - t0));
+
+    t0 = now_us();
+    rc = dsv4l2_handle_checkout(pool, path, NULL, &dev);
+    warm_us = now_us() - t0;
+    TEST_ASSERT(rc == 0, "Checkout warm handle");
+    printf("  Checkout: %llu us\n", (unsigned long long)warm_us);
+
+    TEST_ASSERT(dsv4l2_handle_checkout(pool, path, NULL, &other) == -EBUSY,
+                "Second checkout of a held handle refused");
+
+    if (rc == 0) {
+        TEST_ASSERT(dsv4l2_handle_checkin(pool, dev) == 0, "Checkin");
+        TEST_ASSERT(dsv4l2_handle_checkin(pool, dev) == -EINVAL, "Double checkin rejected");
+        TEST_ASSERT(dsv4l2_handle_checkout(pool, NULL, "camera", &dev) == 0,
+                    "Checkout by role");
+        dsv4l2_handle_checkin(pool, dev);
+    }
+
+    dsv4l2_handle_pool_get_stats(pool, &stats);
+    TEST_ASSERT(stats.checkouts == 2 && stats.busy == 1 && stats.checked_out == 0,
+                "Checkout counters");
+
+    dsv4l2_handle_pool_destroy(pool);
+}
+
+int main(void)
+{
+    dsv4l2rt_config_t config;
+
+    printf("DSV4L2 Warm Handle Pool Tests\n");
+    printf("=============================\n");
+
+    memset(&config, 0, sizeof(config));
+    config.profile = DSV4L2_PROFILE_EXERCISE;
+    dsv4l2rt_init(&config);
+
+    test_bookkeeping();
+
+    if (access("/dev/video0", R_OK | W_OK) == 0) {
+        test_device("/dev/video0");
+    } else {
+        printf("\nNo /dev/video0, skipping device tests\n");
+    }
+
+    dsv4l2rt_shutdown();
+
+    /* Print summary */
+    printf("\n=============================\n");
+    printf("Test Results:\n");
+    printf("  Passed: %d\n", tests_passed);
+    printf("  Failed: %d\n", tests_failed);
+    printf("  Total:  %d\n", tests_passed + tests_failed);
+
+    if (tests_failed > 0) {
+        printf("\nSome tests FAILED!\n");
+        return 1;
+    }
+
+    printf("\nAll tests PASSED!\n");
+    return 0;
+}
@@ -7,10 +7,12 @@
 
 #include "dsv4l2_dsmil.h"
 #include "dsv4l2_profiles.h"
+#include "dsv4l2_core.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
@@ -320,6 +322,107 @@ static void test_profile_matching(void)
     close(fd);
 }
 
+/**
+ * Test: Buffer lifecycle statistics
+ */
+static void test_buffer_lifecycle(void)
+{
+    char device_path[32];
+    dsv4l2_device_t *dev = NULL;
+    dsv4l2_queue_stats_t stats;
+    dsv4l2_device_stats_t dstats;
+    uint64_t hist[DSV4L2_STATS_HIST_BINS] = {0};
+    dsv4l2_frame_t frame;
+    void *start;
+    size_t len;
+    uint64_t cycles = 0, depth_total = 0;
+    uint32_t i;
+    int frames = 0;
+
+    printf("\n=== Test 7: Buffer and Capture Statistics ===\n");
+
+    TEST_ASSERT(dsv4l2_get_buffer_stats(NULL, &stats) == -EINVAL,
+                "Stats rejects NULL device");
+    TEST_ASSERT(dsv4l2_get_device_stats(NULL, &dstats) == -EINVAL,
+                "Device stats rejects NULL device");
+    TEST_ASSERT(dsv4l2_set_buffer_growth(NULL, DSV4L2_BUFFER_GROW_LIVE, 0) == -EINVAL,
+                "Buffer growth rejects NULL device");
+
+    /* 90 samples in [16, 32) µs, 10 in [1024, 2048) µs */
+    hist[5] = 90;
+    hist[11] = 10;
+    TEST_ASSERT(dsv4l2_stats_percentile_us(hist, 50.0) == 32, "p50 from histogram");
+    TEST_ASSERT(dsv4l2_stats_percentile_us(hist, 99.0) == 2048, "p99 from histogram");
+    memset(hist, 0, sizeof(hist));
+    TEST_ASSERT(dsv4l2_stats_percentile_us(hist, 99.0) == 0, "Empty histogram percentile");
+
+    if (!find_v4l2_device(device_path, sizeof(device_path))) {
+        TEST_SKIP("No V4L2 devices available");
+        return;
+    }
+
+    if (dsv4l2_open(device_path, "camera", &dev) != 0) {
+        TEST_SKIP("Cannot open device");
+        return;
+    }
+
+    TEST_ASSERT(dsv4l2_set_buffer_growth(dev, DSV4L2_BUFFER_GROW_LIVE,
+                                         DSV4L2_MAX_BUFFERS + 1) == -EINVAL,
+                "Buffer growth rejects cap above DSV4L2_MAX_BUFFERS");
+    dsv4l2_set_buffer_growth(dev, DSV4L2_BUFFER_GROW_ON_RESTART, 8);
+
+    if (dsv4l2_request_buffers(dev, 4) != 0 || dsv4l2_mmap_buffers(dev) != 0) {
+        TEST_SKIP("Buffer allocation not supported");
+        dsv4l2_release_buffers(dev);
+        dsv4l2_close(dev);
+        return;
+    }
+
+    for (i = 0; dsv4l2_get_buffer(dev, i, &start, &len) == 0; i++) {
+        dsv4l2_queue_buffer(dev, i);
+    }
+
+    dsv4l2_get_buffer_stats(dev, &stats);
+    TEST_ASSERT(stats.queued == stats.buffer_count, "All buffers queued in driver");
+
+    while (frames < 8 && dsv4l2_capture_frame(dev, &frame) == 0) {
+        frames++;
+    }
+
+    if (frames == 0) {
+        TEST_SKIP("Device produced no frames");
+    } else {
+        dsv4l2_get_buffer_stats(dev, &stats);
+        for (i = 0; i < stats.buffer_count && i < DSV4L2_MAX_BUFFERS; i++) {
+            cycles += stats.buffers[i].cycles;
+        }
+        for (i = 0; i < DSV4L2_MAX_BUFFERS; i++) {
+            depth_total += stats.depth_hist[i];
+        }
+
+        TEST_ASSERT(stats.dequeues == (uint64_t)frames, "Dequeue count matches frames");
+        TEST_ASSERT(cycles == (uint64_t)frames, "Every dequeue completed a buffer cycle");
+        TEST_ASSERT(depth_total == stats.dequeues, "Depth histogram covers every dequeue");
+
+        dsv4l2_get_device_stats(dev, &dstats);
+        TEST_ASSERT(dstats.frames == (uint64_t)frames, "Device stats count every frame");
+        TEST_ASSERT(stats.starved_gaps <= dstats.sequence_gaps,
+                    "Starved drops are a subset of sequence gaps");
+        TEST_ASSERT(stats.buffer_target <= 8, "Buffer growth respects the cap");
+        printf("    %.1f fps, %llu gaps (%llu frames lost), %llu error frames\n",
+               dstats.fps, (unsigned long long)dstats.sequence_gaps,
+               (unsigned long long)dstats.frames_lost,
+               (unsigned long long)dstats.error_frames);
+    }
+
+    dsv4l2_stop_streaming(dev);
+    dsv4l2_get_buffer_stats(dev, &stats);
+    TEST_ASSERT(stats.queued == 0, "STREAMOFF returns all buffers");
+
+    dsv4l2_release_buffers(dev);
+    dsv4l2_close(dev);
+}
+
 int main(void)
 {
     printf("╔════════════════════════════════════════════════════════╗\n");
@@ -335,6 +438,7 @@ int main(void)
     test_format_operations();
     test_buffer_allocation();
     test_profile_matching();
+    test_buffer_lifecycle();
 
     printf("\n");
     printf("╔════════════════════════════════════════════════════════╗\n");
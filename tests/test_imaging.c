@@ -0,0 +1,1652 @@
+/*
+ * DSV4L2 Imaging Stage Tests
+ *
+ * Test change detection, preview pyramids, quality metrics, auto
+ * exposure, thermal AGC and IR fusion on synthetic frames, and that every SIMD
+ * level produces identical results
+ */
+
+#include "dsv4l2_imaging.h"
+#include "dsv4l2rt.h"
+#include "../src/dsv4l2_internal.h"
+
+#include <linux/videodev2.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/* Test result tracking */
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+#define TEST_ASSERT(cond, msg) do { \
+    if (cond) { \
+        printf("  [PASS] %s\n", msg); \
+        tests_passed++; \
+    } else { \
+        printf("  [FAIL] %s\n", msg); \
+        tests_failed++; \
+    } \
+} while (0)
+
+#define W 320
+#define H 240
+
+/* Textured YUYV background with a deterministic pattern */
+static void fill_yuyv(uint8_t *frame)
+{
+    int x, y;
+
+    for (y = 0; y < H; y++) {
+        for (x = 0; x < W; x++) {
+            frame[(y * W + x) * 2] = (uint8_t)(16 + ((x * 7 + y * 13) & 0x7f));
+            frame[(y * W + x) * 2 + 1] = 128;
+        }
+    }
+}
+
+/* Paint a bright rectangle of luma */
+static void paint(uint8_t *frame, int x0, int y0, int w, int h)
+{
+    int x, y;
+
+    for (y = y0; y < y0 + h; y++) {
+        for (x = x0; x < x0 + w; x++) {
+            frame[(y * W + x) * 2] = 235;
+        }
+    }
+}
+
+static int bit_set(const dsv4l2_change_result_t *r, uint32_t row, uint32_t col)
+{
+    uint32_t bit = row * r->cols + col;
+
+    return (r->bitmap[bit / 64] >> (bit % 64)) & 1;
+}
+
+static void make_config(dsv4l2_change_config_t *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->format.width = W;
+    cfg->format.height = H;
+    cfg->format.pixelformat = V4L2_PIX_FMT_YUYV;
+}
+
+static void test_detection(void)
+{
+    dsv4l2_change_detector_t *det;
+    dsv4l2_change_config_t cfg;
+    dsv4l2_change_result_t r;
+    uint8_t *frame = malloc(W * H * 2);
+
+    printf("\nTest: Change detection\n");
+
+    make_config(&cfg);
+    cfg.factor = 3;
+    TEST_ASSERT(dsv4l2_change_create(&cfg, &det) == -EINVAL, "Non power-of-two factor rejected");
+
+    make_config(&cfg);
+    TEST_ASSERT(dsv4l2_change_create(&cfg, &det) == 0, "Create detector");
+
+    fill_yuyv(frame);
+    TEST_ASSERT(dsv4l2_change_analyze(det, frame, W * H, &r) == -EMSGSIZE,
+                "Short frame rejected");
+
+    dsv4l2_change_analyze(det, frame, W * H * 2, &r);
+    /* factor 4: 80x60 downsampled, 10x8 blocks (last row half height) */
+    TEST_ASSERT(r.cols == 10 && r.rows == 8 && r.blocks == 80, "Block grid");
+    TEST_ASSERT(r.changed == r.blocks, "First frame reports every block changed");
+
+    dsv4l2_change_analyze(det, frame, W * H * 2, &r);
+    TEST_ASSERT(r.changed == 0 && r.score == 0.0f && r.mean_diff == 0,
+                "Identical frame is static");
+
+    /* One block is 32x32 full-resolution pixels at factor 4 */
+    paint(frame, 64, 96, 32, 32);
+    dsv4l2_change_analyze(det, frame, W * H * 2, &r);
+    TEST_ASSERT(r.changed == 1 && bit_set(&r, 3, 2), "Painted block detected");
+
+    /* Bottom edge block is only 4 downsampled rows tall */
+    fill_yuyv(frame);
+    paint(frame, 288, 224, 32, 16);
+    dsv4l2_change_reset(det);
+    dsv4l2_change_analyze(det, frame, W * H * 2, &r);
+    fill_yuyv(frame);
+    dsv4l2_change_analyze(det, frame, W * H * 2, &r);
+    TEST_ASSERT(r.changed == 1 && bit_set(&r, 7, 9), "Partial edge block detected");
+
+    dsv4l2_change_destroy(det);
+    free(frame);
+}
+
+static void test_simd_levels(void)
+{
+    static const dsv4l2_simd_level_t levels[] = {
+        DSV4L2_SIMD_SCALAR, DSV4L2_SIMD_SSE2, DSV4L2_SIMD_AVX2
+    };
+    dsv4l2_change_result_t ref[4], r;
+    dsv4l2_change_config_t cfg;
+    dsv4l2_change_detector_t *det;
+    dsv4l2_simd_level_t best = dsv4l2_simd_level();
+    uint8_t *frame = malloc(W * H * 2);
+    int same = 1;
+    size_t l;
+    int i;
+
+    printf("\nTest: SIMD levels agree (best: %d)\n", best);
+
+    make_config(&cfg);
+    cfg.factor = 2;
+    cfg.threshold = 4;
+
+    for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        dsv4l2_simd_set_level(levels[l]);
+        dsv4l2_change_create(&cfg, &det);
+
+        for (i = 0; i < 4; i++) {
+            fill_yuyv(frame);
+            paint(frame, 10 + i * 40, 20 + i * 30, 50, 33);
+            dsv4l2_change_analyze(det, frame, W * H * 2, l == 0 ? &ref[i] : &r);
+            if (l > 0 && memcmp(&ref[i], &r, sizeof(r)) != 0) {
+                same = 0;
+            }
+        }
+
+        dsv4l2_change_destroy(det);
+    }
+
+    TEST_ASSERT(same, "Scalar, SSE2 and AVX2 results identical");
+    TEST_ASSERT(dsv4l2_simd_set_level(best) == best, "Level restored");
+    free(frame);
+}
+
+static void test_stage(void)
+{
+    dsv4l2_change_detector_t *det;
+    dsv4l2_change_config_t cfg;
+    dsv4l2_change_result_t *r;
+    dsv4l2_lease_t *lease;
+    uint8_t *frame = malloc(W * H * 2);
+    int rc, kept = 0, i;
+
+    printf("\nTest: Change stage\n");
+
+    make_config(&cfg);
+    cfg.skip_static = 1;
+    cfg.keep_every = 3;
+    dsv4l2_change_create(&cfg, &det);
+    fill_yuyv(frame);
+
+    dsv4l2_lease_wrap(frame, W * H * 2, NULL, &lease);
+    rc = dsv4l2_change_stage(lease, det);
+    r = dsv4l2_lease_get(lease, DSV4L2_SLOT_CHANGE);
+    TEST_ASSERT(rc == 0 && (lease->tags & DSV4L2_TAG_CHANGED) && r && r->changed == r->blocks,
+                "First frame passed and tagged changed");
+    dsv4l2_lease_release(lease);
+
+    for (i = 0; i < 6; i++) {
+        dsv4l2_lease_wrap(frame, W * H * 2, NULL, &lease);
+        rc = dsv4l2_change_stage(lease, det);
+        if (rc == 0) {
+            kept++;
+        }
+        if (!(lease->tags & DSV4L2_TAG_STATIC)) {
+            kept = -100;
+        }
+        dsv4l2_lease_release(lease);
+    }
+    TEST_ASSERT(kept == 2, "Static frames skipped except every 3rd");
+
+    dsv4l2_change_destroy(det);
+    free(frame);
+}
+
+/* Straightforward 2x2 box reference */
+static void ref_box(const uint8_t *src, uint32_t sstride, uint32_t step,
+                    uint8_t *dst, uint32_t w, uint32_t h)
+{
+    uint32_t x, y;
+
+    for (y = 0; y < h; y++) {
+        const uint8_t *r0 = src + (size_t)(2 * y) * sstride;
+        const uint8_t *r1 = r0 + sstride;
+
+        for (x = 0; x < w; x++) {
+            dst[y * w + x] = (uint8_t)((r0[2 * x * step] + r0[(2 * x + 1) * step] +
+                                        r1[2 * x * step] + r1[(2 * x + 1) * step] + 2) >> 2);
+        }
+    }
+}
+
+/* Check a GREY pyramid against the reference cascade */
+static int check_pyramid(const dsv4l2_pyramid_t *pyr, const uint8_t *src,
+                         uint32_t sstride, uint32_t step)
+{
+    uint8_t *ref[3] = { NULL, NULL, NULL };
+    uint32_t i;
+    int ok = 1;
+
+    for (i = 0; i < pyr->levels; i++) {
+        ref[i] = malloc((size_t)pyr->level[i].width * pyr->level[i].height);
+    }
+
+    ref_box(src, sstride, step, ref[0], pyr->level[0].width, pyr->level[0].height);
+    for (i = 1; i < pyr->levels; i++) {
+        ref_box(ref[i - 1], pyr->level[i - 1].width, 1, ref[i],
+                pyr->level[i].width, pyr->level[i].height);
+    }
+
+    for (i = 0; i < pyr->levels; i++) {
+        if (memcmp(ref[i], pyr->level[i].data,
+                   (size_t)pyr->level[i].width * pyr->level[i].height) != 0) {
+            ok = 0;
+        }
+        free(ref[i]);
+    }
+
+    return ok;
+}
+
+static void test_pyramid(void)
+{
+    /* Odd sizes exercise the SIMD tails and dropped edge rows */
+    enum { PW = 330, PH = 250 };
+    static const dsv4l2_simd_level_t levels[] = {
+        DSV4L2_SIMD_SCALAR, DSV4L2_SIMD_SSE2, DSV4L2_SIMD_AVX2
+    };
+    dsv4l2_simd_level_t best = dsv4l2_simd_level();
+    dsv4l2_pyramid_config_t cfg;
+    dsv4l2_pyramid_builder_t *pb;
+    dsv4l2_pyramid_t *pyr, *rgb;
+    uint8_t *yuyv = malloc(PW * PH * 2);
+    uint8_t *nv12 = malloc(PW * PH * 3 / 2);
+    int yuyv_ok = 1, nv12_ok = 1, grey_rgb = 1;
+    size_t l, i;
+
+    printf("\nTest: Preview pyramid\n");
+
+    for (i = 0; i < (size_t)PW * PH * 2; i++) {
+        yuyv[i] = (uint8_t)((i * 131) ^ (i >> 7));
+    }
+    for (i = 0; i < (size_t)PW * PH * 3 / 2; i++) {
+        nv12[i] = (uint8_t)((i * 97) ^ (i >> 5));
+    }
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.format.width = 4;
+    cfg.format.height = 4;
+    cfg.format.pixelformat = V4L2_PIX_FMT_GREY;
+    TEST_ASSERT(dsv4l2_pyramid_create(&cfg, &pb) == -EINVAL, "Frame too small for 3 levels");
+
+    for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        dsv4l2_simd_set_level(levels[l]);
+
+        cfg.format.width = PW;
+        cfg.format.height = PH;
+        cfg.format.pixelformat = V4L2_PIX_FMT_YUYV;
+        dsv4l2_pyramid_create(&cfg, &pb);
+        if (dsv4l2_pyramid_build(pb, yuyv, PW * PH * 2, &pyr) != 0 ||
+            !check_pyramid(pyr, yuyv, PW * 2, 2)) {
+            yuyv_ok = 0;
+        } else {
+            free(pyr);
+        }
+        dsv4l2_pyramid_destroy(pb);
+
+        cfg.format.pixelformat = V4L2_PIX_FMT_NV12;
+        dsv4l2_pyramid_create(&cfg, &pb);
+        if (dsv4l2_pyramid_build(pb, nv12, PW * PH * 3 / 2, &pyr) != 0 ||
+            !check_pyramid(pyr, nv12, PW, 1)) {
+            nv12_ok = 0;
+        } else {
+            free(pyr);
+        }
+        dsv4l2_pyramid_destroy(pb);
+    }
+    dsv4l2_simd_set_level(best);
+
+    TEST_ASSERT(yuyv_ok, "YUYV luma pyramid matches reference at every SIMD level");
+    TEST_ASSERT(nv12_ok, "NV12 luma pyramid matches reference at every SIMD level");
+
+    /* GREY source, RGB output: every level is grey replicated */
+    cfg.format.pixelformat = V4L2_PIX_FMT_GREY;
+    dsv4l2_pyramid_create(&cfg, &pb);
+    dsv4l2_pyramid_build(pb, nv12, PW * PH, &pyr);
+    dsv4l2_pyramid_destroy(pb);
+
+    cfg.output = V4L2_PIX_FMT_RGB24;
+    dsv4l2_pyramid_create(&cfg, &pb);
+    dsv4l2_pyramid_build(pb, nv12, PW * PH, &rgb);
+    dsv4l2_pyramid_destroy(pb);
+
+    TEST_ASSERT(rgb->levels == 3 && rgb->level[2].width == PW / 8 &&
+                rgb->level[2].height == PH / 8 && rgb->level[2].stride == PW / 8 * 3,
+                "RGB level geometry");
+    for (l = 0; l < 3; l++) {
+        for (i = 0; i < (size_t)pyr->level[l].width * pyr->level[l].height; i++) {
+            if (rgb->level[l].data[3 * i] != pyr->level[l].data[i] ||
+                rgb->level[l].data[3 * i + 2] != pyr->level[l].data[i]) {
+                grey_rgb = 0;
+            }
+        }
+    }
+    TEST_ASSERT(grey_rgb, "RGB output of a grey frame matches the luma pyramid");
+
+    free(rgb);
+    free(pyr);
+    free(yuyv);
+    free(nv12);
+}
+
+static void test_pyramid_stages(void)
+{
+    dsv4l2_pyramid_config_t cfg;
+    dsv4l2_pyramid_builder_t *pb;
+    dsv4l2_ring_config_t rcfg;
+    dsv4l2_ring_stats_t rstats;
+    dsv4l2_preview_ring_t preview;
+    dsv4l2_pyramid_t *pyr;
+    dsv4l2_lease_t *lease;
+    uint8_t *frame = malloc(W * H * 2);
+    int rc;
+
+    printf("\nTest: Pyramid and preview stages\n");
+
+    fill_yuyv(frame);
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.format.width = W;
+    cfg.format.height = H;
+    cfg.format.pixelformat = V4L2_PIX_FMT_YUYV;
+    cfg.levels = 2;
+    dsv4l2_pyramid_create(&cfg, &pb);
+
+    memset(&rcfg, 0, sizeof(rcfg));
+    rcfg.slot_size = (W / 4) * (H / 4);
+    rcfg.width = W / 4;
+    rcfg.height = H / 4;
+    rcfg.pixelformat = V4L2_PIX_FMT_GREY;
+    memset(&preview, 0, sizeof(preview));
+    preview.level = 1;
+    dsv4l2_ring_create(NULL, &rcfg, &preview.ring);
+
+    dsv4l2_lease_wrap(frame, W * H * 2, NULL, &lease);
+    rc = dsv4l2_pyramid_stage(lease, pb);
+    pyr = dsv4l2_lease_get(lease, DSV4L2_SLOT_PYRAMID);
+    TEST_ASSERT(rc == 0 && pyr && pyr->levels == 2 && pyr->level[1].width == W / 4,
+                "Pyramid attached to the lease");
+
+    rc = dsv4l2_preview_ring_stage(lease, &preview);
+    dsv4l2_ring_get_stats(preview.ring, &rstats);
+    TEST_ASSERT(rc == 0 && rstats.published == 1, "Quarter-scale level published");
+    dsv4l2_lease_release(lease);
+
+    dsv4l2_ring_destroy(preview.ring);
+    dsv4l2_pyramid_destroy(pb);
+    free(frame);
+}
+
+static void make_redactor(dsv4l2_redactor_t **r, uint32_t fourcc,
+                          const dsv4l2_redact_region_t *reg, uint32_t count)
+{
+    dsv4l2_redact_config_t cfg;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.format.width = W;
+    cfg.format.height = H;
+    cfg.format.pixelformat = fourcc;
+    cfg.regions = reg;
+    cfg.count = count;
+    dsv4l2_redact_create(&cfg, r);
+}
+
+static void test_redact(void)
+{
+    dsv4l2_redact_region_t reg;
+    dsv4l2_redactor_t *r;
+    uint8_t *frame = malloc(W * H * 2);
+    uint8_t *orig = malloc(W * H * 2);
+    int x, y, inside_ok = 1, outside_ok = 1, uniform = 1;
+
+    printf("\nTest: Region redaction\n");
+
+    /* Solid fill on a rectangle, black -> Y 16 / Cb Cr 128 */
+    memset(&reg, 0, sizeof(reg));
+    reg.mode = DSV4L2_REDACT_FILL;
+    reg.x = 40;
+    reg.y = 30;
+    reg.width = 64;
+    reg.height = 20;
+    make_redactor(&r, V4L2_PIX_FMT_YUYV, &reg, 1);
+
+    fill_yuyv(frame);
+    memcpy(orig, frame, W * H * 2);
+    TEST_ASSERT(dsv4l2_redact_apply(r, frame, W * H * 2, NULL, 0) == 0, "Apply standing region");
+    for (y = 0; y < H; y++) {
+        for (x = 0; x < W; x++) {
+            int in = x >= 40 && x < 104 && y >= 30 && y < 50;
+
+            if (in && frame[(y * W + x) * 2] != 16) {
+                inside_ok = 0;
+            }
+            if (!in && frame[(y * W + x) * 2] != orig[(y * W + x) * 2]) {
+                outside_ok = 0;
+            }
+        }
+    }
+    TEST_ASSERT(inside_ok && outside_ok, "Rectangle luma filled, rest untouched");
+    TEST_ASSERT(dsv4l2_redact_apply(r, frame, W * H, NULL, 0) == -EMSGSIZE, "Short frame rejected");
+
+    reg.mode = DSV4L2_REDACT_BLUR;
+    reg.param = 65;
+    TEST_ASSERT(dsv4l2_redact_set_regions(r, &reg, 1) == -EINVAL, "Oversized blur radius rejected");
+    dsv4l2_redact_destroy(r);
+
+    /* Triangle on GREY: pixel centres well inside change, far outside do not */
+    memset(&reg, 0, sizeof(reg));
+    reg.mode = DSV4L2_REDACT_FILL;
+    reg.vertices = 3;
+    reg.vertex[0].x = 100; reg.vertex[0].y = 50;
+    reg.vertex[1].x = 200; reg.vertex[1].y = 150;
+    reg.vertex[2].x = 100; reg.vertex[2].y = 150;
+    reg.color[0] = reg.color[1] = reg.color[2] = 255;
+    make_redactor(&r, V4L2_PIX_FMT_GREY, &reg, 1);
+
+    memset(frame, 0, W * H);
+    dsv4l2_redact_apply(r, frame, W * H, NULL, 0);
+    inside_ok = frame[140 * W + 110] == 255 && frame[60 * W + 102] == 255;
+    outside_ok = frame[60 * W + 190] == 0 && frame[40 * W + 150] == 0 &&
+                 frame[100 * W + 99] == 0;
+    TEST_ASSERT(inside_ok && outside_ok, "Polygon even-odd fill");
+    dsv4l2_redact_destroy(r);
+
+    /* Shallow edge: y rises 1 per 50 px, so one row is crossed far from
+     * where the edge meets the row's centre line */
+    memset(&reg, 0, sizeof(reg));
+    reg.mode = DSV4L2_REDACT_FILL;
+    reg.vertices = 3;
+    reg.vertex[0].x = 0;   reg.vertex[0].y = 10;
+    reg.vertex[1].x = 200; reg.vertex[1].y = 14;
+    reg.vertex[2].x = 0;   reg.vertex[2].y = 20;
+    reg.color[0] = reg.color[1] = reg.color[2] = 255;
+    make_redactor(&r, V4L2_PIX_FMT_GREY, &reg, 1);
+
+    memset(frame, 0, W * H);
+    dsv4l2_redact_apply(r, frame, W * H, NULL, 0);
+    /* Row 10 holds the edge from x 0 to 50: centre-line sampling stops at 25 */
+    inside_ok = frame[10 * W + 49] == 255 && frame[13 * W + 199] == 255 &&
+                frame[14 * W + 195] == 255;
+    outside_ok = frame[10 * W + 50] == 0 && frame[9 * W + 0] == 0 &&
+                 frame[13 * W + 200] == 0;
+    TEST_ASSERT(inside_ok, "Partly covered pixels on a shallow edge redacted");
+    TEST_ASSERT(outside_ok, "Pixels past the shallow edge untouched");
+    dsv4l2_redact_destroy(r);
+
+    /* Pixelate: each 8x8 cell fully inside becomes one value */
+    memset(&reg, 0, sizeof(reg));
+    reg.mode = DSV4L2_REDACT_PIXELATE;
+    reg.x = 64;
+    reg.y = 64;
+    reg.width = 64;
+    reg.height = 64;
+    reg.param = 8;
+    make_redactor(&r, V4L2_PIX_FMT_GREY, &reg, 1);
+
+    for (x = 0; x < W * H; x++) {
+        frame[x] = (uint8_t)(x * 37);
+    }
+    dsv4l2_redact_apply(r, frame, W * H, NULL, 0);
+    for (y = 64; y < 128; y++) {
+        for (x = 64; x < 128; x++) {
+            if (frame[y * W + x] != frame[(y & ~7) * W + (x & ~7)]) {
+                uniform = 0;
+            }
+        }
+    }
+    TEST_ASSERT(uniform, "Pixelated cells uniform");
+    dsv4l2_redact_destroy(r);
+
+    free(frame);
+    free(orig);
+}
+
+static void test_redact_blur(void)
+{
+    static const dsv4l2_simd_level_t levels[] = {
+        DSV4L2_SIMD_SCALAR, DSV4L2_SIMD_SSE2, DSV4L2_SIMD_AVX2
+    };
+    dsv4l2_simd_level_t best = dsv4l2_simd_level();
+    dsv4l2_redact_region_t reg[2];
+    dsv4l2_redactor_t *r;
+    uint8_t *frame = malloc(W * H * 2);
+    uint8_t *ref = malloc(W * H * 2);
+    uint8_t *orig = malloc(W * H * 2);
+    int same = 1, smoothed = 1;
+    size_t l;
+    int x;
+
+    printf("\nTest: Blur across SIMD levels\n");
+
+    memset(reg, 0, sizeof(reg));
+    reg[0].mode = DSV4L2_REDACT_BLUR;
+    reg[0].x = 3;                /* Touches the frame edge and odd chroma */
+    reg[0].y = 0;
+    reg[0].width = 131;
+    reg[0].height = 77;
+    reg[0].param = 9;
+    reg[1].mode = DSV4L2_REDACT_BLUR;
+    reg[1].vertices = 4;
+    reg[1].vertex[0].x = 200; reg[1].vertex[0].y = 100;
+    reg[1].vertex[1].x = 330; reg[1].vertex[1].y = 180;
+    reg[1].vertex[2].x = 260; reg[1].vertex[2].y = 250;
+    reg[1].vertex[3].x = 180; reg[1].vertex[3].y = 200;
+    reg[1].param = 64;
+
+    fill_yuyv(orig);
+    for (x = 0; x < W * H * 2; x += 2) {
+        orig[x + 1] = (uint8_t)(x * 13);
+    }
+
+    for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        dsv4l2_simd_set_level(levels[l]);
+        make_redactor(&r, V4L2_PIX_FMT_YUYV, reg, 2);
+        memcpy(frame, orig, W * H * 2);
+        dsv4l2_redact_apply(r, frame, W * H * 2, NULL, 0);
+        if (l == 0) {
+            memcpy(ref, frame, W * H * 2);
+        } else if (memcmp(ref, frame, W * H * 2) != 0) {
+            same = 0;
+        }
+        dsv4l2_redact_destroy(r);
+    }
+    dsv4l2_simd_set_level(best);
+
+    /* Chroma noise inside the region must be flattened */
+    for (x = 40; x < 100; x += 4) {
+        if (abs((int)ref[(20 * W + x) * 2 + 1] - (int)ref[(20 * W + x + 2) * 2 + 1]) > 24) {
+            smoothed = 0;
+        }
+    }
+
+    TEST_ASSERT(same, "Scalar, SSE2 and AVX2 blur identical");
+    TEST_ASSERT(smoothed, "YUYV chroma blurred");
+    TEST_ASSERT(memcmp(ref + (200 * W) * 2, orig + (200 * W) * 2, 160) == 0,
+                "Pixels outside regions untouched");
+
+    free(frame);
+    free(ref);
+    free(orig);
+}
+
+static void test_redact_stages(void)
+{
+    dsv4l2_redact_region_t reg;
+    dsv4l2_redact_list_t *list;
+    dsv4l2_redactor_t *r;
+    dsv4l2_lease_t *lease;
+    uint8_t *frame = calloc(1, W * H * 3 / 2);
+    int rc;
+
+    printf("\nTest: Redaction stages\n");
+
+    make_redactor(&r, V4L2_PIX_FMT_NV12, NULL, 0);
+
+    dsv4l2_lease_wrap(frame, W * H * 3 / 2, NULL, &lease);
+    TEST_ASSERT(dsv4l2_redact_require_stage(lease, NULL) == -EACCES, "Unredacted frame refused");
+
+    /* Per-frame region from metadata: red fill on NV12 */
+    memset(&reg, 0, sizeof(reg));
+    reg.mode = DSV4L2_REDACT_FILL;
+    reg.x = 10;
+    reg.y = 10;
+    reg.width = 20;
+    reg.height = 20;
+    reg.color[0] = 255;
+    list = calloc(1, sizeof(*list));
+    list->count = 1;
+    list->region[0] = reg;
+    dsv4l2_lease_attach(lease, DSV4L2_SLOT_REDACT, list, free);
+
+    rc = dsv4l2_redact_stage(lease, r);
+    TEST_ASSERT(rc == 0 && (lease->tags & DSV4L2_TAG_REDACTED), "Stage tags the lease");
+    TEST_ASSERT(frame[20 * W + 20] == 82 && frame[W * H + 10 * W + 10 + 1] == 240 &&
+                frame[0] == 0, "Slot region applied to luma and chroma");
+    TEST_ASSERT(dsv4l2_redact_require_stage(lease, NULL) == 0, "Redacted frame passes");
+    dsv4l2_lease_release(lease);
+
+    dsv4l2_redact_destroy(r);
+    free(frame);
+}
+
+static void test_overlay(void)
+{
+    const uint64_t t0 = 1767323045ULL * 1000000000ULL;    /* 2026-01-02 03:04:05Z */
+    dsv4l2_overlay_config_t cfg;
+    dsv4l2_overlay_t *ov;
+    dsv4l2_lease_t *lease;
+    dsv4l2_device_internal_t dev;
+    uint8_t *frame = malloc(W * H * 3);
+    uint8_t *first = malloc(W * H * 3);
+    int x, y, white = 0, only_digit = 1;
+
+    printf("\nTest: Classification overlay\n");
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.format.width = W;
+    cfg.format.height = H;
+    cfg.format.pixelformat = V4L2_PIX_FMT_RGB24;
+    TEST_ASSERT(dsv4l2_overlay_create(&cfg, &ov) == 0, "Create RGB24 overlay");
+
+    memset(frame, 0x55, W * H * 3);
+    dsv4l2_overlay_apply(ov, frame, W * H * 3, NULL, t0);
+    TEST_ASSERT(frame[0] == 0 && frame[1] == 122 && frame[2] == 51, "UNCLASSIFIED banner is green");
+    for (x = 0; x < W * 11 * 3; x++) {
+        white += frame[x] == 255;
+    }
+    TEST_ASSERT(white > 0 && frame[(H / 2 * W) * 3] == 0x55, "Text drawn, picture untouched");
+
+    /* Next second: only the seconds digit of the timestamp changes */
+    memcpy(first, frame, W * H * 3);
+    dsv4l2_overlay_apply(ov, frame, W * H * 3, NULL, t0 + 1000000000ULL);
+    for (y = 0; y < H; y++) {
+        for (x = 0; x < W; x++) {
+            int in_digit = y >= H - 12 && x >= 2 + 18 * 6 && x < 2 + 19 * 6;
+
+            if (!in_digit && memcmp(frame + (y * W + x) * 3, first + (y * W + x) * 3, 3) != 0) {
+                only_digit = 0;
+            }
+        }
+    }
+    TEST_ASSERT(only_digit && memcmp(frame, first, W * H * 3) != 0, "Only the changed digit re-drawn");
+
+    dsv4l2_overlay_set_classification(ov, "SECRET_BIOMETRIC");
+    dsv4l2_lease_wrap(frame, W * H * 3, NULL, &lease);
+    TEST_ASSERT(dsv4l2_overlay_stage(lease, ov) == 0 && frame[0] == 200 && frame[1] == 16,
+                "Configured marking used by the stage: SECRET is red");
+    dsv4l2_lease_release(lease);
+
+    /* A configured marking may raise the device's, never lower it */
+    memset(&dev, 0, sizeof(dev));
+    dev.classification = "TOP_SECRET";
+    dsv4l2_lease_wrap(frame, W * H * 3, NULL, &lease);
+    lease->dev = (dsv4l2_device_t *)&dev;
+    TEST_ASSERT(dsv4l2_overlay_stage(lease, ov) == 0 && frame[0] == 255 && frame[1] == 140,
+                "Device above the configured marking: TOP SECRET is orange");
+    dev.classification = "CONFIDENTIAL";
+    TEST_ASSERT(dsv4l2_overlay_stage(lease, ov) == 0 && frame[0] == 200 && frame[1] == 16,
+                "Device below the configured marking: SECRET kept");
+    dsv4l2_lease_release(lease);
+    dsv4l2_overlay_destroy(ov);
+
+    cfg.format.width = 64;
+    cfg.format.height = 16;
+    TEST_ASSERT(dsv4l2_overlay_create(&cfg, &ov) == -EINVAL, "Banner that does not fit rejected");
+
+    free(frame);
+    free(first);
+}
+
+static void test_overlay_4k(void)
+{
+    static const uint32_t fmts[] = { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12 };
+    dsv4l2_overlay_config_t cfg;
+    dsv4l2_overlay_t *ov;
+    struct timespec a, b;
+    uint8_t *frame = calloc(1, 3840 * 2160 * 2);
+    uint64_t ns;
+    size_t f;
+    int i;
+
+    printf("\nTest: Overlay cost at 4K\n");
+
+    for (f = 0; f < sizeof(fmts) / sizeof(fmts[0]); f++) {
+        memset(&cfg, 0, sizeof(cfg));
+        cfg.format.width = 3840;
+        cfg.format.height = 2160;
+        cfg.format.pixelformat = fmts[f];
+        cfg.classification = "TOP SECRET";
+        dsv4l2_overlay_create(&cfg, &ov);
+
+        dsv4l2_overlay_apply(ov, frame, 3840 * 2160 * 2, NULL, 1000000000ULL);
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        for (i = 0; i < 100; i++) {
+            dsv4l2_overlay_apply(ov, frame, 3840 * 2160 * 2, NULL, 1000000000ULL);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        ns = (uint64_t)(b.tv_sec - a.tv_sec) * 1000000000ULL + (uint64_t)(b.tv_nsec - a.tv_nsec);
+
+        printf("  %s: %.1f us per frame\n", f == 0 ? "YUYV" : "NV12", ns / 100 / 1000.0);
+        TEST_ASSERT(ns / 100 < 2000000, "Cached overlay well under 2 ms per frame");
+        dsv4l2_overlay_destroy(ov);
+    }
+
+    free(frame);
+}
+
+/* Random 2x2 luma cells in 40..215: sharp and direction-free */
+static void fill_texture(uint8_t *frame, uint32_t w, uint32_t h, uint32_t seed)
+{
+    uint32_t x, y;
+
+    for (y = 0; y < h; y++) {
+        for (x = 0; x < w; x++) {
+            uint32_t v = ((x / 2) * 73856093u) ^ ((y / 2) * 19349663u) ^ seed;
+
+            v *= 2654435761u;
+            frame[(y * w + x) * 2] = (uint8_t)(40 + (v >> 24) % 176);
+            frame[(y * w + x) * 2 + 1] = 128;
+        }
+    }
+}
+
+/* Box blur of luma, dx pixels wide and dy lines high */
+static void blur_luma(const uint8_t *src, uint8_t *dst, uint32_t w, uint32_t h,
+                      int dx, int dy)
+{
+    int x, y, i, j;
+
+    memcpy(dst, src, (size_t)w * h * 2);
+    for (y = 0; y < (int)h; y++) {
+        for (x = 0; x < (int)w; x++) {
+            uint32_t sum = 0, n = 0;
+
+            for (j = -dy / 2; j <= dy / 2; j++) {
+                for (i = -dx / 2; i <= dx / 2; i++) {
+                    if (x + i >= 0 && x + i < (int)w && y + j >= 0 && y + j < (int)h) {
+                        sum += src[((y + j) * (int)w + x + i) * 2];
+                        n++;
+                    }
+                }
+            }
+            dst[(y * (int)w + x) * 2] = (uint8_t)(sum / n);
+        }
+    }
+}
+
+static void test_quality(void)
+{
+    static const dsv4l2_simd_level_t levels[] = {
+        DSV4L2_SIMD_SCALAR, DSV4L2_SIMD_SSE2, DSV4L2_SIMD_AVX2
+    };
+    dsv4l2_quality_config_t cfg;
+    dsv4l2_quality_result_t sharp, soft, smear, clipped, r;
+    dsv4l2_quality_t *q;
+    dsv4l2_simd_level_t best = dsv4l2_simd_level();
+    uint8_t *frame = malloc(W * H * 2);
+    uint8_t *blurred = malloc(W * H * 2);
+    uint32_t i, sum = 0;
+    int same = 1;
+    size_t l;
+
+    printf("\nTest: Frame quality\n");
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.format.width = W;
+    cfg.format.height = H;
+    cfg.format.pixelformat = V4L2_PIX_FMT_YUYV;
+    cfg.factor = 9;
+    TEST_ASSERT(dsv4l2_quality_create(&cfg, &q) == -EINVAL, "Grid spacing above 8 rejected");
+    cfg.factor = 1;
+    cfg.focus_ref = 1000.0f;
+    TEST_ASSERT(dsv4l2_quality_create(&cfg, &q) == 0, "Create assessor");
+
+    fill_texture(frame, W, H, 1);
+    TEST_ASSERT(dsv4l2_quality_analyze(q, frame, W * H, &r) == -EMSGSIZE, "Short frame rejected");
+    dsv4l2_quality_analyze(q, frame, W * H * 2, &sharp);
+    for (i = 0; i < 256; i++) {
+        sum += sharp.histogram[i];
+    }
+    TEST_ASSERT(sum == W * H && sharp.pixels == W * H && sharp.histogram[20] == 0,
+                "Histogram covers every pixel");
+    TEST_ASSERT(sharp.score > 0.9f && sharp.isotropy > 0.7f && sharp.dark == 0.0f,
+                "Sharp texture scores high");
+
+    blur_luma(frame, blurred, W, H, 5, 5);
+    dsv4l2_quality_analyze(q, blurred, W * H * 2, &soft);
+    TEST_ASSERT(soft.focus * 10.0f < sharp.focus && soft.score < 0.5f,
+                "Defocus lowers focus and score");
+
+    blur_luma(frame, blurred, W, H, 15, 1);
+    dsv4l2_quality_analyze(q, blurred, W * H * 2, &smear);
+    TEST_ASSERT(smear.isotropy < 0.5f && smear.blur_angle == 0,
+                "Horizontal motion blur detected");
+
+    for (i = 0; i < W * H / 2; i++) {
+        blurred[i * 2] = 252;
+    }
+    memcpy(blurred + W * H, frame + W * H, W * H);
+    dsv4l2_quality_analyze(q, blurred, W * H * 2, &clipped);
+    TEST_ASSERT(clipped.bright >= 0.5f && clipped.score == 0.0f, "Clipped frame scores 0");
+
+    dsv4l2_quality_destroy(q);
+
+    /* Every kernel level, with a line width that leaves scalar tails */
+    cfg.format.width = W - 6;
+    cfg.format.stride = W * 2;
+    cfg.factor = 2;
+    for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        dsv4l2_simd_set_level(levels[l]);
+        dsv4l2_quality_create(&cfg, &q);
+        dsv4l2_quality_analyze(q, frame, W * H * 2, l == 0 ? &sharp : &r);
+        if (l > 0 && memcmp(&sharp, &r, sizeof(r)) != 0) {
+            same = 0;
+        }
+        dsv4l2_quality_destroy(q);
+    }
+    TEST_ASSERT(same, "Scalar, SSE2 and AVX2 quality identical");
+    dsv4l2_simd_set_level(best);
+
+    free(frame);
+    free(blurred);
+}
+
+static void test_quality_stage(void)
+{
+    dsv4l2_quality_config_t cfg;
+    dsv4l2_quality_result_t *r;
+    dsv4l2_quality_t *q;
+    dsv4l2_lease_t *lease;
+    struct timespec a, b;
+    uint8_t *frame = malloc(1280 * 720 * 2);
+    uint8_t *blurred = malloc(1280 * 720 * 2);
+    uint64_t ns;
+    int rc, i;
+
+    printf("\nTest: Quality stage\n");
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.format.width = 1280;
+    cfg.format.height = 720;
+    cfg.format.pixelformat = V4L2_PIX_FMT_YUYV;
+    cfg.focus_ref = 1000.0f;
+    cfg.min_score = 0.5f;
+    cfg.skip_low = 1;
+    dsv4l2_quality_create(&cfg, &q);
+
+    fill_texture(frame, 1280, 720, 7);
+    dsv4l2_lease_wrap(frame, 1280 * 720 * 2, NULL, &lease);
+    lease->tags = DSV4L2_TAG_LOW_QUALITY;
+    rc = dsv4l2_quality_stage(lease, q);
+    r = dsv4l2_lease_get(lease, DSV4L2_SLOT_QUALITY);
+    TEST_ASSERT(rc == 0 && r && r->score >= 0.5f && !(lease->tags & DSV4L2_TAG_LOW_QUALITY),
+                "Sharp frame passed with its result attached");
+    dsv4l2_lease_release(lease);
+
+    blur_luma(frame, blurred, 1280, 720, 9, 9);
+    dsv4l2_lease_wrap(blurred, 1280 * 720 * 2, NULL, &lease);
+    rc = dsv4l2_quality_stage(lease, q);
+    TEST_ASSERT(rc == DSV4L2_STAGE_SKIP && (lease->tags & DSV4L2_TAG_LOW_QUALITY),
+                "Blurred frame tagged and skipped");
+    dsv4l2_lease_release(lease);
+
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    for (i = 0; i < 100; i++) {
+        dsv4l2_lease_wrap(frame, 1280 * 720 * 2, NULL, &lease);
+        dsv4l2_quality_stage(lease, q);
+        dsv4l2_lease_release(lease);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    ns = (uint64_t)(b.tv_sec - a.tv_sec) * 1000000000ULL + (uint64_t)(b.tv_nsec - a.tv_nsec);
+
+    printf("  720p YUYV, factor 2: %.1f us per frame\n", ns / 100 / 1000.0);
+    TEST_ASSERT(ns / 100 < 5000000, "Quality stage under 5 ms per 720p frame");
+
+    dsv4l2_quality_destroy(q);
+    free(frame);
+    free(blurred);
+}
+
+/* Simulated sensor: luma = reflectance x brightness, clipped */
+static void render_scene(uint8_t *frame, uint32_t w, uint32_t h, float brightness)
+{
+    uint32_t x, y;
+
+    for (y = 0; y < h; y++) {
+        for (x = 0; x < w; x++) {
+            uint32_t v = ((x / 4) * 73856093u) ^ ((y / 4) * 19349663u);
+            float refl = 0.2f + (float)((v * 2654435761u) >> 24) / 320.0f;
+            float luma = refl * brightness;
+
+            frame[(y * w + x) * 2] = (uint8_t)(luma > 255.0f ? 255.0f : luma);
+            frame[(y * w + x) * 2 + 1] = 128;
+        }
+    }
+}
+
+static void test_auto_exposure(void)
+{
+    dsv4l2_ae_config_t cfg;
+    dsv4l2_ae_settings_t active, next;
+    dsv4l2_ae_stats_t st;
+    dsv4l2_ae_t *ae;
+    dsv4l2_lease_t *lease;
+    uint8_t *frame = malloc(W * H * 2);
+    uint64_t now = 0, last_write = 0;
+    float scene = 1.8f;
+    int i, rc, converged_at = -1, writes = 0, late_writes = 0, spacing_ok = 1, pending = 0;
+
+    printf("\nTest: Auto exposure\n");
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.format.width = W;
+    cfg.format.height = H;
+    cfg.format.pixelformat = V4L2_PIX_FMT_YUYV;
+    TEST_ASSERT(dsv4l2_ae_create(&cfg, &ae) == 0, "Create controller without ranges");
+    render_scene(frame, W, H, 100.0f);
+    TEST_ASSERT(dsv4l2_ae_process(ae, frame, W * H * 2, 0, &next) == -ENODEV,
+                "No exposure range without a device or configuration");
+    dsv4l2_ae_destroy(ae);
+
+    cfg.exposure_min = 1;
+    cfg.exposure_max = 300;
+    cfg.gain_min = 16;           /* Unity */
+    cfg.gain_max = 128;
+    cfg.exposure = 10;
+    cfg.min_interval_ms = 60;
+    cfg.factor = 17;
+    TEST_ASSERT(dsv4l2_ae_create(&cfg, &ae) == -EINVAL, "Grid spacing above 16 rejected");
+    cfg.factor = 0;
+    dsv4l2_ae_create(&cfg, &ae);
+    active.exposure = 10;
+    active.gain = 16;
+
+    /* 30 fps; written settings reach the image one frame later */
+    for (i = 0; i < 40; i++, now += 33333333ULL) {
+        if (i == 20) {
+            scene /= 8.0f;       /* Lights off */
+        }
+        render_scene(frame, W, H, scene * (float)active.exposure * (float)active.gain / 16.0f);
+        if (pending) {
+            active = next;
+            pending = 0;
+        }
+
+        rc = dsv4l2_ae_process(ae, frame, W * H * 2, now, &next);
+        if (rc == 1) {
+            if (writes && now - last_write < 60000000ULL) {
+                spacing_ok = 0;
+            }
+            last_write = now;
+            writes++;
+            pending = 1;
+            if ((i > 12 && i < 20) || i > 34) {
+                late_writes++;
+            }
+        }
+
+        dsv4l2_ae_get_stats(ae, &st);
+        if (converged_at < 0 && st.converged) {
+            converged_at = i;
+        }
+        if (i == 19) {
+            TEST_ASSERT(st.converged && active.gain == 16 && active.exposure > 90 &&
+                        active.exposure < 115, "Exposure alone reaches the target");
+        }
+    }
+
+    printf("  converged at frame %d, %d writes, exposure %d gain %d, mean %.1f\n",
+           converged_at, writes, active.exposure, active.gain, st.mean);
+    TEST_ASSERT(converged_at >= 0 && converged_at <= 10, "Converges within 10 frames");
+    TEST_ASSERT(st.converged && active.exposure == 300 && active.gain > 16,
+                "Dark scene: exposure maxed, gain makes up the rest");
+    TEST_ASSERT(spacing_ok && late_writes == 0, "Writes rate-limited, none once converged");
+    TEST_ASSERT(st.frames == 40 && st.writes == (uint64_t)writes, "Stats count frames and writes");
+
+    dsv4l2_lease_wrap(frame, W * H * 2, NULL, &lease);
+    TEST_ASSERT(dsv4l2_ae_stage(lease, ae) == 0, "Stage passes frames without a device");
+    dsv4l2_lease_release(lease);
+    dsv4l2_ae_destroy(ae);
+
+    free(frame);
+}
+
+static void test_auto_exposure_y16(void)
+{
+    dsv4l2_ae_config_t cfg;
+    dsv4l2_ae_settings_t next;
+    dsv4l2_ae_stats_t st;
+    dsv4l2_ae_t *ae;
+    struct timespec a, b;
+    uint16_t *frame = malloc(1920 * 1080 * 2);
+    uint8_t *yuyv = malloc(1920 * 1080 * 2);
+    uint64_t ns;
+    int i;
+
+    printf("\nTest: Auto exposure on Y16 and cost\n");
+
+    for (i = 0; i < 1920 * 1080; i++) {
+        frame[i] = 4000;         /* 14-bit thermal: 4000 >> 6 = 62 */
+    }
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.format.width = 1920;
+    cfg.format.height = 1080;
+    cfg.format.pixelformat = V4L2_PIX_FMT_Y16;
+    cfg.y16_bits = 14;
+    cfg.exposure_min = 1;
+    cfg.exposure_max = 1000;
+    cfg.exposure = 100;
+    dsv4l2_ae_create(&cfg, &ae);
+    TEST_ASSERT(dsv4l2_ae_process(ae, (uint8_t *)frame, 1920 * 1080, 0, &next) == -EMSGSIZE,
+                "Short Y16 frame rejected");
+    TEST_ASSERT(dsv4l2_ae_process(ae, (uint8_t *)frame, 1920 * 1080 * 2, 0, &next) == 1 &&
+                next.exposure > 160 && next.exposure < 190, "Y16 scaled to 8 bits and corrected");
+    dsv4l2_ae_get_stats(ae, &st);
+    TEST_ASSERT(st.mean == 62.0f && st.settings.exposure == next.exposure, "Y16 mean");
+    dsv4l2_ae_destroy(ae);
+
+    cfg.format.pixelformat = V4L2_PIX_FMT_YUYV;
+    dsv4l2_ae_create(&cfg, &ae);
+    render_scene(yuyv, 1920, 1080, 150.0f);
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    for (i = 0; i < 1000; i++) {
+        dsv4l2_ae_process(ae, yuyv, 1920 * 1080 * 2, (uint64_t)i * 33333333ULL, &next);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    ns = (uint64_t)(b.tv_sec - a.tv_sec) * 1000000000ULL + (uint64_t)(b.tv_nsec - a.tv_nsec);
+
+    printf("  1080p YUYV, factor 8: %.1f us per frame\n", ns / 1000 / 1000.0);
+    TEST_ASSERT(ns / 1000 < 500000, "Controller well under 0.5 ms per 1080p frame");
+    dsv4l2_ae_destroy(ae);
+
+    free(frame);
+    free(yuyv);
+}
+
+#define IRW 1280
+#define IRH 1024
+
+/*
+ * 14-bit IR scene: background around 8000, a warm object ramping
+ * 8100-8400 in the middle, and a few hot pixels at 16000
+ */
+static void render_ir(uint16_t *frame, uint32_t seed)
+{
+    uint32_t x, y;
+
+    for (y = 0; y < IRH; y++) {
+        for (x = 0; x < IRW; x++) {
+            uint32_t noise = ((x * 73856093u) ^ (y * 19349663u) ^ seed) * 2654435761u >> 27;
+            uint16_t v = (uint16_t)(7990 + noise % 20);
+
+            if (x >= 400 && x < 880 && y >= 300 && y < 700) {
+                v = (uint16_t)(8100 + (x - 400) * 300 / 480);
+            }
+            if (x % 97 == 0 && y % 89 == 0) {
+                v = 16000;
+            }
+            frame[y * IRW + x] = v;
+        }
+    }
+}
+
+static void test_agc(void)
+{
+    static const uint32_t thread_counts[] = { 1, 4 };
+    dsv4l2_agc_config_t cfg;
+    dsv4l2_agc_t *agc;
+    dsv4l2_simd_level_t best = dsv4l2_simd_level();
+    uint16_t *frame = malloc(IRW * IRH * 2);
+    uint8_t *out = malloc(IRW * IRH), *ref = malloc(IRW * IRH);
+    uint32_t x, lo, hi;
+    int monotonic = 1, settled = 1, same = 1;
+    size_t t;
+    int i;
+
+    printf("\nTest: Thermal AGC\n");
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.width = IRW;
+    cfg.height = IRH;
+    cfg.bits = 17;
+    TEST_ASSERT(dsv4l2_agc_create(&cfg, &agc) == -EINVAL, "More than 16 bits rejected");
+    cfg.bits = 14;
+    TEST_ASSERT(dsv4l2_agc_create(&cfg, &agc) == 0, "Create 14-bit AGC");
+
+    render_ir(frame, 1);
+    TEST_ASSERT(dsv4l2_agc_apply(agc, (uint8_t *)frame, IRW * IRH, out, IRW) == -EMSGSIZE,
+                "Short frame rejected");
+    dsv4l2_agc_apply(agc, (uint8_t *)frame, IRW * IRH * 2, out, IRW);
+
+    /* A linear stretch would give the object about 10 of 255 levels */
+    lo = out[500 * IRW + 400];
+    hi = out[500 * IRW + 879];
+    for (x = 401; x < 880; x++) {
+        if (out[500 * IRW + x] < out[500 * IRW + x - 1]) {
+            monotonic = 0;
+        }
+    }
+    printf("  object %u..%u, background %u, hot %u\n", lo, hi, out[10 * IRW + 11], out[0]);
+    TEST_ASSERT(hi - lo > 100 && monotonic, "Object detail spread over the output range");
+    TEST_ASSERT(out[0] >= hi && out[10 * IRW + 11] < lo, "Order kept: background < object <= hot");
+
+    /* Scene change: the mapping follows over a few frames */
+    for (i = 0; i < IRW * IRH; i++) {
+        frame[i] = (uint16_t)(frame[i] + 500 > 16383 ? 16383 : frame[i] + 500);
+    }
+    dsv4l2_agc_apply(agc, (uint8_t *)frame, IRW * IRH * 2, out, IRW);
+    lo = out[500 * IRW + 640];
+    for (i = 0; i < 30; i++) {
+        dsv4l2_agc_apply(agc, (uint8_t *)frame, IRW * IRH * 2, out, IRW);
+    }
+    hi = out[500 * IRW + 640];
+    dsv4l2_agc_reset(agc);
+    dsv4l2_agc_apply(agc, (uint8_t *)frame, IRW * IRH * 2, ref, IRW);
+    for (i = 0; i < IRW * IRH; i++) {
+        if (out[i] > ref[i] + 1 || ref[i] > out[i] + 1) {
+            settled = 0;
+        }
+    }
+    TEST_ASSERT(lo != hi && settled, "Smoothed mapping settles on the reset one");
+    dsv4l2_agc_destroy(agc);
+
+    /* Flat scene: noise over 3 levels stays a narrow band around mid-grey */
+    for (i = 0; i < IRW * IRH; i++) {
+        frame[i] = (uint16_t)(8000 + i % 3);
+    }
+    dsv4l2_agc_create(&cfg, &agc);
+    dsv4l2_agc_apply(agc, (uint8_t *)frame, IRW * IRH * 2, out, IRW);
+    TEST_ASSERT(out[0] >= 120 && out[2] <= 136 && out[0] < out[2], "Flat scene gain limited");
+    dsv4l2_agc_destroy(agc);
+
+    /* Band counts and kernel levels agree */
+    render_ir(frame, 2);
+    for (t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        cfg.threads = thread_counts[t];
+        dsv4l2_simd_set_level(t == 0 ? DSV4L2_SIMD_SCALAR : best);
+        dsv4l2_agc_create(&cfg, &agc);
+        dsv4l2_agc_apply(agc, (uint8_t *)frame, IRW * IRH * 2, t == 0 ? ref : out, IRW);
+        dsv4l2_agc_destroy(agc);
+    }
+    same = memcmp(out, ref, IRW * IRH) == 0;
+    TEST_ASSERT(same, "4 bands with SIMD match 1 scalar band");
+    dsv4l2_simd_set_level(best);
+
+    free(frame);
+    free(out);
+    free(ref);
+}
+
+static void test_agc_stage(void)
+{
+    dsv4l2_agc_config_t cfg;
+    dsv4l2_agc_t *agc;
+    dsv4l2_lease_t *lease;
+    struct timespec a, b;
+    uint16_t *frame = malloc(IRW * IRH * 2);
+    uint8_t *out = malloc(IRW * IRH);
+    uint64_t ns;
+    int i;
+
+    printf("\nTest: Thermal AGC stage and cost\n");
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.width = IRW;
+    cfg.height = IRH;
+    cfg.bits = 14;
+    dsv4l2_agc_create(&cfg, &agc);
+    render_ir(frame, 3);
+
+    dsv4l2_lease_wrap((uint8_t *)frame, IRW * IRH * 2, NULL, &lease);
+    TEST_ASSERT(dsv4l2_agc_stage(lease, agc) == 0 &&
+                dsv4l2_lease_get(lease, DSV4L2_SLOT_CONVERTED) != NULL,
+                "Stage attaches the 8-bit image");
+    dsv4l2_lease_release(lease);
+
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    for (i = 0; i < 60; i++) {
+        dsv4l2_agc_apply(agc, (uint8_t *)frame, IRW * IRH * 2, out, IRW);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    ns = (uint64_t)(b.tv_sec - a.tv_sec) * 1000000000ULL + (uint64_t)(b.tv_nsec - a.tv_nsec);
+
+    printf("  1280x1024 Y16, 1 thread: %.1f us per frame\n", ns / 60 / 1000.0);
+    TEST_ASSERT(ns / 60 < 16666666, "Keeps up with 60 Hz on one thread");
+
+    dsv4l2_agc_destroy(agc);
+    free(frame);
+    free(out);
+}
+
+/* IR test image: a smooth gradient */
+static void fill_ir(uint8_t *ir, uint32_t w, uint32_t h)
+{
+    uint32_t x, y;
+
+    for (y = 0; y < h; y++) {
+        for (x = 0; x < w; x++) {
+            ir[y * w + x] = (uint8_t)((x * 3 + y * 2) & 0xff);
+        }
+    }
+}
+
+static void make_fusion_config(dsv4l2_fusion_config_t *cfg, uint32_t pixelformat,
+                               uint32_t w, uint32_t h, uint32_t ir_w, uint32_t ir_h)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->format.width = w;
+    cfg->format.height = h;
+    cfg->format.pixelformat = pixelformat;
+    cfg->ir_width = ir_w;
+    cfg->ir_height = ir_h;
+    cfg->homography[0] = cfg->homography[4] = cfg->homography[8] = 1.0;
+}
+
+static void test_fusion(void)
+{
+    static const dsv4l2_simd_level_t levels[] = {
+        DSV4L2_SIMD_SCALAR, DSV4L2_SIMD_SSE2, DSV4L2_SIMD_AVX2
+    };
+    static const double shift[9] = { 1, 0, -8, 0, 1, 0, 0, 0, 1 };
+    static const double tilt[9] = { 0.9, 0.05, 3, -0.04, 0.95, 2, 0.0001, 0, 1 };
+    dsv4l2_fusion_config_t cfg;
+    dsv4l2_fusion_t *fu;
+    dsv4l2_simd_level_t best = dsv4l2_simd_level();
+    uint8_t *ir = malloc(160 * 120);
+    uint8_t *vis = malloc(326 * 40 * 2);
+    uint8_t *ref = malloc(326 * 40 * 2);
+    uint32_t x, y, i;
+    int ok, same = 1;
+    size_t l;
+
+    printf("\nTest: IR / visible fusion\n");
+
+    make_fusion_config(&cfg, V4L2_PIX_FMT_GREY, 64, 48, 64, 48);
+    cfg.alpha = 256;
+    TEST_ASSERT(dsv4l2_fusion_create(&cfg, &fu) == 0, "Create fusion");
+    fill_ir(ir, 64, 48);
+
+    memset(vis, 100, 64 * 48);
+    dsv4l2_fusion_apply(fu, vis, 64 * 48, ir, 64 * 48);
+    TEST_ASSERT(memcmp(vis, ir, 64 * 48) == 0, "Identity at full alpha copies the IR frame");
+
+    dsv4l2_fusion_set_homography(fu, shift);
+    memset(vis, 100, 64 * 48);
+    dsv4l2_fusion_apply(fu, vis, 64 * 48, ir, 64 * 48);
+    ok = 1;
+    for (y = 0; y < 48; y++) {
+        for (x = 0; x < 64; x++) {
+            if (vis[y * 64 + x] != (x < 8 ? 100 : ir[y * 64 + x - 8])) {
+                ok = 0;
+            }
+        }
+    }
+    TEST_ASSERT(ok, "Translation shifts the IR frame; uncovered pixels unchanged");
+    dsv4l2_fusion_destroy(fu);
+
+    make_fusion_config(&cfg, V4L2_PIX_FMT_GREY, 64, 48, 64, 48);
+    dsv4l2_fusion_create(&cfg, &fu);
+    memset(vis, 100, 64 * 48);
+    dsv4l2_fusion_apply(fu, vis, 64 * 48, ir, 64 * 48);
+    ok = 1;
+    for (i = 0; i < 64 * 48; i++) {
+        if (vis[i] != (100 * 64 + ir[i] * 64 + 64) >> 7) {
+            ok = 0;
+        }
+    }
+    TEST_ASSERT(ok, "Default alpha mixes half and half");
+    dsv4l2_fusion_destroy(fu);
+
+    /* IR at half resolution: odd pixels interpolate */
+    make_fusion_config(&cfg, V4L2_PIX_FMT_GREY, 64, 48, 32, 24);
+    cfg.homography[0] = cfg.homography[4] = 0.5;
+    cfg.alpha = 256;
+    dsv4l2_fusion_create(&cfg, &fu);
+    fill_ir(ir, 32, 24);
+    memset(vis, 100, 64 * 48);
+    dsv4l2_fusion_apply(fu, vis, 64 * 48, ir, 32 * 24);
+    ok = vis[63] == 100;
+    for (y = 0; y < 48; y += 2) {
+        for (x = 0; x < 62; x += 2) {
+            const uint8_t *p = ir + (y / 2) * 32 + x / 2;
+
+            if (vis[y * 64 + x] != p[0] || vis[y * 64 + x + 1] != (p[0] + p[1] + 1) / 2) {
+                ok = 0;
+            }
+        }
+    }
+    TEST_ASSERT(ok, "Scaled homography samples and interpolates the IR frame");
+    dsv4l2_fusion_destroy(fu);
+
+    /* Colormap paints only the hot square */
+    make_fusion_config(&cfg, V4L2_PIX_FMT_RGB24, 64, 48, 64, 48);
+    cfg.mode = DSV4L2_FUSION_COLORMAP;
+    cfg.alpha = 256;
+    cfg.threshold = 200;
+    dsv4l2_fusion_create(&cfg, &fu);
+    memset(ir, 0, 64 * 48);
+    for (y = 16; y < 32; y++) {
+        memset(ir + y * 64 + 16, 255, 16);
+    }
+    for (i = 0; i < 64 * 48; i++) {
+        vis[3 * i] = 10;
+        vis[3 * i + 1] = 20;
+        vis[3 * i + 2] = 30;
+    }
+    dsv4l2_fusion_apply(fu, vis, 64 * 48 * 3, ir, 64 * 48);
+    ok = 1;
+    for (i = 0; i < 64 * 48; i++) {
+        const uint8_t *px = vis + 3 * i;
+
+        if (ir[i] ? (px[0] != 255 || px[1] != 255 || px[2] != 255)
+                  : (px[0] != 10 || px[1] != 20 || px[2] != 30)) {
+            ok = 0;
+        }
+    }
+    TEST_ASSERT(ok, "Colormap paints levels above the threshold only");
+    TEST_ASSERT(dsv4l2_fusion_apply(fu, vis, 64 * 48 * 3 - 1, ir, 64 * 48) == -EMSGSIZE &&
+                dsv4l2_fusion_apply(fu, vis, 64 * 48 * 3, ir, 64 * 48 - 1) == -EMSGSIZE,
+                "Short frames rejected");
+    dsv4l2_fusion_destroy(fu);
+
+    make_fusion_config(&cfg, V4L2_PIX_FMT_GREY, 64, 48, 64, 48);
+    memset(cfg.homography, 0, sizeof(cfg.homography));
+    TEST_ASSERT(dsv4l2_fusion_create(&cfg, &fu) == -EINVAL, "Singular homography rejected");
+    make_fusion_config(&cfg, V4L2_PIX_FMT_YUYV, 63, 48, 64, 48);
+    TEST_ASSERT(dsv4l2_fusion_create(&cfg, &fu) == -EINVAL, "Odd YUYV width rejected");
+
+    /* Perspective warp into YUYV: every SIMD level gives the same bytes */
+    make_fusion_config(&cfg, V4L2_PIX_FMT_YUYV, 326, 40, 160, 120);
+    memcpy(cfg.homography, tilt, sizeof(tilt));
+    cfg.mode = DSV4L2_FUSION_COLORMAP;
+    cfg.alpha = 200;
+    cfg.threshold = 60;
+    fill_ir(ir, 160, 120);
+
+    for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        dsv4l2_simd_set_level(levels[l]);
+        dsv4l2_fusion_create(&cfg, &fu);
+
+        for (i = 0; i < 326 * 40 * 2; i++) {
+            vis[i] = (uint8_t)(i * 7 + (i >> 5));
+        }
+        dsv4l2_fusion_apply(fu, vis, 326 * 40 * 2, ir, 160 * 120);
+        if (l == 0) {
+            memcpy(ref, vis, 326 * 40 * 2);
+        } else if (memcmp(ref, vis, 326 * 40 * 2) != 0) {
+            same = 0;
+        }
+
+        dsv4l2_fusion_destroy(fu);
+    }
+    dsv4l2_simd_set_level(best);
+    TEST_ASSERT(same, "Scalar, SSE2 and AVX2 fusion identical");
+
+    free(ir);
+    free(vis);
+    free(ref);
+}
+
+static void test_fusion_stage(void)
+{
+    dsv4l2_fusion_config_t cfg;
+    dsv4l2_fusion_stats_t stats;
+    dsv4l2_fusion_t *fu;
+    dsv4l2_lease_t *lease;
+    struct timespec a, b;
+    uint8_t *ir = malloc(640 * 512);
+    uint8_t *vis = malloc(1280 * 720 * 2);
+    uint64_t ns, vis_ts, ir_ts;
+    uint32_t k, j = 0;
+    int rc, ok = 1;
+
+    printf("\nTest: Fusion stages and cost\n");
+
+    /* 9 Hz IR into 30 Hz YUYV, IR frames delivered up to 20 ms late */
+    make_fusion_config(&cfg, V4L2_PIX_FMT_YUYV, 1280, 720, 640, 512);
+    cfg.homography[0] = cfg.homography[4] = 0.5;
+    cfg.homography[5] = 76.0;
+    cfg.max_skew_ns = 17000000ULL;
+    cfg.pair_once = 1;
+    dsv4l2_fusion_create(&cfg, &fu);
+    fill_ir(ir, 640, 512);
+    memset(vis, 128, 1280 * 720 * 2);
+
+    for (k = 0; k < 30; k++) {
+        vis_ts = (uint64_t)k * 1000000000ULL / 30;
+
+        for (; (ir_ts = (uint64_t)j * 1000000000ULL / 9) <= vis_ts + 20000000ULL && j < 9; j++) {
+            dsv4l2_lease_wrap(ir, 640 * 512, NULL, &lease);
+            lease->timestamp_ns = ir_ts;
+            if (dsv4l2_fusion_ir_stage(lease, fu) != 0) {
+                ok = 0;
+            }
+            dsv4l2_lease_release(lease);
+        }
+
+        dsv4l2_lease_wrap(vis, 1280 * 720 * 2, NULL, &lease);
+        lease->timestamp_ns = vis_ts;
+        rc = dsv4l2_fusion_stage(lease, fu);
+        if (rc == 0 ? !(lease->tags & DSV4L2_TAG_FUSED) : rc != DSV4L2_STAGE_SKIP) {
+            ok = 0;
+        }
+        dsv4l2_lease_release(lease);
+    }
+
+    dsv4l2_fusion_get_stats(fu, &stats);
+    TEST_ASSERT(ok, "Fused frames tagged, the rest skipped");
+    TEST_ASSERT(stats.ir_frames == 9 && stats.fused == 9 && stats.ir_unused == 0 &&
+                stats.unmatched == 21, "Output runs at the IR rate, every IR frame used once");
+    TEST_ASSERT(stats.last_skew_ns >= -17000000LL && stats.last_skew_ns <= 17000000LL,
+                "Skew within the limit");
+    dsv4l2_fusion_destroy(fu);
+
+    /* Without pair_once a frame too far from any IR frame passes unfused */
+    cfg.pair_once = 0;
+    dsv4l2_fusion_create(&cfg, &fu);
+    dsv4l2_fusion_push_ir(fu, ir, 640 * 512, 0);
+    dsv4l2_lease_wrap(vis, 1280 * 720 * 2, NULL, &lease);
+    lease->timestamp_ns = 50000000ULL;
+    TEST_ASSERT(dsv4l2_fusion_stage(lease, fu) == 0 && !(lease->tags & DSV4L2_TAG_FUSED),
+                "Frame outside the skew passes unfused");
+    lease->timestamp_ns = 10000000ULL;
+    TEST_ASSERT(dsv4l2_fusion_stage(lease, fu) == 0 && (lease->tags & DSV4L2_TAG_FUSED),
+                "Frame within the skew fused");
+    dsv4l2_lease_release(lease);
+
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    for (k = 0; k < 30; k++) {
+        dsv4l2_fusion_apply(fu, vis, 1280 * 720 * 2, ir, 640 * 512);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    ns = (uint64_t)(b.tv_sec - a.tv_sec) * 1000000000ULL + (uint64_t)(b.tv_nsec - a.tv_nsec);
+
+    printf("  640x512 IR into 1280x720 YUYV: %.1f us per frame\n", ns / 30 / 1000.0);
+    TEST_ASSERT(ns / 30 < 33333333, "Keeps up with 30 Hz on one core");
+
+    dsv4l2_fusion_destroy(fu);
+    free(ir);
+    free(vis);
+}
+
+/* Whole-frame GREY box blur with the redactor's rounding */
+static void ref_blur(const uint8_t *src, uint8_t *dst, uint32_t w, uint32_t h, uint32_t radius)
+{
+    uint32_t win = 2 * radius + 1, half = win / 2, m = 65536 / win;
+    uint32_t eh = h + 2 * radius;
+    uint8_t *hp = malloc((size_t)w * eh);
+    uint32_t x, y, i;
+
+    for (y = 0; y < eh; y++) {
+        int64_t sy = (int64_t)y - radius;
+
+        sy = sy < 0 ? 0 : sy >= h ? h - 1 : sy;
+        for (x = 0; x < w; x++) {
+            uint32_t sum = 0;
+
+            for (i = 0; i < win; i++) {
+                int64_t sx = (int64_t)x + i - radius;
+
+                sx = sx < 0 ? 0 : sx >= w ? w - 1 : sx;
+                sum += src[(size_t)sy * w + sx];
+            }
+            hp[(size_t)y * w + x] = (uint8_t)(((sum + half) * m) >> 16);
+        }
+    }
+
+    for (y = 0; y < h; y++) {
+        for (x = 0; x < w; x++) {
+            uint32_t sum = 0;
+
+            for (i = 0; i < win; i++) {
+                sum += hp[(size_t)(y + i) * w + x];
+            }
+            dst[(size_t)y * w + x] = (uint8_t)(((sum + half) * m) >> 16);
+        }
+    }
+
+    free(hp);
+}
+
+/* Frames big enough to split into several tiles on the shared pool */
+static void test_tiled(void)
+{
+    enum { TW = 3842, TH = 2166, FW = 4000, FH = 1200 };
+    dsv4l2_redact_config_t rcfg;
+    dsv4l2_redact_region_t reg;
+    dsv4l2_redactor_t *r;
+    dsv4l2_pyramid_config_t pcfg;
+    dsv4l2_pyramid_builder_t *pb;
+    dsv4l2_pyramid_t *pyr;
+    dsv4l2_fusion_config_t fcfg;
+    dsv4l2_fusion_t *fu;
+    uint8_t *frame = malloc((size_t)TW * TH * 2);
+    uint8_t *orig = malloc((size_t)TW * TH);
+    uint8_t *ref = malloc((size_t)TW * TH);
+    uint32_t x, y, cx, cy;
+    size_t i;
+    int ok;
+
+    printf("\nTest: Tiled full-frame kernels\n");
+
+    for (i = 0; i < (size_t)TW * TH; i++) {
+        orig[i] = (uint8_t)((i * 131) ^ (i >> 9));
+    }
+
+    /* Redaction over the whole frame: fill, pixelate and blur */
+    memset(&reg, 0, sizeof(reg));
+    reg.width = TW;
+    reg.height = TH;
+    memset(&rcfg, 0, sizeof(rcfg));
+    rcfg.format.width = TW;
+    rcfg.format.height = TH;
+    rcfg.format.pixelformat = V4L2_PIX_FMT_GREY;
+    dsv4l2_redact_create(&rcfg, &r);
+
+    memcpy(frame, orig, (size_t)TW * TH);
+    dsv4l2_redact_apply(r, frame, (size_t)TW * TH, &reg, 1);
+    ok = 1;
+    for (i = 1; i < (size_t)TW * TH; i++) {
+        ok &= frame[i] == frame[0];
+    }
+    TEST_ASSERT(ok, "Whole-frame fill covers every tile");
+
+    reg.mode = DSV4L2_REDACT_PIXELATE;
+    reg.param = 16;
+    memcpy(frame, orig, (size_t)TW * TH);
+    dsv4l2_redact_apply(r, frame, (size_t)TW * TH, &reg, 1);
+    for (cy = 0; cy < TH; cy += 16) {
+        for (cx = 0; cx < TW; cx += 16) {
+            uint32_t ch = TH - cy < 16 ? TH - cy : 16, cw = TW - cx < 16 ? TW - cx : 16;
+            uint32_t sum = 0, count = cw * ch;
+
+            for (y = cy; y < cy + ch; y++) {
+                for (x = cx; x < cx + cw; x++) {
+                    sum += orig[(size_t)y * TW + x];
+                }
+            }
+            for (y = cy; y < cy + ch; y++) {
+                memset(ref + (size_t)y * TW + cx, (sum + count / 2) / count, cw);
+            }
+        }
+    }
+    TEST_ASSERT(memcmp(frame, ref, (size_t)TW * TH) == 0, "Whole-frame pixelate matches reference");
+
+    reg.mode = DSV4L2_REDACT_BLUR;
+    reg.param = 8;
+    memcpy(frame, orig, (size_t)TW * TH);
+    dsv4l2_redact_apply(r, frame, (size_t)TW * TH, &reg, 1);
+    ref_blur(orig, ref, TW, TH, 8);
+    TEST_ASSERT(memcmp(frame, ref, (size_t)TW * TH) == 0, "Whole-frame blur matches reference");
+    dsv4l2_redact_destroy(r);
+
+    /* Pyramid: odd level widths leave a partial block at the edge */
+    for (i = 0; i < (size_t)TW * TH * 2; i++) {
+        frame[i] = (uint8_t)((i * 97) ^ (i >> 5));
+    }
+    memset(&pcfg, 0, sizeof(pcfg));
+    pcfg.format.width = TW;
+    pcfg.format.height = TH;
+    pcfg.format.pixelformat = V4L2_PIX_FMT_YUYV;
+    dsv4l2_pyramid_create(&pcfg, &pb);
+    TEST_ASSERT(dsv4l2_pyramid_build(pb, frame, (size_t)TW * TH * 2, &pyr) == 0 &&
+                check_pyramid(pyr, frame, TW * 2, 2),
+                "Tiled YUYV pyramid matches reference");
+    free(pyr);
+    dsv4l2_pyramid_destroy(pb);
+
+    /* Fusion: identity at full alpha copies the IR frame */
+    make_fusion_config(&fcfg, V4L2_PIX_FMT_GREY, FW, FH, FW, FH);
+    fcfg.alpha = 256;
+    dsv4l2_fusion_create(&fcfg, &fu);
+    fill_ir(ref, FW, FH);
+    memset(frame, 100, (size_t)FW * FH);
+    dsv4l2_fusion_apply(fu, frame, (size_t)FW * FH, ref, (size_t)FW * FH);
+    TEST_ASSERT(memcmp(frame, ref, (size_t)FW * FH) == 0, "Tiled fusion copies every pixel");
+    dsv4l2_fusion_destroy(fu);
+
+    free(frame);
+    free(orig);
+    free(ref);
+}
+
+int main(void)
+{
+    dsv4l2rt_config_t config;
+
+    printf("DSV4L2 Imaging Stage Tests\n");
+    printf("==========================\n");
+
+    memset(&config, 0, sizeof(config));
+    config.profile = DSV4L2_PROFILE_EXERCISE;
+    dsv4l2rt_init(&config);
+
+    test_detection();
+    test_simd_levels();
+    test_stage();
+    test_pyramid();
+    test_pyramid_stages();
+    test_redact();
+    test_redact_blur();
+    test_redact_stages();
+    test_overlay();
+    test_overlay_4k();
+    test_quality();
+    test_quality_stage();
+    test_auto_exposure();
+    test_auto_exposure_y16();
+    test_agc();
+    test_agc_stage();
+    test_fusion();
+    test_fusion_stage();
+    test_tiled();
+
+    dsv4l2rt_shutdown();
+
+    /* Print summary */
+    printf("\n==========================\n");
+    printf("Test Results:\n");
+    printf("  Passed: %d\n", tests_passed);
+    printf("  Failed: %d\n", tests_failed);
+    printf("  Total:  %d\n", tests_passed + tests_failed);
+
+    if (tests_failed > 0) {
+        printf("\nSome tests FAILED!\n");
+        return 1;
+    }
+
+    printf("\nAll tests PASSED!\n");
+    return 0;
+}
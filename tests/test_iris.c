@@ -0,0 +1,449 @@
+/*
+ * DSV4L2 Iris Matching Tests
+ *
+ * Check distances against a straightforward bit-by-bit reference, the
+ * rotation search, and that every kernel agrees with the scalar one
+ */
+
+#include "dsv4l2_iris.h"
+#include "dsv4l2_imaging.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/* Test result tracking */
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+#define TEST_ASSERT(cond, msg) do { \
+    if (cond) { \
+        printf("  [PASS] %s\n", msg); \
+        tests_passed++; \
+    } else { \
+        printf("  [FAIL] %s\n", msg); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int get_bit(const uint64_t *words, int b)
+{
+    b = ((b % DSV4L2_IRIS_CODE_BITS) + DSV4L2_IRIS_CODE_BITS) % DSV4L2_IRIS_CODE_BITS;
+    return (int)((words[b / 64] >> (b % 64)) & 1);
+}
+
+static void random_template(dsv4l2_iris_template_t *t)
+{
+    int i;
+
+    for (i = 0; i < DSV4L2_IRIS_CODE_WORDS; i++) {
+        t->code[i] = rng();
+        /* About 80% of bits usable, like eyelid/eyelash occlusion */
+        t->mask[i] = rng() | rng() | rng();
+    }
+}
+
+/* dst bit j = src bit (j - bits) */
+static void rotate_template(const dsv4l2_iris_template_t *src, int bits,
+                            dsv4l2_iris_template_t *dst)
+{
+    int j;
+
+    memset(dst, 0, sizeof(*dst));
+    for (j = 0; j < DSV4L2_IRIS_CODE_BITS; j++) {
+        dst->code[j / 64] |= (uint64_t)get_bit(src->code, j - bits) << (j % 64);
+        dst->mask[j / 64] |= (uint64_t)get_bit(src->mask, j - bits) << (j % 64);
+    }
+}
+
+/* Bit-by-bit reference for one rotation */
+static void reference_score(const dsv4l2_iris_template_t *p, const dsv4l2_iris_template_t *r,
+                            int bits, uint32_t *distance, uint32_t *valid)
+{
+    int j;
+
+    *distance = 0;
+    *valid = 0;
+    for (j = 0; j < DSV4L2_IRIS_CODE_BITS; j++) {
+        if (get_bit(p->mask, j + bits) && get_bit(r->mask, j)) {
+            (*valid)++;
+            *distance += (uint32_t)(get_bit(p->code, j + bits) != get_bit(r->code, j));
+        }
+    }
+}
+
+static void test_basic(void)
+{
+    dsv4l2_iris_template_t a, b, rotated;
+    dsv4l2_iris_match_t m;
+    uint32_t d, v, best_d = 0, best_v = 0;
+    int k, best_k = 0, ok;
+
+    printf("\nTest: Distances (%s kernel)\n", dsv4l2_iris_kernel());
+
+    random_template(&a);
+    random_template(&b);
+
+    TEST_ASSERT(dsv4l2_iris_compare(&a, &a, 8, 1, &m) == 0 && m.distance == 0 && m.shift == 0 &&
+                m.hd == 0.0, "Template matches itself at shift 0");
+    reference_score(&a, &a, 0, &d, &v);
+    TEST_ASSERT(m.valid == v, "Valid bits = mask overlap");
+
+    dsv4l2_iris_compare(&a, &b, 8, 1, &m);
+    ok = 1;
+    for (k = -8; k <= 8; k++) {
+        reference_score(&a, &b, k, &d, &v);
+        if (k == -8 || (uint64_t)d * best_v < (uint64_t)best_d * v) {
+            best_d = d;
+            best_v = v;
+            best_k = k;
+        }
+    }
+    ok = m.distance == best_d && m.valid == best_v && m.shift == best_k;
+    TEST_ASSERT(ok, "Unrelated templates: best of 17 rotations matches bit-by-bit reference");
+    TEST_ASSERT(m.hd > 0.4 && m.hd < 0.5, "Unrelated templates score near 0.5");
+    printf("  hd %.3f (%u / %u bits) at shift %d\n", m.hd, m.distance, m.valid, m.shift);
+
+    /* Rotate a by 3 steps of 16 bits: the search must undo it */
+    rotate_template(&a, 3 * 16, &rotated);
+    TEST_ASSERT(dsv4l2_iris_compare(&rotated, &a, 4, 16, &m) == 0 && m.hd == 0.0 && m.shift == 3,
+                "Rotated probe found at shift +3");
+    TEST_ASSERT(dsv4l2_iris_compare(&a, &rotated, 4, 16, &m) == 0 && m.hd == 0.0 && m.shift == -3,
+                "Swapped arguments found at shift -3");
+    TEST_ASSERT(dsv4l2_iris_compare(&rotated, &a, 2, 16, &m) == 0 && m.hd > 0.3,
+                "Rotation outside the search range not found");
+
+    memset(&b.mask, 0, sizeof(b.mask));
+    TEST_ASSERT(dsv4l2_iris_compare(&a, &b, 2, 1, &m) == 0 && m.valid == 0 && m.distance == 0 &&
+                m.hd == 1.0, "No mask overlap scores 1.0");
+
+    TEST_ASSERT(dsv4l2_iris_compare(&a, &b, DSV4L2_IRIS_MAX_SHIFT + 1, 1, &m) == -EINVAL,
+                "Too many rotations rejected");
+    TEST_ASSERT(dsv4l2_iris_compare(&a, &b, 1, 0, &m) == -EINVAL, "Zero step rejected");
+}
+
+static void test_kernels(void)
+{
+    dsv4l2_iris_template_t probe, refs[64];
+    dsv4l2_iris_probe_t *prepared;
+    dsv4l2_iris_match_t scalar[64], m;
+    dsv4l2_simd_level_t saved = dsv4l2_simd_level();
+    int i, ok = 1;
+
+    printf("\nTest: Kernel agreement\n");
+
+    random_template(&probe);
+    for (i = 0; i < 64; i++) {
+        /* Mix near matches in with unrelated templates */
+        if (i % 4 == 0) {
+            rotate_template(&probe, (i % 7) - 3, &refs[i]);
+            refs[i].code[i % DSV4L2_IRIS_CODE_WORDS] ^= rng();
+        } else {
+            random_template(&refs[i]);
+        }
+    }
+
+    dsv4l2_simd_set_level(DSV4L2_SIMD_SCALAR);
+    for (i = 0; i < 64; i++) {
+        dsv4l2_iris_compare(&probe, &refs[i], DSV4L2_IRIS_MAX_SHIFT, 1, &scalar[i]);
+    }
+    dsv4l2_simd_set_level(saved);
+
+    TEST_ASSERT(dsv4l2_iris_probe_create(&probe, DSV4L2_IRIS_MAX_SHIFT, 1, &prepared) == 0,
+                "Prepare probe");
+    for (i = 0; i < 64; i++) {
+        dsv4l2_iris_probe_match(prepared, &refs[i], &m);
+        ok &= m.distance == scalar[i].distance && m.valid == scalar[i].valid &&
+              m.shift == scalar[i].shift;
+        dsv4l2_iris_compare(&probe, &refs[i], DSV4L2_IRIS_MAX_SHIFT, 1, &m);
+        ok &= m.distance == scalar[i].distance && m.shift == scalar[i].shift;
+    }
+    printf("  %s kernel vs scalar\n", dsv4l2_iris_kernel());
+    TEST_ASSERT(ok, "All kernels agree on 64 templates x 33 rotations");
+    TEST_ASSERT(scalar[0].hd < 0.05 && scalar[0].shift == 3, "Near match found");
+
+    dsv4l2_iris_probe_destroy(prepared);
+}
+
+static double time_matches(const dsv4l2_iris_probe_t *prepared, const dsv4l2_iris_template_t *refs,
+                           int count, int rounds)
+{
+    dsv4l2_iris_match_t m;
+    uint64_t start = now_ns();
+    int r, i;
+
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < count; i++) {
+            dsv4l2_iris_probe_match(prepared, &refs[i], &m);
+        }
+    }
+    return (double)(now_ns() - start) / ((double)rounds * count);
+}
+
+static void test_timing(void)
+{
+    static dsv4l2_iris_template_t same[256], other[256];
+    dsv4l2_iris_template_t probe;
+    dsv4l2_iris_probe_t *prepared;
+    dsv4l2_simd_level_t saved = dsv4l2_simd_level();
+    double t_same, t_other, t_scalar;
+    int i;
+
+    printf("\nTest: Timing\n");
+
+    random_template(&probe);
+    for (i = 0; i < 256; i++) {
+        same[i] = probe;
+        random_template(&other[i]);
+    }
+
+    dsv4l2_iris_probe_create(&probe, 8, 16, &prepared);
+    time_matches(prepared, other, 256, 20);
+    t_same = time_matches(prepared, same, 256, 200);
+    t_other = time_matches(prepared, other, 256, 200);
+    dsv4l2_iris_probe_destroy(prepared);
+
+    dsv4l2_simd_set_level(DSV4L2_SIMD_SCALAR);
+    dsv4l2_iris_probe_create(&probe, 8, 16, &prepared);
+    t_scalar = time_matches(prepared, other, 256, 50);
+    dsv4l2_iris_probe_destroy(prepared);
+    dsv4l2_simd_set_level(saved);
+
+    printf("  +/-8 rotations: %.0f ns genuine, %.0f ns impostor (%s), %.0f ns scalar\n",
+           t_same, t_other, dsv4l2_iris_kernel(), t_scalar);
+    TEST_ASSERT(t_same > 0 && t_other > 0, "Timed genuine and impostor comparisons");
+}
+
+/* Genuine-like copy: rotated by `bits`, ~12% of code bits flipped */
+static void noisy_copy(const dsv4l2_iris_template_t *src, int bits, dsv4l2_iris_template_t *dst)
+{
+    int i;
+
+    rotate_template(src, bits, dst);
+    for (i = 0; i < DSV4L2_IRIS_CODE_WORDS; i++) {
+        dst->code[i] ^= rng() & rng() & rng();
+    }
+}
+
+static int same_results(const dsv4l2_iris_candidate_t *a, const dsv4l2_iris_candidate_t *b, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (a[i].slot != b[i].slot || a[i].id != b[i].id || a[i].match.distance != b[i].match.distance ||
+            a[i].match.valid != b[i].match.valid || a[i].match.shift != b[i].match.shift) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void test_gallery(void)
+{
+    const char *path = "/tmp/dsv4l2_test_gallery.dat";
+    dsv4l2_iris_search_t cfg = { .max_shift = 8, .step = 16, .k = 5, .threads = 4 };
+    dsv4l2_iris_candidate_t res[8], ref[8], one[8];
+    dsv4l2_iris_search_stats_t stats;
+    dsv4l2_iris_gallery_t *g;
+    dsv4l2_iris_template_t probe, t, back;
+    dsv4l2_iris_match_t m;
+    dsv4l2_simd_level_t saved = dsv4l2_simd_level();
+    uint64_t slot, id;
+    double best_other = 1.0;
+    int i, n, ok, fd;
+
+    printf("\nTest: Gallery\n");
+
+    random_template(&probe);
+    TEST_ASSERT(dsv4l2_iris_gallery_create(path, 1001, &g) == 0, "Create gallery");
+
+    ok = 1;
+    for (i = 0; i < 1001; i++) {
+        if (i == 537) {
+            noisy_copy(&probe, 2 * 16, &t);
+        } else {
+            random_template(&t);
+            dsv4l2_iris_compare(&probe, &t, 8, 16, &m);
+            best_other = m.hd < best_other ? m.hd : best_other;
+        }
+        ok &= dsv4l2_iris_gallery_enroll(g, &t, 5000 + i, &slot) == 0 && slot == (uint64_t)i;
+    }
+    TEST_ASSERT(ok && dsv4l2_iris_gallery_count(g) == 1001, "Enroll 1001 templates");
+
+    n = dsv4l2_iris_gallery_search(g, &probe, &cfg, res, &stats);
+    TEST_ASSERT(n == 5, "Search returns k candidates");
+    TEST_ASSERT(res[0].slot == 537 && res[0].id == 5537 && res[0].match.shift == -2,
+                "Genuine ranked first at shift -2");
+    printf("  genuine hd %.3f, best impostor %.3f\n", res[0].match.hd, best_other);
+    TEST_ASSERT(res[0].match.hd < 0.2 && res[1].match.hd == best_other,
+                "Runner-up is the closest impostor");
+
+    ok = 1;
+    for (i = 0; i < n; i++) {
+        dsv4l2_iris_gallery_get(g, res[i].slot, &t, NULL);
+        dsv4l2_iris_compare(&probe, &t, 8, 16, &m);
+        ok &= m.distance == res[i].match.distance && m.valid == res[i].match.valid &&
+              m.shift == res[i].match.shift;
+        ok &= i == 0 || res[i - 1].match.hd <= res[i].match.hd;
+    }
+    TEST_ASSERT(ok, "Candidates sorted and equal to 1:1 comparison");
+
+    cfg.threads = 1;
+    dsv4l2_iris_gallery_search(g, &probe, &cfg, one, NULL);
+    TEST_ASSERT(same_results(res, one, n), "Single thread gives the same result");
+
+    dsv4l2_simd_set_level(DSV4L2_SIMD_SCALAR);
+    cfg.threads = 3;
+    dsv4l2_iris_gallery_search(g, &probe, &cfg, ref, NULL);
+    dsv4l2_simd_set_level(saved);
+    TEST_ASSERT(same_results(res, ref, n), "Scalar kernel gives the same result");
+
+    cfg.prefilter_hd = 0.40;
+    n = dsv4l2_iris_gallery_search(g, &probe, &cfg, one, &stats);
+    TEST_ASSERT(n >= 1 && one[0].slot == 537, "Prefilter keeps the genuine");
+    printf("  prefilter: %llu of %llu templates fully compared\n",
+           (unsigned long long)stats.compared, (unsigned long long)stats.templates);
+    TEST_ASSERT(stats.compared < stats.templates / 2, "Prefilter skips most blocks");
+    cfg.prefilter_hd = 0;
+
+    cfg.min_valid = DSV4L2_IRIS_CODE_BITS + 1;
+    n = dsv4l2_iris_gallery_search(g, &probe, &cfg, one, NULL);
+    TEST_ASSERT(n == 5 && one[0].match.hd == 1.0 && one[0].slot == 0,
+                "Too little overlap scores 1.0");
+    cfg.min_valid = 0;
+
+    cfg.k = 0;
+    TEST_ASSERT(dsv4l2_iris_gallery_search(g, &probe, &cfg, one, NULL) == -EINVAL, "k = 0 rejected");
+    cfg.k = 5;
+
+    TEST_ASSERT(dsv4l2_iris_gallery_close(g) == 0, "Close gallery");
+
+    TEST_ASSERT(dsv4l2_iris_gallery_open(path, 0, &g) == 0 && dsv4l2_iris_gallery_count(g) == 1001,
+                "Reopen read-only");
+    noisy_copy(&probe, 2 * 16, &t);
+    TEST_ASSERT(dsv4l2_iris_gallery_get(g, 537, &back, &id) == 0 && id == 5537,
+                "Read back enrolled template");
+    TEST_ASSERT(dsv4l2_iris_gallery_get(g, 1001, &back, &id) == -ENOENT, "Unenrolled slot");
+    TEST_ASSERT(dsv4l2_iris_gallery_enroll(g, &t, 1, NULL) == -EROFS, "Read-only gallery refuses enrollment");
+    n = dsv4l2_iris_gallery_search(g, &probe, &cfg, one, NULL);
+    TEST_ASSERT(n == 5 && same_results(res, one, n), "Reopened gallery gives the same result");
+    dsv4l2_iris_gallery_close(g);
+
+    fd = open(path, O_WRONLY);
+    TEST_ASSERT(fd >= 0 && pwrite(fd, "XXXX", 4, 0) == 4, "Corrupt header");
+    close(fd);
+    TEST_ASSERT(dsv4l2_iris_gallery_open(path, 0, &g) == -EBADMSG, "Corrupt gallery rejected");
+
+    dsv4l2_iris_gallery_create(path, 3, &g);
+    for (i = 0; i < 8; i++) {
+        dsv4l2_iris_gallery_enroll(g, &t, (uint64_t)i, NULL);
+    }
+    TEST_ASSERT(dsv4l2_iris_gallery_enroll(g, &t, 8, NULL) == -ENOSPC, "Full gallery returns -ENOSPC");
+    cfg.k = 10;
+    n = dsv4l2_iris_gallery_search(g, &t, &cfg, res, NULL);
+    ok = n == 8;
+    for (i = 0; i < n; i++) {
+        ok &= res[i].slot == (uint64_t)i && res[i].match.distance == 0;
+    }
+    TEST_ASSERT(ok, "Fewer templates than k returns them all, ranked");
+    cfg.k = 5;
+    dsv4l2_iris_gallery_close(g);
+
+    unlink(path);
+}
+
+static void test_gallery_speed(void)
+{
+    const char *path = "/tmp/dsv4l2_test_gallery_big.dat";
+    const uint32_t count = 131072;
+    dsv4l2_iris_search_t cfg = { .max_shift = 8, .step = 16, .k = 10 };
+    dsv4l2_iris_candidate_t res[10];
+    dsv4l2_iris_search_stats_t stats;
+    dsv4l2_iris_gallery_t *g;
+    dsv4l2_iris_template_t probe, t;
+    uint32_t i;
+    int ok = 1;
+
+    printf("\nTest: Gallery search speed\n");
+
+    random_template(&probe);
+    if (dsv4l2_iris_gallery_create(path, count, &g) < 0) {
+        TEST_ASSERT(0, "Create gallery");
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        if (i == count - 3) {
+            noisy_copy(&probe, -16, &t);
+        } else {
+            random_template(&t);
+        }
+        dsv4l2_iris_gallery_enroll(g, &t, i, NULL);
+    }
+
+    /* Warm the page cache */
+    dsv4l2_iris_gallery_search(g, &probe, &cfg, res, &stats);
+
+    ok &= dsv4l2_iris_gallery_search(g, &probe, &cfg, res, &stats) == 10 && res[0].slot == count - 3;
+    printf("  %u templates, 17 rotations, %u threads (%s): %.1f ms (%.0f ms per 1M)\n",
+           count, stats.threads, dsv4l2_iris_kernel(), stats.elapsed_ns / 1e6,
+           stats.elapsed_ns / 1e6 * (1048576.0 / count));
+
+    cfg.prefilter_hd = 0.40;
+    ok &= dsv4l2_iris_gallery_search(g, &probe, &cfg, res, &stats) >= 1 && res[0].slot == count - 3;
+    printf("  with prefilter: %.1f ms (%.0f ms per 1M), %.1f%% fully compared\n",
+           stats.elapsed_ns / 1e6, stats.elapsed_ns / 1e6 * (1048576.0 / count),
+           100.0 * stats.compared / stats.templates);
+    TEST_ASSERT(ok, "Genuine found in large gallery");
+
+    dsv4l2_iris_gallery_close(g);
+    unlink(path);
+}
+
+int main(void)
+{
+    printf("DSV4L2 Iris Matching Tests\n");
+    printf("==========================\n");
+
+    test_basic();
+    test_kernels();
+    test_timing();
+    test_gallery();
+    test_gallery_speed();
+
+    /* Print summary */
+    printf("\n==========================\n");
+    printf("Test Results:\n");
+    printf("  Passed: %d\n", tests_passed);
+    printf("  Failed: %d\n", tests_failed);
+    printf("  Total:  %d\n", tests_passed + tests_failed);
+
+    if (tests_failed > 0) {
+        printf("\nSome tests FAILED!\n");
+        return 1;
+    }
+
+    printf("\nAll tests PASSED!\n");
+    return 0;
+}
@@ -0,0 +1,452 @@
+/*
+ * DSV4L2 Pipeline Tests
+ *
+ * Test frame leases, staged processing, ordering, backpressure and
+ * the work-stealing pool (uses wrapped memory leases, no hardware required)
+ */
+
+#include "dsv4l2_pipeline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+/* Test result tracking */
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+#define TEST_ASSERT(cond, msg) do { \
+    if (cond) { \
+        printf("  [PASS] %s\n", msg); \
+        tests_passed++; \
+    } else { \
+        printf("  [FAIL] %s\n", msg); \
+        tests_failed++; \
+    } \
+} while (0)
+
+/* Frames whose memory has been handed back */
+static int frames_freed = 0;
+static pthread_mutex_t freed_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void count_free(void *data)
+{
+    (void)data;
+    pthread_mutex_lock(&freed_lock);
+    frames_freed++;
+    pthread_mutex_unlock(&freed_lock);
+}
+
+static int attachments_freed = 0;
+
+static void count_attachment_free(void *ptr)
+{
+    __atomic_fetch_add(&attachments_freed, 1, __ATOMIC_RELAXED);
+    free(ptr);
+}
+
+/* Sink that records the order frames arrive in */
+typedef struct {
+    uint32_t order[256];
+    int      count;
+} sink_ctx_t;
+
+static int stage_sink(dsv4l2_lease_t *lease, void *ctx)
+{
+    sink_ctx_t *sink = ctx;
+
+    if (sink->count < 256) {
+        sink->order[sink->count] = lease->tags;
+    }
+    sink->count++;
+    return 0;
+}
+
+/* Variable-latency work so parallel workers finish out of order */
+static int stage_jitter(dsv4l2_lease_t *lease, void *ctx)
+{
+    (void)ctx;
+    usleep((lease->tags * 7919u) % 5 * 300);
+    return 0;
+}
+
+static int stage_slow(dsv4l2_lease_t *lease, void *ctx)
+{
+    (void)lease;
+    (void)ctx;
+    usleep(2000);
+    return 0;
+}
+
+/* Skips odd frames, fails every 4th */
+static int stage_filter(dsv4l2_lease_t *lease, void *ctx)
+{
+    (void)ctx;
+    if (lease->tags % 4 == 0) {
+        return -EIO;
+    }
+    if (lease->tags % 2 == 1) {
+        return DSV4L2_STAGE_SKIP;
+    }
+    return 0;
+}
+
+static int stage_attach(dsv4l2_lease_t *lease, void *ctx)
+{
+    (void)ctx;
+    return dsv4l2_lease_attach(lease, DSV4L2_SLOT_DIGEST, malloc(32),
+                               count_attachment_free);
+}
+
+static int stage_check_attach(dsv4l2_lease_t *lease, void *ctx)
+{
+    int *seen = ctx;
+
+    if (dsv4l2_lease_get(lease, DSV4L2_SLOT_DIGEST) != NULL) {
+        (*seen)++;
+    }
+    return 0;
+}
+
+/**
+ * Submit n wrapped frames tagged with their index
+ */
+static int submit_frames(dsv4l2_pipeline_t *p, int n, uint8_t *buf)
+{
+    int i, dropped = 0;
+
+    for (i = 0; i < n; i++) {
+        dsv4l2_lease_t *lease;
+
+        if (dsv4l2_lease_wrap(buf, 64, count_free, &lease) != 0) {
+            return -1;
+        }
+        lease->tags = (uint32_t)i;
+
+        if (dsv4l2_pipeline_submit(p, lease) == -EAGAIN) {
+            dropped++;
+        }
+    }
+
+    return dropped;
+}
+
+/**
+ * Test lease basics
+ */
+static void test_leases(void)
+{
+    dsv4l2_lease_t *lease;
+    uint8_t data[16];
+
+    printf("\nTest: Frame leases\n");
+
+    TEST_ASSERT(dsv4l2_lease_wrap(NULL, 16, NULL, &lease) == -EINVAL,
+                "Wrap rejects NULL data with length");
+    TEST_ASSERT(dsv4l2_lease_acquire(NULL, &lease) == -EINVAL,
+                "Acquire rejects NULL device");
+
+    frames_freed = 0;
+    attachments_freed = 0;
+    TEST_ASSERT(dsv4l2_lease_wrap(data, sizeof(data), count_free, &lease) == 0,
+                "Wrap caller memory");
+    TEST_ASSERT(lease->data == data && lease->len == sizeof(data),
+                "Lease points at caller memory");
+    TEST_ASSERT(dsv4l2_lease_attach(lease, DSV4L2_SLOT_COUNT, NULL, NULL) == -EINVAL,
+                "Attach rejects invalid slot");
+
+    dsv4l2_lease_attach(lease, DSV4L2_SLOT_META, malloc(8), count_attachment_free);
+    TEST_ASSERT(dsv4l2_lease_get(lease, DSV4L2_SLOT_META) != NULL, "Attachment stored");
+    dsv4l2_lease_attach(lease, DSV4L2_SLOT_META, malloc(8), count_attachment_free);
+    TEST_ASSERT(attachments_freed == 1, "Replacing an attachment frees the old one");
+
+    dsv4l2_lease_release(lease);
+    TEST_ASSERT(attachments_freed == 2, "Release frees attachments");
+    TEST_ASSERT(frames_freed == 1, "Release hands memory back");
+}
+
+/**
+ * Test ordered reassembly with a parallel stage
+ */
+static void test_ordering(void)
+{
+    dsv4l2_pipeline_t *p;
+    dsv4l2_stage_stats_t stats;
+    sink_ctx_t sink;
+    uint8_t buf[64];
+    int i, in_order = 1;
+
+    dsv4l2_stage_config_t work = {
+        .name = "jitter", .fn = stage_jitter, .parallelism = 4,
+        .queue_depth = 4, .ordered = 1,
+    };
+    dsv4l2_stage_config_t out = {
+        .name = "sink", .fn = stage_sink, .ctx = &sink,
+    };
+
+    printf("\nTest: Ordered reassembly\n");
+
+    memset(&sink, 0, sizeof(sink));
+    frames_freed = 0;
+
+    TEST_ASSERT(dsv4l2_pipeline_create(DSV4L2_BACKPRESSURE_BLOCK, &p) == 0,
+                "Create pipeline");
+    TEST_ASSERT(dsv4l2_pipeline_start(p) == -EINVAL, "Start rejects empty pipeline");
+    dsv4l2_pipeline_add_stage(p, &work);
+    dsv4l2_pipeline_add_stage(p, &out);
+    TEST_ASSERT(dsv4l2_pipeline_stage_count(p) == 2, "Two stages added");
+    TEST_ASSERT(dsv4l2_pipeline_start(p) == 0, "Start workers");
+    TEST_ASSERT(dsv4l2_pipeline_add_stage(p, &out) == -EBUSY,
+                "Cannot add stages while running");
+
+    TEST_ASSERT(submit_frames(p, 200, buf) == 0, "BLOCK mode drops nothing");
+    dsv4l2_pipeline_stop(p);
+
+    for (i = 0; i < sink.count && i < 256; i++) {
+        if (sink.order[i] != (uint32_t)i) {
+            in_order = 0;
+        }
+    }
+    TEST_ASSERT(sink.count == 200, "Every frame reached the sink");
+    TEST_ASSERT(in_order, "Frames leave a parallel ordered stage in order");
+    TEST_ASSERT(frames_freed == 200, "Every lease released at the end");
+
+    dsv4l2_pipeline_get_stage_stats(p, 0, &stats);
+    TEST_ASSERT(stats.frames_in == 200 && stats.frames_out == 200,
+                "Stage counters match");
+    TEST_ASSERT(stats.queue_high_water <= stats.queue_capacity,
+                "Occupancy bounded by capacity");
+    TEST_ASSERT(dsv4l2_stats_percentile_us(stats.service_hist, 50.0) > 0,
+                "Service latency recorded");
+    TEST_ASSERT(dsv4l2_pipeline_get_stage_stats(p, 2, &stats) == -EINVAL,
+                "Stats rejects bad stage index");
+
+    TEST_ASSERT(dsv4l2_pipeline_submit(p, NULL) == -EINVAL, "Submit rejects NULL lease");
+    dsv4l2_pipeline_destroy(p);
+}
+
+/**
+ * Test skip/error results and attachments flowing between stages
+ */
+static void test_stage_results(void)
+{
+    dsv4l2_pipeline_t *p;
+    dsv4l2_stage_stats_t stats;
+    uint8_t buf[64];
+    int seen = 0;
+
+    dsv4l2_stage_config_t filter = { .name = "filter", .fn = stage_filter, .parallelism = 2 };
+    dsv4l2_stage_config_t attach = { .name = "hash", .fn = stage_attach };
+    dsv4l2_stage_config_t check = { .name = "check", .fn = stage_check_attach, .ctx = &seen };
+
+    printf("\nTest: Stage results and attachments\n");
+
+    frames_freed = 0;
+    attachments_freed = 0;
+
+    dsv4l2_pipeline_create(DSV4L2_BACKPRESSURE_BLOCK, &p);
+    dsv4l2_pipeline_add_stage(p, &filter);
+    dsv4l2_pipeline_add_stage(p, &attach);
+    dsv4l2_pipeline_add_stage(p, &check);
+    dsv4l2_pipeline_start(p);
+
+    submit_frames(p, 100, buf);
+    dsv4l2_pipeline_stop(p);
+
+    dsv4l2_pipeline_get_stage_stats(p, 0, &stats);
+    TEST_ASSERT(stats.errors == 25, "Errors counted");
+    TEST_ASSERT(stats.skipped == 50, "Skips counted");
+    TEST_ASSERT(stats.frames_out == 25, "Remaining frames passed on");
+    TEST_ASSERT(seen == 25, "Attachments visible to later stages");
+    TEST_ASSERT(attachments_freed == 25, "Attachments freed at release");
+    TEST_ASSERT(frames_freed == 100, "Skipped and failed frames released");
+
+    dsv4l2_pipeline_destroy(p);
+}
+
+/**
+ * Test DROP backpressure
+ */
+static void test_backpressure(void)
+{
+    dsv4l2_pipeline_t *p;
+    dsv4l2_stage_stats_t stats;
+    uint8_t buf[64];
+    int dropped;
+
+    dsv4l2_stage_config_t slow = { .name = "slow", .fn = stage_slow, .queue_depth = 2 };
+
+    printf("\nTest: Backpressure\n");
+
+    frames_freed = 0;
+
+    dsv4l2_pipeline_create(DSV4L2_BACKPRESSURE_DROP, &p);
+    dsv4l2_pipeline_add_stage(p, &slow);
+    dsv4l2_pipeline_start(p);
+
+    dropped = submit_frames(p, 50, buf);
+    dsv4l2_pipeline_stop(p);
+
+    dsv4l2_pipeline_get_stage_stats(p, 0, &stats);
+    TEST_ASSERT(dropped > 0, "Full queue drops instead of blocking the producer");
+    TEST_ASSERT(stats.dropped == (uint64_t)dropped, "Drops counted on the stage");
+    TEST_ASSERT(stats.frames_in + stats.dropped == 50, "Every frame accounted for");
+    TEST_ASSERT(frames_freed == 50, "Dropped frames released");
+
+    TEST_ASSERT(submit_frames(p, 1, buf) == 0 && frames_freed == 51,
+                "Submit after stop releases the frame");
+
+    dsv4l2_pipeline_destroy(p);
+}
+
+/* Each item is counted exactly once */
+typedef struct {
+    uint8_t *hits;
+    dsv4l2_pool_t *pool;
+    uint32_t max_range;
+} range_ctx_t;
+
+static void range_mark(void *ctx, uint32_t begin, uint32_t end)
+{
+    range_ctx_t *rc = ctx;
+    uint32_t i;
+
+    if (end - begin > rc->max_range) {
+        rc->max_range = end - begin;  /* Racy, only ever compared to grain */
+    }
+    for (i = begin; i < end; i++) {
+        __atomic_fetch_add(&rc->hits[i], 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* Nested parallel_for from inside a pool task */
+static void range_nested(void *ctx, uint32_t begin, uint32_t end)
+{
+    range_ctx_t *rc = ctx;
+    uint32_t i;
+
+    for (i = begin; i < end; i++) {
+        range_ctx_t inner = { rc->hits + i * 64, rc->pool, 0 };
+        dsv4l2_parallel_for(rc->pool, 64, 4, range_mark, &inner);
+    }
+}
+
+/* Fills each tile with a byte derived from its position */
+typedef struct {
+    uint8_t *image;
+    uint32_t width;
+    uint32_t tiles;
+} tile_ctx_t;
+
+static void tile_fill(void *ctx, const dsv4l2_tile_t *tile)
+{
+    tile_ctx_t *tc = ctx;
+    uint32_t x, y;
+
+    for (y = tile->y; y < tile->y + tile->height; y++) {
+        for (x = tile->x; x < tile->x + tile->width; x++) {
+            tc->image[(size_t)y * tc->width + x] += (uint8_t)(x ^ y) | 1;
+        }
+    }
+    __atomic_fetch_add(&tc->tiles, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Test the work-stealing pool
+ */
+static void test_pool(void)
+{
+    dsv4l2_pool_config_t cfg = { .threads = 4, .pin = 0, .numa_node = -1 };
+    dsv4l2_pool_t *pool;
+    dsv4l2_pool_stats_t stats;
+    range_ctx_t rc;
+    tile_ctx_t tc;
+    uint32_t i, w = 3840, h = 2160, bad = 0;
+
+    printf("\nTest: Work-stealing pool\n");
+
+    TEST_ASSERT(dsv4l2_pool_create(&cfg, &pool) == 0, "Create 4-worker pool");
+    TEST_ASSERT(dsv4l2_parallel_for(pool, 10, 1, NULL, NULL) == -EINVAL,
+                "parallel_for rejects NULL body");
+
+    rc.hits = calloc(100000, 1);
+    rc.pool = pool;
+    rc.max_range = 0;
+    dsv4l2_parallel_for(pool, 100000, 64, range_mark, &rc);
+    for (i = 0; i < 100000; i++) {
+        bad += rc.hits[i] != 1;
+    }
+    TEST_ASSERT(bad == 0, "Every item processed exactly once");
+    TEST_ASSERT(rc.max_range <= 64, "Ranges never exceed the grain");
+
+    memset(rc.hits, 0, 100000);
+    dsv4l2_parallel_for(pool, 256, 1, range_nested, &rc);
+    for (i = 0, bad = 0; i < 256 * 64; i++) {
+        bad += rc.hits[i] != 1;
+    }
+    TEST_ASSERT(bad == 0, "Nested parallel_for completes");
+    free(rc.hits);
+
+    tc.image = calloc((size_t)w * h, 1);
+    tc.width = w;
+    tc.tiles = 0;
+    dsv4l2_parallel_tiles(pool, w, h, 1, tile_fill, &tc);
+    for (i = 0, bad = 0; i < w * h; i++) {
+        bad += tc.image[i] != ((uint8_t)((i % w) ^ (i / w)) | 1);
+    }
+    TEST_ASSERT(bad == 0, "Tiles cover a 4K frame exactly once");
+    TEST_ASSERT(tc.tiles > 1, "4K frame split into several tiles");
+
+    memset(tc.image, 0, (size_t)w * h);
+    tc.tiles = 0;
+    dsv4l2_parallel_tiles(NULL, w, h, 1, tile_fill, &tc);
+    TEST_ASSERT(tc.image[(size_t)w * h - 1] != 0 && tc.tiles > 1,
+                "NULL pool runs tiles serially");
+    free(tc.image);
+
+    /* 4G one-pixel rows: column count times row count exceeds uint32_t */
+    tc.tiles = 0;
+    TEST_ASSERT(dsv4l2_parallel_tiles(pool, UINT32_MAX, UINT32_MAX, 1, tile_fill, &tc) ==
+                -EOVERFLOW && tc.tiles == 0,
+                "Tile count beyond uint32_t rejected before any tile runs");
+
+    dsv4l2_pool_get_stats(pool, &stats);
+    TEST_ASSERT(stats.threads == 4, "Pool reports its worker count");
+    TEST_ASSERT(stats.numa_nodes >= 1, "Workers mapped to a NUMA node");
+    TEST_ASSERT(stats.jobs >= 3 && stats.tasks >= stats.jobs, "Jobs and tasks counted");
+    dsv4l2_pool_destroy(pool);
+
+    TEST_ASSERT(dsv4l2_pool_shared() != NULL, "Shared pool available");
+    TEST_ASSERT(dsv4l2_pool_shared() == dsv4l2_pool_shared(),
+                "Shared pool is a process-wide singleton");
+}
+
+int main(void)
+{
+    printf("DSV4L2 Pipeline Tests\n");
+    printf("=====================\n");
+
+    test_leases();
+    test_ordering();
+    test_stage_results();
+    test_backpressure();
+    test_pool();
+
+    /* Print summary */
+    printf("\n=====================\n");
+    printf("Test Results:\n");
+    printf("  Passed: %d\n", tests_passed);
+    printf("  Failed: %d\n", tests_failed);
+    printf("  Total:  %d\n", tests_passed + tests_failed);
+
+    if (tests_failed > 0) {
+        printf("\nSome tests FAILED!\n");
+        return 1;
+    }
+
+    printf("\nAll tests PASSED!\n");
+    return 0;
+}
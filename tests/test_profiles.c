@@ -68,6 +68,39 @@ int main(void)
     }
     printf("\n");
 
+    /* Test 5: Parse profile from memory */
+    printf("Test 5: Parse profile from memory\n");
+    {
+        static const char text[] =
+            "# inline profile\n"
+            "id: \"1234:5678\"\n"
+            "role: ir_sensor\n"
+            "classification: 'SECRET'\n"
+            "tempest_ctrl_id: 0x9a0903\n"
+            "width: 640\n"
+            "capture_cpu: 2\n"
+            "capture_priority: 40\n";
+        dsv4l2_device_profile_t parsed;
+
+        if (dsv4l2_parse_profile(text, sizeof(text) - 1, &parsed) == 0 &&
+            strcmp(parsed.id, "1234:5678") == 0 &&
+            strcmp(parsed.classification, "SECRET") == 0 &&
+            parsed.tempest_ctrl_id == 0x9a0903 && parsed.width == 640 &&
+            parsed.capture_cpu == 2 && parsed.capture_priority == 40) {
+            printf("  Parsed inline profile: %s (%s)\n", parsed.id, parsed.role);
+        } else {
+            printf("  ERROR: inline profile not parsed correctly\n");
+            return 1;
+        }
+
+        if (dsv4l2_parse_profile("role: camera\n", 13, &parsed) == 0) {
+            printf("  ERROR: profile without id accepted\n");
+            return 1;
+        }
+        printf("  Profile without id rejected\n");
+    }
+    printf("\n");
+
     printf("All profile tests completed!\n");
 
     return 0;
@@ -0,0 +1,445 @@
+/*
+ * DSV4L2 Recorder Tests
+ *
+ * Record synthetic frames through a pipeline, then read them back in
+ * random order; compressed codecs and ciphers are tested when compiled in
+ */
+
+#include "dsv4l2_recorder.h"
+#include "dsv4l2rt.h"
+
+#include <linux/videodev2.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+/* Test result tracking */
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+#define TEST_ASSERT(cond, msg) do { \
+    if (cond) { \
+        printf("  [PASS] %s\n", msg); \
+        tests_passed++; \
+    } else { \
+        printf("  [FAIL] %s\n", msg); \
+        tests_failed++; \
+    } \
+} while (0)
+
+#define W 320
+#define H 240
+#define FRAME_SIZE (W * H * 2)
+#define FRAMES 40
+
+/* Encrypted index layout: header and crypto header, then entry + seal */
+#define SEALED_INDEX_BASE   96
+#define SEALED_INDEX_RECORD 72
+
+/* Frame n: smooth gradient (compressible); every 10th is noise */
+static void make_frame(uint8_t *frame, uint32_t n)
+{
+    uint32_t i, x = n * 2654435761u + 1;
+
+    for (i = 0; i < FRAME_SIZE; i++) {
+        if (n % 10 == 9) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            frame[i] = (uint8_t)x;
+        } else {
+            frame[i] = (uint8_t)((i / 64 + n) & 0xff);
+        }
+    }
+}
+
+static int record(const dsv4l2_recorder_config_t *cfg, dsv4l2_recorder_stats_t *stats)
+{
+    dsv4l2_recorder_t *rec;
+    dsv4l2_pipeline_t *p;
+    dsv4l2_lease_t *lease;
+    uint32_t n;
+    int rc;
+
+    rc = dsv4l2_recorder_create(cfg, &rec);
+    if (rc < 0) {
+        return rc;
+    }
+
+    dsv4l2_pipeline_create(DSV4L2_BACKPRESSURE_BLOCK, &p);
+    dsv4l2_recorder_add_stages(rec, p);
+    dsv4l2_pipeline_start(p);
+
+    for (n = 0; n < FRAMES; n++) {
+        uint8_t *frame = malloc(FRAME_SIZE);
+
+        make_frame(frame, n);
+        dsv4l2_lease_wrap(frame, FRAME_SIZE, free, &lease);
+        lease->sequence = 1000 + n;
+        dsv4l2_pipeline_submit(p, lease);
+    }
+
+    dsv4l2_pipeline_stop(p);
+    dsv4l2_pipeline_destroy(p);
+
+    dsv4l2_recorder_get_stats(rec, stats);
+    return dsv4l2_recorder_close(rec);
+}
+
+/* Read every frame back in a scrambled order and compare */
+static int verify(const char *path, const uint8_t *key)
+{
+    dsv4l2_recording_t *rd;
+    dsv4l2_record_frame_t info;
+    uint8_t *expect = malloc(FRAME_SIZE);
+    uint8_t *got = malloc(FRAME_SIZE);
+    uint32_t i, n;
+    int ok = 1;
+
+    if (dsv4l2_recording_open(path, &rd) < 0) {
+        ok = 0;
+        goto out;
+    }
+
+    if (key && dsv4l2_recording_set_key(rd, key) < 0) {
+        ok = 0;
+    }
+
+    if (dsv4l2_recording_frames(rd) != FRAMES) {
+        ok = 0;
+    }
+
+    for (i = 0; i < FRAMES && ok; i++) {
+        n = (i * 17) % FRAMES;
+        make_frame(expect, n);
+        if (dsv4l2_recording_read(rd, n, got, FRAME_SIZE, &info) != FRAME_SIZE ||
+            info.sequence != 1000 + n || memcmp(expect, got, FRAME_SIZE) != 0) {
+            ok = 0;
+        }
+    }
+
+    dsv4l2_recording_close(rd);
+out:
+    free(expect);
+    free(got);
+    return ok;
+}
+
+static void test_raw(const char *path)
+{
+    dsv4l2_recorder_config_t cfg;
+    dsv4l2_recorder_stats_t stats;
+    dsv4l2_recording_t *rd;
+    dsv4l2_record_frame_t info;
+    uint8_t small[16];
+    uint32_t w, h, fmt;
+    char index_path[256];
+    int fd;
+
+    printf("\nTest: Uncompressed recording\n");
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.path = path;
+    cfg.width = W;
+    cfg.height = H;
+    cfg.pixelformat = V4L2_PIX_FMT_YUYV;
+
+    TEST_ASSERT(record(&cfg, &stats) == 0 && stats.frames == FRAMES, "Record frames");
+    TEST_ASSERT(stats.stored_bytes == (uint64_t)FRAMES * (FRAME_SIZE + 4), "Raw block per frame");
+    TEST_ASSERT(verify(path, NULL), "Random-order readback matches");
+
+    dsv4l2_recording_open(path, &rd);
+    dsv4l2_recording_format(rd, &w, &h, &fmt);
+    TEST_ASSERT(w == W && h == H && fmt == V4L2_PIX_FMT_YUYV, "Format in index header");
+    TEST_ASSERT(dsv4l2_recording_read(rd, 0, small, sizeof(small), NULL) == -ENOSPC,
+                "Small buffer rejected");
+    TEST_ASSERT(dsv4l2_recording_info(rd, FRAMES, &info) == -ERANGE, "Past the end rejected");
+    dsv4l2_recording_close(rd);
+
+    /* A torn index write leaves a partial record that must be ignored */
+    snprintf(index_path, sizeof(index_path), "%s.idx", path);
+    fd = open(index_path, O_WRONLY | O_APPEND);
+    if (write(fd, "torn!", 5) != 5) {
+        perror("write");
+    }
+    close(fd);
+
+    dsv4l2_recording_open(path, &rd);
+    TEST_ASSERT(dsv4l2_recording_frames(rd) == FRAMES, "Partial index record ignored");
+    dsv4l2_recording_close(rd);
+}
+
+static void test_codec(const char *path, dsv4l2_codec_t codec, const char *name)
+{
+    dsv4l2_recorder_config_t cfg;
+    dsv4l2_recorder_stats_t stats;
+    dsv4l2_recording_t *rd;
+    dsv4l2_record_frame_t info;
+    char msg[128];
+
+    printf("\nTest: %s recording\n", name);
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.path = path;
+    cfg.codec = codec;
+
+    if (!dsv4l2_codec_available(codec)) {
+        TEST_ASSERT(dsv4l2_recorder_create(&cfg, NULL) == -EINVAL &&
+                    record(&cfg, &stats) == -ENOTSUP, "Codec not compiled in: -ENOTSUP");
+        return;
+    }
+
+    cfg.blocks = 4;
+    cfg.workers = 2;
+    cfg.level_max = cfg.level_min = 1;
+
+    snprintf(msg, sizeof(msg), "%s: record and read back", name);
+    TEST_ASSERT(record(&cfg, &stats) == 0 && verify(path, NULL), msg);
+    TEST_ASSERT(stats.stored_bytes < stats.raw_bytes / 2, "Compressed below half size");
+    TEST_ASSERT(stats.level_ups == 0 && stats.level_downs == 0, "Pinned level stays");
+
+    dsv4l2_recording_open(path, &rd);
+    dsv4l2_recording_info(rd, 9, &info);
+    TEST_ASSERT(info.blocks == 4 && info.stored_len == FRAME_SIZE + 16,
+                "Incompressible frame stored raw");
+    dsv4l2_recording_close(rd);
+
+    /* A budget no codec can meet must push the level down */
+    cfg.level_min = 0;
+    cfg.level_max = 0;
+    cfg.level = 6;
+    cfg.fps = 1000000;
+    record(&cfg, &stats);
+    TEST_ASSERT(stats.level_downs > 0 && stats.level < 6, "Level lowered when over budget");
+}
+
+static void flip_byte(const char *path, off_t off)
+{
+    uint8_t b;
+    int fd = open(path, O_RDWR);
+
+    if (pread(fd, &b, 1, off) == 1) {
+        b ^= 0x01;
+        if (pwrite(fd, &b, 1, off) != 1) {
+            perror("pwrite");
+        }
+    }
+    close(fd);
+}
+
+/* Move index record from to position to, shifting the ones between */
+static void move_record(const char *index_path, int from, int to)
+{
+    uint8_t rec[SEALED_INDEX_RECORD], tmp[SEALED_INDEX_RECORD];
+    int fd = open(index_path, O_RDWR);
+    int step = from < to ? 1 : -1;
+    int i;
+
+    if (pread(fd, rec, sizeof(rec), SEALED_INDEX_BASE + from * SEALED_INDEX_RECORD) !=
+        (ssize_t)sizeof(rec)) {
+        perror("pread");
+    }
+    for (i = from; i != to; i += step) {
+        if (pread(fd, tmp, sizeof(tmp), SEALED_INDEX_BASE + (i + step) * SEALED_INDEX_RECORD) !=
+                (ssize_t)sizeof(tmp) ||
+            pwrite(fd, tmp, sizeof(tmp), SEALED_INDEX_BASE + i * SEALED_INDEX_RECORD) !=
+                (ssize_t)sizeof(tmp)) {
+            perror("pwrite");
+        }
+    }
+    if (pwrite(fd, rec, sizeof(rec), SEALED_INDEX_BASE + to * SEALED_INDEX_RECORD) !=
+        (ssize_t)sizeof(rec)) {
+        perror("pwrite");
+    }
+    close(fd);
+}
+
+static void test_cipher(const char *path, dsv4l2_cipher_t cipher, const char *name)
+{
+    static const uint8_t key[DSV4L2_RECORD_KEY_SIZE] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    static const uint8_t wrong[DSV4L2_RECORD_KEY_SIZE] = { 1, 2, 3, 4, 5, 6, 7, 9 };
+    dsv4l2_recorder_config_t cfg;
+    dsv4l2_recorder_stats_t stats;
+    dsv4l2_recorder_t *rec;
+    dsv4l2_recording_t *rd;
+    dsv4l2_record_frame_t info;
+    char index_path[256];
+    uint8_t *frame = malloc(FRAME_SIZE);
+    uint8_t *got = malloc(FRAME_SIZE);
+    uint8_t *data = malloc((size_t)FRAMES * (FRAME_SIZE + 4));
+    struct timespec a, b;
+    uint64_t ns;
+    ssize_t n;
+    int fd, i, leaked = 0;
+    char msg[128];
+
+    printf("\nTest: %s recording\n", name);
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.path = path;
+    cfg.cipher = cipher;
+    cfg.key = key;
+
+    if (!dsv4l2_cipher_available(cipher)) {
+        TEST_ASSERT(dsv4l2_recorder_create(&cfg, &rec) == -ENOTSUP, "Cipher not compiled in: -ENOTSUP");
+        goto out;
+    }
+
+    cfg.workers = 2;
+    snprintf(msg, sizeof(msg), "%s: record %d frames", name, FRAMES);
+    TEST_ASSERT(record(&cfg, &stats) == 0 && stats.frames == FRAMES, msg);
+
+    /* No plaintext in the data file */
+    fd = open(path, O_RDONLY);
+    n = read(fd, data, (size_t)FRAMES * (FRAME_SIZE + 4));
+    close(fd);
+    make_frame(frame, 0);
+    for (i = 0; n > 256 && i + 256 < n; i += 64) {
+        if (memcmp(data + i, frame + 256, 256) == 0) {
+            leaked = 1;
+        }
+    }
+    TEST_ASSERT(n > 0 && !leaked, "No plaintext in the data file");
+
+    dsv4l2_recording_open(path, &rd);
+    TEST_ASSERT(dsv4l2_recording_read(rd, 0, got, FRAME_SIZE, NULL) == -ENOKEY, "Read without key: -ENOKEY");
+    TEST_ASSERT(dsv4l2_recording_set_key(rd, wrong) == -EKEYREJECTED, "Wrong key rejected");
+    dsv4l2_recording_info(rd, 3, &info);
+    TEST_ASSERT(info.cipher == cipher && info.sequence == 1003, "Index readable without key");
+    dsv4l2_recording_close(rd);
+    TEST_ASSERT(verify(path, key), "Random-order readback with key");
+
+    /* Tampering with the data or the index fails authentication */
+    dsv4l2_recording_open(path, &rd);
+    dsv4l2_recording_set_key(rd, key);
+    dsv4l2_recording_info(rd, 5, &info);
+    flip_byte(path, (off_t)(5 * (FRAME_SIZE + 4) + 1000));
+    snprintf(index_path, sizeof(index_path), "%s.idx", path);
+    flip_byte(index_path, SEALED_INDEX_BASE + 7 * SEALED_INDEX_RECORD + 24);   /* Frame 7 sequence */
+    TEST_ASSERT(dsv4l2_recording_read(rd, 5, got, FRAME_SIZE, NULL) == -EBADMSG,
+                "Modified data: -EBADMSG");
+    TEST_ASSERT(dsv4l2_recording_read(rd, 7, got, FRAME_SIZE, NULL) == -EBADMSG,
+                "Modified index entry: -EBADMSG");
+    TEST_ASSERT(dsv4l2_recording_read(rd, 6, got, FRAME_SIZE, NULL) == FRAME_SIZE,
+                "Other frames unaffected");
+    dsv4l2_recording_close(rd);
+
+    /* Intact records moved to another index position, or dropped */
+    move_record(index_path, 1, 2);
+    dsv4l2_recording_open(path, &rd);
+    TEST_ASSERT(dsv4l2_recording_set_key(rd, key) == 0 &&
+                dsv4l2_recording_read(rd, 1, got, FRAME_SIZE, NULL) == -EBADMSG &&
+                dsv4l2_recording_read(rd, 2, got, FRAME_SIZE, NULL) == -EBADMSG,
+                "Swapped records: -EBADMSG");
+    dsv4l2_recording_close(rd);
+
+    move_record(index_path, 10, FRAMES - 1);
+    if (truncate(index_path, SEALED_INDEX_BASE + (FRAMES - 1) * SEALED_INDEX_RECORD) < 0) {
+        perror("truncate");
+    }
+    dsv4l2_recording_open(path, &rd);
+    TEST_ASSERT(dsv4l2_recording_set_key(rd, key) == -EBADMSG &&
+                dsv4l2_recording_frames(rd) == FRAMES - 1,
+                "Truncated index: frame count fails authentication");
+    TEST_ASSERT(dsv4l2_recording_read(rd, 10, got, FRAME_SIZE, NULL) == -EBADMSG &&
+                dsv4l2_recording_read(rd, 9, got, FRAME_SIZE, NULL) == FRAME_SIZE,
+                "Dropped record: later records fail, earlier ones read");
+    dsv4l2_recording_close(rd);
+
+    /* Direct sinks, and compression before encryption when available */
+    if (dsv4l2_codec_available(DSV4L2_CODEC_LZ4)) {
+        cfg.codec = DSV4L2_CODEC_LZ4;
+        cfg.blocks = 4;
+    }
+    dsv4l2_recorder_create(&cfg, &rec);
+    ns = 0;
+    for (i = 0; i < FRAMES; i++) {
+        make_frame(frame, (uint32_t)i);
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        if (i % 2) {
+            dsv4l2_store_encrypted(rec, frame, FRAME_SIZE, 1000 + (uint32_t)i, 0);
+        } else if (dsv4l2_encrypted_write(rec, frame, FRAME_SIZE) != FRAME_SIZE) {
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        ns += (uint64_t)(b.tv_sec - a.tv_sec) * 1000000000ULL + (uint64_t)(b.tv_nsec - a.tv_nsec);
+    }
+    dsv4l2_recorder_close(rec);
+    printf("  direct store: %.0f MB/s (one thread)\n",
+           (double)FRAMES * FRAME_SIZE / 1e6 / ((double)ns / 1e9));
+
+    dsv4l2_recording_open(path, &rd);
+    dsv4l2_recording_set_key(rd, key);
+    make_frame(frame, 9);
+    TEST_ASSERT(dsv4l2_recording_frames(rd) == FRAMES &&
+                dsv4l2_recording_read(rd, 9, got, FRAME_SIZE, &info) == FRAME_SIZE &&
+                memcmp(frame, got, FRAME_SIZE) == 0 && info.sequence == 1009,
+                "dsv4l2_store_encrypted / dsv4l2_encrypted_write round trip");
+    dsv4l2_recording_close(rd);
+
+out:
+    /* Plain recorders are not an encrypted sink */
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.path = path;
+    dsv4l2_recorder_create(&cfg, &rec);
+    TEST_ASSERT(dsv4l2_store_encrypted(rec, frame, 16, 0, 0) == -EPERM,
+                "Plain recorder refuses dsv4l2_store_encrypted");
+    dsv4l2_recorder_close(rec);
+
+    free(frame);
+    free(got);
+    free(data);
+}
+
+int main(void)
+{
+    dsv4l2rt_config_t config;
+    char path[] = "/tmp/dsv4l2_test_rec_XXXXXX";
+    char index_path[64];
+    int fd;
+
+    printf("DSV4L2 Recorder Tests\n");
+    printf("=====================\n");
+
+    memset(&config, 0, sizeof(config));
+    config.profile = DSV4L2_PROFILE_EXERCISE;
+    dsv4l2rt_init(&config);
+
+    fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    snprintf(index_path, sizeof(index_path), "%s.idx", path);
+
+    test_raw(path);
+    test_codec(path, DSV4L2_CODEC_LZ4, "LZ4");
+    test_codec(path, DSV4L2_CODEC_ZSTD, "Zstd");
+    test_cipher(path, DSV4L2_CIPHER_AES_256_GCM, "AES-256-GCM");
+    test_cipher(path, DSV4L2_CIPHER_CHACHA20_POLY1305, "ChaCha20-Poly1305");
+
+    unlink(path);
+    unlink(index_path);
+
+    dsv4l2rt_shutdown();
+
+    /* Print summary */
+    printf("\n=====================\n");
+    printf("Test Results:\n");
+    printf("  Passed: %d\n", tests_passed);
+    printf("  Failed: %d\n", tests_failed);
+    printf("  Total:  %d\n", tests_passed + tests_failed);
+
+    if (tests_failed > 0) {
+        printf("\nSome tests FAILED!\n");
+        return 1;
+    }
+
+    printf("\nAll tests PASSED!\n");
+    return 0;
+}
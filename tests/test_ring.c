@@ -0,0 +1,302 @@
+/*
+ * DSV4L2 Shared-Memory Ring Tests
+ *
+ * Test publishing, attaching by name, slow-consumer skipping,
+ * read-only sealing and cross-process delivery (no hardware required)
+ */
+
+#include "dsv4l2_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+/* Test result tracking */
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+#define TEST_ASSERT(cond, msg) do { \
+    if (cond) { \
+        printf("  [PASS] %s\n", msg); \
+        tests_passed++; \
+    } else { \
+        printf("  [FAIL] %s\n", msg); \
+        tests_failed++; \
+    } \
+} while (0)
+
+#define FRAME_SIZE 4096
+
+static char ring_name[64];
+
+static void fill_frame(uint8_t *frame, uint32_t n)
+{
+    memset(frame, (int)(n & 0xff), FRAME_SIZE);
+    memcpy(frame, &n, sizeof(n));
+}
+
+static int check_frame(const uint8_t *frame, uint32_t n)
+{
+    uint32_t got;
+
+    memcpy(&got, frame, sizeof(got));
+    return got == n && frame[FRAME_SIZE - 1] == (uint8_t)(n & 0xff);
+}
+
+/**
+ * Test argument validation and naming
+ */
+static void test_create(void)
+{
+    dsv4l2_ring_config_t cfg = { .slots = 4, .slot_size = FRAME_SIZE };
+    dsv4l2_ring_pub_t *pub, *dup;
+    dsv4l2_ring_sub_t *sub;
+
+    printf("\nTest: Ring creation\n");
+
+    TEST_ASSERT(dsv4l2_ring_create("bad/name", &cfg, &pub) == -EINVAL,
+                "Reject names with path characters");
+    TEST_ASSERT(dsv4l2_ring_create("", &cfg, &pub) == -EINVAL, "Reject empty name");
+    TEST_ASSERT(dsv4l2_ring_attach("dsv4l2-test-no-such-ring", &sub) == -ENOENT,
+                "Attach to missing ring fails");
+
+    TEST_ASSERT(dsv4l2_ring_create(ring_name, &cfg, &pub) == 0, "Create ring");
+    TEST_ASSERT(dsv4l2_ring_create(ring_name, &cfg, &dup) == -EADDRINUSE,
+                "Second ring with the same name rejected");
+    dsv4l2_ring_destroy(pub);
+
+    TEST_ASSERT(dsv4l2_ring_create(ring_name, &cfg, &pub) == 0,
+                "Name reusable after destroy");
+    dsv4l2_ring_destroy(pub);
+}
+
+/**
+ * Test in-process publish and read
+ */
+static void test_publish_read(void)
+{
+    dsv4l2_ring_config_t cfg = { .slots = 4, .slot_size = FRAME_SIZE,
+                                 .width = 64, .height = 64, .pixelformat = 0x56595559 };
+    dsv4l2_ring_config_t seen;
+    dsv4l2_ring_pub_t *pub;
+    dsv4l2_ring_sub_t *sub;
+    dsv4l2_ring_frame_t info;
+    dsv4l2_ring_stats_t stats;
+    uint8_t frame[FRAME_SIZE], out[FRAME_SIZE];
+    uint8_t *slot;
+    size_t cap;
+    uint32_t i;
+    int rc;
+
+    printf("\nTest: Publish and read\n");
+
+    dsv4l2_ring_create(ring_name, &cfg, &pub);
+    TEST_ASSERT(dsv4l2_ring_attach(ring_name, &sub) == 0, "Attach by name");
+    dsv4l2_ring_get_config(sub, &seen);
+    TEST_ASSERT(seen.slots == 4 && seen.slot_size == FRAME_SIZE && seen.width == 64 &&
+                seen.pixelformat == 0x56595559, "Consumer sees ring format");
+
+    TEST_ASSERT(dsv4l2_ring_read(sub, out, sizeof(out), &info, 0) == -EAGAIN,
+                "Empty ring returns -EAGAIN");
+    TEST_ASSERT(dsv4l2_ring_read(sub, out, sizeof(out), &info, 20) == -ETIMEDOUT,
+                "Read times out");
+
+    fill_frame(frame, 0);
+    dsv4l2_ring_publish(pub, frame, sizeof(frame), 100, 12345, 0);
+    rc = dsv4l2_ring_read(sub, out, sizeof(out), &info, 0);
+    TEST_ASSERT(rc == FRAME_SIZE && check_frame(out, 0), "Frame delivered intact");
+    TEST_ASSERT(info.seq == 0 && info.sequence == 100 && info.timestamp_ns == 12345 &&
+                info.missed == 0, "Frame info delivered");
+
+    TEST_ASSERT(dsv4l2_ring_publish(pub, frame, FRAME_SIZE + 1, 0, 0, 0) == -EMSGSIZE,
+                "Oversized frame rejected");
+
+    /* Zero-copy fill */
+    dsv4l2_ring_reserve(pub, &slot, &cap);
+    TEST_ASSERT(dsv4l2_ring_reserve(pub, &slot, &cap) == -EBUSY &&
+                dsv4l2_ring_publish(pub, frame, sizeof(frame), 0, 0, 0) == -EBUSY,
+                "Second reservation refused while one is outstanding");
+    fill_frame(slot, 1);
+    dsv4l2_ring_commit(pub, cap, 101, 0, 0);
+    TEST_ASSERT(dsv4l2_ring_read(sub, out, 16, &info, 0) == -ENOSPC && info.len == FRAME_SIZE,
+                "Short buffer reports the size needed");
+    rc = dsv4l2_ring_read(sub, out, sizeof(out), &info, 0);
+    TEST_ASSERT(rc == FRAME_SIZE && check_frame(out, 1), "Reserved slot delivered");
+
+    /* Slow consumer: 10 frames into a 4-slot ring */
+    for (i = 2; i < 12; i++) {
+        fill_frame(frame, i);
+        dsv4l2_ring_publish(pub, frame, sizeof(frame), i, 0, 0);
+    }
+    rc = dsv4l2_ring_read(sub, out, sizeof(out), &info, 0);
+    TEST_ASSERT(rc == FRAME_SIZE && info.seq == 9 && check_frame(out, 9),
+                "Slow consumer skipped to the oldest stable frame");
+    TEST_ASSERT(info.missed == 7 && dsv4l2_ring_missed(sub) == 7,
+                "Slow consumer told how many frames it missed");
+
+    dsv4l2_ring_get_stats(pub, &stats);
+    TEST_ASSERT(stats.published == 12 && stats.attaches == 1, "Publisher stats");
+
+    dsv4l2_ring_destroy(pub);
+    rc = dsv4l2_ring_read(sub, out, sizeof(out), &info, 0);
+    TEST_ASSERT(rc == FRAME_SIZE && info.seq == 10, "Remaining frames readable after close");
+    dsv4l2_ring_read(sub, out, sizeof(out), &info, 0);
+    TEST_ASSERT(dsv4l2_ring_read(sub, out, sizeof(out), &info, -1) == -EPIPE,
+                "Drained closed ring returns -EPIPE");
+    dsv4l2_ring_detach(sub);
+}
+
+/**
+ * Test that whoever holds the ring fd can only read it
+ */
+static void test_read_only(void)
+{
+    dsv4l2_ring_config_t cfg = { .slots = 4, .slot_size = FRAME_SIZE };
+    dsv4l2_ring_pub_t *pub;
+    dsv4l2_ring_sub_t *sub;
+    uint8_t frame[FRAME_SIZE], out[FRAME_SIZE];
+    char path[64];
+    void *map;
+    int fd, rw;
+
+    printf("\nTest: Consumers cannot write the ring\n");
+
+    TEST_ASSERT(dsv4l2_ring_create(NULL, &cfg, &pub) == 0, "Create private ring");
+    fd = dsv4l2_ring_fd(pub);
+
+    map = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    TEST_ASSERT(map == MAP_FAILED, "Writable shared mapping refused");
+    if (map != MAP_FAILED) {
+        munmap(map, 4096);
+    }
+
+    map = mmap(NULL, 4096, PROT_READ, MAP_SHARED, fd, 0);
+    TEST_ASSERT(map != MAP_FAILED && mprotect(map, 4096, PROT_READ | PROT_WRITE) != 0,
+                "Read-only mapping cannot be made writable");
+    if (map != MAP_FAILED) {
+        munmap(map, 4096);
+    }
+
+    memset(frame, 0xaa, sizeof(frame));
+    TEST_ASSERT(pwrite(fd, frame, 64, 0) < 0, "write() to the ring refused");
+    TEST_ASSERT(ftruncate(fd, 0) != 0, "Ring cannot be resized");
+
+    /* A fresh O_RDWR open of the same memfd is sealed just the same */
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    rw = open(path, O_RDWR);
+    map = rw >= 0 ? mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, rw, 0) : MAP_FAILED;
+    TEST_ASSERT(map == MAP_FAILED, "Reopened fd cannot map the ring writable");
+    if (map != MAP_FAILED) {
+        munmap(map, 4096);
+    }
+    if (rw >= 0) {
+        close(rw);
+    }
+
+    /* The producer's own mapping still publishes */
+    TEST_ASSERT(dsv4l2_ring_attach_fd(fd, &sub) == 0, "Attach from the sealed fd");
+    fill_frame(frame, 7);
+    dsv4l2_ring_publish(pub, frame, sizeof(frame), 7, 0, 0);
+    TEST_ASSERT(dsv4l2_ring_read(sub, out, sizeof(out), NULL, 0) == FRAME_SIZE &&
+                check_frame(out, 7), "Producer publishes through the sealed ring");
+
+    dsv4l2_ring_detach(sub);
+    dsv4l2_ring_destroy(pub);
+}
+
+/**
+ * Test delivery to another process
+ */
+static void test_cross_process(void)
+{
+    dsv4l2_ring_config_t cfg = { .slots = 64, .slot_size = FRAME_SIZE };
+    dsv4l2_ring_pub_t *pub;
+    uint8_t frame[FRAME_SIZE];
+    int pipefd[2], status = -1;
+    pid_t child;
+    uint32_t i;
+    char go;
+
+    printf("\nTest: Cross-process consumer\n");
+
+    dsv4l2_ring_create(ring_name, &cfg, &pub);
+    if (pipe(pipefd) != 0) {
+        TEST_ASSERT(0, "pipe");
+        return;
+    }
+
+    child = fork();
+    if (child == 0) {
+        dsv4l2_ring_sub_t *sub;
+        dsv4l2_ring_frame_t info;
+        uint8_t out[FRAME_SIZE];
+        uint32_t got = 0, bad = 0;
+
+        if (dsv4l2_ring_attach(ring_name, &sub) != 0) {
+            _exit(2);
+        }
+        go = 1;
+        if (write(pipefd[1], &go, 1) != 1) {
+            _exit(2);
+        }
+
+        /* Blocking reads until the publisher closes */
+        while (dsv4l2_ring_read(sub, out, sizeof(out), &info, 2000) == FRAME_SIZE) {
+            bad += !check_frame(out, (uint32_t)info.seq);
+            got++;
+        }
+        dsv4l2_ring_detach(sub);
+        _exit(bad == 0 && got > 0 ? 0 : 1);
+    }
+
+    TEST_ASSERT(read(pipefd[0], &go, 1) == 1, "Consumer process attached");
+
+    for (i = 0; i < 500; i++) {
+        fill_frame(frame, i);
+        dsv4l2_ring_publish(pub, frame, sizeof(frame), i, 0, 0);
+        if (i % 50 == 0) {
+            usleep(1000);
+        }
+    }
+    dsv4l2_ring_destroy(pub);
+
+    waitpid(child, &status, 0);
+    TEST_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+                "Consumer process read consistent frames until close");
+
+    close(pipefd[0]);
+    close(pipefd[1]);
+}
+
+int main(void)
+{
+    printf("DSV4L2 Shared-Memory Ring Tests\n");
+    printf("===============================\n");
+
+    snprintf(ring_name, sizeof(ring_name), "test-%d", (int)getpid());
+
+    test_create();
+    test_publish_read();
+    test_read_only();
+    test_cross_process();
+
+    /* Print summary */
+    printf("\n===============================\n");
+    printf("Test Results:\n");
+    printf("  Passed: %d\n", tests_passed);
+    printf("  Failed: %d\n", tests_failed);
+    printf("  Total:  %d\n", tests_passed + tests_failed);
+
+    if (tests_failed > 0) {
+        printf("\nSome tests FAILED!\n");
+        return 1;
+    }
+
+    printf("\nAll tests PASSED!\n");
+    return 0;
+}
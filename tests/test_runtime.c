@@ -11,6 +11,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
 
 /* Test result tracking */
 static int tests_passed = 0;
@@ -240,10 +241,122 @@ static void test_file_sink(void)
         TEST_ASSERT(count == 10, "Read 10 events from file");
     }
 
+    /* Read back through the event log reader */
+    {
+        dsv4l2_event_t *events = NULL;
+        size_t n = 0;
+
+        rc = dsv4l2rt_read_event_log(test_file, &events, &n);
+        TEST_ASSERT(rc == 0 && n == 10, "Event log reader returns 10 events");
+        if (rc == 0 && n == 10) {
+            TEST_ASSERT(events[9].aux == 9, "Event log preserves aux field");
+        }
+        free(events);
+    }
+
     /* Cleanup */
     unlink(test_file);
 }
 
+/**
+ * Test event log parsing of damaged input
+ */
+static void test_event_log_parse(void)
+{
+    dsv4l2_event_t evs[3];
+    dsv4l2_event_t *out = NULL;
+    size_t n = 0;
+    int rc;
+
+    printf("\n=== Testing Event Log Parser ===\n");
+
+    memset(evs, 'A', sizeof(evs));
+    for (int i = 0; i < 3; i++) {
+        evs[i].severity = DSV4L2_SEV_INFO;
+    }
+
+    /* Trailing partial record is ignored */
+    rc = dsv4l2rt_parse_event_log(evs, sizeof(evs) - 5, &out, &n);
+    TEST_ASSERT(rc == 0 && n == 2, "Partial trailing record ignored");
+    if (rc == 0 && n == 2) {
+        TEST_ASSERT(strlen(out[0].role) == sizeof(out[0].role) - 1,
+                    "Unterminated role is terminated");
+    }
+    free(out);
+
+    /* Invalid severity is rejected */
+    evs[1].severity = 0x7777;
+    rc = dsv4l2rt_parse_event_log(evs, sizeof(evs), &out, &n);
+    TEST_ASSERT(rc == -EBADMSG, "Invalid severity rejected");
+
+    rc = dsv4l2rt_parse_event_log(NULL, 0, &out, &n);
+    TEST_ASSERT(rc == 0 && n == 0, "Empty log parses to zero events");
+}
+
+/**
+ * Worker for tracing test: records nested spans on its own thread
+ */
+static void *trace_worker(void *arg)
+{
+    (void)arg;
+    for (int i = 0; i < 10; i++) {
+        DSV4L2_TRACE_BEGIN("worker_outer");
+        DSV4L2_TRACE_BEGIN("worker_inner");
+        DSV4L2_TRACE_END("worker_inner");
+        DSV4L2_TRACE_END("worker_outer");
+    }
+    return NULL;
+}
+
+/**
+ * Test span tracing and Chrome trace export
+ */
+static void test_tracing(void)
+{
+    const char *trace_file = "/tmp/dsv4l2_test_trace.json";
+    char json[65536];
+    pthread_t thread;
+    size_t len;
+    FILE *f;
+    int rc;
+
+    printf("\n=== Testing Tracing ===\n");
+
+    unlink(trace_file);
+
+    /* Disabled: macros record nothing */
+    DSV4L2_TRACE_BEGIN("never_recorded");
+    DSV4L2_TRACE_END("never_recorded");
+
+    rc = dsv4l2rt_trace_start(64);
+    TEST_ASSERT(rc == 0 && dsv4l2rt_trace_active, "Start tracing");
+
+    DSV4L2_TRACE_BEGIN("main_span");
+    pthread_create(&thread, NULL, trace_worker, NULL);
+    pthread_join(thread, NULL);
+    DSV4L2_TRACE_END("main_span");
+
+    dsv4l2rt_trace_stop();
+    TEST_ASSERT(!dsv4l2rt_trace_active, "Stop tracing");
+
+    rc = dsv4l2rt_trace_export(trace_file);
+    TEST_ASSERT(rc == 0, "Export Chrome trace JSON");
+
+    f = fopen(trace_file, "r");
+    len = f ? fread(json, 1, sizeof(json) - 1, f) : 0;
+    json[len] = '\0';
+    if (f) {
+        fclose(f);
+    }
+
+    TEST_ASSERT(strstr(json, "\"traceEvents\"") != NULL, "Trace has traceEvents array");
+    TEST_ASSERT(strstr(json, "\"main_span\"") != NULL, "Main thread span exported");
+    TEST_ASSERT(strstr(json, "\"worker_inner\"") != NULL, "Worker thread span exported");
+    TEST_ASSERT(strstr(json, "never_recorded") == NULL, "No spans recorded while disabled");
+
+    unlink(trace_file);
+}
+
 /**
  * Test TPM signed chunks
  */
@@ -353,6 +466,8 @@ int main(void)
     test_buffer_overflow();
     test_custom_sink();
     test_file_sink();
+    test_event_log_parse();
+    test_tracing();
     test_tpm_signing();
     test_statistics();
 
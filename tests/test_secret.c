@@ -0,0 +1,277 @@
+/*
+ * DSV4L2 Secret-Frame Arena Tests
+ *
+ * Check block bookkeeping, that frees and wipes really zeroize, and
+ * that the kernel reports the arena as locked, non-dumpable and wiped
+ * in forked children
+ */
+
+#define _GNU_SOURCE
+
+#include "dsv4l2_secret.h"
+#include "dsv4l2_imaging.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/wait.h>
+
+/* Test result tracking */
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+#define TEST_ASSERT(cond, msg) do { \
+    if (cond) { \
+        printf("  [PASS] %s\n", msg); \
+        tests_passed++; \
+    } else { \
+        printf("  [FAIL] %s\n", msg); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int all_zero(const uint8_t *p, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (p[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * VmFlags of the mapping that contains addr ("lo" = locked,
+ * "dd" = do not dump, "wf" = wipe on fork)
+ */
+static int vm_flags(const void *addr, char *flags, size_t cap)
+{
+    FILE *f = fopen("/proc/self/smaps", "r");
+    char line[512];
+    int inside = 0;
+
+    if (!f) {
+        return -errno;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long lo, hi;
+
+        if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2 && strchr(line, '-') < strchr(line, ' ')) {
+            inside = (uintptr_t)addr >= lo && (uintptr_t)addr < hi;
+        } else if (inside && strncmp(line, "VmFlags:", 8) == 0) {
+            snprintf(flags, cap, "%s", line + 8);
+            fclose(f);
+            return 0;
+        }
+    }
+
+    fclose(f);
+    return -ENOENT;
+}
+
+static int has_flag(const char *flags, const char *flag)
+{
+    char pattern[8];
+
+    snprintf(pattern, sizeof(pattern), " %s", flag);
+    return strstr(flags, pattern) != NULL;
+}
+
+static void test_blocks(void)
+{
+    dsv4l2_secret_arena_config_t cfg = { .block_size = 1000, .blocks = 4 };
+    dsv4l2_secret_arena_t *arena;
+    dsv4l2_secret_arena_stats_t stats;
+    void *blocks[4], *extra;
+    int i, ok;
+
+    printf("\nTest: Block bookkeeping\n");
+
+    TEST_ASSERT(dsv4l2_secret_arena_create(&cfg, &arena) == 0, "Create arena");
+    dsv4l2_secret_arena_get_stats(arena, &stats);
+    TEST_ASSERT(stats.blocks == 4 && stats.block_size == 1024, "Block size rounded to 64");
+
+    TEST_ASSERT(dsv4l2_secret_alloc(arena, 2000, &extra) == -EMSGSIZE, "Oversized allocation refused");
+
+    ok = 1;
+    for (i = 0; i < 4; i++) {
+        ok &= dsv4l2_secret_alloc(arena, 1000, &blocks[i]) == 0;
+        ok &= ((uintptr_t)blocks[i] & 63) == 0;
+    }
+    TEST_ASSERT(ok, "Four aligned blocks allocated");
+    TEST_ASSERT(dsv4l2_secret_alloc(arena, 10, &extra) == -EAGAIN, "Exhausted arena returns -EAGAIN");
+    TEST_ASSERT(dsv4l2_secret_arena_destroy(arena) == -EBUSY, "Destroy refused while blocks in use");
+
+    memset(blocks[1], 0xA5, 1000);
+    TEST_ASSERT(dsv4l2_secret_free(arena, blocks[1]) == 0, "Free block");
+    TEST_ASSERT(all_zero(blocks[1], 1000), "Freed block wiped");
+    TEST_ASSERT(dsv4l2_secret_free(arena, blocks[1]) == -EINVAL, "Double free rejected");
+    TEST_ASSERT(dsv4l2_secret_free(arena, (uint8_t *)blocks[2] + 8) == -EINVAL, "Interior pointer rejected");
+    TEST_ASSERT(dsv4l2_secret_free(arena, &cfg) == -EINVAL, "Foreign pointer rejected");
+
+    TEST_ASSERT(dsv4l2_secret_alloc(arena, 10, &extra) == 0 && extra == blocks[1], "Freed block reused");
+
+    dsv4l2_secret_arena_get_stats(arena, &stats);
+    TEST_ASSERT(stats.in_use == 4 && stats.peak == 4 && stats.allocs == 5 && stats.exhausted == 1,
+                "Stats track usage");
+
+    dsv4l2_secret_free(arena, extra);
+    for (i = 0; i < 4; i++) {
+        if (i != 1) {
+            dsv4l2_secret_free(arena, blocks[i]);
+        }
+    }
+    TEST_ASSERT(dsv4l2_secret_arena_destroy(arena) == 0, "Destroy arena");
+}
+
+static void test_wipe(void)
+{
+    static const size_t sizes[] = { 1, 63, 255, 4096, 4097, 65536 + 17, 1 << 20 };
+    static const dsv4l2_simd_level_t levels[] = {
+        DSV4L2_SIMD_SCALAR, DSV4L2_SIMD_SSE2, DSV4L2_SIMD_AVX2
+    };
+    dsv4l2_simd_level_t best = dsv4l2_simd_level();
+    uint8_t *buf = malloc((1 << 20) + 256);
+    size_t i, l, off;
+    int ok = 1;
+
+    printf("\nTest: Wipe\n");
+
+    for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        dsv4l2_simd_set_level(levels[l]);
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            for (off = 0; off < 3; off++) {
+                uint8_t *p = buf + 64 + off * 7;
+
+                memset(buf, 0x5A, (1 << 20) + 256);
+                dsv4l2_secret_wipe(p, sizes[i]);
+                ok &= all_zero(p, sizes[i]);
+                ok &= p[-1] == 0x5A && p[sizes[i]] == 0x5A;
+            }
+        }
+    }
+    dsv4l2_simd_set_level(best);
+    TEST_ASSERT(ok, "Wipe zeroizes exactly the range at every kernel level, size and alignment");
+
+    free(buf);
+}
+
+static void test_protection(void)
+{
+    dsv4l2_secret_arena_config_t cfg = { .block_size = 64 * 1024, .blocks = 4 };
+    dsv4l2_secret_arena_t *arena;
+    dsv4l2_secret_arena_stats_t stats;
+    char flags[512];
+    uint8_t *block;
+    pid_t pid;
+    int status;
+
+    printf("\nTest: Kernel protections\n");
+
+    if (dsv4l2_secret_arena_create(&cfg, &arena) < 0) {
+        TEST_ASSERT(0, "Create arena");
+        return;
+    }
+    dsv4l2_secret_arena_get_stats(arena, &stats);
+    dsv4l2_secret_alloc(arena, cfg.block_size, (void **)&block);
+
+    TEST_ASSERT(stats.dontdump, "MADV_DONTDUMP applied");
+    if (vm_flags(block, flags, sizeof(flags)) == 0) {
+        TEST_ASSERT(has_flag(flags, "dd"), "Kernel reports arena as non-dumpable");
+        if (stats.locked) {
+            TEST_ASSERT(has_flag(flags, "lo"), "Kernel reports arena as locked");
+        } else {
+            printf("  mlock refused (RLIMIT_MEMLOCK), skipping lock check\n");
+        }
+    } else {
+        printf("  No /proc/self/smaps, skipping VmFlags checks\n");
+    }
+
+    if (stats.wipeonfork) {
+        memset(block, 0xC3, cfg.block_size);
+        pid = fork();
+        if (pid == 0) {
+            _exit(all_zero(block, cfg.block_size) ? 0 : 1);
+        }
+        TEST_ASSERT(pid > 0 && waitpid(pid, &status, 0) == pid &&
+                    WIFEXITED(status) && WEXITSTATUS(status) == 0,
+                    "Forked child sees a zeroed arena");
+        TEST_ASSERT(block[0] == 0xC3, "Parent keeps its data");
+    } else {
+        printf("  MADV_WIPEONFORK not supported, skipping fork check\n");
+    }
+
+    dsv4l2_secret_free(arena, block);
+    dsv4l2_secret_arena_destroy(arena);
+}
+
+static void test_throughput(void)
+{
+    const size_t len = 640 * 480 * 2;
+    dsv4l2_secret_arena_config_t cfg = { .block_size = len, .blocks = 1 };
+    dsv4l2_secret_arena_t *arena;
+    uint64_t start, elapsed;
+    uint8_t *block;
+    int i, ok = 1;
+
+    printf("\nTest: Alloc/copy/free throughput\n");
+
+    if (dsv4l2_secret_arena_create(&cfg, &arena) < 0) {
+        TEST_ASSERT(0, "Create arena");
+        return;
+    }
+
+    start = now_ns();
+    for (i = 0; i < 200; i++) {
+        ok &= dsv4l2_secret_alloc(arena, len, (void **)&block) == 0;
+        memset(block, i, len);
+        ok &= dsv4l2_secret_free(arena, block) == 0;
+    }
+    elapsed = now_ns() - start;
+
+    TEST_ASSERT(ok, "200 frame cycles");
+    printf("  %.1f us per 600 KiB frame (fill + wipe), %.2f GB/s\n",
+           elapsed / 200 / 1000.0, 200.0 * len / (double)elapsed);
+
+    dsv4l2_secret_arena_destroy(arena);
+}
+
+int main(void)
+{
+    printf("DSV4L2 Secret-Frame Arena Tests\n");
+    printf("===============================\n");
+
+    test_blocks();
+    test_wipe();
+    test_protection();
+    test_throughput();
+
+    /* Print summary */
+    printf("\n===============================\n");
+    printf("Test Results:\n");
+    printf("  Passed: %d\n", tests_passed);
+    printf("  Failed: %d\n", tests_failed);
+    printf("  Total:  %d\n", tests_passed + tests_failed);
+
+    if (tests_failed > 0) {
+        printf("\nSome tests FAILED!\n");
+        return 1;
+    }
+
+    printf("\nAll tests PASSED!\n");
+    return 0;
+}